@@ -24,7 +24,7 @@ set(PCRE_CMAKE_ARGS
   -DPCRE2_BUILD_PCRE2_32:BOOL=OFF
   -DPCRE2_BUILD_PCRE2GREP:BOOL=OFF
   -DPCRE2_BUILD_TESTS:BOOL=OFF
-  -DPCRE2_SUPPORT_JIT:BOOL=OFF
+  -DPCRE2_SUPPORT_JIT:BOOL=${OPENELP_USE_PCRE_JIT}
   -DPCRE2_SUPPORT_LIBBZ2:BOOL=OFF
   -DPCRE2_SUPPORT_LIBEDIT:BOOL=OFF
   -DPCRE2_SUPPORT_LIBREADLINE:BOOL=OFF
@@ -0,0 +1,154 @@
+/*!
+ * @file admin.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Local administrative interface for inspecting and draining slots
+ */
+
+#ifndef _admin_h
+#define _admin_h
+
+#include "openelp/openelp.h"
+
+#include "conn.h"
+
+/*!
+ * @brief Represents an instance of the administrative interface
+ *
+ * When proxy_conf::admin_socket is set, the interface accepts connections on
+ * a local socket at that path. Each connection sends a single command line
+ * and receives a plain text reply, which ends with a line reading "OK" or
+ * starting with "ERROR". The commands are:
+ *
+ * - `slots` lists each slot with its state, address, callsign, time
+ *   connected and recent traffic rates
+ * - `status` summarizes the proxy as a whole
+ * - `drain [slot]` stops giving the slot, or the whole proxy, to new clients
+ * - `resume [slot]` undoes `drain`
+ * - `drop <slot>` disconnects the client using the slot
+ * - `trace [path]` writes the recent traffic of every slot to a pcapng file
+ *   at the path, or at proxy_conf::trace_file, using ::proxy_dump_trace
+ * - `help` lists the commands
+ * - `handoff` is sent by a new process taking over using ::admin_take_over,
+ *   and is answered with admin_handle::conn_clients. The connection stays
+ *   open, and the new process sends `ready` on it from ::admin_confirm once
+ *   it has started. Until then this process keeps accepting clients, and if
+ *   the connection closes first this process resumes serving as before.
+ *
+ * Slots are inspected with ::proxy_get_stats, so the interface never blocks
+ * the forwarding threads.
+ *
+ * This struct should be initialized to zero before being used. The private
+ * data should be initialized using the ::admin_init function, and
+ * subsequently freed by ::admin_free when the interface is no longer needed.
+ */
+struct admin_handle
+{
+	/// Private data - used internally by admin functions
+	void *priv;
+
+	/// Proxy instance to administer
+	struct proxy_handle *ph;
+
+	/// Listening connection of the proxy, which is handed off to a new
+	/// process or taken over from a previous one
+	struct conn_handle *conn_clients;
+};
+
+/*!
+ * @brief Tells the process which handed off that this one has started
+ *
+ * This must only be called after ::admin_take_over succeeded.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ */
+void admin_confirm(struct admin_handle *ah);
+
+/*!
+ * @brief Frees data allocated by ::admin_init
+ *
+ * @param[in,out] ah Target administrative interface instance
+ */
+void admin_free(struct admin_handle *ah);
+
+/*!
+ * @brief Initializes the private data in an ::admin_handle
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int admin_init(struct admin_handle *ah);
+
+/*!
+ * @brief Starts accepting commands as configured in admin_handle::ph
+ *
+ * If proxy_conf::admin_socket isn't set, this does nothing.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int admin_start(struct admin_handle *ah);
+
+/*!
+ * @brief Takes over admin_handle::conn_clients from the running process
+ *
+ * The process listening at proxy_conf::admin_socket hands off its listening
+ * connection and lists the addresses of the slots it is still using. Those
+ * slots are drained by ::admin_start and resumed as the running process
+ * releases them, or once it exits.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int admin_take_over(struct admin_handle *ah);
+
+/*!
+ * @brief Stops accepting commands and removes the socket
+ *
+ * @param[in,out] ah Target administrative interface instance
+ */
+void admin_stop(struct admin_handle *ah);
+
+#endif /* _admin_h */
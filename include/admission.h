@@ -0,0 +1,146 @@
+/*!
+ * @file admission.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for limiting the rate at which clients are admitted
+ */
+
+#ifndef _admission_h
+#define _admission_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * @brief Represents a table of recent connection attempts by source address
+ *
+ * Each address is given a token bucket which limits how often its
+ * connections are accepted, and a count of its recent authentication
+ * failures. Once an address has failed too many times, its connections are
+ * refused for a penalty period, which doubles with each further failure.
+ *
+ * The table has a fixed number of entries and never blocks. When every entry
+ * an address may use is taken by another address which is still active, the
+ * address is not tracked and its connections are admitted. All of the
+ * functions are safe to call from multiple threads at once.
+ *
+ * This struct should be initialized to zero before being used. The
+ * admission_handle::size field must be set before calling ::admission_init,
+ * and must not change until ::admission_free. The remaining fields may be
+ * changed at any time.
+ */
+struct admission_handle
+{
+	/// Private data - used internally by admission functions
+	void *priv;
+
+	/// Number of addresses which can be tracked at once, which must be a
+	/// power of two
+	size_t size;
+
+	/// Connections to accept from each address per second, or 0 for no limit
+	uint32_t rate;
+
+	/// Number of connections from an address which may be accepted in quick
+	/// succession before admission_handle::rate applies
+	uint32_t burst;
+
+	/// Number of authentication failures after which an address is refused,
+	/// or 0 to never refuse an address for failing
+	uint32_t max_failures;
+
+	/// Time in seconds that an address is first refused for
+	uint32_t penalty;
+};
+
+/*!
+ * @brief Decides whether to admit a connection from the given address
+ *
+ * If the connection is admitted, it is counted against the address's rate.
+ *
+ * @param[in,out] ah Target admission table instance
+ * @param[in] addr Null-terminated source address of the connection
+ *
+ * @returns 0 if the connection should be admitted, -EAGAIN if the address
+ *          has exceeded its rate, -EACCES if the address is being refused
+ *          for failing to authenticate
+ */
+int admission_check(struct admission_handle *ah, const char *addr);
+
+/*!
+ * @brief Records an authentication failure by the given address
+ *
+ * @param[in,out] ah Target admission table instance
+ * @param[in] addr Null-terminated source address of the client
+ *
+ * @returns Number of consecutive failures recorded for the address, or 0 if
+ *          the address could not be tracked
+ */
+uint32_t admission_fail(struct admission_handle *ah, const char *addr);
+
+/*!
+ * @brief Forgets the authentication failures of the given address
+ *
+ * This should be called once a client from the address has authenticated.
+ *
+ * @param[in,out] ah Target admission table instance
+ * @param[in] addr Null-terminated source address of the client
+ */
+void admission_forgive(struct admission_handle *ah, const char *addr);
+
+/*!
+ * @brief Frees data allocated by ::admission_init
+ *
+ * @param[in,out] ah Target admission table instance
+ */
+void admission_free(struct admission_handle *ah);
+
+/*!
+ * @brief Initializes the private data in a ::admission_handle
+ *
+ * @param[in,out] ah Target admission table instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int admission_init(struct admission_handle *ah);
+
+#endif /* _admission_h */
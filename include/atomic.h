@@ -0,0 +1,305 @@
+/*!
+ * @file atomic.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for atomic memory operations
+ */
+
+#ifndef _atomic_h
+#define _atomic_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#  include <windows.h>
+#endif
+
+/// Size of a cache line, which values updated by different threads should
+/// not share
+#define ATOMIC_CACHE_LINE 64
+
+/// Aligns a struct type to ::ATOMIC_CACHE_LINE, placed after the struct keyword
+#ifdef _MSC_VER
+#  define ATOMIC_ALIGNED __declspec(align(64))
+#else
+#  define ATOMIC_ALIGNED __attribute__((aligned(ATOMIC_CACHE_LINE)))
+#endif
+
+/*!
+ * @brief Atomically add to a 32-bit value
+ *
+ * @param[in,out] ptr Target value
+ * @param[in] val Value to add
+ *
+ * @returns The value before the addition
+ */
+static inline uint32_t atomic_u32_add(volatile uint32_t *ptr, uint32_t val);
+
+/*!
+ * @brief Atomically replace a 32-bit value if it matches an expected value
+ *
+ * @param[in,out] ptr Target value
+ * @param[in] expected Value which must be present for the exchange to occur
+ * @param[in] desired Value to store
+ *
+ * @returns Non-zero if the value was replaced, 0 otherwise
+ */
+static inline int atomic_u32_cas(volatile uint32_t *ptr, uint32_t expected, uint32_t desired);
+
+/*!
+ * @brief Atomically read a 32-bit value with acquire semantics
+ *
+ * @param[in] ptr Target value
+ *
+ * @returns Current value
+ */
+static inline uint32_t atomic_u32_load(const volatile uint32_t *ptr);
+
+/*!
+ * @brief Atomically write a 32-bit value with release semantics
+ *
+ * @param[out] ptr Target value
+ * @param[in] val New value
+ */
+static inline void atomic_u32_store(volatile uint32_t *ptr, uint32_t val);
+
+/*!
+ * @brief Atomically add to a 64-bit value
+ *
+ * @param[in,out] ptr Target value
+ * @param[in] val Value to add
+ *
+ * @returns The value before the addition
+ */
+static inline uint64_t atomic_u64_add(volatile uint64_t *ptr, uint64_t val);
+
+/*!
+ * @brief Atomically replace a 64-bit value if it matches an expected value
+ *
+ * @param[in,out] ptr Target value
+ * @param[in] expected Value which must be present for the exchange to occur
+ * @param[in] desired Value to store
+ *
+ * @returns Non-zero if the value was replaced, 0 otherwise
+ */
+static inline int atomic_u64_cas(volatile uint64_t *ptr, uint64_t expected, uint64_t desired);
+
+/*!
+ * @brief Atomically read a 64-bit value with acquire semantics
+ *
+ * @param[in] ptr Target value
+ *
+ * @returns Current value
+ */
+static inline uint64_t atomic_u64_load(const volatile uint64_t *ptr);
+
+/*!
+ * @brief Atomically replace a size value if it matches an expected value
+ *
+ * @param[in,out] ptr Target value
+ * @param[in] expected Value which must be present for the exchange to occur
+ * @param[in] desired Value to store
+ *
+ * @returns Non-zero if the value was replaced, 0 otherwise
+ */
+static inline int atomic_size_cas(volatile size_t *ptr, size_t expected, size_t desired);
+
+/*!
+ * @brief Atomically read a size value with acquire semantics
+ *
+ * @param[in] ptr Target value
+ *
+ * @returns Current value
+ */
+static inline size_t atomic_size_load(const volatile size_t *ptr);
+
+/*!
+ * @brief Atomically write a size value with release semantics
+ *
+ * @param[out] ptr Target value
+ * @param[in] val New value
+ */
+static inline void atomic_size_store(volatile size_t *ptr, size_t val);
+
+/*!
+ * @brief Issue a full memory barrier
+ *
+ * No loads or stores may be reordered across the barrier in either
+ * direction, including a store followed by a load.
+ */
+static inline void atomic_fence(void);
+
+#ifdef _MSC_VER
+
+static inline uint32_t atomic_u32_add(volatile uint32_t *ptr, uint32_t val)
+{
+	return (uint32_t)InterlockedExchangeAdd((volatile LONG *)ptr, (LONG)val);
+}
+
+static inline int atomic_u32_cas(volatile uint32_t *ptr, uint32_t expected, uint32_t desired)
+{
+	return InterlockedCompareExchange((volatile LONG *)ptr, (LONG)desired, (LONG)expected) == (LONG)expected;
+}
+
+static inline uint32_t atomic_u32_load(const volatile uint32_t *ptr)
+{
+	uint32_t val = *ptr;
+
+	_ReadWriteBarrier();
+
+	return val;
+}
+
+static inline void atomic_u32_store(volatile uint32_t *ptr, uint32_t val)
+{
+	_ReadWriteBarrier();
+
+	*ptr = val;
+}
+
+static inline uint64_t atomic_u64_add(volatile uint64_t *ptr, uint64_t val)
+{
+	return (uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)ptr, (LONG64)val);
+}
+
+static inline int atomic_u64_cas(volatile uint64_t *ptr, uint64_t expected, uint64_t desired)
+{
+	return InterlockedCompareExchange64((volatile LONG64 *)ptr, (LONG64)desired, (LONG64)expected) == (LONG64)expected;
+}
+
+static inline uint64_t atomic_u64_load(const volatile uint64_t *ptr)
+{
+	// A plain 64-bit read may tear on 32-bit targets
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)ptr, 0, 0);
+}
+
+static inline int atomic_size_cas(volatile size_t *ptr, size_t expected, size_t desired)
+{
+#  ifdef _WIN64
+	return InterlockedCompareExchange64((volatile LONG64 *)ptr, (LONG64)desired, (LONG64)expected) == (LONG64)expected;
+#  else
+	return InterlockedCompareExchange((volatile LONG *)ptr, (LONG)desired, (LONG)expected) == (LONG)expected;
+#  endif
+}
+
+static inline size_t atomic_size_load(const volatile size_t *ptr)
+{
+	size_t val = *ptr;
+
+	_ReadWriteBarrier();
+
+	return val;
+}
+
+static inline void atomic_size_store(volatile size_t *ptr, size_t val)
+{
+	_ReadWriteBarrier();
+
+	*ptr = val;
+}
+
+static inline void atomic_fence(void)
+{
+	MemoryBarrier();
+}
+
+#else
+
+static inline uint32_t atomic_u32_add(volatile uint32_t *ptr, uint32_t val)
+{
+	return __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_u32_cas(volatile uint32_t *ptr, uint32_t expected, uint32_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t atomic_u32_load(const volatile uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_u32_store(volatile uint32_t *ptr, uint32_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t atomic_u64_add(volatile uint64_t *ptr, uint64_t val)
+{
+	return __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_u64_cas(volatile uint64_t *ptr, uint64_t expected, uint64_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t atomic_u64_load(const volatile uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline int atomic_size_cas(volatile size_t *ptr, size_t expected, size_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static inline size_t atomic_size_load(const volatile size_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_size_store(volatile size_t *ptr, size_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline void atomic_fence(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+#endif /* _atomic_h */
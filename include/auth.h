@@ -0,0 +1,169 @@
+/*!
+ * @file auth.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for authenticating clients before they are given a slot
+ */
+
+#ifndef _auth_h
+#define _auth_h
+
+#include "admission.h"
+#include "conn.h"
+#include "conn_pool.h"
+
+#include <stdint.h>
+
+/*!
+ * @brief Represents an instance of the client authentication stage
+ *
+ * Connections accepted by the proxy are handed to ::auth_begin, which sends
+ * the nonce and then waits for the client's callsign and password response
+ * without blocking the caller. Once a client has supplied the correct
+ * password and its callsign is authorized, auth_handle::func_ptr is called
+ * with the connection. Clients which fail, or which have not finished
+ * authenticating within a few seconds, are dropped by the authentication stage
+ * itself, and so never consume a proxy client slot.
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::auth_init function, and subsequently freed
+ * by ::auth_free when the authentication stage is no longer needed.
+ */
+struct auth_handle
+{
+	/// Private data - used internally by auth functions
+	void *priv;
+
+	/// Reference to the parent proxy instance handle
+	struct proxy_handle *ph;
+
+	/// Pool to return dropped client connections to
+	struct conn_pool_handle *conn_pool;
+
+	/// Maximum number of clients which may be authenticating at once
+	unsigned int max_pending;
+
+	/*!
+	 * @brief Function called with each client which has been authorized
+	 *
+	 * The function takes ownership of the connection.
+	 */
+	void (*func_ptr)(struct auth_handle *ah, struct conn_handle *conn_client, const char *callsign);
+
+	/// Context to pass to auth_handle::func_ptr
+	void *func_ctx;
+
+	/// Table to record the outcome of each authentication in, or NULL
+	struct admission_handle *admission;
+};
+
+/*!
+ * @brief Begin authenticating a newly accepted client
+ *
+ * If auth_handle::max_pending clients are already authenticating, the one
+ * which has been waiting the longest is dropped to make room.
+ *
+ * This function may be called from several threads at once.
+ *
+ * @param[in,out] ah Target authentication stage instance
+ * @param[in] conn_client Connection to a client, which was taken from
+ *            auth_handle::conn_pool
+ *
+ * @returns 0 on success, in which case ownership of conn_client is
+ *          transferred to the authentication stage, negative ERRNO value on
+ *          failure
+ */
+int auth_begin(struct auth_handle *ah, struct conn_handle *conn_client);
+
+/*!
+ * @brief Drops all of the clients which are currently authenticating
+ *
+ * @param[in,out] ah Target authentication stage instance
+ */
+void auth_drop(struct auth_handle *ah);
+
+/*!
+ * @brief Frees data allocated by ::auth_init
+ *
+ * @param[in,out] ah Target authentication stage instance
+ */
+void auth_free(struct auth_handle *ah);
+
+/*!
+ * @brief Gets the number of clients which did not authenticate successfully
+ *
+ * Clients which were rejected, which sent a malformed response, which took
+ * too long or which were evicted to make room are all counted.
+ *
+ * @param[in] ah Target authentication stage instance
+ *
+ * @returns Number of failures since ::auth_init
+ */
+uint64_t auth_get_failures(struct auth_handle *ah);
+
+/*!
+ * @brief Initializes the private data in a ::auth_handle
+ *
+ * @param[in,out] ah Target authentication stage instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int auth_init(struct auth_handle *ah);
+
+/*!
+ * @brief Starts processing responses from clients
+ *
+ * @param[in,out] ah Target authentication stage instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int auth_start(struct auth_handle *ah);
+
+/*!
+ * @brief Stops processing responses from clients and drops any clients which
+ *        are still authenticating
+ *
+ * @param[in,out] ah Target authentication stage instance
+ */
+void auth_stop(struct auth_handle *ah);
+
+#endif /* _auth_h */
@@ -0,0 +1,119 @@
+/*!
+ * @file callsign_cache.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for caching callsign authorization decisions
+ */
+
+#ifndef _callsign_cache_h
+#define _callsign_cache_h
+
+#include <stddef.h>
+
+/*!
+ * @brief Represents a small cache of recent callsign authorization decisions
+ *
+ * When the cache is full, the least recently used decision is replaced.
+ * All of the functions are safe to call from multiple threads at once.
+ *
+ * This struct should be initialized to zero before being used. The
+ * callsign_cache_handle::size field must be set before calling
+ * ::callsign_cache_init, and must not change until ::callsign_cache_free.
+ */
+struct callsign_cache_handle
+{
+	/// Private data - used internally by callsign_cache functions
+	void *priv;
+
+	/// Maximum number of decisions to remember
+	size_t size;
+};
+
+/*!
+ * @brief Forgets every decision in the cache
+ *
+ * This should be called whenever the rules the decisions were based on
+ * change.
+ *
+ * @param[in,out] cache Target callsign cache instance
+ */
+void callsign_cache_clear(struct callsign_cache_handle *cache);
+
+/*!
+ * @brief Frees data allocated by ::callsign_cache_init
+ *
+ * @param[in,out] cache Target callsign cache instance
+ */
+void callsign_cache_free(struct callsign_cache_handle *cache);
+
+/*!
+ * @brief Looks up the decision made for a callsign
+ *
+ * @param[in,out] cache Target callsign cache instance
+ * @param[in] callsign Null-terminated callsign to look up
+ *
+ * @returns 1 if the callsign was authorized, 0 if it was not, -ENOENT if
+ *          there is no decision for the callsign in the cache
+ */
+int callsign_cache_get(struct callsign_cache_handle *cache, const char *callsign);
+
+/*!
+ * @brief Initializes the private data in a ::callsign_cache_handle
+ *
+ * @param[in,out] cache Target callsign cache instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int callsign_cache_init(struct callsign_cache_handle *cache);
+
+/*!
+ * @brief Remembers the decision made for a callsign
+ *
+ * Callsigns which are too long to have come from a client are not cached.
+ *
+ * @param[in,out] cache Target callsign cache instance
+ * @param[in] callsign Null-terminated callsign the decision was made for
+ * @param[in] authorized 1 if the callsign was authorized, 0 if not
+ */
+void callsign_cache_put(struct callsign_cache_handle *cache, const char *callsign, int authorized);
+
+#endif /* _callsign_cache_h */
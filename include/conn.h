@@ -47,12 +47,22 @@
 #ifndef _conn_h
 #define _conn_h
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef _WIN32
 #  include <unistd.h>
 #endif
 
+/// Maximum number of datagrams handled by a single batched operation
+#define CONN_BATCH_MAX 32
+
+/// Maximum number of buffers handled by a single scatter-gather operation
+#define CONN_IOV_MAX 16
+
+/// Maximum number of addresses accepted by ::conn_filter_sources
+#define CONN_FILTER_MAX 64
+
 /*!
  * @brief Supported connection protocols
  */
@@ -63,6 +73,10 @@ enum CONN_TYPE
 
 	/// User Datagram Protocol
 	CONN_TYPE_UDP,
+
+	/// Stream socket in the local file system, whose path is given by
+	/// conn_handle::source_addr
+	CONN_TYPE_LOCAL,
 };
 
 /*!
@@ -85,6 +99,103 @@ struct conn_handle
 
 	/// Protocol to use for this connection
 	enum CONN_TYPE type;
+
+	/// Maximum time in milliseconds for ::conn_connect to wait for the remote
+	/// host to respond, or 0 to wait as long as the system does
+	uint32_t connect_timeout;
+
+	/// Flag which makes ::conn_connect give up when it is non-zero, or NULL
+	/// for none. The flag is checked once the attempt's socket exists, so an
+	/// attempt is never left running after the flag is set and
+	/// ::conn_shutdown or ::conn_close is then called.
+	volatile uint32_t *connect_cancel;
+
+	/// Maximum number of connections for ::conn_listen to queue before they
+	/// are accepted, or 0 for the system maximum
+	int backlog;
+
+	/// Non-zero for ::conn_listen to share the port with other connections
+	/// which also set this, with the system spreading incoming connections
+	/// between them
+	uint8_t reuse_port;
+
+	/// Non-zero once the socket has been sent to another process using
+	/// ::conn_send_socket, or received from one using ::conn_recv_socket, so
+	/// that ::conn_shutdown and ::conn_close leave it usable by that process
+	uint8_t shared;
+};
+
+/*!
+ * @brief Socket options to apply to a connection using ::conn_set_sockopts
+ *
+ * Members which are zero leave the system default in place.
+ */
+struct conn_sockopts
+{
+	/// Size of the socket receive buffer in bytes
+	int rcvbuf;
+
+	/// Size of the socket send buffer in bytes
+	int sndbuf;
+
+	/// Differentiated services code point to mark outgoing packets with
+	uint8_t dscp;
+
+	/// Non-zero to send TCP data immediately instead of combining small
+	/// segments
+	uint8_t nodelay;
+
+	/// Non-zero to acknowledge received TCP data immediately instead of
+	/// delaying the acknowledgement, where supported
+	uint8_t quickack;
+};
+
+/*!
+ * @brief Remote socket address which is converted for the socket API once, so
+ *        that it can be used repeatedly without any conversion or name lookup
+ *
+ * Prepared by ::conn_peer_ipv4 or ::conn_peer_ipv6.
+ */
+struct conn_peer
+{
+	/// Socket address - used internally by conn functions
+	uint64_t storage[4];
+
+	/// Number of bytes of conn_peer::storage in use
+	uint32_t len;
+};
+
+/*!
+ * @brief Describes a single datagram in a batched operation
+ */
+struct conn_dgram
+{
+	/// Buffer holding the datagram's payload
+	uint8_t *buff;
+
+	/// Number of bytes which can be received into conn_dgram::buff
+	size_t buff_len;
+
+	/// Number of bytes in conn_dgram::buff to send, or that were received
+	size_t len;
+
+	/// Remote address, in network byte order
+	uint32_t addr;
+
+	/// Remote port
+	uint16_t port;
+};
+
+/*!
+ * @brief Describes a single buffer in a scatter-gather operation
+ */
+struct conn_iov
+{
+	/// Buffer holding the data
+	const uint8_t *buff;
+
+	/// Number of bytes in conn_iov::buff
+	size_t len;
 };
 
 /*!
@@ -107,14 +218,45 @@ void conn_close(struct conn_handle *conn);
 /*!
  * @brief Opens a connection to a remote socket
  *
+ * A concurrent call to ::conn_close or ::conn_shutdown cancels the attempt,
+ * as does conn_handle::connect_cancel.
+ * For ::CONN_TYPE_LOCAL connections, addr is the path to the listening
+ * socket and port is unused.
+ *
  * @param[in,out] conn Target network connection instance
  * @param[in] addr Address of listening network host
  * @param[in] port Socket port on listening network host
  *
- * @returns 0 on success, negative ERRNO value on failure
+ * @returns 0 on success, -ETIMEDOUT if conn_handle::connect_timeout elapsed,
+ *          other negative ERRNO value on failure
  */
 int conn_connect(struct conn_handle *conn, const char *addr, const char *port);
 
+/*!
+ * @brief Like ::conn_connect, but to an address which is already resolved
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] addr IPv4 address of listening network host
+ * @param[in] port Socket port on listening network host
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_connect_to(struct conn_handle *conn, uint32_t addr, uint16_t port);
+
+/*!
+ * @brief Like ::conn_connect, but to a prepared address
+ *
+ * If conn_handle::source_addr is numeric, no name lookup is performed.
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] peer Address of listening network host
+ *
+ * @returns 0 on success, -ETIMEDOUT if conn_handle::connect_timeout elapsed,
+ *          -ECANCELED if conn_handle::connect_cancel was set, other negative
+ *          ERRNO value on failure
+ */
+int conn_connect_peer(struct conn_handle *conn, const struct conn_peer *peer);
+
 /*!
  * @brief Drops any active connections but doesn't close the connection
  *
@@ -122,6 +264,25 @@ int conn_connect(struct conn_handle *conn, const char *addr, const char *port);
  */
 void conn_drop(struct conn_handle *conn);
 
+/*!
+ * @brief Asks the operating system to discard datagrams arriving on a UDP
+ *        connection unless they are from one of the given hosts
+ *
+ * This is only supported for IPv4 connections on Linux, where the filter is
+ * attached to the socket and datagrams from other hosts are discarded without
+ * waking any receiver. The filter is replaced by each call, and is removed
+ * when the connection is closed.
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] addrs IPv4 addresses to accept datagrams from, in network byte
+ *            order, or NULL to remove the filter
+ * @param[in] count Number of addresses in addrs, at most ::CONN_FILTER_MAX
+ *
+ * @returns 0 on success, -ENOTSUP if filtering is not supported, other
+ *          negative ERRNO value on failure
+ */
+int conn_filter_sources(struct conn_handle *conn, const uint32_t *addrs, unsigned int count);
+
 /*!
  * @brief Frees data allocated by ::conn_init
  *
@@ -129,6 +290,15 @@ void conn_drop(struct conn_handle *conn);
  */
 void conn_free(struct conn_handle *conn);
 
+/*!
+ * @brief Gets the native socket descriptor used for transmission
+ *
+ * @param[in] conn Target network connection instance
+ *
+ * @returns Native socket descriptor, or -1 if the connection is not open
+ */
+intptr_t conn_get_fd(struct conn_handle *conn);
+
 /*!
  * @brief Initializes the private data in a ::conn_handle
  *
@@ -152,10 +322,69 @@ int conn_in_use(struct conn_handle *conn);
  *
  * @param[in,out] conn Target network connection instance
  *
- * @returns 0 on success, negative ERRNO value on failure
+ * @returns 0 on success, -ENOTSUP if conn_handle::reuse_port is set but the
+ *          platform can't spread connections between listeners, other
+ *          negative ERRNO value on failure
  */
 int conn_listen(struct conn_handle *conn);
 
+/*!
+ * @brief Prepares an IPv4 socket address for repeated use
+ *
+ * @param[out] peer Resulting address
+ * @param[in] addr IPv4 address, in network byte order
+ * @param[in] port Socket port
+ */
+void conn_peer_ipv4(struct conn_peer *peer, uint32_t addr, uint16_t port);
+
+/*!
+ * @brief Prepares an IPv6 socket address for repeated use
+ *
+ * @param[out] peer Resulting address
+ * @param[in] addr IPv6 address, in network byte order
+ * @param[in] port Socket port
+ */
+void conn_peer_ipv6(struct conn_peer *peer, const uint8_t addr[16], uint16_t port);
+
+/*!
+ * @brief Waits for data to become available to receive
+ *
+ * The timeout is rounded up to the resolution supported by the platform,
+ * which may be as coarse as a millisecond.
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] timeout_us Maximum time to wait in microseconds, or zero to
+ *            return immediately
+ *
+ * @returns 1 if data is available, 0 on timeout, negative ERRNO value on
+ *          failure
+ */
+int conn_poll(struct conn_handle *conn, uint32_t timeout_us);
+
+/*!
+ * @brief Like ::conn_poll, but waits for space to send more data
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] timeout_us Maximum time to wait in microseconds, or zero to
+ *            return immediately
+ *
+ * @returns 1 if data can be sent, 0 on timeout, negative ERRNO value on
+ *          failure
+ */
+int conn_poll_send(struct conn_handle *conn, uint32_t timeout_us);
+
+/*!
+ * @brief Looks up the IPv4 address of a network host
+ *
+ * This blocks for as long as the name lookup takes.
+ *
+ * @param[in] addr Name or address of the network host
+ * @param[out] result Resulting IPv4 address, suitable for ::conn_connect_to
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_resolve(const char *addr, uint32_t *result);
+
 /*!
  * @brief Copies data which has been transferred to the connection
  *
@@ -167,6 +396,34 @@ int conn_listen(struct conn_handle *conn);
  */
 int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len);
 
+/*!
+ * @brief Like ::conn_recv, but returns as soon as any data has been copied
+ *
+ * @param[in] conn Target network connection instance
+ * @param[out] buff Buffer to copy received into
+ * @param[in] buff_len Maximum number of bytes of data to read
+ *
+ * @returns Number of bytes copied on success, negative ERRNO value on failure
+ */
+int conn_recv_some(struct conn_handle *conn, uint8_t *buff, size_t buff_len);
+
+/*!
+ * @brief Like ::conn_recv_some, but also receives a socket sent using
+ *        ::conn_send_socket
+ *
+ * This is only supported for ::CONN_TYPE_LOCAL connections on POSIX
+ * systems.
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in,out] received Closed connection instance to take the socket
+ * @param[out] buff Buffer to copy the data sent along with the socket into
+ * @param[in] buff_len Maximum number of bytes of data to read
+ *
+ * @returns Number of bytes copied on success, -EBADMSG if no socket came
+ *          with the data, other negative ERRNO value on failure
+ */
+int conn_recv_socket(struct conn_handle *conn, struct conn_handle *received, uint8_t *buff, size_t buff_len);
+
 /*!
  * @brief Like ::conn_recv, but for any client and any amount of data
  *
@@ -180,6 +437,21 @@ int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len);
  */
 int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len, uint32_t *addr, uint16_t *port);
 
+/*!
+ * @brief Like ::conn_recv_any, but receives multiple datagrams at once
+ *
+ * Only the first datagram is waited for. Any additional datagrams are
+ * received only if they are already available.
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in,out] dgrams Array of datagrams to receive into
+ * @param[in] count Number of datagrams in dgrams, at most ::CONN_BATCH_MAX
+ *
+ * @returns Number of datagrams received on success, negative ERRNO value on
+ *          failure
+ */
+int conn_recv_any_batch(struct conn_handle *conn, struct conn_dgram *dgrams, unsigned int count);
+
 /*!
  * @brief Send data to the connected client
  *
@@ -191,6 +463,48 @@ int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len, uint
  */
 int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len);
 
+/*!
+ * @brief Like ::conn_send, but returns as soon as any data has been sent
+ *
+ * On a non-blocking connection, this returns -EAGAIN or -EWOULDBLOCK without
+ * sending anything if the socket's send buffer is full.
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] buff Buffer containing data to be sent
+ * @param[in] buff_len Number of bytes in buff to send
+ *
+ * @returns Number of bytes sent on success, negative ERRNO value on failure
+ */
+int conn_send_some(struct conn_handle *conn, const uint8_t *buff, size_t buff_len);
+
+/*!
+ * @brief Like ::conn_send, but gathers the data from multiple buffers
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] iov Array of buffers to send, in order
+ * @param[in] count Number of buffers in iov, at most ::CONN_IOV_MAX
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_sendv(struct conn_handle *conn, const struct conn_iov *iov, unsigned int count);
+
+/*!
+ * @brief Like ::conn_send, but also sends a copy of another socket
+ *
+ * The other process receives the socket using ::conn_recv_socket, after
+ * which both processes share it and conn_handle::shared is set on sent.
+ * This is only supported for ::CONN_TYPE_LOCAL connections on POSIX
+ * systems.
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] sent Open connection instance whose socket is sent
+ * @param[in] buff Buffer containing at least one byte to send along with it
+ * @param[in] buff_len Number of bytes in buff to send
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_send_socket(struct conn_handle *conn, struct conn_handle *sent, const uint8_t *buff, size_t buff_len);
+
 /*!
  * @brief Like ::conn_send, but to a specified, unconnected client
  *
@@ -204,6 +518,70 @@ int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len);
  */
 int conn_send_to(struct conn_handle *conn, const uint8_t *buff, size_t buff_len, uint32_t addr, uint16_t port);
 
+/*!
+ * @brief Like ::conn_send_to, but to a prepared address
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] buff Data to send
+ * @param[in] buff_len Number of bytes in buff
+ * @param[in] peer Remote address to send the data to
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_send_peer(struct conn_handle *conn, const uint8_t *buff, size_t buff_len, const struct conn_peer *peer);
+
+/*!
+ * @brief Like ::conn_send_to, but gathers the datagram from multiple buffers
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] iov Array of buffers making up the datagram, in order
+ * @param[in] count Number of buffers in iov, at most ::CONN_IOV_MAX
+ * @param[in] addr Remote address of listening client
+ * @param[in] port Remote port on listening client
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_send_tov(struct conn_handle *conn, const struct conn_iov *iov, unsigned int count, uint32_t addr, uint16_t port);
+
+/*!
+ * @brief Like ::conn_send_to, but sends multiple datagrams at once
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] dgrams Array of datagrams to send
+ * @param[in] count Number of datagrams in dgrams, at most ::CONN_BATCH_MAX
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_send_to_batch(struct conn_handle *conn, const struct conn_dgram *dgrams, unsigned int count);
+
+/*!
+ * @brief Changes whether operations on the connection block
+ *
+ * When non-blocking, ::conn_recv_any returns -EAGAIN if no data is available,
+ * and ::conn_send_to returns -EAGAIN if the data cannot be queued immediately.
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] nonblocking Non-zero to make operations non-blocking, zero to
+ *            make them block
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_set_nonblocking(struct conn_handle *conn, int nonblocking);
+
+/*!
+ * @brief Applies socket options to an open connection
+ *
+ * The TCP options are ignored for UDP connections. The immediate
+ * acknowledgement option is only supported on Linux, where the system may
+ * stop honoring it after some time.
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] opts Options to apply
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_set_sockopts(struct conn_handle *conn, const struct conn_sockopts *opts);
+
 /*!
  * @brief Stops socket operations but does not close the socket
  *
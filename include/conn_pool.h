@@ -0,0 +1,112 @@
+/*!
+ * @file conn_pool.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for preallocated pools of network connections
+ */
+
+#ifndef _conn_pool_h
+#define _conn_pool_h
+
+#include "conn.h"
+
+#include <stddef.h>
+
+/*!
+ * @brief Represents a fixed-size pool of initialized network connections
+ *
+ * All of the connections are allocated and initialized by ::conn_pool_init,
+ * so that taking a connection from the pool and returning it to the pool
+ * never allocates memory or takes a lock.
+ *
+ * This struct should be initialized to zero before being used. The
+ * conn_pool_handle::size field must be set before calling ::conn_pool_init,
+ * and must not change until ::conn_pool_free.
+ */
+struct conn_pool_handle
+{
+	/// Private data - used internally by conn_pool functions
+	void *priv;
+
+	/// Number of connections in the pool
+	size_t size;
+};
+
+/*!
+ * @brief Frees data allocated by ::conn_pool_init
+ *
+ * All connections must have been returned to the pool.
+ *
+ * @param[in,out] pool Target connection pool instance
+ */
+void conn_pool_free(struct conn_pool_handle *pool);
+
+/*!
+ * @brief Takes an unused connection from the pool
+ *
+ * @param[in,out] pool Target connection pool instance
+ *
+ * @returns Closed, initialized ::CONN_TYPE_TCP connection, or NULL if every
+ *          connection in the pool is in use
+ */
+struct conn_handle * conn_pool_get(struct conn_pool_handle *pool);
+
+/*!
+ * @brief Initializes the private data in a ::conn_pool_handle
+ *
+ * @param[in,out] pool Target connection pool instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_pool_init(struct conn_pool_handle *pool);
+
+/*!
+ * @brief Returns a connection taken by ::conn_pool_get to the pool
+ *
+ * The connection must already be closed.
+ *
+ * @param[in,out] pool Target connection pool instance
+ * @param[in] conn Connection to return
+ */
+void conn_pool_put(struct conn_pool_handle *pool, struct conn_handle *conn);
+
+#endif /* _conn_pool_h */
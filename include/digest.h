@@ -47,6 +47,8 @@
 #ifndef _digest_h
 #define _digest_h
 
+#include "md5.h"
+
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -56,6 +58,28 @@
 /// Length in bytes of all digests
 #define DIGEST_LEN 16
 
+/*!
+ * @brief Digest state which has already consumed a proxy password
+ *
+ * This is initialized once by ::digest_password_init, and can then be used to
+ * respond to any number of nonces without digesting the password again.
+ */
+struct digest_password
+{
+	/// MD5 state after the normalized password
+	MD5_CTX ctx;
+};
+
+/*!
+ * @brief Compares two digests in constant time
+ *
+ * @param[in] a First digest value
+ * @param[in] b Second digest value
+ *
+ * @returns 1 if the digests are equal, 0 otherwise
+ */
+int digest_equal(const uint8_t a[DIGEST_LEN], const uint8_t b[DIGEST_LEN]);
+
 /*!
  * @brief Calculates the digest of the given data
  *
@@ -65,6 +89,26 @@
  */
 void digest_get(const uint8_t *data, const unsigned int len, uint8_t result[DIGEST_LEN]);
 
+/*!
+ * @brief Digests a proxy password in preparation for responding to nonces
+ *
+ * The password is converted to uppercase as it is digested. No memory is
+ * allocated, regardless of the length of the password.
+ *
+ * @param[out] dp Target password digest state
+ * @param[in] password Null-terminated password
+ */
+void digest_password_init(struct digest_password *dp, const char *password);
+
+/*!
+ * @brief Calculates the expected response to a nonce
+ *
+ * @param[in] dp Password digest state prepared by ::digest_password_init
+ * @param[in] nonce Nonce value sent to the client
+ * @param[out] result Resulting digest value
+ */
+void digest_password_response(const struct digest_password *dp, const uint32_t nonce, uint8_t result[DIGEST_LEN]);
+
 /*!
  * @brief Converts a 32-bit value to a base 16 string
  *
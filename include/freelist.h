@@ -0,0 +1,111 @@
+/*!
+ * @file freelist.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for lock-free lists of free indices
+ */
+
+#ifndef _freelist_h
+#define _freelist_h
+
+#include <stdint.h>
+
+/*!
+ * @brief Represents an instance of a lock-free list of unused indices
+ *
+ * The list tracks which entries of some fixed-size array are free. Any
+ * number of threads may push and pop indices concurrently, and neither
+ * operation blocks, takes a lock, or allocates memory. Indices are popped
+ * in the reverse of the order they were pushed.
+ *
+ * This struct should be initialized to zero before being used. The
+ * freelist_handle::size field must be set before calling ::freelist_init,
+ * and must not change until ::freelist_free.
+ */
+struct freelist_handle
+{
+	/// Private data - used internally by freelist functions
+	void *priv;
+
+	/// Number of indices which the list can hold
+	uint32_t size;
+};
+
+/*!
+ * @brief Frees data allocated by ::freelist_init
+ *
+ * @param[in,out] fl Target free list instance
+ */
+void freelist_free(struct freelist_handle *fl);
+
+/*!
+ * @brief Initializes the private data in a ::freelist_handle
+ *
+ * The list is initially empty.
+ *
+ * @param[in,out] fl Target free list instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int freelist_init(struct freelist_handle *fl);
+
+/*!
+ * @brief Takes the most recently pushed index from the list
+ *
+ * @param[in,out] fl Target free list instance
+ *
+ * @returns Free index on success, -ENOENT if the list is empty
+ */
+int freelist_pop(struct freelist_handle *fl);
+
+/*!
+ * @brief Adds an index to the list
+ *
+ * The index must be less than freelist_handle::size, and must not already be
+ * in the list.
+ *
+ * @param[in,out] fl Target free list instance
+ * @param[in] index Index to add
+ */
+void freelist_push(struct freelist_handle *fl, uint32_t index);
+
+#endif /* _freelist_h */
@@ -0,0 +1,144 @@
+/*!
+ * @file histogram.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for lock-free log-linear histograms
+ */
+
+#ifndef _histogram_h
+#define _histogram_h
+
+#include "atomic.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Number of bits of each value which select a bucket within its power of two
+#define HISTOGRAM_SUB_BITS 3
+
+/// Number of bits in the largest value which is not clamped to the last bucket
+#define HISTOGRAM_MAX_BITS 24
+
+/// Number of buckets in a ::histogram
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/*!
+ * @brief Distribution of recorded values
+ *
+ * Values below 2^::HISTOGRAM_SUB_BITS each have a bucket of their own. Above
+ * that, each power of two is split into 2^::HISTOGRAM_SUB_BITS buckets of
+ * equal width, so the relative error of a bucket is bounded regardless of the
+ * magnitude of the value. Values of 2^::HISTOGRAM_MAX_BITS and above are
+ * counted in the last bucket.
+ *
+ * Recording takes no lock and may race with any number of readers. This
+ * struct should be initialized to zero before being used.
+ */
+struct ATOMIC_ALIGNED histogram
+{
+	/// Sum of the recorded values
+	volatile uint64_t sum;
+
+	/// Number of values recorded in each bucket
+	volatile uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/*!
+ * @brief Gets the index of the bucket which counts the given value
+ *
+ * @param[in] value Value to look up
+ *
+ * @returns Index of the bucket, less than ::HISTOGRAM_BUCKETS
+ */
+size_t histogram_bucket(uint64_t value);
+
+/*!
+ * @brief Gets the largest value counted in the given bucket
+ *
+ * @param[in] bucket Index of the bucket, less than ::HISTOGRAM_BUCKETS
+ *
+ * @returns Largest value in the bucket, or UINT64_MAX for the last bucket
+ */
+uint64_t histogram_bucket_max(size_t bucket);
+
+/*!
+ * @brief Gets the smallest value counted in the given bucket
+ *
+ * @param[in] bucket Index of the bucket, less than ::HISTOGRAM_BUCKETS
+ *
+ * @returns Smallest value in the bucket
+ */
+uint64_t histogram_bucket_min(size_t bucket);
+
+/*!
+ * @brief Estimates a quantile of a histogram snapshot
+ *
+ * @param[in] buckets Counts of each bucket, as read by ::histogram_read
+ * @param[in] permille Quantile to estimate, in thousandths
+ *
+ * @returns Largest value in the bucket holding the quantile, or 0 if the
+ *          snapshot is empty
+ */
+uint64_t histogram_quantile(const uint64_t buckets[HISTOGRAM_BUCKETS], uint32_t permille);
+
+/*!
+ * @brief Reads a snapshot of a histogram
+ *
+ * Values being recorded concurrently may or may not be included.
+ *
+ * @param[in] hist Target histogram instance
+ * @param[out] buckets Number of values recorded in each bucket
+ * @param[out] sum Sum of the recorded values, or NULL
+ *
+ * @returns Number of values recorded in buckets
+ */
+uint64_t histogram_read(const struct histogram *hist, uint64_t buckets[HISTOGRAM_BUCKETS], uint64_t *sum);
+
+/*!
+ * @brief Records a value in a histogram
+ *
+ * @param[in,out] hist Target histogram instance
+ * @param[in] value Value to record
+ */
+void histogram_record(struct histogram *hist, uint64_t value);
+
+#endif /* _histogram_h */
@@ -0,0 +1,125 @@
+/*!
+ * @file hold_map.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for finding the slot held for a callsign
+ */
+
+#ifndef _hold_map_h
+#define _hold_map_h
+
+#include <stdint.h>
+
+/*!
+ * @brief Represents a table of the callsigns which slots are being held for
+ *
+ * Each slot is held for at most one callsign at a time. Looking up a callsign
+ * takes the same time no matter how many slots there are. All of the
+ * functions are safe to call from multiple threads at once.
+ *
+ * This struct should be initialized to zero before being used. The
+ * hold_map_handle::size field must be set before calling ::hold_map_init,
+ * and must not change until ::hold_map_free.
+ */
+struct hold_map_handle
+{
+	/// Private data - used internally by hold_map functions
+	void *priv;
+
+	/// Number of slots which the table can hold callsigns for
+	uint32_t size;
+};
+
+/*!
+ * @brief Stops holding a slot for any callsign
+ *
+ * @param[in,out] hm Target hold map instance
+ * @param[in] slot Index of the slot, which must be less than
+ *            hold_map_handle::size
+ */
+void hold_map_del(struct hold_map_handle *hm, uint32_t slot);
+
+/*!
+ * @brief Looks up the slot held for a callsign
+ *
+ * If more than one slot is held for the callsign, the one which was held
+ * most recently is found.
+ *
+ * @param[in,out] hm Target hold map instance
+ * @param[in] callsign Null-terminated callsign to look up
+ *
+ * @returns Index of the slot on success, -ENOENT if no slot is held for the
+ *          callsign
+ */
+int hold_map_find(struct hold_map_handle *hm, const char *callsign);
+
+/*!
+ * @brief Frees data allocated by ::hold_map_init
+ *
+ * @param[in,out] hm Target hold map instance
+ */
+void hold_map_free(struct hold_map_handle *hm);
+
+/*!
+ * @brief Initializes the private data in a ::hold_map_handle
+ *
+ * The table is initially empty.
+ *
+ * @param[in,out] hm Target hold map instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int hold_map_init(struct hold_map_handle *hm);
+
+/*!
+ * @brief Holds a slot for a callsign, replacing any callsign it was held for
+ *
+ * Callsigns which are too long to have come from a client are not held.
+ *
+ * @param[in,out] hm Target hold map instance
+ * @param[in] slot Index of the slot, which must be less than
+ *            hold_map_handle::size
+ * @param[in] callsign Null-terminated callsign to hold the slot for
+ */
+void hold_map_put(struct hold_map_handle *hm, uint32_t slot, const char *callsign);
+
+#endif /* _hold_map_h */
@@ -78,6 +78,15 @@ struct log_handle
  */
 void log_close(struct log_handle *log);
 
+/*!
+ * @brief Gets the number of messages discarded because the writer fell behind
+ *
+ * @param[in] log Target logging infrastructure instance
+ *
+ * @returns Number of messages dropped since ::log_init
+ */
+uint32_t log_dropped(struct log_handle *log);
+
 /*!
  * @brief Frees data allocated by ::log_init
  *
@@ -140,6 +149,27 @@ void log_printf(struct log_handle *log, enum LOG_LEVEL lvl, const char *fmt, ...
  */
 int log_select_medium(struct log_handle *log, const enum LOG_MEDIUM medium, const char *target);
 
+/*!
+ * @brief Begins writing log messages from a background thread
+ *
+ * Until this is called, and again after ::log_stop, messages are written to
+ * the medium by the thread which logs them. While the writer is running,
+ * messages are formatted into a bounded queue instead, and are discarded
+ * if the queue is full.
+ *
+ * @param[in,out] log Target logging infrastructure instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int log_start(struct log_handle *log);
+
+/*!
+ * @brief Writes any queued messages and stops the background writer
+ *
+ * @param[in,out] log Target logging infrastructure instance
+ */
+void log_stop(struct log_handle *log);
+
 /*!
  * @brief Logs the given message to the current logging facility
  *
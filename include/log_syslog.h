@@ -58,5 +58,5 @@
 #  define LOG_DEBUG 0
 #  define closelog()
 #  define openlog(ident, option, facility) return -ENOTSUP;
-#  define vsyslog(facility_priority, format, arglist)
+#  define syslog(facility_priority, format, msg)
 #endif /* _log_syslog_h */
@@ -0,0 +1,108 @@
+/*!
+ * @file metrics.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Exporting proxy statistics to monitoring systems
+ */
+
+#ifndef _metrics_h
+#define _metrics_h
+
+#include "openelp/openelp.h"
+
+/*!
+ * @brief Represents an instance of the metrics exporter
+ *
+ * The exporter periodically pushes aggregate counters to a StatsD server when
+ * proxy_conf::statsd_addr is set, and serves per-slot counters in the
+ * Prometheus text format at /metrics when proxy_conf::metrics_port is set.
+ * Statistics are read with ::proxy_get_stats, so exporting never blocks the
+ * forwarding threads.
+ *
+ * This struct should be initialized to zero before being used. The private
+ * data should be initialized using the ::metrics_init function, and
+ * subsequently freed by ::metrics_free when the exporter is no longer needed.
+ */
+struct metrics_handle
+{
+	/// Private data - used internally by metrics functions
+	void *priv;
+
+	/// Proxy instance to export the statistics of
+	struct proxy_handle *ph;
+};
+
+/*!
+ * @brief Frees data allocated by ::metrics_init
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ */
+void metrics_free(struct metrics_handle *mh);
+
+/*!
+ * @brief Initializes the private data in a ::metrics_handle
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int metrics_init(struct metrics_handle *mh);
+
+/*!
+ * @brief Starts exporting statistics as configured in metrics_handle::ph
+ *
+ * If neither exporter is configured, this does nothing.
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int metrics_start(struct metrics_handle *mh);
+
+/*!
+ * @brief Stops exporting statistics
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ */
+void metrics_stop(struct metrics_handle *mh);
+
+#endif /* _metrics_h */
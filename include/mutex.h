@@ -162,6 +162,9 @@ int mutex_lock(struct mutex_handle *mutex);
  * @brief Acquires a shared Lock on the given mutex, blocking if it is already
  *        locked exclusively
  *
+ * A pending exclusive lock blocks new shared holders, so the shared lock must
+ * not be acquired recursively.
+ *
  * @param[in,out] mutex Target mutex instance
  *
  * @returns 0 on success, negative ERRNO value on failure
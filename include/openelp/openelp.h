@@ -56,6 +56,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -75,6 +76,21 @@ extern "C" {
 /// Length in bytes of the expected password response from the client
 #define PROXY_PASS_RES_LEN 16
 
+/// Number of buckets in a ::proxy_latency_stats
+#define PROXY_LATENCY_BUCKETS 176
+
+/*!
+ * @brief UDP traffic to discard when a client can't keep up with it
+ */
+enum DROP_POLICY
+{
+	/// Discard newly arriving traffic
+	DROP_POLICY_NEWEST = 0,
+
+	/// Discard the traffic which has been waiting the longest
+	DROP_POLICY_OLDEST,
+};
+
 /*!
  * @brief Severity level of log information
  */
@@ -126,6 +142,29 @@ enum LOG_MEDIUM
  */
 struct proxy_conf
 {
+	/// Number of threads accepting client connections, where 0 or 1 only
+	/// accepts them in ::proxy_process
+	uint16_t accept_threads;
+
+	/// Path of the local socket to accept administrative commands on, or
+	/// NULL to not accept them
+	char *admin_socket;
+
+	/// Number of connections from an address which may be accepted in quick
+	/// succession before proxy_conf::admission_rate applies
+	uint16_t admission_burst;
+
+	/// Number of consecutive authentication failures after which an
+	/// address is refused, or 0 to never refuse an address for failing
+	uint16_t admission_failures;
+
+	/// Time in seconds that an address is first refused for after
+	/// proxy_conf::admission_failures failures
+	uint16_t admission_penalty;
+
+	/// Connections to accept from each address per second, or 0 for no limit
+	uint16_t admission_rate;
+
 	/// Address to bind to for listening for client connections
 	char *bind_addr;
 
@@ -144,9 +183,72 @@ struct proxy_conf
 	/// Regular expression for matching denied callsigns
 	char *calls_denied;
 
+	/// Maximum time in microseconds to hold UDP traffic for the client while
+	/// waiting for more to send with it, 0 to send it immediately
+	uint32_t client_coalesce_delay;
+
+	/// Maximum number of bytes in a single message sent to the client, which
+	/// only a single larger UDP datagram may exceed
+	uint16_t client_message_size;
+
+	/// Non-zero to disable the combining of small segments sent to the client
+	uint8_t client_nodelay;
+
+	/// Non-zero to acknowledge data from the client immediately
+	uint8_t client_quickack;
+
+	/// Size of the socket receive buffer for the client connection, or 0 for
+	/// the system default
+	uint32_t client_rcvbuf;
+
+	/// Size of the socket send buffer for the client connection, or 0 for the
+	/// system default
+	uint32_t client_sndbuf;
+
+	/// UDP traffic to discard when the client can't keep up with it
+	enum DROP_POLICY drop_policy;
+
+	/// Time in minutes after which a client is disconnected regardless of its
+	/// activity, 0 to allow clients to stay connected indefinitely
+	uint16_t connection_timeout;
+
+	/// Event notification mechanism used by the forwarding threads, or NULL
+	/// to use the default for the platform
+	char *forwarding_backend;
+
+	/// Set of CPUs to run the forwarding threads on, with bit n set for CPU
+	/// n, or 0 to let the system choose
+	uint64_t forwarding_cpus;
+
+	/// Real-time priority for the forwarding threads from 1 to 99, or 0 for
+	/// normal scheduling
+	uint8_t forwarding_priority;
+
+	/// Number of event-driven threads forwarding client traffic, 0 to use
+	/// dedicated threads for each client
+	uint16_t forwarding_threads;
+
+	/// Time in seconds after which a client which has not sent anything is
+	/// disconnected, 0 to allow idle clients to stay connected
+	uint16_t inactivity_timeout;
+
+	/// Maximum number of client connections to queue before they are
+	/// accepted, or 0 for the system maximum
+	uint16_t listen_backlog;
+
+	/// Address to bind to for serving metrics to scrapers, or NULL for all
+	char *metrics_bind_addr;
+
+	/// Port on which to serve metrics to scrapers, 0 to disable
+	uint16_t metrics_port;
+
 	/// Required password for access
 	char *password;
 
+	/// Whether to discard UDP traffic for the client from hosts the client
+	/// has not sent to during the current session
+	uint8_t peer_filter;
+
 	/// Port on which to listen for client connections
 	uint16_t port;
 
@@ -158,6 +260,195 @@ struct proxy_conf
 
 	/// Registered address override
 	char *public_addr;
+
+	/// Time in seconds to keep a client's slot free for it after it
+	/// disconnects, 0 to make the slot available to anyone immediately
+	uint16_t slot_hold_time;
+
+	/// Number of threads to start for serving clients, which are shared by
+	/// all of the slots and added to as more clients connect at once, or 0
+	/// to keep a dedicated thread for each slot
+	uint16_t slot_threads;
+
+	/// Address of the StatsD server to push metrics to, or NULL to disable
+	char *statsd_addr;
+
+	/// Time in seconds between pushes to the StatsD server
+	uint16_t statsd_interval;
+
+	/// Port of the StatsD server
+	uint16_t statsd_port;
+
+	/// Prefix for the names of metrics pushed to the StatsD server, or NULL
+	/// to use "openelp"
+	char *statsd_prefix;
+
+	/// Time in seconds to wait for each attempt to open a TCP connection on
+	/// behalf of a client, 0 to wait as long as the system does
+	uint16_t tcp_connect_timeout;
+
+	/// Size of the socket receive buffer for TCP connections to remote hosts,
+	/// or 0 for the system default
+	uint32_t tcp_rcvbuf;
+
+	/// Number of times to retry opening a TCP connection on behalf of a
+	/// client before reporting failure to it
+	uint16_t tcp_retry_count;
+
+	/// Size of the socket send buffer for TCP connections to remote hosts, or
+	/// 0 for the system default
+	uint32_t tcp_sndbuf;
+
+	/// Size in kilobytes of the stack for each thread started by the proxy, or
+	/// 0 for the system default
+	uint16_t thread_stack_size;
+
+	/// Path of the file to write traced traffic to when asked without
+	/// naming one, or NULL if a path must be given
+	char *trace_file;
+
+	/// Number of payload bytes to keep for each traced packet, at most 64
+	uint8_t trace_snap_len;
+
+	/// Size of the socket receive buffers for UDP traffic, or 0 for the
+	/// system default
+	uint32_t udp_rcvbuf;
+
+	/// Size of the socket send buffers for UDP traffic, or 0 for the system
+	/// default
+	uint32_t udp_sndbuf;
+
+	/// Differentiated services code point to mark UDP data (voice) sent to
+	/// remote hosts with, or 0 to leave it unmarked
+	uint8_t voice_dscp;
+};
+
+/*!
+ * @brief Amount of one kind of traffic forwarded in one direction
+ */
+struct proxy_traffic_stats
+{
+	/// Number of packets or messages forwarded
+	uint64_t packets;
+
+	/// Number of payload bytes forwarded
+	uint64_t bytes;
+};
+
+/*!
+ * @brief Distribution of the time traffic spent inside the proxy
+ *
+ * Each bucket counts frames whose latency, in microseconds, was at most
+ * ::proxy_latency_bucket_max for that bucket and more than that of the bucket
+ * before it.
+ */
+struct proxy_latency_stats
+{
+	/// Number of frames measured
+	uint64_t count;
+
+	/// Sum of the measured latencies, in microseconds
+	uint64_t sum_us;
+
+	/// Number of frames measured in each bucket
+	uint64_t buckets[PROXY_LATENCY_BUCKETS];
+};
+
+/*!
+ * @brief Snapshot of the activity of a single client slot
+ *
+ * Traffic "in" was received from remote hosts and forwarded to the client,
+ * while traffic "out" was sent by the client to remote hosts. All counts
+ * accumulate from the time the proxy was opened.
+ */
+struct proxy_slot_stats
+{
+	/// UDP data forwarded to the client
+	struct proxy_traffic_stats udp_data_in;
+
+	/// UDP data forwarded from the client
+	struct proxy_traffic_stats udp_data_out;
+
+	/// UDP control information forwarded to the client
+	struct proxy_traffic_stats udp_control_in;
+
+	/// UDP control information forwarded from the client
+	struct proxy_traffic_stats udp_control_out;
+
+	/// TCP data forwarded to the client
+	struct proxy_traffic_stats tcp_in;
+
+	/// TCP data forwarded from the client
+	struct proxy_traffic_stats tcp_out;
+
+	/// Number of failed attempts to send to the client or to a remote host
+	uint64_t send_failures;
+
+	/// Number of UDP frames discarded because the client fell behind
+	uint64_t frames_dropped;
+
+	/// Number of UDP datagrams discarded because they came from a host the
+	/// client had not sent to
+	uint64_t udp_filtered;
+
+	/// Time from receiving UDP traffic from a remote host to finishing writing
+	/// it to the client
+	struct proxy_latency_stats latency_in;
+
+	/// Time from receiving a UDP message from the client to sending it on to
+	/// a remote host
+	struct proxy_latency_stats latency_out;
+
+	/// Number of frames waiting to be written to the client
+	uint32_t queue_depth;
+
+	/// Number of seconds the current client has been connected for
+	uint32_t session_time;
+
+	/// Callsign of the current client, or of the client the slot is being
+	/// held for, or empty if neither
+	char callsign[12];
+
+	/// Address the slot binds its connections to remote hosts to, or empty
+	/// for any address
+	char source_addr[46];
+
+	/// Non-zero if a client is currently connected to the slot
+	uint8_t in_use;
+
+	/// Non-zero if the slot is being held for a client which left
+	uint8_t held;
+
+	/// Non-zero if the slot won't be given any more clients
+	uint8_t draining;
+};
+
+/*!
+ * @brief Snapshot of the activity of the proxy as a whole
+ */
+struct proxy_stats
+{
+	/// Number of connections refused before authenticating because their
+	/// address exceeded its rate or was being penalized for failures
+	uint64_t admission_refused;
+
+	/// Number of clients which failed to authenticate
+	uint64_t auth_failures;
+
+	/// Number of clients dropped because no slot was available
+	uint64_t slots_exhausted;
+
+	/// Number of log messages discarded because the log writer fell behind
+	uint32_t log_dropped;
+
+	/// Number of slots which currently have a connected client
+	uint32_t slots_used;
+
+	/// Number of slots which clients may currently use
+	uint32_t slots_total;
+
+	/// Non-zero if the proxy isn't giving slots to new clients
+	uint8_t draining;
 };
 
 /*!
@@ -213,6 +504,19 @@ int OPENELP_API proxy_authorize_callsign(struct proxy_handle *ph, const char *ca
  */
 void OPENELP_API proxy_close(struct proxy_handle *ph);
 
+/*!
+ * @brief Stops giving slots to new clients, without disturbing current ones
+ *
+ * While the whole proxy is draining, it is registered as busy and only
+ * clients returning to a slot held for them are let in.
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] slot Index of the slot to drain, or -1 for the whole proxy
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int OPENELP_API proxy_drain(struct proxy_handle *ph, int slot);
+
 /*!
  * @brief Drops all currently connected clients from the proxy
  *
@@ -220,6 +524,34 @@ void OPENELP_API proxy_close(struct proxy_handle *ph);
  */
 void OPENELP_API proxy_drop(struct proxy_handle *ph);
 
+/*!
+ * @brief Drops the client connected to a single slot
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] slot Index of the slot to drop the client from
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int OPENELP_API proxy_drop_slot(struct proxy_handle *ph, int slot);
+
+/*!
+ * @brief Writes the traffic most recently forwarded by the proxy to a pcapng
+ *        file
+ *
+ * Each slot keeps its last few hundred packets, which are written as an
+ * interface of their own. This may be called from any thread while the
+ * proxy is open, and does not interrupt forwarding.
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] path Path of the file to write, or NULL for
+ *                 proxy_conf::trace_file
+ * @param[in] slot Index of the slot to write, or -1 for every slot
+ *
+ * @returns Number of packets written on success, negative ERRNO value on
+ *          failure
+ */
+int OPENELP_API proxy_dump_trace(struct proxy_handle *ph, const char *path, int slot);
+
 /*!
  * @brief Frees data allocated by ::proxy_init
  *
@@ -227,6 +559,48 @@ void OPENELP_API proxy_drop(struct proxy_handle *ph);
  */
 void OPENELP_API proxy_free(struct proxy_handle *ph);
 
+/*!
+ * @brief Takes a snapshot of the proxy's statistics
+ *
+ * This may be called from any thread while the proxy is open. The counters
+ * are read while forwarding continues, so counts of different kinds may be a
+ * few packets apart from each other.
+ *
+ * @param[in] ph Target proxy instance
+ * @param[out] stats Resulting statistics for the whole proxy
+ * @param[out] slot_stats Resulting statistics for each slot, or NULL
+ * @param[in] slot_stats_len Number of entries available in slot_stats
+ *
+ * @returns Number of slots the proxy has, which may be more than were written
+ *          to slot_stats, or a negative ERRNO value on failure
+ */
+int OPENELP_API proxy_get_stats(struct proxy_handle *ph, struct proxy_stats *stats, struct proxy_slot_stats *slot_stats, size_t slot_stats_len);
+
+/*!
+ * @brief Gets the upper bound of a bucket in a ::proxy_latency_stats
+ *
+ * @param[in] bucket Index of the bucket, less than ::PROXY_LATENCY_BUCKETS
+ *
+ * @returns Largest latency counted in the bucket, in microseconds, or
+ *          UINT64_MAX for the last bucket
+ */
+uint64_t OPENELP_API proxy_latency_bucket_max(size_t bucket);
+
+/*!
+ * @brief Gives up the listening port to a new process, which takes over
+ *
+ * The proxy stops accepting clients and registering itself, but the
+ * current clients are left to finish. Once they have all left,
+ * ::proxy_process returns -ECANCELED. This is normally called once a new
+ * process which sent the 'handoff' command to the administrative socket
+ * confirms that it has started.
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int OPENELP_API proxy_hand_off(struct proxy_handle *ph);
+
 /*!
  * @brief Instructs the proxy to identify itself to the current log medium
  *
@@ -296,10 +670,38 @@ int OPENELP_API proxy_open(struct proxy_handle *ph);
  *
  * @param[in,out] ph Target proxy instance
  *
- * @returns 0 on success, negative ERRNO value on failure
+ * @returns 0 on success, -ECANCELED once the proxy has been handed off by
+ *          ::proxy_hand_off and its clients have left, other negative ERRNO
+ *          value on failure
  */
 int OPENELP_API proxy_process(struct proxy_handle *ph);
 
+/*!
+ * @brief Applies the configuration in the given file to the open proxy
+ *
+ * The callsign patterns, registration comment, admission limits and
+ * external bind addresses are replaced without disturbing connected
+ * clients. A slot whose address is removed stays in use until its client
+ * leaves. Other settings take effect once the proxy is restarted. If the
+ * file can't be loaded, the current configuration is kept.
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] path Null-terminated string containing the path to the file
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int OPENELP_API proxy_reload(struct proxy_handle *ph, const char *path);
+
+/*!
+ * @brief Resumes giving slots to new clients after ::proxy_drain
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] slot Index of the slot to resume, or -1 for the whole proxy
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int OPENELP_API proxy_resume(struct proxy_handle *ph, int slot);
+
 /*!
  * @brief Gracefully shut down all proxy operations asynchronously
  *
@@ -316,6 +718,23 @@ void OPENELP_API proxy_shutdown(struct proxy_handle *ph);
  */
 int OPENELP_API proxy_start(struct proxy_handle *ph);
 
+/*!
+ * @brief Takes over the listening port from the process already running
+ *
+ * The running process is asked to hand off through the socket at
+ * proxy_conf::admin_socket, and keeps serving its current clients until
+ * they leave. Until then, the slots they use are drained in this process.
+ * The running process only stops accepting new clients once ::proxy_start
+ * succeeds here, and carries on as before if this process exits first.
+ * This must be called after the configuration is loaded and before
+ * ::proxy_open. It is only supported on POSIX systems.
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int OPENELP_API proxy_take_over(struct proxy_handle *ph);
+
 /*!
  * @brief Updates the registration status of the proxy instance
  *
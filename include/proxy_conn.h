@@ -48,6 +48,102 @@
 #define _proxy_conn_h
 
 #include "conn.h"
+#include "conn_pool.h"
+#include "freelist.h"
+#include "hold_map.h"
+#include "reactor.h"
+#include "trace.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+
+/*!
+ * @brief Message types used in communication between the proxy and the client
+ */
+enum PROXY_MSG_TYPE
+{
+	/*!
+	 * @brief The proxy should open a new TCP connection
+	 *
+	 * * Sent by: client
+	 * * Expected data: 0 bytes
+	 */
+	PROXY_MSG_TYPE_TCP_OPEN = 1,
+
+	/*!
+	 * @brief Data which has been sent or should be sent over the TCP connection
+	 *
+	 * The address field is ignored in this message
+	 *
+	 * * Sent by: client or proxy
+	 * * Expected data: 1 or more bytes
+	 */
+	PROXY_MSG_TYPE_TCP_DATA,
+
+	/*!
+	 * @brief The TCP has been, or should be closed
+	 *
+	 * The address field is ignored in this message
+	 *
+	 * When the client requests that the TCP connection be closed, the proxy
+	 * responds with another ::PROXY_MSG_TYPE_TCP_CLOSE message
+	 *
+	 * * Sent by: client or proxy
+	 * * Expected data: 0 bytes
+	 */
+	PROXY_MSG_TYPE_TCP_CLOSE,
+
+	/*!
+	 * @brief The status of the TCP connection
+	 *
+	 * The address field is ignored in this message
+	 *
+	 * The data included with this message should be zeroed when the TCP connection
+	 * was opened successfully, and non-zero otherwise
+	 *
+	 * * Sent by: proxy
+	 * * Expected data: 4 bytes
+	 */
+	PROXY_MSG_TYPE_TCP_STATUS,
+
+	/*!
+	 * @brief Data which has been or should be sent of the UDP Data connection
+	 *
+	 * * Sent by: client or proxy
+	 * * Expected data: 1 or more bytes
+	 */
+	PROXY_MSG_TYPE_UDP_DATA,
+
+	/*!
+	 * @brief Data which has been or should be sent of the UDP Control connection
+	 *
+	 * * Sent by: client or proxy
+	 * * Expected data: 1 or more bytes
+	 */
+	PROXY_MSG_TYPE_UDP_CONTROL,
+
+	/*!
+	 * @brief Proxy system information
+	 *
+	 * The contents of this message are a single ::SYSTEM_MSG
+	 *
+	 * * Sent by: proxy
+	 * * Expected data: 1 byte
+	 */
+	PROXY_MSG_TYPE_SYSTEM,
+};
+
+/*!
+ * @brief System messages sent by the proxy to the client
+ */
+enum SYSTEM_MSG
+{
+	/// The client has supplied the proxy with an incorrect password
+	SYSTEM_MSG_BAD_PASSWORD = 1,
+
+	/// The client's callsign is not allowed to use the proxy
+	SYSTEM_MSG_ACCESS_DENIED,
+};
 
 /*!
  * @brief Represents an instance of a proxy client connection
@@ -66,17 +162,44 @@ struct proxy_conn_handle
 
 	/// Null-terminated string containing the source address for client data
 	const char *source_addr;
+
+	/// Reactor to forward client data with, or NULL to use dedicated threads
+	struct reactor_handle *reactor;
+
+	/// Pool to return client connections to once they are finished
+	struct conn_pool_handle *conn_pool;
+
+	/// List to add proxy_conn_handle::slot to whenever this is free
+	struct freelist_handle *free_slots;
+
+	/// Table to add proxy_conn_handle::slot to whenever this is held for a
+	/// client which left
+	struct hold_map_handle *held_slots;
+
+	/// Pool to take a thread from for each client, or NULL to keep a
+	/// dedicated thread waiting for clients
+	struct worker_pool_handle *workers;
+
+	/// Count of the proxy's client connections which have a connected client
+	volatile uint32_t *slots_used;
+
+	/// Severity threshold of the proxy's log, checked before formatting
+	const volatile uint32_t *log_level;
+
+	/// Index of this instance among the proxy's client connections
+	uint32_t slot;
 };
 
 /*!
  * @brief Transfer ownership of the given connection to the proxy_conn
  *
  * @param[in,out] pc Target proxy client connection instance
- * @param[in] conn_client Connection to a client
+ * @param[in] conn_client Connection to a client which has been authorized
+ * @param[in] callsign Null-terminated callsign of the client
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-int proxy_conn_accept(struct proxy_conn_handle *pc, struct conn_handle *conn_client);
+int proxy_conn_accept(struct proxy_conn_handle *pc, struct conn_handle *conn_client, const char *callsign);
 
 /*!
  * @brief Disconnects the connecte client and returns the connection to idle
@@ -92,6 +215,38 @@ void proxy_conn_drop(struct proxy_conn_handle *pc);
  */
 void proxy_conn_free(struct proxy_conn_handle *pc);
 
+/*!
+ * @brief Takes a snapshot of the traffic counters without stopping forwarding
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[out] stats Resulting statistics
+ */
+void proxy_conn_get_stats(struct proxy_conn_handle *pc, struct proxy_slot_stats *stats);
+
+/*!
+ * @brief Gets the ring of traffic most recently forwarded for the slot's
+ *        clients
+ *
+ * The ring may be read while forwarding continues.
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns Trace ring of the slot
+ */
+const struct trace_ring * proxy_conn_get_trace(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Transfer ownership of an authorized connection to the proxy_conn,
+ *        if it is being held for the connection's callsign
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] conn_client Connection to a client which has been authorized
+ * @param[in] callsign Null-terminated callsign of the client
+ *
+ * @returns 0 on success, -EBUSY if pc is not being held for callsign
+ */
+int proxy_conn_handoff(struct proxy_conn_handle *pc, struct conn_handle *conn_client, const char *callsign);
+
 /*!
  * @brief Initializes the private data in a ::proxy_conn_handle
  *
@@ -110,6 +265,55 @@ int proxy_conn_init(struct proxy_conn_handle *pc);
  */
 int proxy_conn_in_use(struct proxy_conn_handle *pc);
 
+/*!
+ * @brief Disconnect the client if it has exceeded the configured connection
+ *        time or has been inactive for too long
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] now Current time in seconds, as measured by ::clock_now_us
+ *
+ * @returns Time in seconds at which the client should next be checked, or 0
+ *          if there is no client or it was disconnected
+ */
+uint32_t proxy_conn_reap(struct proxy_conn_handle *pc, uint32_t now);
+
+/*!
+ * @brief Send a ::SYSTEM_MSG to a client which is not being given a slot
+ *
+ * @param[in,out] conn_client Connection to a client
+ * @param[in] msg Message to send
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int proxy_conn_reject(struct conn_handle *conn_client, enum SYSTEM_MSG msg);
+
+/*!
+ * @brief Takes the slot out of service once its current client leaves
+ *
+ * The current client, if any, is not disturbed, but the slot stops being
+ * held for clients which left and is not given to any new client until
+ * ::proxy_conn_set_source is called.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+void proxy_conn_retire(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Puts the slot back into service, using the given source address
+ *
+ * If the address differs from proxy_conn_handle::source_addr, the slot must
+ * have been retired using ::proxy_conn_retire and its last client must have
+ * left. The string must remain valid until the address is changed again or
+ * the slot is freed.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] source_addr Null-terminated address to bind the client's
+ *            connections to, or NULL for any
+ *
+ * @returns 0 on success, -EBUSY if the slot is stopping or still in use
+ */
+int proxy_conn_set_source(struct proxy_conn_handle *pc, const char *source_addr);
+
 /*!
  * @brief Starts the client thread and prepares to accept connections
  *
@@ -128,4 +332,15 @@ int proxy_conn_start(struct proxy_conn_handle *pc);
  */
 int proxy_conn_stop(struct proxy_conn_handle *pc);
 
+/*!
+ * @brief Serve a slot on a thread from its proxy_conn_handle::workers
+ *
+ * This is the function to use for worker_pool_handle::func_ptr, which the
+ * slot submits itself to when it is given a client.
+ *
+ * @param[in,out] wp Pool the thread belongs to
+ * @param[in,out] item Proxy client connection instance to serve
+ */
+void proxy_conn_worker(struct worker_pool_handle *wp, void *item);
+
 #endif /* _proxy_conn_h */
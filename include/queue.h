@@ -0,0 +1,161 @@
+/*!
+ * @file queue.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for bounded lock-free queues
+ */
+
+#ifndef _queue_h
+#define _queue_h
+
+#include <stddef.h>
+
+/*!
+ * @brief Represents an instance of a bounded, multi-producer, single-consumer
+ *        queue of fixed-size elements
+ *
+ * Producers reserve an element, fill it in place, and then commit it. The
+ * consumer peeks at the oldest committed element and releases it when it is
+ * done with it. None of these operations block or take a lock.
+ *
+ * This struct should be initialized to zero before being used. The
+ * queue_handle::capacity and queue_handle::elem_size fields must be set
+ * before calling ::queue_init, and must not change until ::queue_free.
+ */
+struct queue_handle
+{
+	/// Private data - used internally by queue functions
+	void *priv;
+
+	/// Number of elements the queue can hold, which must be a power of two
+	size_t capacity;
+
+	/// Number of bytes in each element
+	size_t elem_size;
+};
+
+/*!
+ * @brief Publishes an element previously reserved by ::queue_reserve
+ *
+ * @param[in,out] queue Target queue instance
+ * @param[in] elem Reserved element to publish to the consumer
+ */
+void queue_commit(struct queue_handle *queue, void *elem);
+
+/*!
+ * @brief Gets the approximate number of elements in the queue
+ *
+ * Elements which have been reserved but not yet committed are included.
+ *
+ * @param[in] queue Target queue instance
+ *
+ * @returns Number of elements in the queue
+ */
+size_t queue_count(struct queue_handle *queue);
+
+/*!
+ * @brief Frees data allocated by ::queue_init
+ *
+ * @param[in,out] queue Target queue instance
+ */
+void queue_free(struct queue_handle *queue);
+
+/*!
+ * @brief Initializes the private data in a ::queue_handle
+ *
+ * @param[in,out] queue Target queue instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int queue_init(struct queue_handle *queue);
+
+/*!
+ * @brief Gets the oldest element from the queue without removing it
+ *
+ * This may only be called by the queue's consumer.
+ *
+ * @param[in,out] queue Target queue instance
+ *
+ * @returns Oldest committed element, or NULL if there is none
+ */
+void * queue_peek(struct queue_handle *queue);
+
+/*!
+ * @brief Gets a committed element from the queue without removing it
+ *
+ * This may only be called by the queue's consumer. Elements are released in
+ * order, so this allows the consumer to work on several elements before
+ * releasing any of them.
+ *
+ * @param[in,out] queue Target queue instance
+ * @param[in] index Number of elements to skip past the oldest one
+ *
+ * @returns Committed element, or NULL if none has been committed at index
+ */
+void * queue_peek_at(struct queue_handle *queue, size_t index);
+
+/*!
+ * @brief Removes the element returned by ::queue_peek from the queue
+ *
+ * This may only be called by the queue's consumer.
+ *
+ * @param[in,out] queue Target queue instance
+ * @param[in] elem Element returned by ::queue_peek, or by ::queue_peek_at
+ *            with an index of 0
+ */
+void queue_release(struct queue_handle *queue, void *elem);
+
+/*!
+ * @brief Reserves space for a new element at the end of the queue
+ *
+ * The returned element must be passed to ::queue_commit once it is filled.
+ * Elements are consumed in the order that they were reserved, so the consumer
+ * cannot pass an element which has been reserved but not committed.
+ *
+ * @param[in,out] queue Target queue instance
+ *
+ * @returns Space for queue_handle::elem_size bytes, or NULL if the queue is
+ *          full
+ */
+void * queue_reserve(struct queue_handle *queue);
+
+#endif /* _queue_h */
@@ -0,0 +1,241 @@
+/*!
+ * @file reactor.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for event-driven socket readiness dispatch
+ */
+
+#ifndef _reactor_h
+#define _reactor_h
+
+#include "conn.h"
+
+#include <stdint.h>
+
+/*!
+ * @brief Represents a connection which is watched by a reactor
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::reactor_watch_init function, and
+ * subsequently freed by ::reactor_watch_free when the watch is no longer
+ * needed.
+ *
+ * A watch is one-shot: once reactor_watch::func_ptr is called, it will not be
+ * called again for the same watch until it returns. This means that at most
+ * one thread is ever operating on the watched connection on behalf of the
+ * reactor.
+ */
+struct reactor_watch
+{
+	/// Private data - used internally by reactor functions
+	void *priv;
+
+	/// Connection to watch for incoming data
+	struct conn_handle *conn;
+
+	/*!
+	 * @brief Function called when reactor_watch::conn has data to be read
+	 *
+	 * If the function returns non-zero, the watch is detached from the
+	 * reactor and reactor_watch::func_detach is called.
+	 */
+	int (*func_ptr)(struct reactor_watch *);
+
+	/*!
+	 * @brief Function called after the watch is detached by the reactor
+	 *
+	 * This is only called when the watch is detached by a non-zero return
+	 * from reactor_watch::func_ptr, and not when detached by ::reactor_del.
+	 * Since reactor_watch::conn is no longer watched at this point, it is
+	 * safe to close it. May be NULL.
+	 */
+	void (*func_detach)(struct reactor_watch *);
+
+	/// Context to pass to reactor_watch::func_ptr and reactor_watch::func_detach
+	void *func_ctx;
+};
+
+/*!
+ * @brief Represents an instance of an event reactor
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::reactor_init function, and subsequently
+ * freed by ::reactor_free when the reactor is no longer needed.
+ */
+struct reactor_handle
+{
+	/// Private data - used internally by reactor functions
+	void *priv;
+
+	/// Name of the event notification mechanism to use, or NULL to use the
+	/// default for the platform
+	const char *backend;
+
+	/// Number of threads to dispatch events with
+	unsigned int num_threads;
+
+	/// Size for stack used for each of the dispatch threads
+	unsigned int stack_size;
+
+	/// Set of CPUs to run the dispatch threads on, as in
+	/// thread_handle::affinity. Each thread is pinned to a single CPU from the
+	/// set, taking them in turn.
+	uint64_t affinity;
+
+	/// Scheduling priority for the dispatch threads, as in
+	/// thread_handle::priority
+	unsigned int priority;
+};
+
+/*!
+ * @brief Begin watching a connection for incoming data
+ *
+ * @param[in,out] reactor Target reactor instance
+ * @param[in,out] watch Watch instance to attach to the reactor
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int reactor_add(struct reactor_handle *reactor, struct reactor_watch *watch);
+
+/*!
+ * @brief Stop watching a connection and wait for any running callback
+ *
+ * @param[in,out] reactor Target reactor instance
+ * @param[in,out] watch Watch instance to detach from the reactor
+ *
+ * @returns 1 if the watch was detached, 0 if it was not attached
+ *
+ * @note This function must not be called from the reactor_watch::func_ptr of
+ *       the same watch. To detach a watch from within its own callback, return
+ *       a non-zero value instead.
+ */
+int reactor_del(struct reactor_handle *reactor, struct reactor_watch *watch);
+
+/*!
+ * @brief Stop re-arming a watch after its callback returns
+ *
+ * The watch stays attached, but its reactor_watch::func_ptr is not called
+ * again until ::reactor_resume is called.
+ *
+ * @param[in,out] watch Watch instance to pause
+ *
+ * @note This function must only be called from the reactor_watch::func_ptr of
+ *       the same watch.
+ */
+void reactor_pause(struct reactor_watch *watch);
+
+/*!
+ * @brief Begin watching a connection which was paused by ::reactor_pause
+ *
+ * This function may be called from any thread. It does nothing if the watch
+ * is not paused.
+ *
+ * @param[in,out] reactor Target reactor instance
+ * @param[in,out] watch Watch instance to resume
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int reactor_resume(struct reactor_handle *reactor, struct reactor_watch *watch);
+
+/*!
+ * @brief Frees data allocated by ::reactor_init
+ *
+ * @param[in,out] reactor Target reactor instance
+ */
+void reactor_free(struct reactor_handle *reactor);
+
+/*!
+ * @brief Initializes the private data in a ::reactor_handle
+ *
+ * @param[in,out] reactor Target reactor instance
+ *
+ * @returns 0 on success, -ENOTSUP if reactor_handle::backend does not name a
+ *          mechanism available in this build, other negative ERRNO value on
+ *          failure
+ */
+int reactor_init(struct reactor_handle *reactor);
+
+/*!
+ * @brief Gets the name of the event notification mechanism used by the reactor
+ *
+ * @param[in] reactor Target reactor instance
+ *
+ * @returns Null-terminated string containing the name of the mechanism
+ */
+const char * reactor_name(const struct reactor_handle *reactor);
+
+/*!
+ * @brief Starts the reactor's dispatch threads
+ *
+ * @param[in,out] reactor Target reactor instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int reactor_start(struct reactor_handle *reactor);
+
+/*!
+ * @brief Stops and joins the reactor's dispatch threads
+ *
+ * Once stopped, a reactor cannot be started again without being freed and
+ * re-initialized.
+ *
+ * @param[in,out] reactor Target reactor instance
+ */
+void reactor_stop(struct reactor_handle *reactor);
+
+/*!
+ * @brief Frees data allocated by ::reactor_watch_init
+ *
+ * @param[in,out] watch Target watch instance
+ */
+void reactor_watch_free(struct reactor_watch *watch);
+
+/*!
+ * @brief Initializes the private data in a ::reactor_watch
+ *
+ * @param[in,out] watch Target watch instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int reactor_watch_init(struct reactor_watch *watch);
+
+#endif /* _reactor_h */
@@ -0,0 +1,151 @@
+/*!
+ * @file reactor_backend.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal interface between the reactor and event notification mechanisms
+ */
+
+#ifndef _reactor_backend_h
+#define _reactor_backend_h
+
+#include <stdint.h>
+
+/*!
+ * @brief Operations provided by an event notification mechanism
+ *
+ * Every descriptor is registered for one-shot read readiness: once a descriptor
+ * is reported by reactor_backend::wait, it is not reported again until it is
+ * re-armed using reactor_backend::rearm.
+ */
+struct reactor_backend
+{
+	/// Name of the event notification mechanism
+	const char *name;
+
+	/// Non-zero if events can only be dispatched from a single thread
+	uint8_t single_thread;
+
+	/*!
+	 * @brief Register a descriptor and arm it
+	 *
+	 * @param[in,out] state Backend state
+	 * @param[in] fd Native socket descriptor
+	 * @param[in] ctx Value to report when the descriptor is ready
+	 *
+	 * @returns 0 on success, negative ERRNO value on failure
+	 */
+	int (*add)(void *state, intptr_t fd, void *ctx);
+
+	/*!
+	 * @brief Unregister a descriptor
+	 *
+	 * @param[in,out] state Backend state
+	 * @param[in] fd Native socket descriptor
+	 * @param[in] ctx Value given when the descriptor was registered
+	 *
+	 * @returns 0 on success, negative ERRNO value on failure
+	 */
+	int (*del)(void *state, intptr_t fd, void *ctx);
+
+	/*!
+	 * @brief Frees the backend state
+	 *
+	 * @param[in,out] state Backend state
+	 */
+	void (*free)(void *state);
+
+	/*!
+	 * @brief Allocates and initializes the backend state
+	 *
+	 * @param[out] state Resulting backend state
+	 *
+	 * @returns 0 on success, negative ERRNO value on failure
+	 */
+	int (*init)(void **state);
+
+	/*!
+	 * @brief Re-arm a descriptor which was reported by reactor_backend::wait
+	 *
+	 * @param[in,out] state Backend state
+	 * @param[in] fd Native socket descriptor
+	 * @param[in] ctx Value given when the descriptor was registered
+	 *
+	 * @returns 0 on success, negative ERRNO value on failure
+	 */
+	int (*rearm)(void *state, intptr_t fd, void *ctx);
+
+	/*!
+	 * @brief Block until one or more descriptors are ready
+	 *
+	 * This function may return zero descriptors, such as after
+	 * reactor_backend::wake has been called.
+	 *
+	 * @param[in,out] state Backend state
+	 * @param[out] ready Values given with each of the ready descriptors
+	 * @param[in] ready_len Maximum number of values to store in ready
+	 *
+	 * @returns Number of values stored in ready, negative ERRNO value on failure
+	 */
+	int (*wait)(void *state, void **ready, int ready_len);
+
+	/*!
+	 * @brief Permanently wake all threads blocked in reactor_backend::wait
+	 *
+	 * @param[in,out] state Backend state
+	 */
+	void (*wake)(void *state);
+};
+
+#ifdef HAVE_IO_URING
+/// Backend using the Linux io_uring API
+extern const struct reactor_backend reactor_backend_io_uring;
+#endif
+
+#ifdef HAVE_EPOLL
+/// Backend using the Linux epoll API
+extern const struct reactor_backend reactor_backend_epoll;
+#endif
+
+/// Portable backend using poll or WSAPoll
+extern const struct reactor_backend reactor_backend_poll;
+
+#endif /* _reactor_backend_h */
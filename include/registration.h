@@ -79,6 +79,18 @@ void registration_service_free(struct registration_service_handle *rs);
  */
 int registration_service_init(struct registration_service_handle *rs);
 
+/*!
+ * @brief Replaces the comment sent with each registration status message
+ *
+ * The new comment is sent straight away if the service is running.
+ *
+ * @param[in,out] rs Target registration service instance
+ * @param[in] comment Null-terminated comment, or NULL for none
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int registration_service_set_comment(struct registration_service_handle *rs, const char *comment);
+
 /*!
  * @brief Starts the registration service thread
  *
@@ -89,6 +101,18 @@ int registration_service_init(struct registration_service_handle *rs);
  */
 int registration_service_start(struct registration_service_handle *rs, const struct proxy_conf *conf);
 
+/*!
+ * @brief Stops the registration thread without sending a final status message
+ *
+ * This leaves the registration to another process, such as the one taking
+ * over from this one.
+ *
+ * @param[in,out] rs Target registration service instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int registration_service_abandon(struct registration_service_handle *rs);
+
 /*!
  * @brief Sends a final status message and stops the registration thread
  *
@@ -69,10 +69,32 @@ struct thread_handle
 	/// Context to pass to thread_handle::func_ptr
 	void *func_ctx;
 
-	/// Size for stack used for the thread
+	/// Size in bytes for the stack used for the thread, or 0 for the system
+	/// default. Sizes below the system minimum are raised to it.
 	unsigned int stack_size;
+
+	/// Set of CPUs on which the thread may run, with bit n set for CPU n, or
+	/// 0 to let the system choose
+	uint64_t affinity;
+
+	/// Real-time priority for the thread from 1 to 99, or 0 for normal
+	/// scheduling. Higher values are clamped to the system maximum.
+	unsigned int priority;
 };
 
+/*!
+ * @brief Selects a single CPU from a set
+ *
+ * @param[in] set Set of CPUs, with bit n set for CPU n
+ * @param[in] n Index of the CPU to select, wrapping around the set
+ *
+ * @returns Set containing only the selected CPU, or 0 if set is empty
+ *
+ * This is used to spread a group of threads across a set of CPUs, so that
+ * each thread stays on a single one.
+ */
+uint64_t thread_affinity_pick(uint64_t set, unsigned int n);
+
 /*!
  * @brief Frees data allocated by ::thread_init
  *
@@ -104,7 +126,16 @@ int thread_join(struct thread_handle *th);
  * @param[in,out] th Target thread instance
  *
  * @returns 0 on success, negative ERRNO value on failure
+ *
+ * If thread_handle::affinity or thread_handle::priority can't be applied, the
+ * thread is not started. Real-time priorities typically require elevated
+ * privileges.
  */
 int thread_start(struct thread_handle *th);
 
+/*!
+ * @brief Yields the processor to another thread which is ready to run
+ */
+void thread_yield(void);
+
 #endif /* _thread_h */
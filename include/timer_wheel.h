@@ -0,0 +1,157 @@
+/*!
+ * @file timer_wheel.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for hierarchical timer wheels
+ */
+
+#ifndef _timer_wheel_h
+#define _timer_wheel_h
+
+#include <stdint.h>
+
+struct timer_wheel_handle;
+
+/*!
+ * @brief Represents a single timer which can be scheduled on a timer wheel
+ *
+ * This struct should be initialized to zero before being used, and must not
+ * be moved or freed while it is scheduled.
+ */
+struct timer_wheel_entry
+{
+	/// Next entry in the same slot of the wheel - used internally
+	struct timer_wheel_entry *next;
+
+	/// Pointer which refers to this entry, or NULL if it is not scheduled -
+	/// used internally
+	struct timer_wheel_entry **pprev;
+
+	/// Tick at which the entry expires - used internally
+	uint64_t expires;
+
+	/// Arbitrary user data
+	void *ctx;
+};
+
+/*!
+ * @brief Represents an instance of a hierarchical timer wheel
+ *
+ * The wheel keeps any number of timers at a resolution of one tick, which is
+ * whatever unit of time the caller measures in. Scheduling and removing a
+ * timer take constant time, and each advance of the wheel only visits the
+ * timers which expire or which have come close enough to expiring to move to
+ * a finer level of the wheel. All operations are protected by a lock, so the
+ * wheel may be used from any number of threads.
+ *
+ * This struct should be initialized to zero before being used. The
+ * timer_wheel_handle::start field must be set before calling
+ * ::timer_wheel_init, and the private data is subsequently freed by
+ * ::timer_wheel_free when the wheel is no longer needed.
+ */
+struct timer_wheel_handle
+{
+	/// Private data - used internally by timer_wheel functions
+	void *priv;
+
+	/// Current tick when the wheel is initialized
+	uint64_t start;
+
+	/// Function to call for each timer which expires, which returns the tick
+	/// at which to expire that timer again, or 0 to stop scheduling it. The
+	/// function is called with the wheel locked, so it must not add or remove
+	/// timers itself.
+	uint64_t (*func_ptr)(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t now);
+
+	/// Arbitrary user data for use in timer_wheel_handle::func_ptr
+	void *func_ctx;
+};
+
+/*!
+ * @brief Schedules a timer, replacing any time it was previously scheduled for
+ *
+ * A timer which expires before the wheel's current tick expires during the
+ * next call to ::timer_wheel_advance.
+ *
+ * @param[in,out] wh Target timer wheel instance
+ * @param[in,out] entry Timer to schedule
+ * @param[in] expires Tick at which the timer expires
+ */
+void timer_wheel_add(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t expires);
+
+/*!
+ * @brief Expires all of the timers which are due up to the given tick
+ *
+ * @param[in,out] wh Target timer wheel instance
+ * @param[in] now Current tick, which should not go backwards between calls
+ *
+ * @returns Number of timers which expired
+ */
+unsigned int timer_wheel_advance(struct timer_wheel_handle *wh, uint64_t now);
+
+/*!
+ * @brief Frees data allocated by ::timer_wheel_init
+ *
+ * Any timers which are still scheduled are forgotten.
+ *
+ * @param[in,out] wh Target timer wheel instance
+ */
+void timer_wheel_free(struct timer_wheel_handle *wh);
+
+/*!
+ * @brief Initializes the private data in a ::timer_wheel_handle
+ *
+ * @param[in,out] wh Target timer wheel instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int timer_wheel_init(struct timer_wheel_handle *wh);
+
+/*!
+ * @brief Cancels a timer, if it is scheduled
+ *
+ * @param[in,out] wh Target timer wheel instance
+ * @param[in,out] entry Timer to cancel
+ */
+void timer_wheel_remove(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry);
+
+#endif /* _timer_wheel_h */
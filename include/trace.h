@@ -0,0 +1,205 @@
+/*!
+ * @file trace.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for lock-free packet trace rings
+ */
+
+#ifndef _trace_h
+#define _trace_h
+
+#include "atomic.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Number of packets kept in each ::trace_ring, which must be a power of two
+#define TRACE_RING_LEN 256
+
+/// Largest number of payload bytes kept for each packet
+#define TRACE_SNAP_MAX 64
+
+/// The packet was not sent, or the remote host refused the connection
+#define TRACE_FLAG_FAILED (1 << 0)
+
+/// The packet came from a host the client had not sent to, and was discarded
+#define TRACE_FLAG_FILTERED (1 << 1)
+
+/*!
+ * @brief Direction in which a traced packet was forwarded
+ */
+enum TRACE_DIR
+{
+	/// From a remote host to the client
+	TRACE_DIR_TO_CLIENT = 0,
+
+	/// From the client to a remote host
+	TRACE_DIR_FROM_CLIENT,
+};
+
+/*!
+ * @brief Metadata and leading payload bytes of a single traced packet
+ */
+struct trace_record
+{
+	/// Time at which the packet was received, in microseconds of the clock
+	/// read by ::clock_now_us
+	uint64_t stamp;
+
+	/// IPv4 address of the remote host, in network byte order
+	uint32_t addr;
+
+	/// Number of payload bytes in the packet
+	uint32_t len;
+
+	/// Type of proxy message the packet was carried in, one of
+	/// ::PROXY_MSG_TYPE
+	uint8_t type;
+
+	/// Direction the packet was forwarded in, one of ::TRACE_DIR
+	uint8_t dir;
+
+	/// Bitwise OR of TRACE_FLAG_* values
+	uint8_t flags;
+
+	/// Number of bytes of the payload kept in trace_record::data
+	uint8_t snap_len;
+
+	/// Leading bytes of the payload
+	uint8_t data[TRACE_SNAP_MAX];
+};
+
+/*!
+ * @brief Slot in a ::trace_ring
+ */
+struct trace_entry
+{
+	/// One more than the index the entry was last written at, truncated to
+	/// 32 bits, or 0 while it is being written
+	volatile uint32_t seq;
+
+	/// Packet recorded in the entry
+	struct trace_record rec;
+};
+
+/*!
+ * @brief Fixed-size ring of the most recently traced packets
+ *
+ * Recording takes no lock and may race with other writers and with readers.
+ * Once the ring is full, each packet replaces the oldest one. This struct
+ * should be initialized to zero before being used.
+ */
+struct ATOMIC_ALIGNED trace_ring
+{
+	/// Number of packets ever recorded in the ring
+	volatile uint64_t head;
+
+	/// Most recently recorded packets, indexed by their position modulo
+	/// ::TRACE_RING_LEN
+	struct trace_entry entries[TRACE_RING_LEN];
+};
+
+/*!
+ * @brief Ring of traced packets to be written to a capture file
+ */
+struct trace_source
+{
+	/// Target ring
+	const struct trace_ring *ring;
+
+	/// Name of the interface the packets are written to
+	const char *name;
+
+	/// IPv4 address which the client's traffic is forwarded from, or NULL
+	/// for an unspecified address
+	const char *local_addr;
+};
+
+/*!
+ * @brief Reads a snapshot of a trace ring
+ *
+ * Packets being recorded concurrently, or overwritten while they are read,
+ * are left out.
+ *
+ * @param[in] ring Target trace ring instance
+ * @param[out] recs Resulting packets, oldest first
+ * @param[in] recs_len Number of entries available in recs, which should be
+ *                     ::TRACE_RING_LEN to read the whole ring
+ *
+ * @returns Number of packets written to recs
+ */
+size_t trace_read(const struct trace_ring *ring, struct trace_record *recs, size_t recs_len);
+
+/*!
+ * @brief Records a packet in a trace ring
+ *
+ * @param[in,out] ring Target trace ring instance
+ * @param[in] stamp Time at which the packet was received, in microseconds
+ * @param[in] dir Direction the packet was forwarded in
+ * @param[in] type Type of proxy message the packet was carried in
+ * @param[in] flags Bitwise OR of TRACE_FLAG_* values
+ * @param[in] addr IPv4 address of the remote host, in network byte order
+ * @param[in] data Payload of the packet
+ * @param[in] len Number of bytes in data
+ * @param[in] snap_len Largest number of payload bytes to keep, which is
+ *                     limited to ::TRACE_SNAP_MAX
+ */
+void trace_record(struct trace_ring *ring, uint64_t stamp, enum TRACE_DIR dir, uint8_t type, uint8_t flags, uint32_t addr, const uint8_t *data, size_t len, size_t snap_len);
+
+/*!
+ * @brief Writes the packets in a set of trace rings to a pcapng file
+ *
+ * Each ring is written as an interface of its own, and the packets of all of
+ * them are merged in the order they were received. The proxy messages are
+ * written as the IPv4 packets they were forwarded as, with the UDP and TCP
+ * headers made up from what the proxy knows about them.
+ *
+ * @param[in] path Path of the file to write, which is replaced if it exists
+ * @param[in] sources Rings to write
+ * @param[in] num_sources Number of entries in sources
+ *
+ * @returns Number of packets written on success, negative ERRNO value on
+ *          failure
+ */
+int trace_dump(const char *path, const struct trace_source *sources, size_t num_sources);
+
+#endif /* _trace_h */
@@ -0,0 +1,147 @@
+/*!
+ * @file worker_pool.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for pools of worker threads
+ */
+
+#ifndef _worker_pool_h
+#define _worker_pool_h
+
+/*!
+ * @brief Represents an instance of a pool of worker threads
+ *
+ * Items submitted to the pool are each passed to worker_pool_handle::func_ptr
+ * on one of the pool's threads, in the order they were submitted. Some of the
+ * threads are started with the pool, and more are started as items are
+ * submitted while all of the running threads are busy, up to
+ * worker_pool_handle::max_threads. Threads are not stopped until the pool is,
+ * so the pool grows to the largest number of items ever being worked on at
+ * once.
+ *
+ * This struct should be initialized to zero before being used. The
+ * configuration fields must be set before calling ::worker_pool_init, and
+ * must not change until ::worker_pool_free.
+ */
+struct worker_pool_handle
+{
+	/// Private data - used internally by worker_pool functions
+	void *priv;
+
+	/// Function to call on a worker thread for each submitted item
+	void (*func_ptr)(struct worker_pool_handle *wp, void *item);
+
+	/// Arbitrary user data for use in worker_pool_handle::func_ptr
+	void *func_ctx;
+
+	/// Maximum number of threads in the pool, which is also the number of
+	/// items which may be waiting for a thread at once
+	unsigned int max_threads;
+
+	/// Number of threads to start along with the pool
+	unsigned int warm_threads;
+
+	/// Size for the stack used for each thread, or 0 for the system default
+	unsigned int stack_size;
+
+	/// Set of CPUs on which the threads may run, as in thread_handle::affinity
+	uint64_t affinity;
+
+	/// Scheduling priority for the threads, as in thread_handle::priority
+	unsigned int priority;
+};
+
+/*!
+ * @brief Frees data allocated by ::worker_pool_init
+ *
+ * @param[in,out] wp Target worker pool instance
+ */
+void worker_pool_free(struct worker_pool_handle *wp);
+
+/*!
+ * @brief Initializes the private data in a ::worker_pool_handle
+ *
+ * @param[in,out] wp Target worker pool instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int worker_pool_init(struct worker_pool_handle *wp);
+
+/*!
+ * @brief Starts the pool's warm threads and begins accepting items
+ *
+ * @param[in,out] wp Target worker pool instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int worker_pool_start(struct worker_pool_handle *wp);
+
+/*!
+ * @brief Stops accepting items, waits for the items which were already
+ *        submitted to be worked on, and stops all of the threads
+ *
+ * @param[in,out] wp Target worker pool instance
+ */
+void worker_pool_stop(struct worker_pool_handle *wp);
+
+/*!
+ * @brief Hands an item to the next available thread in the pool
+ *
+ * @param[in,out] wp Target worker pool instance
+ * @param[in] item Item to pass to worker_pool_handle::func_ptr
+ *
+ * @returns 0 on success, -ENOSPC if worker_pool_handle::max_threads items
+ *          are already waiting, -EINVAL if the pool is not started, other
+ *          negative ERRNO value on failure
+ */
+int worker_pool_submit(struct worker_pool_handle *wp, void *item);
+
+/*!
+ * @brief Gets the number of threads which have been started in the pool
+ *
+ * @param[in] wp Target worker pool instance
+ *
+ * @returns Number of threads currently running
+ */
+unsigned int worker_pool_threads(struct worker_pool_handle *wp);
+
+#endif /* _worker_pool_h */
@@ -0,0 +1,1441 @@
+/*!
+ * @file admin.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Local administrative interface for inspecting and draining slots
+ */
+
+#include "openelp/openelp.h"
+
+#include "admin.h"
+#include "clock.h"
+#include "conn.h"
+#include "mutex.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Time to wait for a command to arrive, in microseconds
+#define ADMIN_REQUEST_TIMEOUT 2000000
+
+/// Longest command line accepted
+#define ADMIN_REQUEST_MAX 256
+
+/// Initial size of the buffer which replies are built in
+#define ADMIN_BUFF_LEN 4096
+
+/// Time between the samples which traffic rates are computed from, in
+/// microseconds
+#define ADMIN_SAMPLE_INTERVAL 1000000
+
+/// Time to wait for the previous process to hand off, in microseconds
+#define ADMIN_HANDOFF_TIMEOUT 5000000
+
+/// Time between checks for the new process confirming that it has taken
+/// over, in microseconds
+#define ADMIN_HANDOFF_POLL 100000
+
+struct admin_buff
+{
+	/// Text which has been built so far
+	char *data;
+
+	/// Number of characters in admin_buff::data
+	size_t len;
+
+	/// Number of bytes allocated for admin_buff::data
+	size_t size;
+};
+
+/*!
+ * @brief Slot which is still in use by the process which handed off
+ */
+struct admin_busy
+{
+	/// Index of the slot in the process which has it
+	int slot;
+
+	/// Address the slot binds to, or "*" for any address
+	char addr[46];
+};
+
+struct admin_priv
+{
+	/// Thread which samples the slots and serves commands
+	struct thread_handle thread;
+
+	/// Mutex for protecting admin_priv::sentinel
+	struct mutex_handle mutex;
+
+	/// Condition variable for waking admin_priv::thread early
+	struct condvar_handle condvar;
+
+	/// Connection which listens for commands
+	struct conn_handle conn_listen;
+
+	/// Connection the command currently being served came from, which stays
+	/// open to the new process after a handoff
+	struct conn_handle conn_admin;
+
+	/// Connection to the previous process while taking over from it
+	struct conn_handle conn_handoff;
+
+	/// Lines received on admin_priv::conn_handoff which haven't been handled
+	char handoff_buff[ADMIN_REQUEST_MAX + 1];
+
+	/// Number of characters in admin_priv::handoff_buff
+	size_t handoff_len;
+
+	/// Slots which the process which handed off is still using
+	struct admin_busy *busy;
+
+	/// Number of entries in admin_priv::busy
+	size_t num_busy;
+
+	/// Buffer which replies are built in
+	struct admin_buff buff;
+
+	/// Most recent sample of the slot statistics
+	struct proxy_slot_stats *slots;
+
+	/// Sample of the slot statistics before admin_priv::slots
+	struct proxy_slot_stats *slots_prev;
+
+	/// Statistics of the slots as of the command being served
+	struct proxy_slot_stats *slots_live;
+
+	/// Number of slots in admin_priv::slots
+	size_t num_slots;
+
+	/// Number of slots in admin_priv::slots_prev
+	size_t num_slots_prev;
+
+	/// Number of entries allocated in each of the slot sample arrays
+	size_t slots_len;
+
+	/// Time at which admin_priv::slots was taken, in microseconds
+	uint64_t sample_time;
+
+	/// Time at which admin_priv::slots_prev was taken, in microseconds
+	uint64_t sample_time_prev;
+
+	/// Termination indicator for admin_priv::thread
+	uint8_t sentinel;
+
+	/// Non-zero once the listening connection has been sent through
+	/// admin_priv::conn_admin, until the new process confirms that it has
+	/// started
+	uint8_t handing_off;
+
+	/// Non-zero if the proxy was already draining when the handoff began,
+	/// and so stays drained if the new process fails to start
+	uint8_t handoff_drained;
+
+	/// Non-zero once the proxy has been handed off through
+	/// admin_priv::conn_admin
+	uint8_t handed_off;
+
+	/// Non-zero while admin_priv::conn_handoff is open
+	uint8_t taking_over;
+};
+
+/*!
+ * @brief Appends formatted text to a buffer, growing it as needed
+ *
+ * @param[in,out] buff Target buffer
+ * @param[in] fmt Format string
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int buff_printf(struct admin_buff *buff, const char *fmt, ...);
+
+/*!
+ * @brief Gets the current statistics of the slots
+ *
+ * If there are more slots than fit, all of the slot statistics arrays are
+ * grown.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ * @param[in,out] slots One of the slot statistics arrays in ::admin_priv
+ *
+ * @returns Number of slots on success, negative ERRNO value on failure
+ */
+static int fetch(struct admin_handle *ah, struct proxy_slot_stats **slots);
+
+/*!
+ * @brief Hands the proxy off to the process on admin_priv::conn_admin
+ *
+ * The listening socket is sent along with the addresses of the slots which
+ * are in use, and those addresses are released as the slots are freed. This
+ * process keeps accepting clients until the new one confirms that it has
+ * started, which is handled by ::handoff_confirm.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 1 if the listening socket was sent, 0 if an error was sent instead
+ */
+static int hand_off(struct admin_handle *ah);
+
+/*!
+ * @brief Reads the confirmation from the process being handed off to
+ *
+ * Once it has started, this process stops accepting clients. If it exits
+ * first, this process goes back to serving as though the handoff had never
+ * begun.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ */
+static void handoff_confirm(struct admin_handle *ah);
+
+/*!
+ * @brief Reads the addresses released by the process which handed off
+ *
+ * Once that process exits, the slots still waiting for it are resumed.
+ *
+ * @param[in,out] ah Target administrative interface instance
+ */
+static void handoff_recv(struct admin_handle *ah);
+
+/*!
+ * @brief Tells the new process about slots which are no longer in use
+ *
+ * @param[in,out] ah Target administrative interface instance
+ */
+static void handoff_release(struct admin_handle *ah);
+
+/*!
+ * @brief Drains or resumes the slots in this process binding to an address
+ *
+ * @param[in,out] ah Target administrative interface instance
+ * @param[in] addr Null-terminated address, or "*" for any address
+ * @param[in] drain Non-zero to drain the slots, zero to resume them
+ */
+static void handoff_slots(struct admin_handle *ah, const char *addr, int drain);
+
+/*!
+ * @brief Parses the slot index argument of a command
+ *
+ * @param[in] arg Null-terminated argument, or NULL if there is none
+ * @param[out] slot Index of the slot, or -1 if there is no argument
+ *
+ * @returns 0 on success, -EINVAL if the argument isn't a slot index
+ */
+static int parse_slot(const char *arg, int *slot);
+
+/*!
+ * @brief Builds the reply to the given command in admin_priv::buff
+ *
+ * @param[in,out] ah Target administrative interface instance
+ * @param[in,out] cmd Null-terminated command line, which is modified
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int render(struct admin_handle *ah, char *cmd);
+
+/*!
+ * @brief Adds the table of slots to admin_priv::buff
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int render_slots(struct admin_handle *ah);
+
+/*!
+ * @brief Takes a new sample of the slot statistics
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int sample(struct admin_handle *ah);
+
+/*!
+ * @brief Reads a command from admin_priv::conn_admin and replies to it
+ *
+ * @param[in,out] ah Target administrative interface instance
+ *
+ * @returns 1 if admin_priv::conn_admin must be kept open, 0 otherwise
+ */
+static int serve(struct admin_handle *ah);
+
+/*!
+ * @brief Worker thread for sampling the slots and serving commands
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * admin_thread(void *ctx);
+
+/*!
+ * @brief Sums the bytes of traffic forwarded to or from the client of a slot
+ *
+ * @param[in] stats Statistics of the slot
+ * @param[in] to_client Non-zero for traffic forwarded to the client
+ *
+ * @returns Number of bytes forwarded
+ */
+static uint64_t slot_bytes(const struct proxy_slot_stats *stats, int to_client);
+
+/*!
+ * @brief Computes the rate of traffic to or from the client of a slot
+ *
+ * @param[in] prev Earlier statistics of the slot
+ * @param[in] cur Later statistics of the slot
+ * @param[in] to_client Non-zero for traffic forwarded to the client
+ * @param[in] elapsed Time between the statistics, in microseconds
+ *
+ * @returns Rate in bytes per second, or 0 if the counters went backwards
+ */
+static uint64_t slot_rate(const struct proxy_slot_stats *prev, const struct proxy_slot_stats *cur, int to_client, uint64_t elapsed);
+
+/*!
+ * @brief Gets the name of the state a slot is in
+ *
+ * @param[in] stats Statistics of the slot
+ *
+ * @returns Static, null-terminated name of the state
+ */
+static const char * slot_state(const struct proxy_slot_stats *stats);
+
+static int buff_printf(struct admin_buff *buff, const char *fmt, ...)
+{
+	va_list args;
+	char *data;
+	int ret;
+
+	while (1)
+	{
+		va_start(args, fmt);
+		ret = vsnprintf(&buff->data[buff->len], buff->size - buff->len, fmt, args);
+		va_end(args);
+
+		if (ret < 0)
+		{
+			return -EINVAL;
+		}
+
+		if ((size_t)ret < buff->size - buff->len)
+		{
+			buff->len += (size_t)ret;
+
+			return 0;
+		}
+
+		data = realloc(buff->data, buff->size * 2);
+		if (data == NULL)
+		{
+			return -ENOMEM;
+		}
+
+		buff->data = data;
+		buff->size *= 2;
+	}
+}
+
+static int fetch(struct admin_handle *ah, struct proxy_slot_stats **slots)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	struct proxy_slot_stats **arrays[] = { &priv->slots, &priv->slots_prev, &priv->slots_live };
+	struct proxy_slot_stats *array;
+	struct proxy_stats stats;
+	size_t i;
+	int ret;
+
+	while (1)
+	{
+		ret = proxy_get_stats(ah->ph, &stats, *slots, priv->slots_len);
+		if (ret < 0 || (size_t)ret <= priv->slots_len)
+		{
+			return ret;
+		}
+
+		// Slots were added by reloading the configuration
+		for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+		{
+			array = realloc(*arrays[i], sizeof(struct proxy_slot_stats) * (size_t)ret);
+			if (array == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			*arrays[i] = array;
+		}
+
+		priv->slots_len = (size_t)ret;
+	}
+}
+
+static int hand_off(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	struct proxy_slot_stats *stats;
+	struct proxy_stats proxy_stats;
+	size_t num_slots;
+	size_t i;
+	int ret;
+
+	priv->buff.len = 0;
+
+	if (priv->handed_off || priv->handing_off || priv->taking_over)
+	{
+		buff_printf(&priv->buff, "ERROR %s\n", priv->taking_over ? "Still taking over from the previous process" : "Already handed off");
+		goto hand_off_exit;
+	}
+
+	ret = proxy_get_stats(ah->ph, &proxy_stats, NULL, 0);
+	if (ret < 0)
+	{
+		goto hand_off_fail;
+	}
+
+	// No more slots are given out here, so the list can't grow stale
+	ret = proxy_drain(ah->ph, -1);
+	if (ret < 0)
+	{
+		goto hand_off_fail;
+	}
+
+	ret = fetch(ah, &priv->slots_live);
+	if (ret < 0)
+	{
+		goto hand_off_resume;
+	}
+
+	num_slots = (size_t)ret;
+
+	free(priv->busy);
+	priv->num_busy = 0;
+
+	priv->busy = malloc(sizeof(struct admin_busy) * (num_slots > 0 ? num_slots : 1));
+	if (priv->busy == NULL)
+	{
+		ret = -ENOMEM;
+		goto hand_off_resume;
+	}
+
+	for (i = 0; i < num_slots; i++)
+	{
+		stats = &priv->slots_live[i];
+
+		// A client may still return to a slot held for it until the handoff
+		if (!stats->in_use && !stats->held)
+		{
+			continue;
+		}
+
+		priv->busy[priv->num_busy].slot = (int)i;
+		strcpy(priv->busy[priv->num_busy].addr, stats->source_addr[0] != '\0' ? stats->source_addr : "*");
+
+		ret = buff_printf(&priv->buff, "busy %s\n", priv->busy[priv->num_busy].addr);
+		if (ret < 0)
+		{
+			goto hand_off_resume;
+		}
+
+		priv->num_busy++;
+	}
+
+	ret = buff_printf(&priv->buff, "OK\n");
+	if (ret < 0)
+	{
+		goto hand_off_resume;
+	}
+
+	ret = conn_send_socket(&priv->conn_admin, ah->conn_clients, (const uint8_t *)priv->buff.data, priv->buff.len);
+	if (ret < 0)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_ERROR, "Failed to hand off the listening socket (%d): %s\n", -ret, strerror(-ret));
+		goto hand_off_resume;
+	}
+
+	// Nobody would be accepting clients if the new process failed to start
+	// after this one stopped, so that waits for its confirmation
+	priv->handing_off = 1;
+	priv->handoff_drained = proxy_stats.draining;
+	priv->handoff_len = 0;
+
+	proxy_log(ah->ph, LOG_LEVEL_INFO, "Sent the listening socket to the new process. Waiting for it to start...\n");
+
+	return 1;
+
+hand_off_resume:
+	priv->num_busy = 0;
+
+	if (!proxy_stats.draining)
+	{
+		proxy_resume(ah->ph, -1);
+	}
+
+hand_off_fail:
+	priv->buff.len = 0;
+	buff_printf(&priv->buff, "ERROR %s\n", strerror(-ret));
+
+hand_off_exit:
+	conn_send(&priv->conn_admin, (const uint8_t *)priv->buff.data, priv->buff.len);
+
+	return 0;
+}
+
+static void handoff_confirm(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	const struct proxy_conf *conf = &ah->ph->conf;
+	int ret;
+
+	ret = conn_recv_some(&priv->conn_admin, (uint8_t *)&priv->handoff_buff[priv->handoff_len], ADMIN_REQUEST_MAX - priv->handoff_len);
+	if (ret > 0)
+	{
+		priv->handoff_len += (size_t)ret;
+		priv->handoff_buff[priv->handoff_len] = '\0';
+
+		if (strstr(priv->handoff_buff, "ready\n") != NULL)
+		{
+			priv->handing_off = 0;
+			priv->handoff_len = 0;
+
+			ret = proxy_hand_off(ah->ph);
+			if (ret < 0)
+			{
+				proxy_log(ah->ph, LOG_LEVEL_WARN, "Failed to stop registering the proxy (%d): %s\n", -ret, strerror(-ret));
+			}
+
+			priv->handed_off = 1;
+
+			return;
+		}
+
+		// Nothing else the new process sends is this long
+		if (priv->handoff_len < ADMIN_REQUEST_MAX)
+		{
+			return;
+		}
+	}
+	else if (ret == -EAGAIN || ret == -EWOULDBLOCK || ret == -EINTR)
+	{
+		return;
+	}
+
+	proxy_log(ah->ph, LOG_LEVEL_WARN, "The new process exited before it started. Resuming...\n");
+
+	priv->handing_off = 0;
+	priv->handoff_len = 0;
+	priv->num_busy = 0;
+
+	conn_close(&priv->conn_admin);
+
+	// Nobody else has the listening socket anymore
+	ah->conn_clients->shared = 0;
+
+	// This also updates the registration, which was never given up
+	if (!priv->handoff_drained)
+	{
+		proxy_resume(ah->ph, -1);
+	}
+
+	// The new process may have replaced or removed the socket at the path
+	conn_close(&priv->conn_listen);
+
+	ret = conn_listen(&priv->conn_listen);
+	if (ret < 0)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_ERROR, "Failed to listen for administrative commands at '%s' (%d): %s\n", conf->admin_socket, -ret, strerror(-ret));
+	}
+}
+
+static void handoff_recv(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	char *line;
+	char *end;
+	size_t i;
+	int ret;
+
+	ret = conn_recv_some(&priv->conn_handoff, (uint8_t *)&priv->handoff_buff[priv->handoff_len], ADMIN_REQUEST_MAX - priv->handoff_len);
+	if (ret > 0)
+	{
+		priv->handoff_len += (size_t)ret;
+		priv->handoff_buff[priv->handoff_len] = '\0';
+
+		line = priv->handoff_buff;
+		while ((end = strchr(line, '\n')) != NULL)
+		{
+			*end = '\0';
+
+			if (strncmp(line, "release ", 8) == 0)
+			{
+				handoff_slots(ah, &line[8], 0);
+			}
+
+			line = end + 1;
+		}
+
+		priv->handoff_len -= (size_t)(line - priv->handoff_buff);
+		memmove(priv->handoff_buff, line, priv->handoff_len);
+
+		// Nothing the previous process sends is this long
+		if (priv->handoff_len < ADMIN_REQUEST_MAX)
+		{
+			return;
+		}
+	}
+
+	if (ret == -EAGAIN || ret == -EWOULDBLOCK || ret == -EINTR)
+	{
+		return;
+	}
+
+	proxy_log(ah->ph, LOG_LEVEL_INFO, "The previous process has exited\n");
+
+	for (i = 0; i < priv->num_busy; i++)
+	{
+		handoff_slots(ah, priv->busy[i].addr, 0);
+	}
+
+	priv->num_busy = 0;
+
+	conn_close(&priv->conn_handoff);
+	priv->handoff_len = 0;
+	priv->taking_over = 0;
+}
+
+static void handoff_release(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	const struct proxy_slot_stats *stats;
+	char line[64];
+	size_t i = 0;
+	int ret;
+
+	while (i < priv->num_busy)
+	{
+		if ((size_t)priv->busy[i].slot < priv->num_slots)
+		{
+			stats = &priv->slots[priv->busy[i].slot];
+			if (stats->in_use || stats->held)
+			{
+				i++;
+				continue;
+			}
+		}
+
+		snprintf(line, sizeof(line), "release %s\n", priv->busy[i].addr);
+
+		ret = conn_send(&priv->conn_admin, (const uint8_t *)line, strlen(line));
+		if (ret < 0)
+		{
+			// The new process is gone, so there is nobody left to tell
+			priv->num_busy = 0;
+			return;
+		}
+
+		priv->busy[i] = priv->busy[--priv->num_busy];
+	}
+}
+
+static void handoff_slots(struct admin_handle *ah, const char *addr, int drain)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	const struct proxy_slot_stats *stats;
+	size_t num_slots;
+	size_t i;
+	int ret;
+
+	ret = fetch(ah, &priv->slots_live);
+	if (ret < 0)
+	{
+		return;
+	}
+
+	num_slots = (size_t)ret;
+
+	for (i = 0; i < num_slots; i++)
+	{
+		stats = &priv->slots_live[i];
+
+		if (strcmp(stats->source_addr[0] != '\0' ? stats->source_addr : "*", addr) != 0)
+		{
+			continue;
+		}
+
+		ret = drain ? proxy_drain(ah->ph, (int)i) : proxy_resume(ah->ph, (int)i);
+		if (ret < 0)
+		{
+			proxy_log(ah->ph, LOG_LEVEL_ERROR, "Failed to %s proxy connection #%zu (%d): %s\n", drain ? "drain" : "resume", i, -ret, strerror(-ret));
+		}
+	}
+}
+
+static int parse_slot(const char *arg, int *slot)
+{
+	char extra;
+
+	if (arg == NULL)
+	{
+		*slot = -1;
+		return 0;
+	}
+
+	if (sscanf(arg, "%d%c", slot, &extra) != 1 || *slot < 0)
+	{
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int render(struct admin_handle *ah, char *cmd)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	struct proxy_stats stats;
+	const char *verb;
+	const char *arg;
+	const char *extra;
+	int slot;
+	int ret;
+
+	verb = strtok(cmd, " \t\r\n");
+	arg = verb == NULL ? NULL : strtok(NULL, " \t\r\n");
+	extra = arg == NULL ? NULL : strtok(NULL, " \t\r\n");
+
+	if (verb == NULL || strcmp(verb, "help") == 0)
+	{
+		return buff_printf(&priv->buff,
+			"slots           List the slots and their clients\n"
+			"status          Summarize the proxy\n"
+			"drain [SLOT]    Stop giving the slot, or the whole proxy, to new clients\n"
+			"resume [SLOT]   Resume giving the slot, or the whole proxy, to new clients\n"
+			"drop SLOT       Disconnect the client using the slot\n"
+			"trace [PATH]    Write the recent traffic of every slot to a pcapng file\n"
+			"OK\n");
+	}
+
+	if (strcmp(verb, "trace") == 0 && extra == NULL)
+	{
+		ret = proxy_dump_trace(ah->ph, arg, -1);
+		if (ret < 0)
+		{
+			return buff_printf(&priv->buff, "ERROR %s\n", ret == -EINVAL && arg == NULL ? "No TraceFile is configured" : strerror(-ret));
+		}
+
+		return buff_printf(&priv->buff, "packets %d\nOK\n", ret);
+	}
+
+	if (extra != NULL || parse_slot(arg, &slot) < 0)
+	{
+		return buff_printf(&priv->buff, "ERROR Invalid arguments to '%s'\n", verb);
+	}
+
+	if (strcmp(verb, "slots") == 0)
+	{
+		ret = render_slots(ah);
+		return ret < 0 ? ret : buff_printf(&priv->buff, "OK\n");
+	}
+
+	if (strcmp(verb, "status") == 0)
+	{
+		ret = proxy_get_stats(ah->ph, &stats, NULL, 0);
+		if (ret < 0)
+		{
+			return ret;
+		}
+
+		return buff_printf(&priv->buff,
+			"state %s\n"
+			"slots_used %" PRIu32 "\n"
+			"slots_total %" PRIu32 "\n"
+			"slots_exhausted %" PRIu64 "\n"
+			"auth_failures %" PRIu64 "\n"
+			"admission_refused %" PRIu64 "\n"
+			"OK\n",
+			stats.draining ? "draining" : "running", stats.slots_used, stats.slots_total,
+			stats.slots_exhausted, stats.auth_failures, stats.admission_refused);
+	}
+
+	if (strcmp(verb, "drain") == 0)
+	{
+		ret = proxy_drain(ah->ph, slot);
+	}
+	else if (strcmp(verb, "resume") == 0)
+	{
+		ret = proxy_resume(ah->ph, slot);
+	}
+	else if (strcmp(verb, "drop") == 0)
+	{
+		ret = slot < 0 ? -EINVAL : proxy_drop_slot(ah->ph, slot);
+	}
+	else
+	{
+		return buff_printf(&priv->buff, "ERROR Unknown command '%s'\n", verb);
+	}
+
+	if (ret < 0)
+	{
+		return buff_printf(&priv->buff, "ERROR %s\n", ret == -ENOENT ? "No such slot" : strerror(-ret));
+	}
+
+	return buff_printf(&priv->buff, "OK\n");
+}
+
+static int render_slots(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	const struct proxy_slot_stats *stats;
+	uint64_t elapsed = priv->sample_time - priv->sample_time_prev;
+	uint64_t rate_to;
+	uint64_t rate_from;
+	size_t num_slots;
+	size_t i;
+	int ret;
+
+	ret = fetch(ah, &priv->slots_live);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	num_slots = (size_t)ret;
+
+	ret = buff_printf(&priv->buff, "%-4s %-8s %-15s %-11s %8s %12s %12s\n",
+		"SLOT", "STATE", "ADDRESS", "CALLSIGN", "TIME", "TO_CLIENT", "FROM_CLIENT");
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	for (i = 0; i < num_slots; i++)
+	{
+		stats = &priv->slots_live[i];
+
+		// Rates are in bytes per second over the last sampling interval
+		rate_to = 0;
+		rate_from = 0;
+		if (stats->in_use && i < priv->num_slots && i < priv->num_slots_prev && elapsed > 0)
+		{
+			rate_to = slot_rate(&priv->slots_prev[i], &priv->slots[i], 1, elapsed);
+			rate_from = slot_rate(&priv->slots_prev[i], &priv->slots[i], 0, elapsed);
+		}
+
+		ret = buff_printf(&priv->buff, "%-4zu %-8s %-15s %-11s %8" PRIu32 " %12" PRIu64 " %12" PRIu64 "\n",
+			i, slot_state(stats), stats->source_addr[0] != '\0' ? stats->source_addr : "*",
+			stats->callsign[0] != '\0' ? stats->callsign : "-", stats->session_time,
+			rate_to, rate_from);
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int sample(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	struct proxy_slot_stats *slots;
+	int ret;
+
+	// The previous sample is overwritten with the new one
+	slots = priv->slots_prev;
+	priv->slots_prev = priv->slots;
+	priv->slots = slots;
+	priv->num_slots_prev = priv->num_slots;
+	priv->sample_time_prev = priv->sample_time;
+	priv->sample_time = clock_now_us();
+
+	ret = fetch(ah, &priv->slots);
+	if (ret < 0)
+	{
+		priv->num_slots = 0;
+		return ret;
+	}
+
+	priv->num_slots = (size_t)ret;
+
+	return 0;
+}
+
+static int serve(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	char req[ADMIN_REQUEST_MAX + 1];
+	size_t req_len = 0;
+	uint64_t deadline = clock_now_us() + ADMIN_REQUEST_TIMEOUT;
+	uint64_t now;
+	int ret;
+
+	// Only the first line matters
+	while (req_len < ADMIN_REQUEST_MAX)
+	{
+		now = clock_now_us();
+		if (now >= deadline)
+		{
+			return 0;
+		}
+
+		ret = conn_poll(&priv->conn_admin, (uint32_t)(deadline - now));
+		if (ret <= 0)
+		{
+			return 0;
+		}
+
+		ret = conn_recv_some(&priv->conn_admin, (uint8_t *)&req[req_len], ADMIN_REQUEST_MAX - req_len);
+		if (ret < 0 && ret != -EPIPE)
+		{
+			return 0;
+		}
+
+		req_len += ret > 0 ? (size_t)ret : 0;
+		req[req_len] = '\0';
+
+		if (ret == -EPIPE || strchr(req, '\n') != NULL)
+		{
+			break;
+		}
+	}
+
+	// The reply to a handoff carries the listening socket
+	if (strcspn(req, " \t\r\n") == 7 && strncmp(req, "handoff", 7) == 0)
+	{
+		return hand_off(ah);
+	}
+
+	priv->buff.len = 0;
+
+	ret = render(ah, req);
+	if (ret < 0)
+	{
+		priv->buff.len = 0;
+		buff_printf(&priv->buff, "ERROR %s\n", strerror(-ret));
+	}
+
+	conn_send(&priv->conn_admin, (const uint8_t *)priv->buff.data, priv->buff.len);
+
+	return 0;
+}
+
+static void * admin_thread(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct admin_handle *ah = (struct admin_handle *)th->func_ctx;
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	uint64_t now;
+	uint64_t wait;
+	uint8_t sentinel;
+	int ret;
+
+	while (1)
+	{
+		mutex_lock(&priv->mutex);
+		sentinel = priv->sentinel;
+		mutex_unlock(&priv->mutex);
+
+		if (sentinel)
+		{
+			break;
+		}
+
+		now = clock_now_us();
+		if (now - priv->sample_time >= ADMIN_SAMPLE_INTERVAL)
+		{
+			sample(ah);
+			now = priv->sample_time;
+
+			if (priv->handed_off)
+			{
+				handoff_release(ah);
+			}
+		}
+
+		wait = priv->sample_time + ADMIN_SAMPLE_INTERVAL - now;
+
+		if (priv->taking_over && conn_poll(&priv->conn_handoff, 0) != 0)
+		{
+			handoff_recv(ah);
+		}
+
+		if (priv->handing_off && conn_poll(&priv->conn_admin, 0) != 0)
+		{
+			handoff_confirm(ah);
+		}
+
+		// After a handoff, the socket path belongs to the new process
+		if (priv->handed_off || priv->handing_off)
+		{
+			if (priv->handing_off && wait > ADMIN_HANDOFF_POLL)
+			{
+				wait = ADMIN_HANDOFF_POLL;
+			}
+
+			mutex_lock(&priv->mutex);
+			if (!priv->sentinel)
+			{
+				condvar_wait_time(&priv->condvar, &priv->mutex, (uint32_t)((wait + 999) / 1000));
+			}
+			mutex_unlock(&priv->mutex);
+
+			continue;
+		}
+
+		ret = conn_poll(&priv->conn_listen, (uint32_t)wait);
+		if (ret > 0)
+		{
+			ret = conn_accept(&priv->conn_listen, &priv->conn_admin);
+			if (ret == 0 && serve(ah) == 0)
+			{
+				conn_close(&priv->conn_admin);
+			}
+		}
+
+		// Don't spin if accepting keeps failing, e.g. when out of descriptors
+		if (ret < 0)
+		{
+			mutex_lock(&priv->mutex);
+			if (!priv->sentinel)
+			{
+				condvar_wait_time(&priv->condvar, &priv->mutex, 100);
+			}
+			mutex_unlock(&priv->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static uint64_t slot_bytes(const struct proxy_slot_stats *stats, int to_client)
+{
+	if (to_client)
+	{
+		return stats->udp_data_in.bytes + stats->udp_control_in.bytes + stats->tcp_in.bytes;
+	}
+
+	return stats->udp_data_out.bytes + stats->udp_control_out.bytes + stats->tcp_out.bytes;
+}
+
+static uint64_t slot_rate(const struct proxy_slot_stats *prev, const struct proxy_slot_stats *cur, int to_client, uint64_t elapsed)
+{
+	uint64_t bytes_prev = slot_bytes(prev, to_client);
+	uint64_t bytes_cur = slot_bytes(cur, to_client);
+
+	if (bytes_cur < bytes_prev)
+	{
+		return 0;
+	}
+
+	return (bytes_cur - bytes_prev) * 1000000 / elapsed;
+}
+
+static const char * slot_state(const struct proxy_slot_stats *stats)
+{
+	if (stats->in_use)
+	{
+		return stats->draining ? "draining" : "active";
+	}
+
+	if (stats->held)
+	{
+		return "held";
+	}
+
+	return stats->draining ? "drained" : "idle";
+}
+
+void admin_free(struct admin_handle *ah)
+{
+	if (ah->priv != NULL)
+	{
+		struct admin_priv *priv = (struct admin_priv *)ah->priv;
+
+		admin_stop(ah);
+
+		thread_free(&priv->thread);
+
+		conn_free(&priv->conn_handoff);
+		conn_free(&priv->conn_admin);
+		conn_free(&priv->conn_listen);
+
+		condvar_free(&priv->condvar);
+		mutex_free(&priv->mutex);
+
+		free(priv->busy);
+		free(priv->buff.data);
+
+		free(ah->priv);
+		ah->priv = NULL;
+	}
+}
+
+int admin_init(struct admin_handle *ah)
+{
+	struct admin_priv *priv;
+	int ret;
+
+	if (ah->priv == NULL)
+	{
+		ah->priv = malloc(sizeof(struct admin_priv));
+	}
+
+	if (ah->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(ah->priv, 0x0, sizeof(struct admin_priv));
+
+	priv = (struct admin_priv *)ah->priv;
+
+	ret = mutex_init(&priv->mutex);
+	if (ret != 0)
+	{
+		goto admin_init_exit;
+	}
+
+	ret = condvar_init(&priv->condvar);
+	if (ret != 0)
+	{
+		goto admin_init_exit;
+	}
+
+	priv->conn_listen.type = CONN_TYPE_LOCAL;
+
+	ret = conn_init(&priv->conn_listen);
+	if (ret != 0)
+	{
+		goto admin_init_exit;
+	}
+
+	priv->conn_admin.type = CONN_TYPE_LOCAL;
+
+	ret = conn_init(&priv->conn_admin);
+	if (ret != 0)
+	{
+		goto admin_init_exit;
+	}
+
+	priv->conn_handoff.type = CONN_TYPE_LOCAL;
+
+	ret = conn_init(&priv->conn_handoff);
+	if (ret != 0)
+	{
+		goto admin_init_exit;
+	}
+
+	priv->thread.func_ptr = admin_thread;
+	priv->thread.func_ctx = ah;
+
+	ret = thread_init(&priv->thread);
+	if (ret != 0)
+	{
+		goto admin_init_exit;
+	}
+
+	return 0;
+
+admin_init_exit:
+	thread_free(&priv->thread);
+	conn_free(&priv->conn_handoff);
+	conn_free(&priv->conn_admin);
+	conn_free(&priv->conn_listen);
+	condvar_free(&priv->condvar);
+	mutex_free(&priv->mutex);
+
+	free(ah->priv);
+	ah->priv = NULL;
+
+	return ret;
+}
+
+int admin_start(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	const struct proxy_conf *conf = &ah->ph->conf;
+	size_t i;
+	int ret;
+
+	if (conf->admin_socket == NULL)
+	{
+		return 0;
+	}
+
+	if (priv->buff.data == NULL)
+	{
+		priv->buff.data = malloc(ADMIN_BUFF_LEN);
+		if (priv->buff.data == NULL)
+		{
+			return -ENOMEM;
+		}
+
+		priv->buff.size = ADMIN_BUFF_LEN;
+	}
+
+	priv->sentinel = 0;
+	priv->num_slots = 0;
+	priv->num_slots_prev = 0;
+	priv->sample_time = 0;
+	priv->sample_time_prev = 0;
+
+	// Slots can't be given out until the previous process is done with them
+	for (i = 0; i < priv->num_busy; i++)
+	{
+		handoff_slots(ah, priv->busy[i].addr, 1);
+	}
+
+	priv->conn_listen.source_addr = conf->admin_socket;
+
+	ret = conn_listen(&priv->conn_listen);
+	if (ret < 0)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_ERROR, "Failed to listen for administrative commands at '%s' (%d): %s\n", conf->admin_socket, -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = thread_start(&priv->thread);
+	if (ret < 0)
+	{
+		goto admin_start_exit;
+	}
+
+	proxy_log(ah->ph, LOG_LEVEL_INFO, "Accepting administrative commands at '%s'\n", conf->admin_socket);
+
+	return 0;
+
+admin_start_exit:
+	admin_stop(ah);
+
+	return ret;
+}
+
+int admin_take_over(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	const struct proxy_conf *conf = &ah->ph->conf;
+	struct admin_busy *busy;
+	char resp[ADMIN_BUFF_LEN + 1];
+	size_t resp_len = 0;
+	uint64_t deadline = clock_now_us() + ADMIN_HANDOFF_TIMEOUT;
+	uint64_t now;
+	char *line;
+	char *end;
+	int ret;
+
+	if (conf->admin_socket == NULL)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_ERROR, "Taking over from a running proxy requires AdminSocket\n");
+		return -EINVAL;
+	}
+
+	ret = conn_connect(&priv->conn_handoff, conf->admin_socket, NULL);
+	if (ret < 0)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_ERROR, "Failed to connect to the running proxy at '%s' (%d): %s\n", conf->admin_socket, -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = conn_send(&priv->conn_handoff, (const uint8_t *)"handoff\n", 8);
+	if (ret < 0)
+	{
+		goto admin_take_over_exit;
+	}
+
+	// The listening socket comes with the start of the reply, and the rest
+	// of it lists the slots which are still in use
+	while (resp_len < ADMIN_BUFF_LEN && (resp_len == 0 || strstr(resp, "OK\n") == NULL))
+	{
+		now = clock_now_us();
+		if (now >= deadline)
+		{
+			ret = -ETIMEDOUT;
+			goto admin_take_over_exit;
+		}
+
+		ret = conn_poll(&priv->conn_handoff, (uint32_t)(deadline - now));
+		if (ret == 0)
+		{
+			ret = -ETIMEDOUT;
+		}
+
+		if (ret <= 0)
+		{
+			goto admin_take_over_exit;
+		}
+
+		if (resp_len == 0)
+		{
+			ret = conn_recv_socket(&priv->conn_handoff, ah->conn_clients, (uint8_t *)resp, ADMIN_BUFF_LEN);
+		}
+		else
+		{
+			ret = conn_recv_some(&priv->conn_handoff, (uint8_t *)&resp[resp_len], ADMIN_BUFF_LEN - resp_len);
+		}
+
+		if (ret < 0)
+		{
+			goto admin_take_over_exit;
+		}
+
+		resp_len += (size_t)ret;
+		resp[resp_len] = '\0';
+	}
+
+	if (strstr(resp, "OK\n") == NULL)
+	{
+		ret = -EBADMSG;
+		goto admin_take_over_exit;
+	}
+
+	for (line = resp; (end = strchr(line, '\n')) != NULL; line = end + 1)
+	{
+		*end = '\0';
+
+		if (strncmp(line, "busy ", 5) != 0)
+		{
+			continue;
+		}
+
+		busy = realloc(priv->busy, sizeof(struct admin_busy) * (priv->num_busy + 1));
+		if (busy == NULL)
+		{
+			ret = -ENOMEM;
+			goto admin_take_over_exit;
+		}
+
+		priv->busy = busy;
+
+		busy = &priv->busy[priv->num_busy++];
+		busy->slot = -1;
+		snprintf(busy->addr, sizeof(busy->addr), "%s", &line[5]);
+	}
+
+	priv->taking_over = 1;
+
+	proxy_log(ah->ph, LOG_LEVEL_INFO, "Took over from the running proxy, which is still serving %zu clients\n", priv->num_busy);
+
+	return 0;
+
+admin_take_over_exit:
+	proxy_log(ah->ph, LOG_LEVEL_ERROR, "The running proxy didn't hand off (%d): %s\n", -ret, strerror(-ret));
+
+	conn_close(ah->conn_clients);
+	conn_close(&priv->conn_handoff);
+
+	free(priv->busy);
+	priv->busy = NULL;
+	priv->num_busy = 0;
+
+	return ret;
+}
+
+void admin_confirm(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+	int ret;
+
+	ret = conn_send(&priv->conn_handoff, (const uint8_t *)"ready\n", 6);
+	if (ret < 0)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_WARN, "Failed to tell the previous process that this one has started (%d): %s\n", -ret, strerror(-ret));
+	}
+
+	// The previous process stops accepting clients once it hears this, so
+	// shutting the socket down no longer affects it
+	ah->conn_clients->shared = 0;
+}
+
+void admin_stop(struct admin_handle *ah)
+{
+	struct admin_priv *priv = (struct admin_priv *)ah->priv;
+
+	if (priv == NULL)
+	{
+		return;
+	}
+
+	mutex_lock(&priv->mutex);
+	priv->sentinel = 1;
+	condvar_wake_all(&priv->condvar);
+	mutex_unlock(&priv->mutex);
+
+	// Unblock the thread if it is waiting for a command
+	conn_shutdown(&priv->conn_listen);
+
+	thread_join(&priv->thread);
+
+	conn_close(&priv->conn_listen);
+
+	// After a handoff, the socket at the path is the new process's
+	if (priv->conn_listen.source_addr != NULL && !priv->handed_off && !priv->handing_off)
+	{
+		remove(priv->conn_listen.source_addr);
+	}
+
+	priv->conn_listen.source_addr = NULL;
+
+	// Closing these lets the other process know that this one is done
+	conn_close(&priv->conn_admin);
+	conn_close(&priv->conn_handoff);
+
+	priv->handoff_len = 0;
+	priv->handing_off = 0;
+	priv->handed_off = 0;
+	priv->taking_over = 0;
+
+	free(priv->busy);
+	priv->busy = NULL;
+	priv->num_busy = 0;
+
+	free(priv->slots);
+	priv->slots = NULL;
+
+	free(priv->slots_prev);
+	priv->slots_prev = NULL;
+
+	free(priv->slots_live);
+	priv->slots_live = NULL;
+
+	priv->slots_len = 0;
+}
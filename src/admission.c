@@ -0,0 +1,449 @@
+/*!
+ * @file admission.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of the client admission rate limiting table
+ */
+
+#include "admission.h"
+#include "atomic.h"
+#include "clock.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Number of consecutive entries an address may use, starting at its hash
+#define ADMISSION_PROBES 8
+
+/// Time in milliseconds after which an unused entry may be given to another
+/// address, by which point its bucket would have refilled
+#define ADMISSION_IDLE_MS 60000
+
+/// Time in milliseconds after which an address's failures are forgotten
+#define ADMISSION_FORGET_MS 3600000
+
+/// Maximum number of times the penalty is doubled for further failures
+#define ADMISSION_PENALTY_SHIFT_MAX 6
+
+/// Longest time in milliseconds that an address is refused for
+#define ADMISSION_PENALTY_MAX_MS 86400000
+
+/// Number of milli-tokens taken from an address's bucket for a connection
+#define ADMISSION_TOKEN 1000
+
+/*!
+ * @brief State for a single address
+ *
+ * Times are in milliseconds since ::admission_init, truncated to 32 bits.
+ */
+struct admission_entry
+{
+	/// Hash of the address using the entry, or 0 if the entry is unused
+	volatile uint64_t key;
+
+	/// Time at which the bucket was last updated in the upper half, and the
+	/// milli-tokens left in it in the lower half, or 0 if the bucket is full
+	volatile uint64_t bucket;
+
+	/// Time of the last failure in the upper half, and the number of
+	/// consecutive failures in the lower half
+	volatile uint64_t failures;
+
+	/// Time until which the address is refused, or 0 if it is not
+	volatile uint32_t refused_until;
+
+	/// Time at which the entry was last used
+	volatile uint32_t last_used;
+};
+
+/*!
+ * @brief Private data for an instance of an admission table
+ */
+struct admission_priv
+{
+	/// Storage for the state of each address
+	struct admission_entry *entries;
+
+	/// Time in microseconds from which the entries' times are measured
+	uint64_t start;
+};
+
+/*!
+ * @brief Finds the entry used by an address
+ *
+ * @param[in,out] ah Target admission table instance
+ * @param[in] addr Null-terminated address to find
+ * @param[in] now Current time, as stored in the entries
+ * @param[in] create Non-zero to claim an entry if the address has none
+ *
+ * @returns Entry for the address, or NULL if it has none and none could be
+ *          claimed
+ */
+static struct admission_entry * admission_find(struct admission_handle *ah, const char *addr, uint32_t now, int create);
+
+/*!
+ * @brief Computes the key used to find an address in the table
+ *
+ * @param[in] addr Null-terminated address
+ *
+ * @returns Non-zero hash of the address
+ */
+static uint64_t admission_key(const char *addr);
+
+/*!
+ * @brief Gets the current time, as stored in the entries
+ *
+ * @param[in] priv Private data of the target admission table
+ *
+ * @returns Milliseconds since ::admission_init, truncated to 32 bits
+ */
+static uint32_t admission_now(const struct admission_priv *priv);
+
+static struct admission_entry * admission_find(struct admission_handle *ah, const char *addr, uint32_t now, int create)
+{
+	struct admission_priv *priv = (struct admission_priv *)ah->priv;
+	struct admission_entry *entry;
+	struct admission_entry *victim = NULL;
+	uint64_t victim_key = 0;
+	uint64_t key = admission_key(addr);
+	uint64_t cur;
+	uint32_t until;
+	size_t i;
+
+	for (i = 0; i < ADMISSION_PROBES && i < ah->size; i++)
+	{
+		entry = &priv->entries[(key + i) & (ah->size - 1)];
+
+		cur = atomic_u64_load(&entry->key);
+		if (cur == 0 && create)
+		{
+			if (atomic_u64_cas(&entry->key, 0, key))
+			{
+				atomic_u32_store(&entry->last_used, now);
+
+				return entry;
+			}
+
+			cur = atomic_u64_load(&entry->key);
+		}
+
+		if (cur == key)
+		{
+			atomic_u32_store(&entry->last_used, now);
+
+			return entry;
+		}
+
+		// Entries are never released, so an unused one ends the search
+		if (cur == 0)
+		{
+			return NULL;
+		}
+
+		until = atomic_u32_load(&entry->refused_until);
+		if (victim == NULL && now - atomic_u32_load(&entry->last_used) > ADMISSION_IDLE_MS &&
+			(until == 0 || (int32_t)(until - now) <= 0))
+		{
+			victim = entry;
+			victim_key = cur;
+		}
+	}
+
+	if (!create || victim == NULL || !atomic_u64_cas(&victim->key, victim_key, key))
+	{
+		return NULL;
+	}
+
+	// Another thread using the same address may see the previous address's
+	// state until this is done, which is harmless
+	do
+	{
+		cur = atomic_u64_load(&victim->bucket);
+	} while (!atomic_u64_cas(&victim->bucket, cur, 0));
+
+	do
+	{
+		cur = atomic_u64_load(&victim->failures);
+	} while (!atomic_u64_cas(&victim->failures, cur, 0));
+
+	atomic_u32_store(&victim->refused_until, 0);
+	atomic_u32_store(&victim->last_used, now);
+
+	return victim;
+}
+
+static uint64_t admission_key(const char *addr)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (; *addr != '\0'; addr++)
+	{
+		hash ^= (uint8_t)*addr;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash == 0 ? 1 : hash;
+}
+
+static uint32_t admission_now(const struct admission_priv *priv)
+{
+	return (uint32_t)((clock_now_us() - priv->start) / 1000);
+}
+
+int admission_check(struct admission_handle *ah, const char *addr)
+{
+	struct admission_priv *priv = (struct admission_priv *)ah->priv;
+	struct admission_entry *entry;
+	uint64_t capacity;
+	uint64_t tokens;
+	uint64_t next;
+	uint64_t cur;
+	uint32_t elapsed;
+	uint32_t until;
+	uint32_t now;
+
+	if (ah->rate == 0 && ah->max_failures == 0)
+	{
+		return 0;
+	}
+
+	now = admission_now(priv);
+
+	entry = admission_find(ah, addr, now, 1);
+	if (entry == NULL)
+	{
+		return 0;
+	}
+
+	until = atomic_u32_load(&entry->refused_until);
+	if (until != 0 && (int32_t)(until - now) > 0)
+	{
+		return -EACCES;
+	}
+
+	if (ah->rate == 0)
+	{
+		return 0;
+	}
+
+	capacity = (uint64_t)(ah->burst > 0 ? ah->burst : 1) * ADMISSION_TOKEN;
+
+	do
+	{
+		cur = atomic_u64_load(&entry->bucket);
+		if (cur == 0)
+		{
+			tokens = capacity;
+		}
+		else
+		{
+			// The bucket gains admission_handle::rate milli-tokens each
+			// millisecond
+			elapsed = now - (uint32_t)(cur >> 32);
+			tokens = (uint32_t)cur;
+			if ((int32_t)elapsed > 0)
+			{
+				tokens += (uint64_t)elapsed * ah->rate;
+			}
+			if (tokens > capacity)
+			{
+				tokens = capacity;
+			}
+		}
+
+		if (tokens < ADMISSION_TOKEN)
+		{
+			return -EAGAIN;
+		}
+
+		// An empty bucket at time 0 is kept from looking like a full one by
+		// leaving a milli-token in it
+		next = ((uint64_t)now << 32) | (tokens - ADMISSION_TOKEN);
+		if (next == 0)
+		{
+			next = 1;
+		}
+	} while (!atomic_u64_cas(&entry->bucket, cur, next));
+
+	return 0;
+}
+
+uint32_t admission_fail(struct admission_handle *ah, const char *addr)
+{
+	struct admission_priv *priv = (struct admission_priv *)ah->priv;
+	struct admission_entry *entry;
+	uint64_t duration;
+	uint64_t cur;
+	uint32_t count;
+	uint32_t until;
+	uint32_t shift;
+	uint32_t now;
+
+	if (ah->max_failures == 0)
+	{
+		return 0;
+	}
+
+	now = admission_now(priv);
+
+	entry = admission_find(ah, addr, now, 1);
+	if (entry == NULL)
+	{
+		return 0;
+	}
+
+	do
+	{
+		cur = atomic_u64_load(&entry->failures);
+		count = (uint32_t)cur;
+		if (count > 0 && now - (uint32_t)(cur >> 32) > ADMISSION_FORGET_MS)
+		{
+			count = 0;
+		}
+		if (count < UINT32_MAX)
+		{
+			count++;
+		}
+	} while (!atomic_u64_cas(&entry->failures, cur, ((uint64_t)now << 32) | count));
+
+	if (count >= ah->max_failures && ah->penalty > 0)
+	{
+		shift = count - ah->max_failures;
+		if (shift > ADMISSION_PENALTY_SHIFT_MAX)
+		{
+			shift = ADMISSION_PENALTY_SHIFT_MAX;
+		}
+
+		duration = ((uint64_t)ah->penalty * 1000) << shift;
+		if (duration > ADMISSION_PENALTY_MAX_MS)
+		{
+			duration = ADMISSION_PENALTY_MAX_MS;
+		}
+
+		until = now + (uint32_t)duration;
+		atomic_u32_store(&entry->refused_until, until == 0 ? 1 : until);
+	}
+
+	return count;
+}
+
+void admission_forgive(struct admission_handle *ah, const char *addr)
+{
+	struct admission_priv *priv = (struct admission_priv *)ah->priv;
+	struct admission_entry *entry;
+	uint64_t cur;
+
+	if (ah->max_failures == 0)
+	{
+		return;
+	}
+
+	entry = admission_find(ah, addr, admission_now(priv), 0);
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	do
+	{
+		cur = atomic_u64_load(&entry->failures);
+	} while (!atomic_u64_cas(&entry->failures, cur, 0));
+
+	atomic_u32_store(&entry->refused_until, 0);
+}
+
+void admission_free(struct admission_handle *ah)
+{
+	if (ah->priv != NULL)
+	{
+		struct admission_priv *priv = (struct admission_priv *)ah->priv;
+
+		free(priv->entries);
+
+		free(ah->priv);
+		ah->priv = NULL;
+	}
+}
+
+int admission_init(struct admission_handle *ah)
+{
+	struct admission_priv *priv;
+	int ret;
+
+	if (ah->size == 0 || (ah->size & (ah->size - 1)) != 0)
+	{
+		return -EINVAL;
+	}
+
+	if (ah->priv == NULL)
+	{
+		ah->priv = malloc(sizeof(struct admission_priv));
+	}
+
+	if (ah->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(ah->priv, 0x0, sizeof(struct admission_priv));
+
+	priv = (struct admission_priv *)ah->priv;
+
+	priv->entries = calloc(ah->size, sizeof(struct admission_entry));
+	if (priv->entries == NULL)
+	{
+		ret = -ENOMEM;
+		goto admission_init_exit;
+	}
+
+	priv->start = clock_now_us();
+
+	return 0;
+
+admission_init_exit:
+	free(ah->priv);
+	ah->priv = NULL;
+
+	return ret;
+}
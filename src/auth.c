@@ -0,0 +1,756 @@
+/*!
+ * @file auth.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of the client authentication stage
+ */
+
+#include "openelp/openelp.h"
+
+#include "atomic.h"
+#include "auth.h"
+#include "clock.h"
+#include "conn.h"
+#include "conn_pool.h"
+#include "digest.h"
+#include "mutex.h"
+#include "proxy_conn.h"
+#include "reactor.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Time a client is given to authenticate before it is dropped
+#define AUTH_TIMEOUT_US 10000000
+
+/// Time in milliseconds between checks for clients which have run out of
+/// time to authenticate
+#define AUTH_SWEEP_INTERVAL 1000
+
+/// Maximum length of a client's callsign, not including the newline
+#define AUTH_CALLSIGN_MAX 10
+
+/*!
+ * @brief A client which is in the process of authenticating
+ */
+struct auth_pending
+{
+	/// Reference to the authentication stage instance
+	struct auth_handle *ah;
+
+	/// Watch for the client's response, which holds the client connection
+	struct reactor_watch watch;
+
+	/// Time at which the client is dropped if it has not authenticated
+	uint64_t deadline;
+
+	/// Response to the nonce which the client is expected to send
+	uint8_t response[PROXY_PASS_RES_LEN];
+
+	/// Callsign and password response received from the client so far
+	uint8_t buff[AUTH_CALLSIGN_MAX + 1 + PROXY_PASS_RES_LEN];
+
+	/// Number of bytes in auth_pending::buff
+	size_t len;
+
+	/// Length of the callsign including its newline, or 0 if not yet known
+	size_t callsign_len;
+
+	/// Outcome of the authentication, once the watch has been detached
+	int result;
+
+	/// Non-zero while the entry is being used for a client
+	uint8_t in_use;
+};
+
+/*!
+ * @brief Private data for an instance of the client authentication stage
+ */
+struct auth_priv
+{
+	/// Storage for each of the clients which may be authenticating at once
+	struct auth_pending *pending;
+
+	/// Mutex for protecting auth_pending::in_use
+	struct mutex_handle mutex;
+
+	/// Mutex serializing the functions which claim and evict entries, so
+	/// that an entry is never claimed or evicted twice
+	struct mutex_handle claim_mutex;
+
+	/// Digest state of the proxy password, for computing nonce responses
+	struct digest_password password;
+
+	/// Event-driven engine for receiving responses from clients
+	struct reactor_handle reactor;
+
+	/// Thread dropping clients which have run out of time, even when no
+	/// new clients are arriving
+	struct thread_handle sweep_thread;
+
+	/// Signaled when auth_priv::sweep_sentinel is set
+	struct condvar_handle sweep_condvar;
+
+	/// Termination indicator for auth_priv::sweep_thread, protected by
+	/// auth_priv::mutex
+	uint8_t sweep_sentinel;
+
+	/// Non-zero while auth_priv::sweep_thread is running
+	uint8_t sweep_running;
+
+	/// Number of clients which did not authenticate successfully
+	volatile uint64_t failures;
+};
+
+/*!
+ * @brief Verify the response received from a client
+ *
+ * @param[in,out] pending Client which has sent its entire response
+ *
+ * @returns 0 if the client is authorized, negative ERRNO value otherwise
+ */
+static int auth_check(struct auth_pending *pending);
+
+/*!
+ * @brief Drop a client before it has finished authenticating
+ *
+ * If the client finished authenticating first, nothing is done.
+ *
+ * @param[in,out] ah Target authentication stage instance
+ * @param[in,out] pending Client to drop
+ * @param[in] reason Null-terminated reason the client is being dropped
+ */
+static void auth_evict(struct auth_handle *ah, struct auth_pending *pending, const char *reason);
+
+/*!
+ * @brief Drop clients which have run out of time to authenticate
+ *
+ * The caller must hold auth_priv::claim_mutex.
+ *
+ * @param[in,out] ah Target authentication stage instance
+ * @param[in] now Current time in microseconds
+ */
+static void auth_expire(struct auth_handle *ah, uint64_t now);
+
+/*!
+ * @brief Mark an entry as no longer being used for a client
+ *
+ * @param[in,out] ah Target authentication stage instance
+ * @param[in,out] pending Entry to release
+ */
+static void auth_release(struct auth_handle *ah, struct auth_pending *pending);
+
+/*!
+ * @brief Periodically drops clients which have run out of time
+ *
+ * @param[in,out] ctx Thread handle, whose context is the authentication
+ *                stage instance
+ *
+ * @returns Always NULL
+ */
+static void * sweep_worker(void *ctx);
+
+/*!
+ * @brief Callback for when a client's response can be read
+ *
+ * @param[in,out] watch Reactor watch for the client
+ *
+ * @returns 0 if more of the response is expected, 1 once the authentication
+ *          has succeeded or failed
+ */
+static int watch_pending(struct reactor_watch *watch);
+
+/*!
+ * @brief Callback for completing a client's authentication
+ *
+ * @param[in,out] watch Reactor watch for the client
+ */
+static void watch_pending_detach(struct reactor_watch *watch);
+
+static int auth_check(struct auth_pending *pending)
+{
+	struct auth_handle *ah = pending->ah;
+	const char *callsign = (const char *)pending->buff;
+	int ret;
+
+	if (!digest_equal(pending->response, &pending->buff[pending->callsign_len]))
+	{
+		proxy_log(ah->ph, LOG_LEVEL_INFO, "Client '%s' supplied an incorrect password. Dropping...\n", callsign);
+
+		proxy_log(ah->ph, LOG_LEVEL_DEBUG, "Sending SYSTEM message (%d) to client '%s'\n", SYSTEM_MSG_BAD_PASSWORD, callsign);
+
+		ret = proxy_conn_reject(pending->watch.conn, SYSTEM_MSG_BAD_PASSWORD);
+
+		return ret < 0 ? ret : -EACCES;
+	}
+
+	ret = proxy_authorize_callsign(ah->ph, callsign);
+	if (ret != 1)
+	{
+		proxy_log(ah->ph, LOG_LEVEL_INFO, "Client '%s' is not authorized to use this proxy. Dropping...\n", callsign);
+
+		proxy_log(ah->ph, LOG_LEVEL_DEBUG, "Sending SYSTEM message (%d) to client '%s'\n", SYSTEM_MSG_ACCESS_DENIED, callsign);
+
+		ret = proxy_conn_reject(pending->watch.conn, SYSTEM_MSG_ACCESS_DENIED);
+
+		return ret < 0 ? ret : -EACCES;
+	}
+
+	return 0;
+}
+
+static void auth_evict(struct auth_handle *ah, struct auth_pending *pending, const char *reason)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+	char remote_addr[46];
+
+	// If the watch was already detached, the client has finished
+	// authenticating and the entry has been released
+	if (reactor_del(&priv->reactor, &pending->watch) != 1)
+	{
+		return;
+	}
+
+	conn_get_remote_addr(pending->watch.conn, remote_addr);
+	proxy_log(ah->ph, LOG_LEVEL_INFO, "Client '%s' %s. Dropping...\n", remote_addr, reason);
+
+	atomic_u64_add(&priv->failures, 1);
+
+	conn_close(pending->watch.conn);
+	conn_pool_put(ah->conn_pool, pending->watch.conn);
+
+	auth_release(ah, pending);
+}
+
+static void auth_expire(struct auth_handle *ah, uint64_t now)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+	unsigned int i;
+	int expired;
+
+	for (i = 0; i < ah->max_pending; i++)
+	{
+		mutex_lock(&priv->mutex);
+		expired = priv->pending[i].in_use && now >= priv->pending[i].deadline;
+		mutex_unlock(&priv->mutex);
+
+		if (expired)
+		{
+			auth_evict(ah, &priv->pending[i], "did not authenticate in time");
+		}
+	}
+}
+
+static void auth_release(struct auth_handle *ah, struct auth_pending *pending)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+
+	mutex_lock(&priv->mutex);
+
+	pending->watch.conn = NULL;
+	pending->in_use = 0;
+
+	mutex_unlock(&priv->mutex);
+}
+
+static void * sweep_worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct auth_handle *ah = (struct auth_handle *)th->func_ctx;
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+
+	while (1)
+	{
+		mutex_lock(&priv->mutex);
+
+		if (!priv->sweep_sentinel)
+		{
+			condvar_wait_time(&priv->sweep_condvar, &priv->mutex, AUTH_SWEEP_INTERVAL);
+		}
+
+		if (priv->sweep_sentinel)
+		{
+			mutex_unlock(&priv->mutex);
+
+			break;
+		}
+
+		mutex_unlock(&priv->mutex);
+
+		mutex_lock(&priv->claim_mutex);
+		auth_expire(ah, clock_now_us());
+		mutex_unlock(&priv->claim_mutex);
+	}
+
+	return NULL;
+}
+
+static int watch_pending(struct reactor_watch *watch)
+{
+	struct auth_pending *pending = (struct auth_pending *)watch->func_ctx;
+	size_t expected;
+	size_t idx;
+	int ret;
+
+	// We can expect to receive a newline-terminated callsign and a 16-byte
+	// password response.
+	// Since this is variable-length, initially look only for 16 bytes. The
+	// callsign will be part of that, and we can figure out how much we're
+	// missing. Reading any more than that could consume the client's first
+	// message.
+	expected = pending->callsign_len == 0 ? PROXY_PASS_RES_LEN : pending->callsign_len + PROXY_PASS_RES_LEN;
+
+	ret = conn_recv_some(watch->conn, &pending->buff[pending->len], expected - pending->len);
+	if (ret < 0)
+	{
+		pending->result = ret;
+		return 1;
+	}
+
+	pending->len += (size_t)ret;
+
+	if (pending->callsign_len == 0 && pending->len >= PROXY_PASS_RES_LEN)
+	{
+		for (idx = 0; idx <= AUTH_CALLSIGN_MAX && pending->buff[idx] != '\n'; idx++);
+
+		if (idx > AUTH_CALLSIGN_MAX)
+		{
+			pending->result = -EINVAL;
+			return 1;
+		}
+
+		// Make the callsign null-terminated
+		pending->buff[idx] = '\0';
+		pending->callsign_len = idx + 1;
+	}
+
+	if (pending->callsign_len == 0 || pending->len < pending->callsign_len + PROXY_PASS_RES_LEN)
+	{
+		return 0;
+	}
+
+	pending->result = auth_check(pending);
+
+	return 1;
+}
+
+static void watch_pending_detach(struct reactor_watch *watch)
+{
+	struct auth_pending *pending = (struct auth_pending *)watch->func_ctx;
+	struct auth_handle *ah = pending->ah;
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+	char remote_addr[46];
+
+	if (ah->admission != NULL && (pending->result == 0 || pending->result == -EACCES))
+	{
+		conn_get_remote_addr(watch->conn, remote_addr);
+
+		if (pending->result == 0)
+		{
+			admission_forgive(ah->admission, remote_addr);
+		}
+		else if (admission_fail(ah->admission, remote_addr) == ah->admission->max_failures && ah->admission->penalty > 0)
+		{
+			proxy_log(ah->ph, LOG_LEVEL_INFO, "Refusing further connections from '%s' after %" PRIu32 " failures\n", remote_addr, ah->admission->max_failures);
+		}
+	}
+
+	if (pending->result == 0)
+	{
+		ah->func_ptr(ah, watch->conn, (const char *)pending->buff);
+	}
+	else
+	{
+		atomic_u64_add(&priv->failures, 1);
+
+		switch (pending->result)
+		{
+		case -ECONNRESET:
+		case -EINTR:
+		case -ENOTCONN:
+		case -EPIPE:
+			proxy_log(ah->ph, LOG_LEVEL_WARN, "Connection to client was lost before authorization could complete\n");
+			break;
+		default:
+			conn_get_remote_addr(watch->conn, remote_addr);
+			proxy_log(ah->ph, LOG_LEVEL_ERROR, "Authorization failed for client '%s' (%d): %s\n", remote_addr, -pending->result, strerror(-pending->result));
+		}
+
+		conn_close(watch->conn);
+		conn_pool_put(ah->conn_pool, watch->conn);
+	}
+
+	auth_release(ah, pending);
+}
+
+int auth_begin(struct auth_handle *ah, struct conn_handle *conn_client)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+	struct auth_pending *pending = NULL;
+	struct auth_pending *oldest = NULL;
+	uint64_t now = clock_now_us();
+	uint32_t nonce;
+	char nonce_str[9];
+	unsigned int i;
+	int ret;
+
+	mutex_lock(&priv->claim_mutex);
+
+	// Clients which have run out of time are also dropped by the sweep
+	// thread, but doing it here first may leave room for this one
+	auth_expire(ah, now);
+
+	mutex_lock(&priv->mutex);
+
+	for (i = 0; i < ah->max_pending; i++)
+	{
+		if (!priv->pending[i].in_use)
+		{
+			pending = &priv->pending[i];
+			break;
+		}
+		else if (oldest == NULL || priv->pending[i].deadline < oldest->deadline)
+		{
+			oldest = &priv->pending[i];
+		}
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	// Only this function puts entries to use, so an entry which has been
+	// released stays free
+	if (pending == NULL)
+	{
+		auth_evict(ah, oldest, "was taking too long to authenticate");
+		pending = oldest;
+	}
+
+	mutex_lock(&priv->mutex);
+
+	pending->in_use = 1;
+	pending->watch.conn = conn_client;
+
+	mutex_unlock(&priv->mutex);
+
+	pending->deadline = now + AUTH_TIMEOUT_US;
+	pending->len = 0;
+	pending->callsign_len = 0;
+	pending->result = 0;
+
+	ret = get_nonce(&nonce);
+	if (ret < 0)
+	{
+		goto auth_begin_exit;
+	}
+
+	digest_to_hex32(nonce, nonce_str);
+
+	// Generate the expected auth response
+	digest_password_response(&priv->password, nonce, pending->response);
+
+	// Send the nonce
+	ret = conn_send(conn_client, (uint8_t *)nonce_str, 8);
+	if (ret < 0)
+	{
+		goto auth_begin_exit;
+	}
+
+	ret = reactor_add(&priv->reactor, &pending->watch);
+	if (ret < 0)
+	{
+		goto auth_begin_exit;
+	}
+
+	mutex_unlock(&priv->claim_mutex);
+
+	return 0;
+
+auth_begin_exit:
+	auth_release(ah, pending);
+
+	mutex_unlock(&priv->claim_mutex);
+
+	return ret;
+}
+
+void auth_drop(struct auth_handle *ah)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+	unsigned int i;
+	int in_use;
+
+	if (priv == NULL)
+	{
+		return;
+	}
+
+	mutex_lock(&priv->claim_mutex);
+
+	for (i = 0; i < ah->max_pending; i++)
+	{
+		mutex_lock(&priv->mutex);
+		in_use = priv->pending[i].in_use;
+		mutex_unlock(&priv->mutex);
+
+		if (in_use)
+		{
+			auth_evict(ah, &priv->pending[i], "was still authenticating");
+		}
+	}
+
+	mutex_unlock(&priv->claim_mutex);
+}
+
+void auth_free(struct auth_handle *ah)
+{
+	if (ah->priv != NULL)
+	{
+		struct auth_priv *priv = (struct auth_priv *)ah->priv;
+		unsigned int i;
+
+		auth_stop(ah);
+
+		for (i = 0; i < ah->max_pending; i++)
+		{
+			reactor_watch_free(&priv->pending[i].watch);
+		}
+
+		reactor_free(&priv->reactor);
+
+		thread_free(&priv->sweep_thread);
+
+		condvar_free(&priv->sweep_condvar);
+
+		mutex_free(&priv->claim_mutex);
+		mutex_free(&priv->mutex);
+
+		free(priv->pending);
+
+		free(ah->priv);
+		ah->priv = NULL;
+	}
+}
+
+uint64_t auth_get_failures(struct auth_handle *ah)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+
+	if (priv == NULL)
+	{
+		return 0;
+	}
+
+	return atomic_u64_load(&priv->failures);
+}
+
+int auth_init(struct auth_handle *ah)
+{
+	struct auth_priv *priv;
+	unsigned int i;
+	int ret;
+
+	if (ah->max_pending == 0 || ah->func_ptr == NULL)
+	{
+		return -EINVAL;
+	}
+
+	if (ah->priv == NULL)
+	{
+		ah->priv = malloc(sizeof(struct auth_priv));
+	}
+
+	if (ah->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(ah->priv, 0x0, sizeof(struct auth_priv));
+
+	priv = (struct auth_priv *)ah->priv;
+
+	priv->pending = malloc(sizeof(struct auth_pending) * ah->max_pending);
+	if (priv->pending == NULL)
+	{
+		ret = -ENOMEM;
+		goto auth_init_exit;
+	}
+
+	memset(priv->pending, 0x0, sizeof(struct auth_pending) * ah->max_pending);
+
+	// The password is digested once here, rather than for every client
+	digest_password_init(&priv->password, ah->ph->conf.password);
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		goto auth_init_exit;
+	}
+
+	ret = mutex_init(&priv->claim_mutex);
+	if (ret < 0)
+	{
+		goto auth_init_exit_mutex;
+	}
+
+	ret = condvar_init(&priv->sweep_condvar);
+	if (ret < 0)
+	{
+		goto auth_init_exit_claim_mutex;
+	}
+
+	priv->sweep_thread.func_ptr = sweep_worker;
+	priv->sweep_thread.func_ctx = ah;
+	priv->sweep_thread.stack_size = ah->ph->conf.thread_stack_size * 1024U;
+
+	ret = thread_init(&priv->sweep_thread);
+	if (ret < 0)
+	{
+		goto auth_init_exit_condvar;
+	}
+
+	priv->reactor.num_threads = 1;
+	priv->reactor.stack_size = ah->ph->conf.thread_stack_size * 1024U;
+
+	ret = reactor_init(&priv->reactor);
+	if (ret < 0)
+	{
+		goto auth_init_exit_thread;
+	}
+
+	for (i = 0; i < ah->max_pending; i++)
+	{
+		priv->pending[i].ah = ah;
+		priv->pending[i].watch.func_ptr = watch_pending;
+		priv->pending[i].watch.func_detach = watch_pending_detach;
+		priv->pending[i].watch.func_ctx = &priv->pending[i];
+
+		ret = reactor_watch_init(&priv->pending[i].watch);
+		if (ret < 0)
+		{
+			for (; i > 0; i--)
+			{
+				reactor_watch_free(&priv->pending[i - 1].watch);
+			}
+
+			goto auth_init_exit_reactor;
+		}
+	}
+
+	return 0;
+
+auth_init_exit_reactor:
+	reactor_free(&priv->reactor);
+
+auth_init_exit_thread:
+	thread_free(&priv->sweep_thread);
+
+auth_init_exit_condvar:
+	condvar_free(&priv->sweep_condvar);
+
+auth_init_exit_claim_mutex:
+	mutex_free(&priv->claim_mutex);
+
+auth_init_exit_mutex:
+	mutex_free(&priv->mutex);
+
+auth_init_exit:
+	free(priv->pending);
+
+	free(ah->priv);
+	ah->priv = NULL;
+
+	return ret;
+}
+
+int auth_start(struct auth_handle *ah)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+	int ret;
+
+	ret = reactor_start(&priv->reactor);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	priv->sweep_sentinel = 0;
+
+	ret = thread_start(&priv->sweep_thread);
+	if (ret < 0)
+	{
+		reactor_stop(&priv->reactor);
+		return ret;
+	}
+
+	priv->sweep_running = 1;
+
+	return 0;
+}
+
+void auth_stop(struct auth_handle *ah)
+{
+	struct auth_priv *priv = (struct auth_priv *)ah->priv;
+
+	if (priv == NULL)
+	{
+		return;
+	}
+
+	mutex_lock(&priv->mutex);
+	priv->sweep_sentinel = 1;
+	condvar_wake_all(&priv->sweep_condvar);
+	mutex_unlock(&priv->mutex);
+
+	if (priv->sweep_running)
+	{
+		thread_join(&priv->sweep_thread);
+		priv->sweep_running = 0;
+	}
+
+	reactor_stop(&priv->reactor);
+
+	auth_drop(ah);
+}
@@ -0,0 +1,226 @@
+/*!
+ * @file callsign_cache.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of the callsign authorization decision cache
+ */
+
+#include "callsign_cache.h"
+#include "mutex.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Maximum length of a cached callsign, including the null terminator
+#define CALLSIGN_CACHE_CALLSIGN_LEN 12
+
+/*!
+ * @brief A single cached decision
+ */
+struct callsign_cache_entry
+{
+	/// Null-terminated callsign, or empty if the entry is unused
+	char callsign[CALLSIGN_CACHE_CALLSIGN_LEN];
+
+	/// Non-zero if the callsign was authorized
+	uint8_t authorized;
+
+	/// Value of callsign_cache_priv::clock when the entry was last used
+	uint64_t last_used;
+};
+
+/*!
+ * @brief Private data for an instance of a callsign cache
+ */
+struct callsign_cache_priv
+{
+	/// Storage for the cached decisions
+	struct callsign_cache_entry *entries;
+
+	/// Incremented each time an entry is used
+	uint64_t clock;
+
+	/// Mutex for protecting the entries
+	struct mutex_handle mutex;
+};
+
+void callsign_cache_clear(struct callsign_cache_handle *cache)
+{
+	struct callsign_cache_priv *priv = (struct callsign_cache_priv *)cache->priv;
+
+	mutex_lock(&priv->mutex);
+
+	memset(priv->entries, 0x0, sizeof(struct callsign_cache_entry) * cache->size);
+	priv->clock = 0;
+
+	mutex_unlock(&priv->mutex);
+}
+
+void callsign_cache_free(struct callsign_cache_handle *cache)
+{
+	if (cache->priv != NULL)
+	{
+		struct callsign_cache_priv *priv = (struct callsign_cache_priv *)cache->priv;
+
+		mutex_free(&priv->mutex);
+
+		free(priv->entries);
+
+		free(cache->priv);
+		cache->priv = NULL;
+	}
+}
+
+int callsign_cache_get(struct callsign_cache_handle *cache, const char *callsign)
+{
+	struct callsign_cache_priv *priv = (struct callsign_cache_priv *)cache->priv;
+	int ret = -ENOENT;
+	size_t i;
+
+	if (callsign[0] == '\0')
+	{
+		return -ENOENT;
+	}
+
+	mutex_lock(&priv->mutex);
+
+	for (i = 0; i < cache->size; i++)
+	{
+		if (strncmp(priv->entries[i].callsign, callsign, CALLSIGN_CACHE_CALLSIGN_LEN) == 0)
+		{
+			priv->entries[i].last_used = ++priv->clock;
+			ret = priv->entries[i].authorized;
+			break;
+		}
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return ret;
+}
+
+int callsign_cache_init(struct callsign_cache_handle *cache)
+{
+	struct callsign_cache_priv *priv;
+	int ret;
+
+	if (cache->size == 0)
+	{
+		return -EINVAL;
+	}
+
+	if (cache->priv == NULL)
+	{
+		cache->priv = malloc(sizeof(struct callsign_cache_priv));
+	}
+
+	if (cache->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(cache->priv, 0x0, sizeof(struct callsign_cache_priv));
+
+	priv = (struct callsign_cache_priv *)cache->priv;
+
+	priv->entries = calloc(cache->size, sizeof(struct callsign_cache_entry));
+	if (priv->entries == NULL)
+	{
+		ret = -ENOMEM;
+		goto callsign_cache_init_exit;
+	}
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		goto callsign_cache_init_exit;
+	}
+
+	return 0;
+
+callsign_cache_init_exit:
+	free(priv->entries);
+
+	free(cache->priv);
+	cache->priv = NULL;
+
+	return ret;
+}
+
+void callsign_cache_put(struct callsign_cache_handle *cache, const char *callsign, int authorized)
+{
+	struct callsign_cache_priv *priv = (struct callsign_cache_priv *)cache->priv;
+	struct callsign_cache_entry *entry = NULL;
+	size_t len = strlen(callsign);
+	size_t i;
+
+	if (len == 0 || len >= CALLSIGN_CACHE_CALLSIGN_LEN)
+	{
+		return;
+	}
+
+	mutex_lock(&priv->mutex);
+
+	// Replace the existing decision for the callsign, or else the least
+	// recently used one. Unused entries have never been used, so they are
+	// picked first.
+	for (i = 0; i < cache->size; i++)
+	{
+		if (strcmp(priv->entries[i].callsign, callsign) == 0)
+		{
+			entry = &priv->entries[i];
+			break;
+		}
+		else if (entry == NULL || priv->entries[i].last_used < entry->last_used)
+		{
+			entry = &priv->entries[i];
+		}
+	}
+
+	memcpy(entry->callsign, callsign, len + 1);
+	entry->authorized = authorized ? 1 : 0;
+	entry->last_used = ++priv->clock;
+
+	mutex_unlock(&priv->mutex);
+}
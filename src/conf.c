@@ -46,8 +46,10 @@
 
 #include "conf.h"
 #include "log.h"
+#include "trace.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -55,6 +57,17 @@
 /// Maximum size for a single line in a configuration file
 #define CONF_LINE_SIZE 512
 
+/*!
+ * @brief Parse a list of CPUs such as "0,2-3" into a set
+ *
+ * @param[in] val List of CPU numbers and ranges of CPU numbers
+ * @param[in] val_len Length of val in characters
+ * @param[out] cpus Set of CPUs, with bit n set for CPU n
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conf_parse_cpus(const char *val, size_t val_len, uint64_t *cpus);
+
 /*!
  * @brief Parse a single null- or newline-terminated line into the configuration
  *
@@ -158,6 +171,74 @@ static int conf_readline(char **lineptr, size_t *n, FILE *stream)
 	return (int)so_far;
 }
 
+static int conf_parse_cpus(const char *val, size_t val_len, uint64_t *cpus)
+{
+	unsigned int first;
+	unsigned int last;
+	size_t i = 0;
+
+	*cpus = 0;
+
+	while (i < val_len)
+	{
+		if (val[i] < '0' || val[i] > '9')
+		{
+			return -EINVAL;
+		}
+
+		for (first = 0; i < val_len && val[i] >= '0' && val[i] <= '9'; i++)
+		{
+			first = first * 10 + (unsigned int)(val[i] - '0');
+			if (first >= 64)
+			{
+				return -EINVAL;
+			}
+		}
+
+		last = first;
+
+		if (i < val_len && val[i] == '-')
+		{
+			i++;
+			if (i >= val_len || val[i] < '0' || val[i] > '9')
+			{
+				return -EINVAL;
+			}
+
+			for (last = 0; i < val_len && val[i] >= '0' && val[i] <= '9'; i++)
+			{
+				last = last * 10 + (unsigned int)(val[i] - '0');
+				if (last >= 64)
+				{
+					return -EINVAL;
+				}
+			}
+
+			if (last < first)
+			{
+				return -EINVAL;
+			}
+		}
+
+		for (; first <= last; first++)
+		{
+			*cpus |= (uint64_t)1 << first;
+		}
+
+		if (i < val_len)
+		{
+			if (val[i] != ',' || i + 1 >= val_len)
+			{
+				return -EINVAL;
+			}
+
+			i++;
+		}
+	}
+
+	return 0;
+}
+
 static int conf_parse_line(const char *line, struct proxy_conf *conf, struct log_handle *log)
 {
 	const char *key = line;
@@ -246,9 +327,86 @@ static int conf_parse_pair(const char *key, size_t key_len, const char *val, siz
 			}
 		}
 
+		break;
+	case 9:
+		if (strncmp(key, "TraceFile", key_len) == 0)
+		{
+			if (conf->trace_file != NULL)
+			{
+				free(conf->trace_file);
+			}
+
+			if (val_len == 0)
+			{
+				conf->trace_file = NULL;
+				break;
+			}
+
+			conf->trace_file = malloc(val_len + 1);
+			if (conf->trace_file == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(conf->trace_file, val, val_len);
+			conf->trace_file[val_len] = '\0';
+		}
+		else if (strncmp(key, "VoiceDSCP", key_len) == 0)
+		{
+			if (sscanf(val, "%hhu%1s", &conf->voice_dscp, dummy) != 1 || conf->voice_dscp > 63)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'VoiceDSCP': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
+		break;
+	case 10:
+		if (strncmp(key, "PeerFilter", key_len) == 0)
+		{
+			if (sscanf(val, "%hhu%1s", &conf->peer_filter, dummy) != 1 || conf->peer_filter > 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'PeerFilter': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "StatsdPort", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->statsd_port, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'StatsdPort': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
 		break;
 	case 11:
-		if (strncmp(key, "BindAddress", key_len) == 0)
+		if (strncmp(key, "AdminSocket", key_len) == 0)
+		{
+			if (conf->admin_socket != NULL)
+			{
+				free(conf->admin_socket);
+			}
+
+			if (val_len == 0)
+			{
+				conf->admin_socket = NULL;
+				break;
+			}
+
+			conf->admin_socket = malloc(val_len + 1);
+			if (conf->admin_socket == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(conf->admin_socket, val, val_len);
+			conf->admin_socket[val_len] = '\0';
+		}
+		else if (strncmp(key, "BindAddress", key_len) == 0)
 		{
 			if (conf->bind_addr != NULL)
 			{
@@ -270,10 +428,98 @@ static int conf_parse_pair(const char *key, size_t key_len, const char *val, siz
 			memcpy(conf->bind_addr, val, val_len);
 			conf->bind_addr[val_len] = '\0';
 		}
+		else if (strncmp(key, "MetricsPort", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->metrics_port, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'MetricsPort': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "SlotThreads", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->slot_threads, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'SlotThreads': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
+		break;
+	case 12:
+		if (strncmp(key, "SlotHoldTime", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->slot_hold_time, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'SlotHoldTime': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "StatsdPrefix", key_len) == 0)
+		{
+			if (conf->statsd_prefix != NULL)
+			{
+				free(conf->statsd_prefix);
+			}
+
+			if (val_len == 0)
+			{
+				conf->statsd_prefix = NULL;
+				break;
+			}
+
+			conf->statsd_prefix = malloc(val_len + 1);
+			if (conf->statsd_prefix == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(conf->statsd_prefix, val, val_len);
+			conf->statsd_prefix[val_len] = '\0';
+		}
 
 		break;
 	case 13:
-		if (strncmp(key, "PublicAddress", key_len) == 0)
+		if (strncmp(key, "AdmissionRate", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->admission_rate, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'AdmissionRate': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "AcceptThreads", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->accept_threads, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'AcceptThreads': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ClientNoDelay", key_len) == 0)
+		{
+			if (sscanf(val, "%hhu%1s", &conf->client_nodelay, dummy) != 1 || conf->client_nodelay > 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientNoDelay': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ListenBacklog", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->listen_backlog, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ListenBacklog': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "PublicAddress", key_len) == 0)
 		{
 			if (conf->public_addr != NULL)
 			{
@@ -295,6 +541,94 @@ static int conf_parse_pair(const char *key, size_t key_len, const char *val, siz
 			memcpy(conf->public_addr, val, val_len);
 			conf->public_addr[val_len] = '\0';
 		}
+		else if (strncmp(key, "StatsdAddress", key_len) == 0)
+		{
+			if (conf->statsd_addr != NULL)
+			{
+				free(conf->statsd_addr);
+			}
+
+			if (val_len == 0)
+			{
+				conf->statsd_addr = NULL;
+				break;
+			}
+
+			conf->statsd_addr = malloc(val_len + 1);
+			if (conf->statsd_addr == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(conf->statsd_addr, val, val_len);
+			conf->statsd_addr[val_len] = '\0';
+		}
+		else if (strncmp(key, "TCPRetryCount", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->tcp_retry_count, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'TCPRetryCount': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "TCPSendBuffer", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->tcp_sndbuf, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'TCPSendBuffer': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "UDPSendBuffer", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->udp_sndbuf, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'UDPSendBuffer': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
+		break;
+	case 14:
+		if (strncmp(key, "AdmissionBurst", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->admission_burst, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'AdmissionBurst': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ForwardingCPUs", key_len) == 0)
+		{
+			if (conf_parse_cpus(val, val_len, &conf->forwarding_cpus) != 0)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ForwardingCPUs': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ClientQuickAck", key_len) == 0)
+		{
+			if (sscanf(val, "%hhu%1s", &conf->client_quickack, dummy) != 1 || conf->client_quickack > 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientQuickAck': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "StatsdInterval", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->statsd_interval, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'StatsdInterval': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
 
 		break;
 	case 15:
@@ -320,10 +654,65 @@ static int conf_parse_pair(const char *key, size_t key_len, const char *val, siz
 			memcpy(conf->calls_denied, val, val_len);
 			conf->calls_denied[val_len] = '\0';
 		}
+		else if (strncmp(key, "ThreadStackSize", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->thread_stack_size, dummy) != 1 ||
+				(conf->thread_stack_size > 0 && conf->thread_stack_size < 256))
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ThreadStackSize': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "TraceSnapLength", key_len) == 0)
+		{
+			if (sscanf(val, "%hhu%1s", &conf->trace_snap_len, dummy) != 1 || conf->trace_snap_len > TRACE_SNAP_MAX)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'TraceSnapLength': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
 
 		break;
 	case 16:
-		if (strncmp(key, "CallsignsAllowed", key_len) == 0)
+		if (strncmp(key, "AdmissionPenalty", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->admission_penalty, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'AdmissionPenalty': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ClientSendBuffer", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->client_sndbuf, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientSendBuffer': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "TCPReceiveBuffer", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->tcp_rcvbuf, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'TCPReceiveBuffer': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "UDPReceiveBuffer", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->udp_rcvbuf, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'UDPReceiveBuffer': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "CallsignsAllowed", key_len) == 0)
 		{
 			if (conf->calls_allowed != NULL)
 			{
@@ -367,10 +756,149 @@ static int conf_parse_pair(const char *key, size_t key_len, const char *val, siz
 			memcpy(conf->reg_name, val, val_len);
 			conf->reg_name[val_len] = '\0';
 		}
+		else if (strncmp(key, "ClientDropPolicy", key_len) == 0)
+		{
+			if (val_len == 6 && strncmp(val, "newest", val_len) == 0)
+			{
+				conf->drop_policy = DROP_POLICY_NEWEST;
+			}
+			else if (val_len == 6 && strncmp(val, "oldest", val_len) == 0)
+			{
+				conf->drop_policy = DROP_POLICY_OLDEST;
+			}
+			else
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientDropPolicy': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
+		break;
+	case 17:
+		if (strncmp(key, "AdmissionFailures", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->admission_failures, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'AdmissionFailures': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ConnectionTimeout", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->connection_timeout, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ConnectionTimeout': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ClientMessageSize", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->client_message_size, dummy) != 1 || conf->client_message_size < 512 || conf->client_message_size > 4096)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientMessageSize': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ForwardingBackend", key_len) == 0)
+		{
+			if (conf->forwarding_backend != NULL)
+			{
+				free(conf->forwarding_backend);
+			}
+
+			if (val_len == 0)
+			{
+				conf->forwarding_backend = NULL;
+				break;
+			}
+
+			conf->forwarding_backend = malloc(val_len + 1);
+			if (conf->forwarding_backend == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(conf->forwarding_backend, val, val_len);
+			conf->forwarding_backend[val_len] = '\0';
+		}
+		else if (strncmp(key, "ForwardingThreads", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->forwarding_threads, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ForwardingThreads': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "InactivityTimeout", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->inactivity_timeout, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'InactivityTimeout': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "TCPConnectTimeout", key_len) == 0)
+		{
+			if (sscanf(val, "%hu%1s", &conf->tcp_connect_timeout, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'TCPConnectTimeout': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
+		break;
+	case 18:
+		if (strncmp(key, "MetricsBindAddress", key_len) == 0)
+		{
+			if (conf->metrics_bind_addr != NULL)
+			{
+				free(conf->metrics_bind_addr);
+			}
+
+			if (val_len == 0)
+			{
+				conf->metrics_bind_addr = NULL;
+				break;
+			}
+
+			conf->metrics_bind_addr = malloc(val_len + 1);
+			if (conf->metrics_bind_addr == NULL)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(conf->metrics_bind_addr, val, val_len);
+			conf->metrics_bind_addr[val_len] = '\0';
+		}
+		else if (strncmp(key, "ForwardingPriority", key_len) == 0)
+		{
+			if (sscanf(val, "%hhu%1s", &conf->forwarding_priority, dummy) != 1 || conf->forwarding_priority > 99)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ForwardingPriority': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
 
 		break;
 	case 19:
-		if (strncmp(key, "ExternalBindAddress", key_len) == 0)
+		if (strncmp(key, "ClientReceiveBuffer", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->client_rcvbuf, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientReceiveBuffer': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(key, "ExternalBindAddress", key_len) == 0)
 		{
 			if (conf->bind_addr_ext != NULL)
 			{
@@ -392,6 +920,15 @@ static int conf_parse_pair(const char *key, size_t key_len, const char *val, siz
 			memcpy(conf->bind_addr_ext, val, val_len);
 			conf->bind_addr_ext[val_len] = '\0';
 		}
+		else if (strncmp(key, "ClientCoalesceDelay", key_len) == 0)
+		{
+			if (sscanf(val, "%" SCNu32 "%1s", &conf->client_coalesce_delay, dummy) != 1)
+			{
+				log_printf(log, LOG_LEVEL_ERROR, "Invalid configuration value for 'ClientCoalesceDelay': '%.*s'\n", (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
 		else if (strncmp(key, "RegistrationComment", key_len) == 0)
 		{
 			if (conf->reg_comment != NULL)
@@ -517,8 +1054,17 @@ static int conf_parse_stream(FILE *stream, struct proxy_conf *conf, struct log_h
 
 int conf_init(struct proxy_conf *conf)
 {
+	conf->admission_burst = 5;
+	conf->admission_penalty = 60;
+	conf->client_message_size = 4096;
+	conf->client_nodelay = 1;
 	conf->password = NULL;
 	conf->port = 8100;
+	conf->statsd_interval = 10;
+	conf->statsd_port = 8125;
+	conf->tcp_connect_timeout = 10;
+	conf->thread_stack_size = 1024;
+	conf->trace_snap_len = 12;
 
 	return 0;
 }
@@ -546,6 +1092,12 @@ void conf_free(struct proxy_conf *conf)
 		conf->bind_addr = NULL;
 	}
 
+	if (conf->admin_socket != NULL)
+	{
+		free(conf->admin_socket);
+		conf->admin_socket = NULL;
+	}
+
 	if (conf->bind_addr_ext != NULL)
 	{
 		free(conf->bind_addr_ext);
@@ -564,6 +1116,12 @@ void conf_free(struct proxy_conf *conf)
 		conf->calls_denied = NULL;
 	}
 
+	if (conf->forwarding_backend != NULL)
+	{
+		free(conf->forwarding_backend);
+		conf->forwarding_backend = NULL;
+	}
+
 	if (conf->password != NULL)
 	{
 		free(conf->password);
@@ -587,6 +1145,30 @@ void conf_free(struct proxy_conf *conf)
 		free(conf->public_addr);
 		conf->public_addr = NULL;
 	}
+
+	if (conf->statsd_addr != NULL)
+	{
+		free(conf->statsd_addr);
+		conf->statsd_addr = NULL;
+	}
+
+	if (conf->statsd_prefix != NULL)
+	{
+		free(conf->statsd_prefix);
+		conf->statsd_prefix = NULL;
+	}
+
+	if (conf->metrics_bind_addr != NULL)
+	{
+		free(conf->metrics_bind_addr);
+		conf->metrics_bind_addr = NULL;
+	}
+
+	if (conf->trace_file != NULL)
+	{
+		free(conf->trace_file);
+		conf->trace_file = NULL;
+	}
 }
 
 int conf_parse_file(const char *file, struct proxy_conf *conf, struct log_handle *log)
@@ -44,6 +44,12 @@
  * @brief Network connection implementation
  */
 
+#if defined(HAVE_MMSG) && !defined(_GNU_SOURCE)
+/// Expose recvmmsg and sendmmsg
+#  define _GNU_SOURCE
+#endif
+
+#include "atomic.h"
 #include "conn.h"
 #ifdef _WIN32
 #  include "conn_wsa_errno.h"
@@ -54,12 +60,20 @@
 #  include <winsock2.h>
 #  include <ws2tcpip.h>
 #  include <mstcpip.h>
+#  include <afunix.h>
 #else
 #  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <poll.h>
 #  include <netdb.h>
 #  include <netinet/in.h>
 #  include <netinet/tcp.h>
 #  include <arpa/inet.h>
+#  include <fcntl.h>
+#  ifdef __linux__
+#    include <linux/filter.h>
+#  endif
 #  ifdef __APPLE__
 #    define SOL_TCP IPPROTO_TCP
 #    define TCP_KEEPIDLE TCP_KEEPALIVE
@@ -85,6 +99,9 @@
 /// Disallow further receptions and transmissions
 #  define SHUT_RDWR SD_BOTH
 
+/// Wait for events on a set of sockets
+#  define poll(...) WSAPoll(__VA_ARGS__)
+
 /// Last socket function error value
 #  define SOCK_ERRNO -conn_wsa_errno()
 #else
@@ -133,6 +150,106 @@ struct conn_priv
 #endif
 };
 
+/*!
+ * @brief Converts conn_handle::source_addr and conn_handle::source_port to a
+ *        socket address to bind a connection of the given family to
+ *
+ * Numeric addresses are converted directly, without a name lookup.
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] family Address family of the connection
+ * @param[out] saddr Resulting socket address
+ * @param[out] saddr_len Length of saddr
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int bind_addr(const struct conn_handle *conn, int family, struct sockaddr_storage *saddr, socklen_t *saddr_len);
+
+/*!
+ * @brief Listens on a socket at the path in conn_handle::source_addr
+ *
+ * Any socket left at the path by a previous instance is replaced. Only the
+ * owner of the process may connect to the new socket.
+ *
+ * @param[in,out] conn Target network connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int listen_local(struct conn_handle *conn);
+
+/*!
+ * @brief Connects to a socket which is listening at the given path
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] path Null-terminated path to the listening socket
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int connect_local(struct conn_handle *conn, const char *path);
+
+/*!
+ * @brief Starts connecting a socket to a remote address without waiting
+ *
+ * The socket is non-blocking until ::connect_wait returns.
+ *
+ * @param[in] fd Socket to connect
+ * @param[in] addr Remote address to connect to
+ * @param[in] addr_len Length of addr
+ *
+ * @returns 0 if the socket is already connected, 1 if the attempt is in
+ *          progress, negative ERRNO value on failure
+ */
+static int connect_start(SOCKET fd, const struct sockaddr *addr, socklen_t addr_len);
+
+/*!
+ * @brief Waits for an attempt started by ::connect_start, giving up after a
+ *        timeout
+ *
+ * @param[in] fd Socket being connected
+ * @param[in] timeout_ms Maximum time to wait in milliseconds, or 0 to wait as
+ *            long as the system does
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int connect_wait(SOCKET fd, uint32_t timeout_ms);
+
+/*!
+ * @brief Makes a socket block again once it is connected
+ *
+ * @param[in] fd Connected socket
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int connect_finish(SOCKET fd);
+
+/*!
+ * @brief Gathers data from multiple buffers and sends it on a socket
+ *
+ * @param[in] fd Socket to send the data on
+ * @param[in] iov Array of buffers to send, in order
+ * @param[in] count Number of buffers in iov, at most ::CONN_IOV_MAX
+ * @param[in] saddr Remote address to send the data to, or NULL if the socket
+ *            is connected
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int send_iov(SOCKET fd, const struct conn_iov *iov, unsigned int count, const struct sockaddr_in *saddr);
+
+/*!
+ * @brief Waits for a connection's socket to report any of the given events
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] events Events to wait for, as in pollfd::events
+ * @param[in] timeout_us Maximum time to wait in microseconds, or zero to
+ *            return immediately
+ *
+ * @returns 1 if an event was reported, 0 on timeout, negative ERRNO value on
+ *          failure
+ */
+static int poll_events(struct conn_handle *conn, short events, uint32_t timeout_us);
+
+_Static_assert(sizeof(((struct conn_peer *)0)->storage) >= sizeof(struct sockaddr_in6), "conn_peer is too small to hold an IPv6 address");
+
 int conn_init(struct conn_handle *conn)
 {
 	struct conn_priv *priv;
@@ -222,10 +339,20 @@ int conn_listen(struct conn_handle *conn)
 	case  CONN_TYPE_UDP:
 		hints.ai_socktype = SOCK_DGRAM;
 		break;
+	case CONN_TYPE_LOCAL:
+		return listen_local(conn);
 	default:
 		return -1;
 	}
 
+#if !defined(SO_REUSEPORT_LB) && !(defined(__linux__) && defined(SO_REUSEPORT))
+	// Elsewhere, SO_REUSEPORT gives every connection to a single listener
+	if (conn->reuse_port)
+	{
+		return -ENOTSUP;
+	}
+#endif
+
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_flags = AI_PASSIVE;
 
@@ -250,6 +377,30 @@ int conn_listen(struct conn_handle *conn)
 		goto conn_listen_free;
 	}
 
+#if defined(SO_REUSEPORT_LB)
+	if (conn->reuse_port)
+	{
+		ret = setsockopt(priv->sock_fd, SOL_SOCKET, SO_REUSEPORT_LB, (void *)&yes, sizeof(int));
+		if (ret == SOCKET_ERROR)
+		{
+			/// @TODO Close priv->sock_fd
+			ret = SOCK_ERRNO;
+			goto conn_listen_free;
+		}
+	}
+#elif defined(__linux__) && defined(SO_REUSEPORT)
+	if (conn->reuse_port)
+	{
+		ret = setsockopt(priv->sock_fd, SOL_SOCKET, SO_REUSEPORT, (void *)&yes, sizeof(int));
+		if (ret == SOCKET_ERROR)
+		{
+			/// @TODO Close priv->sock_fd
+			ret = SOCK_ERRNO;
+			goto conn_listen_free;
+		}
+	}
+#endif
+
 #ifdef __APPLE__
 	ret = setsockopt(priv->sock_fd, SOL_SOCKET, SO_NOSIGPIPE, (void *)&yes, sizeof(int));
 	if (ret == SOCKET_ERROR)
@@ -270,7 +421,9 @@ int conn_listen(struct conn_handle *conn)
 
 	if (conn->type == CONN_TYPE_TCP)
 	{
-		ret = listen(priv->sock_fd, 0);
+		// Clients which connect while the previous one is still being
+		// accepted must not be turned away
+		ret = listen(priv->sock_fd, conn->backlog > 0 ? conn->backlog : SOMAXCONN);
 		if (ret == SOCKET_ERROR)
 		{
 			/// @TODO Close priv->sock_fd
@@ -303,7 +456,11 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 		.keepalivetime = 600 * 1000,
 		.keepaliveinterval = 12 * 1000,
 	};
+	u_long blocking = 0;
 #else
+#  ifndef __linux__
+	int flags;
+#  endif
 	const int yes = 1;
 	const int ten_min = 600;
 	const int twelve_sec = 12;
@@ -323,6 +480,30 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 		return SOCK_ERRNO;
 	}
 
+#ifdef _WIN32
+	// The accepted socket inherits non-blocking mode from the listener
+	if (ioctlsocket(apriv->conn_fd, FIONBIO, &blocking) == SOCKET_ERROR)
+	{
+		/// @TODO Close apriv->conn_fd
+		return SOCK_ERRNO;
+	}
+#elif !defined(__linux__)
+	// Outside of Linux, the accepted socket inherits non-blocking mode from
+	// the listener
+	flags = fcntl(apriv->conn_fd, F_GETFL, 0);
+	if (flags == -1 || fcntl(apriv->conn_fd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+	{
+		/// @TODO Close apriv->conn_fd
+		return SOCK_ERRNO;
+	}
+#endif
+
+	// Keepalives only apply to network connections
+	if (conn->type == CONN_TYPE_LOCAL)
+	{
+		goto conn_accept_exit;
+	}
+
 #ifdef _WIN32
 	if (WSAIoctl(apriv->conn_fd, SIO_KEEPALIVE_VALS, &keepalive, sizeof(struct tcp_keepalive), NULL, 0, &bytes_returned, NULL, NULL) != 0)
 	{
@@ -355,6 +536,7 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 	}
 #endif
 
+conn_accept_exit:
 	mutex_lock(&apriv->mutex);
 
 	apriv->fd = apriv->conn_fd;
@@ -364,85 +546,149 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 	return 0;
 }
 
-int conn_connect(struct conn_handle *conn, const char *addr, const char *port)
+static int bind_addr(const struct conn_handle *conn, int family, struct sockaddr_storage *saddr, socklen_t *saddr_len)
 {
-	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct sockaddr_in *saddr4 = (struct sockaddr_in *)saddr;
+	struct sockaddr_in6 *saddr6 = (struct sockaddr_in6 *)saddr;
 	struct addrinfo hints;
 	struct addrinfo *res = NULL;
-	struct addrinfo *res_remote = NULL;
-	const int yes = 1;
+	unsigned long port = 0;
+	char *port_end = "";
+	void *addr;
 	int ret;
 
-	if (conn->type != CONN_TYPE_TCP)
+	memset(saddr, 0x0, sizeof(struct sockaddr_storage));
+
+	if (conn->source_port != NULL)
 	{
-		return -EPROTOTYPE;
+		port = strtoul(conn->source_port, &port_end, 10);
+	}
+
+	if (family == AF_INET)
+	{
+		saddr4->sin_family = AF_INET;
+		saddr4->sin_port = htons((uint16_t)port);
+		saddr4->sin_addr.s_addr = htonl(INADDR_ANY);
+		addr = &saddr4->sin_addr;
+		*saddr_len = sizeof(struct sockaddr_in);
+	}
+	else if (family == AF_INET6)
+	{
+		saddr6->sin6_family = AF_INET6;
+		saddr6->sin6_port = htons((uint16_t)port);
+		saddr6->sin6_addr = in6addr_any;
+		addr = &saddr6->sin6_addr;
+		*saddr_len = sizeof(struct sockaddr_in6);
+	}
+	else
+	{
+		return -EAFNOSUPPORT;
+	}
+
+	if (*port_end == '\0' && port <= UINT16_MAX &&
+		(conn->source_addr == NULL || inet_pton(family, conn->source_addr, addr) == 1))
+	{
+		return 0;
 	}
 
+	// Fall back to looking up the name
 	memset(&hints, 0x0, sizeof(struct addrinfo));
 
-	hints.ai_family = AF_INET;
+	hints.ai_family = family;
 	hints.ai_flags = AI_PASSIVE;
 	hints.ai_socktype = SOCK_STREAM;
 
 	ret = getaddrinfo(conn->source_addr, conn->source_port == NULL ? "0" : conn->source_port, &hints, &res);
 	if (ret != 0)
 	{
-		ret = -EADDRNOTAVAIL;
-		goto conn_connect_free_early;
+		return -EADDRNOTAVAIL;
 	}
 
-	memset(&hints, 0x0, sizeof(struct addrinfo));
+	memcpy(saddr, res->ai_addr, res->ai_addrlen);
+	*saddr_len = (socklen_t)res->ai_addrlen;
 
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
+	freeaddrinfo(res);
 
-	ret = getaddrinfo(addr, port, &hints, &res_remote);
-	if (ret != 0)
+	return 0;
+}
+
+static int listen_local(struct conn_handle *conn)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct sockaddr_un saddr;
+	size_t path_len;
+	int ret;
+#ifdef _WIN32
+	DWORD attrs;
+#else
+	struct stat st;
+#endif
+
+	if (conn->source_addr == NULL)
 	{
-		ret = -EADDRNOTAVAIL;
-		goto conn_connect_free_early;
+		return -EINVAL;
 	}
 
-	priv->sock_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-	if (priv->sock_fd == INVALID_SOCKET)
+	path_len = strlen(conn->source_addr);
+	if (path_len == 0 || path_len >= sizeof(saddr.sun_path))
 	{
-		ret = SOCK_ERRNO;
-		goto conn_connect_free_early;
+		return -ENAMETOOLONG;
 	}
 
-	ret = setsockopt(priv->sock_fd, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(int));
-	if (ret == SOCKET_ERROR)
+	memset(&saddr, 0x0, sizeof(struct sockaddr_un));
+	saddr.sun_family = AF_UNIX;
+	memcpy(saddr.sun_path, conn->source_addr, path_len);
+
+	// Only replace what is left of a socket, never some other file
+#ifdef _WIN32
+	attrs = GetFileAttributesA(conn->source_addr);
+	if (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_REPARSE_POINT))
 	{
-		ret = SOCK_ERRNO;
-		goto conn_connect_free_early;
+		DeleteFileA(conn->source_addr);
 	}
-
-#ifdef __APPLE__
-	ret = setsockopt(priv->sock_fd, SOL_SOCKET, SO_NOSIGPIPE, (void *)&yes, sizeof(int));
-	if (ret == SOCKET_ERROR)
+#else
+	if (lstat(conn->source_addr, &st) == 0 && S_ISSOCK(st.st_mode))
 	{
-		ret = SOCK_ERRNO;
-		goto conn_connect_free_early;
+		unlink(conn->source_addr);
 	}
 #endif
 
-	ret = bind(priv->sock_fd, res->ai_addr, (socklen_t)res->ai_addrlen);
+	priv->sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (priv->sock_fd == INVALID_SOCKET)
+	{
+		return SOCK_ERRNO;
+	}
+
+	ret = bind(priv->sock_fd, (const struct sockaddr *)&saddr, (socklen_t)sizeof(struct sockaddr_un));
 	if (ret == SOCKET_ERROR)
 	{
 		ret = SOCK_ERRNO;
-		goto conn_connect_free;
+		goto listen_local_exit;
+	}
+
+#ifndef _WIN32
+	// Nobody can connect before listening starts, so there's no window in
+	// which others could get in
+	if (chmod(conn->source_addr, S_IRUSR | S_IWUSR) != 0)
+	{
+		ret = -errno;
+		unlink(conn->source_addr);
+		goto listen_local_exit;
 	}
+#endif
 
-	ret = connect(priv->sock_fd, res_remote->ai_addr, (socklen_t)res_remote->ai_addrlen);
+	ret = listen(priv->sock_fd, conn->backlog > 0 ? conn->backlog : SOMAXCONN);
 	if (ret == SOCKET_ERROR)
 	{
 		ret = SOCK_ERRNO;
-		goto conn_connect_free;
+#ifdef _WIN32
+		DeleteFileA(conn->source_addr);
+#else
+		unlink(conn->source_addr);
+#endif
+		goto listen_local_exit;
 	}
 
-	freeaddrinfo(res_remote);
-	freeaddrinfo(res);
-
 	mutex_lock(&priv->mutex);
 
 	priv->fd = priv->sock_fd;
@@ -451,135 +697,108 @@ int conn_connect(struct conn_handle *conn, const char *addr, const char *port)
 
 	return 0;
 
-conn_connect_free:
-	shutdown(priv->sock_fd, SHUT_RDWR);
-
+listen_local_exit:
 	closesocket(priv->sock_fd);
-
 	priv->sock_fd = INVALID_SOCKET;
 
-conn_connect_free_early:
-	if (res_remote != NULL)
-	{
-		freeaddrinfo(res_remote);
-	}
-
-	if (res != NULL)
-	{
-		freeaddrinfo(res);
-	}
-
 	return ret;
 }
 
-int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len)
+static int connect_local(struct conn_handle *conn, const char *path)
 {
 	struct conn_priv *priv = (struct conn_priv *)conn->priv;
-	int ret = 0;
-	int bytes_read = 0;
+	struct sockaddr_un saddr;
+	size_t path_len;
+	int ret;
 
-	if (conn->type != CONN_TYPE_TCP)
+	path_len = strlen(path);
+	if (path_len == 0 || path_len >= sizeof(saddr.sun_path))
 	{
-		return -EPROTOTYPE;
+		return -ENAMETOOLONG;
 	}
 
-	mutex_lock_shared(&priv->mutex);
+	memset(&saddr, 0x0, sizeof(struct sockaddr_un));
+	saddr.sun_family = AF_UNIX;
+	memcpy(saddr.sun_path, path, path_len);
 
-	if (priv->fd == INVALID_SOCKET)
+	priv->sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (priv->sock_fd == INVALID_SOCKET)
 	{
-		ret = -ENOTCONN;
-
-		goto conn_recv_exit;
+		return SOCK_ERRNO;
 	}
 
-	while (buff_len > 0)
+	ret = connect(priv->sock_fd, (const struct sockaddr *)&saddr, (socklen_t)sizeof(struct sockaddr_un));
+	if (ret == SOCKET_ERROR)
 	{
-		ret = recvfrom(priv->fd, (char *)buff, (socklen_t)buff_len, 0, NULL, NULL);
-
-		if (ret == 0)
-		{
-			ret = -EPIPE;
+		ret = SOCK_ERRNO;
 
-			goto conn_recv_exit;
-		}
-		else if (ret == SOCKET_ERROR)
-		{
-			ret = SOCK_ERRNO;
+		closesocket(priv->sock_fd);
+		priv->sock_fd = INVALID_SOCKET;
 
-#ifdef _WIN32
-			if (ret == -WSAESHUTDOWN)
-			{
-				ret = -EPIPE;
-			}
-#endif
+		return ret;
+	}
 
-			goto conn_recv_exit;
-		}
+	mutex_lock(&priv->mutex);
 
-		buff_len -= ret;
-		buff += ret;
-		ret = bytes_read += ret;
-	}
+	priv->fd = priv->sock_fd;
 
-conn_recv_exit:
-	mutex_unlock_shared(&priv->mutex);
+	mutex_unlock(&priv->mutex);
 
-	return ret;
+	return 0;
 }
 
-int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len, uint32_t *addr, uint16_t *port)
+int conn_connect(struct conn_handle *conn, const char *addr, const char *port)
 {
-	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	struct conn_peer peer;
 	int ret;
 
-	priv->remote_addr_len = sizeof(struct sockaddr_storage);
-
-	mutex_lock_shared(&priv->mutex);
-
-	if (priv->fd == INVALID_SOCKET)
+	if (conn->type == CONN_TYPE_LOCAL)
 	{
-		ret = -ENOTCONN;
-
-		goto conn_recv_any_exit;
+		return connect_local(conn, addr);
 	}
 
-	ret = recvfrom(priv->fd, (char *)buff, (socklen_t)buff_len, 0, (struct sockaddr *)&priv->remote_addr, &priv->remote_addr_len);
-
-	if (ret == 0)
+	if (conn->type != CONN_TYPE_TCP)
 	{
-		ret = -EPIPE;
+		return -EPROTOTYPE;
 	}
-	else if (ret == SOCKET_ERROR)
-	{
-		ret = SOCK_ERRNO;
 
-#ifdef _WIN32
-		if (ret == -WSAESHUTDOWN)
-		{
-			ret = -EPIPE;
-		}
-#endif
-	}
+	memset(&hints, 0x0, sizeof(struct addrinfo));
 
-conn_recv_any_exit:
-	mutex_unlock_shared(&priv->mutex);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
 
-	if (addr != NULL && ret > 0)
+	ret = getaddrinfo(addr, port, &hints, &res);
+	if (ret != 0)
 	{
-		*addr = ((struct sockaddr_in *)&priv->remote_addr)->sin_addr.s_addr;
+		return -EADDRNOTAVAIL;
 	}
 
-	if (port != NULL && ret > 0)
+	if (res->ai_addrlen > sizeof(peer.storage))
 	{
-		*port = htons(((struct sockaddr_in *)&priv->remote_addr)->sin_port);
+		freeaddrinfo(res);
+
+		return -EAFNOSUPPORT;
 	}
 
-	return ret;
+	memset(&peer, 0x0, sizeof(struct conn_peer));
+	memcpy(peer.storage, res->ai_addr, res->ai_addrlen);
+	peer.len = (uint32_t)res->ai_addrlen;
+
+	freeaddrinfo(res);
+
+	return conn_connect_peer(conn, &peer);
 }
 
-int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
+int conn_connect_peer(struct conn_handle *conn, const struct conn_peer *peer)
 {
 	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	const struct sockaddr *saddr = (const struct sockaddr *)peer->storage;
+	struct sockaddr_storage local;
+	socklen_t local_len;
+	const int yes = 1;
+	SOCKET fd;
 	int ret;
 
 	if (conn->type != CONN_TYPE_TCP)
@@ -587,8 +806,688 @@ int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
 		return -EPROTOTYPE;
 	}
 
-	mutex_lock_shared(&priv->mutex);
-
+	ret = bind_addr(conn, saddr->sa_family, &local, &local_len);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	fd = socket(saddr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+	if (fd == INVALID_SOCKET)
+	{
+		return SOCK_ERRNO;
+	}
+
+	ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(int));
+	if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+		goto conn_connect_peer_close;
+	}
+
+#ifdef __APPLE__
+	ret = setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (void *)&yes, sizeof(int));
+	if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+		goto conn_connect_peer_close;
+	}
+#endif
+
+	ret = bind(fd, (struct sockaddr *)&local, local_len);
+	if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+		goto conn_connect_peer_close;
+	}
+
+	// Publishing the socket, checking for cancellation and starting the
+	// attempt happen together, so conn_shutdown either finds an attempt it
+	// can cancel or runs before the check. Shutting down a socket which has
+	// not started connecting yet would do nothing.
+	mutex_lock(&priv->mutex);
+
+	priv->sock_fd = fd;
+
+	if (conn->connect_cancel != NULL && atomic_u32_load(conn->connect_cancel))
+	{
+		ret = -ECANCELED;
+	}
+	else
+	{
+		ret = connect_start(fd, saddr, (socklen_t)peer->len);
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	// Hold the shared lock so that conn_close waits for the attempt, which
+	// conn_shutdown cancels
+	if (ret > 0)
+	{
+		mutex_lock_shared(&priv->mutex);
+
+		ret = connect_wait(fd, conn->connect_timeout);
+
+		mutex_unlock_shared(&priv->mutex);
+	}
+
+	if (ret == 0)
+	{
+		ret = connect_finish(fd);
+	}
+
+	if (ret < 0)
+	{
+		goto conn_connect_peer_free;
+	}
+
+	mutex_lock(&priv->mutex);
+
+	priv->fd = priv->sock_fd;
+
+	mutex_unlock(&priv->mutex);
+
+	return 0;
+
+conn_connect_peer_close:
+	closesocket(fd);
+
+	return ret;
+
+conn_connect_peer_free:
+	mutex_lock(&priv->mutex);
+
+	if (priv->sock_fd != INVALID_SOCKET)
+	{
+		shutdown(priv->sock_fd, SHUT_RDWR);
+
+		closesocket(priv->sock_fd);
+
+		priv->sock_fd = INVALID_SOCKET;
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return ret;
+}
+
+static int connect_start(SOCKET fd, const struct sockaddr *addr, socklen_t addr_len)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+#else
+	int flags;
+#endif
+	int ret;
+
+#ifdef _WIN32
+	if (ioctlsocket(fd, FIONBIO, &mode) == SOCKET_ERROR)
+	{
+		return SOCK_ERRNO;
+	}
+#else
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		return -errno;
+	}
+#endif
+
+	ret = connect(fd, addr, addr_len);
+	if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+		return ret == -EINPROGRESS || ret == -EWOULDBLOCK ? 1 : ret;
+	}
+
+	return 0;
+}
+
+static int connect_wait(SOCKET fd, uint32_t timeout_ms)
+{
+	struct pollfd pfd;
+	int err = 0;
+	socklen_t err_len = sizeof(int);
+	int ret;
+
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+
+	ret = poll(&pfd, 1, timeout_ms == 0 ? -1 : (int)timeout_ms);
+	if (ret == SOCKET_ERROR)
+	{
+		return SOCK_ERRNO;
+	}
+	else if (ret == 0)
+	{
+		return -ETIMEDOUT;
+	}
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&err, &err_len) == SOCKET_ERROR)
+	{
+		return SOCK_ERRNO;
+	}
+	else if (err != 0)
+	{
+#ifdef _WIN32
+		WSASetLastError(err);
+		return SOCK_ERRNO;
+#else
+		return -err;
+#endif
+	}
+
+	return 0;
+}
+
+static int connect_finish(SOCKET fd)
+{
+#ifdef _WIN32
+	u_long mode = 0;
+#else
+	int flags;
+#endif
+
+	// The connection is used with blocking operations from here on
+#ifdef _WIN32
+	if (ioctlsocket(fd, FIONBIO, &mode) == SOCKET_ERROR)
+	{
+		return SOCK_ERRNO;
+	}
+#else
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+	{
+		return -errno;
+	}
+#endif
+
+	return 0;
+}
+
+int conn_connect_to(struct conn_handle *conn, uint32_t addr, uint16_t port)
+{
+	struct conn_peer peer;
+
+	conn_peer_ipv4(&peer, addr, port);
+
+	return conn_connect_peer(conn, &peer);
+}
+
+void conn_peer_ipv4(struct conn_peer *peer, uint32_t addr, uint16_t port)
+{
+	struct sockaddr_in *saddr = (struct sockaddr_in *)peer->storage;
+
+	memset(peer, 0x0, sizeof(struct conn_peer));
+
+	saddr->sin_family = AF_INET;
+	saddr->sin_port = htons(port);
+	saddr->sin_addr.s_addr = addr;
+
+	peer->len = sizeof(struct sockaddr_in);
+}
+
+void conn_peer_ipv6(struct conn_peer *peer, const uint8_t addr[16], uint16_t port)
+{
+	struct sockaddr_in6 *saddr = (struct sockaddr_in6 *)peer->storage;
+
+	memset(peer, 0x0, sizeof(struct conn_peer));
+
+	saddr->sin6_family = AF_INET6;
+	saddr->sin6_port = htons(port);
+	memcpy(&saddr->sin6_addr, addr, 16);
+
+	peer->len = sizeof(struct sockaddr_in6);
+}
+
+static int poll_events(struct conn_handle *conn, short events, uint32_t timeout_us)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct pollfd pfd;
+	int ret;
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto poll_events_exit;
+	}
+
+	pfd.fd = priv->fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	ret = poll(&pfd, 1, (int)((timeout_us + 999) / 1000));
+	if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+	}
+	else if (ret > 0)
+	{
+		ret = 1;
+	}
+
+poll_events_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_poll(struct conn_handle *conn, uint32_t timeout_us)
+{
+	return poll_events(conn, POLLIN, timeout_us);
+}
+
+int conn_poll_send(struct conn_handle *conn, uint32_t timeout_us)
+{
+	return poll_events(conn, POLLOUT, timeout_us);
+}
+
+int conn_resolve(const char *addr, uint32_t *result)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	int ret;
+
+	memset(&hints, 0x0, sizeof(struct addrinfo));
+
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	ret = getaddrinfo(addr, NULL, &hints, &res);
+	if (ret != 0 || res == NULL)
+	{
+		return -EADDRNOTAVAIL;
+	}
+
+	*result = ((const struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+
+	freeaddrinfo(res);
+
+	return 0;
+}
+
+int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret = 0;
+	int bytes_read = 0;
+
+	if (conn->type == CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_recv_exit;
+	}
+
+	while (buff_len > 0)
+	{
+		ret = recvfrom(priv->fd, (char *)buff, (socklen_t)buff_len, 0, NULL, NULL);
+
+		if (ret == 0)
+		{
+			ret = -EPIPE;
+
+			goto conn_recv_exit;
+		}
+		else if (ret == SOCKET_ERROR)
+		{
+			ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+			if (ret == -WSAESHUTDOWN)
+			{
+				ret = -EPIPE;
+			}
+#endif
+
+			goto conn_recv_exit;
+		}
+
+		buff_len -= ret;
+		buff += ret;
+		ret = bytes_read += ret;
+	}
+
+conn_recv_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_recv_some(struct conn_handle *conn, uint8_t *buff, size_t buff_len)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret;
+
+	if (conn->type == CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_recv_some_exit;
+	}
+
+	ret = recv(priv->fd, (char *)buff, (socklen_t)buff_len, 0);
+
+	if (ret == 0)
+	{
+		ret = -EPIPE;
+	}
+	else if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+		if (ret == -WSAESHUTDOWN)
+		{
+			ret = -EPIPE;
+		}
+#endif
+	}
+
+conn_recv_some_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_recv_socket(struct conn_handle *conn, struct conn_handle *received, uint8_t *buff, size_t buff_len)
+{
+#ifdef _WIN32
+	(void)conn, (void)received, (void)buff, (void)buff_len;
+
+	return -ENOTSUP;
+#else
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct conn_priv *rpriv = (struct conn_priv *)received->priv;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	int fd = -1;
+	int ret;
+
+	if (conn->type != CONN_TYPE_LOCAL)
+	{
+		return -EPROTOTYPE;
+	}
+
+	iov.iov_base = buff;
+	iov.iov_len = buff_len;
+
+	memset(&msg, 0x0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		mutex_unlock_shared(&priv->mutex);
+
+		return -ENOTCONN;
+	}
+
+	ret = (int)recvmsg(priv->fd, &msg, 0);
+
+	mutex_unlock_shared(&priv->mutex);
+
+	if (ret == 0)
+	{
+		return -EPIPE;
+	}
+	else if (ret == SOCKET_ERROR)
+	{
+		return SOCK_ERRNO;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+		{
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	// A message cut short may have lost the socket along with it
+	if (fd < 0 || (msg.msg_flags & MSG_CTRUNC))
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+
+		return -EBADMSG;
+	}
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	mutex_lock(&rpriv->mutex);
+
+	rpriv->sock_fd = fd;
+	rpriv->fd = fd;
+
+	mutex_unlock(&rpriv->mutex);
+
+	// The sender may still be using the socket
+	received->shared = 1;
+
+	return ret;
+#endif
+}
+
+int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len, uint32_t *addr, uint16_t *port)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret;
+
+	priv->remote_addr_len = sizeof(struct sockaddr_storage);
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_recv_any_exit;
+	}
+
+	ret = recvfrom(priv->fd, (char *)buff, (socklen_t)buff_len, 0, (struct sockaddr *)&priv->remote_addr, &priv->remote_addr_len);
+
+	if (ret == 0)
+	{
+		ret = -EPIPE;
+	}
+	else if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+		if (ret == -WSAESHUTDOWN)
+		{
+			ret = -EPIPE;
+		}
+#endif
+	}
+
+conn_recv_any_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	if (addr != NULL && ret > 0)
+	{
+		*addr = ((struct sockaddr_in *)&priv->remote_addr)->sin_addr.s_addr;
+	}
+
+	if (port != NULL && ret > 0)
+	{
+		*port = htons(((struct sockaddr_in *)&priv->remote_addr)->sin_port);
+	}
+
+	return ret;
+}
+
+int conn_recv_any_batch(struct conn_handle *conn, struct conn_dgram *dgrams, unsigned int count)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct sockaddr_in saddrs[CONN_BATCH_MAX];
+#ifdef HAVE_MMSG
+	struct mmsghdr msgs[CONN_BATCH_MAX];
+	struct iovec iovs[CONN_BATCH_MAX];
+#else
+	socklen_t saddr_len;
+	int flags;
+#endif
+	unsigned int i;
+	int ret;
+
+	if (count == 0 || count > CONN_BATCH_MAX)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_recv_any_batch_exit;
+	}
+
+#ifdef HAVE_MMSG
+	memset(msgs, 0x0, sizeof(struct mmsghdr) * count);
+
+	for (i = 0; i < count; i++)
+	{
+		iovs[i].iov_base = dgrams[i].buff;
+		iovs[i].iov_len = dgrams[i].buff_len;
+
+		msgs[i].msg_hdr.msg_name = &saddrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = recvmmsg(priv->fd, msgs, count, MSG_WAITFORONE, NULL);
+	if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+		goto conn_recv_any_batch_exit;
+	}
+
+	for (i = 0; i < (unsigned int)ret; i++)
+	{
+		// Like conn_recv_any, an empty datagram indicates a shutdown
+		if (msgs[i].msg_len == 0)
+		{
+			break;
+		}
+
+		dgrams[i].len = msgs[i].msg_len;
+	}
+#else
+	for (i = 0; i < count; i++)
+	{
+#  ifdef MSG_DONTWAIT
+		// Only wait for the first datagram
+		flags = i == 0 ? 0 : MSG_DONTWAIT;
+#  else
+		// Without a way to check for additional datagrams, receive only one
+		if (i > 0)
+		{
+			break;
+		}
+
+		flags = 0;
+#  endif
+
+		saddr_len = sizeof(struct sockaddr_in);
+
+		ret = recvfrom(priv->fd, (char *)dgrams[i].buff, (socklen_t)dgrams[i].buff_len, flags, (struct sockaddr *)&saddrs[i], &saddr_len);
+		if (ret == 0)
+		{
+			break;
+		}
+		else if (ret == SOCKET_ERROR)
+		{
+			ret = SOCK_ERRNO;
+
+#  ifdef _WIN32
+			if (ret == -WSAESHUTDOWN)
+			{
+				ret = -EPIPE;
+			}
+#  endif
+
+			if (i == 0)
+			{
+				goto conn_recv_any_batch_exit;
+			}
+
+			break;
+		}
+
+		dgrams[i].len = ret;
+	}
+#endif
+
+	if (i == 0)
+	{
+		ret = -EPIPE;
+
+		goto conn_recv_any_batch_exit;
+	}
+
+	for (ret = (int)i, i = 0; i < (unsigned int)ret; i++)
+	{
+		dgrams[i].addr = saddrs[i].sin_addr.s_addr;
+		dgrams[i].port = htons(saddrs[i].sin_port);
+	}
+
+conn_recv_any_batch_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret;
+
+	if (conn->type == CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
 	if (priv->fd != INVALID_SOCKET)
 	{
 		while (buff_len > 0)
@@ -615,6 +1514,219 @@ int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
 				goto conn_send_exit;
 			}
 
+			buff += ret;
+			buff_len -= ret;
+		}
+
+		ret = 0;
+	}
+	else
+	{
+		ret = -ENOTCONN;
+	}
+
+conn_send_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_send_some(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret;
+
+	if (conn->type == CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_send_some_exit;
+	}
+
+	ret = send(priv->fd, (char *)buff, (socklen_t)buff_len, MSG_NOSIGNAL);
+
+	if (ret == 0 && buff_len > 0)
+	{
+		ret = -EPIPE;
+	}
+	else if (ret == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+		if (ret == -WSAESHUTDOWN)
+		{
+			ret = -EPIPE;
+		}
+#endif
+	}
+
+conn_send_some_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_sendv(struct conn_handle *conn, const struct conn_iov *iov, unsigned int count)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret;
+
+	if (conn->type == CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	if (count > CONN_IOV_MAX)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd != INVALID_SOCKET)
+	{
+		ret = send_iov(priv->fd, iov, count, NULL);
+	}
+	else
+	{
+		ret = -ENOTCONN;
+	}
+
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_send_socket(struct conn_handle *conn, struct conn_handle *sent, const uint8_t *buff, size_t buff_len)
+{
+#ifdef _WIN32
+	(void)conn, (void)sent, (void)buff, (void)buff_len;
+
+	return -ENOTSUP;
+#else
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct conn_priv *spriv = (struct conn_priv *)sent->priv;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	int fd;
+	int ret;
+
+	if (conn->type != CONN_TYPE_LOCAL)
+	{
+		return -EPROTOTYPE;
+	}
+
+	// At least one byte must go along with the socket
+	if (buff_len == 0)
+	{
+		return -EINVAL;
+	}
+
+	iov.iov_base = (void *)buff;
+	iov.iov_len = buff_len;
+
+	memset(&control, 0x0, sizeof(control));
+	memset(&msg, 0x0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+	mutex_lock_shared(&spriv->mutex);
+	mutex_lock_shared(&priv->mutex);
+
+	fd = spriv->fd;
+
+	if (priv->fd == INVALID_SOCKET || fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+	}
+	else
+	{
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+		ret = (int)sendmsg(priv->fd, &msg, MSG_NOSIGNAL);
+
+		// The socket went along with the part which was sent
+		while (ret != SOCKET_ERROR && (size_t)ret < buff_len)
+		{
+			buff += ret;
+			buff_len -= (size_t)ret;
+
+			ret = (int)send(priv->fd, (const char *)buff, buff_len, MSG_NOSIGNAL);
+		}
+
+		ret = ret == SOCKET_ERROR ? SOCK_ERRNO : 0;
+	}
+
+	mutex_unlock_shared(&priv->mutex);
+	mutex_unlock_shared(&spriv->mutex);
+
+	if (ret == 0)
+	{
+		sent->shared = 1;
+	}
+
+	return ret;
+#endif
+}
+
+int conn_send_peer(struct conn_handle *conn, const uint8_t *buff, size_t buff_len, const struct conn_peer *peer)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	int ret;
+
+	if (conn->type != CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd != INVALID_SOCKET)
+	{
+		while (buff_len > 0)
+		{
+			ret = sendto(priv->fd, (char *)buff, (socklen_t)buff_len, MSG_NOSIGNAL, (const struct sockaddr *)peer->storage, (socklen_t)peer->len);
+
+			if (ret == 0)
+			{
+				ret = -EPIPE;
+
+				goto conn_send_peer_exit;
+			}
+			else if (ret == SOCKET_ERROR)
+			{
+				ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+				if (ret == -WSAESHUTDOWN)
+				{
+					ret = -EPIPE;
+				}
+#endif
+				goto conn_send_peer_exit;
+			}
+
 			buff_len -= ret;
 		}
 
@@ -625,16 +1737,68 @@ int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
 		ret = -ENOTCONN;
 	}
 
-conn_send_exit:
+conn_send_peer_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_send_to(struct conn_handle *conn, const uint8_t *buff, size_t buff_len, uint32_t addr, uint16_t port)
+{
+	struct conn_peer peer;
+
+	conn_peer_ipv4(&peer, addr, port);
+
+	return conn_send_peer(conn, buff, buff_len, &peer);
+}
+
+int conn_send_tov(struct conn_handle *conn, const struct conn_iov *iov, unsigned int count, uint32_t addr, uint16_t port)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct sockaddr_in saddr;
+	int ret;
+
+	if (conn->type != CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
+	}
+
+	if (count > CONN_IOV_MAX)
+	{
+		return -EINVAL;
+	}
+
+	memset(&saddr, 0x0, sizeof(struct sockaddr_in));
+
+	saddr.sin_family = AF_INET;
+	saddr.sin_port = htons(port);
+	saddr.sin_addr.s_addr = addr;
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd != INVALID_SOCKET)
+	{
+		ret = send_iov(priv->fd, iov, count, &saddr);
+	}
+	else
+	{
+		ret = -ENOTCONN;
+	}
+
 	mutex_unlock_shared(&priv->mutex);
 
 	return ret;
 }
 
-int conn_send_to(struct conn_handle *conn, const uint8_t *buff, size_t buff_len, uint32_t addr, uint16_t port)
+int conn_send_to_batch(struct conn_handle *conn, const struct conn_dgram *dgrams, unsigned int count)
 {
+#ifdef HAVE_MMSG
 	struct conn_priv *priv = (struct conn_priv *)conn->priv;
-	struct sockaddr_in saddr;
+	struct sockaddr_in saddrs[CONN_BATCH_MAX];
+	struct mmsghdr msgs[CONN_BATCH_MAX];
+	struct iovec iovs[CONN_BATCH_MAX];
+#endif
+	unsigned int i;
 	int ret;
 
 	if (conn->type != CONN_TYPE_UDP)
@@ -642,53 +1806,241 @@ int conn_send_to(struct conn_handle *conn, const uint8_t *buff, size_t buff_len,
 		return -EPROTOTYPE;
 	}
 
-	memset(&saddr, 0x0, sizeof(struct sockaddr_in));
+	if (count > CONN_BATCH_MAX)
+	{
+		return -EINVAL;
+	}
 
-	saddr.sin_family = AF_INET;
-	saddr.sin_port = htons(port);
-	saddr.sin_addr.s_addr = addr;
+#ifdef HAVE_MMSG
+	memset(saddrs, 0x0, sizeof(struct sockaddr_in) * count);
+	memset(msgs, 0x0, sizeof(struct mmsghdr) * count);
+
+	for (i = 0; i < count; i++)
+	{
+		saddrs[i].sin_family = AF_INET;
+		saddrs[i].sin_port = htons(dgrams[i].port);
+		saddrs[i].sin_addr.s_addr = dgrams[i].addr;
+
+		iovs[i].iov_base = dgrams[i].buff;
+		iovs[i].iov_len = dgrams[i].len;
+
+		msgs[i].msg_hdr.msg_name = &saddrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
 
 	mutex_lock_shared(&priv->mutex);
 
-	if (priv->fd != INVALID_SOCKET)
+	if (priv->fd == INVALID_SOCKET)
 	{
-		while (buff_len > 0)
+		ret = -ENOTCONN;
+
+		goto conn_send_to_batch_exit;
+	}
+
+	for (i = 0; i < count; i += ret)
+	{
+		ret = sendmmsg(priv->fd, &msgs[i], count - i, MSG_NOSIGNAL);
+		if (ret == 0)
 		{
-			ret = sendto(priv->fd, (char *)buff, (socklen_t)buff_len, MSG_NOSIGNAL, (struct sockaddr *)&saddr, sizeof(struct sockaddr_in));
+			ret = -EPIPE;
 
-			if (ret == 0)
+			goto conn_send_to_batch_exit;
+		}
+		else if (ret == SOCKET_ERROR)
+		{
+			ret = SOCK_ERRNO;
+
+			goto conn_send_to_batch_exit;
+		}
+	}
+
+	ret = 0;
+
+conn_send_to_batch_exit:
+	mutex_unlock_shared(&priv->mutex);
+#else
+	for (i = 0, ret = 0; i < count && ret == 0; i++)
+	{
+		ret = conn_send_to(conn, dgrams[i].buff, dgrams[i].len, dgrams[i].addr, dgrams[i].port);
+	}
+#endif
+
+	return ret;
+}
+
+static int send_iov(SOCKET fd, const struct conn_iov *iov, unsigned int count, const struct sockaddr_in *saddr)
+{
+#ifdef _WIN32
+	WSABUF bufs[CONN_IOV_MAX];
+	DWORD sent;
+	int ret;
+#else
+	struct iovec bufs[CONN_IOV_MAX];
+	struct msghdr msg;
+	ssize_t sent;
+#endif
+	unsigned int first = 0;
+	unsigned int num;
+	size_t off = 0;
+	size_t avail;
+
+	while (first < count)
+	{
+		// Skip over anything which has already been sent
+		if (off == iov[first].len)
+		{
+			first++;
+			off = 0;
+
+			continue;
+		}
+
+		for (num = 0; first + num < count; num++)
+		{
+			avail = num == 0 ? off : 0;
+#ifdef _WIN32
+			bufs[num].buf = (CHAR *)iov[first + num].buff + avail;
+			bufs[num].len = (ULONG)(iov[first + num].len - avail);
+#else
+			bufs[num].iov_base = (void *)(iov[first + num].buff + avail);
+			bufs[num].iov_len = iov[first + num].len - avail;
+#endif
+		}
+
+#ifdef _WIN32
+		if (saddr != NULL)
+		{
+			ret = WSASendTo(fd, bufs, num, &sent, 0, (const struct sockaddr *)saddr, sizeof(struct sockaddr_in), NULL, NULL);
+		}
+		else
+		{
+			ret = WSASend(fd, bufs, num, &sent, 0, NULL, NULL);
+		}
+
+		if (ret == SOCKET_ERROR)
+		{
+			ret = SOCK_ERRNO;
+
+			if (ret == -WSAESHUTDOWN)
 			{
 				ret = -EPIPE;
-
-				goto conn_send_to_exit;
 			}
-			else if (ret == SOCKET_ERROR)
-			{
-				ret = SOCK_ERRNO;
 
-#ifdef _WIN32
-				if (ret == -WSAESHUTDOWN)
-				{
-					ret = -EPIPE;
-				}
+			return ret;
+		}
+#else
+		memset(&msg, 0x0, sizeof(struct msghdr));
+
+		msg.msg_name = (void *)saddr;
+		msg.msg_namelen = saddr != NULL ? sizeof(struct sockaddr_in) : 0;
+		msg.msg_iov = bufs;
+		msg.msg_iovlen = num;
+
+		sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (sent == SOCKET_ERROR)
+		{
+			return SOCK_ERRNO;
+		}
 #endif
-				goto conn_send_to_exit;
+
+		if (sent == 0)
+		{
+			return -EPIPE;
+		}
+
+		// Advance past the data which was sent
+		while (sent > 0)
+		{
+			avail = iov[first].len - off;
+			if ((size_t)sent < avail)
+			{
+				off += sent;
+				break;
 			}
 
-			buff_len -= ret;
+			sent -= avail;
+			first++;
+			off = 0;
 		}
+	}
 
-		ret = 0;
+	return 0;
+}
+
+int conn_filter_sources(struct conn_handle *conn, const uint32_t *addrs, unsigned int count)
+{
+#ifdef __linux__
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct sock_filter code[CONN_FILTER_MAX + 3];
+	struct sock_fprog prog;
+	struct sockaddr_storage local;
+	socklen_t local_len = sizeof(struct sockaddr_storage);
+	unsigned int i;
+	int ret = 0;
+
+	if (conn->type != CONN_TYPE_UDP)
+	{
+		return -EPROTOTYPE;
 	}
-	else
+
+	if (count > CONN_FILTER_MAX)
+	{
+		return -EINVAL;
+	}
+
+	// Load the source address from the IPv4 header, then jump past the drop
+	// to the accept if it is any of the given addresses
+	code[0] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12);
+
+	for (i = 0; i < count; i++)
+	{
+		code[i + 1] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(addrs[i]), (uint8_t)(count - i), 0);
+	}
+
+	code[count + 1] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+	code[count + 2] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF);
+
+	prog.len = (unsigned short)(count + 3);
+	prog.filter = code;
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
 	{
 		ret = -ENOTCONN;
 	}
+	else if (getsockname(priv->fd, (struct sockaddr *)&local, &local_len) == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+	}
+	else if (local.ss_family != AF_INET)
+	{
+		ret = -ENOTSUP;
+	}
+	else if (addrs == NULL)
+	{
+		if (setsockopt(priv->fd, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0) == SOCKET_ERROR && errno != ENOENT)
+		{
+			ret = SOCK_ERRNO;
+		}
+	}
+	else if (setsockopt(priv->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(struct sock_fprog)) == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+	}
 
-conn_send_to_exit:
 	mutex_unlock_shared(&priv->mutex);
 
 	return ret;
+#else
+	(void)conn;
+	(void)addrs;
+	(void)count;
+
+	return -ENOTSUP;
+#endif
 }
 
 void conn_drop(struct conn_handle *conn)
@@ -769,7 +2121,8 @@ void conn_shutdown(struct conn_handle *conn)
 		shutdown(priv->conn_fd, SHUT_RDWR);
 	}
 
-	if (priv->sock_fd != INVALID_SOCKET)
+	// Shutting down a shared socket would shut it down in the other process
+	if (priv->sock_fd != INVALID_SOCKET && !conn->shared)
 	{
 		shutdown(priv->sock_fd, SHUT_RDWR);
 #ifdef _WIN32
@@ -782,6 +2135,169 @@ void conn_shutdown(struct conn_handle *conn)
 	mutex_unlock_shared(&priv->mutex);
 }
 
+int conn_set_nonblocking(struct conn_handle *conn, int nonblocking)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+#ifdef _WIN32
+	u_long mode = nonblocking ? 1 : 0;
+#else
+	int flags;
+#endif
+	int ret = 0;
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_set_nonblocking_exit;
+	}
+
+#ifdef _WIN32
+	if (ioctlsocket(priv->fd, FIONBIO, &mode) == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+	}
+#else
+	flags = fcntl(priv->fd, F_GETFL, 0);
+	if (flags == -1)
+	{
+		ret = SOCK_ERRNO;
+
+		goto conn_set_nonblocking_exit;
+	}
+
+	flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+
+	if (fcntl(priv->fd, F_SETFL, flags) == -1)
+	{
+		ret = SOCK_ERRNO;
+	}
+#endif
+
+conn_set_nonblocking_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+int conn_set_sockopts(struct conn_handle *conn, const struct conn_sockopts *opts)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	struct sockaddr_storage local;
+	socklen_t local_len = sizeof(struct sockaddr_storage);
+	const int yes = 1;
+	int tos;
+	int ret = 0;
+
+	mutex_lock_shared(&priv->mutex);
+
+	if (priv->fd == INVALID_SOCKET)
+	{
+		ret = -ENOTCONN;
+
+		goto conn_set_sockopts_exit;
+	}
+
+	if (opts->rcvbuf > 0 && setsockopt(priv->fd, SOL_SOCKET, SO_RCVBUF, (void *)&opts->rcvbuf, sizeof(int)) == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+		goto conn_set_sockopts_exit;
+	}
+
+	if (opts->sndbuf > 0 && setsockopt(priv->fd, SOL_SOCKET, SO_SNDBUF, (void *)&opts->sndbuf, sizeof(int)) == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+		goto conn_set_sockopts_exit;
+	}
+
+	if (opts->dscp > 0)
+	{
+		// The code point is the upper six bits of the old type of service
+		tos = opts->dscp << 2;
+
+		if (getsockname(priv->fd, (struct sockaddr *)&local, &local_len) == SOCKET_ERROR)
+		{
+			ret = SOCK_ERRNO;
+
+			goto conn_set_sockopts_exit;
+		}
+
+		if (local.ss_family == AF_INET)
+		{
+			if (setsockopt(priv->fd, IPPROTO_IP, IP_TOS, (void *)&tos, sizeof(int)) == SOCKET_ERROR)
+			{
+				ret = SOCK_ERRNO;
+
+				goto conn_set_sockopts_exit;
+			}
+		}
+#ifdef IPV6_TCLASS
+		else if (local.ss_family == AF_INET6)
+		{
+			if (setsockopt(priv->fd, IPPROTO_IPV6, IPV6_TCLASS, (void *)&tos, sizeof(int)) == SOCKET_ERROR)
+			{
+				ret = SOCK_ERRNO;
+
+				goto conn_set_sockopts_exit;
+			}
+		}
+#endif
+		else
+		{
+			ret = -ENOTSUP;
+
+			goto conn_set_sockopts_exit;
+		}
+	}
+
+	if (conn->type != CONN_TYPE_TCP)
+	{
+		goto conn_set_sockopts_exit;
+	}
+
+	if (opts->nodelay && setsockopt(priv->fd, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(int)) == SOCKET_ERROR)
+	{
+		ret = SOCK_ERRNO;
+
+		goto conn_set_sockopts_exit;
+	}
+
+	if (opts->quickack)
+	{
+#ifdef TCP_QUICKACK
+		if (setsockopt(priv->fd, IPPROTO_TCP, TCP_QUICKACK, (void *)&yes, sizeof(int)) == SOCKET_ERROR)
+		{
+			ret = SOCK_ERRNO;
+		}
+#else
+		ret = -ENOTSUP;
+#endif
+	}
+
+conn_set_sockopts_exit:
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
+intptr_t conn_get_fd(struct conn_handle *conn)
+{
+	struct conn_priv *priv = (struct conn_priv *)conn->priv;
+	intptr_t ret;
+
+	mutex_lock_shared(&priv->mutex);
+
+	ret = priv->fd == INVALID_SOCKET ? -1 : (intptr_t)priv->fd;
+
+	mutex_unlock_shared(&priv->mutex);
+
+	return ret;
+}
+
 void conn_get_remote_addr(const struct conn_handle *conn, char dest[46])
 {
 	const struct conn_priv *priv = (const struct conn_priv *)conn->priv;
@@ -0,0 +1,169 @@
+/*!
+ * @file conn_pool.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of preallocated pools of network connections
+ */
+
+#include "conn.h"
+#include "conn_pool.h"
+#include "freelist.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * @brief Private data for an instance of a connection pool
+ */
+struct conn_pool_priv
+{
+	/// Storage for every connection in the pool
+	struct conn_handle *conns;
+
+	/// Indices in conn_pool_priv::conns of the connections not in use
+	struct freelist_handle unused;
+};
+
+void conn_pool_free(struct conn_pool_handle *pool)
+{
+	if (pool->priv != NULL)
+	{
+		struct conn_pool_priv *priv = (struct conn_pool_priv *)pool->priv;
+		size_t i;
+
+		if (priv->conns != NULL)
+		{
+			for (i = 0; i < pool->size; i++)
+			{
+				conn_free(&priv->conns[i]);
+			}
+		}
+
+		freelist_free(&priv->unused);
+
+		free(priv->conns);
+
+		free(pool->priv);
+		pool->priv = NULL;
+	}
+}
+
+struct conn_handle * conn_pool_get(struct conn_pool_handle *pool)
+{
+	struct conn_pool_priv *priv = (struct conn_pool_priv *)pool->priv;
+	int idx;
+
+	idx = freelist_pop(&priv->unused);
+	if (idx < 0)
+	{
+		return NULL;
+	}
+
+	return &priv->conns[idx];
+}
+
+int conn_pool_init(struct conn_pool_handle *pool)
+{
+	struct conn_pool_priv *priv;
+	size_t i;
+	int ret;
+
+	if (pool->size == 0 || pool->size > INT32_MAX)
+	{
+		return -EINVAL;
+	}
+
+	if (pool->priv == NULL)
+	{
+		pool->priv = malloc(sizeof(struct conn_pool_priv));
+	}
+
+	if (pool->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(pool->priv, 0x0, sizeof(struct conn_pool_priv));
+	priv = (struct conn_pool_priv *)pool->priv;
+
+	priv->unused.size = (uint32_t)pool->size;
+
+	ret = freelist_init(&priv->unused);
+	if (ret < 0)
+	{
+		goto conn_pool_init_exit;
+	}
+
+	priv->conns = calloc(pool->size, sizeof(struct conn_handle));
+	if (priv->conns == NULL)
+	{
+		ret = -ENOMEM;
+		goto conn_pool_init_exit;
+	}
+
+	for (i = 0; i < pool->size; i++)
+	{
+		ret = conn_init(&priv->conns[i]);
+		if (ret < 0)
+		{
+			goto conn_pool_init_exit;
+		}
+
+		freelist_push(&priv->unused, (uint32_t)i);
+	}
+
+	return 0;
+
+conn_pool_init_exit:
+	conn_pool_free(pool);
+
+	return ret;
+}
+
+void conn_pool_put(struct conn_pool_handle *pool, struct conn_handle *conn)
+{
+	struct conn_pool_priv *priv = (struct conn_pool_priv *)pool->priv;
+
+	freelist_push(&priv->unused, (uint32_t)(conn - priv->conns));
+}
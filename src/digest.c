@@ -48,6 +48,7 @@
 #include "md5.h"
 
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 
 #ifdef _WIN32
@@ -96,6 +97,21 @@ static inline uint8_t hex4_to_digest(const char data);
  */
 static inline uint8_t hex8_to_digest(const char data[2]);
 
+int digest_equal(const uint8_t a[DIGEST_LEN], const uint8_t b[DIGEST_LEN])
+{
+	uint8_t diff = 0;
+	size_t i;
+
+	// Examine every byte, so that the time taken doesn't reveal where the
+	// first difference is
+	for (i = 0; i < DIGEST_LEN; i++)
+	{
+		diff |= a[i] ^ b[i];
+	}
+
+	return diff == 0;
+}
+
 void digest_get(const uint8_t *data, const unsigned int len, uint8_t result[DIGEST_LEN])
 {
 	MD5_CTX ctx;
@@ -107,6 +123,54 @@ void digest_get(const uint8_t *data, const unsigned int len, uint8_t result[DIGE
 	MD5_Final((unsigned char *)result, &ctx);
 }
 
+void digest_password_init(struct digest_password *dp, const char *password)
+{
+	char chunk[64];
+	size_t chunk_len = 0;
+
+	MD5_Init(&dp->ctx);
+
+	// Digest the password in pieces so that no allocation is needed, however
+	// long it may be
+	while (*password != '\0')
+	{
+		if (*password >= 97 && *password <= 122)
+		{
+			chunk[chunk_len] = *password - 32;
+		}
+		else
+		{
+			chunk[chunk_len] = *password;
+		}
+
+		chunk_len++;
+		password++;
+
+		if (chunk_len == sizeof(chunk))
+		{
+			MD5_Update(&dp->ctx, chunk, (unsigned long)chunk_len);
+			chunk_len = 0;
+		}
+	}
+
+	if (chunk_len > 0)
+	{
+		MD5_Update(&dp->ctx, chunk, (unsigned long)chunk_len);
+	}
+}
+
+void digest_password_response(const struct digest_password *dp, const uint32_t nonce, uint8_t result[DIGEST_LEN])
+{
+	MD5_CTX ctx = dp->ctx;
+	char nonce_str[8];
+
+	digest_to_hex32(nonce, nonce_str);
+
+	MD5_Update(&ctx, nonce_str, sizeof(nonce_str));
+
+	MD5_Final((unsigned char *)result, &ctx);
+}
+
 static inline void digest_to_hex8(const uint8_t data, char result[2])
 {
 	static const char lookup[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
@@ -0,0 +1,159 @@
+/*!
+ * @file freelist.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of lock-free lists of free indices
+ */
+
+#include "atomic.h"
+#include "freelist.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * @brief Private data for an instance of a free list
+ *
+ * The list is a stack threaded through freelist_priv::next. The head packs
+ * the index of the top entry plus one into its low 32 bits, with zero meaning
+ * empty. The high 32 bits are a tag which changes on every update, so that a
+ * pop which raced with other pops and pushes of the same index can't succeed
+ * with a stale successor.
+ */
+struct freelist_priv
+{
+	/// Tag and top entry of the stack
+	volatile uint64_t head;
+
+	/// For each entry in the stack, the index plus one of the entry below it
+	volatile uint32_t *next;
+};
+
+void freelist_free(struct freelist_handle *fl)
+{
+	if (fl->priv != NULL)
+	{
+		struct freelist_priv *priv = (struct freelist_priv *)fl->priv;
+
+		free((void *)priv->next);
+
+		free(fl->priv);
+		fl->priv = NULL;
+	}
+}
+
+int freelist_init(struct freelist_handle *fl)
+{
+	struct freelist_priv *priv;
+
+	// Indices must be representable by the return value of freelist_pop
+	if (fl->size == 0 || fl->size > INT32_MAX)
+	{
+		return -EINVAL;
+	}
+
+	if (fl->priv == NULL)
+	{
+		fl->priv = malloc(sizeof(struct freelist_priv));
+	}
+
+	if (fl->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(fl->priv, 0x0, sizeof(struct freelist_priv));
+	priv = (struct freelist_priv *)fl->priv;
+
+	priv->next = calloc(fl->size, sizeof(uint32_t));
+	if (priv->next == NULL)
+	{
+		free(fl->priv);
+		fl->priv = NULL;
+
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int freelist_pop(struct freelist_handle *fl)
+{
+	struct freelist_priv *priv = (struct freelist_priv *)fl->priv;
+	uint64_t head;
+	uint32_t top;
+	uint32_t next;
+
+	do
+	{
+		head = atomic_u64_load(&priv->head);
+
+		top = (uint32_t)head;
+		if (top == 0)
+		{
+			return -ENOENT;
+		}
+
+		// If the entry is popped by someone else in the meantime, this may
+		// read garbage, but the tag will then have changed and the exchange
+		// will fail
+		next = atomic_u32_load(&priv->next[top - 1]);
+	}
+	while (!atomic_u64_cas(&priv->head, head, (((head >> 32) + 1) << 32) | next));
+
+	return (int)(top - 1);
+}
+
+void freelist_push(struct freelist_handle *fl, uint32_t index)
+{
+	struct freelist_priv *priv = (struct freelist_priv *)fl->priv;
+	uint64_t head;
+
+	do
+	{
+		head = atomic_u64_load(&priv->head);
+
+		atomic_u32_store(&priv->next[index], (uint32_t)head);
+	}
+	while (!atomic_u64_cas(&priv->head, head, (((head >> 32) + 1) << 32) | (index + 1)));
+}
@@ -0,0 +1,184 @@
+/*!
+ * @file histogram.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of lock-free log-linear histograms
+ */
+
+#include "atomic.h"
+#include "histogram.h"
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+#include <stdint.h>
+
+/// Number of buckets into which each power of two is split
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/*!
+ * @brief Gets the position of the most significant set bit of a value
+ *
+ * @param[in] value Value to inspect, which must not be 0
+ *
+ * @returns Zero-based position of the bit
+ */
+static inline unsigned int msb(uint64_t value);
+
+static inline unsigned int msb(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long pos;
+
+	_BitScanReverse64(&pos, value);
+
+	return (unsigned int)pos;
+#else
+	return 63 - (unsigned int)__builtin_clzll(value);
+#endif
+}
+
+size_t histogram_bucket(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < HISTOGRAM_SUB_BUCKETS)
+	{
+		return (size_t)value;
+	}
+
+	if (value >> HISTOGRAM_MAX_BITS)
+	{
+		return HISTOGRAM_BUCKETS - 1;
+	}
+
+	// The bits below the most significant one select the bucket within the
+	// power of two
+	shift = msb(value) - HISTOGRAM_SUB_BITS;
+
+	return ((size_t)(shift + 1) << HISTOGRAM_SUB_BITS) + (size_t)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+uint64_t histogram_bucket_max(size_t bucket)
+{
+	if (bucket >= HISTOGRAM_BUCKETS - 1)
+	{
+		return UINT64_MAX;
+	}
+
+	return histogram_bucket_min(bucket + 1) - 1;
+}
+
+uint64_t histogram_bucket_min(size_t bucket)
+{
+	size_t block = bucket >> HISTOGRAM_SUB_BITS;
+	uint64_t sub = bucket & (HISTOGRAM_SUB_BUCKETS - 1);
+
+	if (block == 0)
+	{
+		return sub;
+	}
+
+	return (HISTOGRAM_SUB_BUCKETS + sub) << (block - 1);
+}
+
+uint64_t histogram_quantile(const uint64_t buckets[HISTOGRAM_BUCKETS], uint32_t permille)
+{
+	uint64_t count = 0;
+	uint64_t rank;
+	uint64_t seen = 0;
+	size_t i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		count += buckets[i];
+	}
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// Smallest number of values which covers the quantile, at least one
+	rank = (count * permille + 999) / 1000;
+	if (rank == 0)
+	{
+		rank = 1;
+	}
+
+	for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+		{
+			break;
+		}
+	}
+
+	return histogram_bucket_max(i);
+}
+
+uint64_t histogram_read(const struct histogram *hist, uint64_t buckets[HISTOGRAM_BUCKETS], uint64_t *sum)
+{
+	uint64_t count = 0;
+	size_t i;
+
+	if (sum != NULL)
+	{
+		*sum = atomic_u64_load(&hist->sum);
+	}
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		buckets[i] = atomic_u64_load(&hist->buckets[i]);
+		count += buckets[i];
+	}
+
+	return count;
+}
+
+void histogram_record(struct histogram *hist, uint64_t value)
+{
+	atomic_u64_add(&hist->buckets[histogram_bucket(value)], 1);
+	atomic_u64_add(&hist->sum, value);
+}
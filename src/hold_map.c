@@ -0,0 +1,293 @@
+/*!
+ * @file hold_map.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of the table of callsigns which slots are held for
+ */
+
+#include "hold_map.h"
+#include "mutex.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Maximum length of a held callsign, including the null terminator
+#define HOLD_MAP_CALLSIGN_LEN 12
+
+/// Value of hold_map_entry::next and hold_map_priv::buckets marking the end
+/// of a chain
+#define HOLD_MAP_NONE UINT32_MAX
+
+/*!
+ * @brief The callsign a single slot is held for
+ */
+struct hold_map_entry
+{
+	/// Null-terminated callsign, or empty if the slot is not held
+	char callsign[HOLD_MAP_CALLSIGN_LEN];
+
+	/// Index of the next slot in the same bucket, or ::HOLD_MAP_NONE
+	uint32_t next;
+};
+
+/*!
+ * @brief Private data for an instance of a hold map
+ */
+struct hold_map_priv
+{
+	/// Index of the first slot in each bucket, or ::HOLD_MAP_NONE
+	uint32_t *buckets;
+
+	/// One less than the number of buckets, which is a power of two
+	uint32_t mask;
+
+	/// Storage for the callsign of each slot, indexed by slot
+	struct hold_map_entry *entries;
+
+	/// Mutex for protecting the buckets and entries
+	struct mutex_handle mutex;
+};
+
+/*!
+ * @brief Finds the bucket a callsign belongs in
+ *
+ * @param[in] priv Private data of the target hold map instance
+ * @param[in] callsign Null-terminated callsign
+ *
+ * @returns Index of the bucket
+ */
+static uint32_t hold_map_bucket(const struct hold_map_priv *priv, const char *callsign);
+
+/*!
+ * @brief Removes a slot from its bucket, if it is in one
+ *
+ * The caller must hold hold_map_priv::mutex.
+ *
+ * @param[in,out] priv Private data of the target hold map instance
+ * @param[in] slot Index of the slot
+ */
+static void hold_map_unlink(struct hold_map_priv *priv, uint32_t slot);
+
+static uint32_t hold_map_bucket(const struct hold_map_priv *priv, const char *callsign)
+{
+	uint32_t hash = 2166136261U;
+
+	// FNV-1a
+	while (*callsign != '\0')
+	{
+		hash ^= (uint8_t)*callsign++;
+		hash *= 16777619U;
+	}
+
+	return hash & priv->mask;
+}
+
+static void hold_map_unlink(struct hold_map_priv *priv, uint32_t slot)
+{
+	struct hold_map_entry *entry = &priv->entries[slot];
+	uint32_t *link;
+
+	if (entry->callsign[0] == '\0')
+	{
+		return;
+	}
+
+	for (link = &priv->buckets[hold_map_bucket(priv, entry->callsign)]; *link != HOLD_MAP_NONE; link = &priv->entries[*link].next)
+	{
+		if (*link == slot)
+		{
+			*link = entry->next;
+			break;
+		}
+	}
+
+	entry->callsign[0] = '\0';
+	entry->next = HOLD_MAP_NONE;
+}
+
+void hold_map_del(struct hold_map_handle *hm, uint32_t slot)
+{
+	struct hold_map_priv *priv = (struct hold_map_priv *)hm->priv;
+
+	mutex_lock(&priv->mutex);
+
+	hold_map_unlink(priv, slot);
+
+	mutex_unlock(&priv->mutex);
+}
+
+int hold_map_find(struct hold_map_handle *hm, const char *callsign)
+{
+	struct hold_map_priv *priv = (struct hold_map_priv *)hm->priv;
+	int ret = -ENOENT;
+	uint32_t slot;
+
+	if (callsign[0] == '\0')
+	{
+		return -ENOENT;
+	}
+
+	mutex_lock(&priv->mutex);
+
+	for (slot = priv->buckets[hold_map_bucket(priv, callsign)]; slot != HOLD_MAP_NONE; slot = priv->entries[slot].next)
+	{
+		if (strncmp(priv->entries[slot].callsign, callsign, HOLD_MAP_CALLSIGN_LEN) == 0)
+		{
+			ret = (int)slot;
+			break;
+		}
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return ret;
+}
+
+void hold_map_free(struct hold_map_handle *hm)
+{
+	if (hm->priv != NULL)
+	{
+		struct hold_map_priv *priv = (struct hold_map_priv *)hm->priv;
+
+		mutex_free(&priv->mutex);
+
+		free(priv->entries);
+		free(priv->buckets);
+
+		free(hm->priv);
+		hm->priv = NULL;
+	}
+}
+
+int hold_map_init(struct hold_map_handle *hm)
+{
+	struct hold_map_priv *priv;
+	uint32_t num_buckets = 1;
+	uint32_t i;
+	int ret;
+
+	if (hm->size == 0 || hm->size > HOLD_MAP_NONE / 4)
+	{
+		return -EINVAL;
+	}
+
+	if (hm->priv == NULL)
+	{
+		hm->priv = malloc(sizeof(struct hold_map_priv));
+	}
+
+	if (hm->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(hm->priv, 0x0, sizeof(struct hold_map_priv));
+
+	priv = (struct hold_map_priv *)hm->priv;
+
+	// Keep the chains short even when every slot is held
+	while (num_buckets < hm->size * 2)
+	{
+		num_buckets *= 2;
+	}
+
+	priv->mask = num_buckets - 1;
+
+	priv->buckets = malloc(sizeof(uint32_t) * num_buckets);
+	priv->entries = calloc(hm->size, sizeof(struct hold_map_entry));
+	if (priv->buckets == NULL || priv->entries == NULL)
+	{
+		ret = -ENOMEM;
+		goto hold_map_init_exit;
+	}
+
+	for (i = 0; i < num_buckets; i++)
+	{
+		priv->buckets[i] = HOLD_MAP_NONE;
+	}
+
+	for (i = 0; i < hm->size; i++)
+	{
+		priv->entries[i].next = HOLD_MAP_NONE;
+	}
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		goto hold_map_init_exit;
+	}
+
+	return 0;
+
+hold_map_init_exit:
+	free(priv->entries);
+	free(priv->buckets);
+
+	free(hm->priv);
+	hm->priv = NULL;
+
+	return ret;
+}
+
+void hold_map_put(struct hold_map_handle *hm, uint32_t slot, const char *callsign)
+{
+	struct hold_map_priv *priv = (struct hold_map_priv *)hm->priv;
+	struct hold_map_entry *entry = &priv->entries[slot];
+	size_t len = strlen(callsign);
+	uint32_t bucket;
+
+	mutex_lock(&priv->mutex);
+
+	hold_map_unlink(priv, slot);
+
+	if (len > 0 && len < HOLD_MAP_CALLSIGN_LEN)
+	{
+		bucket = hold_map_bucket(priv, callsign);
+
+		memcpy(entry->callsign, callsign, len + 1);
+		entry->next = priv->buckets[bucket];
+		priv->buckets[bucket] = slot;
+	}
+
+	mutex_unlock(&priv->mutex);
+}
@@ -46,19 +46,42 @@
 
 #include "openelp/openelp.h"
 
+#include "atomic.h"
 #include "log.h"
 #include "log_eventlog.h"
 #include "log_syslog.h"
+#include "mutex.h"
+#include "queue.h"
+#include "thread.h"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #define OCH_STR1(x) #x
 #define OCH_STR2(x) OCH_STR1(x)
 
+/// Number of bytes in each queued log record, including the level
+#define LOG_RECORD_LEN 256
+
+/// Number of log records which can wait for the writer thread
+#define LOG_QUEUE_LEN 256
+
+/*!
+ * @brief Formatted log message waiting to be written to the medium
+ */
+struct log_record
+{
+	/// Message importance level
+	uint8_t lvl;
+
+	/// Null-terminated message text
+	char msg[LOG_RECORD_LEN - 1];
+};
+
 /*!
  * @brief Private data for an instance of logging infrastrucure
  */
@@ -85,6 +108,39 @@ struct log_priv
 	}
 	/// Private data for ::LOG_MEDIUM_FILE
 	medium_file;
+
+	/// Records waiting to be written by log_priv::thread_writer
+	struct queue_handle queue;
+
+	/// Thread which writes log_priv::queue to the medium
+	struct thread_handle thread_writer;
+
+	/// Used to protect the medium, and to wait for records
+	struct mutex_handle mutex;
+
+	/// Signaled when a record is added while the writer is waiting
+	struct condvar_handle condvar_writer;
+
+	/// Indicates that records should be queued for log_priv::thread_writer
+	volatile uint32_t writer_running;
+
+	/// Indicates that log_priv::thread_writer may be waiting for records
+	volatile uint32_t writer_sleeping;
+
+	/// Termination indicator for log_priv::thread_writer
+	volatile uint32_t writer_stop;
+
+	/// Number of records discarded because log_priv::queue was full
+	volatile uint32_t dropped;
+
+	/// Value of log_priv::dropped when it was last reported to the medium
+	uint32_t dropped_reported;
+
+	/// Time at which log_priv::tstamp was formatted
+	time_t tstamp_epoch;
+
+	/// Null-terminated timestamp for lines written to a log file
+	char tstamp[16];
 };
 
 /// Event log Indentifier lookup table
@@ -117,6 +173,43 @@ static const int SYSLOG_LEVEL[] =
 	LOG_DEBUG,
 };
 
+/*!
+ * @brief Flushes any buffered output to the current medium
+ *
+ * @param[in] log Target logging infrastructure instance
+ */
+static void log_flush(struct log_handle *log);
+
+/*!
+ * @brief Writes a formatted message to the current medium
+ *
+ * The caller must hold log_priv::mutex.
+ *
+ * @param[in] log Target logging infrastructure instance
+ * @param[in] lvl Message importance level
+ * @param[in] msg Null-terminated message text
+ */
+static void log_write(struct log_handle *log, enum LOG_LEVEL lvl, const char *msg);
+
+/*!
+ * @brief Writes any queued records, then reports any which were dropped
+ *
+ * The caller must hold log_priv::mutex, and must be the only consumer of
+ * log_priv::queue.
+ *
+ * @param[in] log Target logging infrastructure instance
+ */
+static void log_write_queued(struct log_handle *log);
+
+/*!
+ * @brief Writes queued records to the medium until ::log_stop is called
+ *
+ * @param[in] ctx Pointer to the thread's ::thread_handle
+ *
+ * @returns Always NULL
+ */
+static void * log_writer(void *ctx);
+
 void log_close(struct log_handle *log)
 {
 	log_select_medium(log, LOG_MEDIUM_NONE, NULL);
@@ -124,10 +217,18 @@ void log_close(struct log_handle *log)
 
 void log_free(struct log_handle *log)
 {
-	if (log->priv != NULL)
+	struct log_priv *priv = (struct log_priv *)log->priv;
+
+	if (priv != NULL)
 	{
+		log_stop(log);
 		log_close(log);
 
+		thread_free(&priv->thread_writer);
+		condvar_free(&priv->condvar_writer);
+		mutex_free(&priv->mutex);
+		queue_free(&priv->queue);
+
 		free(log->priv);
 		log->priv = NULL;
 	}
@@ -141,6 +242,7 @@ void log_ident(struct log_handle *log)
 int log_init(struct log_handle *log)
 {
 	struct log_priv *priv;
+	int ret;
 
 	if (log->priv == NULL)
 	{
@@ -152,6 +254,7 @@ int log_init(struct log_handle *log)
 		return -ENOMEM;
 	}
 
+	memset(log->priv, 0x0, sizeof(struct log_priv));
 	priv = (struct log_priv *)log->priv;
 
 	log->medium = LOG_MEDIUM_NONE;
@@ -160,7 +263,47 @@ int log_init(struct log_handle *log)
 	priv->medium_eventlog.handle = NULL;
 	priv->medium_file.fp = NULL;
 
+	priv->queue.capacity = LOG_QUEUE_LEN;
+	priv->queue.elem_size = sizeof(struct log_record);
+
+	ret = queue_init(&priv->queue);
+	if (ret < 0)
+	{
+		goto log_init_exit;
+	}
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		goto log_init_exit;
+	}
+
+	ret = condvar_init(&priv->condvar_writer);
+	if (ret < 0)
+	{
+		goto log_init_exit;
+	}
+
+	priv->thread_writer.func_ptr = log_writer;
+	priv->thread_writer.func_ctx = log;
+
+	ret = thread_init(&priv->thread_writer);
+	if (ret < 0)
+	{
+		goto log_init_exit;
+	}
+
 	return 0;
+
+log_init_exit:
+	condvar_free(&priv->condvar_writer);
+	mutex_free(&priv->mutex);
+	queue_free(&priv->queue);
+
+	free(log->priv);
+	log->priv = NULL;
+
+	return ret;
 }
 
 const char * log_medium_to_str(enum LOG_MEDIUM medium)
@@ -211,6 +354,8 @@ int log_select_medium(struct log_handle *log, const enum LOG_MEDIUM medium, cons
 	struct log_priv *priv = (struct log_priv *)log->priv;
 	int ret = 0;
 
+	mutex_lock(&priv->mutex);
+
 	// Open the new medium
 	switch (medium)
 	{
@@ -404,66 +549,178 @@ int log_select_medium(struct log_handle *log, const enum LOG_MEDIUM medium, cons
 		break;
 	}
 
+	mutex_unlock(&priv->mutex);
+
 	return ret;
 }
 
+int log_start(struct log_handle *log)
+{
+	struct log_priv *priv = (struct log_priv *)log->priv;
+	int ret;
+
+	if (atomic_u32_load(&priv->writer_running))
+	{
+		return 0;
+	}
+
+	atomic_u32_store(&priv->writer_stop, 0);
+
+	ret = thread_start(&priv->thread_writer);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	atomic_u32_store(&priv->writer_running, 1);
+
+	return 0;
+}
+
+void log_stop(struct log_handle *log)
+{
+	struct log_priv *priv = (struct log_priv *)log->priv;
+
+	if (priv == NULL || !atomic_u32_load(&priv->writer_running))
+	{
+		return;
+	}
+
+	// New messages are written directly from here on
+	atomic_u32_store(&priv->writer_running, 0);
+
+	mutex_lock(&priv->mutex);
+	atomic_u32_store(&priv->writer_stop, 1);
+	condvar_wake_one(&priv->condvar_writer);
+	mutex_unlock(&priv->mutex);
+
+	thread_join(&priv->thread_writer);
+
+	// Catch anything committed after the writer made its last pass
+	mutex_lock(&priv->mutex);
+	log_write_queued(log);
+	log_flush(log);
+	mutex_unlock(&priv->mutex);
+}
+
+uint32_t log_dropped(struct log_handle *log)
+{
+	struct log_priv *priv = (struct log_priv *)log->priv;
+
+	return atomic_u32_load(&priv->dropped);
+}
+
 void log_vprintf(struct log_handle *log, enum LOG_LEVEL lvl, const char *fmt, va_list args)
 {
 	struct log_priv *priv = (struct log_priv *)log->priv;
+	struct log_record *rec;
+	char buff[LOG_RECORD_LEN - 1];
 
-	if ((unsigned)lvl > log->level)
+	if ((unsigned)lvl > log->level || priv == NULL || log->medium == LOG_MEDIUM_NONE)
+	{
+		return;
+	}
+
+	if (!atomic_u32_load(&priv->writer_running))
 	{
+		vsnprintf(buff, sizeof(buff), fmt, args);
+
+		mutex_lock(&priv->mutex);
+		log_write(log, lvl, buff);
+		log_flush(log);
+		mutex_unlock(&priv->mutex);
+
 		return;
 	}
 
+	rec = queue_reserve(&priv->queue);
+	if (rec == NULL)
+	{
+		atomic_u32_add(&priv->dropped, 1);
+
+		return;
+	}
+
+	rec->lvl = (uint8_t)lvl;
+	vsnprintf(rec->msg, sizeof(rec->msg), fmt, args);
+
+	queue_commit(&priv->queue, rec);
+
+	// Pairs with the fence in log_writer, so that either the writer sees the
+	// new record or this sees that the writer needs to be woken
+	atomic_fence();
+
+	if (atomic_u32_load(&priv->writer_sleeping))
+	{
+		mutex_lock(&priv->mutex);
+		condvar_wake_one(&priv->condvar_writer);
+		mutex_unlock(&priv->mutex);
+	}
+}
+
+static void log_flush(struct log_handle *log)
+{
+	struct log_priv *priv = (struct log_priv *)log->priv;
+
 	switch (log->medium)
 	{
 	case LOG_MEDIUM_STDOUT:
-		if (lvl >= LOG_LEVEL_ERROR)
-		{
-			vfprintf(stderr, fmt, args);
-			fflush(stderr);
-		}
-		else
+		fflush(stdout);
+		fflush(stderr);
+
+		break;
+	case LOG_MEDIUM_FILE:
+		if (priv->medium_file.fp != NULL)
 		{
-			vprintf(fmt, args);
-			fflush(stdout);
+			fflush(priv->medium_file.fp);
 		}
 
+		break;
+	default:
+		break;
+	}
+}
+
+static void log_write(struct log_handle *log, enum LOG_LEVEL lvl, const char *msg)
+{
+	struct log_priv *priv = (struct log_priv *)log->priv;
+
+	switch (log->medium)
+	{
+	case LOG_MEDIUM_STDOUT:
+		fputs(msg, lvl >= LOG_LEVEL_ERROR ? stderr : stdout);
+
 		break;
 	case LOG_MEDIUM_FILE:
-		if (priv != NULL)
+		if (priv->medium_file.fp != NULL)
 		{
 			time_t epoch;
-			struct tm *cal_time;
-			char tstamp[16];
 
+			// Lines logged within the same second share a timestamp
 			time(&epoch);
-			cal_time = localtime(&epoch);
-			strftime(tstamp, 16, "%b %d %H:%M:%S", cal_time);
-			fprintf(priv->medium_file.fp, "%s : ", tstamp);
+			if (epoch != priv->tstamp_epoch)
+			{
+				strftime(priv->tstamp, sizeof(priv->tstamp), "%b %d %H:%M:%S", localtime(&epoch));
+				priv->tstamp_epoch = epoch;
+			}
 
-			vfprintf(priv->medium_file.fp, fmt, args);
-			fflush(priv->medium_file.fp);
+			fprintf(priv->medium_file.fp, "%s : %s", priv->tstamp, msg);
 		}
 
 		break;
 	case LOG_MEDIUM_SYSLOG:
-		vsyslog(SYSLOG_LEVEL[lvl], fmt, args);
+		syslog(SYSLOG_LEVEL[lvl], "%s", msg);
 
 		break;
 	case LOG_MEDIUM_EVENTLOG:
-		if (priv != NULL)
+		if (priv->medium_eventlog.handle != NULL)
 		{
-			char buff[256] = "";
 			const char *strings[2] =
 			{
-				buff,
+				msg,
 				NULL,
 			};
 
-			vsnprintf(buff, 256, fmt, args);
-
 			ReportEvent(
 				priv->medium_eventlog.handle,
 				EVENTLOG_LEVEL[lvl],
@@ -476,6 +733,69 @@ void log_vprintf(struct log_handle *log, enum LOG_LEVEL lvl, const char *fmt, va
 				NULL);
 		}
 
+		break;
+	default:
 		break;
 	}
 }
+
+static void log_write_queued(struct log_handle *log)
+{
+	struct log_priv *priv = (struct log_priv *)log->priv;
+	struct log_record *rec;
+	uint32_t dropped;
+	char buff[64];
+
+	while ((rec = queue_peek(&priv->queue)) != NULL)
+	{
+		if ((unsigned)rec->lvl <= log->level)
+		{
+			log_write(log, (enum LOG_LEVEL)rec->lvl, rec->msg);
+		}
+
+		queue_release(&priv->queue, rec);
+	}
+
+	dropped = atomic_u32_load(&priv->dropped);
+	if (dropped != priv->dropped_reported)
+	{
+		snprintf(buff, sizeof(buff), "Dropped %u log messages\n", dropped - priv->dropped_reported);
+		log_write(log, LOG_LEVEL_WARN, buff);
+		priv->dropped_reported = dropped;
+	}
+}
+
+static void * log_writer(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct log_handle *log = (struct log_handle *)th->func_ctx;
+	struct log_priv *priv = (struct log_priv *)log->priv;
+
+	mutex_lock(&priv->mutex);
+
+	while (1)
+	{
+		// Everything which is waiting goes out with a single flush
+		log_write_queued(log);
+		log_flush(log);
+
+		if (atomic_u32_load(&priv->writer_stop))
+		{
+			break;
+		}
+
+		atomic_u32_store(&priv->writer_sleeping, 1);
+		atomic_fence();
+
+		if (queue_peek(&priv->queue) == NULL && !atomic_u32_load(&priv->writer_stop))
+		{
+			condvar_wait(&priv->condvar_writer, &priv->mutex);
+		}
+
+		atomic_u32_store(&priv->writer_sleeping, 0);
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return NULL;
+}
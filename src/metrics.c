@@ -0,0 +1,1149 @@
+/*!
+ * @file metrics.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of the metrics exporter
+ */
+
+#include "openelp/openelp.h"
+
+#include "clock.h"
+#include "conn.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "mutex.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Largest StatsD datagram, which fits in a typical Ethernet MTU
+#define STATSD_DGRAM_MAX 1432
+
+/// Time to wait for a scraper to send its request, in microseconds
+#define HTTP_REQUEST_TIMEOUT 2000000
+
+/// Largest HTTP request accepted from a scraper
+#define HTTP_REQUEST_MAX 1024
+
+/// Initial size of the buffer which responses to scrapers are built in
+#define HTTP_BUFF_LEN 8192
+
+/*!
+ * @brief Description of a counter kept for each slot
+ */
+struct metric_desc
+{
+	/// Name of the metric, without any prefix or suffix
+	const char *name;
+
+	/// Description of the metric for scrapers
+	const char *help;
+
+	/// Offset of the uint64_t counter in ::proxy_slot_stats
+	size_t offset;
+};
+
+/*!
+ * @brief Growable buffer for building text
+ */
+struct metrics_buff
+{
+	/// Text which has been built so far
+	char *data;
+
+	/// Number of characters in metrics_buff::data
+	size_t len;
+
+	/// Number of bytes allocated for metrics_buff::data
+	size_t size;
+};
+
+/*!
+ * @brief Private data for an instance of the metrics exporter
+ */
+struct metrics_priv
+{
+	/// Thread which pushes statistics to the StatsD server
+	struct thread_handle thread_statsd;
+
+	/// Thread which serves statistics to HTTP scrapers
+	struct thread_handle thread_http;
+
+	/// Mutex for protecting metrics_priv::sentinel
+	struct mutex_handle mutex;
+
+	/// Condition variable for waking metrics_priv::thread_statsd early
+	struct condvar_handle condvar;
+
+	/// UDP connection for sending to the StatsD server
+	struct conn_handle conn_statsd;
+
+	/// Connection which listens for HTTP scrapers
+	struct conn_handle conn_listen;
+
+	/// Connection to the HTTP scraper currently being served
+	struct conn_handle conn_scraper;
+
+	/// Null-terminated port for metrics_priv::conn_listen
+	char port_str[6];
+
+	/// Slot statistics storage for metrics_priv::thread_statsd
+	struct proxy_slot_stats *slots_statsd;
+
+	/// Number of entries in metrics_priv::slots_statsd
+	size_t num_slots_statsd;
+
+	/// Slot statistics storage for metrics_priv::thread_http
+	struct proxy_slot_stats *slots_http;
+
+	/// Number of entries in metrics_priv::slots_http
+	size_t num_slots_http;
+
+	/// Totals of the slot statistics in the previous StatsD push
+	struct proxy_slot_stats last_total;
+
+	/// Proxy statistics in the previous StatsD push
+	struct proxy_stats last_stats;
+
+	/// Response being built for an HTTP scraper
+	struct metrics_buff http_buff;
+
+	/// Termination indicator for the exporter threads
+	uint8_t sentinel;
+
+	/// Indicates that the StatsD push has been failing
+	uint8_t statsd_failing;
+};
+
+/// Counters kept for each slot
+static const struct metric_desc slot_counters[] =
+{
+	{ "udp_data_in_packets", "UDP data packets forwarded to the client", offsetof(struct proxy_slot_stats, udp_data_in.packets) },
+	{ "udp_data_in_bytes", "UDP data bytes forwarded to the client", offsetof(struct proxy_slot_stats, udp_data_in.bytes) },
+	{ "udp_data_out_packets", "UDP data packets forwarded from the client", offsetof(struct proxy_slot_stats, udp_data_out.packets) },
+	{ "udp_data_out_bytes", "UDP data bytes forwarded from the client", offsetof(struct proxy_slot_stats, udp_data_out.bytes) },
+	{ "udp_control_in_packets", "UDP control packets forwarded to the client", offsetof(struct proxy_slot_stats, udp_control_in.packets) },
+	{ "udp_control_in_bytes", "UDP control bytes forwarded to the client", offsetof(struct proxy_slot_stats, udp_control_in.bytes) },
+	{ "udp_control_out_packets", "UDP control packets forwarded from the client", offsetof(struct proxy_slot_stats, udp_control_out.packets) },
+	{ "udp_control_out_bytes", "UDP control bytes forwarded from the client", offsetof(struct proxy_slot_stats, udp_control_out.bytes) },
+	{ "tcp_in_packets", "TCP segments forwarded to the client", offsetof(struct proxy_slot_stats, tcp_in.packets) },
+	{ "tcp_in_bytes", "TCP bytes forwarded to the client", offsetof(struct proxy_slot_stats, tcp_in.bytes) },
+	{ "tcp_out_packets", "TCP messages forwarded from the client", offsetof(struct proxy_slot_stats, tcp_out.packets) },
+	{ "tcp_out_bytes", "TCP bytes forwarded from the client", offsetof(struct proxy_slot_stats, tcp_out.bytes) },
+	{ "send_failures", "Failed attempts to send to the client or to a remote host", offsetof(struct proxy_slot_stats, send_failures) },
+	{ "frames_dropped", "UDP frames discarded because the client fell behind", offsetof(struct proxy_slot_stats, frames_dropped) },
+	{ "udp_filtered", "UDP datagrams discarded because they came from a host the client had not sent to", offsetof(struct proxy_slot_stats, udp_filtered) },
+};
+
+/// Number of entries in ::slot_counters
+#define NUM_SLOT_COUNTERS (sizeof(slot_counters) / sizeof(slot_counters[0]))
+
+/// Quantiles of the forwarding latency pushed to the StatsD server, in
+/// thousandths
+static const uint32_t statsd_quantiles[] = { 500, 900, 990 };
+
+/// Number of entries in ::statsd_quantiles
+#define NUM_STATSD_QUANTILES (sizeof(statsd_quantiles) / sizeof(statsd_quantiles[0]))
+
+/*!
+ * @brief Appends formatted text to a buffer, growing it as necessary
+ *
+ * @param[in,out] buff Target buffer
+ * @param[in] fmt String format of the text
+ * @param[in] ... Arguments for format specification
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int buff_printf(struct metrics_buff *buff, const char *fmt, ...);
+
+/*!
+ * @brief Gets the current statistics, growing the slot storage if slots
+ *        were added by reloading the configuration
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ * @param[out] stats Storage for the proxy statistics
+ * @param[in,out] slots Slot statistics storage, which may be reallocated
+ * @param[in,out] num_slots Number of entries in slots
+ *
+ * @returns Number of slots retrieved on success, negative ERRNO value on
+ *          failure
+ */
+static int fetch(struct metrics_handle *mh, struct proxy_stats *stats, struct proxy_slot_stats **slots, size_t *num_slots);
+
+/*!
+ * @brief Gets a counter from slot statistics
+ *
+ * @param[in] stats Slot statistics to read from
+ * @param[in] desc Description of the counter
+ *
+ * @returns Value of the counter
+ */
+static uint64_t get_counter(const struct proxy_slot_stats *stats, const struct metric_desc *desc);
+
+/*!
+ * @brief Builds the Prometheus text for the current statistics
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int http_render(struct metrics_handle *mh);
+
+/*!
+ * @brief Appends a Prometheus histogram of one direction's forwarding latency
+ *
+ * Only the buckets at each power of two are exposed, which keeps the output
+ * short while still showing the shape of the distribution.
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ * @param[in] num_slots Number of entries in metrics_priv::slots_http to use
+ * @param[in] direction Label value identifying the direction
+ * @param[in] offset Offset of the ::proxy_latency_stats in ::proxy_slot_stats
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int http_render_latency(struct metrics_handle *mh, size_t num_slots, const char *direction, size_t offset);
+
+/*!
+ * @brief Reads a request from metrics_priv::conn_scraper and responds to it
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ */
+static void http_serve(struct metrics_handle *mh);
+
+/*!
+ * @brief Worker thread which accepts and serves HTTP scrapers
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * http_thread(void *ctx);
+
+/*!
+ * @brief Appends a line to a StatsD datagram, sending the datagram first if
+ *        the line does not fit
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ * @param[in,out] dgram Datagram being built
+ * @param[in,out] len Number of bytes in dgram
+ * @param[in] addr Address of the StatsD server
+ * @param[in] name Name of the metric, without the prefix
+ * @param[in] value Value of the metric
+ * @param[in] type StatsD type of the metric
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int statsd_append(struct metrics_handle *mh, char dgram[STATSD_DGRAM_MAX], size_t *len, uint32_t addr, const char *name, uint64_t value, const char *type);
+
+/*!
+ * @brief Appends gauges for the quantiles of the latency measured since the
+ *        previous push
+ *
+ * Nothing is appended if no traffic was measured.
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ * @param[in,out] dgram Datagram being built
+ * @param[in,out] len Number of bytes in dgram
+ * @param[in] addr Address of the StatsD server
+ * @param[in] name Name of the metric, without the prefix or quantile
+ * @param[in] cur Latency measured up to now
+ * @param[in] last Latency measured up to the previous push
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int statsd_append_latency(struct metrics_handle *mh, char dgram[STATSD_DGRAM_MAX], size_t *len, uint32_t addr, const char *name, const struct proxy_latency_stats *cur, const struct proxy_latency_stats *last);
+
+/*!
+ * @brief Sends the change in each counter since the previous push
+ *
+ * @param[in,out] mh Target metrics exporter instance
+ * @param[in] addr Address of the StatsD server
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int statsd_push(struct metrics_handle *mh, uint32_t addr);
+
+/*!
+ * @brief Worker thread which periodically pushes to the StatsD server
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * statsd_thread(void *ctx);
+
+/*!
+ * @brief Adds the buckets of one latency histogram to another
+ *
+ * @param[in,out] total Histogram to add to
+ * @param[in] stats Histogram to add
+ */
+static void sum_latency(struct proxy_latency_stats *total, const struct proxy_latency_stats *stats);
+
+static int buff_printf(struct metrics_buff *buff, const char *fmt, ...)
+{
+	va_list args;
+	char *data;
+	int ret;
+
+	while (1)
+	{
+		va_start(args, fmt);
+		ret = vsnprintf(&buff->data[buff->len], buff->size - buff->len, fmt, args);
+		va_end(args);
+
+		if (ret < 0)
+		{
+			return -EINVAL;
+		}
+
+		if ((size_t)ret < buff->size - buff->len)
+		{
+			buff->len += (size_t)ret;
+
+			return 0;
+		}
+
+		data = realloc(buff->data, buff->size * 2);
+		if (data == NULL)
+		{
+			return -ENOMEM;
+		}
+
+		buff->data = data;
+		buff->size *= 2;
+	}
+}
+
+static uint64_t get_counter(const struct proxy_slot_stats *stats, const struct metric_desc *desc)
+{
+	uint64_t val;
+
+	memcpy(&val, (const uint8_t *)stats + desc->offset, sizeof(uint64_t));
+
+	return val;
+}
+
+static int fetch(struct metrics_handle *mh, struct proxy_stats *stats, struct proxy_slot_stats **slots, size_t *num_slots)
+{
+	struct proxy_slot_stats *array;
+	int ret;
+
+	while (1)
+	{
+		ret = proxy_get_stats(mh->ph, stats, *slots, *num_slots);
+		if (ret < 0 || (size_t)ret <= *num_slots)
+		{
+			return ret;
+		}
+
+		array = realloc(*slots, sizeof(struct proxy_slot_stats) * (size_t)ret);
+		if (array == NULL)
+		{
+			return -ENOMEM;
+		}
+
+		*slots = array;
+		*num_slots = (size_t)ret;
+	}
+}
+
+static int http_render(struct metrics_handle *mh)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	struct metrics_buff *buff = &priv->http_buff;
+	struct proxy_stats stats;
+	size_t num_slots;
+	size_t i;
+	size_t j;
+	int ret;
+
+	ret = fetch(mh, &stats, &priv->slots_http, &priv->num_slots_http);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	num_slots = (size_t)ret;
+
+	buff->len = 0;
+
+	for (i = 0; i < NUM_SLOT_COUNTERS; i++)
+	{
+		ret = buff_printf(buff,
+			"# HELP openelp_%s_total %s\n"
+			"# TYPE openelp_%s_total counter\n",
+			slot_counters[i].name, slot_counters[i].help, slot_counters[i].name);
+
+		for (j = 0; ret == 0 && j < num_slots; j++)
+		{
+			ret = buff_printf(buff, "openelp_%s_total{slot=\"%zu\"} %" PRIu64 "\n",
+				slot_counters[i].name, j, get_counter(&priv->slots_http[j], &slot_counters[i]));
+		}
+
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	ret = buff_printf(buff,
+		"# HELP openelp_queue_depth Frames waiting to be written to the client\n"
+		"# TYPE openelp_queue_depth gauge\n");
+
+	for (j = 0; ret == 0 && j < num_slots; j++)
+	{
+		ret = buff_printf(buff, "openelp_queue_depth{slot=\"%zu\"} %" PRIu32 "\n", j, priv->slots_http[j].queue_depth);
+	}
+
+	if (ret == 0)
+	{
+		ret = buff_printf(buff,
+			"# HELP openelp_slot_in_use Whether a client is connected to the slot\n"
+			"# TYPE openelp_slot_in_use gauge\n");
+	}
+
+	for (j = 0; ret == 0 && j < num_slots; j++)
+	{
+		ret = buff_printf(buff, "openelp_slot_in_use{slot=\"%zu\"} %u\n", j, (unsigned)priv->slots_http[j].in_use);
+	}
+
+	if (ret == 0)
+	{
+		ret = http_render_latency(mh, num_slots, "in", offsetof(struct proxy_slot_stats, latency_in));
+	}
+
+	if (ret == 0)
+	{
+		ret = http_render_latency(mh, num_slots, "out", offsetof(struct proxy_slot_stats, latency_out));
+	}
+
+	if (ret == 0)
+	{
+		ret = buff_printf(buff,
+			"# HELP openelp_admission_refused_total Connections refused before authenticating\n"
+			"# TYPE openelp_admission_refused_total counter\n"
+			"openelp_admission_refused_total %" PRIu64 "\n"
+			"# HELP openelp_auth_failures_total Clients which failed to authenticate\n"
+			"# TYPE openelp_auth_failures_total counter\n"
+			"openelp_auth_failures_total %" PRIu64 "\n"
+			"# HELP openelp_slots_exhausted_total Clients dropped because no slot was available\n"
+			"# TYPE openelp_slots_exhausted_total counter\n"
+			"openelp_slots_exhausted_total %" PRIu64 "\n"
+			"# HELP openelp_log_dropped_total Log messages discarded because the writer fell behind\n"
+			"# TYPE openelp_log_dropped_total counter\n"
+			"openelp_log_dropped_total %" PRIu32 "\n"
+			"# HELP openelp_slots_used Slots which have a connected client\n"
+			"# TYPE openelp_slots_used gauge\n"
+			"openelp_slots_used %" PRIu32 "\n"
+			"# HELP openelp_slots_total Slots which clients may use\n"
+			"# TYPE openelp_slots_total gauge\n"
+			"openelp_slots_total %" PRIu32 "\n",
+			stats.admission_refused, stats.auth_failures, stats.slots_exhausted, stats.log_dropped, stats.slots_used, stats.slots_total);
+	}
+
+	return ret;
+}
+
+static int http_render_latency(struct metrics_handle *mh, size_t num_slots, const char *direction, size_t offset)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	struct metrics_buff *buff = &priv->http_buff;
+	const struct proxy_latency_stats *lat;
+	uint64_t seen;
+	size_t i;
+	size_t j;
+	int ret;
+
+	ret = buff_printf(buff,
+		"# HELP openelp_forwarding_latency_%s_seconds Time UDP traffic spent inside the proxy\n"
+		"# TYPE openelp_forwarding_latency_%s_seconds histogram\n",
+		direction, direction);
+
+	for (j = 0; ret == 0 && j < num_slots; j++)
+	{
+		lat = (const struct proxy_latency_stats *)((const uint8_t *)&priv->slots_http[j] + offset);
+		seen = 0;
+
+		for (i = 0; ret == 0 && i < HISTOGRAM_BUCKETS - 1; i++)
+		{
+			seen += lat->buckets[i];
+
+			if (((i + 1) & ((1 << HISTOGRAM_SUB_BITS) - 1)) == 0)
+			{
+				ret = buff_printf(buff, "openelp_forwarding_latency_%s_seconds_bucket{slot=\"%zu\",le=\"%.6f\"} %" PRIu64 "\n",
+					direction, j, (double)histogram_bucket_max(i) / 1000000.0, seen);
+			}
+		}
+
+		if (ret == 0)
+		{
+			ret = buff_printf(buff,
+				"openelp_forwarding_latency_%s_seconds_bucket{slot=\"%zu\",le=\"+Inf\"} %" PRIu64 "\n"
+				"openelp_forwarding_latency_%s_seconds_sum{slot=\"%zu\"} %.6f\n"
+				"openelp_forwarding_latency_%s_seconds_count{slot=\"%zu\"} %" PRIu64 "\n",
+				direction, j, lat->count,
+				direction, j, (double)lat->sum_us / 1000000.0,
+				direction, j, lat->count);
+		}
+	}
+
+	return ret;
+}
+
+static void http_serve(struct metrics_handle *mh)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	uint8_t req[HTTP_REQUEST_MAX + 1];
+	size_t req_len = 0;
+	uint64_t deadline = clock_now_us() + HTTP_REQUEST_TIMEOUT;
+	uint64_t now;
+	char header[128];
+	struct conn_iov iov[2];
+	unsigned int num_iov = 1;
+	int ret;
+
+	// The request line is all that matters, so stop at the end of the header
+	while (req_len < HTTP_REQUEST_MAX)
+	{
+		now = clock_now_us();
+		if (now >= deadline)
+		{
+			return;
+		}
+
+		ret = conn_poll(&priv->conn_scraper, (uint32_t)(deadline - now));
+		if (ret <= 0)
+		{
+			return;
+		}
+
+		ret = conn_recv_some(&priv->conn_scraper, &req[req_len], HTTP_REQUEST_MAX - req_len);
+		if (ret <= 0)
+		{
+			return;
+		}
+
+		req_len += (size_t)ret;
+		req[req_len] = '\0';
+
+		if (strstr((const char *)req, "\r\n\r\n") != NULL)
+		{
+			break;
+		}
+	}
+
+	if (req_len > 12 && strncmp((const char *)req, "GET /metrics", 12) == 0 && (req[12] == ' ' || req[12] == '?'))
+	{
+		ret = http_render(mh);
+		if (ret < 0)
+		{
+			proxy_log(mh->ph, LOG_LEVEL_WARN, "Failed to render metrics (%d): %s\n", -ret, strerror(-ret));
+
+			snprintf(header, sizeof(header), "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		}
+		else
+		{
+			snprintf(header, sizeof(header),
+				"HTTP/1.1 200 OK\r\n"
+				"Content-Type: text/plain; version=0.0.4\r\n"
+				"Content-Length: %zu\r\n"
+				"Connection: close\r\n\r\n",
+				priv->http_buff.len);
+
+			iov[1].buff = (const uint8_t *)priv->http_buff.data;
+			iov[1].len = priv->http_buff.len;
+			num_iov = 2;
+		}
+	}
+	else
+	{
+		snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+	}
+
+	iov[0].buff = (const uint8_t *)header;
+	iov[0].len = strlen(header);
+
+	conn_sendv(&priv->conn_scraper, iov, num_iov);
+}
+
+static void * http_thread(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct metrics_handle *mh = (struct metrics_handle *)th->func_ctx;
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	uint8_t sentinel;
+	int ret;
+
+	while (1)
+	{
+		ret = conn_accept(&priv->conn_listen, &priv->conn_scraper);
+
+		mutex_lock(&priv->mutex);
+		sentinel = priv->sentinel;
+
+		// Don't spin if accepting keeps failing, e.g. when out of descriptors
+		if (ret < 0 && !sentinel)
+		{
+			condvar_wait_time(&priv->condvar, &priv->mutex, 100);
+			sentinel = priv->sentinel;
+		}
+
+		mutex_unlock(&priv->mutex);
+
+		if (ret >= 0)
+		{
+			http_serve(mh);
+			conn_close(&priv->conn_scraper);
+		}
+
+		if (sentinel)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int statsd_append(struct metrics_handle *mh, char dgram[STATSD_DGRAM_MAX], size_t *len, uint32_t addr, const char *name, uint64_t value, const char *type)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	const char *prefix = mh->ph->conf.statsd_prefix != NULL ? mh->ph->conf.statsd_prefix : "openelp";
+	char line[256];
+	int line_len;
+	int ret;
+
+	line_len = snprintf(line, sizeof(line), "%s.%s:%" PRIu64 "|%s\n", prefix, name, value, type);
+	if (line_len < 0 || (size_t)line_len >= sizeof(line))
+	{
+		return -EINVAL;
+	}
+
+	if (*len + (size_t)line_len > STATSD_DGRAM_MAX && *len > 0)
+	{
+		ret = conn_send_to(&priv->conn_statsd, (const uint8_t *)dgram, *len, addr, mh->ph->conf.statsd_port);
+		*len = 0;
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	memcpy(&dgram[*len], line, (size_t)line_len);
+	*len += (size_t)line_len;
+
+	return 0;
+}
+
+static int statsd_append_latency(struct metrics_handle *mh, char dgram[STATSD_DGRAM_MAX], size_t *len, uint32_t addr, const char *name, const struct proxy_latency_stats *cur, const struct proxy_latency_stats *last)
+{
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+	uint64_t count = 0;
+	char line_name[128];
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		buckets[i] = cur->buckets[i] >= last->buckets[i] ? cur->buckets[i] - last->buckets[i] : cur->buckets[i];
+		count += buckets[i];
+	}
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < NUM_STATSD_QUANTILES && ret == 0; i++)
+	{
+		snprintf(line_name, sizeof(line_name), "%s.p%u", name, (unsigned)(statsd_quantiles[i] / 10));
+
+		ret = statsd_append(mh, dgram, len, addr, line_name, histogram_quantile(buckets, statsd_quantiles[i]), "g");
+	}
+
+	return ret;
+}
+
+static int statsd_push(struct metrics_handle *mh, uint32_t addr)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	struct proxy_slot_stats total;
+	struct proxy_stats stats;
+	char dgram[STATSD_DGRAM_MAX];
+	size_t len = 0;
+	size_t num_slots;
+	uint64_t queue_depth = 0;
+	uint64_t cur;
+	uint64_t last;
+	uint64_t val;
+	size_t i;
+	size_t j;
+	int ret;
+
+	ret = fetch(mh, &stats, &priv->slots_statsd, &priv->num_slots_statsd);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	num_slots = (size_t)ret;
+
+	memset(&total, 0x0, sizeof(struct proxy_slot_stats));
+
+	for (i = 0; i < NUM_SLOT_COUNTERS; i++)
+	{
+		val = 0;
+
+		for (j = 0; j < num_slots; j++)
+		{
+			val += get_counter(&priv->slots_statsd[j], &slot_counters[i]);
+		}
+
+		memcpy((uint8_t *)&total + slot_counters[i].offset, &val, sizeof(uint64_t));
+	}
+
+	for (j = 0; j < num_slots; j++)
+	{
+		queue_depth += priv->slots_statsd[j].queue_depth;
+
+		sum_latency(&total.latency_in, &priv->slots_statsd[j].latency_in);
+		sum_latency(&total.latency_out, &priv->slots_statsd[j].latency_out);
+	}
+
+	// StatsD counters are increments, so send the change since the last push.
+	// A counter which went backwards was reset when the proxy was reopened.
+	for (i = 0, ret = 0; i < NUM_SLOT_COUNTERS && ret == 0; i++)
+	{
+		cur = get_counter(&total, &slot_counters[i]);
+		last = get_counter(&priv->last_total, &slot_counters[i]);
+
+		ret = statsd_append(mh, dgram, &len, addr, slot_counters[i].name, cur >= last ? cur - last : cur, "c");
+	}
+
+	if (ret == 0)
+	{
+		cur = stats.admission_refused;
+		last = priv->last_stats.admission_refused;
+		ret = statsd_append(mh, dgram, &len, addr, "admission_refused", cur >= last ? cur - last : cur, "c");
+	}
+
+	if (ret == 0)
+	{
+		cur = stats.auth_failures;
+		last = priv->last_stats.auth_failures;
+		ret = statsd_append(mh, dgram, &len, addr, "auth_failures", cur >= last ? cur - last : cur, "c");
+	}
+
+	if (ret == 0)
+	{
+		cur = stats.slots_exhausted;
+		last = priv->last_stats.slots_exhausted;
+		ret = statsd_append(mh, dgram, &len, addr, "slots_exhausted", cur >= last ? cur - last : cur, "c");
+	}
+
+	if (ret == 0)
+	{
+		cur = stats.log_dropped;
+		last = priv->last_stats.log_dropped;
+		ret = statsd_append(mh, dgram, &len, addr, "log_dropped", cur >= last ? cur - last : cur, "c");
+	}
+
+	if (ret == 0)
+	{
+		ret = statsd_append(mh, dgram, &len, addr, "slots_used", stats.slots_used, "g");
+	}
+
+	if (ret == 0)
+	{
+		ret = statsd_append(mh, dgram, &len, addr, "slots_total", stats.slots_total, "g");
+	}
+
+	if (ret == 0)
+	{
+		ret = statsd_append(mh, dgram, &len, addr, "queue_depth", queue_depth, "g");
+	}
+
+	if (ret == 0)
+	{
+		ret = statsd_append_latency(mh, dgram, &len, addr, "forwarding_latency_in", &total.latency_in, &priv->last_total.latency_in);
+	}
+
+	if (ret == 0)
+	{
+		ret = statsd_append_latency(mh, dgram, &len, addr, "forwarding_latency_out", &total.latency_out, &priv->last_total.latency_out);
+	}
+
+	if (ret == 0 && len > 0)
+	{
+		ret = conn_send_to(&priv->conn_statsd, (const uint8_t *)dgram, len, addr, mh->ph->conf.statsd_port);
+	}
+
+	// Whatever was not sent is included in the next push
+	if (ret == 0)
+	{
+		priv->last_total = total;
+		priv->last_stats = stats;
+	}
+
+	return ret;
+}
+
+static void * statsd_thread(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct metrics_handle *mh = (struct metrics_handle *)th->func_ctx;
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	const uint64_t interval = (mh->ph->conf.statsd_interval > 0 ? mh->ph->conf.statsd_interval : 10) * (uint64_t)1000000;
+	uint64_t deadline = clock_now_us() + interval;
+	uint32_t addr = 0;
+	uint64_t now;
+	int ret;
+
+	mutex_lock(&priv->mutex);
+
+	while (1)
+	{
+		while (!priv->sentinel && (now = clock_now_us()) < deadline)
+		{
+			condvar_wait_time(&priv->condvar, &priv->mutex, (uint32_t)((deadline - now + 999) / 1000));
+		}
+
+		if (priv->sentinel)
+		{
+			break;
+		}
+
+		deadline += interval;
+
+		mutex_unlock(&priv->mutex);
+
+		// Look the server up again after any failure, in case it moved
+		ret = addr == 0 ? conn_resolve(mh->ph->conf.statsd_addr, &addr) : 0;
+		if (ret == 0)
+		{
+			ret = statsd_push(mh, addr);
+		}
+
+		if (ret < 0)
+		{
+			addr = 0;
+
+			if (!priv->statsd_failing)
+			{
+				proxy_log(mh->ph, LOG_LEVEL_WARN, "Failed to push metrics to StatsD server '%s' (%d): %s\n", mh->ph->conf.statsd_addr, -ret, strerror(-ret));
+			}
+		}
+
+		priv->statsd_failing = ret < 0;
+
+		mutex_lock(&priv->mutex);
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return NULL;
+}
+
+static void sum_latency(struct proxy_latency_stats *total, const struct proxy_latency_stats *stats)
+{
+	size_t i;
+
+	total->count += stats->count;
+	total->sum_us += stats->sum_us;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		total->buckets[i] += stats->buckets[i];
+	}
+}
+
+void metrics_free(struct metrics_handle *mh)
+{
+	if (mh->priv != NULL)
+	{
+		struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+
+		metrics_stop(mh);
+
+		thread_free(&priv->thread_http);
+		thread_free(&priv->thread_statsd);
+
+		conn_free(&priv->conn_scraper);
+		conn_free(&priv->conn_listen);
+		conn_free(&priv->conn_statsd);
+
+		condvar_free(&priv->condvar);
+		mutex_free(&priv->mutex);
+
+		free(priv->http_buff.data);
+
+		free(mh->priv);
+		mh->priv = NULL;
+	}
+}
+
+int metrics_init(struct metrics_handle *mh)
+{
+	struct metrics_priv *priv;
+	int ret;
+
+	if (mh->priv == NULL)
+	{
+		mh->priv = malloc(sizeof(struct metrics_priv));
+	}
+
+	if (mh->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(mh->priv, 0x0, sizeof(struct metrics_priv));
+
+	priv = (struct metrics_priv *)mh->priv;
+
+	ret = mutex_init(&priv->mutex);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	ret = condvar_init(&priv->condvar);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	priv->conn_statsd.type = CONN_TYPE_UDP;
+	priv->conn_statsd.source_addr = "0.0.0.0";
+
+	ret = conn_init(&priv->conn_statsd);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	priv->conn_listen.type = CONN_TYPE_TCP;
+	priv->conn_listen.source_port = priv->port_str;
+
+	ret = conn_init(&priv->conn_listen);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	priv->conn_scraper.type = CONN_TYPE_TCP;
+
+	ret = conn_init(&priv->conn_scraper);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	priv->thread_statsd.func_ptr = statsd_thread;
+	priv->thread_statsd.func_ctx = mh;
+
+	ret = thread_init(&priv->thread_statsd);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	priv->thread_http.func_ptr = http_thread;
+	priv->thread_http.func_ctx = mh;
+
+	ret = thread_init(&priv->thread_http);
+	if (ret != 0)
+	{
+		goto metrics_init_exit;
+	}
+
+	return 0;
+
+metrics_init_exit:
+	thread_free(&priv->thread_http);
+	thread_free(&priv->thread_statsd);
+	conn_free(&priv->conn_scraper);
+	conn_free(&priv->conn_listen);
+	conn_free(&priv->conn_statsd);
+	condvar_free(&priv->condvar);
+	mutex_free(&priv->mutex);
+
+	free(mh->priv);
+	mh->priv = NULL;
+
+	return ret;
+}
+
+int metrics_start(struct metrics_handle *mh)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+	const struct proxy_conf *conf = &mh->ph->conf;
+	struct proxy_stats stats;
+	int ret;
+
+	if (conf->statsd_addr == NULL && conf->metrics_port == 0)
+	{
+		return 0;
+	}
+
+	ret = proxy_get_stats(mh->ph, &stats, NULL, 0);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	// Each thread grows its own storage if slots are added later
+	priv->num_slots_statsd = (size_t)ret;
+	priv->num_slots_http = (size_t)ret;
+
+	priv->slots_statsd = malloc(sizeof(struct proxy_slot_stats) * (priv->num_slots_statsd > 0 ? priv->num_slots_statsd : 1));
+	priv->slots_http = malloc(sizeof(struct proxy_slot_stats) * (priv->num_slots_http > 0 ? priv->num_slots_http : 1));
+	if (priv->slots_statsd == NULL || priv->slots_http == NULL)
+	{
+		ret = -ENOMEM;
+		goto metrics_start_exit;
+	}
+
+	priv->sentinel = 0;
+
+	if (conf->statsd_addr != NULL)
+	{
+		memset(&priv->last_total, 0x0, sizeof(struct proxy_slot_stats));
+		memset(&priv->last_stats, 0x0, sizeof(struct proxy_stats));
+		priv->statsd_failing = 0;
+
+		ret = conn_listen(&priv->conn_statsd);
+		if (ret < 0)
+		{
+			goto metrics_start_exit;
+		}
+
+		ret = thread_start(&priv->thread_statsd);
+		if (ret < 0)
+		{
+			goto metrics_start_exit;
+		}
+
+		proxy_log(mh->ph, LOG_LEVEL_INFO, "Pushing metrics to StatsD server '%s' port %hu\n", conf->statsd_addr, conf->statsd_port);
+	}
+
+	if (conf->metrics_port != 0)
+	{
+		if (priv->http_buff.data == NULL)
+		{
+			priv->http_buff.data = malloc(HTTP_BUFF_LEN);
+			if (priv->http_buff.data == NULL)
+			{
+				ret = -ENOMEM;
+				goto metrics_start_exit;
+			}
+
+			priv->http_buff.size = HTTP_BUFF_LEN;
+		}
+
+		snprintf(priv->port_str, sizeof(priv->port_str), "%hu", conf->metrics_port);
+		priv->conn_listen.source_addr = conf->metrics_bind_addr;
+
+		ret = conn_listen(&priv->conn_listen);
+		if (ret < 0)
+		{
+			proxy_log(mh->ph, LOG_LEVEL_ERROR, "Failed to listen for metrics scrapers on port %s (%d): %s\n", priv->port_str, -ret, strerror(-ret));
+			goto metrics_start_exit;
+		}
+
+		ret = thread_start(&priv->thread_http);
+		if (ret < 0)
+		{
+			goto metrics_start_exit;
+		}
+
+		proxy_log(mh->ph, LOG_LEVEL_INFO, "Serving metrics at %s:%s/metrics\n", conf->metrics_bind_addr != NULL ? conf->metrics_bind_addr : "0.0.0.0", priv->port_str);
+	}
+
+	return 0;
+
+metrics_start_exit:
+	metrics_stop(mh);
+
+	return ret;
+}
+
+void metrics_stop(struct metrics_handle *mh)
+{
+	struct metrics_priv *priv = (struct metrics_priv *)mh->priv;
+
+	if (priv == NULL)
+	{
+		return;
+	}
+
+	mutex_lock(&priv->mutex);
+	priv->sentinel = 1;
+	condvar_wake_all(&priv->condvar);
+	mutex_unlock(&priv->mutex);
+
+	// Unblock the HTTP thread if it is waiting for a scraper
+	conn_shutdown(&priv->conn_listen);
+
+	thread_join(&priv->thread_statsd);
+	thread_join(&priv->thread_http);
+
+	conn_close(&priv->conn_listen);
+	conn_close(&priv->conn_statsd);
+
+	free(priv->slots_statsd);
+	priv->slots_statsd = NULL;
+
+	free(priv->slots_http);
+	priv->slots_http = NULL;
+
+	priv->num_slots_statsd = 0;
+	priv->num_slots_http = 0;
+}
@@ -44,6 +44,7 @@
  * @brief Mutex implementation for POSIX machines
  */
 
+#include "atomic.h"
 #include "mutex.h"
 
 #include <pthread.h>
@@ -52,19 +53,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+/// Bit in mutex_priv::state which is set while the exclusive lock is held or
+/// being acquired
+#define MUTEX_WRITER 0x80000000U
+
 /*!
  * @brief Private data for an instance of a POSIX mutex
+ *
+ * Shared holders only touch mutex_priv::state, so the shared lock costs a
+ * single atomic operation each way unless a writer is present.
  */
 struct mutex_priv
 {
-	/// Condition variable used to implement the shared lock
-	pthread_cond_t cond;
+	/// Signalled by the last shared holder to leave while a writer waits
+	pthread_cond_t drain_cond;
 
-	/// POSIX mutex used for exclusive locking
+	/// POSIX mutex protecting mutex_priv::drain_cond
+	pthread_mutex_t drain_lock;
+
+	/// POSIX mutex held for the duration of the exclusive lock
 	pthread_mutex_t lock;
 
-	/// Number of holders of the shared lock
-	unsigned int readers;
+	/// Number of holders of the shared lock, combined with ::MUTEX_WRITER
+	volatile uint32_t state;
 };
 
 /*!
@@ -76,6 +87,17 @@ struct condvar_priv
 	pthread_cond_t cond;
 };
 
+/*!
+ * @brief Blocks new shared holders and waits for the existing ones to leave
+ *
+ * @param[in,out] priv Target mutex private data, with mutex_priv::lock held
+ *
+ * ::MUTEX_WRITER is left set even on failure.
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int mutex_drain(struct mutex_priv *priv);
+
 int mutex_init(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv;
@@ -103,17 +125,28 @@ int mutex_init(struct mutex_handle *mutex)
 		goto mutex_init_exit;
 	}
 
-	ret = pthread_cond_init(&priv->cond, NULL);
+	ret = pthread_mutex_init(&priv->drain_lock, NULL);
+	if (ret != 0)
+	{
+		ret = -ret;
+
+		goto mutex_init_exit_lock;
+	}
+
+	ret = pthread_cond_init(&priv->drain_cond, NULL);
 	if (ret != 0)
 	{
 		ret = -ret;
 
-		goto mutex_init_exit_late;
+		goto mutex_init_exit_drain_lock;
 	}
 
 	return 0;
 
-mutex_init_exit_late:
+mutex_init_exit_drain_lock:
+	pthread_mutex_destroy(&priv->drain_lock);
+
+mutex_init_exit_lock:
 	pthread_mutex_destroy(&priv->lock);
 
 mutex_init_exit:
@@ -123,36 +156,38 @@ mutex_init_exit:
 	return ret;
 }
 
-int mutex_lock(struct mutex_handle *mutex)
+static int mutex_drain(struct mutex_priv *priv)
 {
-	struct mutex_priv *priv = (struct mutex_priv *)mutex->priv;
 	int ret;
 
-	ret = pthread_mutex_lock(&priv->lock);
+	atomic_u32_add(&priv->state, MUTEX_WRITER);
+
+	if (atomic_u32_load(&priv->state) == MUTEX_WRITER)
+	{
+		return 0;
+	}
+
+	ret = pthread_mutex_lock(&priv->drain_lock);
 	if (ret != 0)
 	{
 		return -ret;
 	}
 
-	while (priv->readers > 0)
+	while (atomic_u32_load(&priv->state) != MUTEX_WRITER)
 	{
-		ret = pthread_cond_wait(&priv->cond, &priv->lock);
+		ret = pthread_cond_wait(&priv->drain_cond, &priv->drain_lock);
 		if (ret != 0)
 		{
-			ret = -ret;
-			goto mutex_lock_exit;
+			break;
 		}
 	}
 
-	return 0;
-
-mutex_lock_exit:
-	pthread_mutex_unlock(&priv->lock);
+	pthread_mutex_unlock(&priv->drain_lock);
 
-	return ret;
+	return -ret;
 }
 
-int mutex_lock_shared(struct mutex_handle *mutex)
+int mutex_lock(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = (struct mutex_priv *)mutex->priv;
 	int ret;
@@ -163,16 +198,54 @@ int mutex_lock_shared(struct mutex_handle *mutex)
 		return -ret;
 	}
 
-	priv->readers++;
+	ret = mutex_drain(priv);
+	if (ret != 0)
+	{
+		atomic_u32_add(&priv->state, (uint32_t)-MUTEX_WRITER);
+		pthread_mutex_unlock(&priv->lock);
+	}
 
-	return -pthread_mutex_unlock(&priv->lock);
+	return ret;
+}
+
+int mutex_lock_shared(struct mutex_handle *mutex)
+{
+	struct mutex_priv *priv = (struct mutex_priv *)mutex->priv;
+	uint32_t state;
+	int ret;
+
+	while (1)
+	{
+		state = atomic_u32_load(&priv->state);
+
+		if ((state & MUTEX_WRITER) == 0)
+		{
+			if (atomic_u32_cas(&priv->state, state, state + 1))
+			{
+				return 0;
+			}
+
+			continue;
+		}
+
+		// A writer holds the exclusive lock, so wait for it to be released
+		ret = pthread_mutex_lock(&priv->lock);
+		if (ret != 0)
+		{
+			return -ret;
+		}
+
+		pthread_mutex_unlock(&priv->lock);
+	}
 }
 
 int mutex_unlock(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = (struct mutex_priv *)mutex->priv;
 
-	return pthread_mutex_unlock(&priv->lock);
+	atomic_u32_add(&priv->state, (uint32_t)-MUTEX_WRITER);
+
+	return -pthread_mutex_unlock(&priv->lock);
 }
 
 int mutex_unlock_shared(struct mutex_handle *mutex)
@@ -180,28 +253,23 @@ int mutex_unlock_shared(struct mutex_handle *mutex)
 	struct mutex_priv *priv = (struct mutex_priv *)mutex->priv;
 	int ret;
 
-	ret = pthread_mutex_lock(&priv->lock);
-	if (ret != 0)
+	if (atomic_u32_add(&priv->state, (uint32_t)-1) != (MUTEX_WRITER | 1))
 	{
-		return -ret;
+		return 0;
 	}
 
-	if (--(priv->readers) <= 0)
+	// Last one out while a writer is waiting
+	ret = pthread_mutex_lock(&priv->drain_lock);
+	if (ret != 0)
 	{
-		ret = pthread_cond_broadcast(&priv->cond);
-		if (ret != 0)
-		{
-			ret = -ret;
-			goto mutex_unlock_shared_exit;
-		}
+		return -ret;
 	}
 
-	return -pthread_mutex_unlock(&priv->lock);
+	ret = pthread_cond_signal(&priv->drain_cond);
 
-mutex_unlock_shared_exit:
-	pthread_mutex_unlock(&priv->lock);
+	pthread_mutex_unlock(&priv->drain_lock);
 
-	return ret;
+	return -ret;
 }
 
 void mutex_free(struct mutex_handle *mutex)
@@ -212,7 +280,9 @@ void mutex_free(struct mutex_handle *mutex)
 
 		pthread_mutex_destroy(&priv->lock);
 
-		pthread_cond_destroy(&priv->cond);
+		pthread_mutex_destroy(&priv->drain_lock);
+
+		pthread_cond_destroy(&priv->drain_cond);
 
 		free(mutex->priv);
 		mutex->priv = NULL;
@@ -259,8 +329,19 @@ int condvar_wait(struct condvar_handle *condvar, struct mutex_handle *mutex)
 {
 	struct condvar_priv *priv = (struct condvar_priv *)condvar->priv;
 	struct mutex_priv *mpriv = (struct mutex_priv *)mutex->priv;
+	int ret;
+
+	// Let shared holders in while the exclusive lock is released
+	atomic_u32_add(&mpriv->state, (uint32_t)-MUTEX_WRITER);
 
-	return -pthread_cond_wait(&priv->cond, &mpriv->lock);
+	ret = pthread_cond_wait(&priv->cond, &mpriv->lock);
+
+	if (mutex_drain(mpriv) != 0 && ret == 0)
+	{
+		ret = EDEADLK;
+	}
+
+	return -ret;
 }
 
 int condvar_wait_time(struct condvar_handle *condvar, struct mutex_handle *mutex, uint32_t msec)
@@ -275,7 +356,15 @@ int condvar_wait_time(struct condvar_handle *condvar, struct mutex_handle *mutex
 	abstime.tv_sec += (msec / 1000) + (abstime.tv_nsec / 1000000000);
 	abstime.tv_nsec %= 1000000000;
 
+	atomic_u32_add(&mpriv->state, (uint32_t)-MUTEX_WRITER);
+
 	ret = pthread_cond_timedwait(&priv->cond, &mpriv->lock, &abstime);
+
+	if (mutex_drain(mpriv) != 0 && (ret == 0 || ret == ETIMEDOUT))
+	{
+		ret = EDEADLK;
+	}
+
 	return ret == ETIMEDOUT ? 1 : -ret;
 }
 
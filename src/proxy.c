@@ -46,17 +46,35 @@
 
 #include "openelp/openelp.h"
 
+#include "admin.h"
+#include "admission.h"
+#include "atomic.h"
+#include "auth.h"
+#include "callsign_cache.h"
+#include "clock.h"
 #include "conf.h"
 #include "conn.h"
+#include "conn_pool.h"
 #include "digest.h"
+#include "freelist.h"
+#include "hold_map.h"
+#include "histogram.h"
 #include "log.h"
+#include "metrics.h"
 #include "mutex.h"
 #include "proxy_conn.h"
 #include "rand.h"
+#include "reactor.h"
 #include "regex.h"
 #include "registration.h"
+#include "thread.h"
+#include "timer_wheel.h"
+#include "trace.h"
+#include "worker_pool.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -65,49 +83,1032 @@
 #error Password Response Length Mismatch
 #endif
 
+/// Maximum number of clients which may be authenticating at once
+#define PROXY_AUTH_PENDING 16
+
+/// Number of recent callsign authorization decisions to remember
+#define PROXY_CALLSIGN_CACHE_LEN 32
+
+/// Number of client addresses whose connection attempts can be tracked at
+/// once for admission control
+#define PROXY_ADMISSION_LEN 4096
+
+/// Time in milliseconds to wait before accepting again after a failure
+#define PROXY_ACCEPT_BACKOFF 100
+
+/// Time in microseconds to wait for a client before checking for a handoff
+#define PROXY_ACCEPT_POLL 1000000
+
+/// Time in milliseconds between checks for the last client to leave after
+/// a handoff
+#define PROXY_HANDOFF_POLL 250
+
+/// Time in milliseconds between advances of proxy_priv::timers, which is
+/// the length of one of its ticks
+#define PROXY_REAP_INTERVAL 1000
+
+/// Number of clients held in reserve for addresses added by ::proxy_reload
+#define PROXY_RELOAD_SLOTS 16
+
+/*!
+ * @brief Thread accepting clients in addition to the callers of
+ *        ::proxy_process
+ */
+struct proxy_acceptor
+{
+	/// Proxy to accept clients for
+	struct proxy_handle *ph;
+
+	/// Connection to accept clients from, which is either
+	/// proxy_acceptor::conn_listen or proxy_priv::conn_listen
+	struct conn_handle *conn;
+
+	/// Listening connection of this acceptor, if the port is shared
+	struct conn_handle conn_listen;
+
+	/// Thread accepting the clients
+	struct thread_handle thread;
+
+	/// Non-zero while proxy_acceptor::thread is running
+	uint8_t running;
+};
+
 /*!
  * @brief Private data for an instance of an EchoLink proxy
  */
 struct proxy_priv
 {
-	/// Array which holds all of the proxy client connection handles
-	struct proxy_conn_handle *clients;
+	/// Array which holds all of the proxy client connection handles
+	struct proxy_conn_handle *clients;
+
+	/// Network connection which listens for connections from clients
+	struct conn_handle conn_listen;
+
+	/// Threads accepting clients in addition to the callers of ::proxy_process
+	struct proxy_acceptor *acceptors;
+
+	/// Number of entries in proxy_priv::acceptors
+	int num_acceptors;
+
+	/// Signaled when proxy_priv::accept_sentinel is set
+	struct condvar_handle accept_condvar;
+
+	/// Termination indicator for the threads in proxy_priv::acceptors,
+	/// protected by proxy_priv::usable_clients_mutex
+	uint8_t accept_sentinel;
+
+	/// Connections to accept clients into, one for each client, one for each
+	/// client which may be authenticating and one spare
+	struct conn_pool_handle conn_pool;
+
+	/// Authenticates clients before they are given a slot
+	struct auth_handle auth;
+
+	/// Indices in proxy_priv::clients of the clients which are free
+	struct freelist_handle free_slots;
+
+	/// Indices in proxy_priv::clients of the clients which are being held
+	/// for a callsign, which are looked up by callsign
+	struct hold_map_handle held_slots;
+
+	/// Logging infrastructure handle
+	struct log_handle log;
+
+	/// Exports statistics to monitoring systems
+	struct metrics_handle metrics;
+
+	/// Accepts administrative commands on a local socket
+	struct admin_handle admin;
+
+	/// Number of clients in proxy_priv::clients which have been started,
+	/// which only grows while the proxy is open, under
+	/// proxy_priv::usable_clients_mutex
+	int num_clients;
+
+	/// Number of entries allocated in proxy_priv::clients, including those
+	/// held in reserve for ::proxy_reload
+	int max_clients;
+
+	/// Copy of the address each client in proxy_priv::clients binds to
+	char **client_addrs;
+
+	/// Indicates which clients in proxy_priv::clients have been taken out of
+	/// service by ::proxy_reload
+	uint8_t *client_retired;
+
+	/// Indicates which clients in proxy_priv::clients have been taken out of
+	/// service by ::proxy_drain
+	uint8_t *client_drained;
+
+	/// Indicates that no slots are given to new clients, protected by
+	/// proxy_priv::usable_clients_mutex
+	uint8_t draining;
+
+	/// Indicates that proxy_priv::conn_listen has been handed off to a new
+	/// process by ::proxy_hand_off, protected by
+	/// proxy_priv::usable_clients_mutex
+	uint8_t handed_off;
+
+	/// Indicates that proxy_priv::conn_listen was taken over from a previous
+	/// process by ::proxy_take_over
+	uint8_t taken_over;
+
+	/// Serializes ::proxy_reload with itself and with ::proxy_close
+	struct mutex_handle reload_mutex;
+
+	/// Number of 'usable' clients in proxy_priv::clients
+	int usable_clients;
+
+	/// Used to protect proxy_priv::usable_clients
+	struct mutex_handle usable_clients_mutex;
+
+	/// Number of clients in proxy_priv::clients which are connected
+	volatile uint32_t slots_used;
+
+	/// Number of clients dropped because no slot was available
+	volatile uint64_t slots_exhausted;
+
+	/// Recent connection attempts and authentication failures by address
+	struct admission_handle admission;
+
+	/// Number of connections refused by proxy_priv::admission
+	volatile uint64_t admission_refused;
+
+	/// Regular expression for matching allowed callsigns
+	struct regex_handle *re_calls_allowed;
+
+	/// Regular expression for matching denied callsigns
+	struct regex_handle *re_calls_denied;
+
+	/// Recent decisions made using proxy_priv::re_calls_allowed and
+	/// proxy_priv::re_calls_denied
+	struct callsign_cache_handle callsign_cache;
+
+	/// Used to protect proxy_priv::re_calls_allowed,
+	/// proxy_priv::re_calls_denied and proxy_priv::callsign_cache from being
+	/// replaced while in use
+	struct mutex_handle calls_mutex;
+
+	/// Null-terminated string which holds the listening port identifier
+	char port_str[6];
+
+	/// Event-driven engine for forwarding client data
+	struct reactor_handle reactor;
+
+	/// Service for registering with echolink.org
+	struct registration_service_handle reg_service;
+
+	/// Times at which to check each of the clients for having exceeded the
+	/// connection or inactivity timeouts, with a tick of one second
+	struct timer_wheel_handle timers;
+
+	/// Timer in proxy_priv::timers for each client in proxy_priv::clients
+	struct timer_wheel_entry *slot_timers;
+
+	/// Thread advancing proxy_priv::timers
+	struct thread_handle reaper_thread;
+
+	/// Signaled when proxy_priv::reaper_sentinel is set
+	struct condvar_handle reaper_condvar;
+
+	/// Termination indicator for proxy_priv::reaper_thread, protected by
+	/// proxy_priv::usable_clients_mutex
+	uint8_t reaper_sentinel;
+
+	/// Non-zero while proxy_priv::reaper_thread is running
+	uint8_t reaper_running;
+
+	/// Threads shared by the clients, if the slots don't have their own
+	struct worker_pool_handle slot_workers;
+};
+
+/*!
+ * @brief Convert a port number to an ASCII string
+ *
+ * @param[in] port Port number to convert
+ * @param[out] result Resulting ASCII string
+ */
+static inline void port_to_str(const uint16_t port, char result[6]);
+
+/*!
+ * @brief Give a client which has been authorized a slot
+ *
+ * @param[in,out] ah Authentication stage instance which authorized the client
+ * @param[in] conn Connection to the client
+ * @param[in] callsign Null-terminated callsign of the client
+ */
+static void client_authorized(struct auth_handle *ah, struct conn_handle *conn, const char *callsign);
+
+/*!
+ * @brief Accept a single client and begin authenticating it
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in,out] conn_listen Listening connection to accept the client from
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int accept_client(struct proxy_handle *ph, struct conn_handle *conn_listen);
+
+/*!
+ * @brief Worker thread for accepting clients
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * acceptor_worker(void *ctx);
+
+/*!
+ * @brief Close and free the additional accepting threads' listening
+ *        connections
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void acceptors_free(struct proxy_handle *ph);
+
+/*!
+ * @brief Prepare the additional accepting threads' listening connections
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] count Number of additional accepting threads
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int acceptors_open(struct proxy_handle *ph, int count);
+
+/*!
+ * @brief Tell the additional accepting threads to stop and unblock them
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void acceptors_shutdown(struct proxy_handle *ph);
+
+/*!
+ * @brief Stop and join the additional accepting threads
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void acceptors_stop(struct proxy_handle *ph);
+
+/*!
+ * @brief Worker thread for disconnecting clients which have timed out
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * reaper_worker(void *ctx);
+
+/*!
+ * @brief Start checking a client which was just given a slot for timeouts
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] slot Index of the client in proxy_priv::clients
+ */
+static void reaper_schedule(struct proxy_handle *ph, int slot);
+
+/*!
+ * @brief Stop and join the thread disconnecting clients which have timed out
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void reaper_stop(struct proxy_handle *ph);
+
+/*!
+ * @brief Callback for when it is time to check a client for timeouts
+ *
+ * @param[in,out] wh Timer wheel the client's timer is scheduled on
+ * @param[in,out] entry Timer of the client to check
+ * @param[in] now Current time in seconds
+ *
+ * @returns Time in seconds at which to check the client again, or 0
+ */
+static uint64_t slot_expired(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t now);
+
+/*!
+ * @brief Compares two addresses, either of which may be NULL
+ *
+ * @param[in] a Null-terminated address, or NULL for any address
+ * @param[in] b Null-terminated address, or NULL for any address
+ *
+ * @returns Non-zero if the addresses are the same, 0 if not
+ */
+static int addr_equal(const char *a, const char *b);
+
+/*!
+ * @brief Allocates a copy of the given address
+ *
+ * @param[in] addr Null-terminated address, or NULL for any address
+ * @param[out] result Newly allocated copy, or NULL if addr is NULL
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int addr_dup(const char *addr, char **result);
+
+/*!
+ * @brief Compiles a regular expression for matching callsigns
+ *
+ * @param[in] pattern Null-terminated pattern, or NULL for none
+ * @param[out] result Newly allocated expression, or NULL if pattern is NULL
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int calls_compile(const char *pattern, struct regex_handle **result);
+
+/*!
+ * @brief Frees a regular expression allocated by ::calls_compile
+ *
+ * @param[in,out] re Expression to free, or NULL
+ */
+static void calls_free(struct regex_handle *re);
+
+/*!
+ * @brief Checks that a configuration can be used by the proxy
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] conf Configuration to check
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conf_validate(struct proxy_handle *ph, const struct proxy_conf *conf);
+
+/*!
+ * @brief Starts a client which is held in reserve, using the given address
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] addr Address for the client, which is taken on success
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int slot_add(struct proxy_handle *ph, char *addr);
+
+/*!
+ * @brief Changes the clients in service to match the addresses in conf
+ *
+ * Clients whose address is no longer configured are retired once their
+ * current client leaves. Newly configured addresses are given a retired
+ * client which has been drained, or a client held in reserve.
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in] conf Configuration containing the addresses to use
+ */
+static void slots_reload(struct proxy_handle *ph, const struct proxy_conf *conf);
+
+/*!
+ * @brief Counts the clients which are in service as the usable clients and
+ *        updates the registration to match
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void slots_update_usable(struct proxy_handle *ph);
+
+static void client_authorized(struct auth_handle *ah, struct conn_handle *conn, const char *callsign)
+{
+	struct proxy_handle *ph = (struct proxy_handle *)ah->func_ctx;
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int ret;
+	int slot;
+
+	// A slot being held for this callsign is not on the free list. The
+	// slot makes the final decision, since the hold may have just ended.
+	slot = hold_map_find(&priv->held_slots, callsign);
+	if (slot >= 0 && proxy_conn_handoff(&priv->clients[slot], conn, callsign) == 0)
+	{
+		proxy_log(ph, LOG_LEVEL_DEBUG, "Giving client '%s' the slot held for it\n", callsign);
+		reaper_schedule(ph, slot);
+		return;
+	}
+
+	// A slot taken from the list only refuses the client if it is stopping
+	// or has been retired, in which case it must not go back on the list
+	do
+	{
+		mutex_lock_shared(&priv->usable_clients_mutex);
+		slot = priv->usable_clients > 0 && !priv->draining ? freelist_pop(&priv->free_slots) : -ENOENT;
+		mutex_unlock_shared(&priv->usable_clients_mutex);
+
+		ret = slot < 0 ? slot : proxy_conn_accept(&priv->clients[slot], conn, callsign);
+	}
+	while (ret == -EBUSY);
+
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_INFO, "Dropping client '%s' because there are no available slots.\n", callsign);
+
+		atomic_u64_add(&priv->slots_exhausted, 1);
+
+		conn_close(conn);
+		conn_pool_put(&priv->conn_pool, conn);
+
+		return;
+	}
+
+	reaper_schedule(ph, slot);
+}
+
+static int accept_client(struct proxy_handle *ph, struct conn_handle *conn_listen)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	struct conn_handle *conn = NULL;
+	struct conn_sockopts opts;
+	int ret = -EBUSY;
+	int usable_clients;
+	uint8_t handed_off;
+	char remote_addr[46] = { 0x0 };
+
+	// There is one more connection in the pool than there are clients for
+	// each accepting thread, so one is always available here
+	conn = conn_pool_get(&priv->conn_pool);
+	if (conn == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	proxy_log(ph, LOG_LEVEL_DEBUG, "Waiting for a client...\n");
+
+	// Once the listening socket is handed off, it belongs to the new process
+	do
+	{
+		ret = conn_poll(conn_listen, PROXY_ACCEPT_POLL);
+
+		mutex_lock_shared(&priv->usable_clients_mutex);
+		handed_off = priv->handed_off;
+		mutex_unlock_shared(&priv->usable_clients_mutex);
+
+		if (handed_off)
+		{
+			ret = -ECANCELED;
+			goto accept_client_exit;
+		}
+	} while (ret == 0);
+
+	if (ret < 0)
+	{
+		goto accept_client_exit;
+	}
+
+	// The listening socket doesn't block, since it may be shared with
+	// another process which takes the client first
+	ret = conn_accept(conn_listen, conn);
+	if (ret == -EAGAIN || ret == -EWOULDBLOCK)
+	{
+		ret = 0;
+		goto accept_client_exit;
+	}
+	else if (ret < 0)
+	{
+		goto accept_client_exit;
+	}
+
+	conn_get_remote_addr(conn, remote_addr);
+
+	// Refuse abusive addresses before spending anything more on them
+	ret = admission_check(&priv->admission, remote_addr);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_DEBUG, "Refusing connection from %s (%d): %s\n", remote_addr, -ret, strerror(-ret));
+		atomic_u64_add(&priv->admission_refused, 1);
+		ret = 0;
+		goto accept_client_exit;
+	}
+
+	proxy_log(ph, LOG_LEVEL_DEBUG, "Incoming connection from %s.\n", remote_addr);
+
+	mutex_lock_shared(&priv->usable_clients_mutex);
+	usable_clients = priv->usable_clients;
+	mutex_unlock_shared(&priv->usable_clients_mutex);
+
+	if (usable_clients <= 0)
+	{
+		proxy_log(ph, LOG_LEVEL_INFO, "Dropping client because there are no available slots.\n");
+		atomic_u64_add(&priv->slots_exhausted, 1);
+		ret = 0;
+		goto accept_client_exit;
+	}
+
+	memset(&opts, 0x0, sizeof(struct conn_sockopts));
+	opts.rcvbuf = ph->conf.client_rcvbuf > INT_MAX ? INT_MAX : (int)ph->conf.client_rcvbuf;
+	opts.sndbuf = ph->conf.client_sndbuf > INT_MAX ? INT_MAX : (int)ph->conf.client_sndbuf;
+	opts.nodelay = ph->conf.client_nodelay;
+	opts.quickack = ph->conf.client_quickack;
+
+	// The client is still usable without the options
+	ret = conn_set_sockopts(conn, &opts);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_WARN, "Failed to set socket options for connection from %s (%d): %s\n", remote_addr, -ret, strerror(-ret));
+	}
+
+	// The client is only given a slot once it has been authorized
+	ret = auth_begin(&priv->auth, conn);
+	if (ret < 0)
+	{
+		goto accept_client_exit;
+	}
+
+	return 0;
+
+accept_client_exit:
+	conn_close(conn);
+	conn_pool_put(&priv->conn_pool, conn);
+
+	return ret;
+}
+
+static void * acceptor_worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct proxy_acceptor *acceptor = (struct proxy_acceptor *)th->func_ctx;
+	struct proxy_handle *ph = acceptor->ph;
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int ret;
+
+	while (1)
+	{
+		ret = accept_client(ph, acceptor->conn);
+
+		mutex_lock(&priv->usable_clients_mutex);
+
+		if (priv->accept_sentinel || ret == -ECANCELED)
+		{
+			mutex_unlock(&priv->usable_clients_mutex);
+
+			break;
+		}
+
+		// Failures to accept, such as running out of descriptors, tend to
+		// persist for a while
+		if (ret < 0)
+		{
+			condvar_wait_time(&priv->accept_condvar, &priv->usable_clients_mutex, PROXY_ACCEPT_BACKOFF);
+		}
+
+		mutex_unlock(&priv->usable_clients_mutex);
+
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_WARN, "Failed to accept a client (%d): %s\n", -ret, strerror(-ret));
+		}
+	}
+
+	return NULL;
+}
+
+static void acceptors_free(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int i;
+
+	for (i = 0; i < priv->num_acceptors; i++)
+	{
+		struct proxy_acceptor *acceptor = &priv->acceptors[i];
+
+		conn_close(&acceptor->conn_listen);
+		conn_free(&acceptor->conn_listen);
+		thread_free(&acceptor->thread);
+	}
+
+	free(priv->acceptors);
+	priv->acceptors = NULL;
+	priv->num_acceptors = 0;
+}
+
+static int acceptors_open(struct proxy_handle *ph, int count)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int ret;
+
+	if (count <= 0)
+	{
+		return 0;
+	}
+
+	priv->acceptors = malloc(sizeof(struct proxy_acceptor) * (size_t)count);
+	if (priv->acceptors == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(priv->acceptors, 0x0, sizeof(struct proxy_acceptor) * (size_t)count);
+
+	for (priv->num_acceptors = 0; priv->num_acceptors < count; priv->num_acceptors++)
+	{
+		struct proxy_acceptor *acceptor = &priv->acceptors[priv->num_acceptors];
+
+		acceptor->ph = ph;
+		acceptor->conn = &priv->conn_listen;
+		acceptor->thread.func_ptr = acceptor_worker;
+		acceptor->thread.func_ctx = acceptor;
+
+		acceptor->conn_listen.type = CONN_TYPE_TCP;
+		ret = conn_init(&acceptor->conn_listen);
+		if (ret < 0)
+		{
+			goto acceptors_open_exit;
+		}
+
+		ret = thread_init(&acceptor->thread);
+		if (ret < 0)
+		{
+			conn_free(&acceptor->conn_listen);
+			goto acceptors_open_exit;
+		}
+
+		// Without a listener of its own, the acceptor shares the first one
+		if (priv->conn_listen.reuse_port)
+		{
+			acceptor->conn_listen.source_addr = priv->conn_listen.source_addr;
+			acceptor->conn_listen.source_port = priv->conn_listen.source_port;
+			acceptor->conn_listen.backlog = priv->conn_listen.backlog;
+			acceptor->conn_listen.reuse_port = 1;
+
+			ret = conn_listen(&acceptor->conn_listen);
+			if (ret < 0)
+			{
+				thread_free(&acceptor->thread);
+				conn_free(&acceptor->conn_listen);
+				goto acceptors_open_exit;
+			}
+
+			acceptor->conn = &acceptor->conn_listen;
+		}
+	}
+
+	return 0;
+
+acceptors_open_exit:
+	acceptors_free(ph);
+
+	return ret;
+}
+
+static void acceptors_shutdown(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int i;
+
+	mutex_lock(&priv->usable_clients_mutex);
+	priv->accept_sentinel = 1;
+	condvar_wake_all(&priv->accept_condvar);
+	mutex_unlock(&priv->usable_clients_mutex);
+
+	for (i = 0; i < priv->num_acceptors; i++)
+	{
+		conn_shutdown(priv->acceptors[i].conn);
+	}
+}
+
+static void acceptors_stop(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int i;
+
+	acceptors_shutdown(ph);
+
+	for (i = 0; i < priv->num_acceptors; i++)
+	{
+		if (priv->acceptors[i].running)
+		{
+			thread_join(&priv->acceptors[i].thread);
+			priv->acceptors[i].running = 0;
+		}
+	}
+}
+
+static void * reaper_worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct proxy_handle *ph = (struct proxy_handle *)th->func_ctx;
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+
+	while (1)
+	{
+		mutex_lock(&priv->usable_clients_mutex);
+
+		if (!priv->reaper_sentinel)
+		{
+			condvar_wait_time(&priv->reaper_condvar, &priv->usable_clients_mutex, PROXY_REAP_INTERVAL);
+		}
+
+		if (priv->reaper_sentinel)
+		{
+			mutex_unlock(&priv->usable_clients_mutex);
+
+			break;
+		}
+
+		mutex_unlock(&priv->usable_clients_mutex);
+
+		timer_wheel_advance(&priv->timers, clock_now_us() / 1000000);
+	}
+
+	return NULL;
+}
+
+static void reaper_schedule(struct proxy_handle *ph, int slot)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	uint64_t interval = ph->conf.connection_timeout * (uint64_t)60;
+
+	if (priv->timers.priv == NULL)
+	{
+		return;
+	}
+
+	// The client is checked again at whichever of its deadlines comes first
+	if (ph->conf.inactivity_timeout > 0 && (interval == 0 || ph->conf.inactivity_timeout < interval))
+	{
+		interval = ph->conf.inactivity_timeout;
+	}
+
+	timer_wheel_add(&priv->timers, &priv->slot_timers[slot], clock_now_us() / 1000000 + interval);
+}
+
+static void reaper_stop(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+
+	mutex_lock(&priv->usable_clients_mutex);
+	priv->reaper_sentinel = 1;
+	condvar_wake_all(&priv->reaper_condvar);
+	mutex_unlock(&priv->usable_clients_mutex);
+
+	if (priv->reaper_running)
+	{
+		thread_join(&priv->reaper_thread);
+		priv->reaper_running = 0;
+	}
+}
+
+static uint64_t slot_expired(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t now)
+{
+	(void)wh;
+
+	return proxy_conn_reap((struct proxy_conn_handle *)entry->ctx, (uint32_t)now);
+}
+
+static int addr_equal(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+	{
+		return a == b;
+	}
+
+	return strcmp(a, b) == 0;
+}
+
+static int addr_dup(const char *addr, char **result)
+{
+	size_t len;
 
-	/// Network connection which listens for connections from clients
-	struct conn_handle conn_listen;
+	*result = NULL;
 
-	/// Logging infrastructure handle
-	struct log_handle log;
+	if (addr == NULL)
+	{
+		return 0;
+	}
 
-	/// Total number of clients in proxy_priv::clients
-	int num_clients;
+	len = strlen(addr) + 1;
 
-	/// Number of 'usable' clients in proxy_priv::clients
-	int usable_clients;
+	*result = malloc(len);
+	if (*result == NULL)
+	{
+		return -ENOMEM;
+	}
 
-	/// Used to protect proxy_priv::usable_clients
-	struct mutex_handle usable_clients_mutex;
+	memcpy(*result, addr, len);
 
-	/// Regular expression for matching allowed callsigns
-	struct regex_handle *re_calls_allowed;
+	return 0;
+}
 
-	/// Regular expression for matching denied callsigns
-	struct regex_handle *re_calls_denied;
+static int calls_compile(const char *pattern, struct regex_handle **result)
+{
+	struct regex_handle *re;
+	int ret;
 
-	/// Null-terminated string which holds the listening port identifier
-	char port_str[6];
+	*result = NULL;
 
-	/// Service for registering with echolink.org
-	struct registration_service_handle reg_service;
-};
+	if (pattern == NULL)
+	{
+		return 0;
+	}
 
-/*!
- * @brief Convert a port number to an ASCII string
- *
- * @param[in] port Port number to convert
- * @param[out] result Resulting ASCII string
- */
-static inline void port_to_str(const uint16_t port, char result[6]);
+	re = malloc(sizeof(struct regex_handle));
+	if (re == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(re, 0x0, sizeof(struct regex_handle));
+
+	ret = regex_init(re);
+	if (ret < 0)
+	{
+		free(re);
+		return ret;
+	}
+
+	ret = regex_compile(re, pattern);
+	if (ret < 0)
+	{
+		calls_free(re);
+		return ret;
+	}
+
+	*result = re;
+
+	return 0;
+}
+
+static void calls_free(struct regex_handle *re)
+{
+	if (re != NULL)
+	{
+		regex_free(re);
+		free(re);
+	}
+}
+
+static int conf_validate(struct proxy_handle *ph, const struct proxy_conf *conf)
+{
+	if (conf->bind_addr_ext_add != NULL)
+	{
+		if (conf->bind_addr_ext == NULL || strcmp(conf->bind_addr_ext, "0.0.0.0") == 0)
+		{
+			proxy_log(ph, LOG_LEVEL_ERROR, "ExternalBindAddresses must be specified if AdditionalExternalBindAddresses is used\n");
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int slot_add(struct proxy_handle *ph, char *addr)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int slot = priv->num_clients;
+	int ret;
+
+	if (slot >= priv->max_clients)
+	{
+		return -ENOSPC;
+	}
+
+	priv->clients[slot].source_addr = addr;
+
+	ret = proxy_conn_init(&priv->clients[slot]);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = proxy_conn_start(&priv->clients[slot]);
+	if (ret < 0)
+	{
+		proxy_conn_free(&priv->clients[slot]);
+		return ret;
+	}
+
+	priv->client_addrs[slot] = addr;
+	priv->client_retired[slot] = 0;
+
+	mutex_lock(&priv->usable_clients_mutex);
+	priv->num_clients++;
+	mutex_unlock(&priv->usable_clients_mutex);
+
+	return 0;
+}
+
+static void slots_reload(struct proxy_handle *ph, const struct proxy_conf *conf)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	const char *addr;
+	char *copy;
+	int found;
+	int ret;
+	int i;
+	int j;
+
+	// Keep every client whose address is still configured, but only one
+	// client for each address
+	for (i = 0; i < priv->num_clients; i++)
+	{
+		addr = priv->client_addrs[i];
+
+		found = addr_equal(addr, conf->bind_addr_ext);
+		for (j = 0; !found && j < conf->bind_addr_ext_add_len; j++)
+		{
+			found = addr_equal(addr, conf->bind_addr_ext_add[j]);
+		}
+
+		for (j = 0; found && j < i; j++)
+		{
+			found = priv->client_retired[j] || !addr_equal(addr, priv->client_addrs[j]);
+		}
+
+		if (found && priv->client_retired[i])
+		{
+			// A drained client stays out of service until it is resumed
+			ret = priv->client_drained[i] ? 0 : proxy_conn_set_source(&priv->clients[i], addr);
+			if (ret < 0)
+			{
+				proxy_log(ph, LOG_LEVEL_ERROR, "Failed to return proxy connection #%d to service (%d): %s\n", i, -ret, strerror(-ret));
+				continue;
+			}
+
+			proxy_log(ph, LOG_LEVEL_INFO, "Returning proxy connection #%d to service\n", i);
+
+			priv->client_retired[i] = 0;
+		}
+		else if (!found && !priv->client_retired[i])
+		{
+			proxy_log(ph, LOG_LEVEL_INFO, "Retiring proxy connection #%d once its client leaves\n", i);
+
+			proxy_conn_retire(&priv->clients[i]);
+
+			priv->client_retired[i] = 1;
+		}
+	}
+
+	// Find a client for each address which doesn't have one
+	for (j = -1; j < conf->bind_addr_ext_add_len; j++)
+	{
+		addr = j < 0 ? conf->bind_addr_ext : conf->bind_addr_ext_add[j];
+
+		found = 0;
+		for (i = 0; !found && i < priv->num_clients; i++)
+		{
+			found = !priv->client_retired[i] && addr_equal(addr, priv->client_addrs[i]);
+		}
+
+		if (found)
+		{
+			continue;
+		}
+
+		ret = addr_dup(addr, &copy);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_ERROR, "Failed to add proxy connection for '%s' (%d): %s\n", addr == NULL ? "0.0.0.0" : addr, -ret, strerror(-ret));
+			continue;
+		}
+
+		// Prefer a retired client whose last client has left
+		for (i = 0; i < priv->num_clients; i++)
+		{
+			if (priv->client_retired[i] && !priv->client_drained[i] && proxy_conn_set_source(&priv->clients[i], copy) == 0)
+			{
+				free(priv->client_addrs[i]);
+				priv->client_addrs[i] = copy;
+				priv->client_retired[i] = 0;
+				break;
+			}
+		}
+
+		if (i < priv->num_clients)
+		{
+			proxy_log(ph, LOG_LEVEL_INFO, "Reusing proxy connection #%d for '%s'\n", i, addr == NULL ? "0.0.0.0" : addr);
+			continue;
+		}
+
+		ret = slot_add(ph, copy);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_ERROR, "Failed to add proxy connection for '%s' (%d): %s\n", addr == NULL ? "0.0.0.0" : addr, -ret, strerror(-ret));
+			free(copy);
+			continue;
+		}
+
+		proxy_log(ph, LOG_LEVEL_INFO, "Added proxy connection #%d for '%s'\n", priv->num_clients - 1, addr == NULL ? "0.0.0.0" : addr);
+	}
+
+	slots_update_usable(ph);
+}
+
+static void slots_update_usable(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int usable_clients = 0;
+	int i;
+
+	for (i = 0; i < priv->num_clients; i++)
+	{
+		if (!priv->client_retired[i] && !priv->client_drained[i])
+		{
+			usable_clients++;
+		}
+	}
+
+	// Once the proxy is shutting down, no clients are usable
+	mutex_lock(&priv->usable_clients_mutex);
+	if (!priv->accept_sentinel)
+	{
+		priv->usable_clients = usable_clients;
+	}
+	mutex_unlock(&priv->usable_clients_mutex);
+
+	proxy_update_registration(ph);
+}
 
 static inline void port_to_str(const uint16_t port, char result[6])
 {
@@ -150,68 +1151,283 @@ static inline void port_to_str(const uint16_t port, char result[6])
 		result++;
 	}
 
-	*result = '\0';
+	*result = '\0';
+}
+
+int proxy_authorize_callsign(struct proxy_handle *ph, const char *callsign)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int authorized = 1;
+	int ret;
+
+	mutex_lock_shared(&priv->calls_mutex);
+
+	ret = callsign_cache_get(&priv->callsign_cache, callsign);
+	if (ret >= 0)
+	{
+		goto proxy_authorize_callsign_exit;
+	}
+
+	if (priv->re_calls_denied != NULL)
+	{
+		ret = regex_is_match(priv->re_calls_denied, callsign);
+		if (ret != 0)
+		{
+			if (ret < 0)
+			{
+				proxy_log(ph, LOG_LEVEL_WARN, "Failed to match callsign '%s' against denial pattern (%d): %s\n", callsign, -ret, strerror(-ret));
+
+				ret = 0;
+				goto proxy_authorize_callsign_exit;
+			}
+
+			authorized = 0;
+		}
+	}
+
+	if (authorized && priv->re_calls_allowed != NULL)
+	{
+		ret = regex_is_match(priv->re_calls_allowed, callsign);
+		if (ret != 1)
+		{
+			if (ret < 0)
+			{
+				proxy_log(ph, LOG_LEVEL_WARN, "Failed to match callsign '%s' against allowing pattern (%d): %s\n", callsign, -ret, strerror(-ret));
+
+				ret = 0;
+				goto proxy_authorize_callsign_exit;
+			}
+
+			authorized = 0;
+		}
+	}
+
+	// Failures to match aren't remembered, so that they are retried
+	callsign_cache_put(&priv->callsign_cache, callsign, authorized);
+
+	ret = authorized;
+
+proxy_authorize_callsign_exit:
+	mutex_unlock_shared(&priv->calls_mutex);
+
+	return ret;
+}
+
+int proxy_load_conf(struct proxy_handle *ph, const char *path)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int ret;
+
+	ret = conf_parse_file(path, &ph->conf, &priv->log);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	return conf_validate(ph, &ph->conf);
+}
+
+int proxy_reload(struct proxy_handle *ph, const char *path)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	struct proxy_conf conf;
+	struct regex_handle *re_calls_allowed = NULL;
+	struct regex_handle *re_calls_denied = NULL;
+	struct regex_handle *re_tmp;
+	char *str_tmp;
+	int ret;
+
+	memset(&conf, 0x0, sizeof(struct proxy_conf));
+
+	mutex_lock(&priv->reload_mutex);
+
+	if (priv->clients == NULL)
+	{
+		ret = -EINVAL;
+		goto proxy_reload_exit;
+	}
+
+	ret = conf_init(&conf);
+	if (ret < 0)
+	{
+		goto proxy_reload_exit;
+	}
+
+	ret = conf_parse_file(path, &conf, &priv->log);
+	if (ret < 0)
+	{
+		goto proxy_reload_exit;
+	}
+
+	ret = conf_validate(ph, &conf);
+	if (ret < 0)
+	{
+		goto proxy_reload_exit;
+	}
+
+	ret = calls_compile(conf.calls_allowed, &re_calls_allowed);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_ERROR, "Failed to compile allowed callsigns regex (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_reload_exit;
+	}
+
+	ret = calls_compile(conf.calls_denied, &re_calls_denied);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_ERROR, "Failed to compile denied callsigns regex (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_reload_exit;
+	}
+
+	if (!addr_equal(conf.reg_comment, ph->conf.reg_comment))
+	{
+		ret = registration_service_set_comment(&priv->reg_service, conf.reg_comment);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_ERROR, "Failed to update registration comment (%d): %s\n", -ret, strerror(-ret));
+			goto proxy_reload_exit;
+		}
+
+		str_tmp = ph->conf.reg_comment;
+		ph->conf.reg_comment = conf.reg_comment;
+		conf.reg_comment = str_tmp;
+	}
+
+	// Nothing past this point can fail, so the new configuration is applied
+	// as a whole. Decisions made with the previous patterns no longer apply.
+	mutex_lock(&priv->calls_mutex);
+
+	re_tmp = priv->re_calls_allowed;
+	priv->re_calls_allowed = re_calls_allowed;
+	re_calls_allowed = re_tmp;
+
+	re_tmp = priv->re_calls_denied;
+	priv->re_calls_denied = re_calls_denied;
+	re_calls_denied = re_tmp;
+
+	callsign_cache_clear(&priv->callsign_cache);
+
+	mutex_unlock(&priv->calls_mutex);
+
+	str_tmp = ph->conf.calls_allowed;
+	ph->conf.calls_allowed = conf.calls_allowed;
+	conf.calls_allowed = str_tmp;
+
+	str_tmp = ph->conf.calls_denied;
+	ph->conf.calls_denied = conf.calls_denied;
+	conf.calls_denied = str_tmp;
+
+	priv->admission.rate = ph->conf.admission_rate = conf.admission_rate;
+	priv->admission.burst = ph->conf.admission_burst = conf.admission_burst;
+	priv->admission.max_failures = ph->conf.admission_failures = conf.admission_failures;
+	priv->admission.penalty = ph->conf.admission_penalty = conf.admission_penalty;
+
+	str_tmp = ph->conf.trace_file;
+	ph->conf.trace_file = conf.trace_file;
+	conf.trace_file = str_tmp;
+
+	ph->conf.trace_snap_len = conf.trace_snap_len;
+
+	slots_reload(ph, &conf);
+
+	proxy_log(ph, LOG_LEVEL_INFO, "Reloaded configuration from '%s'. Changes to other settings take effect once the proxy is restarted.\n", path);
+
+proxy_reload_exit:
+	calls_free(re_calls_allowed);
+	calls_free(re_calls_denied);
+
+	conf_free(&conf);
+
+	mutex_unlock(&priv->reload_mutex);
+
+	return ret;
 }
 
-int proxy_authorize_callsign(struct proxy_handle *ph, const char *callsign)
+int proxy_get_stats(struct proxy_handle *ph, struct proxy_stats *stats, struct proxy_slot_stats *slot_stats, size_t slot_stats_len)
 {
 	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
-	int ret;
+	int num_clients;
+	size_t i;
 
-	if (priv->re_calls_denied != NULL)
+	if (priv == NULL)
 	{
-		ret = regex_is_match(priv->re_calls_denied, callsign);
-		if (ret != 0)
-		{
-			if (ret < 0)
-			{
-				proxy_log(ph, LOG_LEVEL_WARN, "Failed to match callsign '%s' against denial pattern (%d): %s\n", callsign, -ret, strerror(-ret));
-			}
-
-			return 0;
-		}
+		return -EINVAL;
 	}
 
-	if (priv->re_calls_allowed != NULL)
-	{
-		ret = regex_is_match(priv->re_calls_allowed, callsign);
-		if (ret != 1)
-		{
-			if (ret < 0)
-			{
-				proxy_log(ph, LOG_LEVEL_WARN, "Failed to match callsign '%s' against allowing pattern (%d): %s\n", callsign, -ret, strerror(-ret));
-			}
+	stats->admission_refused = atomic_u64_load(&priv->admission_refused);
+	stats->auth_failures = auth_get_failures(&priv->auth);
+	stats->slots_exhausted = atomic_u64_load(&priv->slots_exhausted);
+	stats->log_dropped = log_dropped(&priv->log);
+	stats->slots_used = atomic_u32_load(&priv->slots_used);
 
-			return 0;
-		}
+	mutex_lock_shared(&priv->usable_clients_mutex);
+	stats->slots_total = priv->usable_clients > 0 ? (uint32_t)priv->usable_clients : 0;
+	stats->draining = priv->draining;
+	num_clients = priv->num_clients;
+	mutex_unlock_shared(&priv->usable_clients_mutex);
+
+	for (i = 0; slot_stats != NULL && i < slot_stats_len && i < (size_t)num_clients; i++)
+	{
+		proxy_conn_get_stats(&priv->clients[i], &slot_stats[i]);
 	}
 
-	return 1;
+	return num_clients;
 }
 
-int proxy_load_conf(struct proxy_handle *ph, const char *path)
+uint64_t proxy_latency_bucket_max(size_t bucket)
+{
+	return histogram_bucket_max(bucket);
+}
+
+int proxy_hand_off(struct proxy_handle *ph)
 {
 	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
-	int ret;
+	int ret = 0;
+	int i;
 
-	ret = conf_parse_file(path, &ph->conf, &priv->log);
-	if (ret < 0)
+	mutex_lock(&priv->reload_mutex);
+
+	mutex_lock(&priv->usable_clients_mutex);
+	if (priv->handed_off)
 	{
-		return ret;
+		ret = -EALREADY;
 	}
+	else
+	{
+		priv->handed_off = 1;
+		priv->draining = 1;
+		condvar_wake_all(&priv->accept_condvar);
+	}
+	mutex_unlock(&priv->usable_clients_mutex);
 
-	port_to_str(ph->conf.port, priv->port_str);
-
-	if (ph->conf.bind_addr_ext_add != NULL)
+	if (ret == 0)
 	{
-		if (ph->conf.bind_addr_ext == NULL || strcmp(ph->conf.bind_addr_ext, "0.0.0.0") == 0)
+		// Clients returning to a held slot are let back in by the new
+		// process instead
+		for (i = 0; i < priv->num_clients; i++)
 		{
-			proxy_log(ph, LOG_LEVEL_ERROR, "ExternalBindAddresses must be specified if AdditionalExternalBindAddresses is used\n");
-			return -EINVAL;
+			proxy_conn_retire(&priv->clients[i]);
+		}
+
+		// Listeners of this process's own aren't shared, so any clients
+		// still waiting on them are lost
+		for (i = 0; i < priv->num_acceptors; i++)
+		{
+			if (priv->acceptors[i].conn == &priv->acceptors[i].conn_listen)
+			{
+				conn_shutdown(&priv->acceptors[i].conn_listen);
+			}
 		}
+
+		// The new process registers the proxy from now on
+		ret = registration_service_abandon(&priv->reg_service);
+
+		proxy_log(ph, LOG_LEVEL_INFO, "Handed off to a new process. Waiting for %" PRIu32 " clients to leave...\n", atomic_u32_load(&priv->slots_used));
 	}
 
-	return 0;
+	mutex_unlock(&priv->reload_mutex);
+
+	return ret;
 }
 
 void proxy_ident(struct proxy_handle *ph)
@@ -275,6 +1491,23 @@ int proxy_init(struct proxy_handle *ph)
 		goto proxy_init_exit;
 	}
 
+	// Initialize metrics exporter
+	priv->metrics.ph = ph;
+	ret = metrics_init(&priv->metrics);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	// Initialize administrative interface
+	priv->admin.ph = ph;
+	priv->admin.conn_clients = &priv->conn_listen;
+	ret = admin_init(&priv->admin);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
 	// Initialize the usable_clients mutex
 	ret = mutex_init(&priv->usable_clients_mutex);
 	if (ret < 0)
@@ -282,6 +1515,56 @@ int proxy_init(struct proxy_handle *ph)
 		goto proxy_init_exit;
 	}
 
+	// Initialize the mutexes for reloading the configuration
+	ret = mutex_init(&priv->calls_mutex);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	ret = mutex_init(&priv->reload_mutex);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	ret = condvar_init(&priv->accept_condvar);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	ret = condvar_init(&priv->reaper_condvar);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	// Initialize the thread disconnecting clients which have timed out
+	priv->reaper_thread.func_ptr = reaper_worker;
+	priv->reaper_thread.func_ctx = ph;
+	ret = thread_init(&priv->reaper_thread);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	// Initialize the callsign decision cache
+	priv->callsign_cache.size = PROXY_CALLSIGN_CACHE_LEN;
+	ret = callsign_cache_init(&priv->callsign_cache);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
+	// Initialize the admission table
+	priv->admission.size = PROXY_ADMISSION_LEN;
+	ret = admission_init(&priv->admission);
+	if (ret < 0)
+	{
+		goto proxy_init_exit;
+	}
+
 	priv->num_clients = 0;
 	priv->usable_clients = 0;
 
@@ -301,9 +1584,30 @@ void proxy_free(struct proxy_handle *ph)
 
 		proxy_close(ph);
 
+		// Free admission table
+		admission_free(&priv->admission);
+
+		// Free callsign decision cache
+		callsign_cache_free(&priv->callsign_cache);
+
+		// Free timeout thread
+		thread_free(&priv->reaper_thread);
+
 		// Free usable_clients mutex
+		condvar_free(&priv->reaper_condvar);
+		condvar_free(&priv->accept_condvar);
 		mutex_free(&priv->usable_clients_mutex);
 
+		// Free reload mutexes
+		mutex_free(&priv->reload_mutex);
+		mutex_free(&priv->calls_mutex);
+
+		// Free administrative interface
+		admin_free(&priv->admin);
+
+		// Free metrics exporter
+		metrics_free(&priv->metrics);
+
 		// Free registration service
 		registration_service_free(&priv->reg_service);
 
@@ -316,17 +1620,8 @@ void proxy_free(struct proxy_handle *ph)
 		// Free logger
 		log_free(&priv->log);
 
-		if (priv->re_calls_allowed != NULL)
-		{
-			regex_free(priv->re_calls_allowed);
-			free(priv->re_calls_allowed);
-		}
-
-		if (priv->re_calls_denied != NULL)
-		{
-			regex_free(priv->re_calls_denied);
-			free(priv->re_calls_denied);
-		}
+		calls_free(priv->re_calls_allowed);
+		calls_free(priv->re_calls_denied);
 
 		// Free RNG
 		rand_free();
@@ -343,101 +1638,168 @@ int proxy_open(struct proxy_handle *ph)
 	int ret;
 
 	priv->num_clients = 1 + ph->conf.bind_addr_ext_add_len;
+	priv->max_clients = priv->num_clients + PROXY_RELOAD_SLOTS;
 
-	priv->clients = malloc(sizeof(struct proxy_conn_handle) * priv->num_clients);
-	if (priv->clients == NULL)
+	priv->clients = malloc(sizeof(struct proxy_conn_handle) * priv->max_clients);
+	priv->client_addrs = calloc((size_t)priv->max_clients, sizeof(char *));
+	priv->client_retired = calloc((size_t)priv->max_clients, sizeof(uint8_t));
+	priv->client_drained = calloc((size_t)priv->max_clients, sizeof(uint8_t));
+	if (priv->clients == NULL || priv->client_addrs == NULL || priv->client_retired == NULL || priv->client_drained == NULL)
 	{
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto proxy_open_exit;
 	}
 
-	memset(priv->clients, 0x0, sizeof(struct proxy_conn_handle) * priv->num_clients);
+	memset(priv->clients, 0x0, sizeof(struct proxy_conn_handle) * priv->max_clients);
+
+	// The clients own their addresses, which may outlive the configuration
+	for (i = 0; i < priv->num_clients; i++)
+	{
+		ret = addr_dup(i == 0 ? ph->conf.bind_addr_ext : ph->conf.bind_addr_ext_add[i - 1], &priv->client_addrs[i]);
+		if (ret < 0)
+		{
+			goto proxy_open_exit;
+		}
+	}
 
+	// The background writer is only started by proxy_start, since the
+	// daemon forks between the two and a child doesn't inherit the thread
 	ret = log_open(&priv->log);
 	if (ret < 0)
 	{
 		goto proxy_open_exit;
 	}
 
-	if (ph->conf.calls_allowed != NULL)
+	calls_free(priv->re_calls_allowed);
+	ret = calls_compile(ph->conf.calls_allowed, &priv->re_calls_allowed);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to compile allowed callsigns regex (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
+
+	calls_free(priv->re_calls_denied);
+	ret = calls_compile(ph->conf.calls_denied, &priv->re_calls_denied);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to compile denied callsigns regex (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
+
+	// Decisions made with the previous patterns no longer apply
+	callsign_cache_clear(&priv->callsign_cache);
+
+	if (ph->conf.forwarding_threads > 0)
 	{
-		if (priv->re_calls_allowed == NULL)
+		priv->reactor.backend = ph->conf.forwarding_backend;
+		priv->reactor.num_threads = ph->conf.forwarding_threads;
+		priv->reactor.stack_size = ph->conf.thread_stack_size * 1024U;
+		priv->reactor.affinity = ph->conf.forwarding_cpus;
+		priv->reactor.priority = ph->conf.forwarding_priority;
+
+		ret = reactor_init(&priv->reactor);
+		if (ret < 0)
 		{
-			priv->re_calls_allowed = malloc(sizeof(struct regex_handle));
-			if (priv->re_calls_allowed == NULL)
+			if (ret == -ENOTSUP)
 			{
-				ret = -ENOMEM;
-				goto proxy_open_exit;
+				proxy_log(ph, LOG_LEVEL_FATAL, "Forwarding backend '%s' is not available in this build\n", ph->conf.forwarding_backend);
 			}
-
-			memset(priv->re_calls_allowed, 0x0, sizeof(struct regex_handle));
-
-			ret = regex_init(priv->re_calls_allowed);
-			if (ret < 0)
+			else
 			{
-				proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize allowed callsigns regex (%d): %s\n", -ret, strerror(-ret));
-				goto proxy_open_exit;
+				proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize forwarding reactor (%d): %s\n", -ret, strerror(-ret));
 			}
+			goto proxy_open_exit;
 		}
 
-		ret = regex_compile(priv->re_calls_allowed, ph->conf.calls_allowed);
-		if (ret < 0)
+		for (i = 0; i < priv->max_clients; i++)
 		{
-			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to compile allowed callsigns regex (%d): %s\n", -ret, strerror(-ret));
-			goto proxy_open_exit;
+			priv->clients[i].reactor = &priv->reactor;
 		}
 	}
-	else if (priv->re_calls_allowed != NULL)
+
+	priv->conn_pool.size = priv->max_clients + PROXY_AUTH_PENDING + (ph->conf.accept_threads > 1 ? ph->conf.accept_threads : 1);
+
+	ret = conn_pool_init(&priv->conn_pool);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize client connection pool (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
+
+	priv->auth.ph = ph;
+	priv->auth.conn_pool = &priv->conn_pool;
+	priv->auth.max_pending = PROXY_AUTH_PENDING;
+	priv->auth.func_ptr = client_authorized;
+	priv->auth.func_ctx = ph;
+	priv->auth.admission = &priv->admission;
+
+	priv->admission.rate = ph->conf.admission_rate;
+	priv->admission.burst = ph->conf.admission_burst;
+	priv->admission.max_failures = ph->conf.admission_failures;
+	priv->admission.penalty = ph->conf.admission_penalty;
+
+	ret = auth_init(&priv->auth);
+	if (ret < 0)
 	{
-		regex_free(priv->re_calls_allowed);
-		free(priv->re_calls_allowed);
-		priv->re_calls_allowed = NULL;
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize client authentication (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_open_exit;
 	}
 
-	if (ph->conf.calls_denied != NULL)
+	priv->free_slots.size = priv->max_clients;
+
+	ret = freelist_init(&priv->free_slots);
+	if (ret < 0)
 	{
-		if (priv->re_calls_denied == NULL)
-		{
-			priv->re_calls_denied = malloc(sizeof(struct regex_handle));
-			if (priv->re_calls_denied == NULL)
-			{
-				ret = -ENOMEM;
-				goto proxy_open_exit;
-			}
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize free client list (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
 
-			memset(priv->re_calls_denied, 0x0, sizeof(struct regex_handle));
+	priv->held_slots.size = priv->max_clients;
 
-			ret = regex_init(priv->re_calls_denied);
-			if (ret < 0)
-			{
-				proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize denied callsigns regex (%d): %s\n", -ret, strerror(-ret));
-				goto proxy_open_exit;
-			}
-		}
+	ret = hold_map_init(&priv->held_slots);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize held client table (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
 
-		ret = regex_compile(priv->re_calls_denied, ph->conf.calls_denied);
+	if (ph->conf.slot_threads > 0)
+	{
+		priv->slot_workers.func_ptr = proxy_conn_worker;
+		priv->slot_workers.max_threads = (unsigned int)priv->max_clients;
+		priv->slot_workers.warm_threads = ph->conf.slot_threads < priv->num_clients ? ph->conf.slot_threads : (unsigned int)priv->num_clients;
+		priv->slot_workers.stack_size = ph->conf.thread_stack_size * 1024U;
+		priv->slot_workers.affinity = ph->conf.forwarding_cpus;
+		priv->slot_workers.priority = ph->conf.forwarding_priority;
+
+		ret = worker_pool_init(&priv->slot_workers);
 		if (ret < 0)
 		{
-			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to compile denied callsigns regex (%d): %s\n", -ret, strerror(-ret));
+			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize client threads (%d): %s\n", -ret, strerror(-ret));
 			goto proxy_open_exit;
 		}
-	}
-	else if (priv->re_calls_denied != NULL)
-	{
-		regex_free(priv->re_calls_denied);
-		free(priv->re_calls_denied);
-		priv->re_calls_denied = NULL;
-	}
 
-	priv->clients[0].source_addr = ph->conf.bind_addr_ext;
+		for (i = 0; i < priv->max_clients; i++)
+		{
+			priv->clients[i].workers = &priv->slot_workers;
+		}
+	}
 
-	for (i = 1; i < priv->num_clients; i++)
+	// Clients held in reserve are only initialized when they are needed
+	for (i = 0; i < priv->max_clients; i++)
 	{
-		priv->clients[i].source_addr = ph->conf.bind_addr_ext_add[i - 1];
+		priv->clients[i].ph = ph;
+		priv->clients[i].conn_pool = &priv->conn_pool;
+		priv->clients[i].free_slots = &priv->free_slots;
+		priv->clients[i].held_slots = &priv->held_slots;
+		priv->clients[i].slots_used = &priv->slots_used;
+		priv->clients[i].log_level = &priv->log.level;
+		priv->clients[i].slot = (uint32_t)i;
+		priv->clients[i].source_addr = priv->client_addrs[i];
 	}
 
 	for (i = 0; i < priv->num_clients; i++)
 	{
-		priv->clients[i].ph = ph;
 		ret = proxy_conn_init(&priv->clients[i]);
 		if (ret < 0)
 		{
@@ -452,17 +1814,80 @@ int proxy_open(struct proxy_handle *ph)
 		}
 	}
 
+	if (ph->conf.connection_timeout > 0 || ph->conf.inactivity_timeout > 0)
+	{
+		priv->slot_timers = calloc((size_t)priv->max_clients, sizeof(struct timer_wheel_entry));
+		if (priv->slot_timers == NULL)
+		{
+			ret = -ENOMEM;
+			goto proxy_open_exit_late;
+		}
+
+		for (i = 0; i < priv->max_clients; i++)
+		{
+			priv->slot_timers[i].ctx = &priv->clients[i];
+		}
+
+		priv->timers.start = clock_now_us() / 1000000;
+		priv->timers.func_ptr = slot_expired;
+		priv->timers.func_ctx = ph;
+
+		ret = timer_wheel_init(&priv->timers);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to initialize client timeouts (%d): %s\n", -ret, strerror(-ret));
+			goto proxy_open_exit_late;
+		}
+	}
+
+	// The port may have been set without loading a configuration file
+	port_to_str(ph->conf.port, priv->port_str);
+
 	priv->conn_listen.source_addr = (const char *)ph->conf.bind_addr;
 	priv->conn_listen.source_port = (const char *)priv->port_str;
+	priv->conn_listen.backlog = ph->conf.listen_backlog;
+
+	// The previous process may not have been able to share the port, so
+	// accepting threads share the listener which was taken over
+	priv->conn_listen.reuse_port = !priv->taken_over && ph->conf.accept_threads > 1;
+
+	ret = priv->taken_over ? 0 : conn_listen(&priv->conn_listen);
+	if (ret == -ENOTSUP)
+	{
+		proxy_log(ph, LOG_LEVEL_DEBUG, "Listening port can't be shared on this platform. Accepting threads will share one listener.\n");
+
+		priv->conn_listen.reuse_port = 0;
+
+		ret = conn_listen(&priv->conn_listen);
+	}
 
-	ret = conn_listen(&priv->conn_listen);
 	if (ret < 0)
 	{
 		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to open listening port (%d): %s\n", -ret, strerror(-ret));
 		goto proxy_open_exit_late;
 	}
 
-	if (ph->conf.bind_addr == NULL)
+	ret = conn_set_nonblocking(&priv->conn_listen, 1);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to configure listening port (%d): %s\n", -ret, strerror(-ret));
+		conn_close(&priv->conn_listen);
+		goto proxy_open_exit_late;
+	}
+
+	ret = acceptors_open(ph, (int)ph->conf.accept_threads - 1);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to open listening port for accepting thread (%d): %s\n", -ret, strerror(-ret));
+		conn_close(&priv->conn_listen);
+		goto proxy_open_exit_late;
+	}
+
+	if (priv->taken_over)
+	{
+		proxy_log(ph, LOG_LEVEL_INFO, "Listening for connections on the socket taken over from the previous process\n");
+	}
+	else if (ph->conf.bind_addr == NULL)
 	{
 		proxy_log(ph, LOG_LEVEL_INFO, "Listening for connections on port %s\n", priv->port_str);
 	}
@@ -471,28 +1896,63 @@ int proxy_open(struct proxy_handle *ph)
 		proxy_log(ph, LOG_LEVEL_INFO, "Listening for connections at %s:%s\n", ph->conf.bind_addr, priv->port_str);
 	}
 
-	return 0;
+	return 0;
+
+proxy_open_exit_late:
+	timer_wheel_free(&priv->timers);
+
+	free(priv->slot_timers);
+	priv->slot_timers = NULL;
+
+	for (i = 0; i < priv->num_clients; i++)
+	{
+		proxy_conn_free(&priv->clients[i]);
+	}
+
+proxy_open_exit:
+	calls_free(priv->re_calls_allowed);
+	priv->re_calls_allowed = NULL;
+
+	calls_free(priv->re_calls_denied);
+	priv->re_calls_denied = NULL;
+
+	worker_pool_free(&priv->slot_workers);
+
+	hold_map_free(&priv->held_slots);
+
+	freelist_free(&priv->free_slots);
+
+	auth_free(&priv->auth);
+
+	conn_pool_free(&priv->conn_pool);
+
+	reactor_free(&priv->reactor);
+
+	log_stop(&priv->log);
+	log_close(&priv->log);
 
-proxy_open_exit_late:
-	for (i = 0; i < priv->num_clients; i++)
+	if (priv->client_addrs != NULL)
 	{
-		proxy_conn_free(&priv->clients[i]);
+		for (i = 0; i < priv->max_clients; i++)
+		{
+			free(priv->client_addrs[i]);
+		}
 	}
 
-proxy_open_exit:
-	if (priv->re_calls_allowed != NULL)
-	{
-		regex_free(priv->re_calls_allowed);
-		free(priv->re_calls_allowed);
-		priv->re_calls_allowed = NULL;
-	}
+	free(priv->client_addrs);
+	priv->client_addrs = NULL;
 
-	log_close(&priv->log);
+	free(priv->client_retired);
+	priv->client_retired = NULL;
+
+	free(priv->client_drained);
+	priv->client_drained = NULL;
 
 	free(priv->clients);
 	priv->clients = NULL;
 
 	priv->num_clients = 0;
+	priv->max_clients = 0;
 
 	return ret;
 }
@@ -503,6 +1963,14 @@ void proxy_close(struct proxy_handle *ph)
 	int i;
 	int ret;
 
+	// Admin commands take the reload mutex, so the admin thread must be
+	// joined before it is held here
+	admin_stop(&priv->admin);
+
+	mutex_lock(&priv->reload_mutex);
+
+	metrics_stop(&priv->metrics);
+
 	ret = registration_service_stop(&priv->reg_service);
 	if (ret < 0)
 	{
@@ -510,6 +1978,15 @@ void proxy_close(struct proxy_handle *ph)
 	}
 
 	proxy_shutdown(ph);
+
+	acceptors_stop(ph);
+
+	reaper_stop(ph);
+
+	// Stop authenticating first, since a client which finishes would be
+	// given a slot
+	auth_stop(&priv->auth);
+
 	proxy_drop(ph);
 
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Closing client connections...\n");
@@ -519,17 +1996,118 @@ void proxy_close(struct proxy_handle *ph)
 		proxy_conn_free(&priv->clients[i]);
 	}
 
+	if (priv->client_addrs != NULL)
+	{
+		for (i = 0; i < priv->max_clients; i++)
+		{
+			free(priv->client_addrs[i]);
+		}
+	}
+
+	free(priv->client_addrs);
+	priv->client_addrs = NULL;
+
+	free(priv->client_retired);
+	priv->client_retired = NULL;
+
+	free(priv->client_drained);
+	priv->client_drained = NULL;
+
 	free(priv->clients);
 	priv->clients = NULL;
 	priv->num_clients = 0;
+	priv->max_clients = 0;
+
+	timer_wheel_free(&priv->timers);
+
+	free(priv->slot_timers);
+	priv->slot_timers = NULL;
+
+	worker_pool_free(&priv->slot_workers);
+
+	hold_map_free(&priv->held_slots);
+
+	freelist_free(&priv->free_slots);
+
+	auth_free(&priv->auth);
+
+	conn_pool_free(&priv->conn_pool);
+
+	reactor_free(&priv->reactor);
 
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Closing listening connection...\n");
 
+	acceptors_free(ph);
+
 	conn_close(&priv->conn_listen);
 
+	priv->conn_listen.shared = 0;
+	priv->handed_off = 0;
+	priv->taken_over = 0;
+
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Proxy is down - closing log.\n");
 
+	log_stop(&priv->log);
 	log_close(&priv->log);
+
+	mutex_unlock(&priv->reload_mutex);
+}
+
+int proxy_drain(struct proxy_handle *ph, int slot)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int ret = 0;
+
+	mutex_lock(&priv->reload_mutex);
+
+	if (slot < 0)
+	{
+		mutex_lock(&priv->usable_clients_mutex);
+		priv->draining = 1;
+		mutex_unlock(&priv->usable_clients_mutex);
+
+		proxy_log(ph, LOG_LEVEL_INFO, "Draining the proxy. No more clients will be given a slot.\n");
+
+		proxy_update_registration(ph);
+	}
+	else if (slot >= priv->num_clients)
+	{
+		ret = -ENOENT;
+	}
+	else if (!priv->client_drained[slot])
+	{
+		proxy_log(ph, LOG_LEVEL_INFO, "Draining proxy connection #%d\n", slot);
+
+		proxy_conn_retire(&priv->clients[slot]);
+		priv->client_drained[slot] = 1;
+
+		slots_update_usable(ph);
+	}
+
+	mutex_unlock(&priv->reload_mutex);
+
+	return ret;
+}
+
+int proxy_drop_slot(struct proxy_handle *ph, int slot)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int num_clients;
+
+	mutex_lock_shared(&priv->usable_clients_mutex);
+	num_clients = priv->num_clients;
+	mutex_unlock_shared(&priv->usable_clients_mutex);
+
+	if (slot < 0 || slot >= num_clients)
+	{
+		return -ENOENT;
+	}
+
+	proxy_log(ph, LOG_LEVEL_INFO, "Dropping the client from proxy connection #%d\n", slot);
+
+	proxy_conn_drop(&priv->clients[slot]);
+
+	return 0;
 }
 
 void proxy_drop(struct proxy_handle *ph)
@@ -539,12 +2117,87 @@ void proxy_drop(struct proxy_handle *ph)
 
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Dropping all clients...\n");
 
+	auth_drop(&priv->auth);
+
 	for (i = 0; i < priv->num_clients; i++)
 	{
 		proxy_conn_drop(&priv->clients[i]);
 	}
 }
 
+int proxy_dump_trace(struct proxy_handle *ph, const char *path, int slot)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	struct trace_source *sources = NULL;
+	char (*names)[16] = NULL;
+	int first;
+	int num;
+	int i;
+	int ret;
+
+	if (priv == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&priv->reload_mutex);
+
+	if (path == NULL)
+	{
+		path = ph->conf.trace_file;
+	}
+
+	if (path == NULL)
+	{
+		proxy_log(ph, LOG_LEVEL_ERROR, "No TraceFile is configured to write traced traffic to\n");
+		ret = -EINVAL;
+		goto proxy_dump_trace_exit;
+	}
+
+	if (priv->clients == NULL || slot >= priv->num_clients)
+	{
+		ret = -ENOENT;
+		goto proxy_dump_trace_exit;
+	}
+
+	first = slot < 0 ? 0 : slot;
+	num = slot < 0 ? priv->num_clients : 1;
+
+	sources = malloc(num * sizeof(struct trace_source));
+	names = malloc(num * sizeof(*names));
+	if (sources == NULL || names == NULL)
+	{
+		ret = -ENOMEM;
+		goto proxy_dump_trace_exit;
+	}
+
+	for (i = 0; i < num; i++)
+	{
+		snprintf(names[i], sizeof(*names), "slot%d", first + i);
+
+		sources[i].ring = proxy_conn_get_trace(&priv->clients[first + i]);
+		sources[i].name = names[i];
+		sources[i].local_addr = priv->clients[first + i].source_addr;
+	}
+
+	ret = trace_dump(path, sources, num);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_ERROR, "Failed to write traced traffic to '%s' (%d): %s\n", path, -ret, strerror(-ret));
+		goto proxy_dump_trace_exit;
+	}
+
+	proxy_log(ph, LOG_LEVEL_INFO, "Wrote %d traced packets to '%s'\n", ret, path);
+
+proxy_dump_trace_exit:
+	free(names);
+	free(sources);
+
+	mutex_unlock(&priv->reload_mutex);
+
+	return ret;
+}
+
 void proxy_shutdown(struct proxy_handle *ph)
 {
 	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
@@ -557,6 +2210,8 @@ void proxy_shutdown(struct proxy_handle *ph)
 
 	proxy_update_registration(ph);
 
+	acceptors_shutdown(ph);
+
 	conn_shutdown(&priv->conn_listen);
 }
 
@@ -599,64 +2254,23 @@ int proxy_log_select_medium(struct proxy_handle *ph, const enum LOG_MEDIUM mediu
 int proxy_process(struct proxy_handle *ph)
 {
 	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
-	struct conn_handle *conn = NULL;
-	int ret = -EBUSY;
-	int i;
-	char remote_addr[40] = { 0x0 };
-
-	conn = malloc(sizeof(struct conn_handle));
-	if (conn == NULL)
-	{
-		return -ENOMEM;
-	}
-
-	memset(conn, 0x0, sizeof(struct conn_handle));
+	int ret;
 
-	ret = conn_init(conn);
-	if (ret < 0)
+	ret = accept_client(ph, &priv->conn_listen);
+	if (ret != -ECANCELED)
 	{
-		free(conn);
 		return ret;
 	}
 
-	proxy_log(ph, LOG_LEVEL_DEBUG, "Waiting for a client...\n");
-
-	ret = conn_accept(&priv->conn_listen, conn);
-	if (ret < 0)
-	{
-		goto conn_process_exit;
-	}
-
-	conn_get_remote_addr(conn, remote_addr);
-	proxy_log(ph, LOG_LEVEL_DEBUG, "Incoming connection from %s.\n", remote_addr);
-
-	mutex_lock_shared(&priv->usable_clients_mutex);
-	for (i = 0; i < priv->usable_clients; i++)
-	{
-		ret = proxy_conn_accept(&priv->clients[i], conn);
-		if (ret != -EBUSY)
-		{
-			break;
-		}
-	}
-	mutex_unlock_shared(&priv->usable_clients_mutex);
+	// The clients which were here before the handoff are left to finish
+	mutex_lock(&priv->usable_clients_mutex);
 
-	if (ret == -EBUSY)
-	{
-		proxy_log(ph, LOG_LEVEL_INFO, "Dropping client because there are no available slots.\n");
-		ret = 0;
-		goto conn_process_exit;
-	}
-	else if (ret < 0)
+	while (!priv->accept_sentinel && atomic_u32_load(&priv->slots_used) > 0)
 	{
-		goto conn_process_exit;
+		condvar_wait_time(&priv->accept_condvar, &priv->usable_clients_mutex, PROXY_HANDOFF_POLL);
 	}
 
-	return 0;
-
-conn_process_exit:
-	conn_free(conn);
-	free(conn);
+	mutex_unlock(&priv->usable_clients_mutex);
 
 	return ret;
 }
@@ -668,32 +2282,52 @@ int get_nonce(uint32_t *nonce)
 
 int get_password_response(const uint32_t nonce, const char *password, uint8_t response[PROXY_PASS_RES_LEN])
 {
-	unsigned int pass_with_nonce_len = (unsigned int)strlen(password) + 8;
-	uint8_t *pass_with_nonce = malloc(pass_with_nonce_len);
-	char *iter = (char *)pass_with_nonce;
+	struct digest_password dp;
+
+	digest_password_init(&dp, password);
+	digest_password_response(&dp, nonce, response);
+
+	return 0;
+}
+
+int proxy_resume(struct proxy_handle *ph, int slot)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	int ret = 0;
+
+	mutex_lock(&priv->reload_mutex);
 
-	while (*password != '\0')
+	if (slot < 0)
 	{
-		if (*password >= 97 && *password <= 122)
-		{
-			*iter = *password - 32;
-		}
-		else
-		{
-			*iter = *password;
-		}
+		mutex_lock(&priv->usable_clients_mutex);
+		priv->draining = 0;
+		mutex_unlock(&priv->usable_clients_mutex);
 
-		iter++;
-		password++;
+		proxy_log(ph, LOG_LEVEL_INFO, "No longer draining the proxy\n");
+
+		proxy_update_registration(ph);
+	}
+	else if (slot >= priv->num_clients)
+	{
+		ret = -ENOENT;
 	}
+	else if (priv->client_drained[slot])
+	{
+		// A client which was also retired by a reload stays retired
+		ret = priv->client_retired[slot] ? 0 : proxy_conn_set_source(&priv->clients[slot], priv->client_addrs[slot]);
+		if (ret == 0)
+		{
+			proxy_log(ph, LOG_LEVEL_INFO, "Returning proxy connection #%d to service\n", slot);
 
-	digest_to_hex32(nonce, iter);
+			priv->client_drained[slot] = 0;
 
-	digest_get(pass_with_nonce, pass_with_nonce_len, response);
+			slots_update_usable(ph);
+		}
+	}
 
-	free(pass_with_nonce);
+	mutex_unlock(&priv->reload_mutex);
 
-	return 0;
+	return ret;
 }
 
 int proxy_start(struct proxy_handle *ph)
@@ -701,6 +2335,36 @@ int proxy_start(struct proxy_handle *ph)
 	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
 	int ret;
 	int i;
+	int j;
+
+	ret = log_start(&priv->log);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start log writer (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	if (priv->reactor.priv != NULL)
+	{
+		ret = reactor_start(&priv->reactor);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start forwarding reactor (%d): %s\n", -ret, strerror(-ret));
+			goto proxy_start_exit_log;
+		}
+
+		proxy_log(ph, LOG_LEVEL_INFO, "Forwarding client data using %s\n", reactor_name(&priv->reactor));
+	}
+
+	if (priv->slot_workers.priv != NULL)
+	{
+		ret = worker_pool_start(&priv->slot_workers);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start client threads (%d): %s\n", -ret, strerror(-ret));
+			goto proxy_start_exit_reactor;
+		}
+	}
 
 	for (i = 0; i < priv->num_clients; i++)
 	{
@@ -712,10 +2376,64 @@ int proxy_start(struct proxy_handle *ph)
 		}
 	}
 
+	ret = auth_start(&priv->auth);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start client authentication (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_start_exit;
+	}
+
 	mutex_lock(&priv->usable_clients_mutex);
 	priv->usable_clients = priv->num_clients;
+	priv->accept_sentinel = 0;
+	priv->reaper_sentinel = 0;
 	mutex_unlock(&priv->usable_clients_mutex);
 
+	// Slots still in use by the process which was taken over from are
+	// drained before any clients are accepted
+	ret = admin_start(&priv->admin);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start administrative interface (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_start_exit;
+	}
+
+	if (priv->timers.priv != NULL)
+	{
+		ret = thread_start(&priv->reaper_thread);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start client timeout thread (%d): %s\n", -ret, strerror(-ret));
+			goto proxy_start_exit;
+		}
+
+		priv->reaper_running = 1;
+	}
+
+	for (j = 0; j < priv->num_acceptors; j++)
+	{
+		ret = thread_start(&priv->acceptors[j].thread);
+		if (ret < 0)
+		{
+			proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start accepting thread #%d (%d): %s\n", j, -ret, strerror(-ret));
+			goto proxy_start_exit;
+		}
+
+		priv->acceptors[j].running = 1;
+	}
+
+	if (priv->num_acceptors > 0)
+	{
+		proxy_log(ph, LOG_LEVEL_INFO, "Accepting clients on %d threads%s\n", priv->num_acceptors + 1, priv->conn_listen.reuse_port ? " with separate listeners" : "");
+	}
+
+	ret = metrics_start(&priv->metrics);
+	if (ret < 0)
+	{
+		proxy_log(ph, LOG_LEVEL_FATAL, "Failed to start metrics exporter (%d): %s\n", -ret, strerror(-ret));
+		goto proxy_start_exit;
+	}
+
 	proxy_update_registration(ph);
 	ret = registration_service_start(&priv->reg_service, &ph->conf);
 	if (ret < 0)
@@ -724,35 +2442,82 @@ int proxy_start(struct proxy_handle *ph)
 		goto proxy_start_exit;
 	}
 
+	// The previous process keeps accepting clients until it hears this
+	if (priv->taken_over)
+	{
+		admin_confirm(&priv->admin);
+	}
+
 	return 0;
 
 proxy_start_exit:
+	admin_stop(&priv->admin);
+
+	metrics_stop(&priv->metrics);
+
+	acceptors_stop(ph);
+
+	reaper_stop(ph);
+
+	auth_stop(&priv->auth);
+
 	for (i--; i >= 0; i--)
 	{
 		proxy_conn_stop(&priv->clients[i]);
 	}
 
+	if (priv->slot_workers.priv != NULL)
+	{
+		worker_pool_stop(&priv->slot_workers);
+	}
+
+proxy_start_exit_reactor:
+	if (priv->reactor.priv != NULL)
+	{
+		reactor_stop(&priv->reactor);
+	}
+
+proxy_start_exit_log:
+	log_stop(&priv->log);
+
 	return ret;
 }
 
-void proxy_update_registration(struct proxy_handle *ph)
+int proxy_take_over(struct proxy_handle *ph)
 {
 	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
-	int slots_used = 0;
-	int slots_total;
-	int i;
+	int ret;
 
-	for (i = 0; i < priv->num_clients; i++)
+	ret = admin_take_over(&priv->admin);
+	if (ret < 0)
 	{
-		if (proxy_conn_in_use(&priv->clients[i]))
-		{
-			slots_used++;
-		}
+		return ret;
 	}
 
+	priv->taken_over = 1;
+
+	return 0;
+}
+
+void proxy_update_registration(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = (struct proxy_priv *)ph->priv;
+	uint32_t slots_used;
+	int slots_total;
+	uint8_t draining;
+
+	slots_used = atomic_u32_load(&priv->slots_used);
+
 	mutex_lock_shared(&priv->usable_clients_mutex);
 	slots_total = priv->usable_clients;
+	draining = priv->draining;
 	mutex_unlock_shared(&priv->usable_clients_mutex);
 
+	// A draining proxy is full as far as new clients are concerned
+	if (draining && slots_used < (uint32_t)slots_total)
+	{
+		slots_used = (uint32_t)slots_total;
+	}
+
 	registration_service_update(&priv->reg_service, slots_used, slots_total);
 }
@@ -45,19 +45,30 @@
  */
 
 #include "openelp/openelp.h"
+#include "atomic.h"
+#include "clock.h"
 
 #include "conn.h"
-#include "digest.h"
+#include "histogram.h"
 #include "mutex.h"
 #include "proxy_conn.h"
+#include "queue.h"
 #include "rand.h"
+#include "reactor.h"
 #include "thread.h"
+#include "trace.h"
+#include "worker_pool.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if HISTOGRAM_BUCKETS != PROXY_LATENCY_BUCKETS
+#error Latency Histogram Length Mismatch
+#endif
+
 /*!
  * @brief Maximum amount of data to process in one message
  *
@@ -69,93 +80,67 @@
 /// Maximum amount of data to process not including the message header
 #define CONN_BUFF_LEN_HEADERLESS CONN_BUFF_LEN - sizeof(struct proxy_msg)
 
-/*!
- * @brief Message types used in communication between the proxy and the client
- */
-enum PROXY_MSG_TYPE
-{
-	/*!
-	 * @brief The proxy should open a new TCP connection
-	 *
-	 * * Sent by: client
-	 * * Expected data: 0 bytes
-	 */
-	PROXY_MSG_TYPE_TCP_OPEN = 1,
-
-	/*!
-	 * @brief Data which has been sent or should be sent over the TCP connection
-	 *
-	 * The address field is ignored in this message
-	 *
-	 * * Sent by: client or proxy
-	 * * Expected data: 1 or more bytes
-	 */
-	PROXY_MSG_TYPE_TCP_DATA,
-
-	/*!
-	 * @brief The TCP has been, or should be closed
-	 *
-	 * The address field is ignored in this message
-	 *
-	 * When the client requests that the TCP connection be closed, the proxy
-	 * responds with another ::PROXY_MSG_TYPE_TCP_CLOSE message
-	 *
-	 * * Sent by: client or proxy
-	 * * Expected data: 0 bytes
-	 */
-	PROXY_MSG_TYPE_TCP_CLOSE,
-
-	/*!
-	 * @brief The status of the TCP connection
-	 *
-	 * The address field is ignored in this message
-	 *
-	 * The data included with this message should be zeroed when the TCP connection
-	 * was opened successfully, and non-zero otherwise
-	 *
-	 * * Sent by: proxy
-	 * * Expected data: 4 bytes
-	 */
-	PROXY_MSG_TYPE_TCP_STATUS,
-
-	/*!
-	 * @brief Data which has been or should be sent of the UDP Data connection
-	 *
-	 * * Sent by: client or proxy
-	 * * Expected data: 1 or more bytes
-	 */
-	PROXY_MSG_TYPE_UDP_DATA,
-
-	/*!
-	 * @brief Data which has been or should be sent of the UDP Control connection
-	 *
-	 * * Sent by: client or proxy
-	 * * Expected data: 1 or more bytes
-	 */
-	PROXY_MSG_TYPE_UDP_CONTROL,
-
-	/*!
-	 * @brief Proxy system information
-	 *
-	 * The contents of this message are a single ::SYSTEM_MSG
-	 *
-	 * * Sent by: proxy
-	 * * Expected data: 1 byte
-	 */
-	PROXY_MSG_TYPE_SYSTEM,
-};
+/// Maximum number of datagrams to receive and forward to the client at once
+#define UDP_BATCH_LEN 16
 
-/*!
- * @brief System messages sent by the proxy to the client
- */
-enum SYSTEM_MSG
-{
-	/// The client has supplied the proxy with an incorrect password
-	SYSTEM_MSG_BAD_PASSWORD = 1,
+/// Maximum number of batches to forward each time a UDP watch is ready
+#define WATCH_UDP_BURST 4
 
-	/// The client's callsign is not allowed to use the proxy
-	SYSTEM_MSG_ACCESS_DENIED,
-};
+/// Size of the buffer for data received from the client
+#define CLIENT_RX_LEN (2 * CONN_BUFF_LEN)
+
+/// Number of frames which can be waiting to be written to the client
+#define CLIENT_QUEUE_LEN 32
+
+/// Base 2 logarithm of the number of remote hosts whose socket addresses are
+/// kept for each client
+#define PEER_CACHE_BITS 3
+
+/// Number of remote hosts whose socket addresses are kept for each client
+#define PEER_CACHE_LEN (1 << PEER_CACHE_BITS)
+
+/// Number of queued frames beyond which stale UDP frames may be discarded
+#define CLIENT_QUEUE_TRIM (CLIENT_QUEUE_LEN / 2)
+
+/// Time in milliseconds to wait before the first retry of a TCP connection,
+/// which doubles with each further retry
+#define TCP_RETRY_DELAY 100
+
+/// Longest time in milliseconds to wait between retries of a TCP connection
+#define TCP_RETRY_DELAY_MAX 1600
+
+/// Most data from the client which may wait for the remote host to accept it
+/// over TCP, beyond which the connection is closed
+#define TCP_PENDING_LEN (16 * CONN_BUFF_LEN)
+
+/// Time in microseconds to wait for the remote host to accept more TCP data
+/// before checking whether the connection was closed
+#define TCP_FLUSH_POLL 100000
+
+/// Log a message, but only evaluate the arguments if the level is enabled
+#define PROXY_CONN_LOG(pc, lvl, ...) \
+	do \
+	{ \
+		if ((unsigned)(lvl) <= *(pc)->log_level) \
+		{ \
+			proxy_log((pc)->ph, (lvl), __VA_ARGS__); \
+		} \
+	} while (0)
+
+#ifdef HAVE_DEBUG_LOG
+/// Log a debug message, unless debug messages are compiled out
+#  define PROXY_CONN_DEBUG(pc, ...) PROXY_CONN_LOG(pc, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+// The call is never made, but the arguments are still checked and used
+#  define PROXY_CONN_DEBUG(pc, ...) \
+	do \
+	{ \
+		if (0) \
+		{ \
+			proxy_log((pc)->ph, LOG_LEVEL_DEBUG, __VA_ARGS__); \
+		} \
+	} while (0)
+#endif
 
 #ifdef _WIN32
 #  pragma pack(push,1)
@@ -183,6 +168,108 @@ struct proxy_msg
 } __attribute__((packed));
 #endif
 
+/*!
+ * @brief Buffer for packing several messages into a single write to the client
+ */
+struct msg_pack
+{
+	/// Packed messages waiting to be sent to the client
+	uint8_t buff[CONN_BUFF_LEN];
+
+	/// Number of bytes in msg_pack::buff
+	size_t len;
+
+	/// Time by which the packed messages must be sent, in microseconds
+	uint64_t deadline;
+
+	/// Time at which the first of the packed messages was received, in
+	/// microseconds
+	uint64_t stamp;
+};
+
+/*!
+ * @brief Buffer and parser state for the stream of messages from the client
+ */
+struct msg_reader
+{
+	/// Data received from the client which has not yet been processed
+	uint8_t buff[CLIENT_RX_LEN];
+
+	/// Offset in msg_reader::buff of the first unprocessed byte
+	size_t off;
+
+	/// Number of unprocessed bytes in msg_reader::buff
+	size_t len;
+
+	/// Header of the message currently being processed, as a ::proxy_msg
+	uint8_t msg[sizeof(struct proxy_msg)];
+
+	/// Non-zero if msg_reader::msg holds a header whose body is incomplete
+	int in_msg;
+
+	/// Number of bytes of the current message body not yet processed
+	uint32_t remaining;
+
+	/// Result of forwarding the current ::PROXY_MSG_TYPE_TCP_DATA message
+	int tcp_ret;
+
+	/// Time at which data was last received into msg_reader::buff, in
+	/// microseconds
+	uint64_t stamp;
+};
+
+/*!
+ * @brief Socket addresses of a remote host which the client sends UDP traffic
+ *        to
+ */
+struct peer_cache_entry
+{
+	/// IPv4 address of the remote host, in network byte order
+	uint32_t addr;
+
+	/// Non-zero once the entry has been filled
+	uint8_t valid;
+
+	/// Address of the remote host's UDP control port
+	struct conn_peer control;
+
+	/// Address of the remote host's UDP data port
+	struct conn_peer data;
+};
+
+/*!
+ * @brief Counts of one kind of traffic forwarded in one direction
+ *
+ * Each is updated by a different thread, so each has a cache line to itself.
+ */
+struct ATOMIC_ALIGNED traffic_counter
+{
+	/// Number of packets or messages forwarded
+	volatile uint64_t packets;
+
+	/// Number of payload bytes forwarded
+	volatile uint64_t bytes;
+};
+
+/*!
+ * @brief Frame of messages queued to be written to the client
+ */
+struct out_frame
+{
+	/// Number of bytes in out_frame::buff
+	uint32_t len;
+
+	/// Non-zero if the frame holds only UDP traffic, which may be discarded
+	uint8_t droppable;
+
+	/// Time at which the oldest traffic in the frame was received, in
+	/// microseconds, or 0 if its latency is not measured
+	uint64_t stamp;
+
+	/// Messages to write to the client
+	uint8_t buff[CONN_BUFF_LEN];
+};
+
 /*!
  * @brief Private data for an instance of a proxy client connection
  */
@@ -194,6 +281,13 @@ struct proxy_conn_priv
 	/// Condition variable for waking proxy_conn_priv::thread_client
 	struct condvar_handle condvar_client;
 
+	/// Condition variable for waking threads waiting for space in
+	/// proxy_conn_priv::queue_client
+	struct condvar_handle condvar_space;
+
+	/// Condition variable for waking proxy_conn_priv::thread_writer
+	struct condvar_handle condvar_writer;
+
 	/// TCP connection to the client
 	struct conn_handle *conn_client;
 
@@ -206,15 +300,138 @@ struct proxy_conn_priv
 	/// TCP connection for directory information
 	struct conn_handle conn_tcp;
 
-	/// Mutex for protecting transmissions on proxy_conn_priv::conn_client
-	struct mutex_handle mutex_client_send;
+	/// Number of UDP frames discarded because the client fell behind
+	volatile uint32_t frames_dropped;
+
+	/// Number of UDP frames discarded during previous client sessions
+	volatile uint64_t frames_dropped_total;
+
+	/// Number of failed attempts to send to the client or to a remote host
+	volatile uint64_t send_failures;
+
+	/// Number of UDP datagrams discarded because they came from a host the
+	/// client had not sent to
+	volatile uint64_t udp_filtered;
+
+	/// Remote hosts the client has sent UDP traffic to during the current
+	/// session, in network byte order, which is only appended to while
+	/// processing messages from the client
+	volatile uint32_t peer_filter[CONN_FILTER_MAX];
+
+	/// Number of entries in proxy_conn_priv::peer_filter, or more than
+	/// ::CONN_FILTER_MAX if it overflowed and filtering is disabled
+	volatile uint32_t peer_filter_len;
+
+	/// UDP data forwarded to the client
+	struct traffic_counter udp_data_in;
+
+	/// UDP data forwarded from the client
+	struct traffic_counter udp_data_out;
+
+	/// UDP control information forwarded to the client
+	struct traffic_counter udp_control_in;
+
+	/// UDP control information forwarded from the client
+	struct traffic_counter udp_control_out;
+
+	/// TCP data forwarded to the client
+	struct traffic_counter tcp_in;
+
+	/// TCP data forwarded from the client
+	struct traffic_counter tcp_out;
+
+	/// Latency of UDP traffic forwarded to the client
+	struct histogram latency_in;
+
+	/// Latency of UDP traffic forwarded from the client
+	struct histogram latency_out;
+
+	/// Most recent traffic forwarded in either direction, which is kept
+	/// across client sessions
+	struct trace_ring trace;
 
 	/// Mutex for protecting the proxy_conn_priv::sentinel
 	struct mutex_handle mutex_sentinel;
 
+	/// Mutex used with proxy_conn_priv::condvar_space and
+	/// proxy_conn_priv::condvar_writer
+	struct mutex_handle mutex_writer;
+
+	/// Frames waiting to be written to the client
+	struct queue_handle queue_client;
+
+	/// Data received from the client which is waiting to be processed
+	struct msg_reader reader;
+
+	/// Socket addresses of remote hosts the client recently sent UDP traffic
+	/// to, which is only used while processing messages from the client
+	struct peer_cache_entry peer_cache[PEER_CACHE_LEN];
+
 	/// Termination indicator for proxy_conn_priv::thread_client
 	uint8_t sentinel;
 
+	/// Indicates that the client session being forwarded by the reactor ended
+	uint8_t session_done;
+
+	/// Indicates that proxy_conn_handle::slot is in proxy_conn_handle::free_slots
+	uint8_t slot_listed;
+
+	/// Indicates that proxy_conn_priv::conn_client was authorized by another
+	/// slot and handed off to this one
+	uint8_t handed_off;
+
+	/// Indicates that a thread from proxy_conn_handle::workers is serving
+	/// this slot, or has been asked to
+	uint8_t bound;
+
+	/// Indicates that the slot is being taken out of service, and must not
+	/// be given another client once its current one leaves
+	uint8_t retiring;
+
+	/// Callsign of the client this slot is being held for, or empty if none
+	char held_callsign[12];
+
+	/// Time at which the slot stops being held, in microseconds
+	uint64_t hold_until;
+
+	/// Time at which proxy_conn_priv::conn_client was given this slot, in
+	/// seconds
+	uint32_t session_start;
+
+	/// Time at which data was last received from the client, in seconds
+	volatile uint32_t last_active;
+
+	/// Number of threads waiting for space in proxy_conn_priv::queue_client
+	volatile uint32_t space_waiters;
+
+	/// IPv4 address of the remote host to open proxy_conn_priv::conn_tcp to,
+	/// in network byte order
+	uint32_t tcp_addr;
+
+	/// Indicates that the client no longer wants the TCP connection being
+	/// opened or forwarded by proxy_conn_priv::thread_tcp, which is written
+	/// while holding proxy_conn_priv::mutex_sentinel and is also
+	/// conn_handle::connect_cancel for proxy_conn_priv::conn_tcp
+	volatile uint32_t tcp_cancel;
+
+	/// Indicates that proxy_conn_priv::watch_tcp is paused until the writer
+	/// makes room in proxy_conn_priv::queue_client
+	volatile uint32_t tcp_blocked;
+
+	/// TCP_DATA message from the remote host which did not fit in
+	/// proxy_conn_priv::queue_client yet
+	uint8_t tcp_held[CONN_BUFF_LEN];
+
+	/// Number of bytes in proxy_conn_priv::tcp_held, or 0 if it is empty
+	size_t tcp_held_len;
+
+	/// Data from the client which the remote host has not accepted yet,
+	/// protected by proxy_conn_priv::mutex_sentinel
+	uint8_t tcp_pending[TCP_PENDING_LEN];
+
+	/// Number of bytes in proxy_conn_priv::tcp_pending
+	size_t tcp_pending_len;
+
 	/// Thread for handling data sent from the client
 	struct thread_handle thread_client;
 
@@ -226,16 +443,63 @@ struct proxy_conn_priv
 
 	/// Thread for handling data sent to proxy_conn_priv::conn_tcp
 	struct thread_handle thread_tcp;
+
+	/// Thread for writing proxy_conn_priv::queue_client to the client
+	struct thread_handle thread_writer;
+
+	/// Indicates that proxy_conn_priv::thread_writer has stopped writing
+	volatile uint32_t writer_closed;
+
+	/// Indicates that proxy_conn_priv::thread_writer may be waiting for frames
+	volatile uint32_t writer_sleeping;
+
+	/// Termination indicator for proxy_conn_priv::thread_writer
+	volatile uint32_t writer_stop;
+
+	/// Reactor watch for data sent from the client
+	struct reactor_watch watch_client;
+
+	/// Reactor watch for data sent to proxy_conn_priv::conn_control
+	struct reactor_watch watch_control;
+
+	/// Reactor watch for data sent to proxy_conn_priv::conn_data
+	struct reactor_watch watch_data;
+
+	/// Reactor watch for data sent to proxy_conn_priv::conn_tcp
+	struct reactor_watch watch_tcp;
 };
 
 /*!
- * @brief Authorize an incoming client for use of this proxy
+ * @brief Queue messages to be written to the client
+ *
+ * If the queue is full, UDP traffic is discarded, while anything else waits
+ * for space to become available.
  *
  * @param[in,out] pc Target proxy client connection instance
+ * @param[in] buff Messages to write
+ * @param[in] buff_len Number of bytes in buff, at most ::CONN_BUFF_LEN
+ * @param[in] droppable Non-zero if buff holds only UDP traffic
+ * @param[in] stamp Time at which the oldest traffic in buff was received, in
+ *                  microseconds, or 0 to not measure its latency
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int client_authorize(struct proxy_conn_handle *pc);
+static int client_enqueue(struct proxy_conn_handle *pc, const uint8_t *buff, size_t buff_len, int droppable, uint64_t stamp);
+
+/*!
+ * @brief Like ::client_enqueue, but never waits for space in the queue
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] buff Frame to send to the client
+ * @param[in] buff_len Number of bytes in buff
+ * @param[in] droppable Non-zero if the frame may be discarded by the writer
+ * @param[in] stamp Time at which the frame's payload was received, in
+ *            microseconds, or 0 if it should not be timed
+ *
+ * @returns 0 on success, -EAGAIN if the queue is full, other negative ERRNO
+ *          value on failure
+ */
+static int client_try_enqueue(struct proxy_conn_handle *pc, const uint8_t *buff, size_t buff_len, int droppable, uint64_t stamp);
 
 /*!
  * @brief Worker thread for managing the connection to the client
@@ -246,6 +510,102 @@ static int client_authorize(struct proxy_conn_handle *pc);
  */
 static void * client_manager(void *ctx);
 
+/*!
+ * @brief Serve the clients of the slot until it becomes free or stops
+ *
+ * When the slot takes threads from proxy_conn_handle::workers, this is called
+ * once a client has been given to the slot, and it returns once the slot is
+ * back on the free list. Otherwise, it runs for as long as the slot does.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void slot_manage(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Wake whichever thread serves the slot because it was given a client
+ *
+ * If no thread from proxy_conn_handle::workers is serving the slot, one is
+ * requested. The caller must hold proxy_conn_priv::mutex_sentinel.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int slot_wake(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Receive whatever the client has sent and process every complete
+ *        message in it
+ *
+ * This blocks only if no data is available from the client.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int client_recv(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Reset the age and activity of the client session for a new client
+ *
+ * The caller must hold proxy_conn_priv::mutex_sentinel.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void session_begin(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Disconnect the client, which ends its session
+ *
+ * The caller must hold proxy_conn_priv::mutex_sentinel.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void session_end(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Forward the client's data using the reactor until the client leaves
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int client_watch(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Worker thread for writing queued frames to the client
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * client_writer(void *ctx);
+
+/*!
+ * @brief Stop the client writer and discard any frames it did not write
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void client_writer_stop(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Get the maximum number of bytes to send to the client in one message
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns Size of the largest message, at most ::CONN_BUFF_LEN
+ */
+static inline size_t client_message_size(const struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Add forwarded traffic to a counter
+ *
+ * @param[in,out] counter Target counter
+ * @param[in] packets Number of packets or messages forwarded
+ * @param[in] bytes Number of payload bytes forwarded
+ */
+static inline void count_traffic(struct traffic_counter *counter, uint64_t packets, uint64_t bytes);
+
 /*!
  * @brief Worker thread for forwarding control information
  *
@@ -265,7 +625,19 @@ static void * forwarder_control(void *ctx);
 static void * forwarder_data(void *ctx);
 
 /*!
- * @brief Worker thread for forwarding TCP data
+ * @brief Forward control information or UDP data until the connection closes
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] conn One of proxy_conn_priv::conn_control or
+ *                proxy_conn_priv::conn_data
+ * @param[in] type Type of message to forward the datagrams as
+ * @param[in] name Human-readable name of the connection
+ */
+static void forward_udp(struct proxy_conn_handle *pc, struct conn_handle *conn, enum PROXY_MSG_TYPE type, const char *name);
+
+/*!
+ * @brief Worker thread for opening the client's TCP connection, and for
+ *        forwarding its data when there is no reactor
  *
  * @param[in,out] ctx Worker thread context
  *
@@ -273,36 +645,130 @@ static void * forwarder_data(void *ctx);
  */
 static void * forwarder_tcp(void *ctx);
 
+/*!
+ * @brief Prepare datagram descriptors for receiving into message buffers
+ *
+ * Each datagram's payload is placed directly after the space reserved for its
+ * ::proxy_msg header, so that it can be forwarded without being copied.
+ *
+ * @param[in] bufs Message buffers to receive into
+ * @param[out] dgrams Datagram descriptors to prepare
+ */
+static void init_udp_batch(uint8_t bufs[UDP_BATCH_LEN][CONN_BUFF_LEN], struct conn_dgram dgrams[UDP_BATCH_LEN]);
+
+/*!
+ * @brief Send any messages which have been packed to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] pack Packed messages to send
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int pack_flush(struct proxy_conn_handle *pc, struct msg_pack *pack);
+
+/*!
+ * @brief Pack a batch of datagrams prepared by ::init_udp_batch to be
+ *        forwarded to the client
+ *
+ * Messages are sent once the pack is full, or immediately if the configured
+ * coalescing delay is zero. Otherwise, the caller is responsible for calling
+ * ::pack_flush by msg_pack::deadline.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] pack Packed messages waiting to be sent
+ * @param[in] type Type of message to forward the datagrams as
+ * @param[in,out] dgrams Received datagrams to forward
+ * @param[in] count Number of datagrams in dgrams
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int pack_udp_batch(struct proxy_conn_handle *pc, struct msg_pack *pack, enum PROXY_MSG_TYPE type, const struct conn_dgram *dgrams, int count);
+
+/*!
+ * @brief Find the socket addresses of a remote host, preparing them if they
+ *        are not cached
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] addr IPv4 address of the remote host, in network byte order
+ *
+ * @returns Cache entry for the remote host
+ */
+static struct peer_cache_entry * peer_lookup(struct proxy_conn_handle *pc, uint32_t addr);
+
+/*!
+ * @brief Allow UDP traffic from a remote host which the client is sending to
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] addr IPv4 address of the remote host, in network byte order
+ */
+static void peer_filter_add(struct proxy_conn_handle *pc, uint32_t addr);
+
+/*!
+ * @brief Check whether UDP traffic from a remote host should be forwarded to
+ *        the client
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[in] addr IPv4 address of the remote host, in network byte order
+ *
+ * @returns 1 if the traffic should be forwarded, 0 if it should be discarded
+ */
+static int peer_filter_check(const struct proxy_conn_handle *pc, uint32_t addr);
+
+/*!
+ * @brief Start a new client session without any allowed remote hosts
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void peer_filter_reset(struct proxy_conn_handle *pc);
+
 /*!
  * @brief Process an incoming ::PROXY_MSG_TYPE_UDP_CONTROL message from the
  *        client
  *
  * @param[in,out] pc Target proxy client connection instance
- * @param[in] msg Incoming message
+ * @param[in] msg Header of the incoming message
+ * @param[in] data Part of the message body, at most ::CONN_BUFF_LEN bytes
+ * @param[in] data_len Number of bytes in data
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int process_control_data_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
+static int process_control_data_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len);
 
 /*!
  * @brief Process an incoming ::PROXY_MSG_TYPE_UDP_DATA message from the client
  *
  * @param[in,out] pc Target proxy client connection instance
- * @param[in] msg Incoming message
+ * @param[in] msg Header of the incoming message
+ * @param[in] data Part of the message body, at most ::CONN_BUFF_LEN bytes
+ * @param[in] data_len Number of bytes in data
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int process_data_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
+static int process_data_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len);
 
 /*!
  * @brief Process an incoming message from the client
  *
+ * Messages with a body longer than ::CONN_BUFF_LEN are processed in parts,
+ * calling this once for each part.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] msg Header of the incoming message
+ * @param[in] data Part of the message body, at most ::CONN_BUFF_LEN bytes
+ * @param[in] data_len Number of bytes in data
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int process_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len);
+
+/*!
+ * @brief Process every complete message held in proxy_conn_priv::reader
+ *
  * @param[in,out] pc Target proxy client connection instance
- * @param[in] msg Incoming message
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int process_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
+static int process_messages(struct proxy_conn_handle *pc);
 
 /*!
  * @brief Process an incoming ::PROXY_MSG_TYPE_TCP_CLOSE message from the client
@@ -312,17 +778,19 @@ static int process_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int process_tcp_close_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
+static int process_tcp_close_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg);
 
 /*!
  * @brief Process an incoming ::PROXY_MSG_TYPE_TCP_DATA message from the client
  *
  * @param[in,out] pc Target proxy client connection instance
- * @param[in] msg Incoming message
+ * @param[in] msg Header of the incoming message
+ * @param[in] data Part of the message body, at most ::CONN_BUFF_LEN bytes
+ * @param[in] data_len Number of bytes in data
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int process_tcp_data_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
+static int process_tcp_data_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len);
 
 /*!
  * @brief Process an incoming ::PROXY_MSG_TYPE_TCP_OPEN message from the client
@@ -332,107 +800,222 @@ static int process_tcp_data_message(struct proxy_conn_handle *pc, struct proxy_m
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int process_tcp_open_message(struct proxy_conn_handle *pc, struct proxy_msg *msg);
+static int process_tcp_open_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg);
 
 /*!
- * @brief Send a ::PROXY_MSG_TYPE_SYSTEM message to the client
+ * @brief Send a ::PROXY_MSG_TYPE_TCP_CLOSE message to the client
  *
  * @param[in,out] pc Target proxy client connection instance
- * @param[in] msg ::SYSTEM_MSG value
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int send_system(struct proxy_conn_handle *pc, enum SYSTEM_MSG msg);
+static int send_tcp_close(struct proxy_conn_handle *pc);
 
 /*!
- * @brief Send a ::PROXY_MSG_TYPE_TCP_CLOSE message to the client
+ * @brief Send a ::PROXY_MSG_TYPE_TCP_STATUS message to the client
  *
  * @param[in,out] pc Target proxy client connection instance
+ * @param[in] status Outcome of opening the connection, 0 for success
  *
  * @returns 0 on success, negative ERRNO value on failure
  */
-static int send_tcp_close(struct proxy_conn_handle *pc);
+static int send_tcp_status(struct proxy_conn_handle *pc, int status);
 
-static int client_authorize(struct proxy_conn_handle *pc)
-{
-	uint8_t buff[28];
-	size_t idx, j;
-	uint32_t nonce;
-	char nonce_str[9];
-	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	uint8_t response[PROXY_PASS_RES_LEN];
-	int ret;
+/*!
+ * @brief Open proxy_conn_priv::conn_tcp to proxy_conn_priv::tcp_addr
+ *
+ * Each attempt is limited to proxy_conf::tcp_connect_timeout, and failed
+ * attempts are retried proxy_conf::tcp_retry_count times. The outcome is
+ * reported to the client, unless the client canceled the connection first.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int tcp_open(struct proxy_conn_handle *pc);
 
-	ret = get_nonce(&nonce);
-	if (ret < 0)
-	{
-		return ret;
-	}
+/*!
+ * @brief Apply the configured socket options to one of the client's
+ *        connections to remote hosts
+ *
+ * Failures are logged but are otherwise ignored, since the connection still
+ * works without the options.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] conn Connection to apply the options to
+ * @param[in] rcvbuf Size of the socket receive buffer, or 0 for the default
+ * @param[in] sndbuf Size of the socket send buffer, or 0 for the default
+ * @param[in] dscp Differentiated services code point, or 0 for none
+ */
+static void set_sockopts(struct proxy_conn_handle *pc, struct conn_handle *conn, uint32_t rcvbuf, uint32_t sndbuf, uint8_t dscp);
 
-	digest_to_hex32(nonce, nonce_str);
+/*!
+ * @brief Cancel or close the client's TCP connection and wait for
+ *        proxy_conn_priv::thread_tcp to return
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 1 if proxy_conn_priv::watch_tcp was detached, 0 otherwise
+ */
+static int tcp_stop(struct proxy_conn_handle *pc);
 
-	// Generate the expected auth response
-	ret = get_password_response(nonce, pc->ph->conf.password, response);
-	if (ret < 0)
-	{
-		return ret;
-	}
+/*!
+ * @brief Send data from the client to the remote host without blocking
+ *
+ * Whatever the remote host does not accept right away is kept in
+ * proxy_conn_priv::tcp_pending for ::tcp_flush to send.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] data Data to send
+ * @param[in] data_len Number of bytes in data
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int tcp_send(struct proxy_conn_handle *pc, const uint8_t *data, size_t data_len);
 
-	// Send the nonce
-	ret = conn_send(priv->conn_client, (uint8_t *)nonce_str, 8);
-	if (ret < 0)
-	{
-		return ret;
-	}
+/*!
+ * @brief Send proxy_conn_priv::tcp_pending to the remote host as it accepts
+ *        it, until the TCP connection is stopped
+ *
+ * If sending fails, the connection is shut down so that
+ * proxy_conn_priv::watch_tcp reports it to the client.
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void tcp_flush(struct proxy_conn_handle *pc);
 
-	// We can expect to receive a newline-terminated callsign and a 16-byte
-	// password response.
-	// Since this is variable-length, initially look only for 16 bytes. The
-	// callsign will be part of that, and we can figure out how much we're
-	// missing.
-	ret = conn_recv(priv->conn_client, buff, 16);
-	if (ret < 0)
-	{
-		return ret;
-	}
+/*!
+ * @brief Records a message forwarded for the client in the slot's trace ring
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] stamp Time at which the message was received, in microseconds
+ * @param[in] dir Direction the message was forwarded in
+ * @param[in] type Type of the message
+ * @param[in] flags Bitwise OR of TRACE_FLAG_* values
+ * @param[in] addr IPv4 address of the remote host, in network byte order
+ * @param[in] data Payload of the message
+ * @param[in] len Number of bytes in data
+ */
+static inline void trace_msg(struct proxy_conn_handle *pc, uint64_t stamp, enum TRACE_DIR dir, enum PROXY_MSG_TYPE type, uint8_t flags, uint32_t addr, const uint8_t *data, size_t len);
 
-	for (idx = 0; idx < 11 && buff[idx] != '\n'; idx++);
 
-	if (idx >= 11)
-	{
-		return -EINVAL;
-	}
+/*!
+ * @brief Reactor callback for processing a message from the client
+ *
+ * @param[in,out] watch Reactor watch for the client connection
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int watch_client(struct reactor_watch *watch);
+
+/*!
+ * @brief Reactor callback for signaling the end of the client session
+ *
+ * @param[in,out] watch Reactor watch for the client connection
+ */
+static void watch_client_detach(struct reactor_watch *watch);
+
+/*!
+ * @brief Reactor callback for forwarding TCP data
+ *
+ * @param[in,out] watch Reactor watch for proxy_conn_priv::conn_tcp
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int watch_tcp(struct reactor_watch *watch);
 
-	// Make the callsign null-terminated
-	buff[idx] = '\0';
-	strcpy(priv->callsign, (char *)buff);
+/*!
+ * @brief Reactor callback for closing the TCP connection once it has ended
+ *
+ * @param[in,out] watch Reactor watch for proxy_conn_priv::conn_tcp
+ */
+static void watch_tcp_detach(struct reactor_watch *watch);
 
-	ret = conn_recv(priv->conn_client, &buff[16], idx + 1);
-	if (ret < 0)
-	{
-		return ret;
-	}
+/*!
+ * @brief Reactor callback for forwarding control information or UDP data
+ *
+ * @param[in,out] watch Reactor watch for proxy_conn_priv::conn_control or
+ *                proxy_conn_priv::conn_data
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int watch_udp(struct reactor_watch *watch);
+
+static int client_enqueue(struct proxy_conn_handle *pc, const uint8_t *buff, size_t buff_len, int droppable, uint64_t stamp)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret;
 
-	for (idx += 1, j = 0; j < PROXY_PASS_RES_LEN; idx++, j++)
+	while (1)
 	{
-		if (response[j] != buff[idx])
+		ret = client_try_enqueue(pc, buff, buff_len, droppable, stamp);
+		if (ret != -EAGAIN)
+		{
+			return ret;
+		}
+
+		// UDP traffic is useless once it is late, so rather than holding up
+		// the forwarder, discard it
+		if (droppable)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_INFO, "Client '%s' supplied an incorrect password. Dropping...\n", priv->callsign);
+			atomic_u32_add(&priv->frames_dropped, 1);
+
+			return 0;
+		}
 
-			ret = send_system(pc, SYSTEM_MSG_BAD_PASSWORD);
+		mutex_lock(&priv->mutex_writer);
 
-			return ret < 0 ? ret : -EACCES;
+		atomic_u32_add(&priv->space_waiters, 1);
+		atomic_fence();
+
+		if (queue_count(&priv->queue_client) >= CLIENT_QUEUE_LEN && !atomic_u32_load(&priv->writer_closed))
+		{
+			condvar_wait_time(&priv->condvar_space, &priv->mutex_writer, 100);
 		}
+
+		atomic_u32_add(&priv->space_waiters, (uint32_t)-1);
+
+		mutex_unlock(&priv->mutex_writer);
+	}
+}
+
+static int client_try_enqueue(struct proxy_conn_handle *pc, const uint8_t *buff, size_t buff_len, int droppable, uint64_t stamp)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct out_frame *frame;
+
+	if (buff_len > CONN_BUFF_LEN)
+	{
+		return -EMSGSIZE;
+	}
+
+	if (atomic_u32_load(&priv->writer_closed))
+	{
+		return -EPIPE;
 	}
 
-	ret = proxy_authorize_callsign(pc->ph, priv->callsign);
-	if (ret != 1)
+	frame = queue_reserve(&priv->queue_client);
+	if (frame == NULL)
 	{
-		proxy_log(pc->ph, LOG_LEVEL_INFO, "Client '%s' is not authorized to use this proxy. Dropping...\n", priv->callsign);
+		return -EAGAIN;
+	}
+
+	memcpy(frame->buff, buff, buff_len);
+	frame->len = (uint32_t)buff_len;
+	frame->droppable = droppable != 0;
+	frame->stamp = stamp;
 
-		ret = send_system(pc, SYSTEM_MSG_ACCESS_DENIED);
+	queue_commit(&priv->queue_client, frame);
 
-		return ret < 0 ? ret : -EACCES;
+	// Pairs with the fence in client_writer, so that either the writer sees
+	// the new frame or this sees that the writer needs to be woken
+	atomic_fence();
+
+	if (atomic_u32_load(&priv->writer_sleeping))
+	{
+		mutex_lock(&priv->mutex_writer);
+		condvar_wake_one(&priv->condvar_writer);
+		mutex_unlock(&priv->mutex_writer);
 	}
 
 	return 0;
@@ -442,33 +1025,87 @@ static void * client_manager(void *ctx)
 {
 	struct thread_handle *th = (struct thread_handle *)ctx;
 	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
+
+	PROXY_CONN_DEBUG(pc, "Proxy connection is ready on interface '%s'\n", pc->source_addr == NULL ? "0.0.0.0" : pc->source_addr);
+
+	slot_manage(pc);
+
+	PROXY_CONN_DEBUG(pc, "Client manager thread is returning cleanly.\n");
+
+	return NULL;
+}
+
+static void slot_manage(struct proxy_conn_handle *pc)
+{
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	uint8_t handed_off;
+	uint8_t resume = pc->workers != NULL;
+	uint64_t now;
 	int ret;
-	uint8_t buff[CONN_BUFF_LEN];
-	char remote_addr[40];
-
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Proxy connection is ready on interface '%s'\n", pc->source_addr == NULL ? "0.0.0.0" : pc->source_addr);
 
 	while (1)
 	{
 		mutex_lock(&priv->mutex_sentinel);
 
-		if (priv->conn_client != NULL)
+		// A pooled thread only comes to the slot once it has a client
+		if (!resume)
 		{
-			conn_close(priv->conn_client);
-			conn_free(priv->conn_client);
-			free(priv->conn_client);
-			priv->conn_client = NULL;
-		}
+			if (priv->conn_client != NULL)
+			{
+				conn_close(priv->conn_client);
+				conn_pool_put(pc->conn_pool, priv->conn_client);
+				priv->conn_client = NULL;
+			}
 
-		if (priv->sentinel != 0)
-		{
-			mutex_unlock(&priv->mutex_sentinel);
+			if (priv->sentinel != 0)
+			{
+				mutex_unlock(&priv->mutex_sentinel);
 
-			break;
+				break;
+			}
+
+			if (priv->held_callsign[0] != '\0')
+			{
+				// Wait for the client the slot is being held for to come back
+				now = clock_now_us();
+				if (now >= priv->hold_until)
+				{
+					PROXY_CONN_DEBUG(pc, "No longer holding slot for client '%s'\n", priv->held_callsign);
+
+					priv->held_callsign[0] = '\0';
+					hold_map_del(pc->held_slots, pc->slot);
+
+					mutex_unlock(&priv->mutex_sentinel);
+
+					continue;
+				}
+
+				condvar_wait_time(&priv->condvar_client, &priv->mutex_sentinel, (uint32_t)((priv->hold_until - now + 999) / 1000));
+			}
+			else
+			{
+				// Advertise that this slot can accept a client
+				if (!priv->slot_listed && !priv->retiring)
+				{
+					priv->slot_listed = 1;
+					freelist_push(pc->free_slots, pc->slot);
+				}
+
+				// The pooled thread is done until the next client arrives
+				if (pc->workers != NULL)
+				{
+					priv->bound = 0;
+
+					mutex_unlock(&priv->mutex_sentinel);
+
+					return;
+				}
+
+				condvar_wait(&priv->condvar_client, &priv->mutex_sentinel);
+			}
 		}
 
-		condvar_wait(&priv->condvar_client, &priv->mutex_sentinel);
+		resume = 0;
 
 		if (priv->sentinel != 0)
 		{
@@ -478,37 +1115,24 @@ static void * client_manager(void *ctx)
 		}
 		else if (priv->conn_client == NULL)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_ERROR, "New connection was signaled, but no connection was given\n");
+			if (priv->held_callsign[0] == '\0')
+			{
+				proxy_log(pc->ph, LOG_LEVEL_ERROR, "New connection was signaled, but no connection was given\n");
+			}
 
 			mutex_unlock(&priv->mutex_sentinel);
 
 			continue;
 		}
 
-		mutex_unlock(&priv->mutex_sentinel);
-
-		conn_get_remote_addr(priv->conn_client, remote_addr);
+		handed_off = priv->handed_off;
+		priv->handed_off = 0;
 
-		proxy_log(pc->ph, LOG_LEVEL_DEBUG, "New connection - beginning authorization procedure\n");
+		mutex_unlock(&priv->mutex_sentinel);
 
-		ret = client_authorize(pc);
-		if (ret < 0)
+		if (handed_off)
 		{
-			switch (ret)
-			{
-			case -ECONNRESET:
-			case -EINTR:
-			case -ENOTCONN:
-			case -EPIPE:
-				proxy_log(pc->ph, LOG_LEVEL_WARN, "Connection to client was lost before authorization could complete\n");
-				break;
-			default:
-				proxy_log(pc->ph, LOG_LEVEL_ERROR, "Authorization failed for client '%s' (%d): %s\n", remote_addr, -ret, strerror(-ret));
-			}
-
-			conn_drop(priv->conn_client);
-
-			continue;
+			PROXY_CONN_DEBUG(pc, "Client '%s' has returned to the slot held for it\n", priv->callsign);
 		}
 
 		ret = conn_listen(&priv->conn_control);
@@ -533,10 +1157,15 @@ static void * client_manager(void *ctx)
 			continue;
 		}
 
-		ret = thread_start(&priv->thread_control);
+		set_sockopts(pc, &priv->conn_control, pc->ph->conf.udp_rcvbuf, pc->ph->conf.udp_sndbuf, 0);
+		set_sockopts(pc, &priv->conn_data, pc->ph->conf.udp_rcvbuf, pc->ph->conf.udp_sndbuf, pc->ph->conf.voice_dscp);
+
+		peer_filter_reset(pc);
+
+		ret = thread_start(&priv->thread_writer);
 		if (ret < 0)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to start UDP control forwarder. Dropping...\n");
+			proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to start client writer. Dropping...\n");
 
 			conn_close(&priv->conn_control);
 			conn_close(&priv->conn_data);
@@ -546,47 +1175,63 @@ static void * client_manager(void *ctx)
 			continue;
 		}
 
-		ret = thread_start(&priv->thread_data);
-		if (ret < 0)
+		if (pc->reactor == NULL)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to start UDP data forwarder. Dropping...\n");
+			ret = thread_start(&priv->thread_control);
+			if (ret < 0)
+			{
+				proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to start UDP control forwarder. Dropping...\n");
 
-			conn_close(&priv->conn_control);
-			conn_close(&priv->conn_data);
+				conn_close(&priv->conn_control);
+				conn_close(&priv->conn_data);
 
-			thread_join(&priv->thread_control);
+				conn_drop(priv->conn_client);
 
-			conn_drop(priv->conn_client);
+				client_writer_stop(pc);
 
-			continue;
+				continue;
+			}
+
+			ret = thread_start(&priv->thread_data);
+			if (ret < 0)
+			{
+				proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to start UDP data forwarder. Dropping...\n");
+
+				conn_close(&priv->conn_control);
+				conn_close(&priv->conn_data);
+
+				thread_join(&priv->thread_control);
+
+				conn_drop(priv->conn_client);
+
+				client_writer_stop(pc);
+
+				continue;
+			}
 		}
 
+		priv->reader.off = 0;
+		priv->reader.len = 0;
+		priv->reader.in_msg = 0;
+
 		proxy_log(pc->ph, LOG_LEVEL_INFO, "Connected to client '%s', using external interface '%s'.\n", priv->callsign, pc->source_addr == NULL ? "0.0.0.0" : pc->source_addr);
 
+		atomic_u32_add(pc->slots_used, 1);
 		proxy_update_registration(pc->ph);
 
-		// DO STUFF
-		while (1)
+		if (pc->reactor != NULL)
 		{
-			ret = conn_recv(priv->conn_client, buff, sizeof(struct proxy_msg));
+			ret = client_watch(pc);
 			if (ret < 0)
 			{
-				switch (ret)
-				{
-				case -ECONNRESET:
-				case -EINTR:
-				case -ENOTCONN:
-				case -EPIPE:
-					break;
-				default:
-					proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to receive data from client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
-					break;
-				}
-
-				break;
+				proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to begin forwarding data for client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
 			}
+		}
 
-			ret = process_message(pc, (struct proxy_msg *)buff);
+		// DO STUFF
+		while (pc->reactor == NULL)
+		{
+			ret = client_recv(pc);
 			if (ret < 0)
 			{
 				break;
@@ -595,16 +1240,39 @@ static void * client_manager(void *ctx)
 
 		proxy_log(pc->ph, LOG_LEVEL_INFO, "Disconnected from client '%s'.\n", priv->callsign);
 
+		if (pc->reactor != NULL)
+		{
+			// The client watch must go first, since processing a message
+			// from the client can start opening a new TCP connection
+			reactor_del(pc->reactor, &priv->watch_client);
+			reactor_del(pc->reactor, &priv->watch_control);
+			reactor_del(pc->reactor, &priv->watch_data);
+		}
+
+		tcp_stop(pc);
+
 		conn_close(&priv->conn_control);
 		conn_close(&priv->conn_data);
-		conn_close(&priv->conn_tcp);
 
 		thread_join(&priv->thread_data);
 		thread_join(&priv->thread_control);
-		thread_join(&priv->thread_tcp);
 
 		conn_drop(priv->conn_client);
 
+		client_writer_stop(pc);
+
+		if (pc->ph->conf.slot_hold_time > 0)
+		{
+			mutex_lock(&priv->mutex_sentinel);
+
+			strcpy(priv->held_callsign, priv->callsign);
+			priv->hold_until = clock_now_us() + pc->ph->conf.slot_hold_time * (uint64_t)1000000;
+			hold_map_put(pc->held_slots, pc->slot, priv->held_callsign);
+
+			mutex_unlock(&priv->mutex_sentinel);
+		}
+
+		atomic_u32_add(pc->slots_used, (uint32_t)-1);
 		proxy_update_registration(pc->ph);
 	}
 
@@ -613,77 +1281,447 @@ static void * client_manager(void *ctx)
 	if (priv->conn_client != NULL)
 	{
 		conn_close(priv->conn_client);
-		conn_free(priv->conn_client);
-		free(priv->conn_client);
+		conn_pool_put(pc->conn_pool, priv->conn_client);
 		priv->conn_client = NULL;
 	}
 
-	mutex_unlock(&priv->mutex_sentinel);
-
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client manager thread is returning cleanly.\n");
+	// Let proxy_conn_stop know that the slot is no longer being served
+	priv->bound = 0;
+	condvar_wake_all(&priv->condvar_client);
 
-	return NULL;
+	mutex_unlock(&priv->mutex_sentinel);
 }
 
-static void * forwarder_control(void *ctx)
+static int slot_wake(struct proxy_conn_handle *pc)
 {
-	struct thread_handle *th = (struct thread_handle *)ctx;
-	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-
-	uint32_t addr;
-	uint8_t buf[CONN_BUFF_LEN] = { 0x0 };
-	struct proxy_msg *msg = (struct proxy_msg *)buf;
 	int ret;
 
-	msg->type = PROXY_MSG_TYPE_UDP_CONTROL;
+	if (pc->workers == NULL || priv->bound)
+	{
+		condvar_wake_one(&priv->condvar_client);
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "UDP Control forwarding thread is starting for client '%s'\n", priv->callsign);
+		return 0;
+	}
 
-	do
+	// The thread can't look at the slot until the caller unlocks it
+	ret = worker_pool_submit(pc->workers, pc);
+	if (ret < 0)
 	{
-		ret = conn_recv_any(&priv->conn_control, msg->data, CONN_BUFF_LEN_HEADERLESS, &addr, NULL);
-		if (ret > 0)
-		{
-			msg->address = addr;
-			msg->size = ret;
-
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending UDP_DATA message to client '%s' (%d bytes)\n", priv->callsign, msg->size);
+		return ret;
+	}
 
-			mutex_lock(&priv->mutex_client_send);
+	priv->bound = 1;
 
-			ret = conn_send(priv->conn_client, (uint8_t *)msg, sizeof(struct proxy_msg) + msg->size);
+	return 0;
+}
 
-			mutex_unlock(&priv->mutex_client_send);
 
-			// This is an error with the client connection
-			if (ret < 0)
-			{
-				conn_close(&priv->conn_control);
+static void session_begin(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
 
-				proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client '%s' UDP Control thread is returning due to a client connection error (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+	priv->session_start = (uint32_t)(clock_now_us() / 1000000);
+	atomic_u32_store(&priv->last_active, priv->session_start);
+}
 
-				switch (ret)
-				{
-				case -ECONNRESET:
-				case -EINTR:
-				case -ENOTCONN:
-				case -EPIPE:
-					break;
-				default:
-					proxy_conn_drop(pc);
-					break;
-				}
+static void session_end(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
 
-				return NULL;
+	if (priv->conn_client != NULL)
+	{
+		// When the client connection is watched by the reactor, it must
+		// remain open until the watch is detached. Shutting it down wakes
+		// the watch, which ends the client session.
+		if (pc->reactor != NULL)
+		{
+			conn_shutdown(priv->conn_client);
+		}
+		else
+		{
+			conn_drop(priv->conn_client);
+		}
+	}
+}
+
+static int client_recv(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct msg_reader *reader = &priv->reader;
+	int ret;
+
+	// Whatever is left over is the start of an incomplete message, and there
+	// must be room after it for the rest of that message
+	if (reader->off > 0)
+	{
+		memmove(reader->buff, &reader->buff[reader->off], reader->len);
+		reader->off = 0;
+	}
+
+	ret = conn_recv_some(priv->conn_client, &reader->buff[reader->len], CLIENT_RX_LEN - reader->len);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case -ECONNRESET:
+		case -EINTR:
+		case -ENOTCONN:
+		case -EPIPE:
+			break;
+		default:
+			proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to receive data from client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+			break;
+		}
+
+		return ret;
+	}
+
+	reader->len += ret;
+	reader->stamp = clock_now_us();
+	atomic_u32_store(&priv->last_active, (uint32_t)(reader->stamp / 1000000));
+
+	return process_messages(pc);
+}
+
+static int client_watch(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret;
+
+	// The reactor threads must never block waiting for a datagram
+	ret = conn_set_nonblocking(&priv->conn_control, 1);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = conn_set_nonblocking(&priv->conn_data, 1);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	mutex_lock(&priv->mutex_sentinel);
+	priv->session_done = 0;
+	mutex_unlock(&priv->mutex_sentinel);
+
+	priv->watch_client.conn = priv->conn_client;
+
+	ret = reactor_add(pc->reactor, &priv->watch_control);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = reactor_add(pc->reactor, &priv->watch_data);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = reactor_add(pc->reactor, &priv->watch_client);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	mutex_lock(&priv->mutex_sentinel);
+
+	while (priv->session_done == 0 && priv->sentinel == 0)
+	{
+		condvar_wait(&priv->condvar_client, &priv->mutex_sentinel);
+	}
+
+	mutex_unlock(&priv->mutex_sentinel);
+
+	return 0;
+}
+
+static void * client_writer(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	const int drop_oldest = pc->ph->conf.drop_policy == DROP_POLICY_OLDEST;
+	struct conn_iov iov[CONN_IOV_MAX];
+	uint64_t stamps[CONN_IOV_MAX];
+	struct out_frame *frame;
+	uint64_t now;
+	unsigned int num_iov;
+	unsigned int num;
+	size_t backlog;
+	int ret = 0;
+
+	PROXY_CONN_DEBUG(pc, "Client writer thread is starting for client '%s'\n", priv->callsign);
+
+	while (1)
+	{
+		frame = queue_peek(&priv->queue_client);
+		if (frame == NULL)
+		{
+			if (atomic_u32_load(&priv->writer_stop))
+			{
+				break;
+			}
+
+			mutex_lock(&priv->mutex_writer);
+
+			atomic_u32_store(&priv->writer_sleeping, 1);
+			atomic_fence();
+
+			if (queue_peek(&priv->queue_client) == NULL && !atomic_u32_load(&priv->writer_stop))
+			{
+				condvar_wait(&priv->condvar_writer, &priv->mutex_writer);
+			}
+
+			atomic_u32_store(&priv->writer_sleeping, 0);
+
+			mutex_unlock(&priv->mutex_writer);
+
+			continue;
+		}
+
+		// Gather whatever else is waiting so that it all goes out together
+		backlog = queue_count(&priv->queue_client);
+		num_iov = 0;
+
+		for (num = 0; num < CONN_IOV_MAX && frame != NULL; num++)
+		{
+			// When the client has fallen behind, discard the stale UDP
+			// traffic at the front of the queue in favor of what arrived
+			// more recently
+			if (drop_oldest && frame->droppable && backlog > num + CLIENT_QUEUE_TRIM)
+			{
+				atomic_u32_add(&priv->frames_dropped, 1);
+			}
+			else
+			{
+				iov[num_iov].buff = frame->buff;
+				iov[num_iov].len = frame->len;
+				stamps[num_iov] = frame->stamp;
+				num_iov++;
+			}
+
+			frame = queue_peek_at(&priv->queue_client, num + 1);
+		}
+
+		ret = num_iov > 0 ? conn_sendv(priv->conn_client, iov, num_iov) : 0;
+		if (ret < 0)
+		{
+			atomic_u64_add(&priv->send_failures, 1);
+		}
+		else if (num_iov > 0)
+		{
+			now = clock_now_us();
+
+			while (num_iov-- > 0)
+			{
+				if (stamps[num_iov] != 0)
+				{
+					histogram_record(&priv->latency_in, now - stamps[num_iov]);
+				}
+			}
+		}
+
+		while (num-- > 0)
+		{
+			queue_release(&priv->queue_client, queue_peek(&priv->queue_client));
+		}
+
+		atomic_fence();
+
+		if (atomic_u32_load(&priv->space_waiters) > 0)
+		{
+			mutex_lock(&priv->mutex_writer);
+			condvar_wake_all(&priv->condvar_space);
+			mutex_unlock(&priv->mutex_writer);
+		}
+
+		if (atomic_u32_load(&priv->tcp_blocked))
+		{
+			atomic_u32_store(&priv->tcp_blocked, 0);
+			reactor_resume(pc->reactor, &priv->watch_tcp);
+		}
+
+		if (ret < 0)
+		{
+			break;
+		}
+	}
+
+	mutex_lock(&priv->mutex_writer);
+	atomic_u32_store(&priv->writer_closed, 1);
+	condvar_wake_all(&priv->condvar_space);
+	mutex_unlock(&priv->mutex_writer);
+
+	// Let a paused TCP watch find out that the client is gone
+	atomic_fence();
+
+	if (atomic_u32_load(&priv->tcp_blocked))
+	{
+		atomic_u32_store(&priv->tcp_blocked, 0);
+		reactor_resume(pc->reactor, &priv->watch_tcp);
+	}
+
+	if (ret < 0)
+	{
+		PROXY_CONN_DEBUG(pc, "Client '%s' writer thread is returning due to a client connection error (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+
+		switch (ret)
+		{
+		case -ECONNRESET:
+		case -EINTR:
+		case -ENOTCONN:
+		case -EPIPE:
+			break;
+		default:
+			proxy_conn_drop(pc);
+			break;
+		}
+	}
+	else
+	{
+		PROXY_CONN_DEBUG(pc, "Client '%s' writer thread is returning cleanly\n", priv->callsign);
+	}
+
+	return NULL;
+}
+
+static void client_writer_stop(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct out_frame *frame;
+	uint32_t dropped;
+
+	mutex_lock(&priv->mutex_writer);
+	atomic_u32_store(&priv->writer_stop, 1);
+	condvar_wake_all(&priv->condvar_writer);
+	mutex_unlock(&priv->mutex_writer);
+
+	thread_join(&priv->thread_writer);
+
+	// With the writer gone, this thread is now the queue's consumer
+	while ((frame = queue_peek(&priv->queue_client)) != NULL)
+	{
+		queue_release(&priv->queue_client, frame);
+	}
+
+	dropped = atomic_u32_load(&priv->frames_dropped);
+	if (dropped > 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_INFO, "Discarded %u UDP frames because client '%s' fell behind\n", dropped, priv->callsign);
+
+		atomic_u64_add(&priv->frames_dropped_total, dropped);
+	}
+
+	atomic_u32_store(&priv->frames_dropped, 0);
+	atomic_u32_store(&priv->writer_closed, 0);
+	atomic_u32_store(&priv->writer_stop, 0);
+}
+
+static inline size_t client_message_size(const struct proxy_conn_handle *pc)
+{
+	const uint16_t size = pc->ph->conf.client_message_size;
+
+	return size == 0 || size > CONN_BUFF_LEN ? CONN_BUFF_LEN : size;
+}
+
+static inline void count_traffic(struct traffic_counter *counter, uint64_t packets, uint64_t bytes)
+{
+	atomic_u64_add(&counter->packets, packets);
+	atomic_u64_add(&counter->bytes, bytes);
+}
+
+static void * forwarder_control(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	forward_udp(pc, &priv->conn_control, PROXY_MSG_TYPE_UDP_CONTROL, "UDP Control");
+
+	return NULL;
+}
+
+static void * forwarder_data(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	forward_udp(pc, &priv->conn_data, PROXY_MSG_TYPE_UDP_DATA, "UDP Data");
+
+	return NULL;
+}
+
+static void forward_udp(struct proxy_conn_handle *pc, struct conn_handle *conn, enum PROXY_MSG_TYPE type, const char *name)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	uint8_t bufs[UDP_BATCH_LEN][CONN_BUFF_LEN];
+	struct conn_dgram dgrams[UDP_BATCH_LEN];
+	struct msg_pack pack;
+	uint64_t now;
+	int ret;
+
+	init_udp_batch(bufs, dgrams);
+	pack.len = 0;
+
+	PROXY_CONN_DEBUG(pc, "%s forwarding thread is starting for client '%s'\n", name, priv->callsign);
+
+	while (1)
+	{
+		ret = 1;
+
+		// Wait for more datagrams only until the packed messages are due
+		if (pack.len > 0)
+		{
+			now = clock_now_us();
+			ret = now < pack.deadline ? conn_poll(conn, (uint32_t)(pack.deadline - now)) : 0;
+		}
+
+		if (ret > 0)
+		{
+			ret = conn_recv_any_batch(conn, dgrams, UDP_BATCH_LEN);
+			if (ret < 0)
+			{
+				break;
 			}
+
+			ret = pack_udp_batch(pc, &pack, type, dgrams, ret);
 		}
 		else if (ret == 0)
 		{
-			ret = -EPIPE;
+			ret = pack_flush(pc, &pack);
+		}
+		else
+		{
+			break;
+		}
+
+		// This is an error with the client connection
+		if (ret < 0)
+		{
+			conn_close(conn);
+
+			PROXY_CONN_DEBUG(pc, "Client '%s' %s thread is returning due to a client connection error (%d): %s\n", priv->callsign, name, -ret, strerror(-ret));
+
+			switch (ret)
+			{
+			case -ECONNRESET:
+			case -EINTR:
+			case -ENOTCONN:
+			case -EPIPE:
+				break;
+			default:
+				proxy_conn_drop(pc);
+				break;
+			}
+
+			return;
 		}
 	}
-	while (ret >= 0);
 
 	switch (ret)
 	{
@@ -693,431 +1731,1108 @@ static void * forwarder_control(void *ctx)
 	case -EPIPE:
 		break;
 	default:
-		proxy_log(pc->ph, LOG_LEVEL_INFO, "Failed to receive data on client '%s' UDP Control connection (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+		proxy_log(pc->ph, LOG_LEVEL_INFO, "Failed to receive data on client '%s' %s connection (%d): %s\n", priv->callsign, name, -ret, strerror(-ret));
 		// Since the UDP ports must be open while the client is connected,
 		// we should shut down the client if we don't exit cleanly
 		proxy_conn_drop(pc);
 		break;
 	}
 
-	conn_close(&priv->conn_control);
-
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client '%s' UDP Control thread is returning cleanly\n", priv->callsign);
+	conn_close(conn);
 
-	return NULL;
+	PROXY_CONN_DEBUG(pc, "Client '%s' %s thread is returning cleanly\n", priv->callsign, name);
 }
 
-static void * forwarder_data(void *ctx)
+static void * forwarder_tcp(void *ctx)
 {
 	struct thread_handle *th = (struct thread_handle *)ctx;
 	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
 
-	uint32_t addr;
 	uint8_t buf[CONN_BUFF_LEN] = { 0x0 };
 	struct proxy_msg *msg = (struct proxy_msg *)buf;
 	int ret;
 
-	msg->type = PROXY_MSG_TYPE_UDP_DATA;
+	msg->type = PROXY_MSG_TYPE_TCP_DATA;
+
+	if (tcp_open(pc) < 0)
+	{
+		return NULL;
+	}
+
+	if (pc->reactor != NULL)
+	{
+		priv->tcp_held_len = 0;
+		atomic_u32_store(&priv->tcp_blocked, 0);
+
+		// Hand the connection to the reactor, unless the client has already
+		// moved on, in which case nobody would detach the watch again
+		mutex_lock(&priv->mutex_sentinel);
+
+		ret = priv->tcp_cancel ? -ECANCELED : reactor_add(pc->reactor, &priv->watch_tcp);
+
+		mutex_unlock(&priv->mutex_sentinel);
+
+		if (ret < 0)
+		{
+			conn_close(&priv->conn_tcp);
+
+			send_tcp_close(pc);
+
+			return NULL;
+		}
+
+		// The reactor forwards what the remote host sends, while this thread
+		// stays behind to send what the remote host could not take right away
+		tcp_flush(pc);
+
+		return NULL;
+	}
+
+	PROXY_CONN_DEBUG(pc, "TCP forwarding thread is starting for client '%s'\n", priv->callsign);
+
+	do
+	{
+		ret = conn_recv_any(&priv->conn_tcp, msg->data, client_message_size(pc) - sizeof(struct proxy_msg), NULL, NULL);
+		if (ret > 0)
+		{
+			msg->size = ret;
+
+			count_traffic(&priv->tcp_in, 1, msg->size);
+
+			PROXY_CONN_DEBUG(pc, "Sending TCP_DATA message to client '%s' (%d bytes)\n", priv->callsign, msg->size);
+
+			ret = client_enqueue(pc, (uint8_t *)msg, sizeof(struct proxy_msg) + msg->size, 0, 0);
+
+			trace_msg(pc, clock_now_us(), TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_TCP_DATA, ret < 0 ? TRACE_FLAG_FAILED : 0, priv->tcp_addr, msg->data, msg->size);
+
+			// This is an error with the client connection
+			if (ret < 0)
+			{
+				conn_close(&priv->conn_tcp);
+
+				PROXY_CONN_DEBUG(pc, "Client '%s' TCP thread is returning due to a client connection error (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+
+				switch (ret)
+				{
+				case -ECONNRESET:
+				case -EINTR:
+				case -ENOTCONN:
+				case -EPIPE:
+					break;
+				default:
+					proxy_conn_drop(pc);
+					break;
+				}
+
+				return NULL;
+			}
+		}
+		else if (ret == 0)
+		{
+			ret = -EPIPE;
+		}
+	}
+	while (ret >= 0);
+
+	switch (ret)
+	{
+	case -ECONNRESET:
+	case -EINTR:
+	case -ENOTCONN:
+	case -EPIPE:
+		break;
+	default:
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to receive data on client '%s' TCP connection (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+		break;
+	}
+
+	conn_close(&priv->conn_tcp);
+
+	send_tcp_close(pc);
+
+	PROXY_CONN_DEBUG(pc, "Client '%s' TCP thread is returning cleanly\n", priv->callsign);
+
+	return NULL;
+}
+
+static void init_udp_batch(uint8_t bufs[UDP_BATCH_LEN][CONN_BUFF_LEN], struct conn_dgram dgrams[UDP_BATCH_LEN])
+{
+	int i;
+
+	// Leave room in front of each datagram for the message header
+	for (i = 0; i < UDP_BATCH_LEN; i++)
+	{
+		dgrams[i].buff = &bufs[i][sizeof(struct proxy_msg)];
+		dgrams[i].buff_len = CONN_BUFF_LEN_HEADERLESS;
+	}
+}
+
+static int pack_flush(struct proxy_conn_handle *pc, struct msg_pack *pack)
+{
+	int ret;
+
+	if (pack->len == 0)
+	{
+		return 0;
+	}
+
+	ret = client_enqueue(pc, pack->buff, pack->len, 1, pack->stamp);
+
+	pack->len = 0;
+
+	return ret;
+}
+
+static int pack_udp_batch(struct proxy_conn_handle *pc, struct msg_pack *pack, enum PROXY_MSG_TYPE type, const struct conn_dgram *dgrams, int count)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	const uint32_t delay = pc->ph->conf.client_coalesce_delay;
+	const size_t max_len = client_message_size(pc);
+	const uint64_t now = clock_now_us();
+	struct proxy_msg *msg;
+	size_t msg_len;
+	uint64_t bytes = 0;
+	uint64_t packets = 0;
+	uint64_t filtered = 0;
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (!peer_filter_check(pc, dgrams[i].addr))
+		{
+			trace_msg(pc, now, TRACE_DIR_TO_CLIENT, type, TRACE_FLAG_FILTERED, dgrams[i].addr, dgrams[i].buff, dgrams[i].len);
+			filtered++;
+			continue;
+		}
+
+		trace_msg(pc, now, TRACE_DIR_TO_CLIENT, type, 0, dgrams[i].addr, dgrams[i].buff, dgrams[i].len);
+
+		packets++;
+		bytes += dgrams[i].len;
+
+		msg = (struct proxy_msg *)(dgrams[i].buff - sizeof(struct proxy_msg));
+		msg->type = type;
+		msg->address = dgrams[i].addr;
+		msg->size = (uint32_t)dgrams[i].len;
+
+		msg_len = sizeof(struct proxy_msg) + msg->size;
+
+		if (pack->len + msg_len > max_len)
+		{
+			ret = pack_flush(pc, pack);
+			if (ret < 0)
+			{
+				break;
+			}
+		}
+
+		if (pack->len == 0)
+		{
+			pack->stamp = now;
+			pack->deadline = pack->stamp + delay;
+		}
+
+		PROXY_CONN_DEBUG(pc, "Sending %s message to client '%s' (%d bytes)\n", type == PROXY_MSG_TYPE_UDP_CONTROL ? "UDP_CONTROL" : "UDP_DATA", priv->callsign, msg->size);
+
+		memcpy(&pack->buff[pack->len], msg, msg_len);
+		pack->len += msg_len;
+	}
+
+	count_traffic(type == PROXY_MSG_TYPE_UDP_CONTROL ? &priv->udp_control_in : &priv->udp_data_in, packets, bytes);
+
+	if (filtered > 0)
+	{
+		atomic_u64_add(&priv->udp_filtered, filtered);
+	}
+
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	return delay == 0 ? pack_flush(pc, pack) : 0;
+}
+
+static struct peer_cache_entry * peer_lookup(struct proxy_conn_handle *pc, uint32_t addr)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct peer_cache_entry *entry;
+
+	entry = &priv->peer_cache[(uint32_t)(addr * 2654435761U) >> (32 - PEER_CACHE_BITS)];
+
+	// The addresses only depend on the remote host, so an entry never needs
+	// to be invalidated, only replaced
+	if (!entry->valid || entry->addr != addr)
+	{
+		entry->addr = addr;
+		entry->valid = 1;
+
+		conn_peer_ipv4(&entry->control, addr, 5199);
+		conn_peer_ipv4(&entry->data, addr, 5198);
+
+		if (pc->ph->conf.peer_filter)
+		{
+			peer_filter_add(pc, addr);
+		}
+	}
+
+	return entry;
+}
+
+static void peer_filter_add(struct proxy_conn_handle *pc, uint32_t addr)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	const uint32_t len = atomic_u32_load(&priv->peer_filter_len);
+	uint32_t i;
+	int ret;
+
+	if (len > CONN_FILTER_MAX)
+	{
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+	{
+		if (priv->peer_filter[i] == addr)
+		{
+			return;
+		}
+	}
+
+	if (len == CONN_FILTER_MAX)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Client '%s' has sent to more than %d hosts. No longer filtering its UDP traffic.\n", priv->callsign, CONN_FILTER_MAX);
+
+		atomic_u32_store(&priv->peer_filter_len, CONN_FILTER_MAX + 1);
+
+		conn_filter_sources(&priv->conn_control, NULL, 0);
+		conn_filter_sources(&priv->conn_data, NULL, 0);
+
+		return;
+	}
+
+	// The entry must be visible before the length which covers it, since the
+	// UDP receivers read the list without a lock
+	priv->peer_filter[len] = addr;
+	atomic_u32_store(&priv->peer_filter_len, len + 1);
+
+	ret = conn_filter_sources(&priv->conn_control, (const uint32_t *)priv->peer_filter, len + 1);
+	if (ret == 0)
+	{
+		ret = conn_filter_sources(&priv->conn_data, (const uint32_t *)priv->peer_filter, len + 1);
+	}
+
+	if (ret < 0 && ret != -ENOTSUP)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to update UDP filter for client '%s': %d (%s)\n", priv->callsign, -ret, strerror(-ret));
+	}
+}
+
+static int peer_filter_check(const struct proxy_conn_handle *pc, uint32_t addr)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	uint32_t len;
+	uint32_t i;
+
+	if (!pc->ph->conf.peer_filter)
+	{
+		return 1;
+	}
+
+	len = atomic_u32_load(&priv->peer_filter_len);
+	if (len > CONN_FILTER_MAX)
+	{
+		return 1;
+	}
+
+	for (i = 0; i < len; i++)
+	{
+		if (priv->peer_filter[i] == addr)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void peer_filter_reset(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret;
+
+	// Hosts are only added to the filter when they miss the cache
+	memset(priv->peer_cache, 0x0, sizeof(priv->peer_cache));
+
+	atomic_u32_store(&priv->peer_filter_len, 0);
+
+	if (!pc->ph->conf.peer_filter)
+	{
+		return;
+	}
+
+	// Until the client sends something, nothing is allowed through
+	ret = conn_filter_sources(&priv->conn_control, (const uint32_t *)priv->peer_filter, 0);
+	if (ret == 0)
+	{
+		ret = conn_filter_sources(&priv->conn_data, (const uint32_t *)priv->peer_filter, 0);
+	}
+
+	if (ret == -ENOTSUP)
+	{
+		PROXY_CONN_DEBUG(pc, "UDP filtering is not supported by the operating system. Filtering traffic for client '%s' in the proxy.\n", priv->callsign);
+	}
+	else if (ret < 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to set UDP filter for client '%s': %d (%s)\n", priv->callsign, -ret, strerror(-ret));
+	}
+}
+
+static int process_control_data_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret;
+
+	PROXY_CONN_DEBUG(pc, "Processing UDP_CONTROL message (%zu bytes) from client '%s'\n", data_len, priv->callsign);
+
+	if (data_len == 0)
+	{
+		return 0;
+	}
+
+	// Send the data
+	ret = conn_send_peer(&priv->conn_control, data, data_len, &peer_lookup(pc, msg->address)->control);
+
+	trace_msg(pc, priv->reader.stamp, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_UDP_CONTROL, ret < 0 ? TRACE_FLAG_FAILED : 0, msg->address, data, data_len);
+
+	if (ret < 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to send UDP_CONTROL packet of size %zu to client '%s': %d (%s)\n", data_len, priv->callsign, -ret, strerror(-ret));
+		// Drop?
+
+		atomic_u64_add(&priv->send_failures, 1);
+	}
+	else
+	{
+		count_traffic(&priv->udp_control_out, 1, data_len);
+		histogram_record(&priv->latency_out, clock_now_us() - priv->reader.stamp);
+	}
+
+	return 0;
+}
+
+static int process_data_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret;
+
+	PROXY_CONN_DEBUG(pc, "Processing UDP_DATA message (%zu bytes) from client '%s'\n", data_len, priv->callsign);
+
+	if (data_len == 0)
+	{
+		return 0;
+	}
+
+	// Send the data
+	ret = conn_send_peer(&priv->conn_data, data, data_len, &peer_lookup(pc, msg->address)->data);
+
+	trace_msg(pc, priv->reader.stamp, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_UDP_DATA, ret < 0 ? TRACE_FLAG_FAILED : 0, msg->address, data, data_len);
+
+	if (ret < 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to send UDP_DATA packet of size %zu to client '%s': %d (%s)\n", data_len, priv->callsign, -ret, strerror(-ret));
+		// Drop?
+
+		atomic_u64_add(&priv->send_failures, 1);
+	}
+	else
+	{
+		count_traffic(&priv->udp_data_out, 1, data_len);
+		histogram_record(&priv->latency_out, clock_now_us() - priv->reader.stamp);
+	}
+
+	return 0;
+}
+
+// This should return non-zero for conn_client errors only
+static int process_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len)
+{
+	switch(msg->type)
+	{
+	case PROXY_MSG_TYPE_TCP_OPEN:
+		return process_tcp_open_message(pc, msg);
+	case PROXY_MSG_TYPE_TCP_DATA:
+		return process_tcp_data_message(pc, msg, data, data_len);
+	case PROXY_MSG_TYPE_TCP_CLOSE:
+		return process_tcp_close_message(pc, msg);
+	case PROXY_MSG_TYPE_UDP_DATA:
+		return process_data_message(pc, msg, data, data_len);
+	case PROXY_MSG_TYPE_UDP_CONTROL:
+		return process_control_data_message(pc, msg, data, data_len);
+	default:
+		proxy_log(pc->ph, LOG_LEVEL_ERROR, "Invalid data received from client (beginning with %02x)\n", msg->type);
+		return -EINVAL;
+	}
+}
+
+static int process_messages(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct msg_reader *reader = &priv->reader;
+	const uint8_t *data;
+	size_t data_len;
+	int ret;
+
+	while (1)
+	{
+		if (!reader->in_msg)
+		{
+			if (reader->len < sizeof(struct proxy_msg))
+			{
+				break;
+			}
+
+			memcpy(reader->msg, &reader->buff[reader->off], sizeof(struct proxy_msg));
+			reader->off += sizeof(struct proxy_msg);
+			reader->len -= sizeof(struct proxy_msg);
+
+			reader->in_msg = 1;
+			reader->tcp_ret = 0;
+
+			switch (((struct proxy_msg *)reader->msg)->type)
+			{
+			case PROXY_MSG_TYPE_TCP_OPEN:
+			case PROXY_MSG_TYPE_TCP_CLOSE:
+				// These never have a body, so the size isn't meaningful
+				reader->remaining = 0;
+				break;
+			default:
+				reader->remaining = ((struct proxy_msg *)reader->msg)->size;
+				break;
+			}
+		}
+
+		// Long bodies are processed in parts, each of which must be complete
+		data_len = reader->remaining > CONN_BUFF_LEN ? CONN_BUFF_LEN : reader->remaining;
+		if (reader->len < data_len)
+		{
+			break;
+		}
+
+		data = &reader->buff[reader->off];
+		reader->off += data_len;
+		reader->len -= data_len;
+		reader->remaining -= (uint32_t)data_len;
+
+		if (reader->remaining == 0)
+		{
+			reader->in_msg = 0;
+		}
+
+		ret = process_message(pc, (struct proxy_msg *)reader->msg, data, data_len);
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int process_tcp_close_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	int ret;
+
+	PROXY_CONN_DEBUG(pc, "Processing TCP_CLOSE message from client '%s'\n", priv->callsign);
+	(void)msg;
+
+	trace_msg(pc, priv->reader.stamp, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_TCP_CLOSE, 0, priv->tcp_addr, NULL, 0);
+
+	ret = tcp_stop(pc);
+
+	// Without a forwarder thread to notice the closure, the response must be
+	// sent from here
+	return ret == 1 ? send_tcp_close(pc) : 0;
+}
+
+static int process_tcp_data_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg, const uint8_t *data, size_t data_len)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct msg_reader *reader = &priv->reader;
+
+	PROXY_CONN_DEBUG(pc, "Processing TCP_DATA message (%zu of %u bytes) from client '%s'\n", data_len, msg->size, priv->callsign);
+
+	// Send the data
+	if (data_len > 0 && reader->tcp_ret == 0)
+	{
+		PROXY_CONN_DEBUG(pc, "Sending TCP_DATA message (%zu bytes) from client '%s' to remote host\n", data_len, priv->callsign);
+
+		reader->tcp_ret = pc->reactor != NULL ? tcp_send(pc, data, data_len) : conn_send(&priv->conn_tcp, data, data_len);
+
+		trace_msg(pc, reader->stamp, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_TCP_DATA, reader->tcp_ret < 0 ? TRACE_FLAG_FAILED : 0, priv->tcp_addr, data, data_len);
+
+		if (reader->tcp_ret < 0)
+		{
+			PROXY_CONN_DEBUG(pc, "Error sending data to remote host (%d): %s\n", -reader->tcp_ret, strerror(-reader->tcp_ret));
+
+			atomic_u64_add(&priv->send_failures, 1);
+
+			conn_close(&priv->conn_tcp);
+		}
+		else
+		{
+			count_traffic(&priv->tcp_out, 1, data_len);
+		}
+	}
+
+	// Once the whole message has been processed, report any failure
+	if (!reader->in_msg && reader->tcp_ret != 0)
+	{
+		send_tcp_close(pc);
+	}
+
+	return 0;
+}
+
+static int process_tcp_open_message(struct proxy_conn_handle *pc, const struct proxy_msg *msg)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret;
+
+	PROXY_CONN_DEBUG(pc, "Processing TCP_OPEN message from client '%s'\n", priv->callsign);
+
+	tcp_stop(pc);
+
+	priv->tcp_addr = msg->address;
+
+	trace_msg(pc, priv->reader.stamp, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_TCP_OPEN, 0, priv->tcp_addr, NULL, 0);
+
+	mutex_lock(&priv->mutex_sentinel);
+	atomic_u32_store(&priv->tcp_cancel, 0);
+	mutex_unlock(&priv->mutex_sentinel);
+
+	// The connection is opened on another thread, since the remote host can
+	// take a long time to answer and the client's other traffic must not
+	// wait for it
+	ret = thread_start(&priv->thread_tcp);
+	if (ret < 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_ERROR, "Failed to start TCP thread for client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+
+		return send_tcp_status(pc, ret);
+	}
+
+	return 0;
+}
+
+static int send_tcp_close(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct proxy_msg message;
+	int ret;
+
+	memset(&message, 0x0, sizeof(struct proxy_msg));
+	message.type = PROXY_MSG_TYPE_TCP_CLOSE;
+	message.size = 0;
+
+	PROXY_CONN_DEBUG(pc, "Sending TCP_CLOSE message to client '%s'\n", priv->callsign);
+
+	ret = client_enqueue(pc, (uint8_t *)&message, sizeof(struct proxy_msg), 0, 0);
+
+	trace_msg(pc, clock_now_us(), TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_TCP_CLOSE, ret < 0 ? TRACE_FLAG_FAILED : 0, priv->tcp_addr, NULL, 0);
+
+	return ret;
+}
+
+static int send_tcp_status(struct proxy_conn_handle *pc, int status)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	uint8_t status_buf[sizeof(struct proxy_msg) + 4] = { 0x0 };
+	struct proxy_msg *status_msg = (struct proxy_msg *)status_buf;
+
+	status_msg->type = PROXY_MSG_TYPE_TCP_STATUS;
+	status_msg->size = 4;
+
+	// Unless we can figure out what the client is expecting here, the
+	// best we can do is a "non-zero" value to indicate failure.
+	memcpy(status_msg->data, &status, 4);
+
+	PROXY_CONN_DEBUG(pc, "Sending TCP_STATUS message (%d) to client '%s'\n", status, priv->callsign);
+
+	trace_msg(pc, clock_now_us(), TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_TCP_STATUS, status != 0 ? TRACE_FLAG_FAILED : 0, priv->tcp_addr, status_msg->data, status_msg->size);
+
+	return client_enqueue(pc, status_buf, sizeof(struct proxy_msg) + status_msg->size, 0, 0);
+}
+
+static int tcp_open(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	uint16_t retries = pc->ph->conf.tcp_retry_count;
+	uint32_t delay = TCP_RETRY_DELAY;
+	uint64_t deadline;
+	uint64_t now;
+	uint8_t canceled;
+	int ret;
+
+	priv->conn_tcp.connect_timeout = pc->ph->conf.tcp_connect_timeout * 1000U;
+
+	mutex_lock(&priv->mutex_sentinel);
+	priv->tcp_pending_len = 0;
+	mutex_unlock(&priv->mutex_sentinel);
+
+	while (1)
+	{
+		ret = conn_connect_to(&priv->conn_tcp, priv->tcp_addr, 5200);
+
+		mutex_lock(&priv->mutex_sentinel);
+		canceled = priv->tcp_cancel != 0;
+		mutex_unlock(&priv->mutex_sentinel);
+
+		if (canceled)
+		{
+			goto tcp_open_canceled;
+		}
+		else if (ret >= 0 || retries == 0)
+		{
+			break;
+		}
+
+		PROXY_CONN_DEBUG(pc, "Retrying TCP connection for client '%s' in %ums (%d): %s\n", priv->callsign, (unsigned)delay, -ret, strerror(-ret));
+
+		retries--;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "UDP Data forwarding thread is starting for client '%s'\n", priv->callsign);
+		// Give the remote host a moment before trying again, unless the
+		// client gives up on the connection in the meantime
+		deadline = clock_now_us() + delay * (uint64_t)1000;
 
-	do
-	{
-		ret = conn_recv_any(&priv->conn_data, msg->data, CONN_BUFF_LEN_HEADERLESS, &addr, NULL);
-		if (ret > 0)
+		mutex_lock(&priv->mutex_sentinel);
+
+		while (priv->tcp_cancel == 0 && priv->sentinel == 0 && (now = clock_now_us()) < deadline)
 		{
-			msg->address = addr;
-			msg->size = ret;
+			condvar_wait_time(&priv->condvar_client, &priv->mutex_sentinel, (uint32_t)((deadline - now + 999) / 1000));
+		}
 
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending UDP_DATA message to client '%s' (%d bytes)\n", priv->callsign, msg->size);
+		canceled = priv->tcp_cancel || priv->sentinel != 0;
 
-			mutex_lock(&priv->mutex_client_send);
+		mutex_unlock(&priv->mutex_sentinel);
 
-			ret = conn_send(priv->conn_client, (uint8_t *)msg, sizeof(struct proxy_msg) + msg->size);
+		if (canceled)
+		{
+			goto tcp_open_canceled;
+		}
 
-			mutex_unlock(&priv->mutex_client_send);
+		if (delay < TCP_RETRY_DELAY_MAX)
+		{
+			delay *= 2;
+		}
+	}
 
-			// This is an error with the client connection
+	if (ret < 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to open TCP connection for client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+	}
+	else
+	{
+		set_sockopts(pc, &priv->conn_tcp, pc->ph->conf.tcp_rcvbuf, pc->ph->conf.tcp_sndbuf, 0);
+
+		// The reactor threads must never block on the remote host, and the
+		// client may send data as soon as it hears about the connection
+		if (pc->reactor != NULL)
+		{
+			ret = conn_set_nonblocking(&priv->conn_tcp, 1);
 			if (ret < 0)
 			{
-				conn_close(&priv->conn_data);
-
-				proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client '%s' UDP Data thread is returning due to a client connection error (%d): %s\n", priv->callsign, -ret, strerror(-ret));
-
-				switch (ret)
-				{
-				case -ECONNRESET:
-				case -EINTR:
-				case -ENOTCONN:
-				case -EPIPE:
-					break;
-				default:
-					proxy_conn_drop(pc);
-					break;
-				}
+				proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to make TCP connection for client '%s' non-blocking (%d): %s\n", priv->callsign, -ret, strerror(-ret));
 
-				return NULL;
+				conn_close(&priv->conn_tcp);
 			}
 		}
-		else if (ret == 0)
-		{
-			ret = -EPIPE;
-		}
 	}
-	while (ret >= 0);
 
-	switch (ret)
+	if (send_tcp_status(pc, ret) < 0 && ret >= 0)
 	{
-	case -ECONNRESET:
-	case -EINTR:
-	case -ENOTCONN:
-	case -EPIPE:
-		break;
-	default:
-		proxy_log(pc->ph, LOG_LEVEL_INFO, "Failed to receive data on client '%s' UDP Data connection (%d): %s\n", priv->callsign, -ret, strerror(-ret));
-		// Since the UDP ports must be open while the client is connected,
-		// we should shut down the client if we don't exit cleanly
-		proxy_conn_drop(pc);
-		break;
+		conn_close(&priv->conn_tcp);
+
+		ret = -EPIPE;
 	}
 
-	conn_close(&priv->conn_data);
+	return ret;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client '%s' UDP Data thread is returning cleanly\n", priv->callsign);
+tcp_open_canceled:
+	// The client has closed or replaced this connection, so it isn't
+	// expecting to hear about it anymore
+	PROXY_CONN_DEBUG(pc, "TCP connection for client '%s' was canceled\n", priv->callsign);
 
-	return NULL;
+	conn_close(&priv->conn_tcp);
+
+	return -ECANCELED;
 }
 
-static void * forwarder_tcp(void *ctx)
+static void set_sockopts(struct proxy_conn_handle *pc, struct conn_handle *conn, uint32_t rcvbuf, uint32_t sndbuf, uint8_t dscp)
 {
-	struct thread_handle *th = (struct thread_handle *)ctx;
-	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)th->func_ctx;
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-
-	uint8_t buf[CONN_BUFF_LEN] = { 0x0 };
-	struct proxy_msg *msg = (struct proxy_msg *)buf;
+	struct conn_sockopts opts;
 	int ret;
 
-	msg->type = PROXY_MSG_TYPE_TCP_DATA;
-
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "TCP forwarding thread is starting for client '%s'\n", priv->callsign);
-
-	do
+	if (rcvbuf == 0 && sndbuf == 0 && dscp == 0)
 	{
-		ret = conn_recv_any(&priv->conn_tcp, msg->data, CONN_BUFF_LEN_HEADERLESS, NULL, NULL);
-		if (ret > 0)
-		{
-			msg->size = ret;
-
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending TCP_DATA message to client '%s' (%d bytes)\n", priv->callsign, msg->size);
-
-			mutex_lock(&priv->mutex_client_send);
-
-			ret = conn_send(priv->conn_client, (uint8_t *)msg, sizeof(struct proxy_msg) + msg->size);
-
-			mutex_unlock(&priv->mutex_client_send);
+		return;
+	}
 
-			// This is an error with the client connection
-			if (ret < 0)
-			{
-				conn_close(&priv->conn_tcp);
+	memset(&opts, 0x0, sizeof(struct conn_sockopts));
+	opts.rcvbuf = rcvbuf > INT_MAX ? INT_MAX : (int)rcvbuf;
+	opts.sndbuf = sndbuf > INT_MAX ? INT_MAX : (int)sndbuf;
+	opts.dscp = dscp;
 
-				proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client '%s' TCP thread is returning due to a client connection error (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+	ret = conn_set_sockopts(conn, &opts);
+	if (ret < 0)
+	{
+		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to set socket options for client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+	}
+}
 
-				switch (ret)
-				{
-				case -ECONNRESET:
-				case -EINTR:
-				case -ENOTCONN:
-				case -EPIPE:
-					break;
-				default:
-					proxy_conn_drop(pc);
-					break;
-				}
+static int tcp_stop(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret = 0;
 
-				return NULL;
-			}
-		}
-		else if (ret == 0)
-		{
-			ret = -EPIPE;
-		}
-	}
-	while (ret >= 0);
+	mutex_lock(&priv->mutex_sentinel);
+	atomic_u32_store(&priv->tcp_cancel, 1);
+	condvar_wake_all(&priv->condvar_client);
+	mutex_unlock(&priv->mutex_sentinel);
 
-	switch (ret)
+	if (pc->reactor != NULL)
 	{
-	case -ECONNRESET:
-	case -EINTR:
-	case -ENOTCONN:
-	case -EPIPE:
-		break;
-	default:
-		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to receive data on client '%s' TCP connection (%d): %s\n", priv->callsign, -ret, strerror(-ret));
-		break;
+		ret = reactor_del(pc->reactor, &priv->watch_tcp);
 	}
 
+	// This also cancels a connection attempt which is still in progress,
+	// and one which hasn't started yet gives up once it sees tcp_cancel
 	conn_close(&priv->conn_tcp);
 
-	send_tcp_close(pc);
-
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Client '%s' TCP thread is returning cleanly\n", priv->callsign);
+	thread_join(&priv->thread_tcp);
 
-	return NULL;
+	return ret;
 }
 
-static int process_control_data_message(struct proxy_conn_handle *pc, struct proxy_msg *msg)
+static int tcp_send(struct proxy_conn_handle *pc, const uint8_t *data, size_t data_len)
 {
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	size_t msg_size = msg->size;
-	uint32_t addr = msg->address;
-	int ret;
+	int ret = 0;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Processing UDP_CONTROL message (%d bytes) from client '%s'\n", msg_size, priv->callsign);
+	mutex_lock(&priv->mutex_sentinel);
 
-	while (msg_size > 0)
+	// Anything already waiting must go out first
+	if (priv->tcp_pending_len == 0)
 	{
-		size_t curr_msg_size = msg_size > CONN_BUFF_LEN ? CONN_BUFF_LEN : msg_size;
-
-		// Get the data segment from the client
-		ret = conn_recv(priv->conn_client, (void *)msg, curr_msg_size);
-		if (ret < 0)
+		ret = conn_send_some(&priv->conn_tcp, data, data_len);
+		if (ret >= 0)
 		{
-			return ret;
+			data += ret;
+			data_len -= ret;
+			ret = 0;
 		}
-		else if (ret == 0)
+		else if (ret == -EAGAIN || ret == -EWOULDBLOCK)
 		{
-			return -EPIPE;
+			ret = 0;
 		}
+	}
 
-		msg_size -= ret;
-
-		// Send the data
-		ret = conn_send_to(&priv->conn_control, (void *)msg, ret, addr, 5199);
-		if (ret < 0)
+	if (ret == 0 && data_len > 0)
+	{
+		if (data_len > TCP_PENDING_LEN - priv->tcp_pending_len)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to send UDP_CONTROL packet of size %zu to client '%s': %d (%s)\n", curr_msg_size, priv->callsign, -ret, strerror(-ret));
-			// Drop?
+			ret = -ENOBUFS;
+		}
+		else
+		{
+			memcpy(&priv->tcp_pending[priv->tcp_pending_len], data, data_len);
+			priv->tcp_pending_len += data_len;
+
+			condvar_wake_all(&priv->condvar_client);
 		}
 	}
 
-	return 0;
+	mutex_unlock(&priv->mutex_sentinel);
+
+	return ret;
 }
 
-static int process_data_message(struct proxy_conn_handle *pc, struct proxy_msg *msg)
+static void tcp_flush(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	size_t msg_size = msg->size;
-	uint32_t addr = msg->address;
-	int ret;
+	int ret = 0;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Processing UDP_DATA message (%d bytes) from client '%s'\n", msg_size, priv->callsign);
+	mutex_lock(&priv->mutex_sentinel);
 
-	while (msg_size > 0)
+	while (1)
 	{
-		size_t curr_msg_size = msg_size > CONN_BUFF_LEN ? CONN_BUFF_LEN : msg_size;
-
-		// Get the data segment from the client
-		ret = conn_recv(priv->conn_client, (void *)msg, curr_msg_size);
-		if (ret < 0)
+		while (priv->tcp_pending_len == 0 && priv->tcp_cancel == 0 && priv->sentinel == 0)
 		{
-			return ret;
+			condvar_wait(&priv->condvar_client, &priv->mutex_sentinel);
 		}
-		else if (ret == 0)
+
+		if (priv->tcp_cancel || priv->sentinel != 0)
 		{
-			return -EPIPE;
+			break;
 		}
 
-		msg_size -= ret;
+		mutex_unlock(&priv->mutex_sentinel);
+
+		ret = conn_poll_send(&priv->conn_tcp, TCP_FLUSH_POLL);
+
+		mutex_lock(&priv->mutex_sentinel);
+
+		if (ret > 0)
+		{
+			ret = conn_send_some(&priv->conn_tcp, priv->tcp_pending, priv->tcp_pending_len);
+			if (ret == -EAGAIN || ret == -EWOULDBLOCK)
+			{
+				ret = 0;
+			}
+			else if (ret > 0)
+			{
+				priv->tcp_pending_len -= ret;
+				memmove(priv->tcp_pending, &priv->tcp_pending[ret], priv->tcp_pending_len);
+			}
+		}
 
-		// Send the data
-		ret = conn_send_to(&priv->conn_data, (void *)msg, ret, addr, 5198);
 		if (ret < 0)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to send UDP_DATA packet of size %zu to client '%s': %d (%s)\n", curr_msg_size, priv->callsign, -ret, strerror(-ret));
-			// Drop?
+			break;
 		}
 	}
 
-	return 0;
-}
+	priv->tcp_pending_len = 0;
 
-// This should return non-zero for conn_client errors only
-static int process_message(struct proxy_conn_handle *pc, struct proxy_msg *msg)
-{
-	switch(msg->type)
+	mutex_unlock(&priv->mutex_sentinel);
+
+	if (ret < 0)
 	{
-	case PROXY_MSG_TYPE_TCP_OPEN:
-		return process_tcp_open_message(pc, msg);
-	case PROXY_MSG_TYPE_TCP_DATA:
-		return process_tcp_data_message(pc, msg);
-	case PROXY_MSG_TYPE_TCP_CLOSE:
-		return process_tcp_close_message(pc, msg);
-	case PROXY_MSG_TYPE_UDP_DATA:
-		return process_data_message(pc, msg);
-	case PROXY_MSG_TYPE_UDP_CONTROL:
-		return process_control_data_message(pc, msg);
-	default:
-		proxy_log(pc->ph, LOG_LEVEL_ERROR, "Invalid data received from client (beginning with %02x)\n", msg->type);
-		return -EINVAL;
+		PROXY_CONN_DEBUG(pc, "Error sending data to remote host (%d): %s\n", -ret, strerror(-ret));
+
+		atomic_u64_add(&priv->send_failures, 1);
+
+		conn_shutdown(&priv->conn_tcp);
 	}
 }
 
-static int process_tcp_close_message(struct proxy_conn_handle *pc, struct proxy_msg *msg)
+static inline void trace_msg(struct proxy_conn_handle *pc, uint64_t stamp, enum TRACE_DIR dir, enum PROXY_MSG_TYPE type, uint8_t flags, uint32_t addr, const uint8_t *data, size_t len)
 {
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Processing TCP_CLOSE message from client '%s'\n", priv->callsign);
-	(void)msg;
+	trace_record(&priv->trace, stamp, dir, (uint8_t)type, flags, addr, data, len, pc->ph->conf.trace_snap_len);
+}
 
-	conn_close(&priv->conn_tcp);
+static int watch_client(struct reactor_watch *watch)
+{
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)watch->func_ctx;
 
-	return 0;
+	return client_recv(pc);
 }
 
-static int process_tcp_data_message(struct proxy_conn_handle *pc, struct proxy_msg *msg)
+static void watch_client_detach(struct reactor_watch *watch)
 {
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)watch->func_ctx;
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	size_t msg_size = msg->size;
-	size_t curr_msg_size;
-	int tcp_ret = 0;
-	int ret;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Processing TCP_DATA message (%d bytes) from client '%s'\n", msg_size, priv->callsign);
+	mutex_lock(&priv->mutex_sentinel);
+
+	priv->session_done = 1;
+	condvar_wake_all(&priv->condvar_client);
+
+	mutex_unlock(&priv->mutex_sentinel);
+}
+
+static int watch_tcp(struct reactor_watch *watch)
+{
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)watch->func_ctx;
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	struct proxy_msg *msg = (struct proxy_msg *)priv->tcp_held;
+	int ret;
 
-	while (msg_size > 0)
+	// Only read more once the last message has been queued, so that a slow
+	// client leaves the remote host's data waiting in the socket
+	if (priv->tcp_held_len == 0)
 	{
-		curr_msg_size = msg_size > CONN_BUFF_LEN ? CONN_BUFF_LEN : msg_size;
+		msg->type = PROXY_MSG_TYPE_TCP_DATA;
+		msg->address = 0;
 
-		// Get the data segment from the client
-		ret = conn_recv(priv->conn_client, (void *)msg, curr_msg_size);
-		if (ret < 0)
+		ret = conn_recv_any(&priv->conn_tcp, msg->data, client_message_size(pc) - sizeof(struct proxy_msg), NULL, NULL);
+		if (ret == 0)
 		{
-			return ret;
+			ret = -EPIPE;
 		}
-		else if (ret == 0)
+
+		if (ret == -EAGAIN || ret == -EWOULDBLOCK)
 		{
-			return -EPIPE;
+			return 0;
 		}
-
-		msg_size -= ret;
-
-		// Send the data
-		if (tcp_ret == 0)
+		else if (ret < 0)
 		{
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending TCP_DATA message (%d bytes) from client '%s' to remote host\n", ret, priv->callsign);
-
-			tcp_ret = conn_send(&priv->conn_tcp, (void *)msg, ret);
-			if (tcp_ret < 0)
+			switch (ret)
 			{
-				proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Error sending data to remote host (%d): %s\n", -tcp_ret, strerror(-tcp_ret));
-
-				conn_close(&priv->conn_tcp);
+			case -ECONNRESET:
+			case -EINTR:
+			case -ENOTCONN:
+			case -EPIPE:
+				break;
+			default:
+				proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to receive data on client '%s' TCP connection (%d): %s\n", priv->callsign, -ret, strerror(-ret));
+				break;
 			}
-		}
-	}
-
-	if (tcp_ret != 0)
-	{
-		send_tcp_close(pc);
-	}
 
-	return 0;
-}
+			return ret;
+		}
 
-static int process_tcp_open_message(struct proxy_conn_handle *pc, struct proxy_msg *msg)
-{
-	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	uint8_t status_buf[sizeof(struct proxy_msg) + 4] = { 0x0 };
-	struct proxy_msg *status_msg = (struct proxy_msg *)status_buf;
-	uint8_t *addr_sep = (uint8_t *)&msg->address;
-	char addr[16] = "";
-	int ret;
+		msg->size = ret;
+		priv->tcp_held_len = sizeof(struct proxy_msg) + msg->size;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Processing TCP_OPEN message from client '%s'\n", priv->callsign);
+		count_traffic(&priv->tcp_in, 1, msg->size);
 
-	ret = snprintf(addr, 16, "%hhu.%hhu.%hhu.%hhu", addr_sep[0], addr_sep[1], addr_sep[2], addr_sep[3]);
-	if (ret < 7 || ret > 15)
-	{
-		proxy_log(pc->ph, LOG_LEVEL_ERROR, "Address conversion failed (%d)\n", ret);
-		return -EINVAL;
+		PROXY_CONN_DEBUG(pc, "Sending TCP_DATA message to client '%s' (%d bytes)\n", priv->callsign, msg->size);
 	}
 
-	// Attempt to connect
-	ret = conn_connect(&priv->conn_tcp, (const char *)addr, "5200");
-	if (ret < 0)
-	{
-		proxy_log(pc->ph, LOG_LEVEL_WARN, "Failed to open TCP connection for client '%s' (%d): %s\n", priv->callsign, -ret, strerror(-ret));
-	}
-	else
+	ret = client_try_enqueue(pc, priv->tcp_held, priv->tcp_held_len, 0, 0);
+	if (ret == -EAGAIN)
 	{
-		// Connection succeeded - start the thread
-		ret = thread_start(&priv->thread_tcp);
-		if (ret < 0)
+		// Rather than holding up the reactor thread, stop watching until the
+		// writer makes room. This pairs with the fence in client_writer, so
+		// that either the writer sees the flag or this sees the room.
+		reactor_pause(watch);
+
+		atomic_u32_store(&priv->tcp_blocked, 1);
+		atomic_fence();
+
+		ret = client_try_enqueue(pc, priv->tcp_held, priv->tcp_held_len, 0, 0);
+		if (ret == -EAGAIN)
 		{
-			conn_close(&priv->conn_tcp);
+			return 0;
 		}
-	}
 
-	status_msg->type = PROXY_MSG_TYPE_TCP_STATUS;
-	status_msg->size = 4;
+		atomic_u32_store(&priv->tcp_blocked, 0);
+		reactor_resume(pc->reactor, watch);
+	}
 
-	// Unless we can figure out what the client is expecting here, the
-	// best we can do is a "non-zero" value to indicate failure.
-	memcpy(status_msg->data, &ret, 4);
+	priv->tcp_held_len = 0;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending TCP_STATUS message (%d) to client '%s'\n", ret, priv->callsign);
+	trace_msg(pc, clock_now_us(), TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_TCP_DATA, ret < 0 ? TRACE_FLAG_FAILED : 0, priv->tcp_addr, msg->data, msg->size);
 
-	mutex_lock(&priv->mutex_client_send);
+	// This is an error with the client connection
+	if (ret < 0)
+	{
+		PROXY_CONN_DEBUG(pc, "Client '%s' TCP watch is detaching due to a client connection error (%d): %s\n", priv->callsign, -ret, strerror(-ret));
 
-	ret = conn_send(priv->conn_client, status_buf, sizeof(struct proxy_msg) + status_msg->size);
+		switch (ret)
+		{
+		case -ECONNRESET:
+		case -EINTR:
+		case -ENOTCONN:
+		case -EPIPE:
+			break;
+		default:
+			proxy_conn_drop(pc);
+			break;
+		}
 
-	mutex_unlock(&priv->mutex_client_send);
+		return ret;
+	}
 
-	return ret;
+	return 0;
 }
 
-static int send_system(struct proxy_conn_handle *pc, enum SYSTEM_MSG msg)
+static void watch_tcp_detach(struct reactor_watch *watch)
 {
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)watch->func_ctx;
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	uint8_t buf[sizeof(struct proxy_msg) + 1] = { 0x0 };
-	struct proxy_msg *message = (struct proxy_msg *)buf;
-	int ret;
-
-	message->type = PROXY_MSG_TYPE_SYSTEM;
-	message->size = 1;
-	message->data[0] = msg;
-
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending SYSTEM message (%d) to client '%s'\n", msg, priv->callsign);
-
-	mutex_lock(&priv->mutex_client_send);
-
-	ret = conn_send(priv->conn_client, buf, sizeof(struct proxy_msg) + message->size);
 
-	mutex_unlock(&priv->mutex_client_send);
+	conn_close(&priv->conn_tcp);
 
-	return ret;
+	send_tcp_close(pc);
 }
 
-static int send_tcp_close(struct proxy_conn_handle *pc)
+static int watch_udp(struct reactor_watch *watch)
 {
+	struct proxy_conn_handle *pc = (struct proxy_conn_handle *)watch->func_ctx;
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
-	struct proxy_msg message;
-	int ret;
+	const int is_control = watch->conn == &priv->conn_control;
+	const char *name = is_control ? "UDP Control" : "UDP Data";
+	uint8_t bufs[UDP_BATCH_LEN][CONN_BUFF_LEN];
+	struct conn_dgram dgrams[UDP_BATCH_LEN];
+	struct msg_pack pack;
+	int received = UDP_BATCH_LEN;
+	int ret = 0;
+	int i;
 
-	memset(&message, 0x0, sizeof(struct proxy_msg));
-	message.type = PROXY_MSG_TYPE_TCP_CLOSE;
-	message.size = 0;
+	init_udp_batch(bufs, dgrams);
+	pack.len = 0;
+
+	// Forward a limited number of batches so that other watches get a turn,
+	// stopping early once a partial batch shows that the socket is drained
+	for (i = 0; i < WATCH_UDP_BURST && received == UDP_BATCH_LEN; i++)
+	{
+		received = conn_recv_any_batch(watch->conn, dgrams, UDP_BATCH_LEN);
+		if (received == -EAGAIN || received == -EWOULDBLOCK)
+		{
+			break;
+		}
+		else if (received < 0)
+		{
+			ret = received;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG, "Sending TCP_CLOSE message to client '%s'\n", priv->callsign);
+			switch (ret)
+			{
+			case -ECONNRESET:
+			case -EINTR:
+			case -ENOTCONN:
+			case -EPIPE:
+				break;
+			default:
+				proxy_log(pc->ph, LOG_LEVEL_INFO, "Failed to receive data on client '%s' %s connection (%d): %s\n", priv->callsign, name, -ret, strerror(-ret));
+				// Since the UDP ports must be open while the client is connected,
+				// we should shut down the client if we don't exit cleanly
+				proxy_conn_drop(pc);
+				break;
+			}
+
+			return ret;
+		}
+
+		ret = pack_udp_batch(pc, &pack, is_control ? PROXY_MSG_TYPE_UDP_CONTROL : PROXY_MSG_TYPE_UDP_DATA, dgrams, received);
+		if (ret < 0)
+		{
+			break;
+		}
+	}
 
-	mutex_lock(&priv->mutex_client_send);
+	// Since there is no way to be called back at the deadline, anything left
+	// in the pack must be sent before returning
+	if (ret == 0)
+	{
+		ret = pack_flush(pc, &pack);
+	}
 
-	ret = conn_send(priv->conn_client, (uint8_t *)&message, sizeof(struct proxy_msg));
+	// This is an error with the client connection
+	if (ret < 0)
+	{
+		PROXY_CONN_DEBUG(pc, "Client '%s' %s watch is detaching due to a client connection error (%d): %s\n", priv->callsign, name, -ret, strerror(-ret));
 
-	mutex_unlock(&priv->mutex_client_send);
+		switch (ret)
+		{
+		case -ECONNRESET:
+		case -EINTR:
+		case -ENOTCONN:
+		case -EPIPE:
+			break;
+		default:
+			proxy_conn_drop(pc);
+			break;
+		}
+	}
 
 	return ret;
 }
@@ -1126,20 +2841,35 @@ static int send_tcp_close(struct proxy_conn_handle *pc)
  * API Functions
  */
 
-int proxy_conn_accept(struct proxy_conn_handle *pc, struct conn_handle *conn_client)
+int proxy_conn_accept(struct proxy_conn_handle *pc, struct conn_handle *conn_client, const char *callsign)
 {
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
 	int ret = 0;
 
 	mutex_lock(&priv->mutex_sentinel);
-	if (priv->sentinel != 0 || priv->conn_client != NULL)
+
+	// The caller took this slot from the free list
+	priv->slot_listed = 0;
+
+	if (priv->sentinel != 0 || priv->retiring || priv->conn_client != NULL)
 	{
 		ret = -EBUSY;
 		goto proxy_conn_accept_exit;
 	}
 
+	ret = slot_wake(pc);
+	if (ret < 0)
+	{
+		// The slot is still free, so it goes back on the list
+		priv->slot_listed = 1;
+		freelist_push(pc->free_slots, pc->slot);
+
+		goto proxy_conn_accept_exit;
+	}
+
 	priv->conn_client = conn_client;
-	condvar_wake_one(&priv->condvar_client);
+	strcpy(priv->callsign, callsign);
+	session_begin(pc);
 
 proxy_conn_accept_exit:
 	mutex_unlock(&priv->mutex_sentinel);
@@ -1153,10 +2883,7 @@ void proxy_conn_drop(struct proxy_conn_handle *pc)
 
 	mutex_lock(&priv->mutex_sentinel);
 
-	if (priv->conn_client != NULL)
-	{
-		conn_drop(priv->conn_client);
-	}
+	session_end(pc);
 
 	mutex_unlock(&priv->mutex_sentinel);
 }
@@ -1169,14 +2896,24 @@ void proxy_conn_free(struct proxy_conn_handle *pc)
 
 		proxy_conn_stop(pc);
 
+		reactor_watch_free(&priv->watch_tcp);
+		reactor_watch_free(&priv->watch_data);
+		reactor_watch_free(&priv->watch_control);
+		reactor_watch_free(&priv->watch_client);
+
+		thread_free(&priv->thread_writer);
 		thread_free(&priv->thread_tcp);
 		thread_free(&priv->thread_data);
 		thread_free(&priv->thread_control);
 		thread_free(&priv->thread_client);
 
+		queue_free(&priv->queue_client);
+
+		mutex_free(&priv->mutex_writer);
 		mutex_free(&priv->mutex_sentinel);
-		mutex_free(&priv->mutex_client_send);
 
+		condvar_free(&priv->condvar_writer);
+		condvar_free(&priv->condvar_space);
 		condvar_free(&priv->condvar_client);
 
 		conn_free(&priv->conn_tcp);
@@ -1185,22 +2922,109 @@ void proxy_conn_free(struct proxy_conn_handle *pc)
 
 		if (priv->conn_client != NULL)
 		{
-			conn_free(priv->conn_client);
+			conn_close(priv->conn_client);
+			conn_pool_put(pc->conn_pool, priv->conn_client);
+			priv->conn_client = NULL;
 		}
 
+#ifdef _MSC_VER
+		_aligned_free(pc->priv);
+#else
 		free(pc->priv);
+#endif
 		pc->priv = NULL;
 	}
 }
 
+void proxy_conn_get_stats(struct proxy_conn_handle *pc, struct proxy_slot_stats *stats)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	stats->udp_data_in.packets = atomic_u64_load(&priv->udp_data_in.packets);
+	stats->udp_data_in.bytes = atomic_u64_load(&priv->udp_data_in.bytes);
+	stats->udp_data_out.packets = atomic_u64_load(&priv->udp_data_out.packets);
+	stats->udp_data_out.bytes = atomic_u64_load(&priv->udp_data_out.bytes);
+	stats->udp_control_in.packets = atomic_u64_load(&priv->udp_control_in.packets);
+	stats->udp_control_in.bytes = atomic_u64_load(&priv->udp_control_in.bytes);
+	stats->udp_control_out.packets = atomic_u64_load(&priv->udp_control_out.packets);
+	stats->udp_control_out.bytes = atomic_u64_load(&priv->udp_control_out.bytes);
+	stats->tcp_in.packets = atomic_u64_load(&priv->tcp_in.packets);
+	stats->tcp_in.bytes = atomic_u64_load(&priv->tcp_in.bytes);
+	stats->tcp_out.packets = atomic_u64_load(&priv->tcp_out.packets);
+	stats->tcp_out.bytes = atomic_u64_load(&priv->tcp_out.bytes);
+	stats->send_failures = atomic_u64_load(&priv->send_failures);
+	stats->udp_filtered = atomic_u64_load(&priv->udp_filtered);
+	stats->frames_dropped = atomic_u64_load(&priv->frames_dropped_total) + atomic_u32_load(&priv->frames_dropped);
+	stats->latency_in.count = histogram_read(&priv->latency_in, stats->latency_in.buckets, &stats->latency_in.sum_us);
+	stats->latency_out.count = histogram_read(&priv->latency_out, stats->latency_out.buckets, &stats->latency_out.sum_us);
+	stats->queue_depth = (uint32_t)queue_count(&priv->queue_client);
+
+	// Forwarding only takes this lock when a client or connection comes or
+	// goes, never for each message
+	mutex_lock_shared(&priv->mutex_sentinel);
+
+	stats->in_use = priv->conn_client != NULL && conn_in_use(priv->conn_client) != 0;
+	stats->held = priv->held_callsign[0] != '\0';
+	stats->draining = priv->retiring;
+	stats->session_time = stats->in_use ? (uint32_t)(clock_now_us() / 1000000) - priv->session_start : 0;
+	snprintf(stats->callsign, sizeof(stats->callsign), "%s", stats->in_use ? priv->callsign : priv->held_callsign);
+	snprintf(stats->source_addr, sizeof(stats->source_addr), "%s", pc->source_addr != NULL ? pc->source_addr : "");
+
+	mutex_unlock_shared(&priv->mutex_sentinel);
+}
+
+const struct trace_ring * proxy_conn_get_trace(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	return &priv->trace;
+}
+
+int proxy_conn_handoff(struct proxy_conn_handle *pc, struct conn_handle *conn_client, const char *callsign)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret = 0;
+
+	mutex_lock(&priv->mutex_sentinel);
+
+	if (priv->sentinel != 0 || priv->conn_client != NULL || priv->held_callsign[0] == '\0' || strcmp(priv->held_callsign, callsign) != 0)
+	{
+		ret = -EBUSY;
+		goto proxy_conn_handoff_exit;
+	}
+
+	ret = slot_wake(pc);
+	if (ret < 0)
+	{
+		goto proxy_conn_handoff_exit;
+	}
+
+	priv->conn_client = conn_client;
+	strcpy(priv->callsign, callsign);
+	priv->held_callsign[0] = '\0';
+	hold_map_del(pc->held_slots, pc->slot);
+	priv->handed_off = 1;
+	session_begin(pc);
+
+proxy_conn_handoff_exit:
+	mutex_unlock(&priv->mutex_sentinel);
+
+	return ret;
+}
+
 int proxy_conn_init(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv;
 	int ret;
 
+	// The traffic counters must actually be aligned to cache lines
 	if (pc->priv == NULL)
 	{
-		pc->priv = malloc(sizeof(struct proxy_conn_priv));
+#ifdef _MSC_VER
+		pc->priv = _aligned_malloc(sizeof(struct proxy_conn_priv), ATOMIC_CACHE_LINE);
+#else
+		pc->priv = aligned_alloc(ATOMIC_CACHE_LINE, sizeof(struct proxy_conn_priv));
+#endif
 	}
 
 	if (pc->priv == NULL)
@@ -1241,6 +3065,7 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 	priv->conn_tcp.source_addr = pc->source_addr;
 	priv->conn_tcp.source_port = NULL;
 	priv->conn_tcp.type = CONN_TYPE_TCP;
+	priv->conn_tcp.connect_cancel = &priv->tcp_cancel;
 
 	ret = condvar_init(&priv->condvar_client);
 	if (ret != 0)
@@ -1248,7 +3073,13 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 		goto proxy_conn_init_exit;
 	}
 
-	ret = mutex_init(&priv->mutex_client_send);
+	ret = condvar_init(&priv->condvar_space);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
+	ret = condvar_init(&priv->condvar_writer);
 	if (ret != 0)
 	{
 		goto proxy_conn_init_exit;
@@ -1260,6 +3091,21 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 		goto proxy_conn_init_exit;
 	}
 
+	ret = mutex_init(&priv->mutex_writer);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
+	priv->queue_client.capacity = CLIENT_QUEUE_LEN;
+	priv->queue_client.elem_size = sizeof(struct out_frame);
+
+	ret = queue_init(&priv->queue_client);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
 	ret = thread_init(&priv->thread_client);
 	if (ret != 0)
 	{
@@ -1284,39 +3130,116 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 		goto proxy_conn_init_exit;
 	}
 
+	ret = thread_init(&priv->thread_writer);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
 	priv->thread_client.func_ctx = pc;
 	priv->thread_control.func_ctx = pc;
 	priv->thread_data.func_ctx = pc;
 	priv->thread_tcp.func_ctx = pc;
+	priv->thread_writer.func_ctx = pc;
 
 	priv->thread_client.func_ptr = client_manager;
 	priv->thread_control.func_ptr = forwarder_control;
 	priv->thread_data.func_ptr = forwarder_data;
 	priv->thread_tcp.func_ptr = forwarder_tcp;
+	priv->thread_writer.func_ptr = client_writer;
+
+	priv->thread_client.stack_size = pc->ph->conf.thread_stack_size * 1024U;
+	priv->thread_control.stack_size = pc->ph->conf.thread_stack_size * 1024U;
+	priv->thread_data.stack_size = pc->ph->conf.thread_stack_size * 1024U;
+	priv->thread_tcp.stack_size = pc->ph->conf.thread_stack_size * 1024U;
+	priv->thread_writer.stack_size = pc->ph->conf.thread_stack_size * 1024U;
+
+	// Keep every thread on this client's packet path on the same CPU
+	priv->thread_client.affinity = thread_affinity_pick(pc->ph->conf.forwarding_cpus, pc->slot);
+	priv->thread_control.affinity = priv->thread_client.affinity;
+	priv->thread_data.affinity = priv->thread_client.affinity;
+	priv->thread_tcp.affinity = priv->thread_client.affinity;
+	priv->thread_writer.affinity = priv->thread_client.affinity;
+
+	priv->thread_client.priority = pc->ph->conf.forwarding_priority;
+	priv->thread_control.priority = pc->ph->conf.forwarding_priority;
+	priv->thread_data.priority = pc->ph->conf.forwarding_priority;
+	priv->thread_tcp.priority = pc->ph->conf.forwarding_priority;
+	priv->thread_writer.priority = pc->ph->conf.forwarding_priority;
+
+	ret = reactor_watch_init(&priv->watch_client);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
+	ret = reactor_watch_init(&priv->watch_control);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
+	ret = reactor_watch_init(&priv->watch_data);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
+	ret = reactor_watch_init(&priv->watch_tcp);
+	if (ret != 0)
+	{
+		goto proxy_conn_init_exit;
+	}
+
+	priv->watch_client.func_ctx = pc;
+	priv->watch_control.func_ctx = pc;
+	priv->watch_data.func_ctx = pc;
+	priv->watch_tcp.func_ctx = pc;
 
-	priv->thread_client.stack_size = 1024 * 1024;
-	priv->thread_control.stack_size = 1024 * 1024;
-	priv->thread_data.stack_size = 1024 * 1024;
-	priv->thread_tcp.stack_size = 1024 * 1024;
+	priv->watch_client.func_ptr = watch_client;
+	priv->watch_control.func_ptr = watch_udp;
+	priv->watch_data.func_ptr = watch_udp;
+	priv->watch_tcp.func_ptr = watch_tcp;
+
+	priv->watch_client.func_detach = watch_client_detach;
+	priv->watch_tcp.func_detach = watch_tcp_detach;
+
+	priv->watch_control.conn = &priv->conn_control;
+	priv->watch_data.conn = &priv->conn_data;
+	priv->watch_tcp.conn = &priv->conn_tcp;
 
 	return 0;
 
 proxy_conn_init_exit:
+	reactor_watch_free(&priv->watch_tcp);
+	reactor_watch_free(&priv->watch_data);
+	reactor_watch_free(&priv->watch_control);
+	reactor_watch_free(&priv->watch_client);
+
+	thread_free(&priv->thread_writer);
 	thread_free(&priv->thread_tcp);
 	thread_free(&priv->thread_data);
 	thread_free(&priv->thread_control);
 	thread_free(&priv->thread_client);
 
+	queue_free(&priv->queue_client);
+
+	mutex_free(&priv->mutex_writer);
 	mutex_free(&priv->mutex_sentinel);
-	mutex_free(&priv->mutex_client_send);
 
+	condvar_free(&priv->condvar_writer);
+	condvar_free(&priv->condvar_space);
 	condvar_free(&priv->condvar_client);
 
 	conn_free(&priv->conn_tcp);
 	conn_free(&priv->conn_data);
 	conn_free(&priv->conn_control);
 
+#ifdef _MSC_VER
+	_aligned_free(pc->priv);
+#else
 	free(pc->priv);
+#endif
 	pc->priv = NULL;
 
 	return 0;
@@ -1339,11 +3262,154 @@ int proxy_conn_in_use(struct proxy_conn_handle *pc)
 	return ret;
 }
 
+uint32_t proxy_conn_reap(struct proxy_conn_handle *pc, uint32_t now)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	const uint32_t connection_timeout = pc->ph->conf.connection_timeout * (uint32_t)60;
+	const uint32_t inactivity_timeout = pc->ph->conf.inactivity_timeout;
+	uint32_t next = 0;
+	uint32_t deadline;
+
+	mutex_lock(&priv->mutex_sentinel);
+
+	if (priv->conn_client == NULL)
+	{
+		goto proxy_conn_reap_exit;
+	}
+
+	// The times are truncated to whole seconds, so a deadline one second
+	// later guarantees that at least the whole timeout has passed
+	if (connection_timeout > 0)
+	{
+		deadline = priv->session_start + connection_timeout + 1;
+		if ((int32_t)(now - deadline) >= 0)
+		{
+			proxy_log(pc->ph, LOG_LEVEL_INFO, "Dropping client '%s' because it has been connected for %hu minutes\n", priv->callsign, pc->ph->conf.connection_timeout);
+			session_end(pc);
+			goto proxy_conn_reap_exit;
+		}
+
+		next = deadline;
+	}
+
+	if (inactivity_timeout > 0)
+	{
+		deadline = atomic_u32_load(&priv->last_active) + inactivity_timeout + 1;
+		if ((int32_t)(now - deadline) >= 0)
+		{
+			proxy_log(pc->ph, LOG_LEVEL_INFO, "Dropping client '%s' because it has not sent anything for %hu seconds\n", priv->callsign, pc->ph->conf.inactivity_timeout);
+			session_end(pc);
+			next = 0;
+			goto proxy_conn_reap_exit;
+		}
+
+		if (next == 0 || (int32_t)(deadline - next) < 0)
+		{
+			next = deadline;
+		}
+	}
+
+proxy_conn_reap_exit:
+	mutex_unlock(&priv->mutex_sentinel);
+
+	return next;
+}
+
+int proxy_conn_reject(struct conn_handle *conn_client, enum SYSTEM_MSG msg)
+{
+	uint8_t buf[sizeof(struct proxy_msg) + 1] = { 0x0 };
+	struct proxy_msg *message = (struct proxy_msg *)buf;
+
+	message->type = PROXY_MSG_TYPE_SYSTEM;
+	message->size = 1;
+	message->data[0] = msg;
+
+	return conn_send(conn_client, buf, sizeof(struct proxy_msg) + message->size);
+}
+
+void proxy_conn_retire(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+
+	mutex_lock(&priv->mutex_sentinel);
+
+	priv->retiring = 1;
+
+	// Nobody else can come back to the slot once it is gone
+	if (priv->held_callsign[0] != '\0')
+	{
+		PROXY_CONN_DEBUG(pc, "No longer holding slot for client '%s'\n", priv->held_callsign);
+
+		priv->held_callsign[0] = '\0';
+		hold_map_del(pc->held_slots, pc->slot);
+		condvar_wake_all(&priv->condvar_client);
+	}
+
+	mutex_unlock(&priv->mutex_sentinel);
+}
+
+int proxy_conn_set_source(struct proxy_conn_handle *pc, const char *source_addr)
+{
+	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
+	int ret = 0;
+
+	mutex_lock(&priv->mutex_sentinel);
+
+	if (priv->sentinel != 0)
+	{
+		ret = -EBUSY;
+		goto proxy_conn_set_source_exit;
+	}
+
+	if ((pc->source_addr == NULL) != (source_addr == NULL) ||
+		(source_addr != NULL && strcmp(pc->source_addr, source_addr) != 0))
+	{
+		// The address can only change between clients of a retired slot
+		if (!priv->retiring || priv->conn_client != NULL || priv->bound || priv->held_callsign[0] != '\0')
+		{
+			ret = -EBUSY;
+			goto proxy_conn_set_source_exit;
+		}
+
+		pc->source_addr = source_addr;
+		priv->conn_control.source_addr = source_addr;
+		priv->conn_data.source_addr = source_addr;
+		priv->conn_tcp.source_addr = source_addr;
+	}
+
+	priv->retiring = 0;
+
+	if (priv->conn_client == NULL && !priv->bound && priv->held_callsign[0] == '\0' && !priv->slot_listed)
+	{
+		priv->slot_listed = 1;
+		freelist_push(pc->free_slots, pc->slot);
+	}
+
+proxy_conn_set_source_exit:
+	mutex_unlock(&priv->mutex_sentinel);
+
+	return ret;
+}
+
 int proxy_conn_start(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = (struct proxy_conn_priv *)pc->priv;
 	int ret = 0;
 
+	if (pc->workers != NULL)
+	{
+		// A thread is only taken from the pool once a client arrives
+		mutex_lock(&priv->mutex_sentinel);
+		if (priv->conn_client == NULL && !priv->slot_listed)
+		{
+			priv->slot_listed = 1;
+			freelist_push(pc->free_slots, pc->slot);
+		}
+		mutex_unlock(&priv->mutex_sentinel);
+
+		return 0;
+	}
+
 	mutex_lock_shared(&priv->mutex_sentinel);
 	if (priv->conn_client == NULL)
 	{
@@ -1364,9 +3430,19 @@ int proxy_conn_stop(struct proxy_conn_handle *pc)
 	mutex_lock(&priv->mutex_sentinel);
 	priv->sentinel = 1;
 	condvar_wake_all(&priv->condvar_client);
+
+	// A pooled thread which has been given the slot always gets to it
+	while (priv->bound)
+	{
+		condvar_wait(&priv->condvar_client, &priv->mutex_sentinel);
+	}
+
 	mutex_unlock(&priv->mutex_sentinel);
 
-	ret = thread_join(&priv->thread_client);
+	if (pc->workers == NULL)
+	{
+		ret = thread_join(&priv->thread_client);
+	}
 
 	mutex_lock(&priv->mutex_sentinel);
 
@@ -1374,8 +3450,7 @@ int proxy_conn_stop(struct proxy_conn_handle *pc)
 	{
 		proxy_log(pc->ph, LOG_LEVEL_ERROR, "Proxy connection client thread didn't clean up the conn_client!\n");
 		conn_close(priv->conn_client);
-		conn_free(priv->conn_client);
-		free(priv->conn_client);
+		conn_pool_put(pc->conn_pool, priv->conn_client);
 		priv->conn_client = NULL;
 	}
 
@@ -1383,3 +3458,10 @@ int proxy_conn_stop(struct proxy_conn_handle *pc)
 
 	return ret;
 }
+
+void proxy_conn_worker(struct worker_pool_handle *wp, void *item)
+{
+	(void)wp;
+
+	slot_manage((struct proxy_conn_handle *)item);
+}
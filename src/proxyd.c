@@ -51,6 +51,7 @@
 #  include <io.h>
 #  include <windows.h>
 #else
+#  include <pthread.h>
 #  include <signal.h>
 #  include <sys/stat.h>
 #endif
@@ -101,6 +102,9 @@ struct proxy_opts
 
 	/// Boolean value indicating if messages to stdout should be suppressed
 	uint8_t quiet;
+
+	/// Boolean value indicating if the running proxy should be taken over
+	uint8_t upgrade;
 };
 
 /// Global proxy handle
@@ -109,6 +113,14 @@ static struct proxy_handle ph;
 /// Program termination indicator
 static uint8_t sentinel = 0;
 
+#ifndef _WIN32
+/// Indicates that the configuration should be reloaded
+static volatile sig_atomic_t reload = 0;
+
+/// Indicates that the traced traffic should be written to the trace file
+static volatile sig_atomic_t trace = 0;
+#endif
+
 #ifdef _WIN32
 /*!
  * @brief Callback which is used to shut down the EchoLink proxy
@@ -127,6 +139,24 @@ static BOOL WINAPI graceful_shutdown(DWORD ctrl_type);
  * @param[in] ptr Signal handler context
  */
 static void graceful_shutdown(int signum, siginfo_t *info, void *ptr);
+
+/*!
+ * @brief Callback which is used to request that the configuration be reloaded
+ *
+ * @param[in] signum Signal number
+ * @param[in] info Extra signal information
+ * @param[in] ptr Signal handler context
+ */
+static void request_reload(int signum, siginfo_t *info, void *ptr);
+
+/*!
+ * @brief Callback which is used to request that the traced traffic be written
+ *
+ * @param[in] signum Signal number
+ * @param[in] info Extra signal information
+ * @param[in] ptr Signal handler context
+ */
+static void request_trace(int signum, siginfo_t *info, void *ptr);
 #endif
 
 /*!
@@ -194,6 +224,20 @@ static void graceful_shutdown(int signum, siginfo_t *info, void *ptr)
 		proxy_shutdown(&ph);
 	}
 }
+
+static void request_reload(int signum, siginfo_t *info, void *ptr)
+{
+	(void)signum, (void)info, (void)ptr;
+
+	reload = 1;
+}
+
+static void request_trace(int signum, siginfo_t *info, void *ptr)
+{
+	(void)signum, (void)info, (void)ptr;
+
+	trace = 1;
+}
 #endif
 
 int main(int argc, const char *argv[])
@@ -201,6 +245,7 @@ int main(int argc, const char *argv[])
 	struct proxy_opts opts;
 #ifndef _WIN32
 	struct sigaction sigact;
+	sigset_t sigrequest;
 #endif
 	int ret;
 
@@ -228,6 +273,22 @@ int main(int argc, const char *argv[])
 	sigaction(SIGINT, &sigact, NULL);
 	sigaction(SIGTERM, &sigact, NULL);
 	sigaction(SIGUSR1, &sigact, NULL);
+
+	// Handle SIGHUP and SIGUSR2, which interrupt the main thread while it is
+	// accepting clients. The other threads inherit the mask and never see
+	// them.
+	sigact.sa_sigaction = request_reload;
+
+	sigaction(SIGHUP, &sigact, NULL);
+
+	sigact.sa_sigaction = request_trace;
+
+	sigaction(SIGUSR2, &sigact, NULL);
+
+	sigemptyset(&sigrequest);
+	sigaddset(&sigrequest, SIGHUP);
+	sigaddset(&sigrequest, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &sigrequest, NULL);
 #else
 	if (!SetConsoleCtrlHandler(graceful_shutdown, TRUE))
 	{
@@ -262,6 +323,19 @@ int main(int argc, const char *argv[])
 		goto proxyd_exit;
 	}
 
+#ifndef _WIN32
+	// Take the listening port from the running proxy instead of opening it
+	if (opts.upgrade)
+	{
+		ret = proxy_take_over(&ph);
+		if (ret < 0)
+		{
+			proxy_log(&ph, LOG_LEVEL_FATAL, "Failed to take over from the running proxy (%d): %s\n", -ret, strerror(-ret));
+			goto proxyd_exit;
+		}
+	}
+#endif
+
 	// Start listening
 	ret = proxy_open(&ph);
 	if (ret < 0)
@@ -378,18 +452,62 @@ int main(int argc, const char *argv[])
 
 	proxy_log(&ph, LOG_LEVEL_INFO, "Ready.\n");
 
+#ifndef _WIN32
+	pthread_sigmask(SIG_UNBLOCK, &sigrequest, NULL);
+#endif
+
 	// Main dispatch loop
 	while (ret == 0 && sentinel == 0)
 	{
+#ifndef _WIN32
+		if (reload)
+		{
+			pthread_sigmask(SIG_BLOCK, &sigrequest, NULL);
+			reload = 0;
+
+			proxy_log(&ph, LOG_LEVEL_INFO, "Reloading config from '%s'\n", opts.config_path);
+
+			// A bad file doesn't disturb the running proxy
+			ret = proxy_reload(&ph, opts.config_path);
+			if (ret < 0)
+			{
+				proxy_log(&ph, LOG_LEVEL_ERROR, "Failed to reload config from '%s' (%d): %s\n", opts.config_path, -ret, strerror(-ret));
+				ret = 0;
+			}
+
+			pthread_sigmask(SIG_UNBLOCK, &sigrequest, NULL);
+		}
+
+		if (trace)
+		{
+			trace = 0;
+
+			// Failures are logged, and don't disturb the running proxy
+			proxy_dump_trace(&ph, NULL, -1);
+		}
+#endif
+
 		proxy_log(&ph, LOG_LEVEL_DEBUG, "Starting a processing run...\n");
 		ret = proxy_process(&ph);
 		if (ret < 0)
 		{
 			switch (ret)
 			{
+			case -ECANCELED:
+				proxy_log(&ph, LOG_LEVEL_INFO, "Handed off to the new process.\n");
+				ret = 0;
+				sentinel = 1;
+				break;
 			case -EINTR:
 				ret = 0;
 
+#ifndef _WIN32
+				if (reload || trace)
+				{
+					break;
+				}
+#endif
+
 				/// @TODO: Something better than a busy loop
 				while (!sentinel)
 				{
@@ -529,6 +647,11 @@ static void parse_args(const int argc, const char *argv[], struct proxy_opts *op
 
 						opts->syslog = 1;
 						break;
+#endif
+#ifndef _WIN32
+					case 'U':
+						opts->upgrade = 1;
+						break;
 #endif
 					case 'V':
 						printf(OCH_STR2(OPENELP_VERSION) "\n");
@@ -631,6 +754,9 @@ static void print_usage(void)
 		"  -q, --quiet    Suppress messages to stdout\n"
 #ifdef HAVE_SYSLOG
 		"  -S             Use syslog for logging\n"
+#endif
+#ifndef _WIN32
+		"  -U             Take over from the running proxy\n"
 #endif
 		"  -V, --version  Display version and exit\n"
 #ifndef _WIN32
@@ -0,0 +1,271 @@
+/*!
+ * @file queue.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of bounded lock-free queues
+ */
+
+#include "atomic.h"
+#include "queue.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Assumed size of a cache line, used to keep producers and the consumer apart
+#define QUEUE_CACHE_LINE 64
+
+/// Alignment of each element's data
+#define QUEUE_ALIGN 16
+
+/*!
+ * @brief Header preceding each element in the queue
+ *
+ * The sequence number of the cell at index i cycles through three states for
+ * each position p where (p % capacity) == i:
+ *  - p: Free, and may be reserved for position p
+ *  - p + 1: Committed, and may be consumed
+ *  - p + capacity: Released, and free for position p + capacity
+ */
+struct queue_cell
+{
+	/// Sequence number indicating the state of the cell
+	volatile size_t seq;
+
+	/// Position which the cell was reserved for
+	size_t pos;
+};
+
+/// Number of bytes reserved for the ::queue_cell before each element
+#define QUEUE_CELL_HDR ((sizeof(struct queue_cell) + QUEUE_ALIGN - 1) & ~(size_t)(QUEUE_ALIGN - 1))
+
+/*!
+ * @brief Private data for an instance of a queue
+ */
+struct queue_priv
+{
+	/// Next position to be reserved by a producer
+	volatile size_t enqueue_pos;
+
+	/// Padding to keep queue_priv::dequeue_pos in a separate cache line
+	uint8_t pad_enqueue[QUEUE_CACHE_LINE - sizeof(size_t)];
+
+	/// Next position to be consumed
+	volatile size_t dequeue_pos;
+
+	/// Padding to keep queue_priv::dequeue_pos in a separate cache line
+	uint8_t pad_dequeue[QUEUE_CACHE_LINE - sizeof(size_t)];
+
+	/// Number of bytes between consecutive cells
+	size_t stride;
+
+	/// Storage for all of the cells and their elements
+	uint8_t *cells;
+};
+
+/*!
+ * @brief Gets the cell used for the given position
+ *
+ * @param[in] queue Target queue instance
+ * @param[in] pos Position in the queue
+ *
+ * @returns Cell used for pos
+ */
+static inline struct queue_cell * queue_cell_at(struct queue_handle *queue, size_t pos);
+
+static inline struct queue_cell * queue_cell_at(struct queue_handle *queue, size_t pos)
+{
+	struct queue_priv *priv = (struct queue_priv *)queue->priv;
+
+	return (struct queue_cell *)&priv->cells[(pos & (queue->capacity - 1)) * priv->stride];
+}
+
+void queue_commit(struct queue_handle *queue, void *elem)
+{
+	struct queue_cell *cell = (struct queue_cell *)((uint8_t *)elem - QUEUE_CELL_HDR);
+
+	(void)queue;
+
+	atomic_size_store(&cell->seq, cell->pos + 1);
+}
+
+size_t queue_count(struct queue_handle *queue)
+{
+	struct queue_priv *priv = (struct queue_priv *)queue->priv;
+	size_t dequeue_pos;
+
+	// Reading dequeue_pos first ensures that it is not ahead of enqueue_pos
+	dequeue_pos = atomic_size_load(&priv->dequeue_pos);
+
+	return atomic_size_load(&priv->enqueue_pos) - dequeue_pos;
+}
+
+void queue_free(struct queue_handle *queue)
+{
+	if (queue->priv != NULL)
+	{
+		struct queue_priv *priv = (struct queue_priv *)queue->priv;
+
+		free(priv->cells);
+
+		free(queue->priv);
+		queue->priv = NULL;
+	}
+}
+
+int queue_init(struct queue_handle *queue)
+{
+	struct queue_priv *priv;
+	size_t i;
+	int ret;
+
+	// Each cell's committed and released states must be distinguishable
+	if (queue->capacity < 2 || (queue->capacity & (queue->capacity - 1)) != 0 || queue->elem_size == 0)
+	{
+		return -EINVAL;
+	}
+
+	if (queue->priv == NULL)
+	{
+		queue->priv = malloc(sizeof(struct queue_priv));
+	}
+
+	if (queue->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(queue->priv, 0x0, sizeof(struct queue_priv));
+	priv = (struct queue_priv *)queue->priv;
+
+	priv->stride = QUEUE_CELL_HDR + ((queue->elem_size + QUEUE_ALIGN - 1) & ~(size_t)(QUEUE_ALIGN - 1));
+
+	priv->cells = malloc(priv->stride * queue->capacity);
+	if (priv->cells == NULL)
+	{
+		ret = -ENOMEM;
+		goto queue_init_exit;
+	}
+
+	for (i = 0; i < queue->capacity; i++)
+	{
+		queue_cell_at(queue, i)->seq = i;
+	}
+
+	return 0;
+
+queue_init_exit:
+	free(queue->priv);
+	queue->priv = NULL;
+
+	return ret;
+}
+
+void * queue_peek(struct queue_handle *queue)
+{
+	return queue_peek_at(queue, 0);
+}
+
+void * queue_peek_at(struct queue_handle *queue, size_t index)
+{
+	struct queue_priv *priv = (struct queue_priv *)queue->priv;
+	size_t pos = priv->dequeue_pos + index;
+	struct queue_cell *cell;
+
+	if (index >= queue->capacity)
+	{
+		return NULL;
+	}
+
+	cell = queue_cell_at(queue, pos);
+
+	if (atomic_size_load(&cell->seq) != pos + 1)
+	{
+		return NULL;
+	}
+
+	return (uint8_t *)cell + QUEUE_CELL_HDR;
+}
+
+void queue_release(struct queue_handle *queue, void *elem)
+{
+	struct queue_priv *priv = (struct queue_priv *)queue->priv;
+	struct queue_cell *cell = (struct queue_cell *)((uint8_t *)elem - QUEUE_CELL_HDR);
+	size_t pos = priv->dequeue_pos;
+
+	atomic_size_store(&priv->dequeue_pos, pos + 1);
+	atomic_size_store(&cell->seq, pos + queue->capacity);
+}
+
+void * queue_reserve(struct queue_handle *queue)
+{
+	struct queue_priv *priv = (struct queue_priv *)queue->priv;
+	struct queue_cell *cell;
+	size_t pos = atomic_size_load(&priv->enqueue_pos);
+	size_t seq;
+
+	while (1)
+	{
+		cell = queue_cell_at(queue, pos);
+		seq = atomic_size_load(&cell->seq);
+
+		if (seq == pos)
+		{
+			if (atomic_size_cas(&priv->enqueue_pos, pos, pos + 1))
+			{
+				break;
+			}
+		}
+		else if ((ptrdiff_t)(seq - pos) < 0)
+		{
+			// The cell still holds an element from the previous lap
+			return NULL;
+		}
+
+		pos = atomic_size_load(&priv->enqueue_pos);
+	}
+
+	cell->pos = pos;
+
+	return (uint8_t *)cell + QUEUE_CELL_HDR;
+}
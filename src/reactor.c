@@ -0,0 +1,577 @@
+/*!
+ * @file reactor.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Event-driven socket readiness dispatch implementation
+ */
+
+#include "conn.h"
+#include "mutex.h"
+#include "reactor.h"
+#include "reactor_backend.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Maximum number of ready watches to retrieve from the backend at once
+#define REACTOR_BATCH 32
+
+/// Event notification mechanisms available in this build, the first of which
+/// is used by default
+static const struct reactor_backend * const reactor_backends[] =
+{
+#ifdef HAVE_EPOLL
+	&reactor_backend_epoll,
+#endif
+#ifdef HAVE_IO_URING
+	&reactor_backend_io_uring,
+#endif
+	&reactor_backend_poll,
+};
+
+/// Number of entries in ::reactor_backends
+#define NUM_REACTOR_BACKENDS (sizeof(reactor_backends) / sizeof(reactor_backends[0]))
+
+/*!
+ * @brief Private data for an instance of an event reactor
+ */
+struct reactor_priv
+{
+	/// Event notification mechanism used by this reactor
+	const struct reactor_backend *backend;
+
+	/// State of reactor_priv::backend
+	void *backend_state;
+
+	/// Mutex for protecting reactor_priv::sentinel
+	struct mutex_handle mutex_sentinel;
+
+	/// Number of threads in reactor_priv::threads
+	unsigned int num_threads;
+
+	/// Termination indicator for reactor_priv::threads
+	uint8_t sentinel;
+
+	/// Threads dispatching events
+	struct thread_handle *threads;
+};
+
+/*!
+ * @brief Private data for an instance of a reactor watch
+ */
+struct reactor_watch_priv
+{
+	/// Non-zero if the watch is registered with a reactor
+	uint8_t attached;
+
+	/// Non-zero while the watch's callbacks are running
+	uint8_t busy;
+
+	/// Condition variable signaled when reactor_watch_priv::busy is cleared
+	struct condvar_handle condvar;
+
+	/// Native socket descriptor given to the backend
+	intptr_t fd;
+
+	/// Mutex for protecting the watch state
+	struct mutex_handle mutex;
+
+	/// Non-zero if the watch should not be re-armed until ::reactor_resume
+	uint8_t paused;
+};
+
+/*!
+ * @brief Call the callback for a watch which is ready and re-arm or detach it
+ *
+ * @param[in,out] priv Private data of the reactor which reported the watch
+ * @param[in,out] watch Watch which is ready
+ */
+static void reactor_dispatch(struct reactor_priv *priv, struct reactor_watch *watch);
+
+/*!
+ * @brief Worker thread for dispatching events
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * reactor_worker(void *ctx);
+
+static void reactor_dispatch(struct reactor_priv *priv, struct reactor_watch *watch)
+{
+	struct reactor_watch_priv *wpriv = (struct reactor_watch_priv *)watch->priv;
+	int ret;
+
+	mutex_lock(&wpriv->mutex);
+
+	if (!wpriv->attached)
+	{
+		mutex_unlock(&wpriv->mutex);
+
+		return;
+	}
+
+	wpriv->busy = 1;
+
+	mutex_unlock(&wpriv->mutex);
+
+	ret = watch->func_ptr(watch);
+
+	mutex_lock(&wpriv->mutex);
+
+	if (wpriv->attached && ret == 0 && !wpriv->paused)
+	{
+		ret = priv->backend->rearm(priv->backend_state, wpriv->fd, watch);
+	}
+
+	if (wpriv->attached && ret != 0)
+	{
+		priv->backend->del(priv->backend_state, wpriv->fd, watch);
+		wpriv->attached = 0;
+
+		mutex_unlock(&wpriv->mutex);
+
+		// The descriptor is no longer watched, so it is now safe for the
+		// callback to close the connection
+		if (watch->func_detach != NULL)
+		{
+			watch->func_detach(watch);
+		}
+
+		mutex_lock(&wpriv->mutex);
+	}
+
+	wpriv->busy = 0;
+	condvar_wake_all(&wpriv->condvar);
+
+	mutex_unlock(&wpriv->mutex);
+}
+
+static void * reactor_worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct reactor_handle *reactor = (struct reactor_handle *)th->func_ctx;
+	struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+	void *ready[REACTOR_BATCH];
+	int ret;
+	int i;
+
+	while (1)
+	{
+		ret = priv->backend->wait(priv->backend_state, ready, REACTOR_BATCH);
+
+		mutex_lock_shared(&priv->mutex_sentinel);
+
+		if (priv->sentinel != 0)
+		{
+			mutex_unlock_shared(&priv->mutex_sentinel);
+
+			break;
+		}
+
+		mutex_unlock_shared(&priv->mutex_sentinel);
+
+		if (ret < 0)
+		{
+			if (ret == -EINTR)
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		for (i = 0; i < ret; i++)
+		{
+			reactor_dispatch(priv, (struct reactor_watch *)ready[i]);
+		}
+	}
+
+	return NULL;
+}
+
+int reactor_add(struct reactor_handle *reactor, struct reactor_watch *watch)
+{
+	struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+	struct reactor_watch_priv *wpriv = (struct reactor_watch_priv *)watch->priv;
+	int ret;
+
+	mutex_lock(&wpriv->mutex);
+
+	if (wpriv->attached)
+	{
+		ret = -EALREADY;
+		goto reactor_add_exit;
+	}
+
+	wpriv->fd = conn_get_fd(watch->conn);
+	if (wpriv->fd == -1)
+	{
+		ret = -ENOTCONN;
+		goto reactor_add_exit;
+	}
+
+	// The watch may fire on another thread before the backend returns
+	wpriv->attached = 1;
+	wpriv->paused = 0;
+
+	ret = priv->backend->add(priv->backend_state, wpriv->fd, watch);
+	if (ret < 0)
+	{
+		wpriv->attached = 0;
+	}
+
+reactor_add_exit:
+	mutex_unlock(&wpriv->mutex);
+
+	return ret;
+}
+
+int reactor_del(struct reactor_handle *reactor, struct reactor_watch *watch)
+{
+	struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+	struct reactor_watch_priv *wpriv = (struct reactor_watch_priv *)watch->priv;
+	int ret = 0;
+
+	mutex_lock(&wpriv->mutex);
+
+	if (wpriv->attached)
+	{
+		priv->backend->del(priv->backend_state, wpriv->fd, watch);
+		wpriv->attached = 0;
+		ret = 1;
+	}
+
+	wpriv->paused = 0;
+
+	while (wpriv->busy)
+	{
+		condvar_wait(&wpriv->condvar, &wpriv->mutex);
+	}
+
+	mutex_unlock(&wpriv->mutex);
+
+	return ret;
+}
+
+void reactor_pause(struct reactor_watch *watch)
+{
+	struct reactor_watch_priv *wpriv = (struct reactor_watch_priv *)watch->priv;
+
+	mutex_lock(&wpriv->mutex);
+
+	wpriv->paused = 1;
+
+	mutex_unlock(&wpriv->mutex);
+}
+
+int reactor_resume(struct reactor_handle *reactor, struct reactor_watch *watch)
+{
+	struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+	struct reactor_watch_priv *wpriv = (struct reactor_watch_priv *)watch->priv;
+	int ret = 0;
+
+	mutex_lock(&wpriv->mutex);
+
+	if (!wpriv->attached || !wpriv->paused)
+	{
+		goto reactor_resume_exit;
+	}
+
+	wpriv->paused = 0;
+
+	// A running callback re-arms the watch when it returns. Otherwise, the
+	// descriptor is registered again, since only the backend's add wakes a
+	// dispatch thread which is already waiting.
+	if (!wpriv->busy)
+	{
+		priv->backend->del(priv->backend_state, wpriv->fd, watch);
+
+		ret = priv->backend->add(priv->backend_state, wpriv->fd, watch);
+	}
+
+reactor_resume_exit:
+	mutex_unlock(&wpriv->mutex);
+
+	return ret;
+}
+
+void reactor_free(struct reactor_handle *reactor)
+{
+	if (reactor->priv != NULL)
+	{
+		struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+
+		reactor_stop(reactor);
+
+		if (priv->backend_state != NULL)
+		{
+			priv->backend->free(priv->backend_state);
+		}
+
+		mutex_free(&priv->mutex_sentinel);
+
+		free(reactor->priv);
+		reactor->priv = NULL;
+	}
+}
+
+int reactor_init(struct reactor_handle *reactor)
+{
+	const struct reactor_backend *backend = reactor_backends[0];
+	struct reactor_priv *priv;
+	size_t i;
+	int ret;
+
+	if (reactor->backend != NULL)
+	{
+		for (i = 0, backend = NULL; i < NUM_REACTOR_BACKENDS; i++)
+		{
+			if (strcmp(reactor->backend, reactor_backends[i]->name) == 0)
+			{
+				backend = reactor_backends[i];
+				break;
+			}
+		}
+
+		if (backend == NULL)
+		{
+			return -ENOTSUP;
+		}
+	}
+
+	if (reactor->priv == NULL)
+	{
+		reactor->priv = malloc(sizeof(struct reactor_priv));
+	}
+
+	if (reactor->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(reactor->priv, 0x0, sizeof(struct reactor_priv));
+
+	priv = (struct reactor_priv *)reactor->priv;
+
+	priv->backend = backend;
+
+	ret = mutex_init(&priv->mutex_sentinel);
+	if (ret < 0)
+	{
+		goto reactor_init_exit;
+	}
+
+	ret = priv->backend->init(&priv->backend_state);
+	if (ret < 0)
+	{
+		priv->backend_state = NULL;
+		goto reactor_init_exit_late;
+	}
+
+	return 0;
+
+reactor_init_exit_late:
+	mutex_free(&priv->mutex_sentinel);
+
+reactor_init_exit:
+	free(reactor->priv);
+	reactor->priv = NULL;
+
+	return ret;
+}
+
+const char * reactor_name(const struct reactor_handle *reactor)
+{
+	const struct reactor_priv *priv = (const struct reactor_priv *)reactor->priv;
+
+	return priv->backend->name;
+}
+
+int reactor_start(struct reactor_handle *reactor)
+{
+	struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+	unsigned int num_threads = reactor->num_threads;
+	int ret;
+
+	if (priv->threads != NULL)
+	{
+		return -EALREADY;
+	}
+
+	if (priv->sentinel)
+	{
+		return -EINVAL;
+	}
+
+	if (num_threads == 0 || priv->backend->single_thread)
+	{
+		num_threads = 1;
+	}
+
+	priv->threads = malloc(sizeof(struct thread_handle) * num_threads);
+	if (priv->threads == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(priv->threads, 0x0, sizeof(struct thread_handle) * num_threads);
+
+	for (priv->num_threads = 0; priv->num_threads < num_threads; priv->num_threads++)
+	{
+		struct thread_handle *th = &priv->threads[priv->num_threads];
+
+		ret = thread_init(th);
+		if (ret < 0)
+		{
+			goto reactor_start_exit;
+		}
+
+		th->func_ptr = reactor_worker;
+		th->func_ctx = reactor;
+		th->stack_size = reactor->stack_size;
+		th->affinity = thread_affinity_pick(reactor->affinity, priv->num_threads);
+		th->priority = reactor->priority;
+
+		ret = thread_start(th);
+		if (ret < 0)
+		{
+			thread_free(th);
+			goto reactor_start_exit;
+		}
+	}
+
+	return 0;
+
+reactor_start_exit:
+	reactor_stop(reactor);
+
+	return ret;
+}
+
+void reactor_stop(struct reactor_handle *reactor)
+{
+	struct reactor_priv *priv = (struct reactor_priv *)reactor->priv;
+	unsigned int i;
+
+	if (priv->threads == NULL)
+	{
+		return;
+	}
+
+	mutex_lock(&priv->mutex_sentinel);
+	priv->sentinel = 1;
+	mutex_unlock(&priv->mutex_sentinel);
+
+	priv->backend->wake(priv->backend_state);
+
+	for (i = 0; i < priv->num_threads; i++)
+	{
+		thread_join(&priv->threads[i]);
+		thread_free(&priv->threads[i]);
+	}
+
+	free(priv->threads);
+	priv->threads = NULL;
+	priv->num_threads = 0;
+}
+
+void reactor_watch_free(struct reactor_watch *watch)
+{
+	if (watch->priv != NULL)
+	{
+		struct reactor_watch_priv *priv = (struct reactor_watch_priv *)watch->priv;
+
+		condvar_free(&priv->condvar);
+		mutex_free(&priv->mutex);
+
+		free(watch->priv);
+		watch->priv = NULL;
+	}
+}
+
+int reactor_watch_init(struct reactor_watch *watch)
+{
+	struct reactor_watch_priv *priv;
+	int ret;
+
+	if (watch->priv == NULL)
+	{
+		watch->priv = malloc(sizeof(struct reactor_watch_priv));
+	}
+
+	if (watch->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(watch->priv, 0x0, sizeof(struct reactor_watch_priv));
+
+	priv = (struct reactor_watch_priv *)watch->priv;
+
+	priv->fd = -1;
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		goto reactor_watch_init_exit;
+	}
+
+	ret = condvar_init(&priv->condvar);
+	if (ret < 0)
+	{
+		goto reactor_watch_init_exit_late;
+	}
+
+	return 0;
+
+reactor_watch_init_exit_late:
+	mutex_free(&priv->mutex);
+
+reactor_watch_init_exit:
+	free(watch->priv);
+	watch->priv = NULL;
+
+	return ret;
+}
@@ -0,0 +1,303 @@
+/*!
+ * @file reactor_epoll.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Reactor backend using the Linux epoll API
+ */
+
+#include "reactor_backend.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*!
+ * @brief State of an epoll reactor backend
+ */
+struct reactor_epoll_state
+{
+	/// The epoll instance descriptor
+	int epoll_fd;
+
+	/// Event descriptor used to wake the waiting threads
+	int event_fd;
+};
+
+/*!
+ * @brief Register a descriptor and arm it
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value to report when the descriptor is ready
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_epoll_add(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Unregister a descriptor
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value given when the descriptor was registered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_epoll_del(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Frees the backend state
+ *
+ * @param[in,out] state Backend state
+ */
+static void reactor_epoll_free(void *state);
+
+/*!
+ * @brief Allocates and initializes the backend state
+ *
+ * @param[out] state Resulting backend state
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_epoll_init(void **state);
+
+/*!
+ * @brief Re-arm a descriptor which was reported as ready
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value given when the descriptor was registered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_epoll_rearm(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Block until one or more descriptors are ready
+ *
+ * @param[in,out] state Backend state
+ * @param[out] ready Values given with each of the ready descriptors
+ * @param[in] ready_len Maximum number of values to store in ready
+ *
+ * @returns Number of values stored in ready, negative ERRNO value on failure
+ */
+static int reactor_epoll_wait(void *state, void **ready, int ready_len);
+
+/*!
+ * @brief Permanently wake all threads blocked in ::reactor_epoll_wait
+ *
+ * @param[in,out] state Backend state
+ */
+static void reactor_epoll_wake(void *state);
+
+const struct reactor_backend reactor_backend_epoll =
+{
+	.name = "epoll",
+	.single_thread = 0,
+	.add = reactor_epoll_add,
+	.del = reactor_epoll_del,
+	.free = reactor_epoll_free,
+	.init = reactor_epoll_init,
+	.rearm = reactor_epoll_rearm,
+	.wait = reactor_epoll_wait,
+	.wake = reactor_epoll_wake,
+};
+
+static int reactor_epoll_add(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_epoll_state *es = (struct reactor_epoll_state *)state;
+	struct epoll_event ev;
+
+	memset(&ev, 0x0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	ev.data.ptr = ctx;
+
+	if (epoll_ctl(es->epoll_fd, EPOLL_CTL_ADD, (int)fd, &ev) != 0)
+	{
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int reactor_epoll_del(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_epoll_state *es = (struct reactor_epoll_state *)state;
+	struct epoll_event ev;
+
+	(void)ctx;
+
+	// Older kernels require a non-NULL event, even though it is ignored
+	memset(&ev, 0x0, sizeof(struct epoll_event));
+
+	if (epoll_ctl(es->epoll_fd, EPOLL_CTL_DEL, (int)fd, &ev) != 0)
+	{
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void reactor_epoll_free(void *state)
+{
+	struct reactor_epoll_state *es = (struct reactor_epoll_state *)state;
+
+	close(es->event_fd);
+	close(es->epoll_fd);
+
+	free(es);
+}
+
+static int reactor_epoll_init(void **state)
+{
+	struct reactor_epoll_state *es;
+	struct epoll_event ev;
+	int ret;
+
+	es = malloc(sizeof(struct reactor_epoll_state));
+	if (es == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	es->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (es->epoll_fd == -1)
+	{
+		ret = -errno;
+		goto reactor_epoll_init_exit;
+	}
+
+	es->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (es->event_fd == -1)
+	{
+		ret = -errno;
+		goto reactor_epoll_init_exit_late;
+	}
+
+	// The wake event is level-triggered so that every waiting thread sees it
+	memset(&ev, 0x0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+
+	if (epoll_ctl(es->epoll_fd, EPOLL_CTL_ADD, es->event_fd, &ev) != 0)
+	{
+		ret = -errno;
+		goto reactor_epoll_init_exit_later;
+	}
+
+	*state = es;
+
+	return 0;
+
+reactor_epoll_init_exit_later:
+	close(es->event_fd);
+
+reactor_epoll_init_exit_late:
+	close(es->epoll_fd);
+
+reactor_epoll_init_exit:
+	free(es);
+
+	return ret;
+}
+
+static int reactor_epoll_rearm(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_epoll_state *es = (struct reactor_epoll_state *)state;
+	struct epoll_event ev;
+
+	memset(&ev, 0x0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	ev.data.ptr = ctx;
+
+	if (epoll_ctl(es->epoll_fd, EPOLL_CTL_MOD, (int)fd, &ev) != 0)
+	{
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int reactor_epoll_wait(void *state, void **ready, int ready_len)
+{
+	struct reactor_epoll_state *es = (struct reactor_epoll_state *)state;
+	struct epoll_event events[32];
+	int ret;
+	int i;
+	int j;
+
+	if (ready_len > 32)
+	{
+		ready_len = 32;
+	}
+
+	ret = epoll_wait(es->epoll_fd, events, ready_len, -1);
+	if (ret < 0)
+	{
+		return -errno;
+	}
+
+	for (i = 0, j = 0; i < ret; i++)
+	{
+		if (events[i].data.ptr != NULL)
+		{
+			ready[j++] = events[i].data.ptr;
+		}
+	}
+
+	return j;
+}
+
+static void reactor_epoll_wake(void *state)
+{
+	struct reactor_epoll_state *es = (struct reactor_epoll_state *)state;
+	const uint64_t one = 1;
+	ssize_t ret;
+
+	// This can only fail if the counter is already non-zero
+	ret = write(es->event_fd, &one, sizeof(uint64_t));
+	(void)ret;
+}
@@ -0,0 +1,790 @@
+/*!
+ * @file reactor_io_uring.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Event notification using the Linux io_uring API
+ */
+
+#ifndef _GNU_SOURCE
+/// Expose POLLRDHUP
+#  define _GNU_SOURCE
+#endif
+
+#include "atomic.h"
+#include "mutex.h"
+#include "reactor_backend.h"
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Number of submission queue entries to request from the kernel
+#define REACTOR_IO_URING_ENTRIES 512
+
+/// Completion value posted by ::reactor_io_uring_wake, which is never consumed
+#define REACTOR_IO_URING_WAKE UINT64_MAX
+
+/// Completion value of requests whose result is not needed
+#define REACTOR_IO_URING_IGNORE (UINT64_MAX - 1)
+
+/*!
+ * @brief Registration of a single descriptor with an io_uring backend
+ *
+ * Registrations are indexed by descriptor. The generation is changed each time
+ * the descriptor is registered or unregistered, so that completions of polls
+ * belonging to a previous registration can be recognized and ignored.
+ */
+struct reactor_io_uring_reg
+{
+	/// Value to report when the descriptor is ready, or NULL if unregistered
+	void *ctx;
+
+	/// Generation of the registration, which is part of the poll's user data
+	uint32_t gen;
+
+	/// Non-zero while a poll for the descriptor is outstanding
+	uint8_t armed;
+};
+
+/*!
+ * @brief State of an io_uring reactor backend
+ */
+struct reactor_io_uring_state
+{
+	/// The io_uring instance descriptor
+	int ring_fd;
+
+	/// Mapping of the submission queue ring
+	void *sq_ring;
+
+	/// Length of reactor_io_uring_state::sq_ring
+	size_t sq_ring_len;
+
+	/// Mapping of the completion queue ring, which may be the same as
+	/// reactor_io_uring_state::sq_ring
+	void *cq_ring;
+
+	/// Length of reactor_io_uring_state::cq_ring
+	size_t cq_ring_len;
+
+	/// Mapping of the submission queue entries
+	struct io_uring_sqe *sqes;
+
+	/// Length of reactor_io_uring_state::sqes
+	size_t sqes_len;
+
+	/// Index of the first submission queue entry not yet consumed by the kernel
+	volatile uint32_t *sq_head;
+
+	/// Index after the last submission queue entry
+	volatile uint32_t *sq_tail;
+
+	/// Indirection array of the submission queue
+	volatile uint32_t *sq_array;
+
+	/// Mask to apply to submission queue indices
+	uint32_t sq_mask;
+
+	/// Number of entries in the submission queue
+	uint32_t sq_entries;
+
+	/// Index of the first completion queue entry not yet consumed
+	volatile uint32_t *cq_head;
+
+	/// Index after the last completion queue entry posted by the kernel
+	volatile uint32_t *cq_tail;
+
+	/// Mask to apply to completion queue indices
+	uint32_t cq_mask;
+
+	/// Completion queue entries
+	struct io_uring_cqe *cqes;
+
+	/// Mutex for protecting the rings and reactor_io_uring_state::regs
+	struct mutex_handle mutex;
+
+	/// Number of queued submission queue entries not yet submitted
+	uint32_t pending;
+
+	/// Registrations, indexed by descriptor
+	struct reactor_io_uring_reg *regs;
+
+	/// Number of entries in reactor_io_uring_state::regs
+	size_t regs_len;
+};
+
+/*!
+ * @brief Register a descriptor and arm it
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value to report when the descriptor is ready
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_io_uring_add(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Unregister a descriptor
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value given when the descriptor was registered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_io_uring_del(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Submit queued entries and optionally wait for completions
+ *
+ * @param[in] ring_fd The io_uring instance descriptor
+ * @param[in] to_submit Number of queued entries to submit
+ * @param[in] min_complete Number of completions to wait for
+ * @param[in] flags Flags for the io_uring_enter system call
+ *
+ * @returns Number of entries submitted, negative ERRNO value on failure
+ */
+static int reactor_io_uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+/*!
+ * @brief Submit all queued entries without waiting for completions
+ *
+ * The backend mutex must be held.
+ *
+ * @param[in,out] us Backend state
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_io_uring_flush(struct reactor_io_uring_state *us);
+
+/*!
+ * @brief Frees the backend state
+ *
+ * @param[in,out] state Backend state
+ */
+static void reactor_io_uring_free(void *state);
+
+/*!
+ * @brief Get the next free submission queue entry
+ *
+ * The backend mutex must be held, and the entry must be queued using
+ * ::reactor_io_uring_queue before the mutex is released.
+ *
+ * @param[in,out] us Backend state
+ *
+ * @returns Cleared submission queue entry, or NULL if the queue is full
+ */
+static struct io_uring_sqe * reactor_io_uring_get_sqe(struct reactor_io_uring_state *us);
+
+/*!
+ * @brief Allocates and initializes the backend state
+ *
+ * @param[out] state Resulting backend state
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_io_uring_init(void **state);
+
+/*!
+ * @brief Queue a poll for read readiness of a registered descriptor
+ *
+ * The backend mutex must be held.
+ *
+ * @param[in,out] us Backend state
+ * @param[in] fd Native socket descriptor
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_io_uring_poll(struct reactor_io_uring_state *us, intptr_t fd);
+
+/*!
+ * @brief Make the entry returned by ::reactor_io_uring_get_sqe visible to the
+ *        kernel at the next submission
+ *
+ * @param[in,out] us Backend state
+ */
+static void reactor_io_uring_queue(struct reactor_io_uring_state *us);
+
+/*!
+ * @brief Consume completions and collect the values of the ready descriptors
+ *
+ * The backend mutex must be held.
+ *
+ * @param[in,out] us Backend state
+ * @param[out] ready Values given with each of the ready descriptors
+ * @param[in] ready_len Maximum number of values to store in ready
+ * @param[out] woken Set to non-zero if ::reactor_io_uring_wake was called
+ *
+ * @returns Number of values stored in ready
+ */
+static int reactor_io_uring_reap(struct reactor_io_uring_state *us, void **ready, int ready_len, int *woken);
+
+/*!
+ * @brief Re-arm a descriptor which was reported as ready
+ *
+ * The poll is queued, and submitted along with any others the next time a
+ * thread waits for events.
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value given when the descriptor was registered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_io_uring_rearm(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Block until one or more descriptors are ready
+ *
+ * @param[in,out] state Backend state
+ * @param[out] ready Values given with each of the ready descriptors
+ * @param[in] ready_len Maximum number of values to store in ready
+ *
+ * @returns Number of values stored in ready, negative ERRNO value on failure
+ */
+static int reactor_io_uring_wait(void *state, void **ready, int ready_len);
+
+/*!
+ * @brief Permanently wake all threads blocked in ::reactor_io_uring_wait
+ *
+ * @param[in,out] state Backend state
+ */
+static void reactor_io_uring_wake(void *state);
+
+const struct reactor_backend reactor_backend_io_uring =
+{
+	.name = "io_uring",
+	.single_thread = 0,
+	.add = reactor_io_uring_add,
+	.del = reactor_io_uring_del,
+	.free = reactor_io_uring_free,
+	.init = reactor_io_uring_init,
+	.rearm = reactor_io_uring_rearm,
+	.wait = reactor_io_uring_wait,
+	.wake = reactor_io_uring_wake,
+};
+
+static int reactor_io_uring_add(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_io_uring_state *us = (struct reactor_io_uring_state *)state;
+	struct reactor_io_uring_reg *reg;
+	int ret;
+
+	if (fd < 0 || fd > INT32_MAX)
+	{
+		return -EBADF;
+	}
+
+	mutex_lock(&us->mutex);
+
+	if ((size_t)fd >= us->regs_len)
+	{
+		size_t new_len = us->regs_len > 0 ? us->regs_len : 64;
+
+		while (new_len <= (size_t)fd)
+		{
+			new_len *= 2;
+		}
+
+		reg = realloc(us->regs, new_len * sizeof(struct reactor_io_uring_reg));
+		if (reg == NULL)
+		{
+			ret = -ENOMEM;
+			goto reactor_io_uring_add_exit;
+		}
+
+		memset(&reg[us->regs_len], 0x0, (new_len - us->regs_len) * sizeof(struct reactor_io_uring_reg));
+
+		us->regs = reg;
+		us->regs_len = new_len;
+	}
+
+	reg = &us->regs[fd];
+
+	if (reg->ctx != NULL)
+	{
+		ret = -EEXIST;
+		goto reactor_io_uring_add_exit;
+	}
+
+	reg->ctx = ctx;
+	reg->gen++;
+
+	ret = reactor_io_uring_poll(us, fd);
+	if (ret < 0)
+	{
+		reg->ctx = NULL;
+		goto reactor_io_uring_add_exit;
+	}
+
+	// Another thread may already be blocked waiting, so this can't wait to be
+	// submitted with the next wait
+	ret = reactor_io_uring_flush(us);
+
+reactor_io_uring_add_exit:
+	mutex_unlock(&us->mutex);
+
+	return ret;
+}
+
+static int reactor_io_uring_del(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_io_uring_state *us = (struct reactor_io_uring_state *)state;
+	struct reactor_io_uring_reg *reg;
+	struct io_uring_sqe *sqe;
+	int ret = 0;
+
+	mutex_lock(&us->mutex);
+
+	if (fd < 0 || (size_t)fd >= us->regs_len || us->regs[fd].ctx != ctx)
+	{
+		ret = -ENOENT;
+		goto reactor_io_uring_del_exit;
+	}
+
+	reg = &us->regs[fd];
+
+	reg->ctx = NULL;
+
+	if (reg->armed)
+	{
+		sqe = reactor_io_uring_get_sqe(us);
+		if (sqe == NULL)
+		{
+			ret = -EBUSY;
+		}
+		else
+		{
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = ((uint64_t)reg->gen << 32) | (uint32_t)fd;
+			sqe->user_data = REACTOR_IO_URING_IGNORE;
+
+			reactor_io_uring_queue(us);
+
+			reg->armed = 0;
+		}
+	}
+
+	reg->gen++;
+
+	// The kernel holds a reference to the descriptor while the poll is
+	// outstanding, so the removal must be submitted before the caller closes it
+	if (ret == 0)
+	{
+		ret = reactor_io_uring_flush(us);
+	}
+
+reactor_io_uring_del_exit:
+	mutex_unlock(&us->mutex);
+
+	return ret;
+}
+
+static int reactor_io_uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+	long ret;
+
+	ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+	if (ret < 0)
+	{
+		return -errno;
+	}
+
+	return (int)ret;
+}
+
+static int reactor_io_uring_flush(struct reactor_io_uring_state *us)
+{
+	int ret;
+
+	while (us->pending > 0)
+	{
+		ret = reactor_io_uring_enter(us->ring_fd, us->pending, 0, 0);
+		if (ret < 0)
+		{
+			if (ret == -EINTR)
+			{
+				continue;
+			}
+
+			return ret;
+		}
+		else if (ret == 0)
+		{
+			return -EBUSY;
+		}
+
+		us->pending -= (uint32_t)ret;
+	}
+
+	return 0;
+}
+
+static void reactor_io_uring_free(void *state)
+{
+	struct reactor_io_uring_state *us = (struct reactor_io_uring_state *)state;
+
+	munmap(us->sqes, us->sqes_len);
+	if (us->cq_ring != us->sq_ring)
+	{
+		munmap(us->cq_ring, us->cq_ring_len);
+	}
+	munmap(us->sq_ring, us->sq_ring_len);
+
+	close(us->ring_fd);
+
+	mutex_free(&us->mutex);
+
+	free(us->regs);
+	free(us);
+}
+
+static struct io_uring_sqe * reactor_io_uring_get_sqe(struct reactor_io_uring_state *us)
+{
+	const uint32_t tail = *us->sq_tail;
+	struct io_uring_sqe *sqe;
+
+	if (tail - atomic_u32_load(us->sq_head) >= us->sq_entries)
+	{
+		if (reactor_io_uring_flush(us) < 0 || tail - atomic_u32_load(us->sq_head) >= us->sq_entries)
+		{
+			return NULL;
+		}
+	}
+
+	sqe = &us->sqes[tail & us->sq_mask];
+	memset(sqe, 0x0, sizeof(struct io_uring_sqe));
+
+	us->sq_array[tail & us->sq_mask] = tail & us->sq_mask;
+
+	return sqe;
+}
+
+static int reactor_io_uring_init(void **state)
+{
+	struct reactor_io_uring_state *us;
+	struct io_uring_params params;
+	uint8_t *ring;
+	int ret;
+
+	us = malloc(sizeof(struct reactor_io_uring_state));
+	if (us == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(us, 0x0, sizeof(struct reactor_io_uring_state));
+
+	ret = mutex_init(&us->mutex);
+	if (ret < 0)
+	{
+		goto reactor_io_uring_init_exit;
+	}
+
+	memset(&params, 0x0, sizeof(struct io_uring_params));
+
+	us->ring_fd = (int)syscall(__NR_io_uring_setup, REACTOR_IO_URING_ENTRIES, &params);
+	if (us->ring_fd < 0)
+	{
+		ret = -errno;
+		goto reactor_io_uring_init_exit_late;
+	}
+
+	us->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	us->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (us->cq_ring_len > us->sq_ring_len)
+		{
+			us->sq_ring_len = us->cq_ring_len;
+		}
+
+		us->cq_ring_len = us->sq_ring_len;
+	}
+
+	us->sq_ring = mmap(NULL, us->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, us->ring_fd, IORING_OFF_SQ_RING);
+	if (us->sq_ring == MAP_FAILED)
+	{
+		ret = -errno;
+		goto reactor_io_uring_init_exit_later;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		us->cq_ring = us->sq_ring;
+	}
+	else
+	{
+		us->cq_ring = mmap(NULL, us->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, us->ring_fd, IORING_OFF_CQ_RING);
+		if (us->cq_ring == MAP_FAILED)
+		{
+			ret = -errno;
+			goto reactor_io_uring_init_exit_even_later;
+		}
+	}
+
+	us->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	us->sqes = mmap(NULL, us->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, us->ring_fd, IORING_OFF_SQES);
+	if (us->sqes == MAP_FAILED)
+	{
+		ret = -errno;
+		goto reactor_io_uring_init_exit_latest;
+	}
+
+	ring = (uint8_t *)us->sq_ring;
+	us->sq_head = (volatile uint32_t *)(ring + params.sq_off.head);
+	us->sq_tail = (volatile uint32_t *)(ring + params.sq_off.tail);
+	us->sq_array = (volatile uint32_t *)(ring + params.sq_off.array);
+	us->sq_mask = *(uint32_t *)(ring + params.sq_off.ring_mask);
+	us->sq_entries = *(uint32_t *)(ring + params.sq_off.ring_entries);
+
+	ring = (uint8_t *)us->cq_ring;
+	us->cq_head = (volatile uint32_t *)(ring + params.cq_off.head);
+	us->cq_tail = (volatile uint32_t *)(ring + params.cq_off.tail);
+	us->cq_mask = *(uint32_t *)(ring + params.cq_off.ring_mask);
+	us->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+	*state = us;
+
+	return 0;
+
+reactor_io_uring_init_exit_latest:
+	if (us->cq_ring != us->sq_ring)
+	{
+		munmap(us->cq_ring, us->cq_ring_len);
+	}
+
+reactor_io_uring_init_exit_even_later:
+	munmap(us->sq_ring, us->sq_ring_len);
+
+reactor_io_uring_init_exit_later:
+	close(us->ring_fd);
+
+reactor_io_uring_init_exit_late:
+	mutex_free(&us->mutex);
+
+reactor_io_uring_init_exit:
+	free(us);
+
+	return ret;
+}
+
+static int reactor_io_uring_poll(struct reactor_io_uring_state *us, intptr_t fd)
+{
+	struct reactor_io_uring_reg *reg = &us->regs[fd];
+	struct io_uring_sqe *sqe;
+
+	sqe = reactor_io_uring_get_sqe(us);
+	if (sqe == NULL)
+	{
+		return -EBUSY;
+	}
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = (int32_t)fd;
+	sqe->poll_events = POLLIN | POLLRDHUP;
+	sqe->user_data = ((uint64_t)reg->gen << 32) | (uint32_t)fd;
+
+	reactor_io_uring_queue(us);
+
+	reg->armed = 1;
+
+	return 0;
+}
+
+static void reactor_io_uring_queue(struct reactor_io_uring_state *us)
+{
+	// The entry must be written before the kernel can see the new tail
+	atomic_u32_store(us->sq_tail, *us->sq_tail + 1);
+
+	us->pending++;
+}
+
+static int reactor_io_uring_reap(struct reactor_io_uring_state *us, void **ready, int ready_len, int *woken)
+{
+	uint32_t head = *us->cq_head;
+	const uint32_t tail = atomic_u32_load(us->cq_tail);
+	struct reactor_io_uring_reg *reg;
+	struct io_uring_cqe *cqe;
+	uint32_t fd;
+	int i = 0;
+
+	*woken = 0;
+
+	for (; head != tail && i < ready_len; head++)
+	{
+		cqe = &us->cqes[head & us->cq_mask];
+
+		if (cqe->user_data == REACTOR_IO_URING_WAKE)
+		{
+			// Leave the wake completion in place so that every waiting thread
+			// sees it
+			*woken = 1;
+			break;
+		}
+		else if (cqe->user_data == REACTOR_IO_URING_IGNORE)
+		{
+			continue;
+		}
+
+		fd = (uint32_t)cqe->user_data;
+		if (fd >= us->regs_len)
+		{
+			continue;
+		}
+
+		reg = &us->regs[fd];
+		if (reg->ctx == NULL || reg->gen != (uint32_t)(cqe->user_data >> 32))
+		{
+			continue;
+		}
+
+		reg->armed = 0;
+		ready[i++] = reg->ctx;
+	}
+
+	atomic_u32_store(us->cq_head, head);
+
+	return i;
+}
+
+static int reactor_io_uring_rearm(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_io_uring_state *us = (struct reactor_io_uring_state *)state;
+	int ret = 0;
+
+	mutex_lock(&us->mutex);
+
+	if (fd < 0 || (size_t)fd >= us->regs_len || us->regs[fd].ctx != ctx)
+	{
+		ret = -ENOENT;
+	}
+	else if (!us->regs[fd].armed)
+	{
+		ret = reactor_io_uring_poll(us, fd);
+	}
+
+	mutex_unlock(&us->mutex);
+
+	return ret;
+}
+
+static int reactor_io_uring_wait(void *state, void **ready, int ready_len)
+{
+	struct reactor_io_uring_state *us = (struct reactor_io_uring_state *)state;
+	uint32_t to_submit;
+	int woken;
+	int ret;
+
+	mutex_lock(&us->mutex);
+
+	ret = reactor_io_uring_reap(us, ready, ready_len, &woken);
+
+	to_submit = us->pending;
+	us->pending = 0;
+
+	mutex_unlock(&us->mutex);
+
+	if (woken)
+	{
+		return ret;
+	}
+
+	// Polls re-armed while dispatching the last batch are submitted together,
+	// and if nothing is ready yet, in the same call that waits for completions
+	if (to_submit > 0 || ret == 0)
+	{
+		int submitted = reactor_io_uring_enter(us->ring_fd, to_submit, ret == 0 ? 1 : 0, ret == 0 ? IORING_ENTER_GETEVENTS : 0);
+
+		if (submitted < 0 || (uint32_t)submitted < to_submit)
+		{
+			mutex_lock(&us->mutex);
+			us->pending += to_submit - (submitted < 0 ? 0 : (uint32_t)submitted);
+			mutex_unlock(&us->mutex);
+		}
+
+		if (submitted < 0 && submitted != -EBUSY && submitted != -EAGAIN)
+		{
+			return ret > 0 ? ret : submitted;
+		}
+	}
+
+	if (ret == 0)
+	{
+		mutex_lock(&us->mutex);
+		ret = reactor_io_uring_reap(us, ready, ready_len, &woken);
+		mutex_unlock(&us->mutex);
+	}
+
+	return ret;
+}
+
+static void reactor_io_uring_wake(void *state)
+{
+	struct reactor_io_uring_state *us = (struct reactor_io_uring_state *)state;
+	struct io_uring_sqe *sqe;
+
+	mutex_lock(&us->mutex);
+
+	sqe = reactor_io_uring_get_sqe(us);
+	if (sqe != NULL)
+	{
+		sqe->opcode = IORING_OP_NOP;
+		sqe->fd = -1;
+		sqe->user_data = REACTOR_IO_URING_WAKE;
+
+		reactor_io_uring_queue(us);
+
+		reactor_io_uring_flush(us);
+	}
+
+	mutex_unlock(&us->mutex);
+}
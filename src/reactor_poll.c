@@ -0,0 +1,534 @@
+/*!
+ * @file reactor_poll.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Portable reactor backend using poll or WSAPoll
+ */
+
+#include "mutex.h"
+#include "reactor_backend.h"
+
+#ifdef _WIN32
+#  include "conn_wsa_errno.h"
+#  include <winsock2.h>
+#else
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+/// Poll the given descriptors for events
+#  define poll(...) WSAPoll(__VA_ARGS__)
+
+/*!
+ * @brief Milliseconds to wait before re-building the descriptor set
+ *
+ * There is no portable way to interrupt WSAPoll, so descriptors which are
+ * added or removed from other threads are noticed after this period.
+ */
+#  define REACTOR_POLL_TIMEOUT 100
+
+/// Last socket function error value
+#  define SOCK_ERRNO -conn_wsa_errno()
+#else
+/// Wait indefinitely, since the wake pipe is used to interrupt poll
+#  define REACTOR_POLL_TIMEOUT -1
+
+/// Last socket function error value
+#  define SOCK_ERRNO -errno
+
+/// Socket handle type
+typedef int SOCKET;
+#endif
+
+/*!
+ * @brief Descriptor registered with a poll reactor backend
+ */
+struct reactor_poll_entry
+{
+	/// Non-zero if the descriptor should be polled
+	uint8_t armed;
+
+	/// Value to report when the descriptor is ready
+	void *ctx;
+
+	/// Native socket descriptor
+	SOCKET fd;
+};
+
+/*!
+ * @brief State of a poll reactor backend
+ */
+struct reactor_poll_state
+{
+	/// Registered descriptors
+	struct reactor_poll_entry *entries;
+
+	/// Number of valid elements in reactor_poll_state::entries
+	size_t entries_len;
+
+	/// Number of allocated elements in reactor_poll_state::entries
+	size_t entries_size;
+
+	/// Values corresponding with each of reactor_poll_state::fds
+	void **fd_ctx;
+
+	/// Descriptor set given to poll, only used by the waiting thread
+	struct pollfd *fds;
+
+	/// Number of allocated elements in reactor_poll_state::fds
+	size_t fds_size;
+
+	/// Mutex for protecting the backend state
+	struct mutex_handle mutex;
+
+	/// Non-zero after ::reactor_poll_wake has been called
+	uint8_t woken;
+
+#ifndef _WIN32
+	/// Pipe used to interrupt poll
+	int wake_pipe[2];
+#endif
+};
+
+/*!
+ * @brief Register a descriptor and arm it
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value to report when the descriptor is ready
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_poll_add(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Unregister a descriptor
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value given when the descriptor was registered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_poll_del(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Frees the backend state
+ *
+ * @param[in,out] state Backend state
+ */
+static void reactor_poll_free(void *state);
+
+/*!
+ * @brief Allocates and initializes the backend state
+ *
+ * @param[out] state Resulting backend state
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_poll_init(void **state);
+
+/*!
+ * @brief Interrupt a thread blocked in ::reactor_poll_wait
+ *
+ * @param[in,out] ps Backend state
+ */
+static void reactor_poll_interrupt(struct reactor_poll_state *ps);
+
+/*!
+ * @brief Re-arm a descriptor which was reported as ready
+ *
+ * @param[in,out] state Backend state
+ * @param[in] fd Native socket descriptor
+ * @param[in] ctx Value given when the descriptor was registered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int reactor_poll_rearm(void *state, intptr_t fd, void *ctx);
+
+/*!
+ * @brief Block until one or more descriptors are ready
+ *
+ * @param[in,out] state Backend state
+ * @param[out] ready Values given with each of the ready descriptors
+ * @param[in] ready_len Maximum number of values to store in ready
+ *
+ * @returns Number of values stored in ready, negative ERRNO value on failure
+ */
+static int reactor_poll_wait(void *state, void **ready, int ready_len);
+
+/*!
+ * @brief Permanently wake all threads blocked in ::reactor_poll_wait
+ *
+ * @param[in,out] state Backend state
+ */
+static void reactor_poll_wake(void *state);
+
+/*
+ * Descriptors are only re-armed by the dispatching thread between calls to
+ * ::reactor_poll_wait, so a single thread never needs to be interrupted to
+ * notice them.
+ */
+const struct reactor_backend reactor_backend_poll =
+{
+	.name = "poll",
+	.single_thread = 1,
+	.add = reactor_poll_add,
+	.del = reactor_poll_del,
+	.free = reactor_poll_free,
+	.init = reactor_poll_init,
+	.rearm = reactor_poll_rearm,
+	.wait = reactor_poll_wait,
+	.wake = reactor_poll_wake,
+};
+
+static int reactor_poll_add(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_poll_state *ps = (struct reactor_poll_state *)state;
+	int ret = 0;
+
+	mutex_lock(&ps->mutex);
+
+	if (ps->entries_len >= ps->entries_size)
+	{
+		size_t new_size = ps->entries_size == 0 ? 16 : ps->entries_size * 2;
+		struct reactor_poll_entry *new_entries;
+
+		new_entries = realloc(ps->entries, sizeof(struct reactor_poll_entry) * new_size);
+		if (new_entries == NULL)
+		{
+			ret = -ENOMEM;
+			goto reactor_poll_add_exit;
+		}
+
+		ps->entries = new_entries;
+		ps->entries_size = new_size;
+	}
+
+	ps->entries[ps->entries_len].armed = 1;
+	ps->entries[ps->entries_len].ctx = ctx;
+	ps->entries[ps->entries_len].fd = (SOCKET)fd;
+	ps->entries_len++;
+
+reactor_poll_add_exit:
+	mutex_unlock(&ps->mutex);
+
+	if (ret == 0)
+	{
+		reactor_poll_interrupt(ps);
+	}
+
+	return ret;
+}
+
+static int reactor_poll_del(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_poll_state *ps = (struct reactor_poll_state *)state;
+	size_t i;
+	int ret = -ENOENT;
+
+	(void)fd;
+
+	mutex_lock(&ps->mutex);
+
+	for (i = 0; i < ps->entries_len; i++)
+	{
+		if (ps->entries[i].ctx == ctx)
+		{
+			ps->entries[i] = ps->entries[--ps->entries_len];
+			ret = 0;
+			break;
+		}
+	}
+
+	mutex_unlock(&ps->mutex);
+
+	// The descriptor may be closed as soon as this returns, so make sure
+	// that it is no longer being polled
+	if (ret == 0)
+	{
+		reactor_poll_interrupt(ps);
+	}
+
+	return ret;
+}
+
+static void reactor_poll_free(void *state)
+{
+	struct reactor_poll_state *ps = (struct reactor_poll_state *)state;
+
+#ifndef _WIN32
+	close(ps->wake_pipe[0]);
+	close(ps->wake_pipe[1]);
+#endif
+
+	mutex_free(&ps->mutex);
+
+	free(ps->fd_ctx);
+	free(ps->fds);
+	free(ps->entries);
+	free(ps);
+}
+
+static int reactor_poll_init(void **state)
+{
+	struct reactor_poll_state *ps;
+	int ret;
+
+	ps = malloc(sizeof(struct reactor_poll_state));
+	if (ps == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(ps, 0x0, sizeof(struct reactor_poll_state));
+
+	ret = mutex_init(&ps->mutex);
+	if (ret < 0)
+	{
+		goto reactor_poll_init_exit;
+	}
+
+#ifndef _WIN32
+	if (pipe(ps->wake_pipe) != 0)
+	{
+		ret = -errno;
+		goto reactor_poll_init_exit_late;
+	}
+
+	fcntl(ps->wake_pipe[0], F_SETFL, fcntl(ps->wake_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(ps->wake_pipe[1], F_SETFL, fcntl(ps->wake_pipe[1], F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+	*state = ps;
+
+	return 0;
+
+#ifndef _WIN32
+reactor_poll_init_exit_late:
+	mutex_free(&ps->mutex);
+#endif
+
+reactor_poll_init_exit:
+	free(ps);
+
+	return ret;
+}
+
+static void reactor_poll_interrupt(struct reactor_poll_state *ps)
+{
+#ifdef _WIN32
+	(void)ps;
+#else
+	const uint8_t one = 1;
+	ssize_t ret;
+
+	// If the pipe is full, the waiting thread will already wake up
+	ret = write(ps->wake_pipe[1], &one, 1);
+	(void)ret;
+#endif
+}
+
+static int reactor_poll_rearm(void *state, intptr_t fd, void *ctx)
+{
+	struct reactor_poll_state *ps = (struct reactor_poll_state *)state;
+	size_t i;
+	int ret = -ENOENT;
+
+	(void)fd;
+
+	mutex_lock(&ps->mutex);
+
+	for (i = 0; i < ps->entries_len; i++)
+	{
+		if (ps->entries[i].ctx == ctx)
+		{
+			ps->entries[i].armed = 1;
+			ret = 0;
+			break;
+		}
+	}
+
+	mutex_unlock(&ps->mutex);
+
+	return ret;
+}
+
+static int reactor_poll_wait(void *state, void **ready, int ready_len)
+{
+	struct reactor_poll_state *ps = (struct reactor_poll_state *)state;
+	size_t num_fds = 0;
+	size_t i;
+	size_t j;
+	int ret;
+
+	mutex_lock(&ps->mutex);
+
+	if (ps->woken)
+	{
+		mutex_unlock(&ps->mutex);
+
+		return 0;
+	}
+
+	// Room for every entry and the wake pipe
+	if (ps->fds_size < ps->entries_len + 1)
+	{
+		size_t new_size = ps->entries_size + 1;
+		struct pollfd *new_fds;
+		void **new_fd_ctx;
+
+		new_fds = realloc(ps->fds, sizeof(struct pollfd) * new_size);
+		if (new_fds == NULL)
+		{
+			mutex_unlock(&ps->mutex);
+
+			return -ENOMEM;
+		}
+
+		ps->fds = new_fds;
+
+		new_fd_ctx = realloc(ps->fd_ctx, sizeof(void *) * new_size);
+		if (new_fd_ctx == NULL)
+		{
+			mutex_unlock(&ps->mutex);
+
+			return -ENOMEM;
+		}
+
+		ps->fd_ctx = new_fd_ctx;
+		ps->fds_size = new_size;
+	}
+
+	for (i = 0; i < ps->entries_len; i++)
+	{
+		if (ps->entries[i].armed)
+		{
+			ps->fds[num_fds].fd = ps->entries[i].fd;
+			ps->fds[num_fds].events = POLLIN;
+			ps->fds[num_fds].revents = 0;
+			ps->fd_ctx[num_fds] = ps->entries[i].ctx;
+			num_fds++;
+		}
+	}
+
+#ifndef _WIN32
+	ps->fds[num_fds].fd = ps->wake_pipe[0];
+	ps->fds[num_fds].events = POLLIN;
+	ps->fds[num_fds].revents = 0;
+	ps->fd_ctx[num_fds] = NULL;
+	num_fds++;
+#endif
+
+	mutex_unlock(&ps->mutex);
+
+#ifdef _WIN32
+	// WSAPoll fails when given no descriptors
+	if (num_fds == 0)
+	{
+		Sleep(REACTOR_POLL_TIMEOUT);
+
+		return 0;
+	}
+#endif
+
+	ret = poll(ps->fds, (unsigned long)num_fds, REACTOR_POLL_TIMEOUT);
+	if (ret < 0)
+	{
+		ret = SOCK_ERRNO;
+
+		return ret == -EINTR ? 0 : ret;
+	}
+
+	mutex_lock(&ps->mutex);
+
+	for (i = 0, ret = 0; i < num_fds && ret < ready_len; i++)
+	{
+		if (ps->fds[i].revents == 0)
+		{
+			continue;
+		}
+
+		if (ps->fd_ctx[i] == NULL)
+		{
+#ifndef _WIN32
+			uint8_t drain[64];
+
+			while (read(ps->wake_pipe[0], drain, sizeof(drain)) > 0);
+#endif
+
+			continue;
+		}
+
+		// Only report descriptors which are still registered and armed
+		for (j = 0; j < ps->entries_len; j++)
+		{
+			if (ps->entries[j].ctx == ps->fd_ctx[i] && ps->entries[j].armed)
+			{
+				ps->entries[j].armed = 0;
+				ready[ret++] = ps->fd_ctx[i];
+				break;
+			}
+		}
+	}
+
+	mutex_unlock(&ps->mutex);
+
+	return ret;
+}
+
+static void reactor_poll_wake(void *state)
+{
+	struct reactor_poll_state *ps = (struct reactor_poll_state *)state;
+
+	mutex_lock(&ps->mutex);
+	ps->woken = 1;
+	mutex_unlock(&ps->mutex);
+
+	reactor_poll_interrupt(ps);
+}
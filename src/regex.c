@@ -49,6 +49,7 @@
 #include <pcre2.h>
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -59,8 +60,228 @@ struct regex_priv
 {
 	/// Perl Compatible Regular Expression
 	pcre2_code *re;
+
+	/// Hash table of the strings matched by the pattern when it is an
+	/// anchored alternation of literals, in which case regex_priv::re is NULL
+	const char **literals;
+
+	/// Number of entries in regex_priv::literals, which is a power of two
+	size_t literals_size;
+
+	/// Storage for the strings in regex_priv::literals
+	char *literals_buff;
 };
 
+/*!
+ * @brief Compiles a pattern which matches only a set of literal strings
+ *
+ * Patterns of the form `^(A|B|C)$`, `^(?:A|B|C)$` and `^A$|^B$|^C$` are
+ * handled, where each alternative contains only letters, digits and the
+ * characters `-`, `/` and `_`.
+ *
+ * @param[in,out] priv Private data of the target regular expression instance
+ * @param[in] pattern Regular expression pattern to be compiled
+ *
+ * @returns 0 on success, -EINVAL if the pattern is not of a supported form,
+ *          other negative ERRNO value on failure
+ */
+static int compile_literals(struct regex_priv *priv, const char *pattern);
+
+/*!
+ * @brief Frees the compiled form of the pattern
+ *
+ * @param[in,out] priv Private data of the target regular expression instance
+ */
+static void free_compiled(struct regex_priv *priv);
+
+/*!
+ * @brief Calculates the hash of a string for use in regex_priv::literals
+ *
+ * @param[in] str Null terminated string to hash
+ *
+ * @returns Resulting hash value
+ */
+static uint32_t hash_literal(const char *str);
+
+/*!
+ * @brief Determine if a character matches only itself in a pattern
+ *
+ * @param[in] c Character to check
+ *
+ * @returns 1 if c is a literal character, 0 otherwise
+ */
+static int is_literal_char(char c);
+
+static int compile_literals(struct regex_priv *priv, const char *pattern)
+{
+	size_t len = strlen(pattern);
+	size_t start = 0;
+	size_t end = len;
+	size_t count = 0;
+	size_t size = 1;
+	int grouped = 0;
+	char *alt;
+	char *next;
+	char *lit;
+	size_t lit_len;
+	size_t i;
+
+	if (len < 3 || pattern[0] != '^' || pattern[len - 1] != '$')
+	{
+		return -EINVAL;
+	}
+
+	if (pattern[len - 2] == ')')
+	{
+		if (strncmp(pattern, "^(?:", 4) == 0 && len > 6)
+		{
+			start = 4;
+		}
+		else if (strncmp(pattern, "^(", 2) == 0)
+		{
+			start = 2;
+		}
+		else
+		{
+			return -EINVAL;
+		}
+
+		end = len - 2;
+		grouped = 1;
+	}
+
+	priv->literals_buff = malloc(end - start + 1);
+	if (priv->literals_buff == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memcpy(priv->literals_buff, &pattern[start], end - start);
+	priv->literals_buff[end - start] = '\0';
+
+	// Split the alternatives in place and validate each of them
+	for (alt = priv->literals_buff; alt != NULL; alt = next)
+	{
+		next = strchr(alt, '|');
+		if (next != NULL)
+		{
+			*next++ = '\0';
+		}
+
+		lit = alt;
+		lit_len = strlen(alt);
+
+		if (!grouped)
+		{
+			if (lit_len < 2 || lit[0] != '^' || lit[lit_len - 1] != '$')
+			{
+				goto compile_literals_invalid;
+			}
+
+			lit[lit_len - 1] = '\0';
+			lit++;
+			lit_len -= 2;
+		}
+
+		if (lit_len == 0)
+		{
+			goto compile_literals_invalid;
+		}
+
+		for (i = 0; i < lit_len; i++)
+		{
+			if (!is_literal_char(lit[i]))
+			{
+				goto compile_literals_invalid;
+			}
+		}
+
+		count++;
+	}
+
+	// Keep the table at most half full
+	while (size < 2 * count)
+	{
+		size *= 2;
+	}
+
+	priv->literals = calloc(size, sizeof(const char *));
+	if (priv->literals == NULL)
+	{
+		free(priv->literals_buff);
+		priv->literals_buff = NULL;
+
+		return -ENOMEM;
+	}
+
+	priv->literals_size = size;
+
+	for (alt = priv->literals_buff; count > 0; count--)
+	{
+		// Skip the leading anchor, and the null which replaced the trailing
+		// anchor of the previous alternative
+		while (*alt == '\0' || *alt == '^')
+		{
+			alt++;
+		}
+
+		for (i = hash_literal(alt) & (size - 1); priv->literals[i] != NULL; i = (i + 1) & (size - 1))
+		{
+			if (strcmp(priv->literals[i], alt) == 0)
+			{
+				break;
+			}
+		}
+
+		priv->literals[i] = alt;
+
+		alt += strlen(alt);
+	}
+
+	return 0;
+
+compile_literals_invalid:
+	free(priv->literals_buff);
+	priv->literals_buff = NULL;
+
+	return -EINVAL;
+}
+
+static void free_compiled(struct regex_priv *priv)
+{
+	if (priv->re != NULL)
+	{
+		pcre2_code_free(priv->re);
+		priv->re = NULL;
+	}
+
+	free(priv->literals);
+	priv->literals = NULL;
+	priv->literals_size = 0;
+
+	free(priv->literals_buff);
+	priv->literals_buff = NULL;
+}
+
+static uint32_t hash_literal(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	// FNV-1a
+	for (; *str != '\0'; str++)
+	{
+		hash ^= (uint8_t)*str;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int is_literal_char(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '/' || c == '_';
+}
+
 int regex_compile(struct regex_handle *re, const char *pattern)
 {
 	struct regex_priv *priv = (struct regex_priv *)re->priv;
@@ -68,9 +289,12 @@ int regex_compile(struct regex_handle *re, const char *pattern)
 	PCRE2_SIZE erroroffset;
 	int ret;
 
-	if (priv->re != NULL)
+	free_compiled(priv);
+
+	ret = compile_literals(priv, pattern);
+	if (ret != -EINVAL)
 	{
-		pcre2_code_free(priv->re);
+		return ret;
 	}
 
 	priv->re = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, 0, &errorcode, &erroroffset, NULL);
@@ -80,14 +304,16 @@ int regex_compile(struct regex_handle *re, const char *pattern)
 		goto regex_compile_exit;
 	}
 
+#ifdef HAVE_PCRE_JIT
+	// If the JIT isn't available on this platform, matching falls back to
+	// the interpreter
+	pcre2_jit_compile(priv->re, PCRE2_JIT_COMPLETE);
+#endif
+
 	return 0;
 
 regex_compile_exit:
-	if (priv->re != NULL)
-	{
-		pcre2_code_free(priv->re);
-		priv->re = NULL;
-	}
+	free_compiled(priv);
 
 	return ret;
 }
@@ -98,10 +324,7 @@ void regex_free(struct regex_handle *re)
 	{
 		struct regex_priv *priv = (struct regex_priv *)re->priv;
 
-		if (priv->re != NULL)
-		{
-			pcre2_code_free(priv->re);
-		}
+		free_compiled(priv);
 
 		free(re->priv);
 		re->priv = NULL;
@@ -129,10 +352,32 @@ int regex_is_match(struct regex_handle *re, const char *subject)
 {
 	struct regex_priv *priv = (struct regex_priv *)re->priv;
 	PCRE2_SPTR sub = (PCRE2_SPTR)subject;
-	size_t sub_len = strlen(subject);
-	pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(priv->re, NULL);
+	size_t sub_len;
+	pcre2_match_data *match_data;
+	size_t i;
 	int ret;
 
+	if (priv->literals != NULL)
+	{
+		for (i = hash_literal(subject) & (priv->literals_size - 1); priv->literals[i] != NULL; i = (i + 1) & (priv->literals_size - 1))
+		{
+			if (strcmp(priv->literals[i], subject) == 0)
+			{
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	if (priv->re == NULL)
+	{
+		return -EINVAL;
+	}
+
+	sub_len = strlen(subject);
+
+	match_data = pcre2_match_data_create_from_pattern(priv->re, NULL);
 	if (match_data == NULL)
 	{
 		return -EINVAL;
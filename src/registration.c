@@ -46,12 +46,14 @@
 
 #include "openelp/openelp.h"
 
+#include "clock.h"
 #include "digest.h"
 #include "conn.h"
 #include "mutex.h"
 #include "registration.h"
 #include "thread.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -63,6 +65,24 @@
 /// Update (at least) every 10 minutes
 #define UPDATE_INTERVAL 600000
 
+/// Collect changes for 2 seconds before reporting them
+#define UPDATE_DEBOUNCE 2000
+
+/// Wait 5 seconds before retrying the first failed update
+#define BACKOFF_MIN 5000
+
+/// Never wait more than 5 minutes before retrying a failed update
+#define BACKOFF_MAX 300000
+
+/// Look up the registration server's address again after an hour
+#define HOST_CACHE_TTL 3600000
+
+/// Give up on a response from the registration server after 10 seconds
+#define RESPONSE_TIMEOUT 10000000
+
+/// Largest response header accepted from the registration server
+#define RESPONSE_HEADER_MAX 2048
+
 enum REGISTRATION_STATUS
 {
 	REGISTRATION_STATUS_READY,
@@ -75,6 +95,8 @@ enum REGISTRATION_FLAGS
 	REGISTRATION_FLAGS_NONE = 0,
 	REGISTRATION_FLAG_SENTINEL = (1 << 0),
 	REGISTRATION_FLAG_UPDATE = (1 << 1),
+	REGISTRATION_FLAG_REFRESH = (1 << 2),
+	REGISTRATION_FLAG_ABANDON = (1 << 3),
 };
 
 struct registration_service_priv
@@ -85,13 +107,18 @@ struct registration_service_priv
 
 	char public;
 	const char *reg_name;
-	const char *reg_comment;
+	char *reg_comment;
 	const char *reg_suffix;
 
 	size_t slots_total;
 	size_t slots_used;
 	enum REGISTRATION_STATUS status;
 	enum REGISTRATION_FLAGS flags;
+
+	// Only used by the registration thread
+	struct conn_handle conn;
+	uint32_t host_addr;
+	uint64_t host_expires;
 };
 
 static const char http_message[] =
@@ -119,26 +146,199 @@ static const char *status_phrase[] = {
 
 static void * registration_thread(void *ctx);
 
+static uint64_t now_ms(void)
+{
+	return clock_now_us() / 1000;
+}
+
+static const char * find_header(const char *headers, const char *name)
+{
+	size_t name_len = strlen(name);
+	size_t i;
+
+	// Skip the status line
+	headers = strstr(headers, "\r\n");
+
+	while (headers != NULL && headers[2] != '\r')
+	{
+		headers += 2;
+
+		for (i = 0; i < name_len && tolower((unsigned char)headers[i]) == tolower((unsigned char)name[i]); i++);
+
+		if (i == name_len && headers[i] == ':')
+		{
+			for (headers += i + 1; *headers == ' ' || *headers == '\t'; headers++);
+
+			return headers;
+		}
+
+		headers = strstr(headers, "\r\n");
+	}
+
+	return NULL;
+}
+
+static int connect_server(struct registration_service_handle *rs)
+{
+	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
+	int ret;
+
+	if (priv->host_expires == 0)
+	{
+		ret = conn_resolve(http_host, &priv->host_addr);
+		if (ret < 0)
+		{
+			return ret;
+		}
+
+		priv->host_expires = now_ms() + HOST_CACHE_TTL;
+	}
+
+	ret = conn_connect_to(&priv->conn, priv->host_addr, 80);
+	if (ret < 0)
+	{
+		// The server may have moved
+		priv->host_expires = 0;
+	}
+
+	return ret;
+}
+
+static void refresh_host(struct registration_service_handle *rs)
+{
+	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
+	uint32_t host_addr;
+
+	if (priv->host_expires == 0 || now_ms() < priv->host_expires)
+	{
+		return;
+	}
+
+	// This is done after a report has been sent, so a slow lookup doesn't
+	// delay the report. If the lookup fails, keep using the old address.
+	if (conn_resolve(http_host, &host_addr) == 0)
+	{
+		priv->host_addr = host_addr;
+	}
+
+	priv->host_expires = now_ms() + HOST_CACHE_TTL;
+}
+
+static int recv_response(struct registration_service_handle *rs, int *keep_alive)
+{
+	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
+	char buff[RESPONSE_HEADER_MAX + 1];
+	size_t len = 0;
+	size_t header_len;
+	const char *end;
+	const char *value;
+	unsigned long content_len;
+	int ret;
+
+	*keep_alive = 0;
+
+	// Read until the end of the headers
+	while (1)
+	{
+		if (len >= RESPONSE_HEADER_MAX)
+		{
+			return -EMSGSIZE;
+		}
+
+		ret = conn_poll(&priv->conn, RESPONSE_TIMEOUT);
+		if (ret <= 0)
+		{
+			return ret == 0 ? -ETIMEDOUT : ret;
+		}
+
+		ret = conn_recv_some(&priv->conn, (uint8_t *)&buff[len], RESPONSE_HEADER_MAX - len);
+		if (ret < 0)
+		{
+			return ret;
+		}
+
+		len += ret;
+		buff[len] = '\0';
+
+		end = strstr(buff, "\r\n\r\n");
+		if (end != NULL)
+		{
+			break;
+		}
+	}
+
+	if (strncmp(buff, "HTTP/1.1 200 ", 13) != 0)
+	{
+		return -EINVAL;
+	}
+
+	header_len = (size_t)(end - buff) + 4;
+
+	// The connection can only be used again if the end of the body is known
+	value = find_header(buff, "Content-Length");
+	if (value == NULL || sscanf(value, "%lu", &content_len) != 1)
+	{
+		return 0;
+	}
+
+	value = find_header(buff, "Connection");
+	if (value != NULL && strncmp(value, "close", 5) == 0)
+	{
+		return 0;
+	}
+
+	// Discard the body, some of which may have arrived with the headers
+	len -= header_len;
+	content_len = len < content_len ? content_len - len : 0;
+
+	while (content_len > 0)
+	{
+		ret = conn_poll(&priv->conn, RESPONSE_TIMEOUT);
+		if (ret <= 0)
+		{
+			return ret == 0 ? -ETIMEDOUT : ret;
+		}
+
+		ret = conn_recv_some(&priv->conn, (uint8_t *)buff, content_len < RESPONSE_HEADER_MAX ? content_len : RESPONSE_HEADER_MAX);
+		if (ret < 0)
+		{
+			return ret;
+		}
+
+		content_len -= ret;
+	}
+
+	*keep_alive = 1;
+
+	return 0;
+}
+
 static int send_report(struct registration_service_handle *rs, enum REGISTRATION_STATUS status, size_t slots_used, size_t slots_total)
 {
 	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
-	struct conn_handle conn;
+	struct conn_iov iov[2];
 	int ret = 0;
 	int header_length;
 	int body_length = 0;
+	int attempt;
+	int reused;
+	int keep_alive = 0;
 	char message_header[sizeof(http_message) + 14];
 	char *message_body = NULL;
 
-	memset(&conn, 0x0, sizeof(struct conn_handle));
-
 	//printf("Updating registration (%s %s, %zu/%zu)\n", priv->reg_name, status_phrase[status], slots_used, slots_total);
 
 	// TODO: URL encoding
 
+	// The comment may be replaced while the proxy is running
+	mutex_lock(&priv->mutex);
+
 	// Allocate a buffer we *know* will be big enough for the body
 	message_body = malloc(110 + sizeof(protocol_version) + strlen(priv->reg_name) + strlen(priv->reg_comment));
 	if (message_body == NULL)
 	{
+		mutex_unlock(&priv->mutex);
+
 		return -ENOMEM;
 	}
 
@@ -146,6 +346,9 @@ static int send_report(struct registration_service_handle *rs, enum REGISTRATION
 		message_body, "name=%s&comment=%s [%zu/%zu]&public=%c&status=%s%s",
 		priv->reg_name, priv->reg_comment, slots_used, slots_total,
 		priv->public, status_phrase[status], priv->reg_suffix);
+
+	mutex_unlock(&priv->mutex);
+
 	if (body_length <= 0)
 	{
 		ret = -EINVAL; // TODO
@@ -159,45 +362,51 @@ static int send_report(struct registration_service_handle *rs, enum REGISTRATION
 		goto registration_update_exit;
 	}
 
-	conn.type = CONN_TYPE_TCP;
-	ret = conn_init(&conn);
-	if (ret < 0)
-	{
-		goto registration_update_exit;
-	}
+	iov[0].buff = (const uint8_t *)message_header;
+	iov[0].len = header_length;
+	iov[1].buff = (const uint8_t *)message_body;
+	iov[1].len = body_length;
 
-	ret = conn_connect(&conn, http_host, "80");
-	if (ret < 0)
+	// A connection left open by the last report is used again, unless the
+	// server has since closed it. If sending on it fails anyway, try once
+	// more with a new connection.
+	if (conn_in_use(&priv->conn) && conn_poll(&priv->conn, 0) != 0)
 	{
-		goto registration_update_exit;
+		conn_close(&priv->conn);
 	}
 
-	ret = conn_send(&conn, (uint8_t *)message_header, header_length);
-	if (ret < 0)
+	for (attempt = 0; attempt < 2; attempt++)
 	{
-		goto registration_update_exit;
-	}
+		reused = conn_in_use(&priv->conn);
+		if (!reused)
+		{
+			ret = connect_server(rs);
+			if (ret < 0)
+			{
+				break;
+			}
+		}
 
-	ret = conn_send(&conn, (uint8_t *)message_body, body_length);
-	if (ret < 0)
-	{
-		goto registration_update_exit;
-	}
+		ret = conn_sendv(&priv->conn, iov, 2);
+		if (ret == 0)
+		{
+			ret = recv_response(rs, &keep_alive);
+		}
 
-	ret = conn_recv(&conn, (uint8_t *)message_body, 13);
-	if (ret < 0)
-	{
-		goto registration_update_exit;
-	}
+		if (ret == 0 && keep_alive)
+		{
+			break;
+		}
 
-	if (strncmp(message_body, "HTTP/1.1 200 ", 13) != 0)
-	{
-		ret = -EINVAL;
+		conn_close(&priv->conn);
+
+		if (ret == 0 || ret == -EINVAL || !reused)
+		{
+			break;
+		}
 	}
 
 registration_update_exit:
-	conn_free(&conn);
-
 	free(message_body);
 
 	return ret;
@@ -212,10 +421,12 @@ void registration_service_free(struct registration_service_handle *rs)
 		registration_service_stop(rs);
 
 		thread_free(&priv->thread);
+		conn_free(&priv->conn);
 		mutex_free(&priv->mutex);
 		condvar_free(&priv->condvar);
 
 		free((void *)priv->reg_suffix);
+		free(priv->reg_comment);
 
 		free(rs->priv);
 		rs->priv = NULL;
@@ -253,6 +464,13 @@ int registration_service_init(struct registration_service_handle *rs)
 		goto registration_service_init_exit;
 	}
 
+	priv->conn.type = CONN_TYPE_TCP;
+	ret = conn_init(&priv->conn);
+	if (ret != 0)
+	{
+		goto registration_service_init_exit;
+	}
+
 	ret = thread_init(&priv->thread);
 	if (ret != 0)
 	{
@@ -267,6 +485,7 @@ int registration_service_init(struct registration_service_handle *rs)
 
 registration_service_init_exit:
 	thread_free(&priv->thread);
+	conn_free(&priv->conn);
 	mutex_free(&priv->mutex);
 	condvar_free(&priv->condvar);
 
@@ -276,6 +495,40 @@ registration_service_init_exit:
 	return ret;
 }
 
+int registration_service_set_comment(struct registration_service_handle *rs, const char *comment)
+{
+	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
+	size_t len = comment == NULL ? 0 : strlen(comment);
+	char *copy;
+
+	copy = malloc(len + 1);
+	if (copy == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	if (len > 0)
+	{
+		memcpy(copy, comment, len);
+	}
+	copy[len] = '\0';
+
+	mutex_lock(&priv->mutex);
+
+	free(priv->reg_comment);
+	priv->reg_comment = copy;
+
+	if (!(priv->flags & REGISTRATION_FLAG_SENTINEL))
+	{
+		priv->flags |= REGISTRATION_FLAG_UPDATE | REGISTRATION_FLAG_REFRESH;
+		condvar_wake_all(&priv->condvar);
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return 0;
+}
+
 int registration_service_start(struct registration_service_handle *rs, const struct proxy_conf *conf)
 {
 	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
@@ -294,7 +547,16 @@ int registration_service_start(struct registration_service_handle *rs, const str
 	priv->public = strcmp(conf->password, "PUBLIC") == 0 ? 'Y' : 'N';
 
 	priv->reg_name = conf->reg_name;
-	priv->reg_comment = conf->reg_comment;
+
+	mutex_unlock(&priv->mutex);
+
+	ret = registration_service_set_comment(rs, conf->reg_comment);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	mutex_lock(&priv->mutex);
 
 	if (priv->reg_suffix != NULL)
 	{
@@ -307,7 +569,7 @@ int registration_service_start(struct registration_service_handle *rs, const str
 		goto registration_service_start_end;
 	}
 
-	priv->flags &= ~REGISTRATION_FLAG_SENTINEL;
+	priv->flags &= ~(REGISTRATION_FLAG_SENTINEL | REGISTRATION_FLAG_ABANDON);
 
 	ret = sprintf(reg_suffix, "%s%s%s", priv->reg_name, public_addr, digest_salt);
 	if (ret < 0)
@@ -344,6 +606,18 @@ registration_service_start_end:
 	return ret;
 }
 
+int registration_service_abandon(struct registration_service_handle *rs)
+{
+	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
+
+	mutex_lock(&priv->mutex);
+	priv->flags |= REGISTRATION_FLAG_SENTINEL | REGISTRATION_FLAG_ABANDON;
+	condvar_wake_all(&priv->condvar);
+	mutex_unlock(&priv->mutex);
+
+	return thread_join(&priv->thread);
+}
+
 int registration_service_stop(struct registration_service_handle *rs)
 {
 	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
@@ -361,10 +635,13 @@ void registration_service_update(struct registration_service_handle *rs, size_t
 {
 	struct registration_service_priv *priv = (struct registration_service_priv *)rs->priv;
 
+	enum REGISTRATION_STATUS status = slots_used >= slots_total ? REGISTRATION_STATUS_BUSY : REGISTRATION_STATUS_READY;
+
 	mutex_lock(&priv->mutex);
-	if (!(priv->flags & REGISTRATION_FLAG_SENTINEL))
+	if (!(priv->flags & REGISTRATION_FLAG_SENTINEL) &&
+		(status != priv->status || slots_used != priv->slots_used || slots_total != priv->slots_total))
 	{
-		priv->status = slots_used >= slots_total ? REGISTRATION_STATUS_BUSY : REGISTRATION_STATUS_READY;
+		priv->status = status;
 		priv->slots_used = slots_used;
 		priv->slots_total = slots_total;
 		priv->flags |= REGISTRATION_FLAG_UPDATE;
@@ -383,37 +660,105 @@ static void * registration_thread(void *ctx)
 	size_t slots_total;
 	size_t slots_used;
 	enum REGISTRATION_STATUS status;
+	size_t sent_slots_total = 0;
+	size_t sent_slots_used = 0;
+	enum REGISTRATION_STATUS sent_status = REGISTRATION_STATUS_OFF;
+	unsigned int failures = 0;
+	uint8_t refresh;
+	uint32_t backoff;
+	uint64_t refresh_time = 0;
+	uint64_t retry_time;
+	uint64_t settle_time;
+	uint64_t now;
 
 	mutex_lock(&priv->mutex);
 
 	while (1)
 	{
+		if (priv->flags & REGISTRATION_FLAG_ABANDON)
+		{
+			break;
+		}
+
 		slots_total = priv->slots_total;
 		slots_used = priv->slots_used;
 		status = priv->status;
-		priv->flags &= ~REGISTRATION_FLAG_UPDATE;
+		refresh = (priv->flags & REGISTRATION_FLAG_REFRESH) != 0;
+		priv->flags &= ~(REGISTRATION_FLAG_UPDATE | REGISTRATION_FLAG_REFRESH);
 
-		mutex_unlock(&priv->mutex);
-		ret = send_report(rs, status, slots_used, slots_total);
-		if (ret < 0)
+		// Changes which were undone before settling need not be reported
+		if (failures > 0 || refresh || (priv->flags & REGISTRATION_FLAG_SENTINEL) || now_ms() >= refresh_time ||
+			status != sent_status || slots_used != sent_slots_used || slots_total != sent_slots_total)
+		{
+			mutex_unlock(&priv->mutex);
+			ret = send_report(rs, status, slots_used, slots_total);
+			if (ret < 0)
+			{
+				//printf("Proxy registration failed (%d): %s\n", -ret, strerror(-ret));
+			}
+			refresh_host(rs);
+			mutex_lock(&priv->mutex);
+
+			if (ret < 0)
+			{
+				failures++;
+			}
+			else
+			{
+				failures = 0;
+				sent_slots_total = slots_total;
+				sent_slots_used = slots_used;
+				sent_status = status;
+				refresh_time = now_ms() + UPDATE_INTERVAL;
+			}
+		}
+
+		if (priv->flags & REGISTRATION_FLAG_SENTINEL)
 		{
-			//printf("Proxy registration failed (%d): %s\n", -ret, strerror(-ret));
+			// The final report is sent even while backing off
+			if (priv->flags & REGISTRATION_FLAG_UPDATE)
+			{
+				continue;
+			}
+
+			break;
 		}
-		mutex_lock(&priv->mutex);
 
-		if (priv->flags & REGISTRATION_FLAG_UPDATE)
+		if (failures == 0)
 		{
+			while (!(priv->flags & REGISTRATION_FLAG_UPDATE) && (now = now_ms()) < refresh_time)
+			{
+				condvar_wait_time(&priv->condvar, &priv->mutex, (uint32_t)(refresh_time - now));
+			}
+
+			// Let a burst of connects and disconnects settle into one report
+			settle_time = now_ms() + UPDATE_DEBOUNCE;
+
+			while ((priv->flags & REGISTRATION_FLAG_UPDATE) && !(priv->flags & REGISTRATION_FLAG_SENTINEL) &&
+				(now = now_ms()) < settle_time)
+			{
+				condvar_wait_time(&priv->condvar, &priv->mutex, (uint32_t)(settle_time - now));
+			}
+
 			continue;
 		}
 
-		if (priv->flags & REGISTRATION_FLAG_SENTINEL)
+		backoff = failures > 7 ? BACKOFF_MAX : BACKOFF_MIN << (failures - 1);
+		if (backoff > BACKOFF_MAX)
 		{
-			break;
+			backoff = BACKOFF_MAX;
 		}
 
-		condvar_wait_time(&priv->condvar, &priv->mutex, UPDATE_INTERVAL);
+		retry_time = now_ms() + backoff;
+
+		while (!(priv->flags & REGISTRATION_FLAG_SENTINEL) && (now = now_ms()) < retry_time)
+		{
+			condvar_wait_time(&priv->condvar, &priv->mutex, (uint32_t)(retry_time - now));
+		}
 	}
 
+	conn_close(&priv->conn);
+
 	priv->flags = REGISTRATION_FLAGS_NONE;
 
 	mutex_unlock(&priv->mutex);
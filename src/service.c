@@ -62,6 +62,9 @@ static struct proxy_handle ph =
 /// Service termination indicator
 static uint8_t sentinel = 0;
 
+/// Path to the proxy configuration file
+static char config_path[MAX_PATH];
+
 /// Name and display name of the service
 static char *service_name = "OpenELP";
 
@@ -177,6 +180,8 @@ int main(int argc, char *argv[])
 
 void WINAPI service_ctrl_handler(DWORD ctrl)
 {
+	int ret;
+
 	switch (ctrl)
 	{
 	case SERVICE_CONTROL_STOP:
@@ -188,6 +193,17 @@ void WINAPI service_ctrl_handler(DWORD ctrl)
 
 		sentinel = 1;
 
+		break;
+	case SERVICE_CONTROL_PARAMCHANGE:
+		proxy_log(&ph, LOG_LEVEL_INFO, "Reloading config from '%s'\n", config_path);
+
+		// A bad file doesn't disturb the running proxy
+		ret = proxy_reload(&ph, config_path);
+		if (ret < 0)
+		{
+			proxy_log(&ph, LOG_LEVEL_ERROR, "Failed to reload config from '%s' (%d): %s\n", config_path, -ret, strerror(-ret));
+		}
+
 		break;
 	case SERVICE_CONTROL_INTERROGATE:
 		break;
@@ -266,7 +282,6 @@ service_uninstall_exit:
 
 void WINAPI service_main(int argc, char *argv[])
 {
-	char config_path[MAX_PATH];
 	enum LOG_LEVEL default_log_level = LOG_LEVEL_INFO;
 	int ret;
 
@@ -400,7 +415,7 @@ static void service_report_status(int state, int exit_code, int wait_hint)
 		.dwWin32ExitCode = exit_code == 0 ? 0 : ERROR_SERVICE_SPECIFIC_ERROR,
 		.dwServiceSpecificExitCode = exit_code,
 		.dwWaitHint = wait_hint,
-		.dwControlsAccepted = state == SERVICE_START_PENDING ? 0 : SERVICE_ACCEPT_STOP,
+		.dwControlsAccepted = state == SERVICE_START_PENDING ? 0 : SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_PARAMCHANGE,
 		.dwCheckPoint = ((state == SERVICE_RUNNING) || (state == SERVICE_STOPPED)) ? 0 : check_point++,
 	};
 
@@ -44,14 +44,22 @@
  * @brief Threading implementation for POSIX machines
  */
 
+#if defined(HAVE_PTHREAD_AFFINITY) && !defined(_GNU_SOURCE)
+/// Expose pthread_attr_setaffinity_np
+#  define _GNU_SOURCE
+#endif
+
 #include "mutex.h"
 #include "thread.h"
 
 #include <pthread.h>
+#include <sched.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /*!
  * @brief Private data for an instance of a POSIX thread
@@ -68,6 +76,29 @@ struct thread_priv
 	pthread_t thread;
 };
 
+uint64_t thread_affinity_pick(uint64_t set, unsigned int n)
+{
+	unsigned int count = 0;
+	uint64_t rest;
+
+	for (rest = set; rest != 0; rest &= rest - 1)
+	{
+		count++;
+	}
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (n %= count; n > 0; n--)
+	{
+		set &= set - 1;
+	}
+
+	return set & (~set + 1);
+}
+
 void thread_free(struct thread_handle *pt)
 {
 	struct thread_priv *priv = (struct thread_priv *)pt->priv;
@@ -148,6 +179,14 @@ int thread_start(struct thread_handle *pt)
 {
 	struct thread_priv *priv = (struct thread_priv *)pt->priv;
 	pthread_attr_t attr;
+	struct sched_param param;
+	size_t stack_size = pt->stack_size;
+	long page_size;
+#ifdef HAVE_PTHREAD_AFFINITY
+	cpu_set_t cpus;
+	unsigned int i;
+#endif
+	int max_priority;
 	int ret;
 
 	ret = pthread_attr_init(&attr);
@@ -156,12 +195,72 @@ int thread_start(struct thread_handle *pt)
 		return ret > 0 ? -ret : ret;
 	}
 
-	if (pt->stack_size > 0)
+	if (stack_size > 0)
+	{
+		// Some systems reject sizes which are too small or which are not a
+		// whole number of pages
+#ifdef PTHREAD_STACK_MIN
+		if (stack_size < (size_t)PTHREAD_STACK_MIN)
+		{
+			stack_size = (size_t)PTHREAD_STACK_MIN;
+		}
+#endif
+
+		page_size = sysconf(_SC_PAGESIZE);
+		if (page_size > 0)
+		{
+			stack_size = (stack_size + (size_t)page_size - 1) / (size_t)page_size * (size_t)page_size;
+		}
+
+		ret = pthread_attr_setstacksize(&attr, stack_size);
+		if (ret != 0)
+		{
+			goto thread_start_exit;
+		}
+	}
+
+	if (pt->affinity != 0)
+	{
+#ifdef HAVE_PTHREAD_AFFINITY
+		CPU_ZERO(&cpus);
+
+		for (i = 0; i < 64 && i < (unsigned int)CPU_SETSIZE; i++)
+		{
+			if (pt->affinity & ((uint64_t)1 << i))
+			{
+				CPU_SET(i, &cpus);
+			}
+		}
+
+		ret = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+#else
+		ret = ENOTSUP;
+#endif
+		if (ret != 0)
+		{
+			goto thread_start_exit;
+		}
+	}
+
+	if (pt->priority > 0)
 	{
-		ret = pthread_attr_setstacksize(&attr, pt->stack_size);
+		memset(&param, 0x0, sizeof(param));
+
+		max_priority = sched_get_priority_max(SCHED_FIFO);
+		param.sched_priority = (max_priority > 0 && pt->priority > (unsigned int)max_priority) ? max_priority : (int)pt->priority;
+
+		ret = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		if (ret == 0)
+		{
+			ret = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		}
+		if (ret == 0)
+		{
+			ret = pthread_attr_setschedparam(&attr, &param);
+		}
 		if (ret != 0)
 		{
-			return ret > 0 ? -ret : ret;
+			goto thread_start_exit;
 		}
 	}
 
@@ -175,5 +274,13 @@ int thread_start(struct thread_handle *pt)
 
 	mutex_unlock(&priv->mutex);
 
+thread_start_exit:
+	pthread_attr_destroy(&attr);
+
 	return ret > 0 ? -ret : ret;
 }
+
+void thread_yield(void)
+{
+	sched_yield();
+}
@@ -88,6 +88,29 @@ DWORD WINAPI windows_thread_wrapper(LPVOID ctx)
 	return 0;
 }
 
+uint64_t thread_affinity_pick(uint64_t set, unsigned int n)
+{
+	unsigned int count = 0;
+	uint64_t rest;
+
+	for (rest = set; rest != 0; rest &= rest - 1)
+	{
+		count++;
+	}
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (n %= count; n > 0; n--)
+	{
+		set &= set - 1;
+	}
+
+	return set & (~set + 1);
+}
+
 void thread_free(struct thread_handle *pt)
 {
 	struct thread_priv *priv = (struct thread_priv *)pt->priv;
@@ -157,12 +180,46 @@ int thread_join(struct thread_handle *pt)
 int thread_start(struct thread_handle *pt)
 {
 	struct thread_priv *priv = (struct thread_priv *)pt->priv;
+	int ret = 0;
 
 	mutex_lock(&priv->mutex);
 
-	priv->thread = CreateThread(NULL, 0, windows_thread_wrapper, pt, 0, NULL);
+	// Start suspended so that the attributes are in place before the thread
+	// runs any of its work
+	priv->thread = CreateThread(NULL, pt->stack_size, windows_thread_wrapper, pt, CREATE_SUSPENDED | (pt->stack_size > 0 ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0), NULL);
+	if (priv->thread == NULL)
+	{
+		ret = -ECHILD;
+		goto thread_start_exit;
+	}
 
+	if (pt->affinity != 0 && SetThreadAffinityMask(priv->thread, (DWORD_PTR)pt->affinity) == 0)
+	{
+		ret = -EINVAL;
+	}
+	else if (pt->priority > 0 && SetThreadPriority(priv->thread, THREAD_PRIORITY_TIME_CRITICAL) == 0)
+	{
+		ret = -EPERM;
+	}
+
+	if (ret != 0)
+	{
+		TerminateThread(priv->thread, 0);
+		CloseHandle(priv->thread);
+		priv->thread = NULL;
+	}
+	else
+	{
+		ResumeThread(priv->thread);
+	}
+
+thread_start_exit:
 	mutex_unlock(&priv->mutex);
 
-	return priv->thread == NULL ? -ECHILD : 0;
+	return ret;
+}
+
+void thread_yield(void)
+{
+	SwitchToThread();
 }
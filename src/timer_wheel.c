@@ -0,0 +1,299 @@
+/*!
+ * @file timer_wheel.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of hierarchical timer wheels
+ */
+
+#include "mutex.h"
+#include "timer_wheel.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Number of bits of the expiration tick which select a slot in each level
+#define TIMER_WHEEL_BITS 6
+
+/// Number of slots in each level of the wheel
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+/// Number of levels in the wheel
+#define TIMER_WHEEL_LEVELS 4
+
+/// Number of ticks covered by the given level of the wheel and those below it
+#define TIMER_WHEEL_SPAN(level) ((uint64_t)1 << (TIMER_WHEEL_BITS * (level)))
+
+/*!
+ * @brief Private data for an instance of a timer wheel
+ *
+ * Level 0 has a slot for each of the next ::TIMER_WHEEL_SLOTS ticks. Each
+ * slot in level N covers ::TIMER_WHEEL_SLOTS times as many ticks as a slot in
+ * level N - 1, and when the wheel reaches the start of the range a slot
+ * covers, its timers are moved down to the finer levels. Timers further away
+ * than the top level can hold are placed in its furthest slot, and are moved
+ * back up when they are reached.
+ */
+struct timer_wheel_priv
+{
+	/// Lists of the timers scheduled in each slot of each level
+	struct timer_wheel_entry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+	/// Next tick which has yet to be processed
+	uint64_t next;
+
+	/// Number of timers which are scheduled
+	unsigned int count;
+
+	/// Protects all of the data in the wheel and its entries
+	struct mutex_handle mutex;
+};
+
+/*!
+ * @brief Places a timer in the slot for its expiration tick
+ *
+ * @param[in,out] priv Private data of the target timer wheel instance
+ * @param[in,out] entry Timer which is not currently scheduled
+ */
+static void wheel_insert(struct timer_wheel_priv *priv, struct timer_wheel_entry *entry);
+
+/*!
+ * @brief Takes a timer out of the slot it is scheduled in
+ *
+ * @param[in,out] entry Timer which is currently scheduled
+ */
+static void wheel_unlink(struct timer_wheel_entry *entry);
+
+static void wheel_insert(struct timer_wheel_priv *priv, struct timer_wheel_entry *entry)
+{
+	struct timer_wheel_entry **slot;
+	uint64_t when = entry->expires < priv->next ? priv->next : entry->expires;
+	unsigned int level = 0;
+
+	while (level < TIMER_WHEEL_LEVELS - 1 && when - priv->next >= TIMER_WHEEL_SPAN(level + 1))
+	{
+		level++;
+	}
+
+	if (when - priv->next >= TIMER_WHEEL_SPAN(TIMER_WHEEL_LEVELS))
+	{
+		when = priv->next + TIMER_WHEEL_SPAN(TIMER_WHEEL_LEVELS) - 1;
+	}
+
+	slot = &priv->slots[level][(when >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+
+	entry->next = *slot;
+	if (entry->next != NULL)
+	{
+		entry->next->pprev = &entry->next;
+	}
+
+	entry->pprev = slot;
+	*slot = entry;
+}
+
+static void wheel_unlink(struct timer_wheel_entry *entry)
+{
+	*entry->pprev = entry->next;
+	if (entry->next != NULL)
+	{
+		entry->next->pprev = entry->pprev;
+	}
+
+	entry->next = NULL;
+	entry->pprev = NULL;
+}
+
+void timer_wheel_add(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t expires)
+{
+	struct timer_wheel_priv *priv = (struct timer_wheel_priv *)wh->priv;
+
+	mutex_lock(&priv->mutex);
+
+	if (entry->pprev != NULL)
+	{
+		wheel_unlink(entry);
+	}
+	else
+	{
+		priv->count++;
+	}
+
+	entry->expires = expires;
+	wheel_insert(priv, entry);
+
+	mutex_unlock(&priv->mutex);
+}
+
+unsigned int timer_wheel_advance(struct timer_wheel_handle *wh, uint64_t now)
+{
+	struct timer_wheel_priv *priv = (struct timer_wheel_priv *)wh->priv;
+	struct timer_wheel_entry *entry;
+	struct timer_wheel_entry *next;
+	unsigned int expired = 0;
+	unsigned int level;
+	uint64_t tick;
+	uint64_t when;
+
+	mutex_lock(&priv->mutex);
+
+	while (priv->next <= now)
+	{
+		// There is nothing to step through when the wheel is empty
+		if (priv->count == 0)
+		{
+			priv->next = now + 1;
+			break;
+		}
+
+		tick = priv->next;
+
+		// Move timers down from the coarsest level first, since they may
+		// land in a slot of a finer level which is about to be moved too
+		for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+		{
+			if ((tick & (TIMER_WHEEL_SPAN(level) - 1)) != 0)
+			{
+				continue;
+			}
+
+			entry = priv->slots[level][(tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+			priv->slots[level][(tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)] = NULL;
+
+			for (; entry != NULL; entry = next)
+			{
+				next = entry->next;
+				wheel_insert(priv, entry);
+			}
+		}
+
+		entry = priv->slots[0][tick & (TIMER_WHEEL_SLOTS - 1)];
+		priv->slots[0][tick & (TIMER_WHEEL_SLOTS - 1)] = NULL;
+
+		// Timers scheduled again for this tick expire on the next one
+		priv->next = tick + 1;
+
+		for (; entry != NULL; entry = next)
+		{
+			next = entry->next;
+			entry->next = NULL;
+			entry->pprev = NULL;
+			priv->count--;
+			expired++;
+
+			when = wh->func_ptr(wh, entry, now);
+			if (when != 0)
+			{
+				entry->expires = when;
+				wheel_insert(priv, entry);
+				priv->count++;
+			}
+		}
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return expired;
+}
+
+void timer_wheel_free(struct timer_wheel_handle *wh)
+{
+	if (wh->priv != NULL)
+	{
+		struct timer_wheel_priv *priv = (struct timer_wheel_priv *)wh->priv;
+
+		mutex_free(&priv->mutex);
+
+		free(wh->priv);
+		wh->priv = NULL;
+	}
+}
+
+int timer_wheel_init(struct timer_wheel_handle *wh)
+{
+	struct timer_wheel_priv *priv;
+	int ret;
+
+	if (wh->func_ptr == NULL)
+	{
+		return -EINVAL;
+	}
+
+	if (wh->priv == NULL)
+	{
+		wh->priv = malloc(sizeof(struct timer_wheel_priv));
+	}
+
+	if (wh->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(wh->priv, 0x0, sizeof(struct timer_wheel_priv));
+	priv = (struct timer_wheel_priv *)wh->priv;
+
+	priv->next = wh->start;
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		free(wh->priv);
+		wh->priv = NULL;
+	}
+
+	return ret;
+}
+
+void timer_wheel_remove(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry)
+{
+	struct timer_wheel_priv *priv = (struct timer_wheel_priv *)wh->priv;
+
+	mutex_lock(&priv->mutex);
+
+	if (entry->pprev != NULL)
+	{
+		wheel_unlink(entry);
+		priv->count--;
+	}
+
+	mutex_unlock(&priv->mutex);
+}
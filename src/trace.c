@@ -0,0 +1,662 @@
+/*!
+ * @file trace.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of lock-free packet trace rings
+ */
+
+#include "openelp/openelp.h"
+#include "atomic.h"
+#include "clock.h"
+#include "proxy_conn.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#else
+#  include <arpa/inet.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OCH_STR1(x) #x
+#define OCH_STR2(x) OCH_STR1(x)
+
+/// Link type of raw IPv4 packets, without a link layer header
+#define TRACE_LINKTYPE_RAW 101
+
+/// Length of the IPv4 header written before each packet
+#define TRACE_IP_LEN 20
+
+/// Length of the UDP header written before each UDP packet
+#define TRACE_UDP_LEN 8
+
+/// Length of the TCP header written before each TCP packet
+#define TRACE_TCP_LEN 20
+
+/// Largest number of bytes written for a single packet
+#define TRACE_PACKET_MAX (TRACE_IP_LEN + TRACE_TCP_LEN + TRACE_SNAP_MAX)
+
+/// Size of the buffer each pcapng block is built in
+#define TRACE_BLOCK_MAX 512
+
+/// pcapng Section Header Block type
+#define PCAPNG_SHB 0x0A0D0D0A
+
+/// pcapng Interface Description Block type
+#define PCAPNG_IDB 0x00000001
+
+/// pcapng Enhanced Packet Block type
+#define PCAPNG_EPB 0x00000006
+
+/// TCP flag for the last data from the sender
+#define TCP_FIN 0x01
+
+/// TCP flag for synchronizing sequence numbers
+#define TCP_SYN 0x02
+
+/// TCP flag for resetting the connection
+#define TCP_RST 0x04
+
+/// TCP flag for pushing data to the receiver
+#define TCP_PSH 0x08
+
+/// TCP flag for a significant acknowledgment number
+#define TCP_ACK 0x10
+
+/*!
+ * @brief Traced packet being written to a capture file
+ */
+struct trace_packet
+{
+	/// Packet which was recorded
+	const struct trace_record *rec;
+
+	/// Index of the ring the packet was recorded in
+	size_t source;
+};
+
+/*!
+ * @brief State of the capture file which is being written
+ */
+struct trace_writer
+{
+	/// Stream which the file is written to
+	FILE *stream;
+
+	/// Block which is being built
+	uint8_t block[TRACE_BLOCK_MAX];
+
+	/// Number of bytes in trace_writer::block
+	size_t len;
+};
+
+/*!
+ * @brief Appends an option to the block being built
+ *
+ * @param[in,out] tw Target capture file
+ * @param[in] code Option code
+ * @param[in] val Option value
+ * @param[in] val_len Number of bytes in val
+ */
+static void block_option(struct trace_writer *tw, uint16_t code, const void *val, size_t val_len);
+
+/*!
+ * @brief Appends raw bytes to the block being built
+ *
+ * The bytes are padded to a multiple of 4.
+ *
+ * @param[in,out] tw Target capture file
+ * @param[in] data Bytes to append
+ * @param[in] data_len Number of bytes in data
+ */
+static void block_put(struct trace_writer *tw, const void *data, size_t data_len);
+
+/*!
+ * @brief Starts building a new block
+ *
+ * @param[in,out] tw Target capture file
+ * @param[in] type Type of the block
+ */
+static void block_start(struct trace_writer *tw, uint32_t type);
+
+/*!
+ * @brief Completes the block being built and writes it
+ *
+ * @param[in,out] tw Target capture file
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int block_write(struct trace_writer *tw);
+
+/*!
+ * @brief Computes the checksum of an IPv4 header
+ *
+ * @param[in] hdr Header to compute the checksum of
+ *
+ * @returns Checksum, in host byte order
+ */
+static uint16_t ip_checksum(const uint8_t hdr[TRACE_IP_LEN]);
+
+/*!
+ * @brief Compares traced packets by the time they were recorded
+ *
+ * @param[in] a First ::trace_packet
+ * @param[in] b Second ::trace_packet
+ *
+ * @returns Negative if a is older, positive if b is older
+ */
+static int packet_compare(const void *a, const void *b);
+
+/*!
+ * @brief Builds the IPv4 packet which a traced packet was forwarded as
+ *
+ * @param[in] rec Packet which was recorded
+ * @param[in] local_addr IPv4 address the client's traffic is forwarded from,
+ *                       in network byte order
+ * @param[in,out] tcp_seq Next TCP sequence numbers of the remote host and the
+ *                        client, which are advanced past the packet
+ * @param[out] pkt Resulting packet, cut to the bytes which were recorded
+ * @param[out] orig_len Length the packet had when it was forwarded
+ *
+ * @returns Number of bytes written to pkt, or 0 if the message does not
+ *          correspond to a packet
+ */
+static size_t packet_build(const struct trace_record *rec, uint32_t local_addr, uint32_t tcp_seq[2], uint8_t pkt[TRACE_PACKET_MAX], uint32_t *orig_len);
+
+/*!
+ * @brief Stores a 16-bit value in network byte order
+ *
+ * @param[out] buff Target buffer
+ * @param[in] val Value to store
+ */
+static inline void put_be16(uint8_t *buff, uint16_t val);
+
+/*!
+ * @brief Stores a 32-bit value in network byte order
+ *
+ * @param[out] buff Target buffer
+ * @param[in] val Value to store
+ */
+static inline void put_be32(uint8_t *buff, uint32_t val);
+
+static void block_option(struct trace_writer *tw, uint16_t code, const void *val, size_t val_len)
+{
+	uint16_t hdr[2];
+
+	hdr[0] = code;
+	hdr[1] = (uint16_t)val_len;
+
+	block_put(tw, hdr, sizeof(hdr));
+	block_put(tw, val, val_len);
+}
+
+static void block_put(struct trace_writer *tw, const void *data, size_t data_len)
+{
+	size_t padded = (data_len + 3) & ~(size_t)3;
+
+	// Leave room for the trailing length
+	if (tw->len + padded + 4 > TRACE_BLOCK_MAX)
+	{
+		return;
+	}
+
+	if (data_len > 0)
+	{
+		memcpy(&tw->block[tw->len], data, data_len);
+	}
+
+	memset(&tw->block[tw->len + data_len], 0x0, padded - data_len);
+	tw->len += padded;
+}
+
+static void block_start(struct trace_writer *tw, uint32_t type)
+{
+	memcpy(tw->block, &type, 4);
+	memset(&tw->block[4], 0x0, 4);
+	tw->len = 8;
+}
+
+static int block_write(struct trace_writer *tw)
+{
+	uint32_t total = (uint32_t)tw->len + 4;
+
+	memcpy(&tw->block[4], &total, 4);
+	memcpy(&tw->block[tw->len], &total, 4);
+
+	if (fwrite(tw->block, total, 1, tw->stream) != 1)
+	{
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static uint16_t ip_checksum(const uint8_t hdr[TRACE_IP_LEN])
+{
+	uint32_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < TRACE_IP_LEN; i += 2)
+	{
+		sum += ((uint32_t)hdr[i] << 8) | hdr[i + 1];
+	}
+
+	while (sum >> 16)
+	{
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+
+	return (uint16_t)~sum;
+}
+
+static int packet_compare(const void *a, const void *b)
+{
+	const struct trace_packet *pa = (const struct trace_packet *)a;
+	const struct trace_packet *pb = (const struct trace_packet *)b;
+
+	if (pa->rec->stamp != pb->rec->stamp)
+	{
+		return pa->rec->stamp < pb->rec->stamp ? -1 : 1;
+	}
+
+	// Each ring is read oldest first into one array, so this keeps the order
+	// of packets recorded at the same time
+	return pa->rec < pb->rec ? -1 : pa->rec > pb->rec;
+}
+
+static size_t packet_build(const struct trace_record *rec, uint32_t local_addr, uint32_t tcp_seq[2], uint8_t pkt[TRACE_PACKET_MAX], uint32_t *orig_len)
+{
+	const int from_client = rec->dir == TRACE_DIR_FROM_CLIENT;
+	uint8_t *l4 = &pkt[TRACE_IP_LEN];
+	uint32_t payload_len = 0;
+	uint32_t *seq = &tcp_seq[from_client];
+	uint32_t *ack = &tcp_seq[!from_client];
+	size_t l4_len;
+	uint8_t proto;
+	uint8_t flags = TCP_ACK;
+	uint16_t port;
+	size_t snap;
+
+	switch (rec->type)
+	{
+	case PROXY_MSG_TYPE_UDP_DATA:
+	case PROXY_MSG_TYPE_UDP_CONTROL:
+		proto = 17;
+		port = rec->type == PROXY_MSG_TYPE_UDP_DATA ? 5198 : 5199;
+		payload_len = rec->len;
+		l4_len = TRACE_UDP_LEN;
+
+		put_be16(&l4[0], port);
+		put_be16(&l4[2], port);
+		put_be16(&l4[4], (uint16_t)(l4_len + payload_len > 0xFFFF ? 0xFFFF : l4_len + payload_len));
+		put_be16(&l4[6], 0);
+
+		break;
+	case PROXY_MSG_TYPE_TCP_OPEN:
+	case PROXY_MSG_TYPE_TCP_STATUS:
+	case PROXY_MSG_TYPE_TCP_DATA:
+	case PROXY_MSG_TYPE_TCP_CLOSE:
+		proto = 6;
+		l4_len = TRACE_TCP_LEN;
+
+		switch (rec->type)
+		{
+		case PROXY_MSG_TYPE_TCP_OPEN:
+			// Every connection starts numbering from zero
+			tcp_seq[0] = tcp_seq[1] = 0;
+			flags = TCP_SYN;
+			break;
+		case PROXY_MSG_TYPE_TCP_STATUS:
+			flags = (rec->flags & TRACE_FLAG_FAILED) ? TCP_RST | TCP_ACK : TCP_SYN | TCP_ACK;
+			break;
+		case PROXY_MSG_TYPE_TCP_DATA:
+			flags = TCP_PSH | TCP_ACK;
+			payload_len = rec->len;
+			break;
+		default:
+			flags = TCP_FIN | TCP_ACK;
+			break;
+		}
+
+		put_be16(&l4[0], 5200);
+		put_be16(&l4[2], 5200);
+		put_be32(&l4[4], *seq);
+		put_be32(&l4[8], (flags & TCP_ACK) ? *ack : 0);
+		l4[12] = (TRACE_TCP_LEN / 4) << 4;
+		l4[13] = flags;
+		put_be16(&l4[14], 0xFFFF);
+		put_be16(&l4[16], 0);
+		put_be16(&l4[18], 0);
+
+		*seq += payload_len + ((flags & (TCP_SYN | TCP_FIN)) ? 1 : 0);
+
+		break;
+	default:
+		return 0;
+	}
+
+	*orig_len = TRACE_IP_LEN + (uint32_t)l4_len + payload_len;
+
+	pkt[0] = 0x45;
+	pkt[1] = 0;
+	put_be16(&pkt[2], (uint16_t)(*orig_len > 0xFFFF ? 0xFFFF : *orig_len));
+	put_be16(&pkt[4], 0);
+	put_be16(&pkt[6], 0x4000);
+	pkt[8] = 64;
+	pkt[9] = proto;
+	put_be16(&pkt[10], 0);
+	memcpy(&pkt[12], from_client ? &local_addr : &rec->addr, 4);
+	memcpy(&pkt[16], from_client ? &rec->addr : &local_addr, 4);
+	put_be16(&pkt[10], ip_checksum(pkt));
+
+	snap = payload_len < rec->snap_len ? payload_len : rec->snap_len;
+	memcpy(&l4[l4_len], rec->data, snap);
+
+	return TRACE_IP_LEN + l4_len + snap;
+}
+
+static inline void put_be16(uint8_t *buff, uint16_t val)
+{
+	buff[0] = (uint8_t)(val >> 8);
+	buff[1] = (uint8_t)val;
+}
+
+static inline void put_be32(uint8_t *buff, uint32_t val)
+{
+	buff[0] = (uint8_t)(val >> 24);
+	buff[1] = (uint8_t)(val >> 16);
+	buff[2] = (uint8_t)(val >> 8);
+	buff[3] = (uint8_t)val;
+}
+
+size_t trace_read(const struct trace_ring *ring, struct trace_record *recs, size_t recs_len)
+{
+	const struct trace_entry *entry;
+	uint64_t head = atomic_u64_load(&ring->head);
+	uint64_t idx;
+	uint32_t seq;
+	size_t count = 0;
+
+	idx = head > TRACE_RING_LEN ? head - TRACE_RING_LEN : 0;
+	if (head - idx > recs_len)
+	{
+		idx = head - recs_len;
+	}
+
+	for (; idx < head; idx++)
+	{
+		entry = &ring->entries[idx & (TRACE_RING_LEN - 1)];
+
+		// The entry is only used if it held the same packet before and after
+		// it was copied
+		seq = atomic_u32_load(&entry->seq);
+		if (seq == 0 || seq != (uint32_t)(idx + 1))
+		{
+			continue;
+		}
+
+		memcpy(&recs[count], (const void *)&entry->rec, sizeof(struct trace_record));
+
+		atomic_fence();
+
+		if (atomic_u32_load(&entry->seq) != seq)
+		{
+			continue;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+void trace_record(struct trace_ring *ring, uint64_t stamp, enum TRACE_DIR dir, uint8_t type, uint8_t flags, uint32_t addr, const uint8_t *data, size_t len, size_t snap_len)
+{
+	uint64_t idx = atomic_u64_add(&ring->head, 1);
+	struct trace_entry *entry = &ring->entries[idx & (TRACE_RING_LEN - 1)];
+
+	if (snap_len > len)
+	{
+		snap_len = len;
+	}
+
+	if (snap_len > TRACE_SNAP_MAX)
+	{
+		snap_len = TRACE_SNAP_MAX;
+	}
+
+	// Readers which see the entry change before they finish copying it
+	// discard their copy
+	atomic_u32_store(&entry->seq, 0);
+	atomic_fence();
+
+	entry->rec.stamp = stamp;
+	entry->rec.addr = addr;
+	entry->rec.len = len > UINT32_MAX ? UINT32_MAX : (uint32_t)len;
+	entry->rec.type = type;
+	entry->rec.dir = (uint8_t)dir;
+	entry->rec.flags = flags;
+	entry->rec.snap_len = (uint8_t)snap_len;
+	if (snap_len > 0)
+	{
+		memcpy(entry->rec.data, data, snap_len);
+	}
+
+	atomic_u32_store(&entry->seq, (uint32_t)(idx + 1));
+}
+
+int trace_dump(const char *path, const struct trace_source *sources, size_t num_sources)
+{
+	static const char appl[] = "OpenELP " OCH_STR2(OPENELP_VERSION);
+	struct trace_record *recs = NULL;
+	struct trace_packet *pkts = NULL;
+	struct trace_writer tw;
+	uint8_t pkt[TRACE_PACKET_MAX];
+	uint32_t *local_addrs = NULL;
+	uint32_t *tcp_seqs = NULL;
+	const char *comment;
+	uint32_t orig_len;
+	uint32_t val32;
+	uint64_t offset;
+	uint64_t stamp;
+	uint16_t val16[2];
+	int64_t section_len = -1;
+	size_t num_pkts = 0;
+	size_t pkt_len;
+	size_t count;
+	size_t i;
+	int written = 0;
+	int ret;
+
+	memset(&tw, 0x0, sizeof(struct trace_writer));
+
+	if (num_sources > 0)
+	{
+		recs = malloc(num_sources * TRACE_RING_LEN * sizeof(struct trace_record));
+		pkts = malloc(num_sources * TRACE_RING_LEN * sizeof(struct trace_packet));
+		local_addrs = calloc(num_sources, sizeof(uint32_t));
+		tcp_seqs = calloc(num_sources * 2, sizeof(uint32_t));
+		if (recs == NULL || pkts == NULL || local_addrs == NULL || tcp_seqs == NULL)
+		{
+			ret = -ENOMEM;
+			goto trace_dump_exit;
+		}
+	}
+
+	// Take the snapshot first, so that it is as close together as possible
+	for (i = 0; i < num_sources; i++)
+	{
+		count = trace_read(sources[i].ring, &recs[num_pkts], TRACE_RING_LEN);
+
+		for (; count > 0; count--, num_pkts++)
+		{
+			pkts[num_pkts].rec = &recs[num_pkts];
+			pkts[num_pkts].source = i;
+		}
+
+		if (sources[i].local_addr == NULL || inet_pton(AF_INET, sources[i].local_addr, &local_addrs[i]) != 1)
+		{
+			local_addrs[i] = 0;
+		}
+	}
+
+	// The packets were stamped with the monotonic clock
+	offset = clock_wall_us() - clock_now_us();
+
+	if (num_pkts > 0)
+	{
+		qsort(pkts, num_pkts, sizeof(struct trace_packet), packet_compare);
+	}
+
+	tw.stream = fopen(path, "wb");
+	if (tw.stream == NULL)
+	{
+		ret = -errno;
+		goto trace_dump_exit;
+	}
+
+	// Section Header Block, in host byte order
+	block_start(&tw, PCAPNG_SHB);
+	val32 = 0x1A2B3C4D;
+	block_put(&tw, &val32, 4);
+	val16[0] = 1;
+	val16[1] = 0;
+	block_put(&tw, val16, 4);
+	block_put(&tw, &section_len, 8);
+	block_option(&tw, 4, appl, strlen(appl));
+	block_option(&tw, 0, NULL, 0);
+	ret = block_write(&tw);
+
+	for (i = 0; ret == 0 && i < num_sources; i++)
+	{
+		// Interface Description Block
+		block_start(&tw, PCAPNG_IDB);
+		val16[0] = TRACE_LINKTYPE_RAW;
+		val16[1] = 0;
+		block_put(&tw, val16, 4);
+		val32 = TRACE_PACKET_MAX;
+		block_put(&tw, &val32, 4);
+		if (sources[i].name != NULL)
+		{
+			block_option(&tw, 2, sources[i].name, strlen(sources[i].name));
+		}
+		block_option(&tw, 0, NULL, 0);
+		ret = block_write(&tw);
+	}
+
+	for (i = 0; ret == 0 && i < num_pkts; i++)
+	{
+		const struct trace_record *rec = pkts[i].rec;
+
+		pkt_len = packet_build(rec, local_addrs[pkts[i].source], &tcp_seqs[2 * pkts[i].source], pkt, &orig_len);
+		if (pkt_len == 0)
+		{
+			continue;
+		}
+
+		// Enhanced Packet Block
+		block_start(&tw, PCAPNG_EPB);
+		val32 = (uint32_t)pkts[i].source;
+		block_put(&tw, &val32, 4);
+		stamp = rec->stamp + offset;
+		val32 = (uint32_t)(stamp >> 32);
+		block_put(&tw, &val32, 4);
+		val32 = (uint32_t)stamp;
+		block_put(&tw, &val32, 4);
+		val32 = (uint32_t)pkt_len;
+		block_put(&tw, &val32, 4);
+		block_put(&tw, &orig_len, 4);
+		block_put(&tw, pkt, pkt_len);
+
+		// Inbound is from the remote host to the client
+		val32 = rec->dir == TRACE_DIR_FROM_CLIENT ? 2 : 1;
+		block_option(&tw, 2, &val32, 4);
+
+		comment = NULL;
+		if (rec->flags & TRACE_FLAG_FILTERED)
+		{
+			comment = "Discarded by the peer filter";
+		}
+		else if ((rec->flags & TRACE_FLAG_FAILED) && rec->type == PROXY_MSG_TYPE_TCP_STATUS)
+		{
+			comment = "Failed to connect to the remote host";
+		}
+		else if (rec->flags & TRACE_FLAG_FAILED)
+		{
+			comment = "Failed to forward";
+		}
+
+		if (comment != NULL)
+		{
+			block_option(&tw, 1, comment, strlen(comment));
+		}
+
+		block_option(&tw, 0, NULL, 0);
+		ret = block_write(&tw);
+
+		written++;
+	}
+
+	if (fclose(tw.stream) != 0 && ret == 0)
+	{
+		ret = -errno;
+	}
+
+	if (ret == 0)
+	{
+		ret = written;
+	}
+
+trace_dump_exit:
+	free(tcp_seqs);
+	free(local_addrs);
+	free(pkts);
+	free(recs);
+
+	return ret;
+}
@@ -0,0 +1,380 @@
+/*!
+ * @file worker_pool.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Implementation of pools of worker threads
+ */
+
+#include "mutex.h"
+#include "thread.h"
+#include "worker_pool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * @brief Private data for an instance of a worker pool
+ */
+struct worker_pool_priv
+{
+	/// Threads of the pool, of which the first worker_pool_priv::started
+	/// are running
+	struct thread_handle *threads;
+
+	/// Ring of items waiting for a thread
+	void **items;
+
+	/// Index in worker_pool_priv::items of the oldest waiting item
+	unsigned int head;
+
+	/// Number of items in worker_pool_priv::items
+	unsigned int count;
+
+	/// Number of threads in worker_pool_priv::threads which are running
+	unsigned int started;
+
+	/// Number of running threads which are waiting for an item
+	unsigned int idle;
+
+	/// Non-zero while items are being accepted
+	uint8_t running;
+
+	/// Termination indicator for the threads
+	uint8_t sentinel;
+
+	/// Protects all of the data in the pool
+	struct mutex_handle mutex;
+
+	/// Signaled when an item is submitted or the pool is stopping
+	struct condvar_handle condvar;
+};
+
+/*!
+ * @brief Start another thread in the pool
+ *
+ * The caller must hold worker_pool_priv::mutex.
+ *
+ * @param[in,out] wp Target worker pool instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int pool_grow(struct worker_pool_handle *wp);
+
+/*!
+ * @brief Worker thread which passes submitted items to
+ *        worker_pool_handle::func_ptr
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * pool_worker(void *ctx);
+
+static int pool_grow(struct worker_pool_handle *wp)
+{
+	struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+	int ret;
+
+	ret = thread_start(&priv->threads[priv->started]);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	priv->started++;
+
+	return 0;
+}
+
+static void * pool_worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct worker_pool_handle *wp = (struct worker_pool_handle *)th->func_ctx;
+	struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+	void *item;
+
+	mutex_lock(&priv->mutex);
+
+	while (1)
+	{
+		while (priv->count == 0 && !priv->sentinel)
+		{
+			priv->idle++;
+			condvar_wait(&priv->condvar, &priv->mutex);
+			priv->idle--;
+		}
+
+		// Everything which was submitted is worked on before stopping
+		if (priv->count == 0)
+		{
+			break;
+		}
+
+		item = priv->items[priv->head];
+		priv->head = (priv->head + 1) % wp->max_threads;
+		priv->count--;
+
+		mutex_unlock(&priv->mutex);
+
+		wp->func_ptr(wp, item);
+
+		mutex_lock(&priv->mutex);
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return NULL;
+}
+
+void worker_pool_free(struct worker_pool_handle *wp)
+{
+	if (wp->priv != NULL)
+	{
+		struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+		unsigned int i;
+
+		worker_pool_stop(wp);
+
+		for (i = 0; i < wp->max_threads; i++)
+		{
+			thread_free(&priv->threads[i]);
+		}
+
+		condvar_free(&priv->condvar);
+		mutex_free(&priv->mutex);
+
+		free(priv->items);
+		free(priv->threads);
+
+		free(wp->priv);
+		wp->priv = NULL;
+	}
+}
+
+int worker_pool_init(struct worker_pool_handle *wp)
+{
+	struct worker_pool_priv *priv;
+	unsigned int i;
+	int ret;
+
+	if (wp->func_ptr == NULL || wp->max_threads == 0 || wp->warm_threads > wp->max_threads)
+	{
+		return -EINVAL;
+	}
+
+	if (wp->priv == NULL)
+	{
+		wp->priv = malloc(sizeof(struct worker_pool_priv));
+	}
+
+	if (wp->priv == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	memset(wp->priv, 0x0, sizeof(struct worker_pool_priv));
+	priv = (struct worker_pool_priv *)wp->priv;
+
+	priv->threads = calloc(wp->max_threads, sizeof(struct thread_handle));
+	priv->items = calloc(wp->max_threads, sizeof(void *));
+	if (priv->threads == NULL || priv->items == NULL)
+	{
+		ret = -ENOMEM;
+		goto worker_pool_init_exit;
+	}
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+	{
+		goto worker_pool_init_exit;
+	}
+
+	ret = condvar_init(&priv->condvar);
+	if (ret < 0)
+	{
+		goto worker_pool_init_exit_mutex;
+	}
+
+	for (i = 0; i < wp->max_threads; i++)
+	{
+		priv->threads[i].func_ptr = pool_worker;
+		priv->threads[i].func_ctx = wp;
+		priv->threads[i].stack_size = wp->stack_size;
+		priv->threads[i].affinity = wp->affinity;
+		priv->threads[i].priority = wp->priority;
+
+		ret = thread_init(&priv->threads[i]);
+		if (ret < 0)
+		{
+			for (; i > 0; i--)
+			{
+				thread_free(&priv->threads[i - 1]);
+			}
+
+			goto worker_pool_init_exit_condvar;
+		}
+	}
+
+	return 0;
+
+worker_pool_init_exit_condvar:
+	condvar_free(&priv->condvar);
+worker_pool_init_exit_mutex:
+	mutex_free(&priv->mutex);
+worker_pool_init_exit:
+	free(priv->items);
+	free(priv->threads);
+
+	free(wp->priv);
+	wp->priv = NULL;
+
+	return ret;
+}
+
+int worker_pool_start(struct worker_pool_handle *wp)
+{
+	struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+	int ret = 0;
+
+	mutex_lock(&priv->mutex);
+
+	priv->sentinel = 0;
+
+	while (priv->started < wp->warm_threads)
+	{
+		ret = pool_grow(wp);
+		if (ret < 0)
+		{
+			break;
+		}
+	}
+
+	priv->running = ret == 0;
+
+	mutex_unlock(&priv->mutex);
+
+	if (ret < 0)
+	{
+		worker_pool_stop(wp);
+	}
+
+	return ret;
+}
+
+void worker_pool_stop(struct worker_pool_handle *wp)
+{
+	struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+	unsigned int i;
+
+	mutex_lock(&priv->mutex);
+
+	priv->running = 0;
+	priv->sentinel = 1;
+	condvar_wake_all(&priv->condvar);
+
+	mutex_unlock(&priv->mutex);
+
+	// Only a running pool starts threads, so the count can't change now
+	for (i = 0; i < priv->started; i++)
+	{
+		thread_join(&priv->threads[i]);
+	}
+
+	priv->started = 0;
+}
+
+int worker_pool_submit(struct worker_pool_handle *wp, void *item)
+{
+	struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+	int ret = 0;
+
+	mutex_lock(&priv->mutex);
+
+	if (!priv->running)
+	{
+		ret = -EINVAL;
+		goto worker_pool_submit_exit;
+	}
+
+	if (priv->count >= wp->max_threads)
+	{
+		ret = -ENOSPC;
+		goto worker_pool_submit_exit;
+	}
+
+	// Start another thread if every running one already has an item
+	if (priv->idle <= priv->count && priv->started < wp->max_threads)
+	{
+		ret = pool_grow(wp);
+		if (ret < 0 && priv->started == 0)
+		{
+			goto worker_pool_submit_exit;
+		}
+
+		// The threads already running get to it eventually
+		ret = 0;
+	}
+
+	priv->items[(priv->head + priv->count) % wp->max_threads] = item;
+	priv->count++;
+
+	condvar_wake_one(&priv->condvar);
+
+worker_pool_submit_exit:
+	mutex_unlock(&priv->mutex);
+
+	return ret;
+}
+
+unsigned int worker_pool_threads(struct worker_pool_handle *wp)
+{
+	struct worker_pool_priv *priv = (struct worker_pool_priv *)wp->priv;
+	unsigned int started;
+
+	mutex_lock_shared(&priv->mutex);
+	started = priv->started;
+	mutex_unlock_shared(&priv->mutex);
+
+	return started;
+}
@@ -0,0 +1,161 @@
+/*!
+ * @file bench_common.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Proxy client emulation and measurements shared by the benchmarks
+ */
+
+#include "openelp/openelp.h"
+
+#include "bench_common.h"
+#include "clock.h"
+#include "digest.h"
+
+#include <sys/resource.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+uint64_t bench_process_cpu_us(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return (uint64_t)ru.ru_utime.tv_sec * 1000000 + (uint64_t)ru.ru_utime.tv_usec +
+		(uint64_t)ru.ru_stime.tv_sec * 1000000 + (uint64_t)ru.ru_stime.tv_usec;
+}
+
+uint64_t bench_thread_cpu_us(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+	{
+		return 0;
+	}
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+int bench_login(struct conn_handle *conn, const char *addr, const char *port, const char *callsign, const char *password, uint64_t deadline)
+{
+	uint8_t buff[8 + 16 + PROXY_PASS_RES_LEN];
+	size_t len;
+	int ret;
+
+	ret = conn_connect(conn, addr, port);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = bench_recv_until(conn, buff, 8, deadline);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	len = (size_t)snprintf((char *)&buff[8], 16, "%s\n", callsign);
+	if (len >= 16)
+	{
+		return -EINVAL;
+	}
+
+	get_password_response(hex32_to_digest((const char *)buff), password, &buff[8 + len]);
+
+	return conn_send(conn, &buff[8], len + PROXY_PASS_RES_LEN);
+}
+
+int bench_recv_until(struct conn_handle *conn, uint8_t *buff, size_t len, uint64_t deadline)
+{
+	size_t got = 0;
+	uint64_t now;
+	int ret;
+
+	while (got < len)
+	{
+		now = clock_now_us();
+		if (now >= deadline)
+		{
+			return -ETIMEDOUT;
+		}
+
+		ret = conn_poll(conn, (uint32_t)(deadline - now));
+		if (ret < 0)
+		{
+			return ret;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_some(conn, &buff[got], len - got);
+		if (ret < 0)
+		{
+			return ret;
+		}
+		else if (ret == 0)
+		{
+			return -ECONNRESET;
+		}
+
+		got += (size_t)ret;
+	}
+
+	return 0;
+}
+
+size_t bench_write_header(uint8_t *buff, enum PROXY_MSG_TYPE type, uint32_t addr, uint32_t len)
+{
+	buff[0] = (uint8_t)type;
+	memcpy(&buff[1], &addr, sizeof(addr));
+	buff[5] = (uint8_t)len;
+	buff[6] = (uint8_t)(len >> 8);
+	buff[7] = (uint8_t)(len >> 16);
+	buff[8] = (uint8_t)(len >> 24);
+
+	return BENCH_HEADER_LEN;
+}
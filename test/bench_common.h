@@ -0,0 +1,115 @@
+/*!
+ * @file bench_common.h
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Proxy client emulation and measurements shared by the benchmarks
+ */
+
+#ifndef _bench_common_h
+#define _bench_common_h
+
+#include "conn.h"
+#include "proxy_conn.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Size of a message header in the proxy protocol
+#define BENCH_HEADER_LEN 9
+
+/*!
+ * @brief Gets the CPU time used by the whole process
+ *
+ * @returns CPU time in microseconds
+ */
+uint64_t bench_process_cpu_us(void);
+
+/*!
+ * @brief Gets the CPU time used by the calling thread
+ *
+ * @returns CPU time in microseconds, or 0 if it is not available
+ */
+uint64_t bench_thread_cpu_us(void);
+
+/*!
+ * @brief Connects to a proxy and authenticates as a client
+ *
+ * This returns once the response has been sent. Whether the proxy accepted
+ * it is only known from what the proxy does next.
+ *
+ * @param[in,out] conn Unconnected TCP connection to use
+ * @param[in] addr Address the proxy listens on
+ * @param[in] port Port the proxy listens on
+ * @param[in] callsign Null-terminated callsign to authenticate as, which is
+ *            at most 14 characters long
+ * @param[in] password Null-terminated password of the proxy
+ * @param[in] deadline Time to give up at, in microseconds
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int bench_login(struct conn_handle *conn, const char *addr, const char *port, const char *callsign, const char *password, uint64_t deadline);
+
+/*!
+ * @brief Receives an exact number of bytes, giving up at a deadline
+ *
+ * @param[in,out] conn Connection to receive from
+ * @param[out] buff Destination for the data
+ * @param[in] len Number of bytes to receive
+ * @param[in] deadline Time to give up at, in microseconds
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int bench_recv_until(struct conn_handle *conn, uint8_t *buff, size_t len, uint64_t deadline);
+
+/*!
+ * @brief Builds a message header in the proxy protocol
+ *
+ * @param[out] buff Destination for the header
+ * @param[in] type Type of the message
+ * @param[in] addr Address of the remote host, in network byte order
+ * @param[in] len Number of bytes of payload which follow the header
+ *
+ * @returns Number of bytes in the header
+ */
+size_t bench_write_header(uint8_t *buff, enum PROXY_MSG_TYPE type, uint32_t addr, uint32_t len);
+
+#endif /* _bench_common_h */
@@ -0,0 +1,1281 @@
+/*!
+ * @file bench_load.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Load generator for benchmarking a live proxy
+ */
+
+#include "openelp/openelp.h"
+
+#include "atomic.h"
+#include "bench_common.h"
+#include "clock.h"
+#include "conn.h"
+#include "histogram.h"
+#include "proxy_conn.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Address which the proxy listens on and the remote node uses
+#define BENCH_NODE_ADDR "127.0.0.1"
+
+/// Password which the synthetic clients authenticate with
+#define BENCH_PASSWORD "BENCH"
+
+/// Largest message which is sent or received in one piece
+#define BENCH_BUFF_LEN 4096
+
+/// Time to wait for traffic still inside the proxy after sending stops
+#define BENCH_DRAIN_US 500000
+
+/// Time to wait for each step of connecting a client, in microseconds
+#define BENCH_CONNECT_TIMEOUT 2000000
+
+/// Longest time a thread waits before checking whether it should stop
+#define BENCH_POLL_US 50000
+
+/*!
+ * @brief Settings for a benchmark run
+ */
+struct bench_opts
+{
+	/// Number of synthetic clients, each using its own slot
+	int clients;
+
+	/// Length of the measurement, in seconds
+	int duration;
+
+	/// UDP data frames sent each second in each direction for each client
+	int data_rate;
+
+	/// UDP control packets sent each second in each direction for each client
+	int control_rate;
+
+	/// Number of bytes of payload in each UDP data frame
+	int data_size;
+
+	/// TCP bytes sent each second by each client, 0 for none
+	int tcp_rate;
+
+	/// Value for proxy_conf::forwarding_backend
+	const char *forwarding_backend;
+
+	/// Value for proxy_conf::forwarding_threads
+	int forwarding_threads;
+
+	/// Port which the proxy listens on
+	int port;
+};
+
+/*!
+ * @brief Payload at the start of each UDP datagram
+ */
+struct bench_payload
+{
+	/// Time at which the datagram was sent, in microseconds
+	uint64_t stamp;
+
+	/// Index of the client or slot the datagram belongs to
+	uint32_t index;
+};
+
+/*!
+ * @brief State shared by all of the threads in a benchmark run
+ */
+struct bench_ctx
+{
+	/// Settings of the run
+	struct bench_opts opts;
+
+	/// Proxy being measured
+	struct proxy_handle ph;
+
+	/// Null-terminated port which the proxy listens on
+	char port_str[6];
+
+	/// Address of the remote node, in network byte order
+	uint32_t node_addr;
+
+	/// External address of each slot, in network byte order
+	uint32_t *slot_addrs;
+
+	/// Number of clients which are connected and ready to send
+	volatile uint32_t ready;
+
+	/// Non-zero once the clients and remote node should start sending
+	volatile uint32_t sending;
+
+	/// Non-zero once the clients and remote node should stop sending
+	volatile uint32_t sending_done;
+
+	/// Non-zero once every thread should return
+	volatile uint32_t stop;
+
+	/// Number of UDP data frames sent by the remote node
+	volatile uint64_t data_in_sent;
+
+	/// Number of UDP data frames received by the clients
+	volatile uint64_t data_in_recv;
+
+	/// Number of UDP data frames sent by the clients
+	volatile uint64_t data_out_sent;
+
+	/// Number of UDP data frames received by the remote node
+	volatile uint64_t data_out_recv;
+
+	/// Number of UDP control packets sent by the remote node
+	volatile uint64_t control_in_sent;
+
+	/// Number of UDP control packets received by the clients
+	volatile uint64_t control_in_recv;
+
+	/// Number of UDP control packets sent by the clients
+	volatile uint64_t control_out_sent;
+
+	/// Number of UDP control packets received by the remote node
+	volatile uint64_t control_out_recv;
+
+	/// Number of TCP bytes sent by the clients
+	volatile uint64_t tcp_sent;
+
+	/// Number of TCP bytes echoed back to the clients
+	volatile uint64_t tcp_recv;
+
+	/// Number of clients which failed
+	volatile uint32_t failures;
+
+	/// CPU time used by the load generator's own threads, in microseconds
+	volatile uint64_t generator_cpu_us;
+
+	/// Latency of UDP data forwarded to the clients
+	struct histogram latency_in;
+
+	/// Latency of UDP data forwarded from the clients
+	struct histogram latency_out;
+};
+
+/*!
+ * @brief Context of a single synthetic client or remote node TCP session
+ */
+struct bench_peer
+{
+	/// Shared benchmark state
+	struct bench_ctx *bc;
+
+	/// Index of the client
+	uint32_t index;
+
+	/// Connection to the proxy or to the remote node's TCP port
+	struct conn_handle conn;
+
+	/// Thread running the client or session
+	struct thread_handle thread;
+};
+
+/*!
+ * @brief Context of one of the remote node's UDP ports
+ */
+struct bench_node_udp
+{
+	/// Shared benchmark state
+	struct bench_ctx *bc;
+
+	/// Socket bound to the port
+	struct conn_handle conn;
+
+	/// Thread receiving on the port
+	struct thread_handle thread_recv;
+
+	/// Non-zero for the control port, zero for the data port
+	int is_control;
+};
+
+/*!
+ * @brief Runs a synthetic client
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * bench_client(void *ctx);
+
+/*!
+ * @brief Connects a synthetic client and opens its TCP session
+ *
+ * @param[in,out] peer Target client
+ * @param[out] buff Storage for the handshake
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int bench_client_connect(struct bench_peer *peer, uint8_t buff[BENCH_BUFF_LEN]);
+
+/*!
+ * @brief Processes the complete messages received by a synthetic client
+ *
+ * @param[in,out] peer Target client
+ * @param[in,out] buff Received data
+ * @param[in,out] len Number of bytes in buff, updated to what is left over
+ */
+static void bench_client_process(struct bench_peer *peer, uint8_t *buff, size_t *len);
+
+/*!
+ * @brief Echoes TCP data sent through the proxy back to the client
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * bench_node_echo(void *ctx);
+
+/*!
+ * @brief Sends UDP data and control traffic to each slot
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * bench_node_send(void *ctx);
+
+/*!
+ * @brief Accepts TCP sessions opened through the proxy
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * bench_node_tcp(void *ctx);
+
+/*!
+ * @brief Receives UDP traffic sent through the proxy
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * bench_node_udp_recv(void *ctx);
+
+/*!
+ * @brief Accepts clients into the proxy until it is shut down
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * bench_proxy_process(void *ctx);
+
+/*!
+ * @brief Prints the results of a benchmark run
+ *
+ * @param[in] bc Finished benchmark state
+ * @param[in] elapsed_us Length of the measurement, in microseconds
+ * @param[in] proxy_cpu_us CPU time used by the proxy, in microseconds
+ */
+static void bench_report(struct bench_ctx *bc, uint64_t elapsed_us, uint64_t proxy_cpu_us);
+
+/*!
+ * @brief Main entry point for the load generator
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Command line arguments
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(int argc, char *argv[]);
+
+/*!
+ * @brief Parses the command line into benchmark settings
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Command line arguments
+ * @param[out] opts Resulting settings
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int parse_args(int argc, char *argv[], struct bench_opts *opts);
+
+/*!
+ * @brief Print the program usage to STDOUT
+ */
+static void print_usage(void);
+
+/*!
+ * @brief Adds the CPU time used by the calling thread to the generator total
+ *
+ * @param[in,out] bc Shared benchmark state
+ */
+static void thread_cpu_done(struct bench_ctx *bc);
+
+static void * bench_client(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct bench_peer *peer = (struct bench_peer *)th->func_ctx;
+	struct bench_ctx *bc = peer->bc;
+	const uint64_t data_interval = bc->opts.data_rate > 0 ? 1000000 / (uint64_t)bc->opts.data_rate : 0;
+	const uint64_t control_interval = bc->opts.control_rate > 0 ? 1000000 / (uint64_t)bc->opts.control_rate : 0;
+	const size_t tcp_chunk = bc->opts.data_rate > 0 ? (size_t)(bc->opts.tcp_rate / bc->opts.data_rate) : 0;
+	uint8_t rx[2 * BENCH_BUFF_LEN];
+	uint8_t tx[BENCH_BUFF_LEN];
+	struct bench_payload payload;
+	size_t rx_len = 0;
+	size_t hdr_len;
+	uint64_t next_data;
+	uint64_t next_control;
+	uint64_t next;
+	uint64_t now;
+	int ret;
+
+	ret = bench_client_connect(peer, tx);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Client %u failed to connect (%d): %s\n", peer->index, -ret, strerror(-ret));
+		atomic_u32_add(&bc->failures, 1);
+		atomic_u32_add(&bc->ready, 1);
+		thread_cpu_done(bc);
+
+		return NULL;
+	}
+
+	atomic_u32_add(&bc->ready, 1);
+
+	while (!atomic_u32_load(&bc->sending) && !atomic_u32_load(&bc->stop))
+	{
+		usleep(1000);
+	}
+
+	now = clock_now_us();
+
+	// Spread the clients out so that they don't all send at the same moment
+	next_data = now + (data_interval * peer->index) / (uint32_t)bc->opts.clients;
+	next_control = now + (control_interval * peer->index) / (uint32_t)bc->opts.clients;
+
+	while (!atomic_u32_load(&bc->stop))
+	{
+		now = clock_now_us();
+
+		if (!atomic_u32_load(&bc->sending_done))
+		{
+			if (data_interval > 0 && now >= next_data)
+			{
+				payload.stamp = now;
+				payload.index = peer->index;
+
+				hdr_len = bench_write_header(tx, PROXY_MSG_TYPE_UDP_DATA, bc->node_addr, (uint32_t)bc->opts.data_size);
+				memset(&tx[hdr_len], 0x55, (size_t)bc->opts.data_size);
+				memcpy(&tx[hdr_len], &payload, sizeof(payload));
+
+				if (conn_send(&peer->conn, tx, hdr_len + (size_t)bc->opts.data_size) < 0)
+				{
+					break;
+				}
+
+				atomic_u64_add(&bc->data_out_sent, 1);
+
+				if (tcp_chunk > 0)
+				{
+					hdr_len = bench_write_header(tx, PROXY_MSG_TYPE_TCP_DATA, bc->node_addr, (uint32_t)tcp_chunk);
+					memset(&tx[hdr_len], 0xaa, tcp_chunk);
+
+					if (conn_send(&peer->conn, tx, hdr_len + tcp_chunk) < 0)
+					{
+						break;
+					}
+
+					atomic_u64_add(&bc->tcp_sent, tcp_chunk);
+				}
+
+				next_data += data_interval;
+			}
+
+			if (control_interval > 0 && now >= next_control)
+			{
+				payload.stamp = now;
+				payload.index = peer->index;
+
+				hdr_len = bench_write_header(tx, PROXY_MSG_TYPE_UDP_CONTROL, bc->node_addr, sizeof(payload));
+				memcpy(&tx[hdr_len], &payload, sizeof(payload));
+
+				if (conn_send(&peer->conn, tx, hdr_len + sizeof(payload)) < 0)
+				{
+					break;
+				}
+
+				atomic_u64_add(&bc->control_out_sent, 1);
+
+				next_control += control_interval;
+			}
+
+			next = data_interval > 0 ? next_data : now + BENCH_POLL_US;
+			if (control_interval > 0 && next_control < next)
+			{
+				next = next_control;
+			}
+		}
+		else
+		{
+			next = now + BENCH_POLL_US;
+		}
+
+		now = clock_now_us();
+		ret = conn_poll(&peer->conn, next > now ? (uint32_t)(next - now) : 0);
+		if (ret < 0)
+		{
+			break;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_some(&peer->conn, &rx[rx_len], sizeof(rx) - rx_len);
+		if (ret <= 0)
+		{
+			break;
+		}
+
+		rx_len += (size_t)ret;
+
+		bench_client_process(peer, rx, &rx_len);
+	}
+
+	if (!atomic_u32_load(&bc->stop))
+	{
+		fprintf(stderr, "Error: Client %u lost its connection to the proxy\n", peer->index);
+		atomic_u32_add(&bc->failures, 1);
+	}
+
+	conn_close(&peer->conn);
+
+	thread_cpu_done(bc);
+
+	return NULL;
+}
+
+static int bench_client_connect(struct bench_peer *peer, uint8_t buff[BENCH_BUFF_LEN])
+{
+	struct bench_ctx *bc = peer->bc;
+	const uint64_t deadline = clock_now_us() + BENCH_CONNECT_TIMEOUT;
+	char callsign[16];
+	size_t hdr_len;
+	int ret;
+
+	// Each client needs a distinct callsign, since a slot may be held for it
+	snprintf(callsign, sizeof(callsign), "B%uNCH", peer->index);
+
+	ret = bench_login(&peer->conn, BENCH_NODE_ADDR, bc->port_str, callsign, BENCH_PASSWORD, deadline);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	// Opening the TCP session shows that the client has been given a slot
+	hdr_len = bench_write_header(buff, PROXY_MSG_TYPE_TCP_OPEN, bc->node_addr, 0);
+
+	ret = conn_send(&peer->conn, buff, hdr_len);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = bench_recv_until(&peer->conn, buff, BENCH_HEADER_LEN + 4, deadline);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	if (buff[0] != PROXY_MSG_TYPE_TCP_STATUS || buff[BENCH_HEADER_LEN] != 0 || buff[BENCH_HEADER_LEN + 1] != 0 || buff[BENCH_HEADER_LEN + 2] != 0 || buff[BENCH_HEADER_LEN + 3] != 0)
+	{
+		return -ECONNREFUSED;
+	}
+
+	return 0;
+}
+
+static void bench_client_process(struct bench_peer *peer, uint8_t *buff, size_t *len)
+{
+	struct bench_ctx *bc = peer->bc;
+	struct bench_payload payload;
+	size_t off = 0;
+	uint32_t msg_len;
+	uint64_t now = clock_now_us();
+
+	while (*len - off >= BENCH_HEADER_LEN)
+	{
+		msg_len = (uint32_t)buff[off + 5] | ((uint32_t)buff[off + 6] << 8) | ((uint32_t)buff[off + 7] << 16) | ((uint32_t)buff[off + 8] << 24);
+		if (*len - off - BENCH_HEADER_LEN < msg_len)
+		{
+			break;
+		}
+
+		switch (buff[off])
+		{
+		case PROXY_MSG_TYPE_UDP_DATA:
+			if (msg_len >= sizeof(payload))
+			{
+				memcpy(&payload, &buff[off + BENCH_HEADER_LEN], sizeof(payload));
+				histogram_record(&bc->latency_in, now - payload.stamp);
+			}
+
+			atomic_u64_add(&bc->data_in_recv, 1);
+
+			break;
+		case PROXY_MSG_TYPE_UDP_CONTROL:
+			atomic_u64_add(&bc->control_in_recv, 1);
+
+			break;
+		case PROXY_MSG_TYPE_TCP_DATA:
+			atomic_u64_add(&bc->tcp_recv, msg_len);
+
+			break;
+		default:
+			break;
+		}
+
+		off += BENCH_HEADER_LEN + msg_len;
+	}
+
+	memmove(buff, &buff[off], *len - off);
+	*len -= off;
+}
+
+static void * bench_node_echo(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct bench_peer *peer = (struct bench_peer *)th->func_ctx;
+	struct bench_ctx *bc = peer->bc;
+	uint8_t buff[BENCH_BUFF_LEN];
+	int ret;
+
+	while (!atomic_u32_load(&bc->stop))
+	{
+		ret = conn_poll(&peer->conn, BENCH_POLL_US);
+		if (ret < 0)
+		{
+			break;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_some(&peer->conn, buff, sizeof(buff));
+		if (ret <= 0 || conn_send(&peer->conn, buff, (size_t)ret) < 0)
+		{
+			break;
+		}
+	}
+
+	conn_close(&peer->conn);
+
+	thread_cpu_done(bc);
+
+	return NULL;
+}
+
+static void * bench_node_send(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct bench_node_udp *node = (struct bench_node_udp *)th->func_ctx;
+	struct bench_ctx *bc = node->bc;
+	const int rate = node->is_control ? bc->opts.control_rate : bc->opts.data_rate;
+	const size_t size = node->is_control ? sizeof(struct bench_payload) : (size_t)bc->opts.data_size;
+	const uint64_t interval = 1000000 / (uint64_t)rate;
+	uint8_t buff[BENCH_BUFF_LEN];
+	struct bench_payload payload;
+	uint64_t next = clock_now_us();
+	uint64_t now;
+	int i;
+
+	memset(buff, 0x55, size);
+
+	while (!atomic_u32_load(&bc->sending_done))
+	{
+		now = clock_now_us();
+		if (now < next)
+		{
+			usleep((useconds_t)(next - now < BENCH_POLL_US ? next - now : BENCH_POLL_US));
+			continue;
+		}
+
+		for (i = 0; i < bc->opts.clients; i++)
+		{
+			payload.stamp = clock_now_us();
+			payload.index = (uint32_t)i;
+			memcpy(buff, &payload, sizeof(payload));
+
+			if (conn_send_to(&node->conn, buff, size, bc->slot_addrs[i], node->is_control ? 5199 : 5198) == 0)
+			{
+				atomic_u64_add(node->is_control ? &bc->control_in_sent : &bc->data_in_sent, 1);
+			}
+		}
+
+		next += interval;
+	}
+
+	thread_cpu_done(bc);
+
+	return NULL;
+}
+
+static void * bench_node_tcp(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct bench_peer *sessions = (struct bench_peer *)th->func_ctx;
+	struct bench_ctx *bc = sessions[0].bc;
+	struct conn_handle listener;
+	int accepted = 0;
+	int ret;
+	int i;
+
+	memset(&listener, 0x0, sizeof(struct conn_handle));
+	listener.type = CONN_TYPE_TCP;
+	listener.source_addr = BENCH_NODE_ADDR;
+	listener.source_port = "5200";
+
+	ret = conn_init(&listener);
+	if (ret == 0)
+	{
+		ret = conn_listen(&listener);
+	}
+
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Remote node failed to listen on TCP port 5200 (%d): %s\n", -ret, strerror(-ret));
+		atomic_u32_add(&bc->failures, 1);
+		conn_free(&listener);
+		thread_cpu_done(bc);
+
+		return NULL;
+	}
+
+	while (accepted < bc->opts.clients && !atomic_u32_load(&bc->stop))
+	{
+		ret = conn_poll(&listener, BENCH_POLL_US);
+		if (ret <= 0)
+		{
+			continue;
+		}
+
+		ret = conn_accept(&listener, &sessions[accepted].conn);
+		if (ret < 0)
+		{
+			continue;
+		}
+
+		sessions[accepted].thread.func_ptr = bench_node_echo;
+		sessions[accepted].thread.func_ctx = &sessions[accepted];
+
+		ret = thread_start(&sessions[accepted].thread);
+		if (ret < 0)
+		{
+			conn_close(&sessions[accepted].conn);
+			continue;
+		}
+
+		accepted++;
+	}
+
+	for (i = 0; i < accepted; i++)
+	{
+		thread_join(&sessions[i].thread);
+	}
+
+	conn_close(&listener);
+	conn_free(&listener);
+
+	thread_cpu_done(bc);
+
+	return NULL;
+}
+
+static void * bench_node_udp_recv(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct bench_node_udp *node = (struct bench_node_udp *)th->func_ctx;
+	struct bench_ctx *bc = node->bc;
+	uint8_t buff[BENCH_BUFF_LEN];
+	struct bench_payload payload;
+	uint32_t addr;
+	uint16_t port;
+	int ret;
+
+	while (!atomic_u32_load(&bc->stop))
+	{
+		ret = conn_poll(&node->conn, BENCH_POLL_US);
+		if (ret < 0)
+		{
+			break;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_any(&node->conn, buff, sizeof(buff), &addr, &port);
+		if (ret < 0)
+		{
+			break;
+		}
+
+		if (node->is_control)
+		{
+			atomic_u64_add(&bc->control_out_recv, 1);
+		}
+		else
+		{
+			if ((size_t)ret >= sizeof(payload))
+			{
+				memcpy(&payload, buff, sizeof(payload));
+				histogram_record(&bc->latency_out, clock_now_us() - payload.stamp);
+			}
+
+			atomic_u64_add(&bc->data_out_recv, 1);
+		}
+	}
+
+	thread_cpu_done(bc);
+
+	return NULL;
+}
+
+static void * bench_proxy_process(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct bench_ctx *bc = (struct bench_ctx *)th->func_ctx;
+
+	while (!atomic_u32_load(&bc->stop))
+	{
+		if (proxy_process(&bc->ph) < 0 && !atomic_u32_load(&bc->stop))
+		{
+			usleep(1000);
+		}
+	}
+
+	return NULL;
+}
+
+static void bench_report(struct bench_ctx *bc, uint64_t elapsed_us, uint64_t proxy_cpu_us)
+{
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+	const double secs = (double)elapsed_us / 1000000.0;
+	uint64_t sent;
+	uint64_t recv;
+
+	printf("Clients: %d, duration: %.1f s, forwarding threads: %d\n", bc->opts.clients, secs, bc->opts.forwarding_threads);
+	printf("Offered load per client: %d data frames/s of %d bytes, %d control packets/s, %d TCP bytes/s\n",
+		bc->opts.data_rate, bc->opts.data_size, bc->opts.control_rate, bc->opts.tcp_rate);
+
+	sent = atomic_u64_load(&bc->data_in_sent);
+	recv = atomic_u64_load(&bc->data_in_recv);
+	histogram_read(&bc->latency_in, buckets, NULL);
+	printf("UDP data in:     %8" PRIu64 " sent %8" PRIu64 " received %6.2f%% lost %9.1f frames/s  p50 %6" PRIu64 " us  p99 %6" PRIu64 " us\n",
+		sent, recv, sent > 0 ? 100.0 * (double)(sent - (recv < sent ? recv : sent)) / (double)sent : 0.0, (double)recv / secs,
+		histogram_quantile(buckets, 500), histogram_quantile(buckets, 990));
+
+	sent = atomic_u64_load(&bc->data_out_sent);
+	recv = atomic_u64_load(&bc->data_out_recv);
+	histogram_read(&bc->latency_out, buckets, NULL);
+	printf("UDP data out:    %8" PRIu64 " sent %8" PRIu64 " received %6.2f%% lost %9.1f frames/s  p50 %6" PRIu64 " us  p99 %6" PRIu64 " us\n",
+		sent, recv, sent > 0 ? 100.0 * (double)(sent - (recv < sent ? recv : sent)) / (double)sent : 0.0, (double)recv / secs,
+		histogram_quantile(buckets, 500), histogram_quantile(buckets, 990));
+
+	sent = atomic_u64_load(&bc->control_in_sent);
+	recv = atomic_u64_load(&bc->control_in_recv);
+	printf("UDP control in:  %8" PRIu64 " sent %8" PRIu64 " received %6.2f%% lost\n",
+		sent, recv, sent > 0 ? 100.0 * (double)(sent - (recv < sent ? recv : sent)) / (double)sent : 0.0);
+
+	sent = atomic_u64_load(&bc->control_out_sent);
+	recv = atomic_u64_load(&bc->control_out_recv);
+	printf("UDP control out: %8" PRIu64 " sent %8" PRIu64 " received %6.2f%% lost\n",
+		sent, recv, sent > 0 ? 100.0 * (double)(sent - (recv < sent ? recv : sent)) / (double)sent : 0.0);
+
+	printf("TCP echo:        %8" PRIu64 " bytes sent %8" PRIu64 " bytes returned %9.1f bytes/s\n",
+		atomic_u64_load(&bc->tcp_sent), atomic_u64_load(&bc->tcp_recv), (double)atomic_u64_load(&bc->tcp_recv) / secs);
+
+	printf("Proxy CPU:       %.1f ms total, %.3f%% of a core per client\n",
+		(double)proxy_cpu_us / 1000.0, 100.0 * (double)proxy_cpu_us / (double)elapsed_us / (double)bc->opts.clients);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct bench_ctx bc;
+	struct bench_peer *clients = NULL;
+	struct bench_peer *sessions = NULL;
+	struct bench_node_udp nodes[2];
+	struct thread_handle thread_proxy;
+	struct thread_handle thread_tcp;
+	struct thread_handle threads_send[2];
+	char addr[20];
+	uint64_t cpu_start = 0;
+	uint64_t cpu_total;
+	uint64_t generator_cpu;
+	uint64_t start;
+	uint64_t elapsed = 0;
+	int i;
+	int ret;
+
+	memset(nodes, 0x0, sizeof(nodes));
+	memset(&thread_proxy, 0x0, sizeof(thread_proxy));
+	memset(&thread_tcp, 0x0, sizeof(thread_tcp));
+	memset(threads_send, 0x0, sizeof(threads_send));
+
+	ret = parse_args(argc, argv, &bc.opts);
+	if (ret < 0)
+	{
+		return 1;
+	}
+
+	snprintf(bc.port_str, sizeof(bc.port_str), "%d", bc.opts.port);
+
+	clients = calloc((size_t)bc.opts.clients, sizeof(struct bench_peer));
+	sessions = calloc((size_t)bc.opts.clients, sizeof(struct bench_peer));
+	bc.slot_addrs = calloc((size_t)bc.opts.clients, sizeof(uint32_t));
+	if (clients == NULL || sessions == NULL || bc.slot_addrs == NULL)
+	{
+		ret = -ENOMEM;
+		goto main_exit;
+	}
+
+	ret = conn_resolve(BENCH_NODE_ADDR, &bc.node_addr);
+	if (ret < 0)
+	{
+		goto main_exit;
+	}
+
+	// Configure a proxy with one slot for each client, each using its own
+	// loopback address
+	ret = proxy_init(&bc.ph);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize proxy (%d): %s\n", -ret, strerror(-ret));
+		goto main_exit;
+	}
+
+	proxy_log_level(&bc.ph, getenv("BENCH_DEBUG") ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARN);
+
+	bc.ph.conf.port = (uint16_t)bc.opts.port;
+	bc.ph.conf.forwarding_threads = (uint16_t)bc.opts.forwarding_threads;
+	bc.ph.conf.password = malloc(sizeof(BENCH_PASSWORD));
+	bc.ph.conf.bind_addr = malloc(sizeof(BENCH_NODE_ADDR));
+	bc.ph.conf.bind_addr_ext = malloc(sizeof(addr));
+	bc.ph.conf.bind_addr_ext_add = calloc((size_t)bc.opts.clients, sizeof(char *));
+	if (bc.ph.conf.password == NULL || bc.ph.conf.bind_addr == NULL || bc.ph.conf.bind_addr_ext == NULL || bc.ph.conf.bind_addr_ext_add == NULL)
+	{
+		ret = -ENOMEM;
+		goto main_exit;
+	}
+
+	memcpy(bc.ph.conf.password, BENCH_PASSWORD, sizeof(BENCH_PASSWORD));
+	memcpy(bc.ph.conf.bind_addr, BENCH_NODE_ADDR, sizeof(BENCH_NODE_ADDR));
+
+	if (bc.opts.forwarding_backend != NULL)
+	{
+		bc.ph.conf.forwarding_backend = malloc(strlen(bc.opts.forwarding_backend) + 1);
+		if (bc.ph.conf.forwarding_backend == NULL)
+		{
+			ret = -ENOMEM;
+			goto main_exit;
+		}
+
+		strcpy(bc.ph.conf.forwarding_backend, bc.opts.forwarding_backend);
+	}
+
+	for (i = 0; i < bc.opts.clients; i++)
+	{
+		snprintf(addr, sizeof(addr), "127.0.%d.%d", (i + 1) / 254, (i + 1) % 254 + 1);
+
+		ret = conn_resolve(addr, &bc.slot_addrs[i]);
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+
+		if (i == 0)
+		{
+			memcpy(bc.ph.conf.bind_addr_ext, addr, sizeof(addr));
+			continue;
+		}
+
+		bc.ph.conf.bind_addr_ext_add[bc.ph.conf.bind_addr_ext_add_len] = malloc(sizeof(addr));
+		if (bc.ph.conf.bind_addr_ext_add[bc.ph.conf.bind_addr_ext_add_len] == NULL)
+		{
+			ret = -ENOMEM;
+			goto main_exit;
+		}
+
+		memcpy(bc.ph.conf.bind_addr_ext_add[bc.ph.conf.bind_addr_ext_add_len++], addr, sizeof(addr));
+	}
+
+	ret = proxy_open(&bc.ph);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to open proxy (%d): %s\n", -ret, strerror(-ret));
+		goto main_exit;
+	}
+
+	ret = proxy_start(&bc.ph);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to start proxy (%d): %s\n", -ret, strerror(-ret));
+		goto main_exit;
+	}
+
+	// The remote node listens on the EchoLink ports
+	for (i = 0; i < 2; i++)
+	{
+		nodes[i].bc = &bc;
+		nodes[i].is_control = i;
+		nodes[i].conn.type = CONN_TYPE_UDP;
+		nodes[i].conn.source_addr = BENCH_NODE_ADDR;
+		nodes[i].conn.source_port = i ? "5199" : "5198";
+		nodes[i].thread_recv.func_ptr = bench_node_udp_recv;
+		nodes[i].thread_recv.func_ctx = &nodes[i];
+		threads_send[i].func_ptr = bench_node_send;
+		threads_send[i].func_ctx = &nodes[i];
+
+		ret = conn_init(&nodes[i].conn);
+		if (ret == 0)
+		{
+			ret = conn_listen(&nodes[i].conn);
+		}
+
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Remote node failed to listen on UDP port %s (%d): %s\n", nodes[i].conn.source_port, -ret, strerror(-ret));
+			goto main_exit;
+		}
+
+		ret = thread_init(&nodes[i].thread_recv);
+		if (ret == 0)
+		{
+			ret = thread_init(&threads_send[i]);
+		}
+
+		if (ret == 0)
+		{
+			ret = thread_start(&nodes[i].thread_recv);
+		}
+
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+	}
+
+	for (i = 0; i < bc.opts.clients; i++)
+	{
+		clients[i].bc = &bc;
+		clients[i].index = (uint32_t)i;
+		clients[i].conn.type = CONN_TYPE_TCP;
+		clients[i].thread.func_ptr = bench_client;
+		clients[i].thread.func_ctx = &clients[i];
+
+		sessions[i].bc = &bc;
+		sessions[i].index = (uint32_t)i;
+		sessions[i].conn.type = CONN_TYPE_TCP;
+
+		ret = conn_init(&clients[i].conn);
+		if (ret == 0)
+		{
+			ret = conn_init(&sessions[i].conn);
+		}
+
+		if (ret == 0)
+		{
+			ret = thread_init(&clients[i].thread);
+		}
+
+		if (ret == 0)
+		{
+			ret = thread_init(&sessions[i].thread);
+		}
+
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+	}
+
+	thread_tcp.func_ptr = bench_node_tcp;
+	thread_tcp.func_ctx = sessions;
+	thread_proxy.func_ptr = bench_proxy_process;
+	thread_proxy.func_ctx = &bc;
+
+	ret = thread_init(&thread_tcp);
+	if (ret == 0)
+	{
+		ret = thread_init(&thread_proxy);
+	}
+
+	if (ret == 0)
+	{
+		ret = thread_start(&thread_tcp);
+	}
+
+	if (ret == 0)
+	{
+		ret = thread_start(&thread_proxy);
+	}
+
+	if (ret < 0)
+	{
+		goto main_exit;
+	}
+
+	cpu_start = bench_process_cpu_us();
+
+	for (i = 0; i < bc.opts.clients; i++)
+	{
+		ret = thread_start(&clients[i].thread);
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+	}
+
+	while (atomic_u32_load(&bc.ready) < (uint32_t)bc.opts.clients)
+	{
+		usleep(1000);
+	}
+
+	if (atomic_u32_load(&bc.failures) > 0)
+	{
+		ret = -ECONNREFUSED;
+		goto main_exit;
+	}
+
+	start = clock_now_us();
+	atomic_u32_store(&bc.sending, 1);
+
+	for (i = 0; i < 2; i++)
+	{
+		if ((i ? bc.opts.control_rate : bc.opts.data_rate) > 0)
+		{
+			ret = thread_start(&threads_send[i]);
+			if (ret < 0)
+			{
+				goto main_exit;
+			}
+		}
+	}
+
+	usleep((useconds_t)bc.opts.duration * 1000000);
+
+	atomic_u32_store(&bc.sending_done, 1);
+	elapsed = clock_now_us() - start;
+
+	usleep(BENCH_DRAIN_US);
+
+	ret = atomic_u32_load(&bc.failures) > 0 ? -EIO : 0;
+
+main_exit:
+	atomic_u32_store(&bc.sending_done, 1);
+	atomic_u32_store(&bc.stop, 1);
+
+	// Freeing each generator thread waits for it to return
+	for (i = 0; i < 2; i++)
+	{
+		thread_free(&threads_send[i]);
+		thread_free(&nodes[i].thread_recv);
+		conn_free(&nodes[i].conn);
+	}
+
+	for (i = 0; clients != NULL && i < bc.opts.clients; i++)
+	{
+		thread_free(&clients[i].thread);
+		conn_free(&clients[i].conn);
+	}
+
+	thread_free(&thread_tcp);
+
+	for (i = 0; sessions != NULL && i < bc.opts.clients; i++)
+	{
+		thread_free(&sessions[i].thread);
+		conn_free(&sessions[i].conn);
+	}
+
+	if (ret == 0)
+	{
+		cpu_total = bench_process_cpu_us() - cpu_start;
+		generator_cpu = atomic_u64_load(&bc.generator_cpu_us);
+
+		bench_report(&bc, elapsed, cpu_total > generator_cpu ? cpu_total - generator_cpu : 0);
+	}
+	else
+	{
+		fprintf(stderr, "Error: Benchmark failed (%d): %s\n", -ret, strerror(-ret));
+	}
+
+	if (bc.ph.priv != NULL)
+	{
+		proxy_shutdown(&bc.ph);
+	}
+
+	thread_free(&thread_proxy);
+	proxy_free(&bc.ph);
+
+	free(clients);
+	free(sessions);
+	free(bc.slot_addrs);
+
+	return ret == 0 ? 0 : 1;
+}
+
+static int parse_args(int argc, char *argv[], struct bench_opts *opts)
+{
+	int *target;
+	int i;
+
+	opts->clients = 4;
+	opts->duration = 5;
+	opts->data_rate = 50;
+	opts->control_rate = 1;
+	opts->data_size = 320;
+	opts->tcp_rate = 1024;
+	opts->forwarding_backend = NULL;
+	opts->forwarding_threads = 0;
+	opts->port = 8100;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+		{
+			print_usage();
+			exit(0);
+		}
+
+		if (strlen(argv[i]) != 2 || argv[i][0] != '-' || i + 1 >= argc)
+		{
+			fprintf(stderr, "Error: Invalid argument '%s'\n", argv[i]);
+			print_usage();
+			return -EINVAL;
+		}
+
+		if (argv[i][1] == 'b')
+		{
+			opts->forwarding_backend = argv[++i];
+			continue;
+		}
+
+		switch (argv[i][1])
+		{
+		case 'c':
+			target = &opts->clients;
+			break;
+		case 'd':
+			target = &opts->duration;
+			break;
+		case 'f':
+			target = &opts->forwarding_threads;
+			break;
+		case 'p':
+			target = &opts->port;
+			break;
+		case 'r':
+			target = &opts->data_rate;
+			break;
+		case 'R':
+			target = &opts->control_rate;
+			break;
+		case 's':
+			target = &opts->data_size;
+			break;
+		case 't':
+			target = &opts->tcp_rate;
+			break;
+		default:
+			fprintf(stderr, "Error: Invalid argument '%s'\n", argv[i]);
+			print_usage();
+			return -EINVAL;
+		}
+
+		i++;
+		*target = atoi(argv[i]);
+	}
+
+	if (opts->clients < 1 || opts->clients > 1000 || opts->duration < 1 || opts->data_rate < 0 || opts->data_rate > 1000000 ||
+		opts->control_rate < 0 || opts->control_rate > 1000000 || opts->data_size < (int)sizeof(struct bench_payload) ||
+		opts->data_size > BENCH_BUFF_LEN - BENCH_HEADER_LEN || opts->tcp_rate < 0 || opts->forwarding_threads < 0 ||
+		opts->forwarding_threads > UINT16_MAX || opts->port < 1 || opts->port > UINT16_MAX)
+	{
+		fprintf(stderr, "Error: Argument out of range\n");
+		return -EINVAL;
+	}
+
+	// TCP data is sent along with each UDP data frame
+	if (opts->tcp_rate > 0 && (opts->data_rate == 0 || opts->tcp_rate / opts->data_rate > BENCH_BUFF_LEN - BENCH_HEADER_LEN))
+	{
+		fprintf(stderr, "Error: TCP rate requires a UDP data rate of at least %d\n", opts->tcp_rate / (BENCH_BUFF_LEN - BENCH_HEADER_LEN) + 1);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void print_usage(void)
+{
+	printf("Usage: bench_load [OPTION...]\n\n"
+		"Runs a proxy on the loopback interface and measures it with synthetic\n"
+		"clients and a synthetic remote node. Slots use 127.0.0.2 and up.\n\n"
+		"Options:\n"
+		"  -b <name>   Forwarding backend, such as epoll or io_uring (default\n"
+		"              is the platform default)\n"
+		"  -c <count>  Number of clients (default 4)\n"
+		"  -d <secs>   Length of the measurement (default 5)\n"
+		"  -f <count>  Forwarding threads, 0 for a thread per client (default 0)\n"
+		"  -p <port>   Port for the proxy to listen on (default 8100)\n"
+		"  -r <rate>   UDP data frames per second per client (default 50)\n"
+		"  -R <rate>   UDP control packets per second per client (default 1)\n"
+		"  -s <bytes>  Size of each UDP data frame (default 320)\n"
+		"  -t <rate>   TCP bytes per second per client (default 1024)\n"
+		"  -h, --help  Display this help\n");
+}
+
+static void thread_cpu_done(struct bench_ctx *bc)
+{
+	atomic_u64_add(&bc->generator_cpu_us, bench_thread_cpu_us());
+}
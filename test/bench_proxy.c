@@ -0,0 +1,131 @@
+/*!
+ * @file bench_proxy.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Benchmarks related to the proxy itself
+ */
+
+#include "openelp/openelp.h"
+
+#include "clock.h"
+#include "digest.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/// Number of responses to compute for each measurement
+#define BENCH_ITERATIONS 100000
+
+/*!
+ * @brief Measure the cost of computing password responses with and without a
+ *        precomputed password digest state
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int bench_proxy_password_response(void);
+
+/*!
+ * @brief Main entry point for proxy benchmarks
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= bench_proxy_password_response();
+
+	return ret;
+}
+
+static int bench_proxy_password_response(void)
+{
+	const char password[] = "correct horse battery staple";
+	struct digest_password dp;
+	uint8_t expected[PROXY_PASS_RES_LEN];
+	uint8_t response[PROXY_PASS_RES_LEN];
+	uint64_t scratch_us;
+	uint64_t precomputed_us;
+	uint64_t start;
+	uint32_t i;
+	int ret;
+
+	start = clock_now_us();
+
+	for (i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		ret = get_password_response(i, password, expected);
+		if (ret != 0)
+		{
+			fprintf(stderr, "Error: get_password_response returned %d\n", ret);
+			return ret;
+		}
+	}
+
+	scratch_us = clock_now_us() - start;
+
+	start = clock_now_us();
+
+	digest_password_init(&dp, password);
+
+	for (i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		digest_password_response(&dp, i, response);
+	}
+
+	precomputed_us = clock_now_us() - start;
+
+	// The last response from each loop was for the same nonce
+	if (!digest_equal(expected, response))
+	{
+		fprintf(stderr, "Error: Precomputed password response does not match\n");
+		return -EINVAL;
+	}
+
+	printf("Password response from scratch: %" PRIu64 " ns\n", scratch_us * 1000 / BENCH_ITERATIONS);
+	printf("Password response precomputed:  %" PRIu64 " ns\n", precomputed_us * 1000 / BENCH_ITERATIONS);
+
+	return 0;
+}
@@ -0,0 +1,2338 @@
+/*!
+ * @file bench_replay.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Replays recorded traffic through a proxy and measures it
+ *
+ * Recordings are pcap or pcapng captures, such as those written by
+ * ::proxy_dump_trace or those taken with tcpdump on the proxy's external
+ * interface. Each local address in the capture is replayed by a client of
+ * its own, and each remote host by a node on a loopback address of its own.
+ * Without a capture, a built-in recording of a conference is replayed.
+ */
+
+#include "openelp/openelp.h"
+
+#include "atomic.h"
+#include "bench_common.h"
+#include "clock.h"
+#include "conn.h"
+#include "histogram.h"
+#include "proxy_conn.h"
+#include "thread.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Address which the proxy listens on
+#define REPLAY_PROXY_ADDR "127.0.0.1"
+
+/// Password which the replaying clients authenticate with
+#define REPLAY_PASSWORD "REPLAY"
+
+/// Exit status telling CTest that the replay could not be run here
+#define REPLAY_EXIT_SKIP 77
+
+/// Size of the buffer each client receives into
+#define REPLAY_BUFF_LEN 4096
+
+/// Largest payload sent in a single UDP datagram or TCP_DATA message
+#define REPLAY_PAYLOAD_MAX 65507
+
+/// Time to wait for traffic still inside the proxy after the last event
+#define REPLAY_DRAIN_US 500000
+
+/// Time to wait for each step of connecting a client, in microseconds
+#define REPLAY_CONNECT_TIMEOUT 2000000
+
+/// Longest time a thread waits before checking whether it should stop
+#define REPLAY_POLL_US 50000
+
+/// Largest number of sessions, each of which is given a slot of its own
+#define REPLAY_SESSIONS_MAX 250
+
+/// Largest number of emulated remote hosts, beyond which the remote hosts
+/// of a recording share them
+#define REPLAY_REMOTES_MAX 32
+
+/// Number of kinds of traffic which are counted separately
+#define REPLAY_KINDS 3
+
+/// Link-layer header types which captures are read from
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_LINUX_SLL2 276
+
+/// Block types which pcapng captures are read from
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+
+/// TCP header flags which the replay depends on
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+/*!
+ * @brief Kinds of traffic which are counted separately
+ */
+enum REPLAY_KIND
+{
+	/// UDP data on port 5198
+	REPLAY_KIND_DATA = 0,
+
+	/// UDP control information on port 5199
+	REPLAY_KIND_CONTROL,
+
+	/// TCP data on port 5200, counted in bytes
+	REPLAY_KIND_TCP,
+};
+
+/*!
+ * @brief Settings for a replay
+ */
+struct replay_opts
+{
+	/// Path of the capture to replay, or NULL for the built-in recording
+	const char *path;
+
+	/// Comma-separated addresses of the proxy in the capture, used to tell
+	/// the direction of packets which the capture doesn't mark
+	const char *local_addrs;
+
+	/// Replay speed as a multiple of the recording, or 0 for as fast as
+	/// possible
+	int speed;
+
+	/// Number of clients in the built-in recording
+	int sessions;
+
+	/// Length of the built-in recording, in seconds
+	int duration;
+
+	/// Largest percentage of UDP packets lost before the replay fails
+	int max_loss;
+
+	/// Value for proxy_conf::forwarding_backend
+	const char *forwarding_backend;
+
+	/// Value for proxy_conf::forwarding_threads
+	int forwarding_threads;
+
+	/// Port which the proxy listens on
+	int port;
+};
+
+/*!
+ * @brief Single packet or proxy message in a recording
+ */
+struct replay_event
+{
+	/// Time of the event, in microseconds since the start of the recording
+	uint64_t stamp;
+
+	/// Number of bytes of payload
+	uint32_t len;
+
+	/// Position of the event in the capture, which keeps the order of
+	/// events recorded at the same time
+	uint32_t seq;
+
+	/// Index of the session the event belongs to
+	uint16_t session;
+
+	/// Index of the emulated remote host the event is exchanged with
+	uint16_t remote;
+
+	/// Type of proxy message the event is carried in, one of
+	/// ::PROXY_MSG_TYPE
+	uint8_t type;
+
+	/// Direction of the event, one of ::TRACE_DIR
+	uint8_t dir;
+};
+
+/*!
+ * @brief Sequence of events to replay
+ */
+struct replay_recording
+{
+	/// Events, in order once the recording is loaded
+	struct replay_event *events;
+
+	/// Number of entries in replay_recording::events
+	size_t len;
+
+	/// Number of entries allocated in replay_recording::events
+	size_t cap;
+
+	/// Number of sessions in the recording
+	int sessions;
+
+	/// Number of emulated remote hosts the recording uses
+	int remotes;
+
+	/// Non-zero for each emulated remote host which has TCP traffic
+	uint8_t remote_tcp[REPLAY_REMOTES_MAX];
+
+	/// Interface and local address of each session in the capture
+	uint64_t session_keys[REPLAY_SESSIONS_MAX];
+
+	/// Address of each remote host seen in the capture
+	uint32_t *remote_keys;
+
+	/// Number of entries in replay_recording::remote_keys
+	size_t num_remote_keys;
+
+	/// Number of packets in the capture which could not be replayed
+	uint64_t skipped;
+
+	/// Number of packets skipped because their direction was not known
+	uint64_t undirected;
+};
+
+/*!
+ * @brief Counters of one kind of traffic in one direction
+ */
+struct replay_flow
+{
+	/// Number of packets or bytes sent
+	volatile uint64_t sent;
+
+	/// Number of packets or bytes received at the other side of the proxy
+	volatile uint64_t recv;
+
+	/// Time taken to forward each UDP packet
+	struct histogram latency;
+};
+
+/*!
+ * @brief Payload at the start of each UDP datagram
+ */
+struct replay_payload
+{
+	/// Time at which the datagram was sent, in microseconds
+	uint64_t stamp;
+
+	/// Index of the session the datagram belongs to
+	uint32_t index;
+};
+
+/*!
+ * @brief Context of one of an emulated remote host's UDP ports
+ */
+struct replay_port
+{
+	/// Shared replay state
+	struct replay_ctx *rc;
+
+	/// Socket bound to the port
+	struct conn_handle conn;
+
+	/// Thread receiving on the port
+	struct thread_handle thread;
+
+	/// Kind of traffic on the port
+	enum REPLAY_KIND kind;
+};
+
+/*!
+ * @brief Context of an emulated remote host
+ */
+struct replay_remote
+{
+	/// Data and control ports
+	struct replay_port ports[2];
+
+	/// Socket accepting TCP connections on port 5200
+	struct conn_handle listener;
+
+	/// Null-terminated address of the remote host
+	char addr[20];
+};
+
+/*!
+ * @brief Remote host's end of the TCP connection of a session
+ */
+struct replay_tcp
+{
+	/// Shared replay state
+	struct replay_ctx *rc;
+
+	/// Accepted connection from the proxy
+	struct conn_handle conn;
+
+	/// Thread receiving on the connection
+	struct thread_handle thread;
+
+	/// Index of the emulated remote host, or -1 if the session has no TCP
+	/// connection open
+	int remote;
+
+	/// Non-zero while the thread has been started and not joined
+	int live;
+
+	/// Non-zero once the thread has seen the connection close
+	volatile uint32_t done;
+
+	/// Non-zero once the session has opened a TCP connection
+	int opened;
+};
+
+/*!
+ * @brief Context of a client replaying a session
+ */
+struct replay_client
+{
+	/// Shared replay state
+	struct replay_ctx *rc;
+
+	/// Index of the session
+	uint32_t index;
+
+	/// Connection to the proxy
+	struct conn_handle conn;
+
+	/// Thread receiving from the proxy
+	struct thread_handle thread;
+
+	/// Number of TCP_STATUS messages received
+	volatile uint32_t statuses;
+
+	/// Number of bytes of the current message's body not yet received
+	uint32_t msg_left;
+
+	/// Received data not yet processed
+	uint8_t rx[REPLAY_BUFF_LEN];
+
+	/// Number of bytes in replay_client::rx
+	size_t rx_len;
+};
+
+/*!
+ * @brief State shared by all of the threads in a replay
+ */
+struct replay_ctx
+{
+	/// Settings of the replay
+	struct replay_opts opts;
+
+	/// Recording being replayed
+	struct replay_recording rec;
+
+	/// Proxy being measured
+	struct proxy_handle ph;
+
+	/// Null-terminated port which the proxy listens on
+	char port_str[6];
+
+	/// Address of each emulated remote host, in network byte order
+	uint32_t remote_addrs[REPLAY_REMOTES_MAX];
+
+	/// External address of the slot each session was given, in network
+	/// byte order
+	uint32_t session_addrs[REPLAY_SESSIONS_MAX];
+
+	/// Non-zero once every thread should return
+	volatile uint32_t stop;
+
+	/// Number of clients which failed
+	volatile uint32_t failures;
+
+	/// Number of TCP connections which the proxy opened
+	volatile uint64_t tcp_opened;
+
+	/// Number of TCP connections which the proxy failed to open
+	volatile uint64_t tcp_failed;
+
+	/// CPU time used by the replay's own threads, in microseconds
+	volatile uint64_t generator_cpu_us;
+
+	/// Traffic in each direction, indexed by ::TRACE_DIR and ::REPLAY_KIND
+	struct replay_flow flows[2][REPLAY_KINDS];
+
+	/// Time each event was sent behind schedule
+	struct histogram lag;
+};
+
+/*!
+ * @brief Appends an event to a recording
+ *
+ * @param[in,out] rec Target recording
+ * @param[in] stamp Time of the event, in microseconds
+ * @param[in] session Index of the session
+ * @param[in] remote Index of the emulated remote host
+ * @param[in] type Type of proxy message the event is carried in
+ * @param[in] dir Direction of the event
+ * @param[in] len Number of bytes of payload
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_add(struct replay_recording *rec, uint64_t stamp, int session, int remote, enum PROXY_MSG_TYPE type, enum TRACE_DIR dir, uint32_t len);
+
+/*!
+ * @brief Receives from the proxy on behalf of a client
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * replay_client_recv(void *ctx);
+
+/*!
+ * @brief Counts the complete messages received by a client
+ *
+ * @param[in,out] client Target client
+ */
+static void replay_client_process(struct replay_client *client);
+
+/*!
+ * @brief Compares two events by the time they were recorded
+ *
+ * @param[in] a First ::replay_event
+ * @param[in] b Second ::replay_event
+ *
+ * @returns Negative, zero or positive value as a is before, with or after b
+ */
+static int replay_compare(const void *a, const void *b);
+
+/*!
+ * @brief Connects the client of each session and finds the slot it was given
+ *
+ * @param[in,out] rc Shared replay state
+ * @param[in,out] clients Client of each session
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_connect(struct replay_ctx *rc, struct replay_client *clients);
+
+/*!
+ * @brief Counts a message or datagram which came out of the proxy
+ *
+ * @param[in,out] rc Shared replay state
+ * @param[in] dir Direction the message was forwarded in
+ * @param[in] type Type of proxy message
+ * @param[in] data Start of the payload
+ * @param[in] len Number of bytes of payload
+ * @param[in] now Time at which the message arrived, in microseconds
+ */
+static void replay_count(struct replay_ctx *rc, enum TRACE_DIR dir, enum PROXY_MSG_TYPE type, const uint8_t *data, uint32_t len, uint64_t now);
+
+/*!
+ * @brief Builds the built-in recording of a conference
+ *
+ * @param[in,out] rec Target recording
+ * @param[in] sessions Number of clients on the proxy
+ * @param[in] duration Length of the recording, in seconds
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_generate(struct replay_recording *rec, int sessions, int duration);
+
+/*!
+ * @brief Adds a directory server query to the built-in recording
+ *
+ * @param[in,out] rec Target recording
+ * @param[in] session Index of the client making the query
+ * @param[in] stamp Time at which the query starts, in microseconds
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_generate_directory(struct replay_recording *rec, int session, uint64_t stamp);
+
+/*!
+ * @brief Loads a recording from a pcap or pcapng capture
+ *
+ * @param[in,out] rec Target recording
+ * @param[in] path Path of the capture
+ * @param[in] local_addrs Addresses of the proxy, in network byte order
+ * @param[in] num_local_addrs Number of entries in local_addrs
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_load(struct replay_recording *rec, const char *path, const uint32_t *local_addrs, size_t num_local_addrs);
+
+/*!
+ * @brief Adds a captured packet to a recording
+ *
+ * @param[in,out] rec Target recording
+ * @param[in] iface Index of the capture interface
+ * @param[in] linktype Link-layer header type of the interface
+ * @param[in] pkt Captured bytes of the packet
+ * @param[in] cap_len Number of bytes in pkt
+ * @param[in] orig_len Length of the packet on the wire
+ * @param[in] stamp Time at which the packet was captured, in microseconds
+ * @param[in] dir Direction marked in the capture, or -1 if unmarked
+ * @param[in] local_addrs Addresses of the proxy, in network byte order
+ * @param[in] num_local_addrs Number of entries in local_addrs
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_load_packet(struct replay_recording *rec, uint32_t iface, uint32_t linktype, const uint8_t *pkt, uint32_t cap_len, uint32_t orig_len, uint64_t stamp, int dir, const uint32_t *local_addrs, size_t num_local_addrs);
+
+/*!
+ * @brief Receives UDP traffic sent through the proxy to a remote host
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * replay_port_recv(void *ctx);
+
+/*!
+ * @brief Accepts clients into the proxy until it is shut down
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * replay_proxy_process(void *ctx);
+
+/*!
+ * @brief Gets a pseudo-random number
+ *
+ * @param[in,out] state Generator state, which must not be zero
+ *
+ * @returns Next number from the generator
+ */
+static uint32_t replay_rand(uint32_t *state);
+
+/*!
+ * @brief Prints the results of a replay
+ *
+ * @param[in] rc Finished replay state
+ * @param[in] elapsed_us Length of the replay, in microseconds
+ * @param[in] proxy_cpu_us CPU time used by the proxy, in microseconds
+ *
+ * @returns Non-zero if a TCP connection failed or more UDP traffic was lost
+ *          than allowed
+ */
+static int replay_report(struct replay_ctx *rc, uint64_t elapsed_us, uint64_t proxy_cpu_us);
+
+/*!
+ * @brief Sends a single event through the proxy
+ *
+ * @param[in,out] rc Shared replay state
+ * @param[in,out] clients Client of each session
+ * @param[in,out] remotes Emulated remote hosts
+ * @param[in,out] tcp Remote host's end of each session's TCP connection
+ * @param[in] ev Target event
+ */
+static void replay_send(struct replay_ctx *rc, struct replay_client *clients, struct replay_remote *remotes, struct replay_tcp *tcp, const struct replay_event *ev);
+
+/*!
+ * @brief Receives TCP data sent through the proxy to a remote host
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * replay_tcp_recv(void *ctx);
+
+/*!
+ * @brief Opens the TCP connection of a session, closing any open one
+ *
+ * @param[in,out] rc Shared replay state
+ * @param[in,out] client Client of the session
+ * @param[in,out] remote Emulated remote host to connect to
+ * @param[in,out] tcp Remote host's end of the session's TCP connection
+ * @param[in] index Index of the emulated remote host
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int replay_tcp_open(struct replay_ctx *rc, struct replay_client *client, struct replay_remote *remote, struct replay_tcp *tcp, int index);
+
+/*!
+ * @brief Closes the remote host's end of a session's TCP connection
+ *
+ * If the session has closed the connection, this first waits a while for the
+ * proxy to close it too.
+ *
+ * @param[in,out] tcp Target TCP connection
+ */
+static void replay_tcp_reset(struct replay_tcp *tcp);
+
+/*!
+ * @brief Reads a 16-bit value from a capture
+ *
+ * @param[in] buff Location of the value
+ * @param[in] swap Non-zero if the capture was written in the other byte order
+ *
+ * @returns Value in host byte order
+ */
+static inline uint16_t get_u16(const uint8_t *buff, int swap);
+
+/*!
+ * @brief Reads a 32-bit value from a capture
+ *
+ * @param[in] buff Location of the value
+ * @param[in] swap Non-zero if the capture was written in the other byte order
+ *
+ * @returns Value in host byte order
+ */
+static inline uint32_t get_u32(const uint8_t *buff, int swap);
+
+/*!
+ * @brief Main entry point for the replay harness
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Command line arguments
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(int argc, char *argv[]);
+
+/*!
+ * @brief Parses the command line into replay settings
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Command line arguments
+ * @param[out] opts Resulting settings
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int parse_args(int argc, char *argv[], struct replay_opts *opts);
+
+/*!
+ * @brief Print the program usage to STDOUT
+ */
+static void print_usage(void);
+
+/// Buffer which each message or datagram is built in before being sent,
+/// only used by the thread replaying the events
+static uint8_t replay_tx[BENCH_HEADER_LEN + REPLAY_PAYLOAD_MAX];
+
+static int replay_add(struct replay_recording *rec, uint64_t stamp, int session, int remote, enum PROXY_MSG_TYPE type, enum TRACE_DIR dir, uint32_t len)
+{
+	struct replay_event *events;
+	struct replay_event *ev;
+	size_t cap;
+
+	if (rec->len == rec->cap)
+	{
+		cap = rec->cap > 0 ? 2 * rec->cap : 1024;
+
+		events = realloc(rec->events, cap * sizeof(struct replay_event));
+		if (events == NULL)
+		{
+			return -ENOMEM;
+		}
+
+		rec->events = events;
+		rec->cap = cap;
+	}
+
+	ev = &rec->events[rec->len];
+	ev->stamp = stamp;
+	ev->len = len < REPLAY_PAYLOAD_MAX ? len : REPLAY_PAYLOAD_MAX;
+	ev->seq = (uint32_t)rec->len;
+	ev->session = (uint16_t)session;
+	ev->remote = (uint16_t)remote;
+	ev->type = (uint8_t)type;
+	ev->dir = (uint8_t)dir;
+
+	rec->len++;
+
+	if (type == PROXY_MSG_TYPE_TCP_OPEN || type == PROXY_MSG_TYPE_TCP_DATA)
+	{
+		rec->remote_tcp[remote] = 1;
+	}
+
+	return 0;
+}
+
+static void * replay_client_recv(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct replay_client *client = (struct replay_client *)th->func_ctx;
+	struct replay_ctx *rc = client->rc;
+	int ret;
+
+	while (!atomic_u32_load(&rc->stop))
+	{
+		ret = conn_poll(&client->conn, REPLAY_POLL_US);
+		if (ret < 0)
+		{
+			break;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_some(&client->conn, &client->rx[client->rx_len], sizeof(client->rx) - client->rx_len);
+		if (ret <= 0)
+		{
+			break;
+		}
+
+		client->rx_len += (size_t)ret;
+
+		replay_client_process(client);
+	}
+
+	if (!atomic_u32_load(&rc->stop))
+	{
+		fprintf(stderr, "Error: Session %u lost its connection to the proxy\n", client->index);
+		atomic_u32_add(&rc->failures, 1);
+	}
+
+	atomic_u64_add(&rc->generator_cpu_us, bench_thread_cpu_us());
+
+	return NULL;
+}
+
+static void replay_client_process(struct replay_client *client)
+{
+	const uint64_t now = clock_now_us();
+	uint8_t *buff = client->rx;
+	size_t off = 0;
+	size_t head_len;
+	size_t chunk;
+	uint32_t msg_len;
+
+	while (off < client->rx_len)
+	{
+		if (client->msg_left == 0)
+		{
+			// Wait for the header and for the start of the body, which holds
+			// the stamp or the status, to be counted in one piece
+			if (client->rx_len - off < BENCH_HEADER_LEN)
+			{
+				break;
+			}
+
+			msg_len = (uint32_t)buff[off + 5] | ((uint32_t)buff[off + 6] << 8) | ((uint32_t)buff[off + 7] << 16) | ((uint32_t)buff[off + 8] << 24);
+			head_len = msg_len < sizeof(struct replay_payload) ? msg_len : sizeof(struct replay_payload);
+			if (client->rx_len - off - BENCH_HEADER_LEN < head_len)
+			{
+				break;
+			}
+
+			if (buff[off] == PROXY_MSG_TYPE_TCP_STATUS)
+			{
+				atomic_u32_add(&client->statuses, 1);
+			}
+
+			replay_count(client->rc, TRACE_DIR_TO_CLIENT, (enum PROXY_MSG_TYPE)buff[off], &buff[off + BENCH_HEADER_LEN], msg_len, now);
+
+			off += BENCH_HEADER_LEN;
+			client->msg_left = msg_len;
+		}
+
+		// The rest of the body is only skipped
+		chunk = client->rx_len - off < client->msg_left ? client->rx_len - off : client->msg_left;
+		off += chunk;
+		client->msg_left -= (uint32_t)chunk;
+	}
+
+	memmove(buff, &buff[off], client->rx_len - off);
+	client->rx_len -= off;
+}
+
+static int replay_compare(const void *a, const void *b)
+{
+	const struct replay_event *ea = (const struct replay_event *)a;
+	const struct replay_event *eb = (const struct replay_event *)b;
+
+	if (ea->stamp != eb->stamp)
+	{
+		return ea->stamp < eb->stamp ? -1 : 1;
+	}
+
+	return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+
+static int replay_connect(struct replay_ctx *rc, struct replay_client *clients)
+{
+	const size_t num_slots = (size_t)rc->rec.sessions;
+	const uint64_t deadline = clock_now_us() + REPLAY_CONNECT_TIMEOUT;
+	struct proxy_slot_stats *slot_stats;
+	struct proxy_stats stats;
+	char callsign[16];
+	size_t found;
+	size_t i;
+	int ret;
+	int j;
+
+	for (j = 0; j < rc->rec.sessions; j++)
+	{
+		// Each client needs a distinct callsign, since a slot may be held for it
+		snprintf(callsign, sizeof(callsign), "R%dPLAY", j);
+
+		ret = bench_login(&clients[j].conn, REPLAY_PROXY_ADDR, rc->port_str, callsign, REPLAY_PASSWORD, deadline);
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	slot_stats = calloc(num_slots, sizeof(struct proxy_slot_stats));
+	if (slot_stats == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	// Traffic from the remote hosts has to go to whichever slot the proxy
+	// gave each session
+	do
+	{
+		usleep(1000);
+
+		ret = proxy_get_stats(&rc->ph, &stats, slot_stats, num_slots);
+		if (ret < 0)
+		{
+			break;
+		}
+
+		found = 0;
+
+		for (i = 0; i < num_slots; i++)
+		{
+			if (!slot_stats[i].in_use || sscanf(slot_stats[i].callsign, "R%dPLAY", &j) != 1 || j < 0 || j >= rc->rec.sessions)
+			{
+				continue;
+			}
+
+			snprintf(callsign, sizeof(callsign), "R%dPLAY", j);
+			if (strcmp(callsign, slot_stats[i].callsign) != 0 || conn_resolve(slot_stats[i].source_addr, &rc->session_addrs[j]) < 0)
+			{
+				continue;
+			}
+
+			found++;
+		}
+
+		ret = found == num_slots ? 0 : -ETIMEDOUT;
+	} while (ret == -ETIMEDOUT && clock_now_us() < deadline);
+
+	free(slot_stats);
+
+	return ret;
+}
+
+static void replay_count(struct replay_ctx *rc, enum TRACE_DIR dir, enum PROXY_MSG_TYPE type, const uint8_t *data, uint32_t len, uint64_t now)
+{
+	struct replay_flow *flow;
+	struct replay_payload payload;
+
+	switch (type)
+	{
+	case PROXY_MSG_TYPE_UDP_DATA:
+	case PROXY_MSG_TYPE_UDP_CONTROL:
+		flow = &rc->flows[dir][type == PROXY_MSG_TYPE_UDP_DATA ? REPLAY_KIND_DATA : REPLAY_KIND_CONTROL];
+
+		if (len >= sizeof(payload))
+		{
+			memcpy(&payload, data, sizeof(payload));
+			histogram_record(&flow->latency, now - payload.stamp);
+		}
+
+		atomic_u64_add(&flow->recv, 1);
+
+		break;
+	case PROXY_MSG_TYPE_TCP_DATA:
+		atomic_u64_add(&rc->flows[dir][REPLAY_KIND_TCP].recv, len);
+
+		break;
+	case PROXY_MSG_TYPE_TCP_STATUS:
+		if (len >= 4 && (data[0] | data[1] | data[2] | data[3]) != 0)
+		{
+			atomic_u64_add(&rc->tcp_failed, 1);
+		}
+		else
+		{
+			atomic_u64_add(&rc->tcp_opened, 1);
+		}
+
+		break;
+	default:
+		break;
+	}
+}
+
+static int replay_generate(struct replay_recording *rec, int sessions, int duration)
+{
+	const uint64_t end = (uint64_t)duration * 1000000;
+	uint32_t seed = 0x4F454C50;
+	uint64_t spurt_end;
+	uint64_t stall_end = 0;
+	uint64_t arrival;
+	uint64_t t;
+	uint64_t f;
+	int talker;
+	int ret = 0;
+	int s;
+	int k;
+
+	// Everyone is in the same conference on remote host 0, and looks up
+	// stations on the directory server, which is remote host 1
+	rec->sessions = sessions;
+	rec->remotes = 2;
+
+	for (s = 0; s < sessions && ret == 0; s++)
+	{
+		ret = replay_generate_directory(rec, s, 20000 * (uint64_t)s);
+		if (ret == 0)
+		{
+			ret = replay_generate_directory(rec, s, end * 3 / 4 + 20000 * (uint64_t)s);
+		}
+	}
+
+	// Talk spurts of GSM audio, four 33 byte frames to each 144 byte RTP
+	// packet, from one of the clients or from a station elsewhere. The
+	// conference's uplink stalls now and then, after which the frames
+	// held up arrive back to back.
+	for (t = 0; t < end && ret == 0; t = spurt_end)
+	{
+		spurt_end = t + 500000 + replay_rand(&seed) % 1500000;
+		talker = (int)(replay_rand(&seed) % (uint32_t)(sessions + 1)) - 1;
+
+		for (f = t; f < spurt_end && f < end && ret == 0; f += 80000)
+		{
+			if (talker >= 0)
+			{
+				ret = replay_add(rec, f, talker, 0, PROXY_MSG_TYPE_UDP_DATA, TRACE_DIR_FROM_CLIENT, 144);
+			}
+
+			if (f >= stall_end && replay_rand(&seed) % 25 == 0)
+			{
+				stall_end = f + 100000 + replay_rand(&seed) % 200000;
+			}
+
+			arrival = f < stall_end ? stall_end + (f - t) % 1000 : f + 2000 + replay_rand(&seed) % 8000;
+
+			for (s = 0; s < sessions && ret == 0; s++)
+			{
+				if (s != talker)
+				{
+					ret = replay_add(rec, arrival + 50 * (uint64_t)s, s, 0, PROXY_MSG_TYPE_UDP_DATA, TRACE_DIR_TO_CLIENT, 144);
+				}
+			}
+		}
+	}
+
+	// RTCP reports every few seconds in each direction
+	for (s = 0; s < sessions && ret == 0; s++)
+	{
+		for (t = replay_rand(&seed) % 1000000; t < end && ret == 0; t += 2000000 + replay_rand(&seed) % 1000000)
+		{
+			ret = replay_add(rec, t, s, 0, PROXY_MSG_TYPE_UDP_CONTROL, TRACE_DIR_FROM_CLIENT, 80 + replay_rand(&seed) % 40);
+			if (ret == 0)
+			{
+				ret = replay_add(rec, t + 30000, s, 0, PROXY_MSG_TYPE_UDP_CONTROL, TRACE_DIR_TO_CLIENT, 80 + replay_rand(&seed) % 40);
+			}
+		}
+	}
+
+	// A station joining halfway through makes the conference send its
+	// whole station list to every client at once
+	for (s = 0; s < sessions && ret == 0; s++)
+	{
+		for (k = 0; k < 30 && ret == 0; k++)
+		{
+			ret = replay_add(rec, end / 2 + 500 * (uint64_t)k + replay_rand(&seed) % 500, s, 0, PROXY_MSG_TYPE_UDP_CONTROL, TRACE_DIR_TO_CLIENT, 60 + replay_rand(&seed) % 140);
+		}
+	}
+
+	return ret;
+}
+
+static int replay_generate_directory(struct replay_recording *rec, int session, uint64_t stamp)
+{
+	int ret;
+	int i;
+
+	ret = replay_add(rec, stamp, session, 1, PROXY_MSG_TYPE_TCP_OPEN, TRACE_DIR_FROM_CLIENT, 0);
+	if (ret == 0)
+	{
+		ret = replay_add(rec, stamp + 5000, session, 1, PROXY_MSG_TYPE_TCP_DATA, TRACE_DIR_FROM_CLIENT, 40);
+	}
+
+	// The station list comes back in full-sized segments
+	for (i = 0; i < 12 && ret == 0; i++)
+	{
+		ret = replay_add(rec, stamp + 20000 + 1000 * (uint64_t)i, session, 1, PROXY_MSG_TYPE_TCP_DATA, TRACE_DIR_TO_CLIENT, 1448);
+	}
+
+	if (ret == 0)
+	{
+		ret = replay_add(rec, stamp + 40000, session, 1, PROXY_MSG_TYPE_TCP_CLOSE, TRACE_DIR_TO_CLIENT, 0);
+	}
+
+	return ret;
+}
+
+static int replay_load(struct replay_recording *rec, const char *path, const uint32_t *local_addrs, size_t num_local_addrs)
+{
+	uint8_t *buff = NULL;
+	uint32_t *linktypes = NULL;
+	uint64_t *resolutions = NULL;
+	uint32_t *grown32;
+	uint64_t *grown64;
+	uint32_t num_ifaces = 0;
+	uint32_t block_type;
+	uint32_t block_len;
+	uint32_t cap_len;
+	uint32_t digits;
+	uint32_t iface;
+	uint32_t magic;
+	uint64_t stamp;
+	size_t buff_len;
+	size_t off;
+	size_t opt;
+	uint16_t opt_code;
+	uint16_t opt_len = 0;
+	FILE *stream;
+	long file_len;
+	int dir;
+	int swap = 0;
+	int ret = 0;
+
+	stream = fopen(path, "rb");
+	if (stream == NULL)
+	{
+		ret = -errno;
+		fprintf(stderr, "Error: Failed to open '%s' (%d): %s\n", path, -ret, strerror(-ret));
+		return ret;
+	}
+
+	if (fseek(stream, 0, SEEK_END) != 0 || (file_len = ftell(stream)) < 0 || fseek(stream, 0, SEEK_SET) != 0)
+	{
+		ret = -errno;
+		goto replay_load_exit;
+	}
+
+	buff_len = (size_t)file_len;
+	buff = malloc(buff_len > 0 ? buff_len : 1);
+	if (buff == NULL)
+	{
+		ret = -ENOMEM;
+		goto replay_load_exit;
+	}
+
+	if (fread(buff, 1, buff_len, stream) != buff_len)
+	{
+		ret = -EIO;
+		goto replay_load_exit;
+	}
+
+	if (buff_len < 24)
+	{
+		ret = -EPROTO;
+		goto replay_load_exit;
+	}
+
+	memcpy(&magic, buff, 4);
+
+	if (magic == PCAPNG_SHB)
+	{
+		for (off = 0; ret == 0 && off + 12 <= buff_len; off += block_len)
+		{
+			block_type = get_u32(&buff[off], swap);
+
+			// Each section says which byte order it was written in
+			if (block_type == PCAPNG_SHB)
+			{
+				swap = get_u32(&buff[off + 8], 0) != 0x1A2B3C4D;
+				num_ifaces = 0;
+			}
+
+			block_len = get_u32(&buff[off + 4], swap);
+			if (block_len < 12 || block_len % 4 != 0 || block_len > buff_len - off)
+			{
+				ret = -EPROTO;
+				break;
+			}
+
+			switch (block_type)
+			{
+			case PCAPNG_IDB:
+				if (block_len < 20)
+				{
+					ret = -EPROTO;
+					break;
+				}
+
+				grown32 = realloc(linktypes, (num_ifaces + 1) * sizeof(uint32_t));
+				if (grown32 != NULL)
+				{
+					linktypes = grown32;
+				}
+
+				grown64 = realloc(resolutions, (num_ifaces + 1) * sizeof(uint64_t));
+				if (grown64 != NULL)
+				{
+					resolutions = grown64;
+				}
+
+				if (grown32 == NULL || grown64 == NULL)
+				{
+					ret = -ENOMEM;
+					break;
+				}
+
+				linktypes[num_ifaces] = get_u16(&buff[off + 8], swap);
+				resolutions[num_ifaces] = 1000000;
+
+				for (opt = off + 16; opt + 4 <= off + block_len - 4; opt += 4 + ((opt_len + 3U) & ~3U))
+				{
+					opt_code = get_u16(&buff[opt], swap);
+					opt_len = get_u16(&buff[opt + 2], swap);
+
+					if (opt_code == 0)
+					{
+						break;
+					}
+					else if (opt_code == 9 && opt_len == 1)
+					{
+						// A power of two when the top bit is set, otherwise of ten
+						digits = buff[opt + 4] & 0x7F;
+						resolutions[num_ifaces] = (buff[opt + 4] & 0x80) ? (uint64_t)1 << (digits < 63 ? digits : 63) : 1;
+
+						while (!(buff[opt + 4] & 0x80) && digits-- > 0 && resolutions[num_ifaces] < 10000000000000000000ULL)
+						{
+							resolutions[num_ifaces] *= 10;
+						}
+					}
+				}
+
+				num_ifaces++;
+
+				break;
+			case PCAPNG_EPB:
+				if (block_len < 32)
+				{
+					ret = -EPROTO;
+					break;
+				}
+
+				iface = get_u32(&buff[off + 8], swap);
+				cap_len = get_u32(&buff[off + 20], swap);
+				if (iface >= num_ifaces || cap_len > block_len - 32)
+				{
+					ret = -EPROTO;
+					break;
+				}
+
+				stamp = ((uint64_t)get_u32(&buff[off + 12], swap) << 32) | get_u32(&buff[off + 16], swap);
+				stamp = stamp / resolutions[iface] * 1000000 + stamp % resolutions[iface] * 1000000 / resolutions[iface];
+
+				// Inbound packets are from a remote host to the client
+				dir = -1;
+
+				for (opt = off + 28 + ((cap_len + 3U) & ~3U); opt + 4 <= off + block_len - 4; opt += 4 + ((opt_len + 3U) & ~3U))
+				{
+					opt_code = get_u16(&buff[opt], swap);
+					opt_len = get_u16(&buff[opt + 2], swap);
+
+					if (opt_code == 0)
+					{
+						break;
+					}
+					else if (opt_code == 2 && opt_len == 4 && opt + 8 <= off + block_len)
+					{
+						switch (get_u32(&buff[opt + 4], swap) & 0x3)
+						{
+						case 1:
+							dir = TRACE_DIR_TO_CLIENT;
+							break;
+						case 2:
+							dir = TRACE_DIR_FROM_CLIENT;
+							break;
+						default:
+							break;
+						}
+					}
+				}
+
+				ret = replay_load_packet(rec, iface, linktypes[iface], &buff[off + 28], cap_len, get_u32(&buff[off + 24], swap), stamp, dir, local_addrs, num_local_addrs);
+
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	else if (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1 || magic == 0xA1B23C4D || magic == 0x4D3CB2A1)
+	{
+		swap = magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1;
+
+		for (off = 24; ret == 0 && off + 16 <= buff_len; off += 16 + cap_len)
+		{
+			cap_len = get_u32(&buff[off + 8], swap);
+			if (cap_len > buff_len - off - 16)
+			{
+				ret = -EPROTO;
+				break;
+			}
+
+			stamp = (uint64_t)get_u32(&buff[off], swap) * 1000000 + get_u32(&buff[off + 4], swap) / (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1 ? 1 : 1000);
+
+			ret = replay_load_packet(rec, 0, get_u32(&buff[20], swap) & 0xFFFF, &buff[off + 16], cap_len, get_u32(&buff[off + 12], swap), stamp, -1, local_addrs, num_local_addrs);
+		}
+	}
+	else
+	{
+		ret = -EPROTO;
+	}
+
+	if (ret == 0 && rec->len == 0)
+	{
+		if (rec->undirected > 0)
+		{
+			fprintf(stderr, "Error: Capture '%s' doesn't say which way its packets went, so the proxy's addresses must be given with -l\n", path);
+		}
+		else
+		{
+			fprintf(stderr, "Error: Capture '%s' has no EchoLink traffic\n", path);
+		}
+
+		ret = -ENODATA;
+	}
+
+	if (ret == 0)
+	{
+		qsort(rec->events, rec->len, sizeof(struct replay_event), replay_compare);
+
+		for (off = rec->len; off > 0; off--)
+		{
+			rec->events[off - 1].stamp -= rec->events[0].stamp;
+		}
+	}
+	else if (ret == -EPROTO)
+	{
+		fprintf(stderr, "Error: '%s' is not a valid pcap or pcapng capture\n", path);
+	}
+
+replay_load_exit:
+	free(resolutions);
+	free(linktypes);
+	free(buff);
+	fclose(stream);
+
+	return ret;
+}
+
+static int replay_load_packet(struct replay_recording *rec, uint32_t iface, uint32_t linktype, const uint8_t *pkt, uint32_t cap_len, uint32_t orig_len, uint64_t stamp, int dir, const uint32_t *local_addrs, size_t num_local_addrs)
+{
+	enum PROXY_MSG_TYPE type;
+	uint32_t *remote_keys;
+	uint32_t link_len;
+	uint32_t ip_len;
+	uint32_t payload_len;
+	uint32_t src;
+	uint32_t dst;
+	uint32_t remote_addr;
+	uint16_t ethertype = 0x0800;
+	uint16_t remote_port;
+	uint64_t key;
+	uint8_t flags;
+	size_t i;
+	int session;
+	int remote;
+	int ret = 0;
+
+	switch (linktype)
+	{
+	case LINKTYPE_NULL:
+		link_len = 4;
+		break;
+	case LINKTYPE_ETHERNET:
+		link_len = 14;
+		if (cap_len >= 18 && pkt[12] == 0x81 && pkt[13] == 0x00)
+		{
+			link_len = 18;
+		}
+
+		ethertype = cap_len >= link_len ? (uint16_t)((pkt[link_len - 2] << 8) | pkt[link_len - 1]) : 0;
+		break;
+	case LINKTYPE_RAW:
+	case LINKTYPE_IPV4:
+		link_len = 0;
+		break;
+	case LINKTYPE_LINUX_SLL:
+		link_len = 16;
+		ethertype = cap_len >= link_len ? (uint16_t)((pkt[14] << 8) | pkt[15]) : 0;
+		break;
+	case LINKTYPE_LINUX_SLL2:
+		link_len = 20;
+		ethertype = cap_len >= link_len ? (uint16_t)((pkt[0] << 8) | pkt[1]) : 0;
+		break;
+	default:
+		link_len = cap_len;
+		break;
+	}
+
+	// Only the first fragment of each IPv4 packet has the ports in it
+	if (ethertype != 0x0800 || cap_len < link_len + 20 || (pkt[link_len] >> 4) != 4 ||
+		((pkt[link_len + 6] & 0x1F) | pkt[link_len + 7]) != 0)
+	{
+		rec->skipped++;
+		return 0;
+	}
+
+	pkt += link_len;
+	cap_len -= link_len;
+	orig_len = orig_len > link_len ? orig_len - link_len : 0;
+
+	ip_len = (pkt[0] & 0x0F) * 4U;
+	if (ip_len < 20 || cap_len < ip_len + 8 || (pkt[9] == 6 && cap_len < ip_len + 20))
+	{
+		rec->skipped++;
+		return 0;
+	}
+
+	memcpy(&src, &pkt[12], 4);
+	memcpy(&dst, &pkt[16], 4);
+
+	if (dir < 0)
+	{
+		for (i = 0; i < num_local_addrs && dir < 0; i++)
+		{
+			if (src == local_addrs[i])
+			{
+				dir = TRACE_DIR_FROM_CLIENT;
+			}
+			else if (dst == local_addrs[i])
+			{
+				dir = TRACE_DIR_TO_CLIENT;
+			}
+		}
+
+		if (dir < 0)
+		{
+			rec->undirected++;
+			return 0;
+		}
+	}
+
+	remote_addr = dir == TRACE_DIR_FROM_CLIENT ? dst : src;
+	remote_port = (uint16_t)((pkt[ip_len + (dir == TRACE_DIR_FROM_CLIENT ? 2 : 0)] << 8) | pkt[ip_len + (dir == TRACE_DIR_FROM_CLIENT ? 3 : 1)]);
+
+	// Segmentation offload leaves the IPv4 length of large packets unset
+	if (((pkt[2] << 8) | pkt[3]) != 0)
+	{
+		orig_len = (uint32_t)((pkt[2] << 8) | pkt[3]);
+	}
+
+	if (pkt[9] == 17 && (remote_port == 5198 || remote_port == 5199))
+	{
+		type = remote_port == 5198 ? PROXY_MSG_TYPE_UDP_DATA : PROXY_MSG_TYPE_UDP_CONTROL;
+		payload_len = (uint32_t)((pkt[ip_len + 4] << 8) | pkt[ip_len + 5]);
+		payload_len = payload_len > 8 ? payload_len - 8 : 0;
+		flags = 0;
+	}
+	else if (pkt[9] == 6 && remote_port == 5200)
+	{
+		flags = pkt[ip_len + 13];
+		ip_len += (pkt[ip_len + 12] >> 4) * 4U;
+		payload_len = orig_len > ip_len ? orig_len - ip_len : 0;
+
+		// The proxy answers the client's connection attempt by itself
+		if ((flags & TCP_RST) || ((flags & TCP_SYN) && (flags & TCP_ACK)))
+		{
+			return 0;
+		}
+
+		type = (flags & TCP_SYN) ? PROXY_MSG_TYPE_TCP_OPEN : payload_len > 0 ? PROXY_MSG_TYPE_TCP_DATA : PROXY_MSG_TYPE_TCP_CLOSE;
+		if (type == PROXY_MSG_TYPE_TCP_OPEN && dir == TRACE_DIR_TO_CLIENT)
+		{
+			return 0;
+		}
+		else if (type == PROXY_MSG_TYPE_TCP_CLOSE && !(flags & TCP_FIN))
+		{
+			return 0;
+		}
+		else if (type == PROXY_MSG_TYPE_TCP_OPEN)
+		{
+			payload_len = 0;
+		}
+	}
+	else
+	{
+		rec->skipped++;
+		return 0;
+	}
+
+	key = ((uint64_t)iface << 32) | (dir == TRACE_DIR_FROM_CLIENT ? src : dst);
+
+	for (session = 0; session < rec->sessions && rec->session_keys[session] != key; session++)
+	{
+	}
+
+	if (session == rec->sessions)
+	{
+		if (rec->sessions == REPLAY_SESSIONS_MAX)
+		{
+			fprintf(stderr, "Error: Capture has more than %d sessions\n", REPLAY_SESSIONS_MAX);
+			return -E2BIG;
+		}
+
+		rec->session_keys[rec->sessions++] = key;
+	}
+
+	for (i = 0; i < rec->num_remote_keys && rec->remote_keys[i] != remote_addr; i++)
+	{
+	}
+
+	if (i == rec->num_remote_keys)
+	{
+		remote_keys = realloc(rec->remote_keys, (i + 1) * sizeof(uint32_t));
+		if (remote_keys == NULL)
+		{
+			return -ENOMEM;
+		}
+
+		rec->remote_keys = remote_keys;
+		rec->remote_keys[rec->num_remote_keys++] = remote_addr;
+
+		if (rec->remotes < REPLAY_REMOTES_MAX)
+		{
+			rec->remotes++;
+		}
+	}
+
+	remote = (int)(i % REPLAY_REMOTES_MAX);
+
+	ret = replay_add(rec, stamp, session, remote, type, (enum TRACE_DIR)dir, payload_len);
+
+	// A segment can carry the last of the data along with the FIN
+	if (ret == 0 && type == PROXY_MSG_TYPE_TCP_DATA && (flags & TCP_FIN))
+	{
+		ret = replay_add(rec, stamp, session, remote, PROXY_MSG_TYPE_TCP_CLOSE, (enum TRACE_DIR)dir, 0);
+	}
+
+	return ret;
+}
+
+static void * replay_port_recv(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct replay_port *port = (struct replay_port *)th->func_ctx;
+	struct replay_ctx *rc = port->rc;
+	uint8_t buff[REPLAY_BUFF_LEN];
+	uint32_t addr;
+	uint16_t port_num;
+	int ret;
+
+	while (!atomic_u32_load(&rc->stop))
+	{
+		ret = conn_poll(&port->conn, REPLAY_POLL_US);
+		if (ret < 0)
+		{
+			break;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_any(&port->conn, buff, sizeof(buff), &addr, &port_num);
+		if (ret < 0)
+		{
+			break;
+		}
+
+		replay_count(rc, TRACE_DIR_FROM_CLIENT, port->kind == REPLAY_KIND_DATA ? PROXY_MSG_TYPE_UDP_DATA : PROXY_MSG_TYPE_UDP_CONTROL, buff, (uint32_t)ret, clock_now_us());
+	}
+
+	atomic_u64_add(&rc->generator_cpu_us, bench_thread_cpu_us());
+
+	return NULL;
+}
+
+static void * replay_proxy_process(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct replay_ctx *rc = (struct replay_ctx *)th->func_ctx;
+
+	while (!atomic_u32_load(&rc->stop))
+	{
+		if (proxy_process(&rc->ph) < 0 && !atomic_u32_load(&rc->stop))
+		{
+			usleep(1000);
+		}
+	}
+
+	return NULL;
+}
+
+static uint32_t replay_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static int replay_report(struct replay_ctx *rc, uint64_t elapsed_us, uint64_t proxy_cpu_us)
+{
+	static const char * const names[2][REPLAY_KINDS] = {
+		{ "UDP data in:    ", "UDP control in: ", "TCP in:         " },
+		{ "UDP data out:   ", "UDP control out:", "TCP out:        " },
+	};
+	const struct replay_event *last = &rc->rec.events[rc->rec.len - 1];
+	const double secs = (double)elapsed_us / 1000000.0;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+	uint64_t udp_sent = 0;
+	uint64_t udp_lost = 0;
+	uint64_t sent;
+	uint64_t recv;
+	double lost;
+	int dir;
+	int kind;
+
+	printf("Recording: %s, %d sessions, %d remote hosts, %zu events over %.1f s\n",
+		rc->opts.path != NULL ? rc->opts.path : "built-in conference", rc->rec.sessions, rc->rec.remotes, rc->rec.len, (double)last->stamp / 1000000.0);
+	if (rc->rec.skipped > 0 || rc->rec.undirected > 0)
+	{
+		printf("Skipped %" PRIu64 " packets which weren't EchoLink traffic and %" PRIu64 " whose direction wasn't known\n", rc->rec.skipped, rc->rec.undirected);
+	}
+
+	if (rc->opts.speed > 0)
+	{
+		printf("Replayed at %dx in %.1f s, forwarding threads: %d\n", rc->opts.speed, secs, rc->opts.forwarding_threads);
+	}
+	else
+	{
+		printf("Replayed as fast as possible in %.1f s, forwarding threads: %d\n", secs, rc->opts.forwarding_threads);
+	}
+
+	for (dir = TRACE_DIR_TO_CLIENT; dir <= TRACE_DIR_FROM_CLIENT; dir++)
+	{
+		for (kind = 0; kind < REPLAY_KINDS; kind++)
+		{
+			sent = atomic_u64_load(&rc->flows[dir][kind].sent);
+			recv = atomic_u64_load(&rc->flows[dir][kind].recv);
+			lost = sent > 0 ? 100.0 * (double)(sent - (recv < sent ? recv : sent)) / (double)sent : 0.0;
+
+			if (kind == REPLAY_KIND_TCP)
+			{
+				printf("%s %8" PRIu64 " bytes sent %8" PRIu64 " bytes received\n", names[dir][kind], sent, recv);
+				continue;
+			}
+
+			histogram_read(&rc->flows[dir][kind].latency, buckets, NULL);
+			printf("%s %8" PRIu64 " sent %8" PRIu64 " received %6.2f%% lost  p50 %6" PRIu64 " us  p99 %6" PRIu64 " us  max %6" PRIu64 " us\n",
+				names[dir][kind], sent, recv, lost, histogram_quantile(buckets, 500), histogram_quantile(buckets, 990), histogram_quantile(buckets, 1000));
+
+			udp_sent += sent;
+			udp_lost += sent - (recv < sent ? recv : sent);
+		}
+	}
+
+	printf("TCP connections: %" PRIu64 " opened, %" PRIu64 " failed\n", atomic_u64_load(&rc->tcp_opened), atomic_u64_load(&rc->tcp_failed));
+
+	histogram_read(&rc->lag, buckets, NULL);
+	printf("Replay lag:       p50 %6" PRIu64 " us  p99 %6" PRIu64 " us behind the recording\n", histogram_quantile(buckets, 500), histogram_quantile(buckets, 990));
+
+	printf("Proxy CPU:        %.1f ms total, %.3f%% of a core\n", (double)proxy_cpu_us / 1000.0, 100.0 * (double)proxy_cpu_us / (double)elapsed_us);
+
+	if (udp_sent > 0 && 100 * udp_lost > (uint64_t)rc->opts.max_loss * udp_sent)
+	{
+		fprintf(stderr, "Error: Lost %" PRIu64 " of %" PRIu64 " UDP packets, more than the allowed %d%%\n", udp_lost, udp_sent, rc->opts.max_loss);
+		return 1;
+	}
+
+	if (atomic_u64_load(&rc->tcp_failed) > 0)
+	{
+		fprintf(stderr, "Error: The proxy failed to open %" PRIu64 " TCP connections\n", atomic_u64_load(&rc->tcp_failed));
+		return 1;
+	}
+
+	return 0;
+}
+
+static void replay_send(struct replay_ctx *rc, struct replay_client *clients, struct replay_remote *remotes, struct replay_tcp *tcp, const struct replay_event *ev)
+{
+	struct replay_client *client = &clients[ev->session];
+	struct replay_tcp *session_tcp = &tcp[ev->session];
+	const uint32_t remote_addr = rc->remote_addrs[ev->remote];
+	const enum PROXY_MSG_TYPE type = (enum PROXY_MSG_TYPE)ev->type;
+	struct replay_payload payload;
+	size_t hdr_len;
+	uint32_t len;
+	int kind;
+	int ret;
+
+	switch (type)
+	{
+	case PROXY_MSG_TYPE_UDP_DATA:
+	case PROXY_MSG_TYPE_UDP_CONTROL:
+		kind = type == PROXY_MSG_TYPE_UDP_DATA ? REPLAY_KIND_DATA : REPLAY_KIND_CONTROL;
+		len = ev->len > sizeof(payload) ? ev->len : (uint32_t)sizeof(payload);
+
+		payload.stamp = clock_now_us();
+		payload.index = ev->session;
+		memcpy(&replay_tx[BENCH_HEADER_LEN], &payload, sizeof(payload));
+
+		if (ev->dir == TRACE_DIR_TO_CLIENT)
+		{
+			ret = conn_send_to(&remotes[ev->remote].ports[kind].conn, &replay_tx[BENCH_HEADER_LEN], len, rc->session_addrs[ev->session], kind == REPLAY_KIND_DATA ? 5198 : 5199);
+		}
+		else
+		{
+			hdr_len = bench_write_header(replay_tx, type, remote_addr, len);
+			ret = conn_send(&client->conn, replay_tx, hdr_len + len);
+		}
+
+		if (ret == 0)
+		{
+			atomic_u64_add(&rc->flows[ev->dir][kind].sent, 1);
+		}
+
+		break;
+	case PROXY_MSG_TYPE_TCP_OPEN:
+		replay_tcp_open(rc, client, &remotes[ev->remote], session_tcp, ev->remote);
+
+		break;
+	case PROXY_MSG_TYPE_TCP_DATA:
+		// A capture can start partway through a connection, but data from
+		// the remote host after the connection was closed is left out
+		if (session_tcp->remote != ev->remote &&
+			((session_tcp->opened && ev->dir == TRACE_DIR_TO_CLIENT) || replay_tcp_open(rc, client, &remotes[ev->remote], session_tcp, ev->remote) < 0))
+		{
+			break;
+		}
+
+		if (ev->dir == TRACE_DIR_TO_CLIENT)
+		{
+			ret = conn_send(&session_tcp->conn, &replay_tx[BENCH_HEADER_LEN], ev->len);
+		}
+		else
+		{
+			hdr_len = bench_write_header(replay_tx, type, remote_addr, ev->len);
+			ret = conn_send(&client->conn, replay_tx, hdr_len + ev->len);
+		}
+
+		if (ret == 0)
+		{
+			atomic_u64_add(&rc->flows[ev->dir][REPLAY_KIND_TCP].sent, ev->len);
+		}
+
+		break;
+	case PROXY_MSG_TYPE_TCP_CLOSE:
+		// Whichever side closes first, the proxy closes the other, so the
+		// second close in a capture is left out
+		if (session_tcp->remote != ev->remote)
+		{
+			break;
+		}
+
+		if (ev->dir == TRACE_DIR_TO_CLIENT)
+		{
+			conn_shutdown(&session_tcp->conn);
+		}
+		else
+		{
+			hdr_len = bench_write_header(replay_tx, type, remote_addr, 0);
+			conn_send(&client->conn, replay_tx, hdr_len);
+		}
+
+		session_tcp->remote = -1;
+
+		break;
+	default:
+		break;
+	}
+}
+
+static void * replay_tcp_recv(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct replay_tcp *tcp = (struct replay_tcp *)th->func_ctx;
+	struct replay_ctx *rc = tcp->rc;
+	uint8_t buff[REPLAY_BUFF_LEN];
+	int ret;
+
+	while (!atomic_u32_load(&rc->stop))
+	{
+		ret = conn_poll(&tcp->conn, REPLAY_POLL_US);
+		if (ret < 0)
+		{
+			break;
+		}
+		else if (ret == 0)
+		{
+			continue;
+		}
+
+		ret = conn_recv_some(&tcp->conn, buff, sizeof(buff));
+		if (ret <= 0)
+		{
+			break;
+		}
+
+		atomic_u64_add(&rc->flows[TRACE_DIR_FROM_CLIENT][REPLAY_KIND_TCP].recv, (uint64_t)ret);
+	}
+
+	atomic_u32_store(&tcp->done, 1);
+
+	atomic_u64_add(&rc->generator_cpu_us, bench_thread_cpu_us());
+
+	return NULL;
+}
+
+static int replay_tcp_open(struct replay_ctx *rc, struct replay_client *client, struct replay_remote *remote, struct replay_tcp *tcp, int index)
+{
+	const uint64_t deadline = clock_now_us() + REPLAY_CONNECT_TIMEOUT;
+	const uint32_t statuses = atomic_u32_load(&client->statuses);
+	uint8_t buff[BENCH_HEADER_LEN];
+	size_t hdr_len;
+	int ret;
+
+	replay_tcp_reset(tcp);
+
+	hdr_len = bench_write_header(buff, PROXY_MSG_TYPE_TCP_OPEN, rc->remote_addrs[index], 0);
+
+	ret = conn_send(&client->conn, buff, hdr_len);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	// Like a real client, wait until the proxy reports the connection open
+	// before going on
+	ret = conn_poll(&remote->listener, REPLAY_CONNECT_TIMEOUT);
+	if (ret == 0)
+	{
+		ret = -ETIMEDOUT;
+	}
+
+	if (ret > 0)
+	{
+		ret = conn_accept(&remote->listener, &tcp->conn);
+	}
+
+	while (ret == 0 && atomic_u32_load(&client->statuses) == statuses)
+	{
+		if (clock_now_us() >= deadline)
+		{
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		usleep(100);
+	}
+
+	if (ret == 0)
+	{
+		atomic_u32_store(&tcp->done, 0);
+
+		ret = thread_start(&tcp->thread);
+		if (ret < 0)
+		{
+			conn_close(&tcp->conn);
+		}
+	}
+
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Session %u failed to open a TCP connection through the proxy (%d): %s\n", client->index, -ret, strerror(-ret));
+		atomic_u64_add(&rc->tcp_failed, 1);
+
+		return ret;
+	}
+
+	tcp->remote = index;
+	tcp->live = 1;
+	tcp->opened = 1;
+
+	return 0;
+}
+
+static void replay_tcp_reset(struct replay_tcp *tcp)
+{
+	const uint64_t deadline = clock_now_us() + REPLAY_CONNECT_TIMEOUT;
+
+	if (tcp->live)
+	{
+		// Once the proxy has been asked to close the connection, the data
+		// still on its way is counted before giving up on it
+		while (tcp->remote < 0 && !atomic_u32_load(&tcp->done) && clock_now_us() < deadline)
+		{
+			usleep(100);
+		}
+
+		conn_shutdown(&tcp->conn);
+		thread_join(&tcp->thread);
+		conn_close(&tcp->conn);
+
+		tcp->live = 0;
+	}
+
+	tcp->remote = -1;
+}
+
+static inline uint16_t get_u16(const uint8_t *buff, int swap)
+{
+	uint16_t val;
+
+	memcpy(&val, buff, sizeof(val));
+
+	return swap ? (uint16_t)((val >> 8) | (val << 8)) : val;
+}
+
+static inline uint32_t get_u32(const uint8_t *buff, int swap)
+{
+	uint32_t val;
+
+	memcpy(&val, buff, sizeof(val));
+
+	return swap ? (val >> 24) | ((val >> 8) & 0xFF00) | ((val << 8) & 0xFF0000) | (val << 24) : val;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct replay_ctx rc;
+	struct replay_client *clients = NULL;
+	struct replay_remote *remotes = NULL;
+	struct replay_tcp *tcp = NULL;
+	struct thread_handle thread_proxy;
+	uint32_t local_addrs[REPLAY_SESSIONS_MAX];
+	size_t num_local_addrs = 0;
+	char *local_list = NULL;
+	char *tok;
+	char addr[20];
+	const struct replay_event *ev;
+	uint64_t cpu_start = 0;
+	uint64_t cpu_self = 0;
+	uint64_t cpu_total;
+	uint64_t generator_cpu;
+	uint64_t start;
+	uint64_t target;
+	uint64_t now;
+	uint64_t elapsed = 0;
+	size_t i;
+	int j;
+	int k;
+	int unavailable = 0;
+	int ret;
+
+	memset(&thread_proxy, 0x0, sizeof(thread_proxy));
+
+	ret = parse_args(argc, argv, &rc.opts);
+	if (ret < 0)
+	{
+		return 1;
+	}
+
+	snprintf(rc.port_str, sizeof(rc.port_str), "%d", rc.opts.port);
+
+	if (rc.opts.local_addrs != NULL)
+	{
+		local_list = malloc(strlen(rc.opts.local_addrs) + 1);
+		if (local_list == NULL)
+		{
+			ret = -ENOMEM;
+			goto main_exit;
+		}
+
+		strcpy(local_list, rc.opts.local_addrs);
+
+		for (tok = strtok(local_list, ","); tok != NULL && num_local_addrs < REPLAY_SESSIONS_MAX; tok = strtok(NULL, ","))
+		{
+			ret = conn_resolve(tok, &local_addrs[num_local_addrs++]);
+			if (ret < 0)
+			{
+				fprintf(stderr, "Error: Invalid address '%s'\n", tok);
+				goto main_exit;
+			}
+		}
+	}
+
+	if (rc.opts.path != NULL)
+	{
+		ret = replay_load(&rc.rec, rc.opts.path, local_addrs, num_local_addrs);
+	}
+	else
+	{
+		ret = replay_generate(&rc.rec, rc.opts.sessions, rc.opts.duration);
+		if (ret == 0)
+		{
+			qsort(rc.rec.events, rc.rec.len, sizeof(struct replay_event), replay_compare);
+		}
+	}
+
+	if (ret < 0)
+	{
+		goto main_exit;
+	}
+
+	clients = calloc((size_t)rc.rec.sessions, sizeof(struct replay_client));
+	tcp = calloc((size_t)rc.rec.sessions, sizeof(struct replay_tcp));
+	remotes = calloc((size_t)rc.rec.remotes, sizeof(struct replay_remote));
+	if (clients == NULL || tcp == NULL || remotes == NULL)
+	{
+		ret = -ENOMEM;
+		goto main_exit;
+	}
+
+	// Configure a proxy with one slot for each session, each using its own
+	// loopback address
+	ret = proxy_init(&rc.ph);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize proxy (%d): %s\n", -ret, strerror(-ret));
+		goto main_exit;
+	}
+
+	proxy_log_level(&rc.ph, getenv("REPLAY_DEBUG") ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARN);
+
+	rc.ph.conf.port = (uint16_t)rc.opts.port;
+	rc.ph.conf.forwarding_threads = (uint16_t)rc.opts.forwarding_threads;
+	rc.ph.conf.password = malloc(sizeof(REPLAY_PASSWORD));
+	rc.ph.conf.bind_addr = malloc(sizeof(REPLAY_PROXY_ADDR));
+	rc.ph.conf.bind_addr_ext = malloc(sizeof(addr));
+	rc.ph.conf.bind_addr_ext_add = calloc((size_t)rc.rec.sessions, sizeof(char *));
+	if (rc.ph.conf.password == NULL || rc.ph.conf.bind_addr == NULL || rc.ph.conf.bind_addr_ext == NULL || rc.ph.conf.bind_addr_ext_add == NULL)
+	{
+		ret = -ENOMEM;
+		goto main_exit;
+	}
+
+	memcpy(rc.ph.conf.password, REPLAY_PASSWORD, sizeof(REPLAY_PASSWORD));
+	memcpy(rc.ph.conf.bind_addr, REPLAY_PROXY_ADDR, sizeof(REPLAY_PROXY_ADDR));
+
+	if (rc.opts.forwarding_backend != NULL)
+	{
+		rc.ph.conf.forwarding_backend = malloc(strlen(rc.opts.forwarding_backend) + 1);
+		if (rc.ph.conf.forwarding_backend == NULL)
+		{
+			ret = -ENOMEM;
+			goto main_exit;
+		}
+
+		strcpy(rc.ph.conf.forwarding_backend, rc.opts.forwarding_backend);
+	}
+
+	for (j = 0; j < rc.rec.sessions; j++)
+	{
+		snprintf(addr, sizeof(addr), "127.0.1.%d", j + 1);
+
+		if (j == 0)
+		{
+			memcpy(rc.ph.conf.bind_addr_ext, addr, sizeof(addr));
+			continue;
+		}
+
+		rc.ph.conf.bind_addr_ext_add[rc.ph.conf.bind_addr_ext_add_len] = malloc(sizeof(addr));
+		if (rc.ph.conf.bind_addr_ext_add[rc.ph.conf.bind_addr_ext_add_len] == NULL)
+		{
+			ret = -ENOMEM;
+			goto main_exit;
+		}
+
+		memcpy(rc.ph.conf.bind_addr_ext_add[rc.ph.conf.bind_addr_ext_add_len++], addr, sizeof(addr));
+	}
+
+	ret = proxy_open(&rc.ph);
+	if (ret < 0)
+	{
+		// Sandboxes may refuse the system calls a backend relies on
+		if (rc.opts.forwarding_backend != NULL && (ret == -ENOSYS || ret == -EPERM))
+		{
+			fprintf(stderr, "Skipping: Forwarding backend '%s' is not available here (%d): %s\n", rc.opts.forwarding_backend, -ret, strerror(-ret));
+			unavailable = 1;
+		}
+		else
+		{
+			fprintf(stderr, "Error: Failed to open proxy (%d): %s\n", -ret, strerror(-ret));
+		}
+
+		goto main_exit;
+	}
+
+	ret = proxy_start(&rc.ph);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to start proxy (%d): %s\n", -ret, strerror(-ret));
+		goto main_exit;
+	}
+
+	// Each remote host listens on the EchoLink ports of an address of its own
+	for (j = 0; j < rc.rec.remotes; j++)
+	{
+		snprintf(remotes[j].addr, sizeof(remotes[j].addr), "127.0.2.%d", j + 1);
+
+		ret = conn_resolve(remotes[j].addr, &rc.remote_addrs[j]);
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+
+		for (k = 0; k < 2; k++)
+		{
+			remotes[j].ports[k].rc = &rc;
+			remotes[j].ports[k].kind = k ? REPLAY_KIND_CONTROL : REPLAY_KIND_DATA;
+			remotes[j].ports[k].conn.type = CONN_TYPE_UDP;
+			remotes[j].ports[k].conn.source_addr = remotes[j].addr;
+			remotes[j].ports[k].conn.source_port = k ? "5199" : "5198";
+			remotes[j].ports[k].thread.func_ptr = replay_port_recv;
+			remotes[j].ports[k].thread.func_ctx = &remotes[j].ports[k];
+
+			ret = conn_init(&remotes[j].ports[k].conn);
+			if (ret == 0)
+			{
+				ret = conn_listen(&remotes[j].ports[k].conn);
+			}
+
+			if (ret < 0)
+			{
+				fprintf(stderr, "Error: Remote host %s failed to listen on UDP port %s (%d): %s\n", remotes[j].addr, remotes[j].ports[k].conn.source_port, -ret, strerror(-ret));
+				goto main_exit;
+			}
+
+			ret = thread_init(&remotes[j].ports[k].thread);
+			if (ret == 0)
+			{
+				ret = thread_start(&remotes[j].ports[k].thread);
+			}
+
+			if (ret < 0)
+			{
+				goto main_exit;
+			}
+		}
+
+		if (rc.rec.remote_tcp[j])
+		{
+			remotes[j].listener.type = CONN_TYPE_TCP;
+			remotes[j].listener.source_addr = remotes[j].addr;
+			remotes[j].listener.source_port = "5200";
+
+			ret = conn_init(&remotes[j].listener);
+			if (ret == 0)
+			{
+				ret = conn_listen(&remotes[j].listener);
+			}
+
+			if (ret < 0)
+			{
+				fprintf(stderr, "Error: Remote host %s failed to listen on TCP port 5200 (%d): %s\n", remotes[j].addr, -ret, strerror(-ret));
+				goto main_exit;
+			}
+		}
+	}
+
+	for (j = 0; j < rc.rec.sessions; j++)
+	{
+		clients[j].rc = &rc;
+		clients[j].index = (uint32_t)j;
+		clients[j].conn.type = CONN_TYPE_TCP;
+		clients[j].thread.func_ptr = replay_client_recv;
+		clients[j].thread.func_ctx = &clients[j];
+
+		tcp[j].rc = &rc;
+		tcp[j].remote = -1;
+		tcp[j].conn.type = CONN_TYPE_TCP;
+		tcp[j].thread.func_ptr = replay_tcp_recv;
+		tcp[j].thread.func_ctx = &tcp[j];
+
+		ret = conn_init(&clients[j].conn);
+		if (ret == 0)
+		{
+			ret = conn_init(&tcp[j].conn);
+		}
+
+		if (ret == 0)
+		{
+			ret = thread_init(&clients[j].thread);
+		}
+
+		if (ret == 0)
+		{
+			ret = thread_init(&tcp[j].thread);
+		}
+
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+	}
+
+	thread_proxy.func_ptr = replay_proxy_process;
+	thread_proxy.func_ctx = &rc;
+
+	ret = thread_init(&thread_proxy);
+	if (ret == 0)
+	{
+		ret = thread_start(&thread_proxy);
+	}
+
+	if (ret < 0)
+	{
+		goto main_exit;
+	}
+
+	ret = replay_connect(&rc, clients);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to connect the sessions to the proxy (%d): %s\n", -ret, strerror(-ret));
+		goto main_exit;
+	}
+
+	for (j = 0; j < rc.rec.sessions; j++)
+	{
+		ret = thread_start(&clients[j].thread);
+		if (ret < 0)
+		{
+			goto main_exit;
+		}
+	}
+
+	cpu_start = bench_process_cpu_us();
+	cpu_self = bench_thread_cpu_us();
+	start = clock_now_us();
+
+	for (i = 0; i < rc.rec.len && !atomic_u32_load(&rc.failures); i++)
+	{
+		ev = &rc.rec.events[i];
+
+		if (rc.opts.speed > 0)
+		{
+			target = start + ev->stamp / (uint64_t)rc.opts.speed;
+
+			while ((now = clock_now_us()) < target)
+			{
+				usleep((useconds_t)(target - now < REPLAY_POLL_US ? target - now : REPLAY_POLL_US));
+			}
+
+			histogram_record(&rc.lag, now - target);
+		}
+
+		replay_send(&rc, clients, remotes, tcp, ev);
+	}
+
+	elapsed = clock_now_us() - start;
+
+	usleep(REPLAY_DRAIN_US);
+
+	for (j = 0; j < rc.rec.sessions; j++)
+	{
+		replay_tcp_reset(&tcp[j]);
+	}
+
+	atomic_u64_add(&rc.generator_cpu_us, bench_thread_cpu_us() - cpu_self);
+
+	ret = atomic_u32_load(&rc.failures) > 0 ? -EIO : 0;
+
+main_exit:
+	atomic_u32_store(&rc.stop, 1);
+
+	// Freeing each thread waits for it to return
+	for (j = 0; remotes != NULL && j < rc.rec.remotes; j++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			thread_free(&remotes[j].ports[k].thread);
+			conn_free(&remotes[j].ports[k].conn);
+		}
+
+		conn_free(&remotes[j].listener);
+	}
+
+	for (j = 0; clients != NULL && j < rc.rec.sessions; j++)
+	{
+		thread_free(&clients[j].thread);
+		conn_free(&clients[j].conn);
+	}
+
+	for (j = 0; tcp != NULL && j < rc.rec.sessions; j++)
+	{
+		thread_free(&tcp[j].thread);
+		conn_free(&tcp[j].conn);
+	}
+
+	if (ret == 0)
+	{
+		cpu_total = bench_process_cpu_us() - cpu_start;
+		generator_cpu = atomic_u64_load(&rc.generator_cpu_us);
+
+		ret = replay_report(&rc, elapsed, cpu_total > generator_cpu ? cpu_total - generator_cpu : 0) ? -EIO : 0;
+	}
+	else if (!unavailable)
+	{
+		fprintf(stderr, "Error: Replay failed (%d): %s\n", -ret, strerror(-ret));
+	}
+
+	if (rc.ph.priv != NULL)
+	{
+		proxy_shutdown(&rc.ph);
+	}
+
+	thread_free(&thread_proxy);
+	proxy_free(&rc.ph);
+
+	free(clients);
+	free(tcp);
+	free(remotes);
+	free(local_list);
+	free(rc.rec.events);
+	free(rc.rec.remote_keys);
+
+	return unavailable ? REPLAY_EXIT_SKIP : ret == 0 ? 0 : 1;
+}
+
+static int parse_args(int argc, char *argv[], struct replay_opts *opts)
+{
+	int *target;
+	int i;
+
+	opts->path = NULL;
+	opts->local_addrs = NULL;
+	opts->speed = 1;
+	opts->sessions = 4;
+	opts->duration = 3;
+	opts->max_loss = 1;
+	opts->forwarding_backend = NULL;
+	opts->forwarding_threads = 0;
+	opts->port = 8100;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+		{
+			print_usage();
+			exit(0);
+		}
+
+		// The capture is the only argument without an option
+		if (argv[i][0] != '-' && opts->path == NULL)
+		{
+			opts->path = argv[i];
+			continue;
+		}
+
+		if (strlen(argv[i]) != 2 || argv[i][0] != '-' || i + 1 >= argc)
+		{
+			fprintf(stderr, "Error: Invalid argument '%s'\n", argv[i]);
+			print_usage();
+			return -EINVAL;
+		}
+
+		if (argv[i][1] == 'b')
+		{
+			opts->forwarding_backend = argv[++i];
+			continue;
+		}
+		else if (argv[i][1] == 'l')
+		{
+			opts->local_addrs = argv[++i];
+			continue;
+		}
+
+		switch (argv[i][1])
+		{
+		case 'c':
+			target = &opts->sessions;
+			break;
+		case 'd':
+			target = &opts->duration;
+			break;
+		case 'f':
+			target = &opts->forwarding_threads;
+			break;
+		case 'L':
+			target = &opts->max_loss;
+			break;
+		case 'p':
+			target = &opts->port;
+			break;
+		case 'x':
+			target = &opts->speed;
+			break;
+		default:
+			fprintf(stderr, "Error: Invalid argument '%s'\n", argv[i]);
+			print_usage();
+			return -EINVAL;
+		}
+
+		i++;
+		*target = atoi(argv[i]);
+	}
+
+	if (opts->speed < 0 || opts->sessions < 1 || opts->sessions > REPLAY_SESSIONS_MAX || opts->duration < 1 ||
+		opts->duration > 3600 || opts->max_loss < 0 || opts->max_loss > 100 || opts->forwarding_threads < 0 ||
+		opts->forwarding_threads > UINT16_MAX || opts->port < 1 || opts->port > UINT16_MAX)
+	{
+		fprintf(stderr, "Error: Argument out of range\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void print_usage(void)
+{
+	printf("Usage: bench_replay [OPTION...] [CAPTURE]\n\n"
+		"Runs a proxy on the loopback interface and replays the EchoLink traffic\n"
+		"in a pcap or pcapng capture through it, such as one written by the\n"
+		"admin 'trace' command or taken with tcpdump on the proxy's external\n"
+		"interface. Without a capture, a built-in recording of a conference is\n"
+		"replayed. Slots use 127.0.1.1 and up, and remote hosts 127.0.2.1 and up.\n\n"
+		"Options:\n"
+		"  -b <name>   Forwarding backend, such as epoll or io_uring (default\n"
+		"              is the platform default)\n"
+		"  -c <count>  Number of clients in the built-in recording (default 4)\n"
+		"  -d <secs>   Length of the built-in recording (default 3)\n"
+		"  -f <count>  Forwarding threads, 0 for a thread per client (default 0)\n"
+		"  -l <addrs>  Comma-separated addresses of the proxy in the capture, for\n"
+		"              captures which don't mark the direction of each packet\n"
+		"  -L <pct>    Percentage of UDP packets which may be lost before the\n"
+		"              replay fails (default 1)\n"
+		"  -p <port>   Port for the proxy to listen on (default 8100)\n"
+		"  -x <speed>  Multiple of the recorded speed to replay at, 0 for as fast\n"
+		"              as possible (default 1)\n"
+		"  -h, --help  Display this help\n");
+}
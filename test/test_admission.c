@@ -0,0 +1,253 @@
+/*!
+ * @file test_admission.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to the client admission table
+ */
+
+#include "admission.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/*!
+ * @brief Test that the address which failed is refused until it is forgiven
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the address which failed is refused until it is forgiven
+ */
+static int test_admission_penalty(void);
+
+/*!
+ * @brief Test that each address is limited to its burst
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that each address is limited to its burst
+ */
+static int test_admission_rate(void);
+
+/*!
+ * @brief Test that addresses are admitted when the table is full
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that addresses are admitted when the table is full
+ */
+static int test_admission_full(void);
+
+/*!
+ * @brief Main entry point for admission table tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_admission_penalty();
+	ret |= test_admission_rate();
+	ret |= test_admission_full();
+
+	return ret;
+}
+
+static int test_admission_penalty(void)
+{
+	struct admission_handle ah;
+	int ret;
+
+	memset(&ah, 0x0, sizeof(struct admission_handle));
+	ah.size = 16;
+	ah.max_failures = 2;
+	ah.penalty = 60;
+
+	ret = admission_init(&ah);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize admission table (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	if (admission_fail(&ah, "192.0.2.1") != 1 || admission_check(&ah, "192.0.2.1") != 0)
+	{
+		fprintf(stderr, "Error: Address was refused before reaching the failure limit\n");
+		ret = -EINVAL;
+		goto test_admission_penalty_exit;
+	}
+
+	if (admission_fail(&ah, "192.0.2.1") != 2 || admission_check(&ah, "192.0.2.1") != -EACCES)
+	{
+		fprintf(stderr, "Error: Address was not refused after reaching the failure limit\n");
+		ret = -EINVAL;
+		goto test_admission_penalty_exit;
+	}
+
+	if (admission_check(&ah, "192.0.2.2") != 0)
+	{
+		fprintf(stderr, "Error: Address was refused for the failures of another\n");
+		ret = -EINVAL;
+		goto test_admission_penalty_exit;
+	}
+
+	admission_forgive(&ah, "192.0.2.1");
+
+	if (admission_check(&ah, "192.0.2.1") != 0 || admission_fail(&ah, "192.0.2.1") != 1)
+	{
+		fprintf(stderr, "Error: Failures were not forgotten\n");
+		ret = -EINVAL;
+	}
+
+test_admission_penalty_exit:
+	admission_free(&ah);
+
+	return ret;
+}
+
+static int test_admission_rate(void)
+{
+	struct admission_handle ah;
+	int ret;
+	int i;
+
+	memset(&ah, 0x0, sizeof(struct admission_handle));
+	ah.size = 16;
+	ah.rate = 1;
+	ah.burst = 3;
+
+	ret = admission_init(&ah);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize admission table (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		ret = admission_check(&ah, "2001:db8::1");
+		if (ret != 0)
+		{
+			fprintf(stderr, "Error: Connection %d of the burst was refused (%d): %s\n", i, -ret, strerror(-ret));
+			ret = -EINVAL;
+			goto test_admission_rate_exit;
+		}
+	}
+
+	if (admission_check(&ah, "2001:db8::1") != -EAGAIN)
+	{
+		fprintf(stderr, "Error: Connection beyond the burst was admitted\n");
+		ret = -EINVAL;
+		goto test_admission_rate_exit;
+	}
+
+	if (admission_check(&ah, "2001:db8::2") != 0)
+	{
+		fprintf(stderr, "Error: Address was limited by the rate of another\n");
+		ret = -EINVAL;
+	}
+
+test_admission_rate_exit:
+	admission_free(&ah);
+
+	return ret;
+}
+
+static int test_admission_full(void)
+{
+	struct admission_handle ah;
+	int ret;
+	int i;
+
+	memset(&ah, 0x0, sizeof(struct admission_handle));
+	ah.size = 2;
+	ah.rate = 1;
+	ah.burst = 1;
+	ah.max_failures = 1;
+	ah.penalty = 60;
+
+	ret = admission_init(&ah);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize admission table (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	if (admission_check(&ah, "192.0.2.1") != 0 || admission_check(&ah, "192.0.2.2") != 0)
+	{
+		fprintf(stderr, "Error: First connections were refused\n");
+		ret = -EINVAL;
+		goto test_admission_full_exit;
+	}
+
+	// With both entries in use, the third address can't be tracked
+	for (i = 0; i < 3; i++)
+	{
+		if (admission_check(&ah, "192.0.2.3") != 0)
+		{
+			fprintf(stderr, "Error: Untracked address was refused\n");
+			ret = -EINVAL;
+			goto test_admission_full_exit;
+		}
+	}
+
+	if (admission_fail(&ah, "192.0.2.3") != 0)
+	{
+		fprintf(stderr, "Error: Failure was recorded for an untracked address\n");
+		ret = -EINVAL;
+		goto test_admission_full_exit;
+	}
+
+	if (admission_check(&ah, "192.0.2.1") != -EAGAIN)
+	{
+		fprintf(stderr, "Error: Tracked address lost its state\n");
+		ret = -EINVAL;
+	}
+
+test_admission_full_exit:
+	admission_free(&ah);
+
+	return ret;
+}
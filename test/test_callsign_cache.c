@@ -0,0 +1,181 @@
+/*!
+ * @file test_callsign_cache.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to the callsign decision cache
+ */
+
+#include "callsign_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/*!
+ * @brief Test that decisions can be retrieved and are forgotten when cleared
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that decisions can be retrieved and are forgotten when cleared
+ */
+static int test_callsign_cache_basic(void);
+
+/*!
+ * @brief Test that the least recently used decision is replaced
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the least recently used decision is replaced
+ */
+static int test_callsign_cache_eviction(void);
+
+/*!
+ * @brief Main entry point for callsign cache tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_callsign_cache_basic();
+	ret |= test_callsign_cache_eviction();
+
+	return ret;
+}
+
+static int test_callsign_cache_basic(void)
+{
+	struct callsign_cache_handle cache;
+	int ret;
+
+	memset(&cache, 0x0, sizeof(struct callsign_cache_handle));
+	cache.size = 4;
+
+	ret = callsign_cache_init(&cache);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize callsign cache (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	callsign_cache_put(&cache, "KM0H", 1);
+	callsign_cache_put(&cache, "K1RFD-L", 0);
+	callsign_cache_put(&cache, "AVERYLONGCALLSIGN", 1);
+
+	if (callsign_cache_get(&cache, "KM0H") != 1 || callsign_cache_get(&cache, "K1RFD-L") != 0)
+	{
+		fprintf(stderr, "Error: Cached decisions were not retrieved\n");
+		ret = -EINVAL;
+		goto test_callsign_cache_basic_exit;
+	}
+
+	if (callsign_cache_get(&cache, "AVERYLONGCALLSIGN") != -ENOENT || callsign_cache_get(&cache, "KD0JLT") != -ENOENT)
+	{
+		fprintf(stderr, "Error: Decision was found for a callsign which should not be cached\n");
+		ret = -EINVAL;
+		goto test_callsign_cache_basic_exit;
+	}
+
+	callsign_cache_put(&cache, "KM0H", 0);
+
+	if (callsign_cache_get(&cache, "KM0H") != 0)
+	{
+		fprintf(stderr, "Error: Cached decision was not replaced\n");
+		ret = -EINVAL;
+		goto test_callsign_cache_basic_exit;
+	}
+
+	callsign_cache_clear(&cache);
+
+	if (callsign_cache_get(&cache, "KM0H") != -ENOENT || callsign_cache_get(&cache, "K1RFD-L") != -ENOENT)
+	{
+		fprintf(stderr, "Error: Decision was found after clearing the cache\n");
+		ret = -EINVAL;
+	}
+
+test_callsign_cache_basic_exit:
+	callsign_cache_free(&cache);
+
+	return ret;
+}
+
+static int test_callsign_cache_eviction(void)
+{
+	struct callsign_cache_handle cache;
+	int ret;
+
+	memset(&cache, 0x0, sizeof(struct callsign_cache_handle));
+	cache.size = 2;
+
+	ret = callsign_cache_init(&cache);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize callsign cache (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	callsign_cache_put(&cache, "KM0H", 1);
+	callsign_cache_put(&cache, "KD0JLT", 1);
+
+	// Using the older entry makes the other one the least recently used
+	callsign_cache_get(&cache, "KM0H");
+
+	callsign_cache_put(&cache, "K1RFD", 1);
+
+	if (callsign_cache_get(&cache, "KD0JLT") != -ENOENT)
+	{
+		fprintf(stderr, "Error: Least recently used decision was not replaced\n");
+		ret = -EINVAL;
+	}
+	else if (callsign_cache_get(&cache, "KM0H") != 1 || callsign_cache_get(&cache, "K1RFD") != 1)
+	{
+		fprintf(stderr, "Error: Recently used decisions were replaced\n");
+		ret = -EINVAL;
+	}
+
+	callsign_cache_free(&cache);
+
+	return ret;
+}
@@ -59,6 +59,24 @@
  */
 static int test_digest_conversion(void);
 
+/*!
+ * @brief Test of the constant-time digest comparison
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test of the constant-time digest comparison
+ */
+static int test_digest_equal(void);
+
+/*!
+ * @brief Test of password responses computed from a password digest state
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test of password responses computed from a password digest state
+ */
+static int test_digest_password(void);
+
 /*!
  * @brief Main entry point for digest tests
  *
@@ -71,6 +89,8 @@ int main(void)
 	int ret = 0;
 
 	ret |= test_digest_conversion();
+	ret |= test_digest_equal();
+	ret |= test_digest_password();
 
 	return ret;
 }
@@ -99,3 +119,75 @@ static int test_digest_conversion(void)
 
 	return ret;
 }
+
+static int test_digest_equal(void)
+{
+	uint8_t a[DIGEST_LEN];
+	uint8_t b[DIGEST_LEN];
+	size_t i;
+
+	for (i = 0; i < DIGEST_LEN; i++)
+	{
+		a[i] = (uint8_t)(i * 37);
+	}
+
+	memcpy(b, a, DIGEST_LEN);
+
+	if (!digest_equal(a, b))
+	{
+		fprintf(stderr, "Error: Identical digests were not equal\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < DIGEST_LEN; i++)
+	{
+		b[i] ^= 0x80;
+
+		if (digest_equal(a, b))
+		{
+			fprintf(stderr, "Error: Digests differing at index %zu were equal\n", i);
+			return -EINVAL;
+		}
+
+		b[i] ^= 0x80;
+	}
+
+	return 0;
+}
+
+static int test_digest_password(void)
+{
+	const uint32_t nonce = 0x4d3b6d47;
+	struct digest_password dp;
+	char password[150];
+	uint8_t buff[sizeof(password) + 8];
+	uint8_t expected[DIGEST_LEN];
+	uint8_t response[DIGEST_LEN];
+	size_t len;
+	size_t i;
+
+	// Cover passwords which end on either side of MD5's 64-byte blocks
+	for (len = 0; len < sizeof(password); len++)
+	{
+		for (i = 0; i < len; i++)
+		{
+			password[i] = (char)('a' + i % 26);
+			buff[i] = (uint8_t)('A' + i % 26);
+		}
+
+		password[len] = '\0';
+		digest_to_hex32(nonce, (char *)&buff[len]);
+		digest_get(buff, (unsigned int)(len + 8), expected);
+
+		digest_password_init(&dp, password);
+		digest_password_response(&dp, nonce, response);
+
+		if (memcmp(expected, response, DIGEST_LEN) != 0)
+		{
+			fprintf(stderr, "Error: Password response mismatch for a password of length %zu\n", len);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,332 @@
+/*!
+ * @file test_freelist.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to lock-free lists of free indices
+ */
+
+#include "atomic.h"
+#include "freelist.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Number of indices in the list used by the concurrency test
+#define TEST_FREELIST_SIZE 8
+
+/// Number of worker threads used in the concurrency test
+#define TEST_FREELIST_WORKERS 4
+
+/// Number of indices taken and returned by each worker in the concurrency test
+#define TEST_FREELIST_PER_WORKER 20000
+
+/*!
+ * @brief Context shared by the worker threads in the concurrency test
+ */
+struct test_freelist_ctx
+{
+	/// List to take indices from and return them to
+	struct freelist_handle *fl;
+
+	/// Number of workers currently holding each index
+	volatile uint32_t holders[TEST_FREELIST_SIZE];
+
+	/// Number of times an index was held by two workers at once
+	volatile uint32_t conflicts;
+};
+
+/*!
+ * @brief Main entry point for free list tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Worker thread which repeatedly takes and returns indices
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * worker(void *ctx);
+
+/*!
+ * @brief Test that concurrent users never take the same index at once
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that concurrent users never take the same index at once
+ */
+static int test_freelist_concurrent(void);
+
+/*!
+ * @brief Test that invalid list sizes are rejected
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that invalid list sizes are rejected
+ */
+static int test_freelist_invalid(void);
+
+/*!
+ * @brief Test that indices are popped in the reverse of the order pushed
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that indices are popped in the reverse of the order pushed
+ */
+static int test_freelist_order(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_freelist_concurrent();
+	ret |= test_freelist_invalid();
+	ret |= test_freelist_order();
+
+	return ret;
+}
+
+static void * worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct test_freelist_ctx *tc = (struct test_freelist_ctx *)th->func_ctx;
+	int idx;
+	int i;
+
+	for (i = 0; i < TEST_FREELIST_PER_WORKER; i++)
+	{
+		while ((idx = freelist_pop(tc->fl)) < 0)
+		{
+			thread_yield();
+		}
+
+		if (atomic_u32_add(&tc->holders[idx], 1) != 0)
+		{
+			atomic_u32_add(&tc->conflicts, 1);
+		}
+
+		if (i % 16 == 0)
+		{
+			thread_yield();
+		}
+
+		atomic_u32_add(&tc->holders[idx], (uint32_t)-1);
+
+		freelist_push(tc->fl, (uint32_t)idx);
+	}
+
+	return NULL;
+}
+
+static int test_freelist_concurrent(void)
+{
+	struct freelist_handle fl;
+	struct thread_handle threads[TEST_FREELIST_WORKERS];
+	struct test_freelist_ctx tc;
+	uint8_t seen[TEST_FREELIST_SIZE] = { 0 };
+	int started;
+	int idx;
+	int i;
+	int ret;
+
+	memset(&fl, 0x0, sizeof(struct freelist_handle));
+	memset(threads, 0x0, sizeof(threads));
+	memset(&tc, 0x0, sizeof(struct test_freelist_ctx));
+	fl.size = TEST_FREELIST_SIZE;
+	tc.fl = &fl;
+
+	ret = freelist_init(&fl);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize free list (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	for (i = 0; i < TEST_FREELIST_SIZE; i++)
+	{
+		freelist_push(&fl, (uint32_t)i);
+	}
+
+	for (started = 0; started < TEST_FREELIST_WORKERS; started++)
+	{
+		ret = thread_init(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to initialize worker thread (%d): %s\n", -ret, strerror(-ret));
+			break;
+		}
+
+		threads[started].func_ptr = worker;
+		threads[started].func_ctx = &tc;
+
+		ret = thread_start(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to start worker thread (%d): %s\n", -ret, strerror(-ret));
+			thread_free(&threads[started]);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		thread_join(&threads[i]);
+		thread_free(&threads[i]);
+	}
+
+	if (ret < 0)
+	{
+		goto test_freelist_concurrent_exit;
+	}
+
+	if (tc.conflicts != 0)
+	{
+		fprintf(stderr, "Error: An index was taken by two workers at once %u times\n", tc.conflicts);
+		ret = -EINVAL;
+		goto test_freelist_concurrent_exit;
+	}
+
+	// Every index must have been returned exactly once
+	for (i = 0; i < TEST_FREELIST_SIZE; i++)
+	{
+		idx = freelist_pop(&fl);
+		if (idx < 0 || idx >= TEST_FREELIST_SIZE || seen[idx])
+		{
+			fprintf(stderr, "Error: Unexpected index %d after the workers finished\n", idx);
+			ret = -EINVAL;
+			goto test_freelist_concurrent_exit;
+		}
+
+		seen[idx] = 1;
+	}
+
+	if (freelist_pop(&fl) != -ENOENT)
+	{
+		fprintf(stderr, "Error: Free list holds more indices than were pushed\n");
+		ret = -EINVAL;
+	}
+
+test_freelist_concurrent_exit:
+	freelist_free(&fl);
+
+	return ret;
+}
+
+static int test_freelist_invalid(void)
+{
+	struct freelist_handle fl;
+	int ret;
+
+	memset(&fl, 0x0, sizeof(struct freelist_handle));
+
+	ret = freelist_init(&fl);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Free list of size 0 was not rejected (%d)\n", ret);
+		freelist_free(&fl);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_freelist_order(void)
+{
+	struct freelist_handle fl;
+	int ret;
+	int i;
+
+	memset(&fl, 0x0, sizeof(struct freelist_handle));
+	fl.size = 4;
+
+	ret = freelist_init(&fl);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize free list (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = freelist_pop(&fl);
+	if (ret != -ENOENT)
+	{
+		fprintf(stderr, "Error: New free list is not empty (%d)\n", ret);
+		ret = -EINVAL;
+		goto test_freelist_order_exit;
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		freelist_push(&fl, (uint32_t)i);
+	}
+
+	for (i = 3; i >= 0; i--)
+	{
+		ret = freelist_pop(&fl);
+		if (ret != i)
+		{
+			fprintf(stderr, "Error: Expected index %d but got %d\n", i, ret);
+			ret = -EINVAL;
+			goto test_freelist_order_exit;
+		}
+	}
+
+	ret = freelist_pop(&fl);
+	if (ret != -ENOENT)
+	{
+		fprintf(stderr, "Error: Emptied free list is not empty (%d)\n", ret);
+		ret = -EINVAL;
+		goto test_freelist_order_exit;
+	}
+
+	ret = 0;
+
+test_freelist_order_exit:
+	freelist_free(&fl);
+
+	return ret;
+}
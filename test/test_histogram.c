@@ -0,0 +1,285 @@
+/*!
+ * @file test_histogram.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to lock-free log-linear histograms
+ */
+
+#include "histogram.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Number of worker threads used in the concurrency test
+#define TEST_HISTOGRAM_WORKERS 4
+
+/// Number of values recorded by each worker in the concurrency test
+#define TEST_HISTOGRAM_PER_WORKER 20000
+
+/*!
+ * @brief Main entry point for histogram tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Test that every value falls within the bounds of its bucket
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that every value falls within the bounds of its bucket
+ */
+static int test_histogram_buckets(void);
+
+/*!
+ * @brief Test that concurrent recording loses no values
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that concurrent recording loses no values
+ */
+static int test_histogram_concurrent(void);
+
+/*!
+ * @brief Test that quantiles are estimated within the bucket resolution
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that quantiles are estimated within the bucket resolution
+ */
+static int test_histogram_quantile(void);
+
+/*!
+ * @brief Worker thread which repeatedly records values
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * worker(void *ctx);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_histogram_buckets();
+	ret |= test_histogram_concurrent();
+	ret |= test_histogram_quantile();
+
+	return ret;
+}
+
+static int test_histogram_buckets(void)
+{
+	uint64_t value;
+	size_t bucket;
+	size_t i;
+
+	if (histogram_bucket_min(0) != 0)
+	{
+		fprintf(stderr, "Error: First bucket does not start at 0\n");
+		return -EINVAL;
+	}
+
+	// Buckets must be contiguous and each must map back to itself
+	for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+	{
+		if (histogram_bucket_min(i) > histogram_bucket_max(i) || histogram_bucket_max(i) + 1 != histogram_bucket_min(i + 1))
+		{
+			fprintf(stderr, "Error: Bucket %zu is not contiguous with the next\n", i);
+			return -EINVAL;
+		}
+
+		if (histogram_bucket(histogram_bucket_min(i)) != i || histogram_bucket(histogram_bucket_max(i)) != i)
+		{
+			fprintf(stderr, "Error: Bounds of bucket %zu do not map back to it\n", i);
+			return -EINVAL;
+		}
+	}
+
+	// The relative width of each bucket is bounded
+	for (value = 1; value < ((uint64_t)1 << HISTOGRAM_MAX_BITS); value = value * 3 + 1)
+	{
+		bucket = histogram_bucket(value);
+
+		if ((histogram_bucket_max(bucket) - histogram_bucket_min(bucket)) << HISTOGRAM_SUB_BITS > value)
+		{
+			fprintf(stderr, "Error: Bucket %zu for value %" PRIu64 " is too wide\n", bucket, value);
+			return -EINVAL;
+		}
+	}
+
+	if (histogram_bucket(UINT64_MAX) != HISTOGRAM_BUCKETS - 1 || histogram_bucket_max(HISTOGRAM_BUCKETS - 1) != UINT64_MAX)
+	{
+		fprintf(stderr, "Error: Large values are not clamped to the last bucket\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_histogram_concurrent(void)
+{
+	struct histogram hist;
+	struct thread_handle threads[TEST_HISTOGRAM_WORKERS];
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+	uint64_t expected_sum;
+	uint64_t count;
+	uint64_t sum;
+	int started;
+	int i;
+	int ret = 0;
+
+	memset(&hist, 0x0, sizeof(struct histogram));
+	memset(threads, 0x0, sizeof(threads));
+
+	for (started = 0; started < TEST_HISTOGRAM_WORKERS; started++)
+	{
+		ret = thread_init(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to initialize worker thread (%d): %s\n", -ret, strerror(-ret));
+			break;
+		}
+
+		threads[started].func_ptr = worker;
+		threads[started].func_ctx = &hist;
+
+		ret = thread_start(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to start worker thread (%d): %s\n", -ret, strerror(-ret));
+			thread_free(&threads[started]);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		thread_join(&threads[i]);
+		thread_free(&threads[i]);
+	}
+
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	count = histogram_read(&hist, buckets, &sum);
+	expected_sum = (uint64_t)TEST_HISTOGRAM_WORKERS * TEST_HISTOGRAM_PER_WORKER * (TEST_HISTOGRAM_PER_WORKER - 1) / 2;
+
+	if (count != (uint64_t)TEST_HISTOGRAM_WORKERS * TEST_HISTOGRAM_PER_WORKER || sum != expected_sum)
+	{
+		fprintf(stderr, "Error: Expected %d values summing to %" PRIu64 " but got %" PRIu64 " summing to %" PRIu64 "\n",
+			TEST_HISTOGRAM_WORKERS * TEST_HISTOGRAM_PER_WORKER, expected_sum, count, sum);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_histogram_quantile(void)
+{
+	struct histogram hist;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+	uint64_t result;
+	uint64_t i;
+
+	memset(&hist, 0x0, sizeof(struct histogram));
+
+	histogram_read(&hist, buckets, NULL);
+
+	if (histogram_quantile(buckets, 500) != 0)
+	{
+		fprintf(stderr, "Error: Quantile of an empty histogram is not 0\n");
+		return -EINVAL;
+	}
+
+	for (i = 1; i <= 1000; i++)
+	{
+		histogram_record(&hist, i);
+	}
+
+	histogram_read(&hist, buckets, NULL);
+
+	result = histogram_quantile(buckets, 500);
+	if (result < 500 || result > 500 + (500 >> HISTOGRAM_SUB_BITS))
+	{
+		fprintf(stderr, "Error: Median of 1..1000 estimated as %" PRIu64 "\n", result);
+		return -EINVAL;
+	}
+
+	result = histogram_quantile(buckets, 990);
+	if (result < 990 || result > 990 + (990 >> HISTOGRAM_SUB_BITS))
+	{
+		fprintf(stderr, "Error: 99th percentile of 1..1000 estimated as %" PRIu64 "\n", result);
+		return -EINVAL;
+	}
+
+	result = histogram_quantile(buckets, 0);
+	if (result != 1)
+	{
+		fprintf(stderr, "Error: Minimum of 1..1000 estimated as %" PRIu64 "\n", result);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void * worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct histogram *hist = (struct histogram *)th->func_ctx;
+	uint64_t i;
+
+	for (i = 0; i < TEST_HISTOGRAM_PER_WORKER; i++)
+	{
+		histogram_record(hist, i);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,191 @@
+/*!
+ * @file test_hold_map.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to the table of callsigns which slots are held for
+ */
+
+#include "hold_map.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/*!
+ * @brief Test that held slots are found until they are no longer held
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that held slots are found until they are no longer held
+ */
+static int test_hold_map_basic(void);
+
+/*!
+ * @brief Test that many slots sharing a few buckets are still found
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that many slots sharing a few buckets are still found
+ */
+static int test_hold_map_many(void);
+
+/*!
+ * @brief Main entry point for hold map tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_hold_map_basic();
+	ret |= test_hold_map_many();
+
+	return ret;
+}
+
+static int test_hold_map_basic(void)
+{
+	struct hold_map_handle hm;
+	int ret;
+
+	memset(&hm, 0x0, sizeof(struct hold_map_handle));
+	hm.size = 4;
+
+	ret = hold_map_init(&hm);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize hold map (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	hold_map_put(&hm, 0, "KM0H");
+	hold_map_put(&hm, 3, "K1RFD-L");
+	hold_map_put(&hm, 1, "AVERYLONGCALLSIGN");
+
+	if (hold_map_find(&hm, "KM0H") != 0 || hold_map_find(&hm, "K1RFD-L") != 3)
+	{
+		fprintf(stderr, "Error: Held slots were not found\n");
+		ret = -EINVAL;
+		goto test_hold_map_basic_exit;
+	}
+
+	if (hold_map_find(&hm, "AVERYLONGCALLSIGN") != -ENOENT || hold_map_find(&hm, "KD0JLT") != -ENOENT || hold_map_find(&hm, "") != -ENOENT)
+	{
+		fprintf(stderr, "Error: Slot was found for a callsign which should not be held\n");
+		ret = -EINVAL;
+		goto test_hold_map_basic_exit;
+	}
+
+	// Holding the slot for someone else replaces the old callsign
+	hold_map_put(&hm, 0, "KD0JLT");
+
+	if (hold_map_find(&hm, "KM0H") != -ENOENT || hold_map_find(&hm, "KD0JLT") != 0)
+	{
+		fprintf(stderr, "Error: Held callsign was not replaced\n");
+		ret = -EINVAL;
+		goto test_hold_map_basic_exit;
+	}
+
+	hold_map_del(&hm, 3);
+	hold_map_del(&hm, 2);
+
+	if (hold_map_find(&hm, "K1RFD-L") != -ENOENT || hold_map_find(&hm, "KD0JLT") != 0)
+	{
+		fprintf(stderr, "Error: Wrong slot stopped being held\n");
+		ret = -EINVAL;
+	}
+
+test_hold_map_basic_exit:
+	hold_map_free(&hm);
+
+	return ret;
+}
+
+static int test_hold_map_many(void)
+{
+	struct hold_map_handle hm;
+	char callsign[12];
+	uint32_t i;
+	int ret;
+
+	memset(&hm, 0x0, sizeof(struct hold_map_handle));
+	hm.size = 500;
+
+	ret = hold_map_init(&hm);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize hold map (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	for (i = 0; i < hm.size; i++)
+	{
+		snprintf(callsign, sizeof(callsign), "W%uAB", (unsigned)(i % 1000));
+		hold_map_put(&hm, i, callsign);
+	}
+
+	// Remove every other slot, so that entries are unlinked from the middle
+	// of their chains
+	for (i = 0; i < hm.size; i += 2)
+	{
+		hold_map_del(&hm, i);
+	}
+
+	for (i = 0; i < hm.size; i++)
+	{
+		snprintf(callsign, sizeof(callsign), "W%uAB", (unsigned)(i % 1000));
+
+		if (hold_map_find(&hm, callsign) != (i % 2 == 0 ? -ENOENT : (int)i))
+		{
+			fprintf(stderr, "Error: Wrong result looking up callsign '%s'\n", callsign);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	hold_map_free(&hm);
+
+	return ret;
+}
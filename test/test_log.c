@@ -0,0 +1,277 @@
+/*!
+ * @file test_log.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to logging infrastructure
+ */
+
+#include "log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Number of messages logged in the background writer test
+#define TEST_LOG_MESSAGES 2000
+
+/// Path of the log file written by the tests
+#define TEST_LOG_PATH "test_log.tmp"
+
+/*!
+ * @brief Main entry point for logging tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Count the lines in the test log file which match a pattern
+ *
+ * @param[in] seq_fmt Format with a single integer conversion which each
+ *            counted line must match
+ * @param[out] in_order Set to 0 if the matched sequence numbers decrease
+ * @param[out] dropped_lines Number of lines reporting dropped messages
+ *
+ * @returns Number of matching lines, or negative ERRNO value on failure
+ */
+static int count_lines(const char *seq_fmt, int *in_order, int *dropped_lines);
+
+/*!
+ * @brief Test that queued messages are written in order or counted as dropped
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that queued messages are written in order or counted as dropped
+ */
+static int test_log_async(void);
+
+/*!
+ * @brief Test that messages are written immediately without a writer thread
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that messages are written immediately without a writer thread
+ */
+static int test_log_sync(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_log_async();
+	ret |= test_log_sync();
+
+	remove(TEST_LOG_PATH);
+
+	return ret;
+}
+
+static int count_lines(const char *seq_fmt, int *in_order, int *dropped_lines)
+{
+	FILE *fp;
+	char line[256];
+	const char *msg;
+	int count = 0;
+	int last = -1;
+	int seq;
+
+	*in_order = 1;
+	*dropped_lines = 0;
+
+	fp = fopen(TEST_LOG_PATH, "r");
+	if (fp == NULL)
+	{
+		return -errno;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		// Skip the timestamp
+		msg = strstr(line, " : ");
+		msg = msg == NULL ? line : msg + 3;
+
+		if (sscanf(msg, seq_fmt, &seq) == 1)
+		{
+			if (seq <= last)
+			{
+				*in_order = 0;
+			}
+
+			last = seq;
+			count++;
+		}
+		else if (strncmp(msg, "Dropped ", 8) == 0)
+		{
+			(*dropped_lines)++;
+		}
+	}
+
+	fclose(fp);
+
+	return count;
+}
+
+static int test_log_async(void)
+{
+	struct log_handle log;
+	int dropped_lines;
+	int in_order;
+	int i;
+	int ret;
+
+	memset(&log, 0x0, sizeof(struct log_handle));
+	remove(TEST_LOG_PATH);
+
+	ret = log_init(&log);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize log (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = log_select_medium(&log, LOG_MEDIUM_FILE, TEST_LOG_PATH);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to open log file (%d): %s\n", -ret, strerror(-ret));
+		goto test_log_async_exit;
+	}
+
+	ret = log_start(&log);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to start log writer (%d): %s\n", -ret, strerror(-ret));
+		goto test_log_async_exit;
+	}
+
+	for (i = 0; i < TEST_LOG_MESSAGES; i++)
+	{
+		log_printf(&log, LOG_LEVEL_INFO, "async %d\n", i);
+		log_printf(&log, LOG_LEVEL_DEBUG, "hidden %d\n", i);
+	}
+
+	log_stop(&log);
+	log_close(&log);
+
+	ret = count_lines("async %d", &in_order, &dropped_lines);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to read log file (%d): %s\n", -ret, strerror(-ret));
+		goto test_log_async_exit;
+	}
+
+	if (!in_order)
+	{
+		fprintf(stderr, "Error: Queued messages were written out of order\n");
+		ret = -EINVAL;
+		goto test_log_async_exit;
+	}
+
+	if (ret + log_dropped(&log) != TEST_LOG_MESSAGES)
+	{
+		fprintf(stderr, "Error: Wrote %d and dropped %u of %d messages\n", ret, log_dropped(&log), TEST_LOG_MESSAGES);
+		ret = -EINVAL;
+		goto test_log_async_exit;
+	}
+
+	if ((log_dropped(&log) > 0) != (dropped_lines > 0))
+	{
+		fprintf(stderr, "Error: Dropped messages were not reported\n");
+		ret = -EINVAL;
+		goto test_log_async_exit;
+	}
+
+	ret = count_lines("hidden %d", &in_order, &dropped_lines);
+	if (ret != 0)
+	{
+		fprintf(stderr, "Error: Messages above the log level were written\n");
+		ret = -EINVAL;
+		goto test_log_async_exit;
+	}
+
+test_log_async_exit:
+	log_free(&log);
+
+	return ret;
+}
+
+static int test_log_sync(void)
+{
+	struct log_handle log;
+	int dropped_lines;
+	int in_order;
+	int ret;
+
+	memset(&log, 0x0, sizeof(struct log_handle));
+	remove(TEST_LOG_PATH);
+
+	ret = log_init(&log);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize log (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = log_select_medium(&log, LOG_MEDIUM_FILE, TEST_LOG_PATH);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to open log file (%d): %s\n", -ret, strerror(-ret));
+		goto test_log_sync_exit;
+	}
+
+	log_printf(&log, LOG_LEVEL_WARN, "sync %d\n", 1);
+
+	// The file is still open, so the message must already have been flushed
+	ret = count_lines("sync %d", &in_order, &dropped_lines);
+	if (ret != 1)
+	{
+		fprintf(stderr, "Error: Message was not written immediately\n");
+		ret = -EINVAL;
+		goto test_log_sync_exit;
+	}
+
+	ret = 0;
+
+test_log_sync_exit:
+	log_free(&log);
+
+	return ret;
+}
@@ -0,0 +1,379 @@
+/*!
+ * @file test_mutex.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to mutual exclusion objects
+ */
+
+#include "atomic.h"
+#include "mutex.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Number of worker threads used in the exclusion test
+#define TEST_MUTEX_WORKERS 4
+
+/// Number of times each worker locks the mutex in the exclusion test
+#define TEST_MUTEX_PER_WORKER 20000
+
+/// Every this many locks, a worker takes the exclusive lock instead
+#define TEST_MUTEX_WRITE_EVERY 8
+
+/*!
+ * @brief Context shared by the worker threads in the mutex tests
+ */
+struct test_mutex_ctx
+{
+	/// Mutex under test
+	struct mutex_handle mutex;
+
+	/// Condition variable used by the condition variable test
+	struct condvar_handle condvar;
+
+	/// Number of workers currently holding the shared lock
+	volatile uint32_t readers;
+
+	/// Number of workers currently holding the exclusive lock
+	volatile uint32_t writers;
+
+	/// Number of times the lock was held in conflicting modes at once
+	volatile uint32_t conflicts;
+
+	/// Counter which is only modified while holding the exclusive lock
+	uint32_t counter;
+
+	/// Set by the waiting thread once it is blocked on the condition variable
+	uint32_t waiting;
+
+	/// Set to release the waiting thread
+	uint32_t done;
+};
+
+/*!
+ * @brief Main entry point for mutex tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Test that the shared lock is available while the exclusive holder
+ *        waits on a condition variable
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the shared lock is available while the exclusive holder
+ *       waits on a condition variable
+ */
+static int test_mutex_condvar(void);
+
+/*!
+ * @brief Test that the exclusive lock is never held alongside any other lock
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the exclusive lock is never held alongside any other lock
+ */
+static int test_mutex_exclusion(void);
+
+/*!
+ * @brief Worker thread which waits on the condition variable until released
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * waiter(void *ctx);
+
+/*!
+ * @brief Worker thread which repeatedly takes shared and exclusive locks
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * worker(void *ctx);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_mutex_condvar();
+	ret |= test_mutex_exclusion();
+
+	return ret;
+}
+
+static void * waiter(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct test_mutex_ctx *tc = (struct test_mutex_ctx *)th->func_ctx;
+
+	mutex_lock(&tc->mutex);
+
+	tc->waiting = 1;
+
+	while (!tc->done)
+	{
+		condvar_wait(&tc->condvar, &tc->mutex);
+	}
+
+	// The shared lock must have been released again before waking
+	if (atomic_u32_load(&tc->readers) != 0)
+	{
+		atomic_u32_add(&tc->conflicts, 1);
+	}
+
+	mutex_unlock(&tc->mutex);
+
+	return NULL;
+}
+
+static void * worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct test_mutex_ctx *tc = (struct test_mutex_ctx *)th->func_ctx;
+	int i;
+
+	for (i = 0; i < TEST_MUTEX_PER_WORKER; i++)
+	{
+		if (i % TEST_MUTEX_WRITE_EVERY == 0)
+		{
+			mutex_lock(&tc->mutex);
+
+			if (atomic_u32_add(&tc->writers, 1) != 0 || atomic_u32_load(&tc->readers) != 0)
+			{
+				atomic_u32_add(&tc->conflicts, 1);
+			}
+
+			tc->counter++;
+
+			atomic_u32_add(&tc->writers, (uint32_t)-1);
+
+			mutex_unlock(&tc->mutex);
+		}
+		else
+		{
+			mutex_lock_shared(&tc->mutex);
+
+			atomic_u32_add(&tc->readers, 1);
+
+			if (atomic_u32_load(&tc->writers) != 0)
+			{
+				atomic_u32_add(&tc->conflicts, 1);
+			}
+
+			if (i % 16 == 1)
+			{
+				thread_yield();
+			}
+
+			atomic_u32_add(&tc->readers, (uint32_t)-1);
+
+			mutex_unlock_shared(&tc->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static int test_mutex_condvar(void)
+{
+	struct thread_handle th;
+	struct test_mutex_ctx tc;
+	uint32_t waiting = 0;
+	int ret;
+
+	memset(&th, 0x0, sizeof(struct thread_handle));
+	memset(&tc, 0x0, sizeof(struct test_mutex_ctx));
+
+	ret = mutex_init(&tc.mutex);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize mutex (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = condvar_init(&tc.condvar);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize condition variable (%d): %s\n", -ret, strerror(-ret));
+		goto test_mutex_condvar_exit;
+	}
+
+	ret = thread_init(&th);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize waiting thread (%d): %s\n", -ret, strerror(-ret));
+		goto test_mutex_condvar_exit_condvar;
+	}
+
+	th.func_ptr = waiter;
+	th.func_ctx = &tc;
+
+	ret = thread_start(&th);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to start waiting thread (%d): %s\n", -ret, strerror(-ret));
+		goto test_mutex_condvar_exit_thread;
+	}
+
+	while (!waiting)
+	{
+		mutex_lock(&tc.mutex);
+		waiting = tc.waiting;
+		mutex_unlock(&tc.mutex);
+
+		thread_yield();
+	}
+
+	// The waiting thread still owns the exclusive lock, but has released it
+	// for the duration of the wait
+	ret = mutex_lock_shared(&tc.mutex);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to take the shared lock (%d): %s\n", -ret, strerror(-ret));
+	}
+	else
+	{
+		atomic_u32_add(&tc.readers, 1);
+		thread_yield();
+		atomic_u32_add(&tc.readers, (uint32_t)-1);
+
+		mutex_unlock_shared(&tc.mutex);
+	}
+
+	mutex_lock(&tc.mutex);
+	tc.done = 1;
+	condvar_wake_all(&tc.condvar);
+	mutex_unlock(&tc.mutex);
+
+	thread_join(&th);
+
+	if (ret == 0 && tc.conflicts != 0)
+	{
+		fprintf(stderr, "Error: Waiting thread woke while the shared lock was held\n");
+		ret = -EINVAL;
+	}
+
+test_mutex_condvar_exit_thread:
+	thread_free(&th);
+test_mutex_condvar_exit_condvar:
+	condvar_free(&tc.condvar);
+test_mutex_condvar_exit:
+	mutex_free(&tc.mutex);
+
+	return ret;
+}
+
+static int test_mutex_exclusion(void)
+{
+	struct thread_handle threads[TEST_MUTEX_WORKERS];
+	struct test_mutex_ctx tc;
+	int started;
+	int i;
+	int ret;
+
+	memset(threads, 0x0, sizeof(threads));
+	memset(&tc, 0x0, sizeof(struct test_mutex_ctx));
+
+	ret = mutex_init(&tc.mutex);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize mutex (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	for (started = 0; started < TEST_MUTEX_WORKERS; started++)
+	{
+		ret = thread_init(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to initialize worker thread (%d): %s\n", -ret, strerror(-ret));
+			break;
+		}
+
+		threads[started].func_ptr = worker;
+		threads[started].func_ctx = &tc;
+
+		ret = thread_start(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to start worker thread (%d): %s\n", -ret, strerror(-ret));
+			thread_free(&threads[started]);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		thread_join(&threads[i]);
+		thread_free(&threads[i]);
+	}
+
+	if (ret < 0)
+	{
+		goto test_mutex_exclusion_exit;
+	}
+
+	if (tc.conflicts != 0)
+	{
+		fprintf(stderr, "Error: The lock was held in conflicting modes %u times\n", tc.conflicts);
+		ret = -EINVAL;
+		goto test_mutex_exclusion_exit;
+	}
+
+	if (tc.counter != TEST_MUTEX_WORKERS * (TEST_MUTEX_PER_WORKER / TEST_MUTEX_WRITE_EVERY))
+	{
+		fprintf(stderr, "Error: Exclusive counter is %u after the workers finished\n", tc.counter);
+		ret = -EINVAL;
+	}
+
+test_mutex_exclusion_exit:
+	mutex_free(&tc.mutex);
+
+	return ret;
+}
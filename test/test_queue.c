@@ -0,0 +1,559 @@
+/*!
+ * @file test_queue.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to bounded lock-free queues
+ */
+
+#include "queue.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Number of producer threads used in the concurrency test
+#define TEST_QUEUE_PRODUCERS 4
+
+/// Number of elements committed by each producer in the concurrency test
+#define TEST_QUEUE_PER_PRODUCER 20000
+
+/*!
+ * @brief Element type used in the concurrency test
+ */
+struct test_queue_elem
+{
+	/// Index of the producer which committed the element
+	uint32_t producer;
+
+	/// Sequence number of the element, per producer
+	uint32_t seq;
+};
+
+/*!
+ * @brief Context for a producer thread in the concurrency test
+ */
+struct test_queue_producer
+{
+	/// Queue to commit elements to
+	struct queue_handle *queue;
+
+	/// Index of this producer
+	uint32_t index;
+};
+
+/*!
+ * @brief Main entry point for queue tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Worker thread which commits a sequence of elements to a queue
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * producer(void *ctx);
+
+/*!
+ * @brief Test that a full queue rejects reservations until space is released
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a full queue rejects reservations until space is released
+ */
+static int test_queue_full(void);
+
+/*!
+ * @brief Test that invalid queue dimensions are rejected
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that invalid queue dimensions are rejected
+ */
+static int test_queue_invalid(void);
+
+/*!
+ * @brief Test that elements are consumed in order across many laps
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that elements are consumed in order across many laps
+ */
+static int test_queue_order(void);
+
+/*!
+ * @brief Test that the consumer can look past the oldest element
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the consumer can look past the oldest element
+ */
+static int test_queue_peek_at(void);
+
+/*!
+ * @brief Test that concurrent producers lose and duplicate no elements
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that concurrent producers lose and duplicate no elements
+ */
+static int test_queue_producers(void);
+
+/*!
+ * @brief Test that an uncommitted element blocks the elements after it
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that an uncommitted element blocks the elements after it
+ */
+static int test_queue_uncommitted(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_queue_full();
+	ret |= test_queue_invalid();
+	ret |= test_queue_order();
+	ret |= test_queue_peek_at();
+	ret |= test_queue_producers();
+	ret |= test_queue_uncommitted();
+
+	return ret;
+}
+
+static void * producer(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	struct test_queue_producer *tp = (struct test_queue_producer *)th->func_ctx;
+	struct test_queue_elem *elem;
+	uint32_t i;
+
+	for (i = 0; i < TEST_QUEUE_PER_PRODUCER; i++)
+	{
+		while ((elem = queue_reserve(tp->queue)) == NULL)
+		{
+			thread_yield();
+		}
+
+		elem->producer = tp->index;
+		elem->seq = i;
+
+		queue_commit(tp->queue, elem);
+	}
+
+	return NULL;
+}
+
+static int test_queue_full(void)
+{
+	struct queue_handle queue;
+	void *elems[4];
+	void *elem;
+	int i;
+	int ret;
+
+	memset(&queue, 0x0, sizeof(struct queue_handle));
+	queue.capacity = 4;
+	queue.elem_size = 1;
+
+	ret = queue_init(&queue);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize queue (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		elems[i] = queue_reserve(&queue);
+		if (elems[i] == NULL)
+		{
+			fprintf(stderr, "Error: Failed to reserve element %d of 4\n", i);
+			ret = -EINVAL;
+			goto test_queue_full_exit;
+		}
+
+		queue_commit(&queue, elems[i]);
+	}
+
+	if (queue_reserve(&queue) != NULL || queue_count(&queue) != 4)
+	{
+		fprintf(stderr, "Error: Full queue accepted another element\n");
+		ret = -EINVAL;
+		goto test_queue_full_exit;
+	}
+
+	elem = queue_peek(&queue);
+	if (elem != elems[0])
+	{
+		fprintf(stderr, "Error: Full queue returned the wrong element\n");
+		ret = -EINVAL;
+		goto test_queue_full_exit;
+	}
+
+	queue_release(&queue, elem);
+
+	if (queue_reserve(&queue) != elems[0])
+	{
+		fprintf(stderr, "Error: Released element was not reused\n");
+		ret = -EINVAL;
+		goto test_queue_full_exit;
+	}
+
+test_queue_full_exit:
+	queue_free(&queue);
+
+	return ret;
+}
+
+static int test_queue_invalid(void)
+{
+	struct queue_handle queue;
+	const size_t capacities[] = { 0, 1, 3, 12 };
+	size_t i;
+	int ret;
+
+	memset(&queue, 0x0, sizeof(struct queue_handle));
+	queue.elem_size = 8;
+
+	for (i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++)
+	{
+		queue.capacity = capacities[i];
+
+		ret = queue_init(&queue);
+		if (ret != -EINVAL)
+		{
+			fprintf(stderr, "Error: Queue capacity of %zu was not rejected\n", capacities[i]);
+			queue_free(&queue);
+			return -EINVAL;
+		}
+	}
+
+	queue.capacity = 8;
+	queue.elem_size = 0;
+
+	ret = queue_init(&queue);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Queue element size of 0 was not rejected\n");
+		queue_free(&queue);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_queue_order(void)
+{
+	struct queue_handle queue;
+	uint32_t next_in = 0;
+	uint32_t next_out = 0;
+	uint32_t *elem;
+	int ret = 0;
+
+	memset(&queue, 0x0, sizeof(struct queue_handle));
+	queue.capacity = 8;
+	queue.elem_size = sizeof(uint32_t);
+
+	ret = queue_init(&queue);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize queue (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	// Alternate between adding three elements and removing two
+	while (next_out < 1000)
+	{
+		int i;
+
+		for (i = 0; i < 3 && (elem = queue_reserve(&queue)) != NULL; i++)
+		{
+			*elem = next_in++;
+			queue_commit(&queue, elem);
+		}
+
+		for (i = 0; i < 2 && (elem = queue_peek(&queue)) != NULL; i++)
+		{
+			if (*elem != next_out)
+			{
+				fprintf(stderr, "Error: Expected element %u but got %u\n", next_out, *elem);
+				ret = -EINVAL;
+				goto test_queue_order_exit;
+			}
+
+			next_out++;
+			queue_release(&queue, elem);
+		}
+	}
+
+test_queue_order_exit:
+	queue_free(&queue);
+
+	return ret;
+}
+
+static int test_queue_peek_at(void)
+{
+	struct queue_handle queue;
+	uint32_t *elem;
+	uint32_t i;
+	int ret = 0;
+
+	memset(&queue, 0x0, sizeof(struct queue_handle));
+	queue.capacity = 4;
+	queue.elem_size = sizeof(uint32_t);
+
+	ret = queue_init(&queue);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize queue (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	// Start part of the way around the ring so that the peeks wrap
+	for (i = 0; i < 3; i++)
+	{
+		elem = queue_reserve(&queue);
+		queue_commit(&queue, elem);
+		queue_release(&queue, queue_peek(&queue));
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		elem = queue_reserve(&queue);
+		*elem = i;
+		queue_commit(&queue, elem);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		elem = queue_peek_at(&queue, i);
+		if (elem == NULL || *elem != i)
+		{
+			fprintf(stderr, "Error: Expected element %u at index %u\n", i, i);
+			ret = -EINVAL;
+			goto test_queue_peek_at_exit;
+		}
+	}
+
+	if (queue_peek_at(&queue, 3) != NULL || queue_peek_at(&queue, 4) != NULL)
+	{
+		fprintf(stderr, "Error: Got an element past the end of the queue\n");
+		ret = -EINVAL;
+		goto test_queue_peek_at_exit;
+	}
+
+	queue_release(&queue, queue_peek(&queue));
+
+	elem = queue_peek_at(&queue, 1);
+	if (elem == NULL || *elem != 2)
+	{
+		fprintf(stderr, "Error: Expected element 2 after a release\n");
+		ret = -EINVAL;
+		goto test_queue_peek_at_exit;
+	}
+
+test_queue_peek_at_exit:
+	queue_free(&queue);
+
+	return ret;
+}
+
+static int test_queue_producers(void)
+{
+	struct queue_handle queue;
+	struct thread_handle threads[TEST_QUEUE_PRODUCERS];
+	struct test_queue_producer producers[TEST_QUEUE_PRODUCERS];
+	uint32_t next_seq[TEST_QUEUE_PRODUCERS] = { 0 };
+	struct test_queue_elem *elem;
+	uint32_t received = 0;
+	int started = 0;
+	int i;
+	int ret;
+
+	memset(&queue, 0x0, sizeof(struct queue_handle));
+	memset(threads, 0x0, sizeof(threads));
+	queue.capacity = 64;
+	queue.elem_size = sizeof(struct test_queue_elem);
+
+	ret = queue_init(&queue);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize queue (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	for (started = 0; started < TEST_QUEUE_PRODUCERS; started++)
+	{
+		producers[started].queue = &queue;
+		producers[started].index = started;
+
+		ret = thread_init(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to initialize producer thread (%d): %s\n", -ret, strerror(-ret));
+			goto test_queue_producers_exit;
+		}
+
+		threads[started].func_ptr = producer;
+		threads[started].func_ctx = &producers[started];
+
+		ret = thread_start(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to start producer thread (%d): %s\n", -ret, strerror(-ret));
+			thread_free(&threads[started]);
+			goto test_queue_producers_exit;
+		}
+	}
+
+	while (received < TEST_QUEUE_PRODUCERS * TEST_QUEUE_PER_PRODUCER)
+	{
+		elem = queue_peek(&queue);
+		if (elem == NULL)
+		{
+			thread_yield();
+			continue;
+		}
+
+		// Each producer's elements must arrive in the order they were committed
+		if (elem->producer >= TEST_QUEUE_PRODUCERS || elem->seq != next_seq[elem->producer])
+		{
+			fprintf(stderr, "Error: Unexpected element %u from producer %u\n", elem->seq, elem->producer);
+			ret = -EINVAL;
+			goto test_queue_producers_exit;
+		}
+
+		next_seq[elem->producer]++;
+		received++;
+
+		queue_release(&queue, elem);
+	}
+
+	if (queue_peek(&queue) != NULL || queue_count(&queue) != 0)
+	{
+		fprintf(stderr, "Error: Queue is not empty after receiving every element\n");
+		ret = -EINVAL;
+	}
+
+test_queue_producers_exit:
+	// Keep draining so that the producers can finish
+	while (received < (uint32_t)started * TEST_QUEUE_PER_PRODUCER)
+	{
+		elem = queue_peek(&queue);
+		if (elem == NULL)
+		{
+			thread_yield();
+			continue;
+		}
+
+		received++;
+		queue_release(&queue, elem);
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		thread_join(&threads[i]);
+		thread_free(&threads[i]);
+	}
+
+	queue_free(&queue);
+
+	return ret;
+}
+
+static int test_queue_uncommitted(void)
+{
+	struct queue_handle queue;
+	void *first;
+	void *second;
+	int ret;
+
+	memset(&queue, 0x0, sizeof(struct queue_handle));
+	queue.capacity = 4;
+	queue.elem_size = 1;
+
+	ret = queue_init(&queue);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize queue (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	first = queue_reserve(&queue);
+	second = queue_reserve(&queue);
+	if (first == NULL || second == NULL)
+	{
+		fprintf(stderr, "Error: Failed to reserve elements\n");
+		ret = -EINVAL;
+		goto test_queue_uncommitted_exit;
+	}
+
+	queue_commit(&queue, second);
+
+	if (queue_peek(&queue) != NULL)
+	{
+		fprintf(stderr, "Error: Consumer passed an uncommitted element\n");
+		ret = -EINVAL;
+		goto test_queue_uncommitted_exit;
+	}
+
+	queue_commit(&queue, first);
+
+	if (queue_peek(&queue) != first)
+	{
+		fprintf(stderr, "Error: Consumer did not return the first element\n");
+		ret = -EINVAL;
+	}
+
+test_queue_uncommitted_exit:
+	queue_free(&queue);
+
+	return ret;
+}
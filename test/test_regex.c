@@ -95,6 +95,60 @@ static int test_regex_catchall_empty(void);
  */
 static int test_regex_exact_match(void);
 
+/*!
+ * @brief Test regular expression anchored alternation of literals
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test regular expression anchored alternation of literals
+ */
+static int test_regex_literal_set(void);
+
+/*!
+ * @brief Test regular expression anchored alternation of literals not matching
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test regular expression anchored alternation of literals not matching
+ */
+static int test_regex_literal_set_no_match(void);
+
+/*!
+ * @brief Test regular expression anchored alternation of literals matching to a superstring
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test regular expression anchored alternation of literals matching to a superstring
+ */
+static int test_regex_literal_set_superstring(void);
+
+/*!
+ * @brief Test regular expression separately anchored literals
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test regular expression separately anchored literals
+ */
+static int test_regex_literal_set_separate(void);
+
+/*!
+ * @brief Test regular expression anchored alternation of literals with different case
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test regular expression anchored alternation of literals with different case
+ */
+static int test_regex_literal_set_case(void);
+
+/*!
+ * @brief Test regular expression anchored alternation which is not all literals
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test regular expression anchored alternation which is not all literals
+ */
+static int test_regex_literal_set_fallback(void);
+
 /*!
  * @brief Test regular expression negative match case
  *
@@ -202,6 +256,12 @@ int main(void)
 	ret |= test_regex_catchall();
 	ret |= test_regex_catchall_empty();
 	ret |= test_regex_exact_match();
+	ret |= test_regex_literal_set();
+	ret |= test_regex_literal_set_no_match();
+	ret |= test_regex_literal_set_superstring();
+	ret |= test_regex_literal_set_separate();
+	ret |= test_regex_literal_set_case();
+	ret |= test_regex_literal_set_fallback();
 	ret |= test_regex_no_match();
 	ret |= test_regex_or_exact();
 	ret |= test_regex_or_first();
@@ -228,6 +288,36 @@ static int test_regex_exact_match(void)
 	return assert_match("KM0H", "KM0H", 1);
 }
 
+static int test_regex_literal_set(void)
+{
+	return assert_match("^(KM0H|KD0JLT|K1RFD-L)$", "K1RFD-L", 1);
+}
+
+static int test_regex_literal_set_no_match(void)
+{
+	return assert_match("^(KM0H|KD0JLT|K1RFD-L)$", "K1RFD", 0);
+}
+
+static int test_regex_literal_set_superstring(void)
+{
+	return assert_match("^(?:KM0H|KD0JLT)$", "KKM0H", 0);
+}
+
+static int test_regex_literal_set_separate(void)
+{
+	return assert_match("^KM0H$|^KD0JLT$", "KD0JLT", 1);
+}
+
+static int test_regex_literal_set_case(void)
+{
+	return assert_match("^(KM0H|KD0JLT)$", "km0h", 0);
+}
+
+static int test_regex_literal_set_fallback(void)
+{
+	return assert_match("^(KM0H|.*-L)$", "AK8V-L", 1);
+}
+
 static int test_regex_no_match(void)
 {
 	return assert_match("asdf", "KM0H", 0);
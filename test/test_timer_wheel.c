@@ -0,0 +1,310 @@
+/*!
+ * @file test_timer_wheel.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to hierarchical timer wheels
+ */
+
+#include "timer_wheel.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Tick at which the wheels in these tests start
+#define TEST_TIMER_WHEEL_START 1000
+
+/*!
+ * @brief Record of a timer's expirations in a test
+ */
+struct test_timer
+{
+	/// Timer being tested
+	struct timer_wheel_entry entry;
+
+	/// Tick at which the timer is expected to expire
+	uint64_t expires;
+
+	/// Tick passed to the callback when the timer last expired
+	uint64_t fired;
+
+	/// Number of times the timer has expired
+	unsigned int count;
+
+	/// Number of ticks after expiring to schedule the timer again, or 0
+	uint64_t interval;
+};
+
+/*!
+ * @brief Main entry point for timer wheel tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Callback which records the expiration of a ::test_timer
+ *
+ * @param[in,out] wh Timer wheel the timer expired on
+ * @param[in,out] entry Timer which expired
+ * @param[in] now Tick the wheel was advanced to
+ *
+ * @returns Tick at which to expire the timer again, or 0
+ */
+static uint64_t timer_fired(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t now);
+
+/*!
+ * @brief Test that timers expire exactly at their ticks on every level
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that timers expire exactly at their ticks on every level
+ */
+static int test_timer_wheel_expiry(void);
+
+/*!
+ * @brief Test that a wheel without a callback is rejected
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a wheel without a callback is rejected
+ */
+static int test_timer_wheel_invalid(void);
+
+/*!
+ * @brief Test that timers can be rescheduled, repeated and canceled
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that timers can be rescheduled, repeated and canceled
+ */
+static int test_timer_wheel_reschedule(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_timer_wheel_expiry();
+	ret |= test_timer_wheel_invalid();
+	ret |= test_timer_wheel_reschedule();
+
+	return ret;
+}
+
+static uint64_t timer_fired(struct timer_wheel_handle *wh, struct timer_wheel_entry *entry, uint64_t now)
+{
+	struct test_timer *timer = (struct test_timer *)entry->ctx;
+
+	(void)wh;
+
+	timer->fired = now;
+	timer->count++;
+
+	return timer->interval != 0 ? now + timer->interval : 0;
+}
+
+static int test_timer_wheel_expiry(void)
+{
+	// Distances from the start which exercise each level and its edges,
+	// including one beyond the reach of the top level
+	static const uint64_t deltas[] = { 0, 1, 2, 63, 64, 65, 127, 4095, 4096, 4097, 262143, 262144, 300000, 16777215, 16777216, 40000000 };
+	struct test_timer timers[sizeof(deltas) / sizeof(deltas[0])];
+	struct timer_wheel_handle wh;
+	unsigned int expired;
+	size_t i;
+	size_t j;
+	int ret;
+
+	memset(&wh, 0x0, sizeof(struct timer_wheel_handle));
+	memset(timers, 0x0, sizeof(timers));
+	wh.start = TEST_TIMER_WHEEL_START;
+	wh.func_ptr = timer_fired;
+
+	ret = timer_wheel_init(&wh);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize timer wheel (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	// Schedule in reverse so that slots hold more than one timer at times
+	for (i = sizeof(deltas) / sizeof(deltas[0]); i > 0; i--)
+	{
+		timers[i - 1].expires = TEST_TIMER_WHEEL_START + deltas[i - 1];
+		timers[i - 1].entry.ctx = &timers[i - 1];
+		timer_wheel_add(&wh, &timers[i - 1].entry, timers[i - 1].expires);
+	}
+
+	for (i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++)
+	{
+		if (timers[i].expires > TEST_TIMER_WHEEL_START)
+		{
+			expired = timer_wheel_advance(&wh, timers[i].expires - 1);
+			if (expired != 0)
+			{
+				fprintf(stderr, "Error: %u timers expired before tick %llu\n", expired, (unsigned long long)timers[i].expires);
+				ret = -EINVAL;
+				goto test_timer_wheel_expiry_exit;
+			}
+		}
+
+		expired = timer_wheel_advance(&wh, timers[i].expires);
+		if (expired != 1 || timers[i].count != 1 || timers[i].fired != timers[i].expires)
+		{
+			fprintf(stderr, "Error: Timer for tick %llu expired %u times at tick %llu\n", (unsigned long long)timers[i].expires, timers[i].count, (unsigned long long)timers[i].fired);
+			ret = -EINVAL;
+			goto test_timer_wheel_expiry_exit;
+		}
+
+		for (j = i + 1; j < sizeof(deltas) / sizeof(deltas[0]); j++)
+		{
+			if (timers[j].count != 0)
+			{
+				fprintf(stderr, "Error: Timer for tick %llu expired early\n", (unsigned long long)timers[j].expires);
+				ret = -EINVAL;
+				goto test_timer_wheel_expiry_exit;
+			}
+		}
+	}
+
+test_timer_wheel_expiry_exit:
+	timer_wheel_free(&wh);
+
+	return ret;
+}
+
+static int test_timer_wheel_invalid(void)
+{
+	struct timer_wheel_handle wh;
+	int ret;
+
+	memset(&wh, 0x0, sizeof(struct timer_wheel_handle));
+
+	ret = timer_wheel_init(&wh);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Timer wheel without a callback was not rejected (%d)\n", ret);
+		timer_wheel_free(&wh);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_timer_wheel_reschedule(void)
+{
+	struct timer_wheel_handle wh;
+	struct test_timer repeating;
+	struct test_timer moved;
+	struct test_timer canceled;
+	uint64_t now;
+	int ret;
+
+	memset(&wh, 0x0, sizeof(struct timer_wheel_handle));
+	memset(&repeating, 0x0, sizeof(struct test_timer));
+	memset(&moved, 0x0, sizeof(struct test_timer));
+	memset(&canceled, 0x0, sizeof(struct test_timer));
+	wh.start = TEST_TIMER_WHEEL_START;
+	wh.func_ptr = timer_fired;
+
+	ret = timer_wheel_init(&wh);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize timer wheel (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	repeating.entry.ctx = &repeating;
+	repeating.interval = 100;
+	timer_wheel_add(&wh, &repeating.entry, TEST_TIMER_WHEEL_START + 100);
+
+	moved.entry.ctx = &moved;
+	timer_wheel_add(&wh, &moved.entry, TEST_TIMER_WHEEL_START + 5000);
+	timer_wheel_add(&wh, &moved.entry, TEST_TIMER_WHEEL_START + 50);
+
+	canceled.entry.ctx = &canceled;
+	timer_wheel_add(&wh, &canceled.entry, TEST_TIMER_WHEEL_START + 70);
+	timer_wheel_remove(&wh, &canceled.entry);
+
+	// Advance one tick at a time, as a periodic caller would
+	for (now = TEST_TIMER_WHEEL_START; now <= TEST_TIMER_WHEEL_START + 10000; now++)
+	{
+		timer_wheel_advance(&wh, now);
+	}
+
+	if (repeating.count != 100 || repeating.fired != TEST_TIMER_WHEEL_START + 10000)
+	{
+		fprintf(stderr, "Error: Repeating timer expired %u times, last at tick %llu\n", repeating.count, (unsigned long long)repeating.fired);
+		ret = -EINVAL;
+		goto test_timer_wheel_reschedule_exit;
+	}
+
+	if (moved.count != 1 || moved.fired != TEST_TIMER_WHEEL_START + 50)
+	{
+		fprintf(stderr, "Error: Rescheduled timer expired %u times, last at tick %llu\n", moved.count, (unsigned long long)moved.fired);
+		ret = -EINVAL;
+		goto test_timer_wheel_reschedule_exit;
+	}
+
+	if (canceled.count != 0)
+	{
+		fprintf(stderr, "Error: Canceled timer expired %u times\n", canceled.count);
+		ret = -EINVAL;
+		goto test_timer_wheel_reschedule_exit;
+	}
+
+	// A timer scheduled in the past expires on the next advance
+	timer_wheel_remove(&wh, &repeating.entry);
+	timer_wheel_add(&wh, &moved.entry, TEST_TIMER_WHEEL_START);
+	if (timer_wheel_advance(&wh, now) != 1 || moved.count != 2)
+	{
+		fprintf(stderr, "Error: Timer scheduled in the past did not expire\n");
+		ret = -EINVAL;
+		goto test_timer_wheel_reschedule_exit;
+	}
+
+test_timer_wheel_reschedule_exit:
+	timer_wheel_free(&wh);
+
+	return ret;
+}
@@ -0,0 +1,470 @@
+/*!
+ * @file test_trace.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to lock-free packet trace rings
+ */
+
+#include "openelp/openelp.h"
+#include "proxy_conn.h"
+#include "thread.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Path of the capture file written by the tests
+#define TEST_TRACE_PATH "test_trace.tmp"
+
+/// Number of worker threads used in the concurrency test
+#define TEST_TRACE_WORKERS 4
+
+/// Number of packets recorded by each worker in the concurrency test
+#define TEST_TRACE_PER_WORKER 50000
+
+/// Ring shared by the workers in the concurrency test
+static struct trace_ring shared_ring;
+
+/*!
+ * @brief Main entry point for trace ring tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Test that concurrent recording never yields a torn packet
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that concurrent recording never yields a torn packet
+ */
+static int test_trace_concurrent(void);
+
+/*!
+ * @brief Test that a capture file holds the IPv4 packets which were traced
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a capture file holds the IPv4 packets which were traced
+ */
+static int test_trace_dump(void);
+
+/*!
+ * @brief Test that the ring keeps the most recent packets in order
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the ring keeps the most recent packets in order
+ */
+static int test_trace_ring(void);
+
+/*!
+ * @brief Worker thread which repeatedly records packets
+ *
+ * @param[in,out] ctx Worker thread context
+ *
+ * @returns Always NULL
+ */
+static void * worker(void *ctx);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_trace_concurrent();
+	ret |= test_trace_dump();
+	ret |= test_trace_ring();
+
+	return ret;
+}
+
+static int test_trace_concurrent(void)
+{
+	static struct trace_record recs[TRACE_RING_LEN];
+	struct thread_handle threads[TEST_TRACE_WORKERS];
+	uint32_t ids[TEST_TRACE_WORKERS];
+	size_t count;
+	size_t i;
+	size_t j;
+	int started;
+	int ret = 0;
+
+	memset(&shared_ring, 0x0, sizeof(struct trace_ring));
+	memset(threads, 0x0, sizeof(threads));
+
+	for (started = 0; started < TEST_TRACE_WORKERS; started++)
+	{
+		ids[started] = started;
+
+		ret = thread_init(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to initialize worker thread (%d): %s\n", -ret, strerror(-ret));
+			break;
+		}
+
+		threads[started].func_ptr = worker;
+		threads[started].func_ctx = &ids[started];
+
+		ret = thread_start(&threads[started]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to start worker thread (%d): %s\n", -ret, strerror(-ret));
+			thread_free(&threads[started]);
+			break;
+		}
+	}
+
+	// Every packet read while the workers are recording must be whole
+	while (ret == 0 && started > 0 && atomic_u64_load(&shared_ring.head) < (uint64_t)started * TEST_TRACE_PER_WORKER)
+	{
+		count = trace_read(&shared_ring, recs, TRACE_RING_LEN);
+
+		for (i = 0; ret == 0 && i < count; i++)
+		{
+			if (recs[i].addr != (uint32_t)recs[i].stamp || recs[i].len != recs[i].addr % 1000 || recs[i].snap_len != (recs[i].len < TRACE_SNAP_MAX ? recs[i].len : TRACE_SNAP_MAX))
+			{
+				fprintf(stderr, "Error: Read a torn packet header\n");
+				ret = -EINVAL;
+			}
+
+			for (j = 0; ret == 0 && j < recs[i].snap_len; j++)
+			{
+				if (recs[i].data[j] != (uint8_t)recs[i].addr)
+				{
+					fprintf(stderr, "Error: Read a torn packet payload\n");
+					ret = -EINVAL;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < (size_t)started; i++)
+	{
+		thread_join(&threads[i]);
+		thread_free(&threads[i]);
+	}
+
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	if (shared_ring.head != (uint64_t)TEST_TRACE_WORKERS * TEST_TRACE_PER_WORKER)
+	{
+		fprintf(stderr, "Error: Expected %d packets to be recorded but got %" PRIu64 "\n", TEST_TRACE_WORKERS * TEST_TRACE_PER_WORKER, shared_ring.head);
+		return -EINVAL;
+	}
+
+	// Once the workers are done, the whole ring is readable
+	if (trace_read(&shared_ring, recs, TRACE_RING_LEN) != TRACE_RING_LEN)
+	{
+		fprintf(stderr, "Error: Packets are missing from the ring after recording stopped\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_trace_dump(void)
+{
+	static struct trace_ring ring;
+	static const uint8_t payload[100] = { 0x80, 0x03 };
+	struct trace_source source;
+	uint8_t *buff = NULL;
+	uint8_t *block;
+	uint8_t *pkt;
+	uint32_t block_len;
+	uint32_t cap_len;
+	uint32_t orig_len;
+	uint32_t sum;
+	uint32_t remote;
+	uint32_t val;
+	long file_len;
+	size_t off;
+	size_t i;
+	int packets = 0;
+	FILE *fp;
+	int ret;
+
+	memset(&ring, 0x0, sizeof(struct trace_ring));
+
+	// 10.0.0.1, in network byte order
+	memcpy(&remote, "\x0A\x00\x00\x01", 4);
+
+	trace_record(&ring, 1, TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_UDP_DATA, 0, remote, payload, sizeof(payload), 12);
+	trace_record(&ring, 2, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_UDP_CONTROL, TRACE_FLAG_FAILED, remote, payload, 20, 12);
+	trace_record(&ring, 3, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_TCP_OPEN, 0, remote, NULL, 0, 12);
+	trace_record(&ring, 4, TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_TCP_STATUS, 0, remote, payload, 4, 12);
+	trace_record(&ring, 5, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_TCP_DATA, 0, remote, payload, 5, 12);
+	trace_record(&ring, 6, TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_TCP_CLOSE, 0, remote, NULL, 0, 12);
+
+	source.ring = &ring;
+	source.name = "slot0";
+	source.local_addr = "192.0.2.1";
+
+	remove(TEST_TRACE_PATH);
+
+	ret = trace_dump(TEST_TRACE_PATH, &source, 1);
+	if (ret != 6)
+	{
+		fprintf(stderr, "Error: Expected 6 packets to be written but got %d\n", ret);
+		return ret < 0 ? ret : -EINVAL;
+	}
+
+	ret = 0;
+
+	fp = fopen(TEST_TRACE_PATH, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error: Failed to open the capture file\n");
+		return -errno;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	file_len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	buff = malloc(file_len > 0 ? (size_t)file_len : 1);
+	if (buff == NULL || file_len < 28 || fread(buff, (size_t)file_len, 1, fp) != 1)
+	{
+		fprintf(stderr, "Error: Failed to read the capture file\n");
+		ret = -EIO;
+		goto test_trace_dump_exit;
+	}
+
+	memcpy(&val, &buff[0], 4);
+	memcpy(&block_len, &buff[8], 4);
+	if (val != 0x0A0D0D0A || block_len != 0x1A2B3C4D)
+	{
+		fprintf(stderr, "Error: The capture file does not start with a section header\n");
+		ret = -EINVAL;
+		goto test_trace_dump_exit;
+	}
+
+	for (off = 0; ret == 0 && off + 12 <= (size_t)file_len; off += block_len)
+	{
+		block = &buff[off];
+		memcpy(&val, &block[0], 4);
+		memcpy(&block_len, &block[4], 4);
+
+		if (block_len < 12 || block_len % 4 != 0 || off + block_len > (size_t)file_len || memcmp(&block[block_len - 4], &block_len, 4) != 0)
+		{
+			fprintf(stderr, "Error: Malformed block at offset %zu\n", off);
+			ret = -EINVAL;
+			break;
+		}
+
+		// Only Enhanced Packet Blocks are inspected
+		if (val != 6)
+		{
+			continue;
+		}
+
+		memcpy(&cap_len, &block[20], 4);
+		memcpy(&orig_len, &block[24], 4);
+		pkt = &block[28];
+
+		// The IPv4 header checksum must verify
+		for (i = 0, sum = 0; i < 20; i += 2)
+		{
+			sum += ((uint32_t)pkt[i] << 8) | pkt[i + 1];
+		}
+		while (sum >> 16)
+		{
+			sum = (sum & 0xFFFF) + (sum >> 16);
+		}
+
+		if (pkt[0] != 0x45 || sum != 0xFFFF)
+		{
+			fprintf(stderr, "Error: Packet %d has an invalid IPv4 header\n", packets);
+			ret = -EINVAL;
+		}
+
+		switch (packets)
+		{
+		case 0:
+			// UDP data from the remote host, cut to the kept payload
+			if (pkt[9] != 17 || cap_len != 20 + 8 + 12 || orig_len != 20 + 8 + 100 || memcmp(&pkt[12], "\x0A\x00\x00\x01\xC0\x00\x02\x01", 8) != 0 || pkt[22] != 0x14 || pkt[23] != 0x4E || pkt[28] != 0x80)
+			{
+				fprintf(stderr, "Error: UDP data packet was not written as expected\n");
+				ret = -EINVAL;
+			}
+			break;
+		case 1:
+			// UDP control from the client
+			if (pkt[9] != 17 || memcmp(&pkt[12], "\xC0\x00\x02\x01\x0A\x00\x00\x01", 8) != 0 || pkt[22] != 0x14 || pkt[23] != 0x4F)
+			{
+				fprintf(stderr, "Error: UDP control packet was not written as expected\n");
+				ret = -EINVAL;
+			}
+			break;
+		case 2:
+			// SYN from the client
+			if (pkt[9] != 6 || cap_len != 40 || pkt[33] != 0x02)
+			{
+				fprintf(stderr, "Error: TCP_OPEN was not written as a SYN\n");
+				ret = -EINVAL;
+			}
+			break;
+		case 3:
+			// SYN-ACK from the remote host, acknowledging the SYN
+			if (pkt[9] != 6 || cap_len != 40 || pkt[33] != 0x12 || memcmp(&pkt[28], "\x00\x00\x00\x01", 4) != 0)
+			{
+				fprintf(stderr, "Error: TCP_STATUS was not written as a SYN-ACK\n");
+				ret = -EINVAL;
+			}
+			break;
+		case 4:
+			// Data from the client, following its SYN
+			if (pkt[9] != 6 || cap_len != 45 || orig_len != 45 || pkt[33] != 0x18 || memcmp(&pkt[24], "\x00\x00\x00\x01\x00\x00\x00\x01", 8) != 0)
+			{
+				fprintf(stderr, "Error: TCP_DATA was not written as expected\n");
+				ret = -EINVAL;
+			}
+			break;
+		case 5:
+			// FIN from the remote host, acknowledging the data
+			if (pkt[9] != 6 || pkt[33] != 0x11 || memcmp(&pkt[24], "\x00\x00\x00\x01\x00\x00\x00\x06", 8) != 0)
+			{
+				fprintf(stderr, "Error: TCP_CLOSE was not written as a FIN\n");
+				ret = -EINVAL;
+			}
+			break;
+		}
+
+		packets++;
+	}
+
+	if (ret == 0 && packets != 6)
+	{
+		fprintf(stderr, "Error: Expected 6 packets in the capture file but found %d\n", packets);
+		ret = -EINVAL;
+	}
+
+test_trace_dump_exit:
+	free(buff);
+	fclose(fp);
+	remove(TEST_TRACE_PATH);
+
+	return ret;
+}
+
+static int test_trace_ring(void)
+{
+	static struct trace_ring ring;
+	static struct trace_record recs[TRACE_RING_LEN];
+	uint8_t payload[TRACE_SNAP_MAX + 16];
+	size_t count;
+	uint64_t i;
+
+	memset(&ring, 0x0, sizeof(struct trace_ring));
+	memset(payload, 0xAB, sizeof(payload));
+
+	if (trace_read(&ring, recs, TRACE_RING_LEN) != 0)
+	{
+		fprintf(stderr, "Error: An empty ring is not empty\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < TRACE_RING_LEN + 44; i++)
+	{
+		trace_record(&ring, i, TRACE_DIR_TO_CLIENT, PROXY_MSG_TYPE_UDP_DATA, 0, (uint32_t)i, payload, (size_t)(i % sizeof(payload)), i % 2 ? SIZE_MAX : 8);
+	}
+
+	count = trace_read(&ring, recs, TRACE_RING_LEN);
+	if (count != TRACE_RING_LEN)
+	{
+		fprintf(stderr, "Error: Expected a full ring but read %zu packets\n", count);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (recs[i].stamp != i + 44)
+		{
+			fprintf(stderr, "Error: Packet %" PRIu64 " is out of order\n", i);
+			return -EINVAL;
+		}
+
+		if (recs[i].len != recs[i].stamp % sizeof(payload) || recs[i].snap_len > TRACE_SNAP_MAX || recs[i].snap_len > recs[i].len || (recs[i].stamp % 2 == 0 && recs[i].snap_len > 8))
+		{
+			fprintf(stderr, "Error: Packet %" PRIu64 " kept %u of %" PRIu32 " payload bytes\n", i, recs[i].snap_len, recs[i].len);
+			return -EINVAL;
+		}
+	}
+
+	// A short read returns the newest packets
+	count = trace_read(&ring, recs, 10);
+	if (count != 10 || recs[0].stamp != TRACE_RING_LEN + 34 || recs[9].stamp != TRACE_RING_LEN + 43)
+	{
+		fprintf(stderr, "Error: A short read did not return the newest packets\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void * worker(void *ctx)
+{
+	struct thread_handle *th = (struct thread_handle *)ctx;
+	const uint32_t id = *(const uint32_t *)th->func_ctx;
+	uint8_t payload[TRACE_SNAP_MAX];
+	uint32_t addr;
+	uint32_t i;
+
+	for (i = 0; i < TEST_TRACE_PER_WORKER; i++)
+	{
+		// Each packet can be checked against itself
+		addr = id * TEST_TRACE_PER_WORKER + i;
+		memset(payload, (uint8_t)addr, sizeof(payload));
+
+		trace_record(&shared_ring, ((uint64_t)id << 32) | addr, TRACE_DIR_FROM_CLIENT, PROXY_MSG_TYPE_UDP_DATA, 0, addr, payload, addr % 1000, TRACE_SNAP_MAX);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,372 @@
+/*!
+ * @file test_worker_pool.c
+ *
+ * @copyright
+ * Copyright &copy; 2020, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to pools of worker threads
+ */
+
+#include "mutex.h"
+#include "worker_pool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Maximum number of threads in the pool used by the growth test
+#define TEST_WORKER_POOL_MAX 4
+
+/*!
+ * @brief Context shared by the items submitted in a test
+ */
+struct test_worker_pool_ctx
+{
+	/// Protects the rest of the context
+	struct mutex_handle mutex;
+
+	/// Signaled whenever the context changes
+	struct condvar_handle condvar;
+
+	/// Number of items currently being worked on
+	unsigned int active;
+
+	/// Number of items which have been worked on to completion
+	unsigned int done;
+
+	/// Non-zero once items may complete
+	uint8_t released;
+};
+
+/*!
+ * @brief Main entry point for worker pool tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+/*!
+ * @brief Work function which blocks until the test releases it
+ *
+ * @param[in,out] wp Worker pool the item was submitted to
+ * @param[in] item Unused
+ */
+static void blocking_item(struct worker_pool_handle *wp, void *item);
+
+/*!
+ * @brief Test that the pool starts threads as they are needed, up to the
+ *        limit, and works on everything submitted before stopping
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the pool starts threads as they are needed, up to the
+ *       limit, and works on everything submitted before stopping
+ */
+static int test_worker_pool_growth(void);
+
+/*!
+ * @brief Test that invalid pool configurations are rejected
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that invalid pool configurations are rejected
+ */
+static int test_worker_pool_invalid(void);
+
+/*!
+ * @brief Test that the warm threads are started with the pool
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that the warm threads are started with the pool
+ */
+static int test_worker_pool_warm(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_worker_pool_growth();
+	ret |= test_worker_pool_invalid();
+	ret |= test_worker_pool_warm();
+
+	return ret;
+}
+
+static void blocking_item(struct worker_pool_handle *wp, void *item)
+{
+	struct test_worker_pool_ctx *tc = (struct test_worker_pool_ctx *)wp->func_ctx;
+
+	(void)item;
+
+	mutex_lock(&tc->mutex);
+
+	tc->active++;
+	condvar_wake_all(&tc->condvar);
+
+	while (!tc->released)
+	{
+		condvar_wait(&tc->condvar, &tc->mutex);
+	}
+
+	tc->active--;
+	tc->done++;
+
+	mutex_unlock(&tc->mutex);
+}
+
+static int test_worker_pool_growth(void)
+{
+	struct worker_pool_handle wp;
+	struct test_worker_pool_ctx tc;
+	unsigned int threads;
+	unsigned int active;
+	int waits;
+	int ret;
+	int i;
+
+	memset(&wp, 0x0, sizeof(struct worker_pool_handle));
+	memset(&tc, 0x0, sizeof(struct test_worker_pool_ctx));
+	wp.func_ptr = blocking_item;
+	wp.func_ctx = &tc;
+	wp.max_threads = TEST_WORKER_POOL_MAX;
+	wp.warm_threads = 1;
+
+	ret = mutex_init(&tc.mutex);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize mutex (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = condvar_init(&tc.condvar);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize condition variable (%d): %s\n", -ret, strerror(-ret));
+		mutex_free(&tc.mutex);
+		return ret;
+	}
+
+	ret = worker_pool_init(&wp);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize worker pool (%d): %s\n", -ret, strerror(-ret));
+		goto test_worker_pool_growth_exit;
+	}
+
+	ret = worker_pool_start(&wp);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to start worker pool (%d): %s\n", -ret, strerror(-ret));
+		goto test_worker_pool_growth_exit;
+	}
+
+	// Each item holds on to its thread, so all of them running at once
+	// means the pool grew to the limit
+	for (i = 0; i < TEST_WORKER_POOL_MAX; i++)
+	{
+		ret = worker_pool_submit(&wp, NULL);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to submit item #%d (%d): %s\n", i, -ret, strerror(-ret));
+			goto test_worker_pool_growth_exit;
+		}
+	}
+
+	mutex_lock(&tc.mutex);
+	for (waits = 0; tc.active < TEST_WORKER_POOL_MAX && waits < 50; waits++)
+	{
+		condvar_wait_time(&tc.condvar, &tc.mutex, 100);
+	}
+	active = tc.active;
+	mutex_unlock(&tc.mutex);
+
+	threads = worker_pool_threads(&wp);
+	if (active != TEST_WORKER_POOL_MAX || threads != TEST_WORKER_POOL_MAX)
+	{
+		fprintf(stderr, "Error: Expected %d items on %d threads, but %u were on %u\n", TEST_WORKER_POOL_MAX, TEST_WORKER_POOL_MAX, active, threads);
+		ret = -EINVAL;
+		goto test_worker_pool_growth_exit;
+	}
+
+	// Items wait for a thread until the queue is full
+	for (i = 0; i < TEST_WORKER_POOL_MAX; i++)
+	{
+		ret = worker_pool_submit(&wp, NULL);
+		if (ret < 0)
+		{
+			fprintf(stderr, "Error: Failed to queue item #%d (%d): %s\n", i, -ret, strerror(-ret));
+			goto test_worker_pool_growth_exit;
+		}
+	}
+
+	ret = worker_pool_submit(&wp, NULL);
+	if (ret != -ENOSPC)
+	{
+		fprintf(stderr, "Error: Item beyond the queue's capacity was not rejected (%d)\n", ret);
+		ret = -EINVAL;
+		goto test_worker_pool_growth_exit;
+	}
+
+	mutex_lock(&tc.mutex);
+	tc.released = 1;
+	condvar_wake_all(&tc.condvar);
+	mutex_unlock(&tc.mutex);
+
+	worker_pool_stop(&wp);
+
+	if (tc.done != 2 * TEST_WORKER_POOL_MAX)
+	{
+		fprintf(stderr, "Error: Only %u of %d items were worked on before stopping\n", tc.done, 2 * TEST_WORKER_POOL_MAX);
+		ret = -EINVAL;
+		goto test_worker_pool_growth_exit;
+	}
+
+	ret = worker_pool_submit(&wp, NULL);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Stopped pool accepted an item (%d)\n", ret);
+		ret = -EINVAL;
+		goto test_worker_pool_growth_exit;
+	}
+
+	ret = 0;
+
+test_worker_pool_growth_exit:
+	mutex_lock(&tc.mutex);
+	tc.released = 1;
+	condvar_wake_all(&tc.condvar);
+	mutex_unlock(&tc.mutex);
+
+	worker_pool_free(&wp);
+
+	condvar_free(&tc.condvar);
+	mutex_free(&tc.mutex);
+
+	return ret;
+}
+
+static int test_worker_pool_invalid(void)
+{
+	struct worker_pool_handle wp;
+	int ret;
+
+	memset(&wp, 0x0, sizeof(struct worker_pool_handle));
+	wp.func_ptr = blocking_item;
+
+	ret = worker_pool_init(&wp);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Worker pool without threads was not rejected (%d)\n", ret);
+		worker_pool_free(&wp);
+		return -EINVAL;
+	}
+
+	wp.max_threads = 2;
+	wp.warm_threads = 3;
+
+	ret = worker_pool_init(&wp);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Worker pool with more warm threads than allowed was not rejected (%d)\n", ret);
+		worker_pool_free(&wp);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_worker_pool_warm(void)
+{
+	struct worker_pool_handle wp;
+	unsigned int threads;
+	int ret;
+
+	memset(&wp, 0x0, sizeof(struct worker_pool_handle));
+	wp.func_ptr = blocking_item;
+	wp.max_threads = 8;
+	wp.warm_threads = 3;
+	wp.stack_size = 256 * 1024;
+
+	ret = worker_pool_init(&wp);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to initialize worker pool (%d): %s\n", -ret, strerror(-ret));
+		return ret;
+	}
+
+	ret = worker_pool_submit(&wp, NULL);
+	if (ret != -EINVAL)
+	{
+		fprintf(stderr, "Error: Pool which was not started accepted an item (%d)\n", ret);
+		ret = -EINVAL;
+		goto test_worker_pool_warm_exit;
+	}
+
+	ret = worker_pool_start(&wp);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error: Failed to start worker pool (%d): %s\n", -ret, strerror(-ret));
+		goto test_worker_pool_warm_exit;
+	}
+
+	threads = worker_pool_threads(&wp);
+	if (threads != 3)
+	{
+		fprintf(stderr, "Error: Expected 3 warm threads, but %u were started\n", threads);
+		ret = -EINVAL;
+		goto test_worker_pool_warm_exit;
+	}
+
+	worker_pool_stop(&wp);
+
+	threads = worker_pool_threads(&wp);
+	if (threads != 0)
+	{
+		fprintf(stderr, "Error: %u threads are still running after stopping\n", threads);
+		ret = -EINVAL;
+	}
+
+test_worker_pool_warm_exit:
+	worker_pool_free(&wp);
+
+	return ret;
+}